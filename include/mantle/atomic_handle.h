@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+#include <type_traits>
+#include "mantle/object.h"
+#include "mantle/handle.h"
+#include "mantle/operation.h"
+
+namespace mantle {
+
+    // A handle that can be loaded and replaced from any number of threads at once, which makes it a
+    // good fit for publishing read-mostly values like configuration snapshots or routing tables.
+    //
+    // A load is one atomic read followed by an increment in the reader's own ledger, so readers never
+    // write to shared memory and don't contend with each other. A value that is replaced is dropped
+    // like any other handle. Its decrement is only applied after a cycle, which no region can finish
+    // while it's in the middle of a load, so whatever a reader sees stays alive until its increment
+    // has been counted. This is the same reasoning that makes a `Borrow` safe.
+    //
+    // NOTE: Threads that load must run a region, like threads that copy handles.
+    //
+    template<typename T, typename Policy = DefaultReferencePolicy>
+    class AtomicHandle {
+        static_assert(std::is_base_of_v<Object, T>, "Object is a required base class");
+        static_assert(std::atomic<Operation>::is_always_lock_free);
+        static_assert(!Policy::SHARDED, "Sharded references can't be published");
+
+        AtomicHandle(AtomicHandle&&) = delete;
+        AtomicHandle(const AtomicHandle&) = delete;
+        AtomicHandle& operator=(AtomicHandle&&) = delete;
+        AtomicHandle& operator=(const AtomicHandle&) = delete;
+
+    public:
+        using HandleType = Handle<T, Policy>;
+
+        AtomicHandle() noexcept
+            : operation_(make_null_operation())
+        {
+        }
+
+        AtomicHandle(std::nullptr_t) noexcept
+            : AtomicHandle()
+        {
+        }
+
+        explicit AtomicHandle(HandleType handle) noexcept
+            : operation_(take_reference(handle))
+        {
+        }
+
+        // Drops the current value.
+        ~AtomicHandle() noexcept {
+            HandleType value(operation_.load(std::memory_order_acquire));
+        }
+
+        // Take a reference of our own to the current value.
+        [[nodiscard]] HandleType load() const noexcept {
+            const Operation operation = operation_.load(std::memory_order_acquire);
+            if (operation.type() != OperationType::DECREMENT) {
+                return HandleType(operation); // Null or immortal.
+            }
+
+            Object* object = operation.mutable_object();
+
+            object->start_increment_operation(make_increment_operation(object));
+            return HandleType(make_decrement_operation(object));
+        }
+
+        // Replace the current value, which is dropped.
+        void store(HandleType handle) noexcept {
+            (void)exchange(std::move(handle));
+        }
+
+        // Replace the current value and return it.
+        [[nodiscard]] HandleType exchange(HandleType handle) noexcept {
+            return HandleType(operation_.exchange(take_reference(handle), std::memory_order_acq_rel));
+        }
+
+    private:
+        // The handle's weight moves in along with the reference.
+        static Operation take_reference(HandleType& handle) noexcept {
+            return std::exchange(handle.operation_, make_null_operation());
+        }
+
+    private:
+        std::atomic<Operation> operation_;
+    };
+
+}
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <new>
+#include <bit>
+#include <span>
+#include <algorithm>
+#include <type_traits>
+#include <atomic>
+#include <vector>
+#include <optional>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+#include "mantle/util.h"
+#include "mantle/types.h"
+#include "mantle/config.h"
+#include "mantle/handle.h"
+#include "mantle/operation.h"
+#include "mantle/doorbell.h"
+#include "mantle/connection.h"
+#include "mantle/memory_mapping.h"
+
+namespace mantle {
+
+    // Wakes up the receiver of a channel through a doorbell, but only when it has gone back to its
+    // event loop. Senders that find it busy draining the channel skip the system call.
+    class ChannelSignal {
+        ChannelSignal(ChannelSignal&&) = delete;
+        ChannelSignal(const ChannelSignal&) = delete;
+        ChannelSignal& operator=(ChannelSignal&&) = delete;
+        ChannelSignal& operator=(const ChannelSignal&) = delete;
+
+    public:
+        ChannelSignal()
+            : armed_(true)
+        {
+        }
+
+        int file_descriptor() {
+            return doorbell_.file_descriptor();
+        }
+
+        // Senders call this after every value they send.
+        void notify() {
+            // Pairs with the fence in `arm`. Either the receiver sees the value when it checks one
+            // last time, or we see that it is armed and ring the doorbell.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (armed_.load(std::memory_order_relaxed) && armed_.exchange(false, std::memory_order_relaxed)) {
+                doorbell_.ring();
+            }
+        }
+
+        // The receiver calls this before draining the channel.
+        void disarm(const bool non_blocking) {
+            doorbell_.poll(non_blocking);
+            armed_.store(false, std::memory_order_relaxed);
+        }
+
+        // The receiver calls this once it has drained the channel, and must pass a check for values
+        // that arrived in the meantime. They may not have rung the doorbell, so we ring it for them.
+        template<typename HasValues>
+        void arm(HasValues&& has_values) {
+            armed_.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (has_values() && armed_.exchange(false, std::memory_order_relaxed)) {
+                doorbell_.ring();
+            }
+        }
+
+    private:
+        Doorbell                                  doorbell_;
+        alignas(CACHE_LINE_SIZE) std::atomic_bool armed_;
+    };
+
+    template<typename T>
+    class Channel;
+
+    template<typename T>
+    class MpscChannel;
+
+    // Passes handles from one thread to another. Handles are moved through the channel as they are,
+    // so a handoff never touches the ledger. This is a `Stream` of the handles' operations with
+    // a doorbell that can be polled from an event loop.
+    //
+    // NOTE: There can only be one sender and one receiver at a time. See `MpscChannel` for more senders.
+    //
+    template<typename T, typename Policy>
+    class Channel<Handle<T, Policy>> {
+        Channel(Channel&&) = delete;
+        Channel(const Channel&) = delete;
+        Channel& operator=(Channel&&) = delete;
+        Channel& operator=(const Channel&) = delete;
+
+    public:
+        using HandleType = Handle<T, Policy>;
+
+        // The ring is only ever read by the receiver, so it should live on the receiver's NUMA node.
+        explicit Channel(size_t minimum_capacity = CHANNEL_CAPACITY, std::optional<size_t> numa_node = std::nullopt)
+            : stream_(minimum_capacity, numa_node)
+        {
+        }
+
+        // Handles that were never received are dropped by whoever destroys the channel.
+        ~Channel() {
+            std::vector<HandleType> handles;
+            receive(handles, true);
+        }
+
+        size_t capacity() const {
+            return stream_.capacity();
+        }
+
+        // Becomes readable when there are handles to receive.
+        int file_descriptor() {
+            return signal_.file_descriptor();
+        }
+
+        // Returns false if the channel is full, in which case the handle is left as it was.
+        bool send(HandleType&& handle) {
+            if (!stream_.send(handle.operation_)) {
+                return false;
+            }
+
+            handle.operation_ = make_null_operation();
+            signal_.notify();
+            return true;
+        }
+
+        // Append the handles that have arrived. This blocks until the doorbell rings unless
+        // `non_blocking` is set, and can still come back empty-handed when it does.
+        size_t receive(std::vector<HandleType>& handles, const bool non_blocking) {
+            signal_.disarm(non_blocking);
+
+            const size_t count = handles.size();
+            while (stream_.has_messages()) {
+                const typename Stream::Window window = stream_.receive();
+                for (const std::span<const Operation> operations: { window.first, window.second }) {
+                    for (const Operation operation: operations) {
+                        handles.push_back(HandleType(operation));
+                    }
+                }
+                stream_.release();
+            }
+
+            signal_.arm([&] { return stream_.has_messages(); });
+            return handles.size() - count;
+        }
+
+    private:
+        using Stream = BasicStream<Operation>;
+
+        Stream        stream_;
+        ChannelSignal signal_;
+    };
+
+    // Like `Channel`, but any number of threads can send at the same time. Senders claim slots in
+    // the ring with a compare and swap, and mark them as written with a sequence number of their own.
+    template<typename T, typename Policy>
+    class MpscChannel<Handle<T, Policy>> {
+        MpscChannel(MpscChannel&&) = delete;
+        MpscChannel(const MpscChannel&) = delete;
+        MpscChannel& operator=(MpscChannel&&) = delete;
+        MpscChannel& operator=(const MpscChannel&) = delete;
+
+        struct Slot {
+            AtomicSequence sequence;
+            Operation      operation;
+        };
+
+    public:
+        using HandleType = Handle<T, Policy>;
+
+        explicit MpscChannel(size_t minimum_capacity = CHANNEL_CAPACITY, std::optional<size_t> numa_node = std::nullopt)
+            : ring_(std::bit_ceil(std::max<size_t>(minimum_capacity, 1)), MappedAllocator<Slot>(HugePagePolicy::NONE, numa_node))
+            , mask_(ring_.size() - 1)
+            , head_(0)
+            , tail_(0)
+        {
+            for (Sequence sequence = 0; sequence < ring_.size(); ++sequence) {
+                ring_[sequence].sequence.store(sequence, std::memory_order_relaxed);
+            }
+        }
+
+        // Handles that were never received are dropped by whoever destroys the channel.
+        ~MpscChannel() {
+            std::vector<HandleType> handles;
+            receive(handles, true);
+        }
+
+        size_t capacity() const {
+            return ring_.size();
+        }
+
+        // Becomes readable when there are handles to receive.
+        int file_descriptor() {
+            return signal_.file_descriptor();
+        }
+
+        // Returns false if the channel is full, in which case the handle is left as it was.
+        bool send(HandleType&& handle) {
+            Sequence tail = tail_.load(std::memory_order_relaxed);
+            Slot* slot;
+            while (true) {
+                slot = &ring_[tail & mask_];
+
+                // The slot is free for this lap once the receiver has moved its sequence up to ours.
+                const Sequence sequence = slot->sequence.load(std::memory_order_acquire);
+                const auto lag = static_cast<std::make_signed_t<Sequence>>(sequence - tail);
+                if (lag == 0) {
+                    if (tail_.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                }
+                else if (lag < 0) {
+                    return false; // Channel is full.
+                }
+                else {
+                    tail = tail_.load(std::memory_order_relaxed);
+                }
+            }
+
+            slot->operation = std::exchange(handle.operation_, make_null_operation());
+            slot->sequence.store(tail + 1, std::memory_order_release);
+
+            signal_.notify();
+            return true;
+        }
+
+        // Append the handles that have arrived. This blocks until the doorbell rings unless
+        // `non_blocking` is set, and can still come back empty-handed when it does.
+        //
+        // NOTE: A sender that has claimed a slot but not written it yet holds back the ones after it.
+        //
+        size_t receive(std::vector<HandleType>& handles, const bool non_blocking) {
+            signal_.disarm(non_blocking);
+
+            const size_t count = handles.size();
+            while (has_handles()) {
+                Slot& slot = ring_[head_ & mask_];
+                handles.push_back(HandleType(slot.operation));
+
+                // Hand the slot to whoever sends in it on the next lap.
+                slot.sequence.store(head_ + ring_.size(), std::memory_order_release);
+                head_ += 1;
+            }
+
+            signal_.arm([&] { return has_handles(); });
+            return handles.size() - count;
+        }
+
+    private:
+        // Only the receiver may call this.
+        bool has_handles() const {
+            return ring_[head_ & mask_].sequence.load(std::memory_order_acquire) == (head_ + 1);
+        }
+
+    private:
+        std::vector<Slot, MappedAllocator<Slot>> ring_;
+        size_t                                   mask_;
+
+        // Private to receive.
+        alignas(CACHE_LINE_SIZE) Sequence        head_;
+
+        alignas(CACHE_LINE_SIZE) AtomicSequence  tail_;
+        ChannelSignal                            signal_;
+    };
+
+}
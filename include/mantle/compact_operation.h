@@ -0,0 +1,117 @@
+#pragma once
+
+#include <array>
+#include <type_traits>
+#include <cstdint>
+#include <cstddef>
+#include <climits>
+#include <cassert>
+#include "mantle/util.h"
+#include "mantle/config.h"
+#include "mantle/operation.h"
+
+namespace mantle {
+
+    // Half an operation, which keeps the tag but stores the object as an offset from a base address,
+    // in units of the object alignment. Zero is a null operation, like it is for a full one.
+    //
+    // Objects outside the window of the base are escaped: the entry holds `ESCAPE` instead of an offset,
+    // and the next two entries hold the low and high half of the full operation.
+    //
+    struct CompactOperation {
+        static constexpr uint32_t OFFSET_SHIFT = Operation::TAG_BITS;
+        static constexpr uint32_t OFFSET_BITS  = (sizeof(uint32_t) * CHAR_BIT) - OFFSET_SHIFT;
+        static constexpr uint32_t ESCAPE       = (1u << OFFSET_BITS) - 1;
+
+        // The number of entries an escaped operation takes up.
+        static constexpr size_t ESCAPED_SIZE = 3;
+
+        [[nodiscard]]
+        bool is_escape() const noexcept {
+            return (bits >> OFFSET_SHIFT) == ESCAPE;
+        }
+
+        uint32_t bits;
+    };
+    static_assert(std::is_trivial_v<CompactOperation>, "CompactOperation must be a trivial type.");
+
+    // NOTE: `capacity == size` since it is always padded by null operations.
+    struct alignas(CACHE_LINE_SIZE) CompactOperationBatch {
+        using Entry = CompactOperation;
+
+        static constexpr size_t SIZE  = CACHE_LINE_SIZE / sizeof(CompactOperation);
+        static constexpr size_t SHIFT = log2_floor(SIZE);
+        static constexpr size_t MASK  = SIZE - 1;
+
+        CompactOperation operations[SIZE];
+    };
+    static_assert(sizeof(CompactOperationBatch) == sizeof(OperationBatch));
+
+    // Converts between full and compact operations around a base address, which is picked so the
+    // first object encoded lands in the middle of the window. It never moves after that, so entries
+    // stay readable for as long as the ledger that holds them.
+    class CompactOperationCodec {
+    public:
+        static constexpr uintptr_t WINDOW_SIZE = uintptr_t{1} << (CompactOperation::OFFSET_BITS + CompactOperation::OFFSET_SHIFT);
+
+        CompactOperationCodec()
+            : base_(0)
+            , has_base_(false)
+        {
+        }
+
+        // Returns false if the operation has to be escaped.
+        [[nodiscard]] MANTLE_HOT bool encode(const Operation operation, CompactOperation& entry) {
+            const uintptr_t pointer = operation.tagged_pointer_ & Operation::POINTER_MASK;
+            if (UNLIKELY(!has_base_)) {
+                base_ = (pointer > (WINDOW_SIZE / 2)) ? ((pointer - (WINDOW_SIZE / 2)) & Operation::POINTER_MASK) : 0;
+                has_base_ = true;
+            }
+
+            const uintptr_t offset = (pointer - base_) >> CompactOperation::OFFSET_SHIFT;
+
+            // Offsets wrap around below the base, and the smallest one would read as a null operation.
+            if (UNLIKELY((pointer <= base_) || (offset >= CompactOperation::ESCAPE))) {
+                return false;
+            }
+
+            entry.bits = static_cast<uint32_t>((offset << CompactOperation::OFFSET_SHIFT) | (operation.tagged_pointer_ & Operation::TAG_MASK));
+            return true;
+        }
+
+        // The entries an escaped operation is written as.
+        [[nodiscard]]
+        static std::array<CompactOperation, CompactOperation::ESCAPED_SIZE> escape(const Operation operation) {
+            return {{
+                { .bits = CompactOperation::ESCAPE << CompactOperation::OFFSET_SHIFT },
+                { .bits = static_cast<uint32_t>(operation.tagged_pointer_) },
+                { .bits = static_cast<uint32_t>(operation.tagged_pointer_ >> 32) },
+            }};
+        }
+
+        [[nodiscard]] MANTLE_HOT Operation decode(const CompactOperation entry) const {
+            assert(!entry.is_escape());
+
+            const uintptr_t offset = uintptr_t{entry.bits} & ~Operation::TAG_MASK;
+            const uintptr_t tag = uintptr_t{entry.bits} & Operation::TAG_MASK;
+
+            // Null entries have to decode to a null operation rather than the base.
+            const uintptr_t live = -static_cast<uintptr_t>(entry.bits != 0);
+            return {
+                .tagged_pointer_ = (base_ + offset + tag) & live,
+            };
+        }
+
+        [[nodiscard]]
+        static Operation unescape(const CompactOperation low, const CompactOperation high) {
+            return {
+                .tagged_pointer_ = uintptr_t{low.bits} | (uintptr_t{high.bits} << 32),
+            };
+        }
+
+    private:
+        uintptr_t base_;
+        bool      has_base_;
+    };
+
+}
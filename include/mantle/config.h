@@ -1,33 +1,271 @@
 #pragma once
 
 #include <span>
+#include <chrono>
 #include <optional>
 #include <cstddef>
+#include <sys/user.h>
+
+// The size of a cache line on the target. Most x86-64 and aarch64 parts, Graviton included, use
+// 64 bytes. Apple's aarch64 cores use 128, and so do POWER cores. Define this at build time, e.g.
+// through the `MANTLE_CACHE_LINE_SIZE` CMake option, for targets these defaults get wrong.
+#if !defined(MANTLE_CACHE_LINE_SIZE)
+#  if (defined(__aarch64__) && defined(__APPLE__)) || defined(__powerpc64__)
+#    define MANTLE_CACHE_LINE_SIZE 128
+#  else
+#    define MANTLE_CACHE_LINE_SIZE 64
+#  endif
+#endif
+
+// aarch64 kernels can be built with 4, 16 or 64 KiB pages, so glibc doesn't define this there.
+#if !defined(PAGE_SIZE)
+#  if defined(MANTLE_PAGE_SIZE)
+#    define PAGE_SIZE MANTLE_PAGE_SIZE
+#  else
+#    define PAGE_SIZE 4096ul
+#  endif
+#endif
 
 // TODO: Use macros for the global variables instead of global variables.
 
 namespace mantle {
 
-    // This flag enables weighted reference counting in handles.
+    // This flag makes weighted reference counting the default policy for handles.
     constexpr bool ENABLE_WEIGHTED_REFERENCE_COUNTING = false;
     constexpr bool ENABLE_OBJECT_GROUPING = true;
 
+    // Phase transitions, messages and other cycle events are recorded in a per-thread ring
+    // that can be exported with `write_chrome_trace`.
+    constexpr bool ENABLE_TRACE = true;
+    constexpr size_t TRACE_RING_CAPACITY = 16 * 1024;
+
     // The number of messages that can be queued between `Domain` and `Region` endpoints.
     constexpr size_t STREAM_CAPACITY = 4096;
 
-    // FIXME: Some architectures have cache lines that are 128 bytes. We should detect this.
-    constexpr size_t CACHE_LINE_SIZE = 64;
+    // The number of handles that can be queued in a `Channel` by default.
+    constexpr size_t CHANNEL_CAPACITY = 4096;
+
+    // Hot shared state is padded to this, and operation batches are one line each.
+    constexpr size_t CACHE_LINE_SIZE = MANTLE_CACHE_LINE_SIZE;
+    static_assert((CACHE_LINE_SIZE >= 32) && !(CACHE_LINE_SIZE & (CACHE_LINE_SIZE - 1)), "Cache lines must be a power of two of at least 32 bytes");
+
+    // Only the default huge page size is used. This is 2 MiB on x86-64 and on aarch64 with 4 KiB pages.
+    constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
 
     constexpr size_t WRITE_BARRIER_CAPACITY = 128 * 1024;
 
+    // Idle write barrier segments are kept resident between these watermarks. Below the low one the pool
+    // is refilled ahead of demand, and above the high one the excess memory is handed back to the OS.
+    constexpr size_t WRITE_BARRIER_POOL_LOW_WATERMARK  = 4;
+    constexpr size_t WRITE_BARRIER_POOL_HIGH_WATERMARK = 16;
+
+    // Ledger pages are committed as the writer first touches them. Once a region has stayed below this
+    // fraction of its ledger capacity for a number of cycles, the pages it isn't using are decommitted.
+    constexpr double LEDGER_DECOMMIT_FILL   = 0.125;
+    constexpr size_t LEDGER_DECOMMIT_CYCLES = 16;
+
+    // How many objects ahead of the one being updated the apply loops prefetch by default.
+    // This should roughly cover memory latency divided by the cost of applying one operation.
+    constexpr size_t APPLY_PREFETCH_DISTANCE = 8;
+
+    // The largest batch of objects handed to a finalizer at once when finalization is time-budgeted.
+    // The deadline is only checked between batches.
+    constexpr size_t FINALIZATION_BATCH_SIZE = 256;
+
+    // The number of operation groups in each controller's grouper by default.
+    constexpr size_t OPERATION_GROUPER_CACHE_SIZE = 512;
+
+    enum class HugePagePolicy {
+        NONE,        // Regular pages.
+        TRANSPARENT, // Huge page aligned and advised with MADV_HUGEPAGE, if THP is set to madvise or always.
+        EXPLICIT,    // Reserved hugetlb pages, falling back to TRANSPARENT when none are available.
+    };
+
+    // How operations are stored in a region's ledger.
+    enum class LedgerEncoding {
+        FULL,    // Every operation is a full tagged pointer.
+        COMPACT, // Operations take half the space as offsets from a base, and objects far from it take one and a half times.
+    };
+
+    enum class WakeupPolicy {
+        EVENTFD, // Every message rings an eventfd, so the receiver can wait on a file descriptor.
+        FUTEX,   // Messages only wake the receiver when it is blocked, through a futex. There's no file descriptor.
+    };
+
+    enum class LedgerBackend {
+        OPERATION_LEDGER, // Only handles record operations, in each region's operation ledger.
+        WRITE_BARRIER,    // Refs also record operations, with a plain store into guard-paged segments.
+    };
+
+    // How the operation grouper makes room for new groups, and which groups it keeps across cycles.
+    enum class GrouperEvictionPolicy {
+        SMALLEST_DELTA, // Replace the group with the smallest net delta. Groups that keep getting hit outlive a cycle.
+        FEWEST_HITS,    // Replace the group that has been hit the least. Groups that keep getting hit outlive a cycle.
+        EVERY_CYCLE,    // Replace the group with the smallest net delta, and flush every group at the end of a cycle.
+    };
+
+    // How the operation grouper combines operations on the same object.
+    enum class GrouperEngine {
+        CACHE, // Groups operations in a set-associative cache. Objects that don't fit aren't combined.
+        RADIX, // Radix sorts each cycle's operations by object, so every duplicate is merged and applied in address order.
+    };
+
+    class LedgerRecorder;
+
     struct Config {
+        // Run the domain thread and its workers on these CPUs. An empty list is rejected rather than
+        // leaving the threads unpinned.
         std::optional<std::span<size_t>> domain_cpu_affinity;
 
+        // Run the domain thread and its workers on the CPUs of this NUMA node. `domain_cpu_affinity` takes
+        // precedence when both are set. Nodes without any CPUs are rejected.
+        std::optional<size_t> domain_numa_node;
+
+        // Pin the domain thread and its workers to CPUs that share a cache with the most region threads,
+        // as read from sysfs. Region threads get matching CPUs from `Domain::placement`. The two options
+        // above take precedence when either is set.
+        bool topology_placement = false;
+
+        // Bind memory to the NUMA node of the thread that mostly uses it, instead of wherever it is first
+        // touched. Ledgers and region-bound streams go to the region thread's node, and domain-bound streams
+        // to the domain's node. Controllers are only touched by the domain thread and its workers, so they
+        // follow `domain_numa_node`.
+        bool numa_placement = false;
+
+        // Handles always record their operations in the operation ledger. With `WRITE_BARRIER`, regions
+        // also set up a write barrier ledger that `Ref`s record into, and the domain runs a thread to
+        // swap in fresh segments when a write runs into a guard page. This needs userfaultfd, so
+        // constructing the domain throws where it isn't available.
+        LedgerBackend ledger_backend = LedgerBackend::OPERATION_LEDGER;
+
+        // How many idle write barrier segments the domain keeps resident. See `WRITE_BARRIER_POOL_LOW_WATERMARK`.
+        size_t write_barrier_pool_low_watermark  = WRITE_BARRIER_POOL_LOW_WATERMARK;
+        size_t write_barrier_pool_high_watermark = WRITE_BARRIER_POOL_HIGH_WATERMARK;
+
+        // Keep reference counts in a dense table per region instead of in the objects, so that applying
+        // operations doesn't dirty the cache lines of live objects. Each region can have at most
+        // `reference_count_table_capacity` live objects. The table's pages are only populated as needed.
+        bool   reference_count_table          = false;
+        size_t reference_count_table_capacity = 16 * 1024 * 1024;
+
         // The maximum number of pending operations per-region.
         size_t ledger_capacity = 1024 * 1024;
 
+        // How long a region has to stay below `ledger_decommit_fill` before it gives back the pages of
+        // its ledger it isn't using. Zero keeps every page that was ever written.
+        double ledger_decommit_fill   = LEDGER_DECOMMIT_FILL;
+        size_t ledger_decommit_cycles = LEDGER_DECOMMIT_CYCLES;
+
+        // When the ledger is full, operations spill into per-transaction overflow buffers that grow
+        // as needed, instead of stalling the writing thread until the domain has caught up.
+        bool ledger_overflow = false;
+
+        // Operations from threads without a region go to a process-wide fallback ledger, which this
+        // domain's regions drain into their own transactions, instead of being leaked. Only one domain
+        // per process can enable this. See `DomainMetrics::fallback_operation_count`.
+        bool fallback_ledger = false;
+
+        // Fold operations on the same object together on the region thread before they reach the ledger,
+        // in a direct-mapped cache of this many objects. Only the net deltas of a transaction are written,
+        // so handles that are copied and dropped again cost no ledger bandwidth. Zero disables this.
+        size_t region_combining_cache_size = 0;
+
+        // Apply operations on objects bound to the writing region on the region thread, instead of
+        // sending them through the domain. Only operations on other regions' objects are submitted, so
+        // mostly local workloads hardly load the domain. This is ignored with `reference_count_table`.
+        bool local_operations = false;
+
+        // Back ledger storage with huge pages. The domain reads every region's ledger each cycle, so a
+        // large `ledger_capacity` spends much of that time in TLB misses with regular pages.
+        HugePagePolicy ledger_huge_pages = HugePagePolicy::NONE;
+
+        // Write half-size operations to the ledger, which halves the memory traffic of writing them on
+        // the region and reading them on the domain. Objects more than a couple of GiB from the first one
+        // a region writes are stored in full and take up three entries. `ledger_capacity` counts entries.
+        LedgerEncoding ledger_encoding = LedgerEncoding::FULL;
+
+        // When non-zero, the domain checks region streams in a busy loop for this long before blocking,
+        // and regions skip the doorbell while it is. This takes syscalls out of busy cycles at the
+        // cost of keeping the domain thread's core busy, so pair it with `domain_cpu_affinity`.
+        std::chrono::nanoseconds domain_spin_duration = std::chrono::nanoseconds::zero();
+
+        // Don't give the domain a thread of its own. Whoever created it drives it with `Domain::step`
+        // instead, e.g. from an event loop watching `Domain::file_descriptor`. Regions on that thread
+        // step the domain themselves whenever they would block, so they can still be created and
+        // stopped there. The domain's CPU affinity isn't applied, since the thread isn't its own.
+        bool domain_embedded = false;
+
+        // How the domain wakes up regions blocked in `Region::step`. With futexes the sender skips the
+        // system call unless the region is actually asleep, so a busy cycle costs no syscalls on either
+        // side. `Region::file_descriptor` never becomes readable then, so keep eventfds for event loops.
+        WakeupPolicy region_wakeups = WakeupPolicy::EVENTFD;
+
+        // The number of helper threads the domain uses to route and apply operations in parallel.
+        // Zero keeps all of this work on the domain thread.
+        size_t domain_worker_count = 0;
+
+        // The domain splits its controllers into clusters of this many consecutive regions, e.g. one per
+        // L3 cache, and keeps a census for each. Barrier state is combined from the clusters, and clusters
+        // with nothing to send or synchronize are skipped as a whole. With `domain_worker_count`, each
+        // cluster also delivers, synchronizes and sends for its own regions on the workers, leaving the
+        // domain thread with only the combined census to act on. Zero keeps a single cluster.
+        size_t domain_cluster_size = 0;
+
+        // How many objects ahead the reference count apply loops prefetch. Zero disables prefetching.
+        size_t apply_prefetch_distance = APPLY_PREFETCH_DISTANCE;
+
+        // Regions sort operations by owning region when they commit a transaction, so the domain
+        // can route them without reading every object.
+        bool partition_operations = false;
+
+        // Overlap each cycle's routing with applying the operations routed in the cycle before, so a
+        // cycle only has one barrier to wait on after submitting. Operations take an extra cycle to be
+        // applied, but cycles are shorter and routing and applying share one pass over the workers.
+        bool pipeline_cycles = false;
+
         // This enables the grouper which tries to consolidate operations on the same object.
         // and net their effects to reduce the number of operations that need to be retired/applied.
         bool operation_grouper_enabled = true;
+
+        // The number of operation groups each controller keeps, rounded up to a power of two. If the maximum
+        // is larger, the cache doubles at a cycle boundary when groups were evicted before they could combine,
+        // and halves back towards `operation_grouper_cache_size` once it has been mostly empty for a while.
+        size_t                operation_grouper_cache_size     = OPERATION_GROUPER_CACHE_SIZE;
+        size_t                operation_grouper_cache_size_max = OPERATION_GROUPER_CACHE_SIZE;
+        GrouperEvictionPolicy operation_grouper_eviction       = GrouperEvictionPolicy::SMALLEST_DELTA;
+        GrouperEngine         operation_grouper_engine         = GrouperEngine::CACHE;
+
+        // Bounds how much finalization a single `Region::step` call will do. Garbage that
+        // doesn't fit in the budget is carried over to the next step, and the region's file
+        // descriptor stays readable until it has been dealt with. Zero means unbounded.
+        size_t                   finalization_budget_objects = 0;
+        std::chrono::nanoseconds finalization_budget_time    = std::chrono::nanoseconds::zero();
+
+        // Regions ask for a cycle whenever they have pending operations. The domain holds a request
+        // until `cycle_interval_min` has passed since the previous cycle started, so busy regions get
+        // fewer, larger cycles. A region whose ledger is at least `cycle_urgent_fill` full is not held.
+        std::chrono::nanoseconds cycle_interval_min = std::chrono::nanoseconds::zero();
+        double                   cycle_urgent_fill  = 0.5;
+
+        // Operations stay in flight for a few cycles after they are submitted. If no region asks for
+        // a cycle within `cycle_interval_max` the domain starts one itself, so memory is reclaimed
+        // promptly once the application goes idle. Zero disables this.
+        std::chrono::nanoseconds cycle_interval_max = std::chrono::nanoseconds::zero();
+
+        // Objects can be bound with a rough byte cost. Once the objects a region dropped in cycles that
+        // haven't been applied yet add up to `cycle_pressure_bytes`, its cycles aren't held back either.
+        // The domain does the same while the resident set of the process is above `cycle_pressure_rss`
+        // bytes. Zero disables either.
+        size_t                   cycle_pressure_bytes = 0;
+        size_t                   cycle_pressure_rss   = 0;
+
+        // Record every operation the domain routes, with the cycles they were routed in, so the workload
+        // can be replayed offline with `LedgerReplay`. The recorder has to outlive the domain.
+        LedgerRecorder* ledger_recorder = nullptr;
+
+        // Take a census of live objects by group every `heap_census_interval` cycles, which is published
+        // with the domain's metrics. Counting live objects costs a little at every bind and death, and a
+        // sampled cycle also looks at every object it applied operations to. Zero disables it.
+        size_t heap_census_interval = 0;
     };
 }
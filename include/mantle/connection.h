@@ -3,8 +3,12 @@
 #include <new>
 #include <span>
 #include <array>
+#include <atomic>
 #include <vector>
 #include <mutex>
+#include <optional>
+#include <utility>
+#include <algorithm>
 #include <type_traits>
 #include <cstdint>
 #include <cstddef>
@@ -16,22 +20,41 @@
 #include "mantle/config.h"
 #include "mantle/message.h"
 #include "mantle/doorbell.h"
+#include "mantle/memory_mapping.h"
 
 namespace mantle {
 
-    class Stream {
-        Stream(Stream&&) = delete;
-        Stream(const Stream&) = delete;
-        Stream& operator=(Stream&&) = delete;
-        Stream& operator=(const Stream&) = delete;
+    // A single producer, single consumer ring of trivially copyable values. Regions and the domain
+    // exchange `Message`s over these, and channels use them to pass handles around.
+    template<typename T>
+    class BasicStream {
+        static_assert(std::is_trivially_copyable_v<T>);
+
+        BasicStream(BasicStream&&) = delete;
+        BasicStream(const BasicStream&) = delete;
+        BasicStream& operator=(BasicStream&&) = delete;
+        BasicStream& operator=(const BasicStream&) = delete;
 
     public:
-        Stream(size_t minimum_capacity = STREAM_CAPACITY)
-            : mask_()
+        using Value = T;
+
+        // Values that have been received but not released yet. They are read in place,
+        // so there are two spans when they wrap around the end of the ring.
+        struct Window {
+            std::span<const T> first;
+            std::span<const T> second;
+        };
+
+        // The ring is only ever read by the receiver, so it should live on the receiver's NUMA node.
+        explicit BasicStream(size_t minimum_capacity = STREAM_CAPACITY, std::optional<size_t> numa_node = std::nullopt)
+            : ring_(MappedAllocator<T>(HugePagePolicy::NONE, numa_node))
+            , mask_()
             , head_(0)
             , tail_(0)
             , private_head_(0)
+            , private_window_count_(0)
             , private_tail_(0)
+            , private_cached_head_(0)
         {
             size_t capacity = 1;
             while (capacity < minimum_capacity) {
@@ -46,49 +69,172 @@ namespace mantle {
             return ring_.size();
         }
 
-        bool send(const Message& message) {
-            uint64_t head = head_.load(std::memory_order_acquire);
-            if ((private_tail_ - head) == ring_.size()) {
-                return false; // Stream is full.
+        bool send(const T& value) {
+            // Only look at where the receiver is when we appear to be full. The receiver has
+            // probably moved on since we last checked.
+            if ((private_tail_ - private_cached_head_) == ring_.size()) {
+                private_cached_head_ = head_.load(std::memory_order_acquire);
+                if ((private_tail_ - private_cached_head_) == ring_.size()) {
+                    return false; // Stream is full.
+                }
             }
 
-            Slot& slot = ring_[private_tail_ & mask_];
-            slot.message = message;
+            ring_[private_tail_ & mask_] = value;
 
             private_tail_ += 1;
             tail_.store(private_tail_, std::memory_order_release);
             return true;
         }
 
-        size_t receive(std::vector<Message>& messages) {
-            Sequence tail = tail_.load(std::memory_order_acquire);
-            size_t count = tail - private_head_;
+        // Returns true if there are values that haven't been received yet. Only the receiver may call this.
+        [[nodiscard]]
+        bool has_messages() const {
+            return tail_.load(std::memory_order_acquire) != private_head_;
+        }
+
+        // Returns the values that arrived since the last call. They stay valid until `release`
+        // has been called once for each `receive`, which is when the sender can reuse their slots.
+        Window receive() {
+            const Sequence tail = tail_.load(std::memory_order_acquire);
+            const size_t count = tail - private_head_;
             assert(count <= ring_.size());
 
-            for (size_t i = 0; i < count; ++i) {
-                messages.push_back(
-                    ring_[(private_head_ + i) & mask_].message
-                );
-            }
+            const size_t offset = private_head_ & mask_;
+            const size_t first_count = std::min(count, ring_.size() - offset);
+
+            private_head_ = tail;
+            private_window_count_ += 1;
 
-            private_head_ += count;
-            head_.store(private_head_, std::memory_order_release);
-            return count;
+            return {
+                .first  = { ring_.data() + offset, first_count },
+                .second = { ring_.data(), count - first_count },
+            };
         }
 
-    private:
-        struct alignas(CACHE_LINE_SIZE) Slot {
-            Message message;
-        };
+        // Windows can be nested, so the slots are only handed back once the outermost one is released.
+        void release() {
+            assert(private_window_count_ > 0);
 
-        std::vector<Slot> ring_;
-        size_t            mask_;
+            if (--private_window_count_ == 0) {
+                head_.store(private_head_, std::memory_order_release);
+            }
+        }
+
+    private:
+        std::vector<T, MappedAllocator<T>> ring_;
+        size_t                             mask_;
 
         alignas(CACHE_LINE_SIZE) AtomicSequence head_;
         alignas(CACHE_LINE_SIZE) AtomicSequence tail_;
 
-        alignas(CACHE_LINE_SIZE) Sequence private_head_; // Private to receive.
-        alignas(CACHE_LINE_SIZE) Sequence private_tail_; // Private to send.
+        // Private to receive.
+        alignas(CACHE_LINE_SIZE) Sequence private_head_;
+        size_t                            private_window_count_;
+
+        // Private to send.
+        alignas(CACHE_LINE_SIZE) Sequence private_tail_;
+        Sequence                          private_cached_head_;
+    };
+
+    using Stream = BasicStream<Message>;
+
+    // Received messages, read in place from the stream. The slots are released when this is destroyed.
+    class MessageBatch {
+    public:
+        class Iterator {
+        public:
+            Iterator(const MessageBatch& batch, size_t index)
+                : batch_(&batch)
+                , index_(index)
+            {
+            }
+
+            const Message& operator*() const {
+                return (*batch_)[index_];
+            }
+
+            Iterator& operator++() {
+                index_ += 1;
+                return *this;
+            }
+
+            bool operator==(const Iterator& other) const {
+                return index_ == other.index_;
+            }
+
+        private:
+            const MessageBatch* batch_;
+            size_t              index_;
+        };
+
+        MessageBatch()
+            : stream_(nullptr)
+            , window_()
+        {
+        }
+
+        MessageBatch(Stream& stream, Stream::Window window)
+            : stream_(&stream)
+            , window_(window)
+        {
+        }
+
+        MessageBatch(MessageBatch&& other)
+            : stream_(std::exchange(other.stream_, nullptr))
+            , window_(std::exchange(other.window_, {}))
+        {
+        }
+
+        MessageBatch& operator=(MessageBatch&& other) {
+            if (this != &other) {
+                reset();
+                stream_ = std::exchange(other.stream_, nullptr);
+                window_ = std::exchange(other.window_, {});
+            }
+
+            return *this;
+        }
+
+        MessageBatch(const MessageBatch&) = delete;
+        MessageBatch& operator=(const MessageBatch&) = delete;
+
+        ~MessageBatch() {
+            reset();
+        }
+
+        [[nodiscard]]
+        size_t size() const {
+            return window_.first.size() + window_.second.size();
+        }
+
+        [[nodiscard]]
+        bool empty() const {
+            return size() == 0;
+        }
+
+        const Message& operator[](size_t index) const {
+            const size_t first_count = window_.first.size();
+            return (index < first_count) ? window_.first[index] : window_.second[index - first_count];
+        }
+
+        Iterator begin() const {
+            return { *this, 0 };
+        }
+
+        Iterator end() const {
+            return { *this, size() };
+        }
+
+        void reset() {
+            if (stream_) {
+                std::exchange(stream_, nullptr)->release();
+                window_ = {};
+            }
+        }
+
+    private:
+        Stream*        stream_;
+        Stream::Window window_;
     };
 
     class Endpoint {
@@ -98,12 +244,20 @@ namespace mantle {
         Endpoint& operator=(const Endpoint&) = delete;
 
     public:
-        explicit Endpoint(Endpoint& remote_endpoint)
+        // The NUMA node is where messages sent to this endpoint are kept. The wakeup policy is how
+        // senders wake up this endpoint when it is blocked waiting for messages.
+        explicit Endpoint(Endpoint& remote_endpoint, std::optional<size_t> numa_node = std::nullopt, WakeupPolicy wakeups = WakeupPolicy::EVENTFD)
             : remote_endpoint_(remote_endpoint)
+            , stream_(STREAM_CAPACITY, numa_node)
+            , wakeups_(wakeups)
+            , spinning_(false)
+            , rung_(false)
+            , sleeping_(0)
+            , notified_(false)
         {
-            temp_messages_.reserve(stream_.capacity());
         }
 
+        // Only becomes readable with `WakeupPolicy::EVENTFD`.
         int file_descriptor() {
             return doorbell_.file_descriptor();
         }
@@ -112,41 +266,124 @@ namespace mantle {
             return stream_;
         }
 
+        // Ring our own doorbell so that the file descriptor stays readable, and the next
+        // blocking receive doesn't block.
+        void notify() {
+            if (wakeups_ == WakeupPolicy::FUTEX) {
+                notified_ = true;
+            }
+            else {
+                doorbell_.ring();
+                rung_.store(true, std::memory_order_relaxed);
+            }
+        }
+
         bool send_message(const Message& message) {
             if (!remote_endpoint_.stream_.send(message)) {
                 return false;
             }
 
-            remote_endpoint_.doorbell_.ring();
+            // Pairs with the fence in `set_spinning`. Either the receiver sees the message when it
+            // checks one last time, or we see that it has stopped spinning and ring the doorbell.
+            // Futexes work the same way with the flag the receiver raises before it goes to sleep.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (remote_endpoint_.wakeups_ == WakeupPolicy::FUTEX) {
+                if (remote_endpoint_.sleeping_.load(std::memory_order_relaxed) && remote_endpoint_.sleeping_.exchange(0, std::memory_order_relaxed)) {
+                    futex_wake(remote_endpoint_.sleeping_);
+                }
+            }
+            else if (!remote_endpoint_.spinning_.load(std::memory_order_relaxed)) {
+                // The flag is raised after ringing, so seeing it down means the ring has been read
+                // or is about to be followed by the flag, and the doorbell can be left alone.
+                remote_endpoint_.doorbell_.ring();
+                remote_endpoint_.rung_.store(true, std::memory_order_relaxed);
+            }
+
             return true;
         }
 
-        std::span<const Message> receive_messages(bool non_blocking) {
-            doorbell_.poll(non_blocking);
+        // While spinning, the receiver promises to check the stream without being woken up. It must
+        // check once more after it stops, since senders may not have rung the doorbell.
+        void set_spinning(bool spinning) {
+            spinning_.store(spinning, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+
+        [[nodiscard]]
+        bool has_messages() const {
+            return stream_.has_messages();
+        }
 
-            temp_messages_.clear();
-            size_t count = stream_.receive(temp_messages_);
-            assert(count == temp_messages_.size());
+        // Returns true if a receive could find anything, or has a doorbell ring to clear. This
+        // doesn't make a system call, so receivers can check it before every receive.
+        [[nodiscard]]
+        bool has_pending() const {
+            return stream_.has_messages() || notified_ || rung_.load(std::memory_order_relaxed);
+        }
 
-            return {
-                temp_messages_.data(),
-                temp_messages_.size(),
-            };
+        // NOTE: The sender can't reuse the slots of these messages until the batch is destroyed,
+        //       so don't hold on to it for longer than it takes to handle them.
+        MessageBatch receive_messages(bool non_blocking) {
+            if (wakeups_ == WakeupPolicy::FUTEX) {
+                wait_for_messages(non_blocking);
+            }
+            else {
+                rung_.store(false, std::memory_order_relaxed);
+                doorbell_.poll(non_blocking);
+            }
+
+            return { stream_, stream_.receive() };
+        }
+
+        // Like the above, but leaves the doorbell alone. This is for receivers that are spinning.
+        MessageBatch receive_pending_messages() {
+            return { stream_, stream_.receive() };
         }
 
     private:
-        Endpoint&            remote_endpoint_;
-        Doorbell             doorbell_;
-        Stream               stream_;
-        std::vector<Message> temp_messages_;
+        // Like polling the doorbell. A notification lets one receive through, and so does a message.
+        void wait_for_messages(const bool non_blocking) {
+            if (std::exchange(notified_, false) || non_blocking) {
+                return;
+            }
+
+            while (!stream_.has_messages()) {
+                sleeping_.store(1, std::memory_order_relaxed);
+
+                // Pairs with the fence in `send_message`. Either we see the message, or the sender
+                // sees that we're sleeping and wakes us up.
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (!stream_.has_messages()) {
+                    futex_wait(sleeping_, 1);
+                }
+
+                sleeping_.store(0, std::memory_order_relaxed);
+            }
+        }
+
+    private:
+        Endpoint&                                     remote_endpoint_;
+        Doorbell                                      doorbell_;
+        Stream                                        stream_;
+        WakeupPolicy                                  wakeups_;
+        alignas(CACHE_LINE_SIZE) std::atomic_bool     spinning_;
+        alignas(CACHE_LINE_SIZE) std::atomic_bool     rung_; // Raised by whoever rings the doorbell.
+        alignas(CACHE_LINE_SIZE) std::atomic_uint32_t sleeping_;
+        bool                                          notified_; // Private to the receiver.
     };
 
     // A pair of endpoints linked with bidirectional message streams.
     class Connection {
     public:
-        Connection()
-            : client_endpoint_(server_endpoint_)
-            , server_endpoint_(client_endpoint_)
+        // NOTE: The endpoints refer to each other, so one of them has to be bound before it
+        //       is constructed. Going through the accessor keeps GCC from flagging this.
+        explicit Connection(
+            std::optional<size_t> client_numa_node = std::nullopt,
+            std::optional<size_t> server_numa_node = std::nullopt,
+            WakeupPolicy          client_wakeups   = WakeupPolicy::EVENTFD
+        )
+            : client_endpoint_(server_endpoint(), client_numa_node, client_wakeups)
+            , server_endpoint_(client_endpoint(), server_numa_node)
         {
         }
 
@@ -154,10 +391,18 @@ namespace mantle {
             return client_endpoint_;
         }
 
+        const Endpoint& client_endpoint() const {
+            return client_endpoint_;
+        }
+
         Endpoint& server_endpoint() {
             return server_endpoint_;
         }
 
+        const Endpoint& server_endpoint() const {
+            return server_endpoint_;
+        }
+
     private:
         Endpoint client_endpoint_;
         Endpoint server_endpoint_;
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <optional>
+#include "mantle/config.h"
+
+namespace mantle {
+
+    // Decides when the domain lets a coherence cycle start.
+    class CycleScheduler {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        explicit CycleScheduler(const Config& config)
+            : interval_min_(config.cycle_interval_min)
+            , interval_max_(config.cycle_interval_max)
+            , last_start_(Clock::time_point::min())
+        {
+        }
+
+        // Returns true if a cycle that was asked for can start now.
+        [[nodiscard]]
+        bool may_start(const Clock::time_point now, const bool urgent) const {
+            return urgent || elapsed(now) >= interval_min_;
+        }
+
+        // Returns true if it has been long enough that the domain should start a cycle by itself.
+        [[nodiscard]]
+        bool is_overdue(const Clock::time_point now) const {
+            return (interval_max_ > std::chrono::nanoseconds::zero()) && (elapsed(now) >= interval_max_);
+        }
+
+        void start(const Clock::time_point now) {
+            last_start_ = now;
+        }
+
+        // How long the domain can sleep before one of the above changes its answer.
+        [[nodiscard]]
+        std::optional<std::chrono::nanoseconds> timeout(const Clock::time_point now, const bool holding, const bool pending) const {
+            if (holding) {
+                return interval_min_ - elapsed(now);
+            }
+
+            if (pending && (interval_max_ > std::chrono::nanoseconds::zero())) {
+                return interval_max_ - elapsed(now);
+            }
+
+            return std::nullopt;
+        }
+
+    private:
+        [[nodiscard]]
+        std::chrono::nanoseconds elapsed(const Clock::time_point now) const {
+            if (last_start_ == Clock::time_point::min()) {
+                return std::chrono::nanoseconds::max();
+            }
+
+            return now - last_start_;
+        }
+
+    private:
+        std::chrono::nanoseconds interval_min_;
+        std::chrono::nanoseconds interval_max_;
+        Clock::time_point        last_start_;
+    };
+
+}
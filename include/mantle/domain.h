@@ -1,23 +1,78 @@
 #pragma once
 
+#include <span>
+#include <array>
+#include <atomic>
 #include <mutex>
+#include <memory>
 #include <thread>
 #include <vector>
+#include <chrono>
+#include <utility>
+#include <optional>
 #include "mantle/types.h"
 #include "mantle/config.h"
 #include "mantle/doorbell.h"
 #include "mantle/selector.h"
 #include "mantle/region.h"
 #include "mantle/region_controller.h"
+#include "mantle/fallback_ledger.h"
+#include "mantle/topology.h"
+#include "mantle/reference_count_table.h"
+#include "mantle/worker_pool.h"
+#include "mantle/cycle_scheduler.h"
+#include "mantle/heap_census.h"
 
 namespace mantle {
 
     class Region;
 
+    // A copy of one region's metrics, taken by the domain between cycles.
+    struct RegionMetricsSnapshot {
+        RegionId              region_id = INVALID_REGION_ID;
+        RegionControllerState state     = RegionControllerState::STARTING;
+
+        size_t                                                              cycle_count = 0;
+        std::array<std::chrono::nanoseconds, REGION_CONTROLLER_PHASE_COUNT> phase_durations = {};
+
+        size_t                   increment_count = 0;
+        size_t                   decrement_count = 0;
+        size_t                   applied_count   = 0;
+        std::chrono::nanoseconds apply_duration  = std::chrono::nanoseconds::zero();
+
+        size_t ledger_occupancy = 0;
+        size_t ledger_capacity  = 0;
+
+        // Objects retired by the domain are counted by the object grouper.
+        size_t finalized_count = 0;
+
+        OperationGrouperMetrics operation_grouper;
+        ObjectGrouperMetrics    object_grouper;
+
+        // The region's last heap census, with `Config::heap_census_interval`.
+        std::vector<ObjectGroupCensus> heap_census;
+    };
+
+    struct DomainMetrics {
+        // The cycle every region had reached when the snapshot was taken.
+        Sequence                           cycle = 0;
+        std::vector<RegionMetricsSnapshot> regions;
+
+        // Operations written by threads without a region so far, with `Config::fallback_ledger`.
+        size_t fallback_operation_count = 0;
+
+        // Every region's last heap census summed by group, with `Config::heap_census_interval`. Regions
+        // take theirs in the same cycles, but one that joined late may not have taken one yet.
+        std::vector<ObjectGroupCensus> heap_census;
+        std::optional<Sequence>        heap_census_cycle;
+    };
+
     class Domain {
         friend class Region;
 
     public:
+        using Metrics = DomainMetrics;
+
         explicit Domain(const Config& config = Config());
         ~Domain();
 
@@ -29,28 +84,157 @@ namespace mantle {
         [[nodiscard]]
         const Config& config() const;
 
+        // Returns the metrics of every region as of the last cycle to finish. This is safe to
+        // call from any thread, and doesn't synchronize with regions.
+        [[nodiscard]]
+        Metrics snapshot_metrics() const;
+
+        // With `Config::domain_embedded`, call step from the thread that created the domain when this
+        // becomes readable, or once `timeout` has passed since the last step, whichever comes first.
+        int file_descriptor();
+        void step(bool non_blocking);
+
+        [[nodiscard]]
+        std::optional<std::chrono::nanoseconds> timeout() const;
+
+        // Returns true if regions on the calling thread have to step the domain themselves.
+        [[nodiscard]]
+        bool is_driven_here() const;
+
+        // Where region threads should run to share a cache with the domain thread. Call `place_thread`
+        // on it from each region thread. Only with `Config::topology_placement`.
+        [[nodiscard]]
+        ThreadPlacement* placement();
+
     private:
+        // The node that memory only the domain reads should be placed on, if placement is enabled.
+        [[nodiscard]]
+        std::optional<size_t> numa_node() const;
+
         void run();
 
+        // One pass of the domain loop: wait for messages, handle them and let controllers make progress.
+        void iterate(bool non_blocking);
+
+        // Swaps segments in for regions' write barriers until the doorbell rings. This runs on its own
+        // thread, since region threads that run into a guard page are stuck until it does.
+        void service_write_barriers();
+        WriteBarrierManager& write_barrier_manager();
+
+        // Only with `Config::fallback_ledger`.
+        FallbackLedger* fallback_ledger();
+
         void handle_event(void* user_data);
+        void deliver_messages(Region& region, const MessageBatch& messages);
+        void send_messages(RegionId region_id);
+
+        // Finalize garbage on behalf of a region that has left.
+        void finalize_garbage(RegionId region_id, ObjectGroups garbage);
+
+        // Busy-waits for messages for up to `Config::domain_spin_duration` and handles them. Returns
+        // false if none arrived and the domain should block. The time spent is taken off `timeout`.
+        bool spin(std::optional<std::chrono::nanoseconds>& timeout);
+        bool receive_pending_messages();
+        void set_spinning(bool spinning);
 
         void update_controllers(const RegionControllerCensus& census);
+
+        // Returns false if the cycle some region asked for should be held back for now.
+        bool schedule_cycle(const RegionControllerCensus& census);
+        std::optional<std::chrono::nanoseconds> schedule_timeout(const RegionControllerCensus& census) const;
+        bool is_start_urgent(const RegionControllerCensus& census) const;
+        bool has_pending_operations() const;
+        void parallelize_controllers(const RegionControllerCensus& census);
         void start_controllers(const RegionControllerCensus& census, std::scoped_lock<std::mutex>&);
         void stop_controllers(const RegionControllerCensus& census, std::scoped_lock<std::mutex>&);
+        void detach_region(RegionId region_id, const Message& message);
+        void publish_metrics(const RegionControllerCensus& census);
+
+        // Returns true if no region is joining or leaving, so the cadence is up to the scheduler.
+        [[nodiscard]]
+        bool is_steady(const RegionControllerCensus& census) const;
 
-        RegionId bind(Region& region);
+        // Combine the censuses of every cluster into one that covers all controllers.
+        RegionControllerCensus combine_censuses() const;
+
+        // The controllers in a cluster are the ones with consecutive region ids starting here.
+        std::span<const std::unique_ptr<RegionController>> cluster_controllers(size_t cluster_index) const;
+
+        // Returns true if clusters coordinate their controllers on the worker pool, rather than all
+        // of them on the domain thread. Each cluster delivers, synchronizes and sends for its own
+        // controllers, which only touches them and the census of the cluster.
+        [[nodiscard]]
+        bool has_cluster_workers() const;
+
+        // Call `pass(cluster_index)` for every cluster, in parallel if clusters have workers.
+        template<typename Pass>
+        void for_each_cluster(Pass&& pass);
+
+        // Returns true if a cluster can send the controller's messages. Regions that are leaving or
+        // have left are answered for on the domain thread, since that touches state shared by all of them.
+        [[nodiscard]]
+        bool is_sent_by_cluster(const RegionController& controller) const;
+
+        // Regions can join and leave between any two cycles. A leaving region has to wait for the
+        // domain to be done with it before it goes away, which is what `unbind` is for. Binding
+        // gives the region its id before the domain can see it, as it is looked up when messages arrive.
+        void bind(Region& region);
+        void unbind(Region& region);
 
     private:
         Config                 config_;
-        std::thread            thread_;
+        std::vector<size_t>    cpu_affinity_; // Shared by the domain thread and its workers.
+        std::unique_ptr<ThreadPlacement> placement_; // Only with `Config::topology_placement`.
+        std::optional<size_t>  numa_node_;
+        std::thread            thread_; // Not started when embedded.
+        std::thread::id        driver_thread_id_;
+
+        // Shared with regions that are joining or leaving.
+        std::mutex                                  regions_mutex_;
+        std::vector<std::pair<RegionId, Region*>>   joining_regions_;
+        std::vector<RegionId>                       vacant_region_ids_;
+
+        // Indexed by region id, with `Config::reference_count_table`. Like controllers, these are
+        // taken over by regions that reuse an id, since objects can outlive the region that owns them.
+        std::vector<std::unique_ptr<ReferenceCountTable>> reference_count_tables_;
+        RegionId                                    next_region_id_;
+        std::atomic_bool                            stop_requested_;
+
+        // Private to the domain thread. Regions are indexed like their controllers, and are null
+        // once they have left. Their finalizers stay around for the objects they leave behind.
+        std::vector<Region*>          regions_;
+        std::vector<ObjectFinalizer*> finalizers_;
+        size_t                        attached_region_count_;
+        RegionControllerGroup         controllers_;
+
+        // Controllers keep the census of their cluster up to date as they transition. The addresses
+        // must stay put, since controllers hold on to them.
+        size_t                                               cluster_size_;
+        std::vector<std::unique_ptr<RegionControllerCensus>> cluster_censuses_;
+        std::vector<std::vector<Region*>>                    cluster_arrivals_; // Regions with messages, when clusters have workers.
+        std::atomic_size_t            bound_region_count_; // Lets a spinning domain notice new regions.
+        size_t                        spin_region_count_;
+
+        bool                        running_;
+        std::optional<std::chrono::nanoseconds> timeout_; // How long the next blocking pass may wait.
+        Doorbell                    doorbell_;
+        Selector                    selector_;
+        std::unique_ptr<WorkerPool> worker_pool_;
+
+        // Only with the write barrier backend.
+        std::unique_ptr<WriteBarrierManager> write_barrier_manager_;
+        std::unique_ptr<Doorbell>            write_barrier_doorbell_;
+        std::thread                          write_barrier_thread_;
+
+        std::unique_ptr<FallbackLedger>      fallback_ledger_; // Only with `Config::fallback_ledger`.
 
-        std::mutex             regions_mutex_;
-        std::vector<Region*>   regions_;
-        RegionControllerGroup  controllers_;
+        CycleScheduler                               scheduler_;
+        std::optional<RegionControllerCensus::Cycle> admitted_cycle_;
+        bool                                         idle_cycle_armed_;
 
-        bool                   running_;
-        Doorbell               doorbell_;
-        Selector               selector_;
+        mutable std::mutex                           metrics_mutex_;
+        Metrics                                      metrics_;
+        std::optional<RegionControllerCensus::Cycle> published_cycle_;
     };
 
 }
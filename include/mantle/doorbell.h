@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <cstddef>
 
@@ -28,4 +29,10 @@ namespace mantle {
         int file_descriptor_;
     };
 
+    // Block while `word` still holds `expected`. This can return spuriously, so check again after.
+    void futex_wait(std::atomic_uint32_t& word, uint32_t expected);
+
+    // Wake up a thread blocked in `futex_wait` on this word, if there is one.
+    void futex_wake(std::atomic_uint32_t& word);
+
 }
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <span>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include "mantle/operation.h"
+#include "mantle/operation_ledger.h"
+
+namespace mantle {
+
+    // Operations from threads that don't run a region, which would otherwise be leaked. Any thread can
+    // write to it, and the next region of its domain to commit a transaction moves everything written
+    // so far into that transaction's spill, as if it had written the operations itself. Decrements are
+    // then submitted two transactions later like the region's own, so this is as safe as a region
+    // ledger, just slower.
+    //
+    // Objects don't know which domain they belong to, so only one domain at a time can have one.
+    // See `Config::fallback_ledger`.
+    //
+    class FallbackLedger {
+        FallbackLedger(FallbackLedger&&) = delete;
+        FallbackLedger(const FallbackLedger&) = delete;
+        FallbackLedger& operator=(FallbackLedger&&) = delete;
+        FallbackLedger& operator=(const FallbackLedger&) = delete;
+
+    public:
+        // Throws `std::runtime_error` if another domain has one.
+        FallbackLedger();
+        ~FallbackLedger();
+
+        // Returns the ledger of the domain that has one, if any.
+        static FallbackLedger* instance() {
+            return installed_instance().load(std::memory_order_acquire);
+        }
+
+        void write(Operation operation);
+        void write(std::span<const Operation> operations);
+
+        // Returns true if operations have been written since the last drain. Regions check this
+        // every step, so it doesn't take the lock.
+        [[nodiscard]]
+        bool has_operations() const {
+            return has_operations_.load(std::memory_order_relaxed);
+        }
+
+        // Move everything written so far into the spill.
+        void drain(OperationSpill& spill);
+
+        // The number of operations that have been written, which is how much traffic takes this path.
+        [[nodiscard]]
+        size_t written_count() const {
+            return written_count_.load(std::memory_order_relaxed);
+        }
+
+    private:
+        static std::atomic<FallbackLedger*>& installed_instance() {
+            static std::atomic<FallbackLedger*> instance = nullptr;
+            return instance;
+        }
+
+    private:
+        std::mutex             mutex_;
+        std::vector<Operation> operations_;
+        std::atomic_bool       has_operations_;
+        std::atomic_size_t     written_count_;
+    };
+
+}
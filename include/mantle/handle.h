@@ -1,5 +1,8 @@
 #pragma once
 
+#include <span>
+#include <array>
+#include <vector>
 #include <utility>
 #include <type_traits>
 #include "mantle/config.h"
@@ -9,25 +12,123 @@
 
 namespace mantle {
 
+    // Every copy of a handle is paired with an increment and a decrement in the ledger.
+    struct CountedReferencePolicy {
+        static constexpr bool WEIGHTED = false;
+        static constexpr bool SHARDED  = false;
+    };
+
+    // A copy splits the handle's weight in half and the new handle takes the other half, so
+    // copies stay local to the handle. The ledger is only touched when the weight runs out.
+    // This is a good fit for types that are copied far more often than they are dropped.
+    struct WeightedReferencePolicy {
+        static constexpr bool WEIGHTED = true;
+        static constexpr bool SHARDED  = false;
+    };
+
+    // Copies and drops are counted against the region's shard of the object instead of going to the
+    // ledger. The shard holds a reference of its own, and only net deltas are written, so objects that
+    // every region touches all the time, like a global config, don't load their owner's controller.
+    // Shards are given back once a region hasn't used one for a cycle, so objects die a cycle later.
+    //
+    // NOTE: Handles can't be converted to or from other policies, since their references may only
+    //       exist in a shard.
+    //
+    struct ShardedReferencePolicy {
+        static constexpr bool WEIGHTED = false;
+        static constexpr bool SHARDED  = true;
+    };
+
+    using DefaultReferencePolicy = std::conditional_t<
+        ENABLE_WEIGHTED_REFERENCE_COUNTING,
+        WeightedReferencePolicy,
+        CountedReferencePolicy
+    >;
+
+    template<typename T, typename Policy = DefaultReferencePolicy>
+    class Handle;
+
+    template<typename Policy = DefaultReferencePolicy, typename T>
+    Handle<T, Policy> make_handle(T& object) noexcept;
+
+    // Like the above, but with a rough count of the bytes that are freed once the object is finalized.
+    // See `Config::cycle_pressure_bytes`.
+    template<typename Policy = DefaultReferencePolicy, typename T>
+    Handle<T, Policy> make_handle(T& object, size_t byte_cost) noexcept;
+
+    // Return a handle to an object that outlives every region, like a `static` singleton. Copies and
+    // drops of it never submit any operations, and it is never finalized. The object is left unbound,
+    // so it must never be passed to `make_handle`.
+    template<typename Policy = DefaultReferencePolicy, typename T>
+    Handle<T, Policy> make_immortal_handle(T& object) noexcept;
+
+    // The handles are taken from `clones`, so vectors of handles can be passed as they are.
+    template<typename T, typename Policy>
+    void clone_handles(std::type_identity_t<std::span<const Handle<T, Policy>>> handles, std::vector<Handle<T, Policy>>& clones);
+
+    template<typename T, typename Policy>
+    void drop_handles(std::span<Handle<T, Policy>> handles) noexcept;
+
+    template<typename T>
+    class Borrow;
+
+    template<typename T, typename Policy>
+    class AtomicHandle;
+
     // This class holds a strong reference to an Object derived class instance.
     // It implements a smart-pointer like interface and has semantics similar to std::shared_ptr.
     //
-    // NOTE: We've got an extra `OperationType` bit we can use for a flag if needed.
+    // A handle at rest holds the decrement that is submitted when it is dropped. Immortal handles hold an
+    // increment instead, which is never submitted, so copies and drops only need to check the type bit.
+    // The null handle is an increment too, so that one check covers it as well.
+    //
     // NOTE: The exponent is never saturated at rest. We can use the high bit for a flag if needed.
     // TODO: Think about renaming this to `Ref<T>` for brevity.
     //
-    template<typename T>
+    // The policy only decides what happens when a handle is copied, and a copy follows the policy
+    // of the handle it was copied from. Handles with different policies all hold a decrement of
+    // some weight, so they can point to the same objects and be converted into one another freely.
+    //
+    template<typename T, typename Policy>
     class Handle {
         static_assert(std::is_base_of_v<Object, T>, "Object is a required base class");
 
-        friend Handle<T> make_handle<T>(T& object) noexcept;
+        template<typename U, typename OtherPolicy>
+        friend class Handle;
+
+        template<typename OtherPolicy, typename U>
+        friend Handle<U, OtherPolicy> make_handle(U& object) noexcept;
+
+        template<typename OtherPolicy, typename U>
+        friend Handle<U, OtherPolicy> make_handle(U& object, size_t byte_cost) noexcept;
+
+        template<typename OtherPolicy, typename U>
+        friend Handle<U, OtherPolicy> make_immortal_handle(U& object) noexcept;
+
+        template<typename U, typename OtherPolicy>
+        friend void clone_handles(std::type_identity_t<std::span<const Handle<U, OtherPolicy>>> handles, std::vector<Handle<U, OtherPolicy>>& clones);
+
+        template<typename U, typename OtherPolicy>
+        friend void drop_handles(std::span<Handle<U, OtherPolicy>> handles) noexcept;
+
+        template<typename U>
+        friend class Borrow;
+
+        template<typename U, typename OtherPolicy>
+        friend class AtomicHandle;
+
+        template<typename U>
+        friend class Channel;
+
+        template<typename U>
+        friend class MpscChannel;
 
         // Bind an `Object` subclass to the local `Region` and return a managed `Handle` to it.
-        static Handle bind(T& object) noexcept {
+        static Handle bind(T& object, const size_t byte_cost = 0) noexcept {
             Region* region = Region::thread_local_instance();
             assert(region);
 
-            static_cast<Object&>(object).bind(region->id());
+            region->bind_object(object, byte_cost);
 
             return Handle(make_decrement_operation(&object, Operation::EXPONENT_MIN));
         }
@@ -54,10 +155,11 @@ namespace mantle {
             std::swap(operation_, other.operation_);
         }
 
-        template<typename U>
-        Handle(Handle<U>&& other) noexcept
+        template<typename U, typename OtherPolicy>
+        Handle(Handle<U, OtherPolicy>&& other) noexcept
             : operation_(make_null_operation())
         {
+            static_assert(Policy::SHARDED == OtherPolicy::SHARDED);
             std::swap(operation_, other.operation_);
         }
 
@@ -66,11 +168,12 @@ namespace mantle {
         {
         }
 
-        template<typename U>
-        Handle(const Handle<U>& other) noexcept
+        template<typename U, typename OtherPolicy>
+        Handle(const Handle<U, OtherPolicy>& other) noexcept
             : operation_(other.copy_reference())
         {
             static_assert(std::is_base_of_v<T, U>);
+            static_assert(Policy::SHARDED == OtherPolicy::SHARDED);
         }
 
         Handle& operator=(Handle&& that) noexcept {
@@ -82,9 +185,10 @@ namespace mantle {
             return *this;
         }
 
-        template<typename U>
-        Handle& operator=(Handle<U>&& that) noexcept {
+        template<typename U, typename OtherPolicy>
+        Handle& operator=(Handle<U, OtherPolicy>&& that) noexcept {
             static_assert(std::is_base_of_v<T, U>);
+            static_assert(Policy::SHARDED == OtherPolicy::SHARDED);
 
             if (operation_.object() != that.operation_.object()) {
                 reset();
@@ -103,9 +207,10 @@ namespace mantle {
             return *this;
         }
 
-        template<typename U>
-        Handle& operator=(const Handle<U>& that) noexcept {
+        template<typename U, typename OtherPolicy>
+        Handle& operator=(const Handle<U, OtherPolicy>& that) noexcept {
             static_assert(std::is_base_of_v<T, U>);
+            static_assert(Policy::SHARDED == OtherPolicy::SHARDED);
 
             if (operation_.object() != that.operation_.object()) {
                 reset();
@@ -156,15 +261,20 @@ namespace mantle {
         }
 
         void reset() noexcept {
-            if (operation_) {
+            if (holds_reference()) {
                 Object* object = operation_.mutable_object();
                 assert(object);
-                object->start_decrement_operation(operation_);
-
-                operation_ = make_null_operation();
+                start_decrement_operation(*object, operation_);
             }
 
-            assert(!operation_);
+            // Immortal handles are dropped without submitting anything.
+            operation_ = make_null_operation();
+        }
+
+        // Returns true if this is a handle to an object made with `make_immortal_handle`.
+        [[nodiscard]]
+        bool is_immortal() const noexcept {
+            return operation_ && !holds_reference();
         }
 
     public:
@@ -173,15 +283,26 @@ namespace mantle {
         }
 
     private:
+        // Returns false for null and immortal handles, which have nothing to submit.
+        [[nodiscard]] MANTLE_HOT bool holds_reference() const noexcept {
+            return operation_.type() == OperationType::DECREMENT;
+        }
+
         [[nodiscard]] MANTLE_HOT Operation copy_reference() const {
-            Object* object = operation_.mutable_object();
-            if (!object) {
-                return make_null_operation();
+            if (UNLIKELY(!holds_reference())) {
+                return operation_;
             }
 
-            if constexpr (ENABLE_WEIGHTED_REFERENCE_COUNTING) {
+            Object* object = operation_.mutable_object();
+            assert(object);
+
+            if constexpr (Policy::WEIGHTED) {
                 // Check if we need to gain additional weight.
-                if (weight() == 0) {
+                if (UNLIKELY(weight() == 0)) {
+                    if (Region* region = Region::thread_local_instance(); LIKELY(region)) {
+                        region->metrics_.weight_refill_count += 1;
+                    }
+
                     // NOTE: Submit the new operation before the old operation.
                     object->start_increment_operation(make_increment_operation(object, Operation::EXPONENT_MAX));
                     object->start_decrement_operation(operation_);
@@ -198,20 +319,238 @@ namespace mantle {
                 Operation decrement = make_decrement_operation(object);
 
                 // The increment can be started immediately.
-                object->start_increment_operation(increment);
+                start_increment_operation(*object, increment);
 
                 // The decrement will be started once the new reference is dropped.
                 return decrement;
             }
         }
 
+        // The bulk functions below stage this many operations at a time before writing them out.
+        static constexpr size_t BULK_BATCH_SIZE = 32 * OperationBatch::SIZE;
+
+        // Without a region, sharded handles submit their operations like any other.
+        MANTLE_HOT static void start_increment_operation(Object& object, const Operation operation) noexcept {
+            if constexpr (Policy::SHARDED) {
+                if (Region* region = Region::thread_local_instance(); LIKELY(region)) {
+                    region->start_sharded_operation(operation);
+                    return;
+                }
+            }
+
+            object.start_increment_operation(operation);
+        }
+
+        MANTLE_HOT static void start_decrement_operation(Object& object, const Operation operation) noexcept {
+            if constexpr (Policy::SHARDED) {
+                if (Region* region = Region::thread_local_instance(); LIKELY(region)) {
+                    region->start_sharded_operation(operation);
+                    return;
+                }
+            }
+
+            object.start_decrement_operation(operation);
+        }
+
+        // Submit operations of either type, and handle them like single operations without a region.
+        static void start_operations(std::span<const Operation> operations) noexcept {
+            if (Region* region = Region::thread_local_instance(); LIKELY(region)) {
+                if constexpr (Policy::SHARDED) {
+                    for (const Operation operation: operations) {
+                        region->start_sharded_operation(operation);
+                    }
+                }
+                else {
+                    region->start_operations(operations);
+                }
+            }
+            else if (FallbackLedger* fallback_ledger = FallbackLedger::instance()) {
+                fallback_ledger->write(operations);
+            }
+            else {
+                // Leak.
+            }
+        }
+
     private:
         mutable Operation operation_;
     };
 
-    template<typename T>
-    inline Handle<T> make_handle(T& object) noexcept {
-        return Handle<T>::bind(object);
+    template<typename Policy, typename T>
+    inline Handle<T, Policy> make_handle(T& object) noexcept {
+        return Handle<T, Policy>::bind(object);
     }
 
+    template<typename Policy, typename T>
+    inline Handle<T, Policy> make_handle(T& object, const size_t byte_cost) noexcept {
+        return Handle<T, Policy>::bind(object, byte_cost);
+    }
+
+    template<typename Policy, typename T>
+    inline Handle<T, Policy> make_immortal_handle(T& object) noexcept {
+        assert(!object.is_managed());
+        return Handle<T, Policy>(make_increment_operation(&object));
+    }
+
+    // Append a copy of each handle to `clones`. This is the same as copying them one by one, but the
+    // increments are written to the ledger in bulk so there's a single bounds check per batch.
+    template<typename T, typename Policy>
+    void clone_handles(const std::type_identity_t<std::span<const Handle<T, Policy>>> handles, std::vector<Handle<T, Policy>>& clones) {
+        using HandleType = Handle<T, Policy>;
+
+        clones.reserve(clones.size() + handles.size());
+
+        // Weighted copies rarely touch the ledger, so there is nothing to batch.
+        if constexpr (Policy::WEIGHTED) {
+            clones.insert(clones.end(), handles.begin(), handles.end());
+        }
+        else {
+            std::array<Operation, HandleType::BULK_BATCH_SIZE> increments;
+
+            for (size_t offset = 0; offset < handles.size(); offset += increments.size()) {
+                const size_t count = std::min(increments.size(), handles.size() - offset);
+
+                size_t increment_count = 0;
+                for (const HandleType& handle: handles.subspan(offset, count)) {
+                    if (!handle.holds_reference()) {
+                        clones.push_back(HandleType(handle.operation_));
+                        continue;
+                    }
+
+                    Object* object = handle.operation_.mutable_object();
+
+                    increments[increment_count++] = make_increment_operation(object);
+                    clones.push_back(HandleType(make_decrement_operation(object)));
+                }
+
+                HandleType::start_operations({increments.data(), increment_count});
+            }
+        }
+    }
+
+    // Reset every handle. This is the same as resetting them one by one, but the decrements are
+    // written to the ledger in bulk.
+    template<typename T, typename Policy>
+    void drop_handles(const std::span<Handle<T, Policy>> handles) noexcept {
+        using HandleType = Handle<T, Policy>;
+
+        std::array<Operation, HandleType::BULK_BATCH_SIZE> decrements;
+        size_t decrement_count = 0;
+
+        for (HandleType& handle: handles) {
+            if (!handle.holds_reference()) {
+                handle.operation_ = make_null_operation();
+                continue;
+            }
+
+            decrements[decrement_count++] = std::exchange(handle.operation_, make_null_operation());
+            if (decrement_count == decrements.size()) {
+                HandleType::start_operations(decrements);
+                decrement_count = 0;
+            }
+        }
+
+        HandleType::start_operations({decrements.data(), decrement_count});
+    }
+
+    // A reference that borrows from a handle for a while and never touches the ledger. Objects only
+    // die once decrements have gone through a cycle, and this region can't finish one without calling
+    // `Region::step`, so whatever a live handle points to stays alive until then. That's how long a
+    // borrow is valid, which makes it a good fit for arguments that are only read during a request.
+    //
+    // NOTE: Builds with assertions check that borrows aren't used after the region has stepped.
+    //       Call `handle` to hold on to the object for longer. The epoch is recorded either way,
+    //       so the layout doesn't depend on `NDEBUG`.
+    //
+    template<typename T>
+    class Borrow {
+        static_assert(std::is_base_of_v<Object, T>, "Object is a required base class");
+
+    public:
+        Borrow() noexcept
+            : object_(nullptr)
+            , epoch_(0)
+        {
+        }
+
+        Borrow(std::nullptr_t) noexcept
+            : Borrow()
+        {
+        }
+
+        template<typename U, typename Policy>
+        Borrow(const Handle<U, Policy>& handle) noexcept
+            : object_(handle.operation_.mutable_object())
+            , epoch_(current_epoch())
+        {
+            static_assert(std::is_base_of_v<T, U>);
+        }
+
+        template<typename U>
+        Borrow(const Borrow<U>& other) noexcept
+            : object_(other.object_)
+            , epoch_(other.epoch_)
+        {
+            static_assert(std::is_base_of_v<T, U>);
+        }
+
+        T* get() const noexcept {
+            assert(is_valid());
+
+            return static_cast<T*>(object_);
+        }
+
+        T* operator->() const noexcept {
+            assert(*this);
+
+            return get();
+        }
+
+        T& operator*() const noexcept {
+            assert(*this);
+
+            return *get();
+        }
+
+        explicit operator bool() const noexcept {
+            return object_ != nullptr;
+        }
+
+        // Take a reference of our own, which stays valid after the borrow expires.
+        template<typename Policy = DefaultReferencePolicy>
+        [[nodiscard]] Handle<T, Policy> handle() const noexcept {
+            assert(is_valid());
+
+            if (!object_) {
+                return {};
+            }
+
+            // Only immortal objects are borrowed without being bound.
+            if (UNLIKELY(!object_->is_managed())) {
+                return Handle<T, Policy>(make_increment_operation(object_));
+            }
+
+            object_->start_increment_operation(make_increment_operation(object_));
+            return Handle<T, Policy>(make_decrement_operation(object_));
+        }
+
+    private:
+        template<typename U>
+        friend class Borrow;
+
+        static Region::Epoch current_epoch() noexcept {
+            const Region* region = Region::thread_local_instance();
+            return region ? region->epoch() : 0;
+        }
+
+        [[nodiscard]]
+        bool is_valid() const noexcept {
+            return !object_ || (epoch_ == current_epoch());
+        }
+
+    private:
+        Object*       object_;
+        Region::Epoch epoch_;
+    };
+
 }
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <span>
+#include <array>
+#include <vector>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+#include <cstddef>
+#include "mantle/types.h"
+
+namespace mantle {
+
+    class Object;
+
+    // Objects are bucketed by how many references they hold: one, two or three, four to seven, and so
+    // on, with the last bucket holding everything above.
+    constexpr size_t HEAP_CENSUS_BUCKET_COUNT = 8;
+
+    // What a census found for one object group.
+    struct ObjectGroupCensus {
+        ObjectGroup group = 0;
+
+        // Objects that have been bound and haven't died yet, whether or not they are still referenced.
+        size_t live_count = 0;
+
+        // Objects that had decrements applied in the sampled cycle, including those that died from them.
+        size_t pending_decrement_count = 0;
+
+        // Objects that died in the sampled cycle, and were handed over to be finalized.
+        size_t finalized_count = 0;
+
+        // The reference counts of objects that were updated in the sampled cycle and survived it.
+        std::array<size_t, HEAP_CENSUS_BUCKET_COUNT> reference_counts = {};
+    };
+
+    // The groups of objects a region bound, and of those that died on it with `Config::local_operations`,
+    // since its last submission. Regions hand these to their controller along with their operations.
+    struct HeapCensusDelta {
+        std::vector<ObjectGroup> bound_groups;
+        std::vector<ObjectGroup> released_groups;
+
+        void clear() {
+            bound_groups.clear();
+            released_groups.clear();
+        }
+    };
+
+    // Counts a controller's objects by group, with `Config::heap_census_interval`. Live objects are
+    // counted in every cycle from what the region bound and what died, which costs nothing per
+    // operation. Every `interval` cycles the controller also looks at the objects it applied operations
+    // to, and once the cycle's garbage is known the census is taken.
+    class HeapCensus {
+    public:
+        explicit HeapCensus(size_t interval);
+
+        [[nodiscard]]
+        bool is_sampled(Sequence cycle) const {
+            return (cycle % interval_) == 0;
+        }
+
+        // What the region submitted in `cycle`.
+        void add(Sequence cycle, const HeapCensusDelta& delta);
+
+        // Objects that operations were applied to in a sampled cycle. Survivors are counted by how many
+        // references they hold. The grouper can hand over an object more than once, but it only counts once.
+        void add_decremented(const Object& object);
+        void add_survivor(const Object& object, uint64_t reference_count);
+
+        // Objects that died in `cycle`, which takes the census if it is a sampled one.
+        void add_garbage(Sequence cycle, ObjectGroups garbage);
+
+        // The last finished sample, ordered by group, and the cycle it was taken in. It isn't updated
+        // while the domain is idle, so objects that died since then may still be counted as live.
+        [[nodiscard]]
+        std::span<const ObjectGroupCensus> sample() const;
+
+        [[nodiscard]]
+        std::optional<Sequence> sample_cycle() const;
+
+        // Adds the groups of `census` to those of `total`, both ordered by group.
+        static void merge(std::vector<ObjectGroupCensus>& total, std::span<const ObjectGroupCensus> census);
+
+    private:
+        [[nodiscard]]
+        static size_t to_bucket(uint64_t reference_count);
+
+        [[nodiscard]]
+        ObjectGroupCensus& group(ObjectGroup group);
+
+        void release(ObjectGroup group, size_t count, bool sampled);
+
+        void take_sample(Sequence cycle);
+
+    private:
+        size_t                                             interval_;
+        std::unordered_map<ObjectGroup, ObjectGroupCensus> groups_;
+        std::unordered_set<const Object*>                  decremented_; // Seen in the sampled cycle so far.
+        std::unordered_set<const Object*>                  survivors_;
+        std::vector<ObjectGroupCensus>                     sample_;
+        std::optional<Sequence>                            sample_cycle_;
+    };
+
+}
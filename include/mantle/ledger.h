@@ -11,6 +11,8 @@
 #include "mantle/config.h"
 #include "mantle/types.h"
 #include "mantle/util.h"
+#include "mantle/operation.h"
+#include "mantle/doorbell.h"
 #include "mantle/page_fault_handler.h"
 
 #define WRITE_BARRIER_PHASES(X) \
@@ -53,14 +55,23 @@ namespace mantle {
         [[nodiscard]]
         std::span<const std::byte> memory() const;
 
+        // Fault in the first `size` bytes, so that writing to them doesn't have to.
+        void populate(size_t size);
+
+        // Hand the first `size` bytes back to the OS. They read as zero once touched again.
+        void release(size_t size);
+
     private:
         std::span<std::byte> memory_;
     };
 
+    // Operations are stored as they are written, with decrements first since they are delayed.
+    // The last page is write protected, so running into it swaps in a fresh segment.
     struct WriteBarrierSegment {
         WriteBarrierSegment* prev;
         WriteBarrier*        barrier;
         bool                 primed;
+        bool                 resident; // Whether the pages before the guard page are populated.
         size_t               increment_count;
         size_t               decrement_count;
         PrivateMemoryMapping mapping;
@@ -72,9 +83,18 @@ namespace mantle {
         WriteBarrierSegment& operator=(WriteBarrierSegment&&) = delete;
         WriteBarrierSegment& operator=(const WriteBarrierSegment&) = delete;
 
-        Object** cursor();
-        std::span<Object*> objects();
+        Operation* cursor();
+        const Operation* cursor() const;
+        std::span<Operation> operations();
         std::span<std::byte> guard_page();
+
+        // Populate or release the pages before the guard page, which stays primed either way.
+        void populate();
+        void release();
+
+        // The operations committed to this segment.
+        [[nodiscard]]
+        std::span<const Operation> committed_operations() const;
     };
 
     // Rename to WriteBarrierStack?
@@ -98,6 +118,7 @@ namespace mantle {
         [[nodiscard]]
         bool is_empty() const;
         WriteBarrierSegment* back();
+        const WriteBarrierSegment* back() const;
         void push_back(WriteBarrierSegment& segment);
         WriteBarrierSegment* pop_back();
 
@@ -111,41 +132,94 @@ namespace mantle {
         [[nodiscard]]
         size_t decrement_count() const;
 
+        // Visit the operations committed to each segment.
+        template<typename Visitor>
+        void for_each_segment(Visitor&& visitor) const {
+            for (const WriteBarrierSegment* segment = stack_; segment; segment = segment->prev) {
+                visitor(*segment);
+            }
+        }
+
     private:
         Ledger&              ledger_;
         size_t               phase_shift_;
         WriteBarrierSegment* stack_;
     };
 
+    struct WriteBarrierPoolMetrics {
+        size_t segment_count           = 0; // Every segment allocated so far.
+        size_t resident_count          = 0; // Idle segments that are ready to be handed out.
+        size_t released_count          = 0; // Idle segments whose memory was handed back to the OS.
+        size_t demand_allocation_count = 0; // Times a segment had to be created or populated on demand.
+    };
+
+    // Hands out segments and swaps them when a write runs into a guard page. Someone has to call
+    // `poll` whenever the file descriptor is readable, since faulting threads are stuck until then.
+    //
+    // Idle segments are kept between two watermarks. Handing out and taking back segments only moves
+    // them between lists, and rings the maintenance doorbell when the pool leaves the watermarks. Whoever
+    // watches it calls `maintain`, which populates or releases segments away from the writing threads.
     class WriteBarrierManager {
     public:
-        WriteBarrierManager();
+        using Metrics = WriteBarrierPoolMetrics;
+
+        explicit WriteBarrierManager(size_t low_watermark = WRITE_BARRIER_POOL_LOW_WATERMARK, size_t high_watermark = WRITE_BARRIER_POOL_HIGH_WATERMARK);
 
         [[nodiscard]]
         int file_descriptor();
-        void poll();
+
+        [[nodiscard]]
+        int maintenance_file_descriptor();
+
+        // Handle one pending fault. Returns false if there weren't any.
+        bool poll();
+
+        // Bring the resident idle segments back between the watermarks.
+        void maintain();
+
+        [[nodiscard]]
+        Metrics metrics();
 
         void attach(WriteBarrier& barrier);
         void detach(WriteBarrier& barrier);
 
+        // Give back every segment but a fresh one, once the operations in the barrier have been consumed.
+        void reset(WriteBarrier& barrier);
+
     private:
         void prime_guard_page(WriteBarrierSegment& segment);
 
+        WriteBarrierSegment& create_segment();
         WriteBarrierSegment& allocate_segment();
         void deallocate_segment(WriteBarrierSegment& segment);
 
+        // Must be called with the pool locked.
+        void request_maintenance();
+
     private:
         PageFaultHandler                                  page_fault_handler_;
+        size_t                                            low_watermark_;
+        size_t                                            high_watermark_;
+        Doorbell                                          maintenance_doorbell_;
 
         std::mutex                                        segment_pool_mutex_;
-        std::vector<WriteBarrierSegment*>                 segment_pool_;
+        std::vector<WriteBarrierSegment*>                 segment_pool_;          // Resident.
+        std::vector<WriteBarrierSegment*>                 released_segment_pool_; // Handed back to the OS.
         std::vector<std::unique_ptr<WriteBarrierSegment>> segment_pool_storage_;
+        bool                                              maintenance_requested_;
+        size_t                                            demand_allocation_count_;
     };
 
+    // Records the operations of `Ref`s on this thread. Write barriers rotate through the phases each
+    // time the ledger steps, so the barrier in the APPLY phase always holds the increments of the last
+    // transaction and the decrements of the one two before it.
+    //
+    // NOTE: The cursors are thread local, so there can only be one ledger per thread.
+    //
     class Ledger {
     public:
-        // Conceptually a `std::atomic<std::vector<Object*>::iterator>`.
-        using Cursor = std::atomic<Object**>;
+        // Conceptually a `std::atomic<std::vector<Operation>::iterator>`.
+        using Cursor = std::atomic<Operation*>;
 
         static Cursor& local_increment_cursor() {
             thread_local Cursor cursor = nullptr;
@@ -173,9 +247,17 @@ namespace mantle {
 
         // Find the barrier in the corresponding phase.
         WriteBarrier& barrier(WriteBarrierPhase phase);
+        const WriteBarrier& barrier(WriteBarrierPhase phase) const;
         WriteBarrier& increment_barrier();
         WriteBarrier& decrement_barrier();
+        WriteBarrier& apply_barrier();
+
+        // Returns true if nothing has been written since the barrier in the APPLY phase was committed.
+        [[nodiscard]]
+        bool is_empty() const;
 
+        // Commit the current transaction. The operations in the APPLY phase must have been consumed
+        // since the last step, because that barrier starts collecting decrements again.
         void step();
 
     private:
@@ -186,20 +268,22 @@ namespace mantle {
         WriteBarrierManager& write_barrier_manager_;
     };
 
+    // These are a plain store. There is no bounds check, since running off the end of a segment
+    // faults on its guard page and the write barrier manager swaps in the next one.
     MANTLE_HOT
     void increment_ref_cnt(Object& object) {
-        std::atomic<Object**>& cursor = Ledger::local_increment_cursor();
-        Object** record = cursor.load(std::memory_order_acquire); // Doesn't need to be a fetch-add.
+        Ledger::Cursor& cursor = Ledger::local_increment_cursor();
+        Operation* record = cursor.load(std::memory_order_acquire); // Doesn't need to be a fetch-add.
         cursor.store(record + 1, std::memory_order_release);
-        *record = &object;
+        *record = make_increment_operation(&object, Operation::EXPONENT_MIN);
     }
 
     MANTLE_HOT
     void decrement_ref_cnt(Object& object) {
-        std::atomic<Object**>& cursor = Ledger::local_decrement_cursor();
-        Object** record = cursor.load(std::memory_order_acquire); // Doesn't need to be a fetch-add.
+        Ledger::Cursor& cursor = Ledger::local_decrement_cursor();
+        Operation* record = cursor.load(std::memory_order_acquire); // Doesn't need to be a fetch-add.
         cursor.store(record + 1, std::memory_order_release);
-        *record = &object;
+        *record = make_decrement_operation(&object, Operation::EXPONENT_MIN);
     }
 
 }
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <optional>
+#include <algorithm>
+#include <unordered_map>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include "mantle/types.h"
+#include "mantle/config.h"
+#include "mantle/util.h"
+#include "mantle/operation.h"
+#include "mantle/operation_grouper.h"
+#include "mantle/operation_ledger.h"
+#include "mantle/region_controller.h"
+
+namespace mantle {
+
+    class Object;
+
+    // An operation with its object replaced by the id the recording gave it.
+    struct RecordedOperation {
+        uint64_t object_id;
+        uint8_t  tag; // The type and exponent, encoded like they are in an `Operation`.
+    };
+
+    // What the recording knows about an object.
+    struct RecordedObject {
+        RegionId    region_id;
+        ObjectGroup group;
+    };
+
+    // The operations one region submitted in a cycle.
+    struct RecordedSubmission {
+        RegionId                       region_id;
+        std::vector<RecordedOperation> operations;
+    };
+
+    struct RecordedCycle {
+        Sequence                        cycle;
+        std::vector<RecordedSubmission> submissions;
+    };
+
+    // A recording read back in full. Object ids index `objects`, in the order they first appeared.
+    struct LedgerRecording {
+        std::vector<RecordedObject> objects;
+        std::vector<RecordedCycle>  cycles;
+
+        // A recording that was cut short, e.g. because the process died, is read up to its last whole
+        // record. Throws `std::runtime_error` if the stream doesn't hold a recording at all.
+        [[nodiscard]]
+        static LedgerRecording read(std::istream& stream);
+
+        [[nodiscard]]
+        size_t region_count() const;
+
+        [[nodiscard]]
+        size_t operation_count() const;
+    };
+
+    // Records the operations routed by a domain's controllers, so a production workload can be fed
+    // through controllers again offline with `LedgerReplay`. Install it with `Config::ledger_recorder`.
+    //
+    // Objects are written as dense ids along with their region and group, so no addresses end up in
+    // the file. Once the domain sees an object die its id is retired, and an object that is allocated
+    // at the same address later gets a new one. Objects that die on their own region with
+    // `Config::local_operations` aren't seen, so record without it.
+    //
+    // Controllers record into buffers of their own while they route, and the domain thread writes them
+    // out between steps, so recording doesn't need a lock even with domain workers.
+    //
+    class LedgerRecorder {
+    public:
+        explicit LedgerRecorder(std::ostream& stream);
+        ~LedgerRecorder();
+
+        LedgerRecorder(LedgerRecorder&&) = delete;
+        LedgerRecorder(const LedgerRecorder&) = delete;
+        LedgerRecorder& operator=(LedgerRecorder&&) = delete;
+        LedgerRecorder& operator=(const LedgerRecorder&) = delete;
+
+        // The number of operations and objects written so far.
+        [[nodiscard]]
+        size_t operation_count() const;
+
+        [[nodiscard]]
+        size_t object_count() const;
+
+    private:
+        friend class Domain;
+        friend class RegionController;
+
+        // Called by a controller when it is created, before it routes anything.
+        void add_region(RegionId region_id);
+
+        // Called by the controller of `region_id` for every operation it routes, and for every
+        // object of its region that dies.
+        MANTLE_HOT void record_operation(const RegionId region_id, const Sequence cycle, const Operation operation, const RegionId owner_id) {
+            Buffer& buffer = *buffers_[region_id];
+            buffer.cycle = cycle;
+            buffer.operations.push_back({ .operation = operation, .owner_id = owner_id });
+        }
+
+        void record_release(const RegionId region_id, const Object& object) {
+            buffers_[region_id]->released_objects.push_back(&object);
+        }
+
+        // Write out everything recorded since the last call. The domain calls this between steps,
+        // while none of its controllers are routing or applying.
+        void flush();
+
+    private:
+        struct RoutedOperation {
+            Operation operation;
+            RegionId  owner_id; // The object may have died by the time it is written out.
+        };
+
+        struct alignas(CACHE_LINE_SIZE) Buffer {
+            Sequence                     cycle = 0;
+            std::vector<RoutedOperation> operations;
+            std::vector<const Object*>   released_objects;
+        };
+
+        std::ostream&                                stream_;
+        std::vector<std::unique_ptr<Buffer>>         buffers_; // Indexed by region id.
+        std::unordered_map<const Object*, uint64_t> object_ids_;
+        std::optional<Sequence>                      cycle_; // The last cycle written.
+        std::vector<uint8_t>                         record_;
+        size_t                                       object_count_;
+        size_t                                       operation_count_;
+    };
+
+    struct LedgerReplayMetrics {
+        size_t cycle_count     = 0;
+        size_t operation_count = 0;
+
+        // Summed over every controller.
+        OperationGrouperMetrics operation_grouper;
+
+        // The number of objects whose reference counts were updated, and the time spent doing it.
+        size_t                   applied_count  = 0;
+        std::chrono::nanoseconds apply_duration = std::chrono::nanoseconds::zero();
+
+        // The number of dead objects handed back by controllers, and the time spent finalizing them.
+        size_t                   finalized_count   = 0;
+        std::chrono::nanoseconds finalize_duration = std::chrono::nanoseconds::zero();
+
+        // Objects that were used again after they died in the replay. This is only non-zero when
+        // deaths were missed while recording.
+        size_t revived_count = 0;
+
+        std::chrono::nanoseconds duration = std::chrono::nanoseconds::zero();
+
+        // The fraction of routed operations that grouping saved a reference count update for, either by
+        // folding them into another operation on the same object or because they cancelled out.
+        [[nodiscard]]
+        double grouper_hit_rate() const {
+            if (operation_count == 0) {
+                return 0.0;
+            }
+
+            const size_t update_count = std::min(applied_count, operation_count);
+            return 1.0 - (static_cast<double>(update_count) / static_cast<double>(operation_count));
+        }
+
+        [[nodiscard]]
+        double applied_objects_per_second() const {
+            if (apply_duration.count() <= 0) {
+                return 0.0;
+            }
+
+            return static_cast<double>(applied_count) / std::chrono::duration<double>(apply_duration).count();
+        }
+    };
+
+    // Feeds a recording through a group of controllers on the calling thread, the way the domain
+    // would without workers. Each recorded cycle runs as one cycle, in which every region submits
+    // what it submitted then, and once the recording ends cycles keep running until nothing is in
+    // flight. Objects are created when they are first used and deleted when they are finalized.
+    //
+    // The controllers use `config`, so one recording can be compared across grouper and apply options.
+    // Domain workers, reference count tables and heap censuses are not used.
+    //
+    class LedgerReplay {
+    public:
+        LedgerReplay(const LedgerRecording& recording, const Config& config);
+        ~LedgerReplay();
+
+        LedgerReplay(LedgerReplay&&) = delete;
+        LedgerReplay(const LedgerReplay&) = delete;
+        LedgerReplay& operator=(LedgerReplay&&) = delete;
+        LedgerReplay& operator=(const LedgerReplay&) = delete;
+
+        // Play the whole recording. This can only be done once.
+        //
+        // Throws `std::runtime_error` if a cycle doesn't fit in the ledgers, which are sized from the
+        // recording and `Config::ledger_capacity`.
+        //
+        [[nodiscard]]
+        LedgerReplayMetrics run();
+
+    private:
+        struct ReplayedObject;
+
+        // The object behind an id, created and bound to its region if it isn't alive.
+        [[nodiscard]]
+        Object& object(uint64_t object_id);
+
+        // Run one cycle, in which regions submit what they did in `cycle`, or nothing if it is null.
+        void run_cycle(const RecordedCycle* cycle);
+
+        void finalize(ObjectGroups garbage);
+
+    private:
+        const LedgerRecording& recording_;
+        Config                 config_;
+        LedgerReplayMetrics    metrics_;
+        bool                   finished_;
+
+        std::vector<ReplayedObject*>                  objects_; // Indexed by object id, null until used and once finalized.
+        std::vector<bool>                             created_;
+        std::vector<std::unique_ptr<OperationLedger>> ledgers_;
+        std::vector<SequenceRange>                    submitted_ranges_;
+        RegionControllerGroup                         controllers_;
+    };
+
+}
@@ -3,9 +3,17 @@
 #include "mantle/config.h"
 #include "mantle/domain.h"
 #include "mantle/region.h"
+#include "mantle/region_pool.h"
+#include "mantle/topology.h"
 #include "mantle/object.h"
 #include "mantle/object_finalizer.h"
 #include "mantle/handle.h"
+#include "mantle/atomic_handle.h"
+#include "mantle/channel.h"
+#include "mantle/region_allocator.h"
+#include "mantle/trace.h"
+#include "mantle/ledger_recording.h"
+#include "mantle/heap_census.h"
 
 #include "mantle/ledger.h"
 #include "mantle/ref.h"
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <span>
+#include <new>
+#include <optional>
+#include <cstddef>
+#include <sys/user.h>
+#include "mantle/config.h"
+
+namespace mantle {
+
+    // Map private anonymous memory of at least `size` bytes. With a huge page policy the mapping is
+    // rounded up to whole huge pages and aligned to them. Explicit huge pages fall back to transparent
+    // ones when the hugetlb pool can't satisfy the request. If a NUMA node is given the memory prefers
+    // it, but can still come from other nodes when it is short. Throws `std::bad_alloc` on failure.
+    std::span<std::byte> map_memory(size_t size, HugePagePolicy policy, std::optional<size_t> numa_node = std::nullopt);
+
+    // Unmap memory returned by `map_memory` with the same size and policy.
+    void unmap_memory(std::span<std::byte> memory, HugePagePolicy policy);
+
+    // Hand the pages within this range of a mapping back to the OS, so they read as zero and are only
+    // committed again once they're touched. Pages that are only partly inside the range are kept.
+    void decommit_memory(std::span<std::byte> memory, HugePagePolicy policy);
+
+    // The size of the mapping `map_memory` creates for `size` bytes under this policy.
+    [[nodiscard]]
+    size_t mapping_size(size_t size, HugePagePolicy policy);
+
+    // The resident set size of this process in bytes, or zero if it can't be read.
+    [[nodiscard]]
+    size_t resident_memory_size();
+
+    // A standard allocator that gives every allocation its own mapping, so large buffers can be
+    // backed by huge pages. Only use this for a few big, long-lived allocations.
+    template<typename T>
+    class MappedAllocator {
+    public:
+        using value_type = T;
+
+        explicit MappedAllocator(HugePagePolicy policy = HugePagePolicy::NONE, std::optional<size_t> numa_node = std::nullopt)
+            : policy_(policy)
+            , numa_node_(numa_node)
+        {
+        }
+
+        template<typename U>
+        MappedAllocator(const MappedAllocator<U>& other)
+            : policy_(other.policy())
+            , numa_node_(other.numa_node())
+        {
+        }
+
+        [[nodiscard]]
+        HugePagePolicy policy() const {
+            return policy_;
+        }
+
+        [[nodiscard]]
+        std::optional<size_t> numa_node() const {
+            return numa_node_;
+        }
+
+        [[nodiscard]]
+        T* allocate(size_t count) {
+            static_assert(alignof(T) <= PAGE_SIZE);
+            return reinterpret_cast<T*>(map_memory(count * sizeof(T), policy_, numa_node_).data());
+        }
+
+        void deallocate(T* pointer, size_t count) {
+            unmap_memory({ reinterpret_cast<std::byte*>(pointer), count * sizeof(T) }, policy_);
+        }
+
+        template<typename U>
+        bool operator==(const MappedAllocator<U>& other) const {
+            return (policy_ == other.policy()) && (numa_node_ == other.numa_node());
+        }
+
+    private:
+        HugePagePolicy        policy_;
+        std::optional<size_t> numa_node_;
+    };
+
+}
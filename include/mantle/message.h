@@ -16,6 +16,11 @@
 
 namespace mantle {
 
+    class OperationPartition;
+    struct OperationSpill;
+    class WriteBarrier;
+    struct HeapCensusDelta;
+
     enum class MessageType {
 #define X(MANTLE_MESSAGE_TYPE) \
         MANTLE_MESSAGE_TYPE,   \
@@ -30,6 +35,7 @@ namespace mantle {
         // region -> domain
         struct Start {
             MessageType type;
+            bool        urgent; // The region's ledger is filling up, don't hold the cycle back.
         } start;
 
         // domain -> region
@@ -44,6 +50,24 @@ namespace mantle {
             bool          stop; // The region is ready to stop.
             SequenceRange increments;
             SequenceRange decrements;
+
+            // Set when the region partitioned the submitted operations by owning region.
+            const OperationPartition* increment_partition;
+            const OperationPartition* decrement_partition;
+
+            // Set when operations overflowed the ledger. These are routed in addition to the ranges.
+            const OperationSpill* increment_spill;
+            const OperationSpill* decrement_spill;
+
+            // Set when the region records `Ref` operations. These are also routed in addition to the ranges.
+            const WriteBarrier* barrier;
+
+            size_t finalized_count; // The number of objects the region has finalized so far.
+            size_t bound_count;     // The number of objects the region has bound so far.
+            size_t released_count;  // The number of those that died on the region, with `Config::local_operations`.
+
+            // Set with `Config::heap_census_interval`, holding what was bound and released since the last submission.
+            const HeapCensusDelta* heap_census;
         } submit;
 
         // domain -> region
@@ -59,10 +83,11 @@ namespace mantle {
         } leave;
     };
 
-    constexpr Message make_start_message() {
+    constexpr Message make_start_message(bool urgent = false) {
         return {
             .start = {
-                .type = MessageType::START,
+                .type   = MessageType::START,
+                .urgent = urgent,
             }
         };
     }
@@ -30,10 +30,16 @@ namespace mantle {
     private:
         template<typename T>
         friend class Ref;
-        template<typename T>
+        template<typename T, typename Policy>
         friend class Handle;
+        template<typename T>
+        friend class Borrow;
+        template<typename T, typename Policy>
+        friend class AtomicHandle;
         friend class Region;
         friend class RegionController;
+        friend class RegionAllocator;
+        friend class LedgerReplay;
 
         // Associate this `Object` to the local `Region`. Reference counting
         // and object finalization will be handled by that `Region. An `Object`
@@ -41,17 +47,28 @@ namespace mantle {
         //
         void bind(RegionId region_id);
 
-        // Submit an operation to the `Region` who will forward it to the `Domain`.
+        // Submit an operation to the `Region` who will forward it to the `Domain`. The ones that take an
+        // operation are the fast path behind every handle copy and drop, so they're defined in region.h
+        // where they can inline all the way down to the ledger write.
         void start_increment_operation(uint8_t exponent);
-        void start_increment_operation(Operation operation);
+        inline void start_increment_operation(Operation operation);
         void start_decrement_operation(uint8_t exponent);
-        void start_decrement_operation(Operation operation);
+        inline void start_decrement_operation(Operation operation);
 
         // Update the reference count of this `Object` by the given magnitude.
         // These functions return `true` if the reference count remains positive.
         bool apply_increment(uint32_t delta_magnitude);
         bool apply_decrement(uint32_t delta_magnitude);
 
+        // Drop the association with a region once the object has died.
+        void unbind();
+
+        // With `Config::reference_count_table` the count is kept in the region's table instead, and
+        // the field holds the slot it was given there.
+        [[nodiscard]]
+        uint32_t reference_count_slot() const;
+        void set_reference_count_slot(uint32_t slot);
+
     private:
         uint32_t    reference_count_;
         RegionId    region_id_;
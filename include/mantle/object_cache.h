@@ -1,31 +1,43 @@
 #pragma once
 
+#include <bit>
+#include <array>
+#include <vector>
 #include <utility>
-#include <optional>
+#include <algorithm>
 #include <cstdint>
 #include <cstddef>
 #include <cstring>
 #include <cassert>
 #include "mantle/util.h"
 #include "mantle/types.h"
+#include "mantle/config.h"
 #include "mantle/object.h"
 
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#elif defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
 namespace mantle {
 
-    // TODO: SSE2 probing.
-    // TODO: Live mask that we can `&` with the probe result.
+    // A set-associative cache keyed by object address. Each set tracks which of its ways
+    // are live, and lookups compare every key in a set at once when SIMD is available.
+    // The number of sets is chosen at construction, so owners can size it to their workload.
     //
-    template<typename T, size_t CACHE_SIZE, size_t CACHE_WAYS>
+    template<typename T, size_t CACHE_WAYS>
     class ObjectCache {
     public:
-        static_assert(is_power_of_2(CACHE_SIZE));
         static_assert(is_power_of_2(CACHE_WAYS));
-
-        static constexpr size_t CACHE_SETS = CACHE_SIZE / CACHE_WAYS;
+        static_assert(CACHE_WAYS <= 32, "Way masks are 32 bits wide");
 
         static constexpr uintptr_t SET_SHIFT = log2_floor(alignof(Object));
-        static constexpr uintptr_t SET_BITS  = log2_floor(CACHE_SETS);
-        static constexpr uintptr_t SET_MASK  = (1ull << SET_BITS) - 1;
+
+        // A bitset of ways within a set.
+        using WayMask = uint32_t;
+
+        static constexpr WayMask ALL_WAYS = static_cast<WayMask>((1ull << CACHE_WAYS) - 1);
 
     public:
         struct Entry {
@@ -40,21 +52,16 @@ namespace mantle {
             explicit Cursor(const size_t pos = 0)
                 : pos_(pos)
             {
-                assert(pos_ <= CACHE_SIZE);
             }
 
             Cursor(const size_t set, const size_t way)
                 : Cursor((set * CACHE_WAYS) + way)
             {
-                assert(pos_ <= CACHE_SIZE);
+                assert(way < CACHE_WAYS);
             }
 
             auto operator<=>(const Cursor&) const noexcept = default;
 
-            explicit operator bool() const {
-                return pos_ < CACHE_SIZE;
-            }
-
             [[nodiscard]]
             size_t set() const {
                 return pos_ / CACHE_WAYS;
@@ -65,30 +72,106 @@ namespace mantle {
                 return pos_ % CACHE_WAYS;
             }
 
-            std::optional<Cursor> next() const {
-                if (Cursor cursor = *this; cursor.advance()) {
-                    return cursor;
-                }
-
-                return std::nullopt;
-            }
-
-            bool advance() {
-                assert(*this);
-
+            void advance() {
                 pos_ += 1;
-                return static_cast<bool>(*this);
             }
 
         private:
             size_t pos_;
         };
 
+    private:
+        // The keys of a set are loaded together, so they're aligned for the widest load that covers them.
+        struct alignas(std::min(CACHE_LINE_SIZE, CACHE_WAYS * sizeof(Object*))) KeySet {
+            Object* keys[CACHE_WAYS];
+        };
+
     public:
-        ObjectCache() {
+        // The size is the total number of entries, and is rounded up to whole sets.
+        explicit ObjectCache(const size_t size)
+            : keys_(std::bit_ceil(std::max(size, CACHE_WAYS)) / CACHE_WAYS)
+            , vals_(keys_.size())
+            , live_(keys_.size())
+            , set_mask_(keys_.size() - 1)
+        {
             reset();
         }
 
+        [[nodiscard]]
+        size_t size() const {
+            return keys_.size() * CACHE_WAYS;
+        }
+
+        [[nodiscard]]
+        size_t sets() const {
+            return keys_.size();
+        }
+
+        [[nodiscard]]
+        Cursor begin() const {
+            return Cursor(0);
+        }
+
+        [[nodiscard]]
+        Cursor end() const {
+            return Cursor(size());
+        }
+
+        [[nodiscard]]
+        size_t to_set(Object* key) const {
+            uintptr_t ptr;
+            memcpy(&ptr, &key, sizeof(ptr));
+            return (ptr >> SET_SHIFT) & set_mask_;
+        }
+
+        // Returns the ways in this set that currently hold an entry.
+        [[nodiscard]]
+        WayMask live_ways(const size_t set) const {
+            return live_[set];
+        }
+
+        // Returns the live ways in this set whose key matches.
+        [[nodiscard]]
+        MANTLE_HOT WayMask matching_ways(const size_t set, Object* key) const {
+            uintptr_t needle;
+            memcpy(&needle, &key, sizeof(needle));
+
+            const Object* const* keys = keys_[set].keys;
+            WayMask mask = 0;
+
+#if defined(__AVX2__)
+            if constexpr ((CACHE_WAYS % 4) == 0) {
+                const __m256i needles = _mm256_set1_epi64x(static_cast<long long>(needle));
+                for (size_t way = 0; way < CACHE_WAYS; way += 4) {
+                    const __m256i haystack = _mm256_load_si256(reinterpret_cast<const __m256i*>(&keys[way]));
+                    const __m256i matches = _mm256_cmpeq_epi64(haystack, needles);
+                    mask |= static_cast<WayMask>(_mm256_movemask_pd(_mm256_castsi256_pd(matches))) << way;
+                }
+
+                return mask & live_[set];
+            }
+#endif
+#if defined(__SSE2__)
+            if constexpr ((CACHE_WAYS % 2) == 0) {
+                // SSE2 doesn't have a 64-bit compare. A key matches when both 32-bit halves do.
+                const __m128i needles = _mm_set1_epi64x(static_cast<long long>(needle));
+                for (size_t way = 0; way < CACHE_WAYS; way += 2) {
+                    const __m128i haystack = _mm_load_si128(reinterpret_cast<const __m128i*>(&keys[way]));
+                    const __m128i half_matches = _mm_cmpeq_epi32(haystack, needles);
+                    const __m128i matches = _mm_and_si128(half_matches, _mm_shuffle_epi32(half_matches, _MM_SHUFFLE(2, 3, 0, 1)));
+                    mask |= static_cast<WayMask>(_mm_movemask_pd(_mm_castsi128_pd(matches))) << way;
+                }
+
+                return mask & live_[set];
+            }
+#endif
+            for (size_t way = 0; way < CACHE_WAYS; ++way) {
+                mask |= static_cast<WayMask>(keys[way] == key) << way;
+            }
+
+            return mask & live_[set];
+        }
+
         std::pair<Cursor, Cursor> equal_range(Object* key) const {
             size_t set = to_set(key);
 
@@ -103,7 +186,7 @@ namespace mantle {
             size_t way = cursor.way();
 
             return {
-                .key = keys_[set][way],
+                .key = keys_[set].keys[way],
                 .val = vals_[set][way],
             };
         }
@@ -112,34 +195,41 @@ namespace mantle {
             size_t set = cursor.set();
             size_t way = cursor.way();
 
-            keys_[set][way] = entry.key;
+            keys_[set].keys[way] = entry.key;
             vals_[set][way] = entry.val;
+
+            if (entry.key) {
+                live_[set] |= (WayMask{1} << way);
+            }
+            else {
+                live_[set] &= ~(WayMask{1} << way);
+            }
         }
 
         void reset(Cursor cursor) {
             size_t set = cursor.set();
             size_t way = cursor.way();
 
-            keys_[set][way] = nullptr;
+            keys_[set].keys[way] = nullptr;
             vals_[set][way] = T{};
+            live_[set] &= ~(WayMask{1} << way);
         }
 
         void reset() {
-            for (Cursor cursor; cursor; cursor.advance()) {
-                reset(cursor);
+            for (WayMask& mask: live_) {
+                mask = 0;
             }
-        }
 
-    private:
-        static size_t to_set(Object* key) {
-            uintptr_t ptr;
-            memcpy(&ptr, &key, sizeof(ptr));
-            return (ptr >> SET_SHIFT) & SET_MASK;
+            for (Cursor cursor = begin(); cursor != end(); cursor.advance()) {
+                reset(cursor);
+            }
         }
 
     private:
-        Object* keys_[CACHE_SETS][CACHE_WAYS];
-        T       vals_[CACHE_SETS][CACHE_WAYS];
+        std::vector<KeySet>                    keys_;
+        std::vector<std::array<T, CACHE_WAYS>> vals_;
+        std::vector<WayMask>                   live_;
+        uintptr_t                              set_mask_;
     };
 
 }
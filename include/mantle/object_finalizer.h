@@ -1,16 +1,102 @@
 #pragma once
 
+#include <span>
+#include <array>
+#include <algorithm>
+#include <type_traits>
+#include <cstdlib>
+#include <cstddef>
 #include "mantle/types.h"
+#include "mantle/config.h"
+#include "mantle/util.h"
+#include "mantle/object.h"
 
 namespace mantle {
 
     // An interface for cleaning up objects once they are no longer referenced.
+    //
+    // A region's finalizer is called on the region's thread, from `Region::step`. Objects the region
+    // bound can outlive it when other regions still hold them, and once it has left those are
+    // finalized on the domain's thread instead. So a finalizer must outlive its region, until the
+    // domain is destroyed or a new region takes over the region's id, and must not rely on running on
+    // the region's thread.
+    //
     class ObjectFinalizer {
     public:
         virtual ~ObjectFinalizer() = default;
 
         // Objects are finalized in batches based on group membership.
+        //
+        // NOTE: The span may be reused once a finalizer steps its region, so be done with it first.
+        //
         virtual void finalize(ObjectGroup group, std::span<Object*> objects) noexcept = 0;
     };
 
+    // Declares that every object in `GROUP` is a `T`, for `TypedObjectFinalizer`.
+    template<ObjectGroup GROUP, typename T>
+    struct ObjectGroupType {
+        static_assert(std::is_base_of_v<Object, T>, "Object is a required base class");
+
+        static constexpr ObjectGroup group = GROUP;
+        using Type = T;
+    };
+
+    // A finalizer for groups whose objects each have one known type. Groups are looked up in a table
+    // that is built at compile time, and their objects handed to `Derived::finalize(std::span<T*>)`.
+    // Since the type is known the calls can be inlined, so there is one indirect call per group and
+    // none per object. Objects in groups that aren't listed are a bug.
+    //
+    // NOTE: Objects are converted in batches of up to `FINALIZATION_BATCH_SIZE`, so a group can be
+    //       handed to the typed overload in more than one call.
+    //
+    template<typename Derived, typename... GroupTypes>
+    class TypedObjectFinalizer : public ObjectFinalizer {
+        static_assert(sizeof...(GroupTypes) > 0);
+
+    public:
+        void finalize(const ObjectGroup group, const std::span<Object*> objects) noexcept final {
+            if (UNLIKELY(group >= GROUP_COUNT) || UNLIKELY(!DISPATCH_TABLE[group])) {
+                abort(); // The group wasn't registered.
+            }
+
+            DISPATCH_TABLE[group](static_cast<Derived&>(*this), objects);
+        }
+
+    private:
+        using Thunk = void (*)(Derived&, std::span<Object*>) noexcept;
+
+        static constexpr size_t GROUP_COUNT = size_t{std::max({GroupTypes::group...})} + 1;
+
+        template<typename T>
+        static void finalize_typed(Derived& derived, const std::span<Object*> objects) noexcept {
+            // The `Object` base need not be at the start of `T`, so pointers can't be cast in place.
+            std::array<T*, FINALIZATION_BATCH_SIZE> batch;
+
+            for (size_t offset = 0; offset < objects.size(); offset += batch.size()) {
+                const size_t count = std::min(batch.size(), objects.size() - offset);
+                for (size_t i = 0; i < count; ++i) {
+                    batch[i] = static_cast<T*>(objects[offset + i]);
+                }
+
+                derived.finalize(std::span<T*>(batch.data(), count));
+            }
+        }
+
+        static constexpr std::array<Thunk, GROUP_COUNT> make_dispatch_table() {
+            std::array<Thunk, GROUP_COUNT> table = {};
+            ((table[GroupTypes::group] = &finalize_typed<typename GroupTypes::Type>), ...);
+            return table;
+        }
+
+        static constexpr bool has_unique_groups() {
+            std::array<ObjectGroup, sizeof...(GroupTypes)> groups = { GroupTypes::group... };
+            std::sort(groups.begin(), groups.end());
+            return std::adjacent_find(groups.begin(), groups.end()) == groups.end();
+        }
+
+        static_assert(has_unique_groups(), "Each group can only have one type");
+
+        static constexpr std::array<Thunk, GROUP_COUNT> DISPATCH_TABLE = make_dispatch_table();
+    };
+
 }
@@ -2,6 +2,9 @@
 
 #include "mantle/types.h"
 #include "mantle/object.h"
+#include <memory>
+#include <vector>
+#include <limits>
 #include <cstdint>
 #include <cstddef>
 #include <cassert>
@@ -15,17 +18,25 @@ namespace mantle {
     };
 
     // This class groups objects for more efficient finalization.
+    //
+    // Only a handful of groups tend to be in use at a time, out of the tens of thousands an object can
+    // belong to. The grouper keeps track of which groups it has touched, so the work done by `flush`
+    // is proportional to the number of objects and groups actually used, rather than all of them.
+    //
     class ObjectGrouper {
+        static constexpr size_t GROUP_COUNT = static_cast<size_t>(std::numeric_limits<ObjectGroup>::max()) + 1;
+
     public:
         using Metrics = ObjectGrouperMetrics;
 
         ObjectGrouper()
             : group_min_(std::numeric_limits<ObjectGroup>::max())
             , group_max_(std::numeric_limits<ObjectGroup>::min())
+            , group_counts_(std::make_unique<size_t[]>(GROUP_COUNT))
+            , group_offsets_(std::make_unique_for_overwrite<size_t[]>(GROUP_COUNT))
+            , group_sizes_(std::make_unique_for_overwrite<size_t[]>(GROUP_COUNT))
+            , group_mask_{}
         {
-            for (size_t& bucket: group_buckets_) {
-                bucket = 0;
-            }
         }
 
         [[nodiscard]]
@@ -36,7 +47,9 @@ namespace mantle {
         void write(Object& object) {
             const ObjectGroup group = object.group();
 
-            group_buckets_[group] += 1;
+            if (group_counts_[group]++ == 0) {
+                touched_groups_.push_back(group);
+            }
             group_min_ = std::min(group, group_min_);
             group_max_ = std::max(group, group_max_);
 
@@ -52,43 +65,43 @@ namespace mantle {
             metrics_.group_max = std::max(group_max_, metrics_.group_max);
 
             if constexpr (ENABLE_OBJECT_GROUPING) {
-                // Reset working memory.
                 output_.resize(input_.size());
-                for (size_t& offset: group_offsets_) {
-                    offset = 0;
+
+                // Forget the groups from the last flush and mark the ones we've touched since.
+                for (const ObjectGroup group: flushed_groups_) {
+                    group_mask_[group / OBJECT_GROUP_MASK_WORD_BITS] = 0;
                 }
-                for (uint64_t& chunk: group_mask_) {
-                    chunk = 0;
+                for (const ObjectGroup group: touched_groups_) {
+                    group_mask_[group / OBJECT_GROUP_MASK_WORD_BITS] |= uint64_t(1) << (group % OBJECT_GROUP_MASK_WORD_BITS);
                 }
+                flushed_groups_.swap(touched_groups_);
+                touched_groups_.clear();
 
-                // Calculate group offsets and initialize the group mask.
+                // Calculate group offsets in group order.
                 {
                     size_t offset = 0;
-                    for (ObjectGroup group = group_min_; group <= group_max_; ++group) {
-                        const size_t group_size = group_buckets_[group];
-                        const uint64_t group_populated = !!group_size;
+                    for_each_group(group_mask_, group_min_, group_max_, [&](const ObjectGroup group) {
+                        const size_t group_size = group_counts_[group];
 
                         group_offsets_[group] = offset;
-                        group_mask_[group / 64] |= (group_populated << (group % 64));
+                        group_sizes_[group] = group_size;
 
                         offset += group_size;
-                    }
+                    });
 
-                    // The cumulative offset is stored at the end (not the back).
                     assert(offset == input_.size());
-                    group_offsets_[static_cast<size_t>(group_max_) + 1] = offset;
                 }
 
-                // Group objects in O(n) using radix sort.
+                // Group objects in O(n) using radix sort. This leaves every count at zero again.
                 for (Object* object: input_) {
                     const ObjectGroup group = object->group();
 
                     const size_t offset = group_offsets_[group];
-                    size_t& bucket = group_buckets_[group];
-                    assert(bucket);
+                    size_t& count = group_counts_[group];
+                    assert(count);
 
-                    bucket -= 1;
-                    output_[offset + bucket] = object;
+                    count -= 1;
+                    output_[offset + count] = object;
                 }
 
                 groups = ObjectGroups {
@@ -96,32 +109,42 @@ namespace mantle {
                     .object_count  = output_.size(),
                     .group_min     = group_min_,
                     .group_max     = group_max_,
-                    .group_offsets = group_offsets_.data(),
+                    .group_offsets = group_offsets_.get(),
+                    .group_sizes   = group_sizes_.get(),
                     .group_mask    = &group_mask_,
                 };
 
 #ifdef MANTLE_AUDIT
                 // Sanity check group membership.
-                for (ObjectGroup group = group_min_; group <= group_max_; ++group) {
-                    const std::span<Object*> group_members = groups.group_members(group);
+                size_t member_count = 0;
+                groups.for_each_group([&](ObjectGroup group, std::span<Object*> group_members) {
                     assert(group_members.size() <= groups.object_count);
+                    member_count += group_members.size();
 
                     for (const Object* object: group_members) {
                         assert(object->group() == group);
                         assert(object->is_managed());
                     }
-                }
+                });
+                assert(member_count == groups.object_count);
 #endif
             }
             else {
                 output_ = input_;
 
+                // Counts are only reset by grouping.
+                for (const ObjectGroup group: touched_groups_) {
+                    group_counts_[group] = 0;
+                }
+                touched_groups_.clear();
+
                 groups = ObjectGroups {
                     .objects       = output_.data(),
                     .object_count  = output_.size(),
                     .group_min     = group_min_,
                     .group_max     = group_max_,
                     .group_offsets = nullptr,
+                    .group_sizes   = nullptr,
                     .group_mask    = nullptr,
                 };
             }
@@ -129,27 +152,26 @@ namespace mantle {
             input_.clear();
             group_min_ = std::numeric_limits<ObjectGroup>::max();
             group_max_ = std::numeric_limits<ObjectGroup>::min();
-            for (size_t& bucket: group_buckets_) {
-                bucket = 0;
-            }
 
             return groups;
         }
 
     private:
-        using GroupBucketArray = std::array<size_t, std::numeric_limits<ObjectGroup>::max() + 0>;
-        using GroupOffsetArray = std::array<size_t, std::numeric_limits<ObjectGroup>::max() + 1>;
-
-        std::vector<Object*> input_;
-        ObjectGroup          group_min_;
-        ObjectGroup          group_max_;
-        GroupBucketArray     group_buckets_;
-
-        std::vector<Object*> output_;
-        GroupOffsetArray     group_offsets_;
-        ObjectGroupMask      group_mask_;
-
-        Metrics              metrics_;
+        // Counts are zero for every group that hasn't been touched since the last flush. Offsets and
+        // sizes are only meaningful for the groups set in the mask.
+        std::vector<Object*>      input_;
+        ObjectGroup               group_min_;
+        ObjectGroup               group_max_;
+        std::unique_ptr<size_t[]> group_counts_;
+        std::vector<ObjectGroup>  touched_groups_;
+
+        std::vector<Object*>      output_;
+        std::unique_ptr<size_t[]> group_offsets_;
+        std::unique_ptr<size_t[]> group_sizes_;
+        ObjectGroupMask           group_mask_;
+        std::vector<ObjectGroup>  flushed_groups_;
+
+        Metrics                   metrics_;
     };
 
 }
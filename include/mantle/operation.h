@@ -100,7 +100,9 @@ namespace mantle {
     static_assert(std::is_trivial_v<Operation>, "Operation must be a trivial type.");
 
     // NOTE: `capacity == size` since it is always padded by null operations.
-    struct alignas(64) OperationBatch {
+    struct alignas(CACHE_LINE_SIZE) OperationBatch {
+        using Entry = Operation;
+
         static constexpr size_t SIZE  = CACHE_LINE_SIZE / sizeof(Operation);
         static constexpr size_t SHIFT = log2_floor(SIZE);
         static constexpr size_t MASK  = SIZE - 1; // TODO: Remove this.
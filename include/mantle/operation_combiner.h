@@ -0,0 +1,165 @@
+#pragma once
+
+#include <bit>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include "mantle/util.h"
+#include "mantle/object.h"
+#include "mantle/operation.h"
+
+namespace mantle {
+
+    // A small direct-mapped cache on the region thread that folds operations on the same object
+    // together before they reach the ledger. Copying a handle and dropping it again within one
+    // transaction then costs no ledger entries at all.
+    //
+    // Each object maps to a single slot. An object that lands on a slot held by another one evicts
+    // it, and the evicted net delta is written out straight away. Folding only ever replaces a
+    // region's own operations with their sum, so the counts the domain applies are unchanged.
+    //
+    class OperationCombiner {
+    public:
+        // The capacity is rounded up to a power of two. Zero disables the cache.
+        explicit OperationCombiner(const size_t capacity = 0)
+            : entries_(capacity ? std::bit_ceil(capacity) : 0)
+            , mask_(entries_.empty() ? 0 : (entries_.size() - 1))
+            , written_count_(0)
+            , emitted_count_(0)
+        {
+            occupied_.reserve(entries_.size());
+        }
+
+        [[nodiscard]]
+        bool is_enabled() const {
+            return !entries_.empty();
+        }
+
+        [[nodiscard]]
+        size_t capacity() const {
+            return entries_.size();
+        }
+
+        // Returns true if no operations are waiting to be written out.
+        [[nodiscard]]
+        bool is_empty() const {
+            return occupied_.empty();
+        }
+
+        // The number of operations that went into the cache, and the number that came out of it.
+        [[nodiscard]]
+        size_t written_count() const {
+            return written_count_;
+        }
+
+        [[nodiscard]]
+        size_t emitted_count() const {
+            return emitted_count_;
+        }
+
+        // Fold an operation into its object's slot. An object that held the slot before is evicted,
+        // and its net delta is handed to the sink, which must take every operation it's given.
+        //
+        // NOTE: The sink may call back into the combiner, so the slot is reassigned before the
+        //       evicted delta is written out.
+        template<typename Sink>
+        MANTLE_HOT void write(const Operation operation, Sink&& sink) {
+            assert(is_enabled());
+
+            Object* object = operation.mutable_object();
+            assert(object);
+
+            written_count_ += 1;
+
+            const size_t index = to_index(object);
+            Entry& entry = entries_[index];
+            if (LIKELY(entry.key == object)) {
+                entry.delta += operation.value();
+                return;
+            }
+
+            const Entry evicted = std::exchange(entry, Entry { .key = object, .delta = operation.value() });
+            if (!evicted.key) {
+                occupied_.push_back(index);
+                return;
+            }
+
+            [[maybe_unused]] const int64_t remainder = emit(evicted, sink);
+            assert(remainder == 0);
+        }
+
+        // Hand the net delta of every slot to the sink, which returns false once it can't take any
+        // more. Whatever is left stays in the cache. Returns true if the cache was emptied.
+        template<typename Sink>
+        bool flush(Sink&& sink) {
+            while (!occupied_.empty()) {
+                const size_t index = occupied_.back();
+                occupied_.pop_back();
+
+                const Entry entry = std::exchange(entries_[index], Entry {});
+                if (const int64_t remainder = emit(entry, sink)) {
+                    entries_[index] = { .key = entry.key, .delta = remainder };
+                    occupied_.push_back(index);
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+    private:
+        struct Entry {
+            Object* key   = nullptr;
+            int64_t delta = 0;
+        };
+
+        size_t to_index(Object* key) const {
+            uintptr_t ptr;
+            memcpy(&ptr, &key, sizeof(ptr));
+            return (ptr >> SHIFT) & mask_;
+        }
+
+        // Write a net delta out as operations that sum to it, each taking the delta to the nearest power
+        // of two. That way a delta never needs more operations than went into it, e.g. 127 is +128 -1.
+        // Returns the part of the delta the sink didn't take.
+        template<typename Sink>
+        int64_t emit(const Entry entry, Sink&& sink) {
+            int64_t delta = entry.delta;
+
+            while (delta != 0) {
+                const OperationType type = (delta > 0) ? OperationType::INCREMENT : OperationType::DECREMENT;
+                const uint64_t magnitude = static_cast<uint64_t>((delta > 0) ? delta : -delta);
+
+                uint64_t exponent = log2_floor(magnitude);
+                if ((magnitude - (uint64_t{1} << exponent)) > ((uint64_t{2} << exponent) - magnitude)) {
+                    exponent += 1;
+                }
+                exponent = std::min<uint64_t>(exponent, Operation::EXPONENT_MAX);
+
+                const Operation operation = make_operation(entry.key, type, static_cast<uint8_t>(exponent));
+                if (!sink(operation)) {
+                    break;
+                }
+
+                emitted_count_ += 1;
+                delta -= operation.value();
+            }
+
+            return delta;
+        }
+
+    private:
+        static constexpr uintptr_t SHIFT = log2_floor(alignof(Object));
+
+        std::vector<Entry>  entries_;
+        std::vector<size_t> occupied_; // Slots that hold an object, each listed once.
+        size_t              mask_;
+        size_t              written_count_;
+        size_t              emitted_count_;
+    };
+
+}
@@ -4,13 +4,14 @@
 #include <vector>
 #include <cstdint>
 #include <cstddef>
+#include "mantle/config.h"
 #include "mantle/object_cache.h"
 #include "mantle/operation.h"
 
 namespace mantle {
 
     struct OperationGrouperMetrics {
-        size_t grouped_count           = 0;
+        size_t grouped_count           = 0; // Operations merged into another by the radix engine.
 
         size_t written_count           = 0;
         size_t written_increment_count = 0;
@@ -19,6 +20,10 @@ namespace mantle {
         size_t flushed_count           = 0;
         size_t flushed_increment_count = 0;
         size_t flushed_decrement_count = 0;
+
+        size_t evicted_count           = 0; // Groups flushed early to make room for another object.
+        size_t cache_capacity          = 0;
+        size_t resize_count            = 0;
     };
 
     // This class attempts to reduce the number of random memory writes needed to update reference counts
@@ -29,24 +34,43 @@ namespace mantle {
     //   1. Increments can be applied before decrements.
     //   2. The prefetcher should have an easier time predicting what will be touched next.
     //
+    // With `GrouperEngine::RADIX` the cache isn't used. Every operation goes straight to the collections,
+    // which are sorted by object and merged when they're flushed.
+    //
+    // The cache can be resized at cycle boundaries. It grows when a cycle evicts a quarter of its capacity
+    // or more, and shrinks when it has stayed below an eighth of its capacity for a number of cycles.
+    //
     class OperationGrouper {
-        static constexpr size_t CACHE_SIZE = 512;
         static constexpr size_t CACHE_WAYS = 8;
 
+        static constexpr size_t GROW_EVICTION_DIVISOR = 4;
+        static constexpr size_t SHRINK_FILL_DIVISOR   = 8;
+        static constexpr size_t SHRINK_CYCLES         = 16;
+
+        // Radix sorting goes through the operations once per digit. Smaller collections are sorted in place.
+        static constexpr size_t RADIX_BITS     = 8;
+        static constexpr size_t RADIX_SORT_MIN = 256;
+
         struct OperationGroup {
             int64_t delta = 0;
             size_t  hit_count = 0;
             size_t  hit_decay = 0;
         };
 
-        using Cache       = ObjectCache<OperationGroup, CACHE_SIZE, CACHE_WAYS>;
+        using Cache       = ObjectCache<OperationGroup, CACHE_WAYS>;
         using CacheEntry  = Cache::Entry;
         using CacheCursor = Cache::Cursor;
 
     public:
         using Metrics = OperationGrouperMetrics;
 
-        OperationGrouper();
+        // A maximum size no larger than the initial one keeps the cache at a fixed size.
+        explicit OperationGrouper(
+            size_t                cache_size     = OPERATION_GROUPER_CACHE_SIZE,
+            size_t                cache_size_max = 0,
+            GrouperEvictionPolicy eviction       = GrouperEvictionPolicy::SMALLEST_DELTA,
+            GrouperEngine         engine         = GrouperEngine::CACHE
+        );
 
         [[nodiscard]]
         const Metrics& metrics() const;
@@ -74,13 +98,43 @@ namespace mantle {
         // Clear the increment and decrement collections.
         void clear();
 
+        // Flush operations and set the increment and decrement collections aside, so that new operations
+        // can be written while these are applied. Anything set aside earlier must be cleared first.
+        void retire(bool force = false);
+
+        // Returns true if retired operations haven't been cleared yet.
+        [[nodiscard]]
+        bool has_retired() const;
+
+        [[nodiscard]]
+        std::span<std::pair<Object*, int64_t>> retired_increments();
+
+        [[nodiscard]]
+        std::span<std::pair<Object*, int64_t>> retired_decrements();
+
+        // Clear the retired increment and decrement collections.
+        void clear_retired();
+
         // Equivelent to calling flush(true) and then clear().
         void reset();
 
+        // The number of groups the cache can hold right now.
+        [[nodiscard]]
+        size_t cache_capacity() const;
+
     private:
         // Select a cache entry for this object using a bunch of heuristics.
         CacheCursor choose_way(Object* object);
 
+        // Sort the increment and decrement collections by object, and merge operations on the same one.
+        void merge_collections();
+
+        // Sort by object address, using the scratch space as a second buffer.
+        static void sort_by_object(std::vector<std::pair<Object*, int64_t>>& values, std::vector<std::pair<Object*, int64_t>>& scratch);
+
+        // Decide whether the cache should be resized, based on the cycle that just ended.
+        void maybe_resize();
+
         void flush_group(CacheCursor cursor, bool force);
         void reset_group(CacheCursor cursor);
 
@@ -90,9 +144,22 @@ namespace mantle {
     private:
         std::vector<std::pair<Object*, int64_t>> increments_;
         std::vector<std::pair<Object*, int64_t>> decrements_;
+        std::vector<std::pair<Object*, int64_t>> retired_increments_;
+        std::vector<std::pair<Object*, int64_t>> retired_decrements_;
+        std::vector<std::pair<Object*, int64_t>> merge_buffer_;  // Private to `merge_collections`.
+        std::vector<std::pair<Object*, int64_t>> merge_scratch_;
         size_t                                   cache_size_;
+        size_t                                   cache_size_min_;
+        size_t                                   cache_size_max_;
+        GrouperEvictionPolicy                    eviction_;
+        GrouperEngine                            engine_;
         Metrics                                  metrics_;
         Cache                                    cache_;
+
+        // What happened to the cache since the last cycle boundary.
+        size_t                                   cycle_evicted_count_;
+        size_t                                   cycle_peak_size_;
+        size_t                                   low_cycle_count_;
     };
 
 }
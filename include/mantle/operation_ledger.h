@@ -1,14 +1,21 @@
 #pragma once
 
+#include <bit>
+#include <span>
 #include <memory>
+#include <optional>
+#include <algorithm>
+#include <vector>
 #include <cstdint>
 #include <cstddef>
 #include "mantle/types.h"
 #include "mantle/config.h"
 #include "mantle/util.h"
 #include "mantle/ring.h"
+#include "mantle/memory_mapping.h"
 #include "mantle/operation.h"
 #include "mantle/operation_writer.h"
+#include "mantle/compact_operation.h"
 
 namespace mantle {
 
@@ -47,17 +54,186 @@ namespace mantle {
         Ring<Sequence> data_;
     };
 
+    // Operations written while the ledger was full, kept per transaction. These are submitted
+    // alongside the ledger's ranges and must outlive the cycles that submit them.
+    struct OperationSpill {
+        std::vector<Operation> increments;
+        std::vector<Operation> decrements;
+
+        [[nodiscard]]
+        bool is_empty() const {
+            return increments.empty() && decrements.empty();
+        }
+
+        void write(const Operation operation) {
+            if (operation.type() == OperationType::INCREMENT) {
+                increments.push_back(operation);
+            }
+            else {
+                decrements.push_back(operation);
+            }
+        }
+
+        void clear() {
+            increments.clear();
+            decrements.clear();
+        }
+    };
+
+    // A ring of operation batches in a mapping that is reserved up front. Pages are only committed as
+    // batches are first written, and can be decommitted again while they aren't in use.
+    class LedgerStorage {
+    public:
+        LedgerStorage(size_t batch_count, HugePagePolicy huge_pages, std::optional<size_t> numa_node)
+            : memory_(map_memory(std::bit_ceil(batch_count) * sizeof(OperationBatch), huge_pages, numa_node))
+            , huge_pages_(huge_pages)
+            , mask_(std::bit_ceil(batch_count) - 1)
+        {
+        }
+
+        ~LedgerStorage() {
+            unmap_memory(memory_, huge_pages_);
+        }
+
+        LedgerStorage(LedgerStorage&&) = delete;
+        LedgerStorage(const LedgerStorage&) = delete;
+        LedgerStorage& operator=(LedgerStorage&&) = delete;
+        LedgerStorage& operator=(const LedgerStorage&) = delete;
+
+        // The number of batches in the ring.
+        [[nodiscard]]
+        size_t size() const {
+            return mask_ + 1;
+        }
+
+        [[nodiscard]]
+        std::span<const std::byte> memory() const {
+            return memory_;
+        }
+
+        OperationBatch& operator[](const Sequence batch) {
+            return batches()[batch & mask_];
+        }
+
+        const OperationBatch& operator[](const Sequence batch) const {
+            return batches()[batch & mask_];
+        }
+
+        // The same lines, with a compact encoding.
+        CompactOperationBatch& compact_batch(const Sequence batch) {
+            return compact_batches()[batch & mask_];
+        }
+
+        const CompactOperationBatch& compact_batch(const Sequence batch) const {
+            return compact_batches()[batch & mask_];
+        }
+
+        // Decommit the pages that only hold batches in this range. It can't be longer than the ring.
+        void decommit(const Sequence head_batch, const Sequence tail_batch) {
+            assert((tail_batch - head_batch) <= size());
+
+            const size_t head = head_batch & mask_;
+            const size_t count = tail_batch - head_batch;
+            const size_t first_count = std::min(count, size() - head);
+
+            decommit_memory(memory_.subspan(head * sizeof(OperationBatch), first_count * sizeof(OperationBatch)), huge_pages_);
+            decommit_memory(memory_.first((count - first_count) * sizeof(OperationBatch)), huge_pages_);
+        }
+
+    private:
+        OperationBatch* batches() const {
+            return reinterpret_cast<OperationBatch*>(memory_.data());
+        }
+
+        CompactOperationBatch* compact_batches() const {
+            return reinterpret_cast<CompactOperationBatch*>(memory_.data());
+        }
+
+    private:
+        std::span<std::byte> memory_;
+        HugePagePolicy       huge_pages_;
+        size_t               mask_;
+    };
+
+    // Writes the ledger's lines as compact batches.
+    class CompactLedgerStorage {
+    public:
+        explicit CompactLedgerStorage(LedgerStorage& storage)
+            : storage_(storage)
+        {
+        }
+
+        CompactOperationBatch& operator[](const Sequence batch) {
+            return storage_.compact_batch(batch);
+        }
+
+    private:
+        LedgerStorage& storage_;
+    };
+
+    // With `LedgerEncoding::COMPACT` every entry is a `CompactOperation`, so the capacity counts those,
+    // and an operation that has to be escaped takes up several entries. Readers go through
+    // `for_each_operation`, which decodes either encoding.
     class OperationLedger {
     public:
-        explicit OperationLedger(size_t ledger_capacity)
-            : storage_(ledger_capacity)
+        // Pages are given back once fewer than `decommit_fill` of the entries have been in use for
+        // `decommit_cycles` transactions in a row, and are never given back if that is zero.
+        explicit OperationLedger(
+            size_t                ledger_capacity,
+            HugePagePolicy        huge_pages      = HugePagePolicy::NONE,
+            std::optional<size_t> numa_node       = std::nullopt,
+            double                decommit_fill   = LEDGER_DECOMMIT_FILL,
+            size_t                decommit_cycles = LEDGER_DECOMMIT_CYCLES,
+            LedgerEncoding        encoding        = LedgerEncoding::FULL
+        )
+            : compact_(encoding == LedgerEncoding::COMPACT)
+            , batch_shift_(compact_ ? CompactOperationBatch::SHIFT : OperationBatch::SHIFT)
+            , capacity_(std::bit_ceil(std::max(ledger_capacity, size_t{1} << batch_shift_)))
+            , storage_(capacity_ >> batch_shift_, huge_pages, numa_node)
+            , compact_storage_(storage_)
             , transaction_log_(TRANSACTION_LOG_HISTORY)
             , transaction_head_(0)
-            , transaction_tail_(storage_.size())
+            , transaction_tail_(capacity_)
             , writer_(storage_, transaction_head_, transaction_tail_)
+            , compact_writer_(compact_storage_, transaction_head_, transaction_tail_)
+            , escaped_count_(0)
+            , decommit_entries_(static_cast<size_t>(static_cast<double>(capacity_) * std::clamp(decommit_fill, 0.0, 1.0)))
+            , decommit_cycles_(decommit_cycles)
+            , low_cycle_count_(0)
+            , decommit_cursor_(0)
+            , decommit_count_(0)
         {
         }
 
+        // The number of entries that can be held by uncommitted and unretired transactions.
+        [[nodiscard]]
+        size_t capacity() const {
+            return capacity_;
+        }
+
+        // The mapping behind the ledger, of which only the pages in use are committed.
+        [[nodiscard]]
+        std::span<const std::byte> memory() const {
+            return storage_.memory();
+        }
+
+        // The number of times unused pages were given back.
+        [[nodiscard]]
+        size_t decommit_count() const {
+            return decommit_count_;
+        }
+
+        [[nodiscard]]
+        LedgerEncoding encoding() const {
+            return compact_ ? LedgerEncoding::COMPACT : LedgerEncoding::FULL;
+        }
+
+        // The number of operations that were too far from the others to be compacted.
+        [[nodiscard]]
+        size_t escaped_count() const {
+            return escaped_count_;
+        }
+
         [[nodiscard]]
         const SequenceRangeHistory& transaction_log() const {
             return transaction_log_;
@@ -65,19 +241,36 @@ namespace mantle {
 
         [[nodiscard]]
         bool is_empty() const {
-            return (transaction_tail_ - writer_.tell()) == storage_.size();
+            return (transaction_tail_ - tell()) == capacity_;
         }
 
         void begin_transaction() {
-            transaction_head_ = writer_.tell();
-            transaction_tail_ = transaction_log_.select(-1).tail + storage_.size();
+            const Sequence retired = transaction_log_.select(-1).tail;
+
+            transaction_head_ = tell();
+            transaction_tail_ = retired + capacity_;
 
-            writer_.reset(transaction_head_, transaction_tail_);
+            if (compact_) {
+                compact_writer_.reset(transaction_head_, transaction_tail_);
+            }
+            else {
+                writer_.reset(transaction_head_, transaction_tail_);
+            }
+
+            if (decommit_cycles_ > 0) {
+                maybe_decommit(retired);
+            }
         }
 
         SequenceRange commit_transaction() {
-            writer_.flush();
-            transaction_log_.insert(writer_.tell());
+            if (compact_) {
+                compact_writer_.flush();
+            }
+            else {
+                writer_.flush();
+            }
+
+            transaction_log_.insert(tell());
             return transaction_log_.select(0);
         }
 
@@ -87,10 +280,12 @@ namespace mantle {
         //
         [[nodiscard]]
         const OperationBatch& read_batch(const Sequence sequence) const {
+            assert(!compact_);
             return storage_[sequence >> OperationBatch::SHIFT];
         }
 
-        // Returns a reference to the operation corresponding to this sequence.
+        // Returns a reference to the operation corresponding to this sequence. Compact ledgers can
+        // only be read in order, with `for_each_operation`.
         //
         // NOTE: Reading an operation that hasn't been published in a transaction is undefined behavior.
         //
@@ -99,30 +294,155 @@ namespace mantle {
             return read_batch(sequence).operations[sequence & OperationBatch::MASK];
         }
 
+        // Visit every operation in a committed range, including the null ones that pad it.
+        template<typename Visitor>
+        MANTLE_HOT void for_each_operation(const SequenceRange range, Visitor&& visitor) const {
+            if (LIKELY(!compact_)) {
+                for (Sequence sequence = range.head; sequence != range.tail; ++sequence) {
+                    visitor(read(sequence));
+                }
+                return;
+            }
+
+            // Whole lines are decoded at a time, and escapes never leave the range they were written in.
+            Sequence sequence = range.head;
+            while (sequence != range.tail) {
+                const CompactOperationBatch& batch = storage_.compact_batch(sequence >> CompactOperationBatch::SHIFT);
+                const size_t first = sequence & CompactOperationBatch::MASK;
+                const size_t last = std::min<size_t>(CompactOperationBatch::SIZE, first + (range.tail - sequence));
+
+                size_t index = first;
+                while (index < last) {
+                    const CompactOperation entry = batch.operations[index];
+                    if (UNLIKELY(entry.is_escape())) {
+                        const Sequence escaped = sequence + (index - first);
+                        visitor(CompactOperationCodec::unescape(read_compact(escaped + 1), read_compact(escaped + 2)));
+                        index += CompactOperation::ESCAPED_SIZE;
+                        continue;
+                    }
+
+                    visitor(codec_.decode(entry));
+                    index += 1;
+                }
+
+                // An escape can run into the next line.
+                sequence += index - first;
+            }
+        }
+
         // Adds an operation to the current, uncommitted transaction.
         // This can fail and return false if the ledger is full.
         MANTLE_HOT bool write(const Operation operation) {
-            return writer_.write(operation);
+            if (LIKELY(!compact_)) {
+                return writer_.write(operation);
+            }
+
+            return write_compact(operation);
+        }
+
+        // Adds as many of the operations as fit to the current transaction, and returns how many that was.
+        MANTLE_HOT size_t write(const std::span<const Operation> operations) {
+            if (LIKELY(!compact_)) {
+                return writer_.write(operations);
+            }
+
+            size_t count = 0;
+            while ((count < operations.size()) && write_compact(operations[count])) {
+                count += 1;
+            }
+
+            return count;
         }
 
         // Return the number of entries that can still be written to the current transaction.
         [[nodiscard]]
         size_t writable_transaction_entries() const {
-            const Sequence ceiling = transaction_log_.select(-1).tail + storage_.size();
-            return ceiling - writer_.tell();
+            const Sequence ceiling = transaction_log_.select(-1).tail + capacity_;
+            return ceiling - tell();
+        }
+
+    private:
+        Sequence tell() const {
+            return compact_ ? compact_writer_.tell() : writer_.tell();
+        }
+
+        [[nodiscard]]
+        CompactOperation read_compact(const Sequence sequence) const {
+            return storage_.compact_batch(sequence >> CompactOperationBatch::SHIFT).operations[sequence & CompactOperationBatch::MASK];
+        }
+
+        MANTLE_HOT bool write_compact(const Operation operation) {
+            CompactOperation entry;
+            if (LIKELY(codec_.encode(operation, entry))) {
+                return compact_writer_.write(entry);
+            }
+
+            // Escapes are written whole, or not at all.
+            if (compact_writer_.available() < CompactOperation::ESCAPED_SIZE) {
+                return false;
+            }
+
+            // Entry by entry, as the batched write streams whole batches out of its input.
+            for (const CompactOperation& escaped: CompactOperationCodec::escape(operation)) {
+                compact_writer_.write(escaped);
+            }
+            escaped_count_ += 1;
+            return true;
+        }
+
+        // Everything before `retired` has been retired, and everything from the writer on is unwritten.
+        // Only pages that were written since they were last decommitted are worth giving back.
+        void maybe_decommit(const Sequence retired) {
+            const Sequence head = tell();
+            if ((head - retired) >= decommit_entries_) {
+                low_cycle_count_ = 0;
+                return;
+            }
+
+            if (++low_cycle_count_ < decommit_cycles_) {
+                return;
+            }
+
+            // The ring has wrapped around since it was last decommitted if this is more than its size.
+            const Sequence first = std::max(decommit_cursor_, head - std::min(head, static_cast<Sequence>(capacity_)));
+            if ((retired - std::min(retired, first)) >= (MINIMUM_DECOMMIT_BATCHES << batch_shift_)) {
+                storage_.decommit(first >> batch_shift_, retired >> batch_shift_);
+                decommit_cursor_ = retired;
+                decommit_count_ += 1;
+            }
+
+            low_cycle_count_ = 0;
         }
 
     private:
         static constexpr size_t TRANSACTION_LOG_HISTORY = 4;
 
-        using Storage = Ring<OperationBatch>;
+        // Don't bother giving back less than a page's worth of entries.
+        static constexpr size_t MINIMUM_DECOMMIT_BATCHES = PAGE_SIZE / sizeof(OperationBatch);
+
+        using Storage = LedgerStorage;
         using Writer = OperationWriter<Storage>;
+        using CompactWriter = OperationWriter<CompactLedgerStorage, CompactOperationBatch>;
 
+        bool                  compact_;
+        size_t                batch_shift_;
+        size_t                capacity_;
         Storage               storage_;
+        CompactLedgerStorage  compact_storage_;
         SequenceRangeHistory  transaction_log_;
         Sequence              transaction_head_;
         Sequence              transaction_tail_;
-        Writer                writer_;
+        Writer                writer_;         // Only without a compact encoding.
+        CompactWriter         compact_writer_; // Only with one.
+        CompactOperationCodec codec_;
+        size_t                escaped_count_;
+
+        // Private to `maybe_decommit`.
+        size_t                decommit_entries_;
+        size_t                decommit_cycles_;
+        size_t                low_cycle_count_;
+        Sequence              decommit_cursor_;
+        size_t                decommit_count_;
     };
 
 }
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "mantle/types.h"
+#include "mantle/util.h"
+#include "mantle/object.h"
+#include "mantle/operation.h"
+#include "mantle/operation_ledger.h"
+
+namespace mantle {
+
+    // The operations of a committed transaction, sorted by the region that owns their objects
+    // and by type. Regions build these while committing so that the domain can hand each
+    // controller its slice without dereferencing any objects during routing.
+    class OperationPartition {
+    public:
+        OperationPartition() = default;
+
+        OperationPartition(OperationPartition&&) = delete;
+        OperationPartition(const OperationPartition&) = delete;
+        OperationPartition& operator=(OperationPartition&&) = delete;
+        OperationPartition& operator=(const OperationPartition&) = delete;
+
+        [[nodiscard]]
+        size_t size() const {
+            return operations_.size();
+        }
+
+        // Operations on objects that aren't bound to any region. These can't be routed, and are left
+        // out of every slice.
+        [[nodiscard]]
+        size_t unowned_count() const {
+            return unowned_count_;
+        }
+
+        // One more than the largest region id with operations in this partition.
+        [[nodiscard]]
+        size_t region_count() const {
+            // The last region's keys may not all be present, so round up.
+            return offsets_.empty() ? 0 : ((offsets_.size() - 1 + OPERATION_TYPE_COUNT - 1) / OPERATION_TYPE_COUNT);
+        }
+
+        [[nodiscard]]
+        std::span<const Operation> slice(const RegionId region_id, const OperationType type) const {
+            const size_t key = to_key(region_id, type);
+            if ((key + 1) >= offsets_.size()) {
+                return {};
+            }
+
+            return {
+                operations_.data() + offsets_[key],
+                offsets_[key + 1] - offsets_[key],
+            };
+        }
+
+        // Rebuild the partition from a committed range of the ledger.
+        void assign(const OperationLedger& ledger, const SequenceRange range) {
+            clear();
+
+            // Bucket operations by destination and type. We've probably just touched these objects,
+            // so reading their region here should be much cheaper than it would be on the domain.
+            size_t key_count = 0;
+            ledger.for_each_operation(range, [&](const Operation operation) {
+                const Object* object = operation.object();
+                if (!object) {
+                    return; // Padding.
+                }
+
+                const RegionId region_id = object->region_id();
+                if (UNLIKELY(region_id == INVALID_REGION_ID)) {
+                    unowned_count_ += 1;
+                    return;
+                }
+
+                const size_t key = to_key(region_id, operation.type());
+                if (key >= key_count) {
+                    key_count = key + 1;
+                    counts_.resize(key_count, 0);
+                }
+
+                counts_[key] += 1;
+                scratch_.push_back({key, operation});
+            });
+
+            // Calculate offsets. The cumulative offset is stored at the end.
+            offsets_.resize(key_count + 1);
+            {
+                size_t offset = 0;
+                for (size_t key = 0; key < key_count; ++key) {
+                    offsets_[key] = offset;
+                    offset += counts_[key];
+                }
+                offsets_[key_count] = offset;
+            }
+
+            // Scatter operations into their slices.
+            operations_.resize(scratch_.size());
+            for (auto&& [key, operation]: scratch_) {
+                operations_[offsets_[key + 1] - counts_[key]] = operation;
+                counts_[key] -= 1;
+            }
+
+            scratch_.clear();
+        }
+
+        void clear() {
+            operations_.clear();
+            offsets_.clear();
+            counts_.clear();
+            scratch_.clear();
+            unowned_count_ = 0;
+        }
+
+    private:
+        static size_t to_key(const RegionId region_id, const OperationType type) {
+            return (static_cast<size_t>(region_id) * OPERATION_TYPE_COUNT) + to_index(type);
+        }
+
+    private:
+        std::vector<Operation>                     operations_;
+        std::vector<size_t>                        offsets_;
+        std::vector<size_t>                        counts_;
+        std::vector<std::pair<size_t, Operation>>  scratch_;
+        size_t                                     unowned_count_ = 0;
+    };
+
+}
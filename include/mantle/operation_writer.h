@@ -1,22 +1,34 @@
 #pragma once
 
+#include <span>
 #include <vector>
+#include <algorithm>
 #include <cstring>
 #include <cstdint>
 #include <cstddef>
 #include <cassert>
-#include <emmintrin.h>
+#include <atomic>
+
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#elif defined(__aarch64__)
+#  include <arm_neon.h>
+#endif
+
 #include "mantle/types.h"
 #include "mantle/util.h"
 #include "mantle/operation.h"
 
 namespace mantle {
 
-    // This class streams batches of operations to memory, bypassing the CPU cache hierarchy.
-    template<typename Storage_>
+    // This class streams batches of operations to memory, bypassing the CPU cache hierarchy. The batch
+    // decides how operations are encoded, and the storage hands out batches by index.
+    template<typename Storage_, typename Batch_ = OperationBatch>
     class OperationWriter {
     public:
         using Storage = Storage_;
+        using Batch = Batch_;
+        using Entry = typename Batch::Entry;
 
         OperationWriter(Storage& storage, Sequence head = 0, Sequence tail = 0)
             : storage_(storage)
@@ -37,35 +49,56 @@ namespace mantle {
             return head_;
         }
 
+        // The number of entries that can still be written before running into the tail.
+        size_t available() const {
+            return tail_ - head_;
+        }
+
         // TODO: Look at the code-gen for this. I think it might suck.
         //       We want a fairly short instruction sequence so it can inline.
-        MANTLE_HOT bool write(Operation operation) {
+        MANTLE_HOT bool write(Entry operation) {
             if (head_ == tail_) {
                 return false;
             }
 
-            size_t operation_index = head_ & OperationBatch::MASK;
+            size_t operation_index = head_ & Batch::MASK;
             batch_.operations[operation_index] = operation;
 
             // Stream the batch to memory if we just completed it.
-            if (operation_index == OperationBatch::MASK) {
-                size_t batch_index = head_ >> OperationBatch::SHIFT;
+            if (operation_index == Batch::MASK) {
+                size_t batch_index = head_ >> Batch::SHIFT;
+                stream_batch(storage_[batch_index], batch_.operations);
+            }
+
+            head_ += 1;
 
-                OperationBatch* target_batch = &storage_[batch_index];
-                __m128i* target_pointer = (__m128i*)target_batch;
+            return true;
+        }
 
-                const OperationBatch* source_batch = &batch_;
-                const __m128i* source_pointer = (const __m128i*)source_batch;
+        // Write as many of the operations as there is room for, and return how many that was. The bounds
+        // are only checked once, and whole batches go straight from the operations to memory.
+        MANTLE_HOT size_t write(std::span<const Entry> operations) {
+            const size_t count = std::min<size_t>(operations.size(), tail_ - head_);
+            size_t index = 0;
 
-                _mm_stream_si128(target_pointer+0, _mm_load_si128(source_pointer+0));
-                _mm_stream_si128(target_pointer+1, _mm_load_si128(source_pointer+1));
-                _mm_stream_si128(target_pointer+2, _mm_load_si128(source_pointer+2));
-                _mm_stream_si128(target_pointer+3, _mm_load_si128(source_pointer+3));
+            // Top up the batch we're in the middle of.
+            while ((index < count) && (head_ & Batch::MASK)) {
+                write(operations[index++]);
             }
 
-            head_ += 1;
+            while ((count - index) >= Batch::SIZE) {
+                // The operations needn't be aligned to a batch.
+                stream_batch(storage_[head_ >> Batch::SHIFT], &operations[index]);
 
-            return true;
+                head_ += Batch::SIZE;
+                index += Batch::SIZE;
+            }
+
+            while (index < count) {
+                write(operations[index++]);
+            }
+
+            return count;
         }
 
         // Pad the current batch with null operations and write it out if it is partially full.
@@ -73,26 +106,65 @@ namespace mantle {
         // !!! This must be called to make prior writes visible in other threads. !!!
         //
         void flush() {
-            while (head_ & OperationBatch::MASK) {
-                write(make_null_operation());
+            // Null entries are all zero, whatever the encoding.
+            while (head_ & Batch::MASK) {
+                write(Entry {});
             }
 
-            _mm_sfence();
+            store_fence();
         }
 
         void reset(Sequence head = 0, Sequence tail = 0) {
-            assert(!(head & OperationBatch::MASK));
-            assert(!(tail & OperationBatch::MASK));
+            assert(!(head & Batch::MASK));
+            assert(!(tail & Batch::MASK));
 
             head_ = head;
             tail_ = tail;
         }
 
+    private:
+        // Copy a whole batch to memory without pulling its cache line into the cache. The source only
+        // needs to be aligned like an entry.
+        MANTLE_HOT static void stream_batch(Batch& target, const Entry* source) {
+#if defined(__SSE2__)
+            __m128i* target_pointer = reinterpret_cast<__m128i*>(&target);
+            const __m128i* source_pointer = reinterpret_cast<const __m128i*>(source);
+
+            for (size_t i = 0; i < (sizeof(Batch) / sizeof(__m128i)); ++i) {
+                _mm_stream_si128(target_pointer + i, _mm_loadu_si128(source_pointer + i));
+            }
+#elif defined(__aarch64__)
+            // STNP stores a pair of registers with a hint that they won't be read again soon.
+            std::byte* target_pointer = reinterpret_cast<std::byte*>(&target);
+            const uint64_t* source_pointer = reinterpret_cast<const uint64_t*>(source);
+
+            for (size_t i = 0; i < (sizeof(Batch) / (2 * sizeof(uint64x2_t))); ++i) {
+                const uint64x2_t low = vld1q_u64(source_pointer + (4 * i) + 0);
+                const uint64x2_t high = vld1q_u64(source_pointer + (4 * i) + 2);
+                asm volatile("stnp %q0, %q1, [%2]" :: "w"(low), "w"(high), "r"(target_pointer + (i * 2 * sizeof(uint64x2_t))) : "memory");
+            }
+#else
+            memcpy(&target, source, sizeof(Batch));
+#endif
+        }
+
+        // Order the streamed stores before whatever publishes them. Non-temporal stores are weakly
+        // ordered on x86, and a store barrier covers STNP on aarch64.
+        static void store_fence() {
+#if defined(__SSE2__)
+            _mm_sfence();
+#elif defined(__aarch64__)
+            asm volatile("dmb ishst" ::: "memory");
+#else
+            std::atomic_thread_fence(std::memory_order_release);
+#endif
+        }
+
     private:
         Storage&       storage_;
         Sequence       head_;
         Sequence       tail_;
-        OperationBatch batch_;
+        Batch          batch_;
     };
 
     using OperationVector = std::vector<OperationBatch>;
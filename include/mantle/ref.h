@@ -18,8 +18,9 @@ namespace mantle {
         {
             Region* region = Region::thread_local_instance();
             assert(region);
+            assert(region->has_write_barriers());
 
-            static_cast<Object&>(object).bind(region->id());
+            region->bind_object(object);
         }
 
     public:
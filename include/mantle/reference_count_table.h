@@ -0,0 +1,132 @@
+#pragma once
+
+#include <span>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <optional>
+#include <utility>
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include "mantle/config.h"
+#include "mantle/util.h"
+#include "mantle/memory_mapping.h"
+
+namespace mantle {
+
+    // Reference counts of the objects that a region owns, kept out of the objects themselves. Objects
+    // store the index of their slot instead, so applying operations only writes to this dense table
+    // and the cache lines of live objects stay with the threads that use them.
+    //
+    // Slots are handed out by the owning region's thread, and their counts are only touched by whoever
+    // applies the region's operations. Dead objects give their slots back in batches, which the region
+    // picks up once it runs out of its own.
+    //
+    class ReferenceCountTable {
+    public:
+        using Slot  = uint32_t;
+        using Count = uint32_t;
+
+        // The table is only ever written by the domain, so it should live on the domain's NUMA node.
+        // The mapping is reserved up front, and pages are only populated as slots are first used.
+        explicit ReferenceCountTable(const size_t capacity, const std::optional<size_t> numa_node = std::nullopt)
+            : counts_(map_memory(capacity * sizeof(Count), HugePagePolicy::NONE, numa_node))
+            , capacity_(capacity)
+            , next_slot_(0)
+            , has_released_slots_(false)
+        {
+        }
+
+        ~ReferenceCountTable() {
+            unmap_memory(counts_, HugePagePolicy::NONE);
+        }
+
+        ReferenceCountTable(ReferenceCountTable&&) = delete;
+        ReferenceCountTable(const ReferenceCountTable&) = delete;
+        ReferenceCountTable& operator=(ReferenceCountTable&&) = delete;
+        ReferenceCountTable& operator=(const ReferenceCountTable&) = delete;
+
+        [[nodiscard]]
+        size_t capacity() const {
+            return capacity_;
+        }
+
+        [[nodiscard]]
+        Count count(const Slot slot) const {
+            assert(slot < capacity_);
+            return counts()[slot];
+        }
+
+        // Only the owning region's thread may call this. Released slots are always zero.
+        [[nodiscard]]
+        Slot allocate() {
+            if (UNLIKELY(free_slots_.empty()) && has_released_slots_.load(std::memory_order_acquire)) {
+                std::scoped_lock lock(released_slots_mutex_);
+                std::swap(free_slots_, released_slots_);
+                has_released_slots_.store(false, std::memory_order_relaxed);
+            }
+
+            if (LIKELY(!free_slots_.empty())) {
+                const Slot slot = free_slots_.back();
+                free_slots_.pop_back();
+                return slot;
+            }
+
+            if (UNLIKELY(next_slot_ == capacity_)) {
+                abort(); // Raise `Config::reference_count_table_capacity`.
+            }
+
+            return static_cast<Slot>(next_slot_++);
+        }
+
+        // Give back the slots of objects that have died.
+        void release(const std::span<const Slot> slots) {
+            if (slots.empty()) {
+                return;
+            }
+
+            std::scoped_lock lock(released_slots_mutex_);
+            released_slots_.insert(released_slots_.end(), slots.begin(), slots.end());
+            has_released_slots_.store(true, std::memory_order_release);
+        }
+
+        // These return `true` if the reference count remains positive, like `Object::apply_increment`
+        // and `Object::apply_decrement`. A slot that drops to zero can be released.
+        bool apply_increment(const Slot slot, const Count delta_magnitude) {
+            counts()[slot] += delta_magnitude;
+            return true;
+        }
+
+        bool apply_decrement(const Slot slot, const Count delta_magnitude) {
+            Count& count = counts()[slot];
+            if (count < delta_magnitude) {
+                count = 0;
+                return false;
+            }
+
+            count -= delta_magnitude;
+            return true;
+        }
+
+    private:
+        Count* counts() const {
+            return reinterpret_cast<Count*>(counts_.data());
+        }
+
+    private:
+        std::span<std::byte> counts_;
+        size_t               capacity_;
+
+        // Private to the owning region.
+        size_t               next_slot_;
+        std::vector<Slot>    free_slots_;
+
+        // Shared with whoever applies the region's operations.
+        std::mutex           released_slots_mutex_;
+        std::vector<Slot>    released_slots_;
+        std::atomic_bool     has_released_slots_;
+    };
+
+}
@@ -1,15 +1,28 @@
 #pragma once
 
 #include <span>
+#include <array>
+#include <vector>
+#include <coroutine>
 #include <string_view>
 #include <utility>
+#include <optional>
+#include <unordered_map>
+#include <cstring>
 #include <cassert>
 #include "mantle/types.h"
 #include "mantle/util.h"
+#include "mantle/object.h"
 #include "mantle/message.h"
 #include "mantle/connection.h"
+#include "mantle/ledger.h"
 #include "mantle/operation.h"
 #include "mantle/operation_ledger.h"
+#include "mantle/fallback_ledger.h"
+#include "mantle/operation_combiner.h"
+#include "mantle/operation_partition.h"
+#include "mantle/reference_count_table.h"
+#include "mantle/heap_census.h"
 
 #define MANTLE_REGION_STATES(X) \
     X(RUNNING)                  \
@@ -27,6 +40,7 @@ namespace mantle {
     class Domain;
     class Object;
     class ObjectFinalizer;
+    class RegionPool;
 
     enum class RegionState {
 #define X(MANTLE_REGION_STATE) \
@@ -44,12 +58,51 @@ namespace mantle {
 #undef X
     };
 
+    struct RegionMetrics {
+        // The number of times a weighted handle on this thread ran out of weight and had to
+        // submit a real increment to the ledger.
+        size_t weight_refill_count = 0;
+
+        // The number of transactions that overflowed the ledger, and the operations that were spilled.
+        size_t overflow_count = 0;
+        size_t spilled_count  = 0;
+
+        // The number of operations folded away by the combining cache before they reached the ledger.
+        size_t combined_count = 0;
+
+        // The number of objects handed to the finalizer.
+        size_t finalized_count = 0;
+
+        // The number of objects bound to this region.
+        size_t bound_count = 0;
+
+        // The number of cycles asked for early because dropped objects held too many bytes.
+        size_t pressure_start_count = 0;
+
+        // The number of retired allocations that have been freed.
+        size_t retired_count = 0;
+
+        // The number of operations applied here with `Config::local_operations`, and of the objects
+        // that died from them.
+        size_t local_count          = 0;
+        size_t local_released_count = 0;
+
+        // The number of operations on `ShardedReferencePolicy` handles that were absorbed by a shard,
+        // and the number of shards that have been taken.
+        size_t sharded_count = 0;
+        size_t shard_count   = 0;
+    };
+
     class Region {
     public:
         using State = RegionState;
         using Phase = RegionPhase;
         using Cycle = Sequence;
+        using Epoch = Sequence;
+        using Metrics = RegionMetrics;
 
+        // The finalizer is used for objects this region bound even after it has left, so it must
+        // outlive the region. See `ObjectFinalizer`.
         Region(Domain& domain, ObjectFinalizer& finalizer);
         ~Region();
 
@@ -64,22 +117,181 @@ namespace mantle {
         Phase phase() const;
         Cycle cycle() const;
 
-        // Call step when this becomes readable.
+        // Counts calls to `step`, which is how long a `Borrow` stays valid.
+        Epoch epoch() const;
+
+        [[nodiscard]]
+        const Metrics& metrics() const;
+
+        // Call step when this becomes readable. This is never readable with `WakeupPolicy::FUTEX`,
+        // so only block in step then.
         int file_descriptor();
 
         void stop();
         void step(bool non_blocking);
 
-    private:
+        // Returns true if `step` has anything to do, without making a system call. Non-blocking
+        // steps return straight away when it doesn't, so loops can call them as often as they like.
+        [[nodiscard]]
+        bool has_work() const;
+
+        // Lets a coroutine on this region's thread wait for the region instead of spinning on `step`.
+        // It is resumed from within `step`, once the LEAVE message it is waiting for has arrived.
+        class Awaiter {
+        public:
+            [[nodiscard]]
+            bool await_ready() const;
+            void await_suspend(std::coroutine_handle<> handle);
+            void await_resume() const noexcept {}
+
+        private:
+            friend class Region;
+
+            Awaiter(Region& region, Cycle cycle, bool quiesce)
+                : region_(region)
+                , cycle_(cycle)
+                , quiesce_(quiesce)
+            {
+            }
+
+            Region& region_;
+            Cycle   cycle_;
+            bool    quiesce_;
+        };
+
+        // Resumes once a cycle that operations written from now on take part in has finished.
+        [[nodiscard]]
+        Awaiter next_cycle();
+
+        // Resumes once everything written so far has been applied, and our garbage finalized.
+        [[nodiscard]]
+        Awaiter quiesce();
+
+        // Free memory that isn't an `Object` once every region has taken part in a cycle that started
+        // after this call. Readers of lock-free containers can't hold on to a pointer past their next
+        // step, so this takes the place of hazard pointers without readers having to publish anything.
+        //
+        // NOTE: Every thread that reads the memory must run a region, like threads that copy handles.
+        //       Memory retired by finalizers while the region is shutting down is leaked.
+        //
+        void retire(void* pointer, void (*deleter)(void*));
+
         template<typename T>
+        void retire(T* pointer) {
+            retire(static_cast<void*>(pointer), [](void* retired) { delete static_cast<T*>(retired); });
+        }
+
+    private:
+        template<typename T, typename Policy>
         friend class Handle;
+        template<typename T>
+        friend class Ref;
         friend class Object;
+        friend class RegionPool;
+
+        // Become the region on this thread, and take part in cycles until ours matches the domain's.
+        void attach_thread();
+        void join();
+
+        // Stop and let go of this thread, keeping the ledger and connection so `adopt` can reuse them.
+        // An adopted region joins under a new id, like a newly constructed one.
+        void park();
+        void adopt();
+
+        void bind_object(Object& object, size_t byte_cost = 0);
 
         MANTLE_HOT void start_increment_operation(Object& object, Operation operation);
         MANTLE_HOT void start_decrement_operation(Object& object, Operation operation);
 
+        // Like the above, but for many operations of either type at once.
+        MANTLE_HOT void start_operations(std::span<const Operation> operations);
+
+        // Count an operation of a `ShardedReferencePolicy` handle against our shard of the object.
+        MANTLE_HOT void start_sharded_operation(Operation operation);
+
+        // Give back shards we haven't used since the last cycle. Objects can only die once every region
+        // has given its shard back. This runs while the domain waits for us to submit, so a shard whose
+        // operations don't fit is kept until the next transaction.
+        void reconcile_shards();
+
+        // Write out the delta of a shard that has grown too large. This only waits for room once the
+        // copies it holds could outgrow the shard's weight, and never with the delta taken out of it.
+        MANTLE_COLD void flush_shard(Object& object);
+
+        // Returns true if we hold shards, which need cycles to be given back.
+        bool has_shards() const;
+
+        // Write a delta as operations of up to the largest weight, as far as there is room for them
+        // without waiting. Returns what is left to write.
+        [[nodiscard]]
+        int64_t try_write_delta(Object& object, int64_t delta);
+
+        // Add an operation to the current transaction, making room for it if needed.
+        MANTLE_HOT void write_operation(Operation operation);
+
+        // Like the above, but returns false instead of waiting for room.
+        [[nodiscard]]
+        bool try_write_operation(Operation operation);
+
         MANTLE_COLD void flush_operation(Operation operation);
 
+        // Returns true if the object may have been bound with a byte cost. This only looks at the filter.
+        bool has_byte_cost(const Object& object) const;
+
+        // Any decrement may be the last one, so the object's bytes are counted, once, until its latest
+        // decrement has been applied.
+        void drop_byte_cost(const Object& object);
+
+        // Like the above, for the decrements among `operations`.
+        void drop_byte_costs(std::span<const Operation> operations);
+
+        // Write out the net deltas of the combining cache, as far as the ledger has room for them.
+        void flush_combined_operations();
+
+        // Returns true if the combining cache holds operations that haven't been written out yet.
+        bool has_combined_operations() const;
+
+        // Returns true if spilled operations haven't all been submitted yet.
+        bool has_spilled_operations() const;
+
+        // Apply the increments committed this cycle and the decrements committed two cycles ago to our
+        // own objects. This runs when RETIRE arrives, since the domain doesn't touch them again until
+        // we've submitted next, and follows the same schedule as the domain.
+        void apply_local_operations();
+
+        // Returns true if operations on our own objects haven't all been applied yet.
+        bool has_local_operations() const;
+
+        // Returns true if threads without a region have written operations this region can take over.
+        bool has_fallback_operations() const;
+
+        // Returns true if `Ref`s can be used on this thread.
+        bool has_write_barriers() const;
+
+        // Returns true if `Ref` operations haven't all been submitted yet.
+        bool has_barrier_operations() const;
+
+        // Returns true if there's a reason to start a cycle, once the previous one is over.
+        bool wants_cycle() const;
+
+        // Returns true if operations written here or memory retired here are still waiting on a cycle.
+        bool has_pending_work() const;
+
+        // Returns true if nothing written here is in flight, and there's no garbage left to finalize.
+        bool is_quiescent() const;
+
+        // Returns true if a coroutine waiting for this could be resumed now.
+        bool is_awaited(Cycle cycle, bool quiesce) const;
+
+        // Resume coroutines waiting on us, once they can be. Stopping resumes all of them.
+        void resume_awaiters(bool stopped);
+
+        // Returns true if retired memory is waiting for other regions to move on.
+        bool has_retired_memory() const;
+
+        // Free the retired memory that no region can be using anymore.
+        void free_retired_memory();
+
     private:
         friend class Domain;
 
@@ -95,28 +307,144 @@ namespace mantle {
         void transition(Phase next_phase);
         void transition(Cycle next_cycle);
 
+        // Returns true if the current transaction is full enough that the domain shouldn't hold back the next cycle.
+        bool is_ledger_pressured() const;
+
+        // Returns true if objects dropped in transactions that haven't been applied yet hold enough bytes
+        // that the domain shouldn't hold back the next cycle either.
+        bool is_memory_pressured() const;
+
+        // Returns true if either of the above holds.
+        bool is_pressured() const;
+        void send_start(bool urgent);
+
+        // Returns true if there is garbage waiting to be finalized.
+        bool has_garbage() const;
+
+        // Copy garbage out of the domain's buffers so it can be finalized later.
+        void stash_garbage();
         void finalize_garbage();
+        void finalize_objects(ObjectGroup group, std::span<Object*> objects);
 
     private:
         static constexpr State INITIAL_STATE = State::RUNNING;
         static constexpr Phase INITIAL_PHASE = Phase::RECV_ENTER;
         static constexpr Cycle INITIAL_CYCLE = 0;
 
+        static constexpr size_t PARTITION_HISTORY = 4;
+        using PartitionHistory = std::array<OperationPartition, PARTITION_HISTORY>;
+
+        static constexpr size_t SPILL_HISTORY = 4;
+        using SpillHistory = std::array<OperationSpill, SPILL_HISTORY>;
+
+        static constexpr size_t DROPPED_BYTES_HISTORY = 4;
+        using DroppedBytesHistory = std::array<size_t, DROPPED_BYTES_HISTORY>;
+
+        struct ByteCost {
+            size_t   bytes = 0;
+            bool     is_dropped = false;
+            Sequence dropped_cursor = 0; // The history entry the bytes were last counted in.
+        };
+
+        static constexpr size_t BYTE_COST_FILTER_BITS = 4096;
+        using ByteCostFilter = std::array<uint64_t, BYTE_COST_FILTER_BITS / 64>;
+
+        static size_t to_byte_cost_filter_bit(const Object& object);
+
         Domain&                     domain_;
         RegionId                    id_;
 
         State                       state_;
         Phase                       phase_;
         Cycle                       cycle_;
+        Epoch                       epoch_;
         size_t                      depth_;
 
         ObjectFinalizer&            finalizer_;
+        std::optional<size_t>       numa_node_; // Where memory used by this thread is placed, if anywhere.
         OperationLedger             ledger_;
+        OperationCombiner           combiner_; // Disabled unless `Config::region_combining_cache_size` is set.
+        std::optional<Ledger>       barrier_ledger_; // Only with the write barrier backend.
+        ReferenceCountTable*        reference_count_table_; // Set by the domain, if counts are kept out of objects.
+        size_t                      urgent_start_entries_; // Ask for an urgent cycle below this many writable entries.
+        bool                        sent_urgent_start_;
+
+        // Bytes held by objects dropped in recent transactions, indexed like the partitions below. A
+        // threshold of zero disables this, so objects aren't touched when their handles are dropped.
+        size_t                      pressure_bytes_;
+        size_t                      dropped_bytes_; // The sum of the history.
+        Sequence                    dropped_cursor_;
+        DroppedBytesHistory         dropped_bytes_history_;
+
+        // Costs are kept here rather than in the objects, so they don't grow. The filter lets drops of
+        // objects without a cost skip the lookup. Objects dropped on other threads aren't counted.
+        std::unordered_map<const Object*, ByteCost> byte_costs_;
+        ByteCostFilter              byte_cost_filter_;
+
+        // Partitions of recently committed transactions. These must outlive the cycles that submit them.
+        bool                        partition_operations_;
+        Sequence                    partition_cursor_;
+        PartitionHistory            partitions_;
+
+        // Overflow buffers of recent transactions, indexed like the partitions above. Operations drained
+        // from the fallback ledger go in here too.
+        bool                        ledger_overflow_;
+        FallbackLedger*             fallback_ledger_;
+        bool                        spill_operations_; // Set with either of the above.
+        Sequence                    spill_cursor_;
+        SpillHistory                spills_;
+
+        // Each shard holds a reference of `SHARD_WEIGHT` in the object's count, which covers references
+        // that were copied here but not written yet. The delta is written out before it can reach that.
+        struct Shard {
+            int64_t                 delta   = 0;
+            bool                    touched = true;
+        };
+
+        static constexpr int64_t SHARD_WEIGHT = int64_t{1} << Operation::EXPONENT_MAX;
+        static constexpr int64_t SHARD_LIMIT  = SHARD_WEIGHT / 2;
+
+        std::unordered_map<Object*, Shard> shards_;
+
+        // Operations on our own objects of recent transactions, indexed by transaction like the spills.
+        bool                        apply_local_operations_;
+        Sequence                    local_cursor_;
+        SpillHistory                local_operations_;
+        std::vector<Object*>        local_garbage_;
+
+        // The groups bound and released since the last submission, with `Config::heap_census_interval`.
+        // The previous one is read by our controller until the next cycle starts.
+        bool                            heap_census_;
+        Sequence                        heap_census_cursor_;
+        std::array<HeapCensusDelta, 2>  heap_census_deltas_;
+
+        bool                        drives_domain_; // Set on the thread that steps an embedded domain.
+
+        struct AwaitingCoroutine {
+            Cycle                   cycle;
+            bool                    quiesce;
+            std::coroutine_handle<> handle;
+        };
+
+        std::vector<AwaitingCoroutine> awaiting_;
+
+        struct RetiredMemory {
+            void*                   pointer;
+            void                    (*deleter)(void*);
+            Cycle                   cycle; // Freed once this cycle has been submitted by every region.
+        };
+
+        std::vector<RetiredMemory>  retired_memory_; // Cycle ordered.
 
         std::optional<ObjectGroups> garbage_;
         std::vector<Object*>        garbage_pile_;
+        std::vector<Object*>        garbage_pile_round_; // The part of the pile being finalized.
+        std::vector<Object*>        garbage_backlog_; // Group ordered, carried over between steps.
+        size_t                      garbage_backlog_offset_;
+        size_t                      garbage_cursor_; // How far finalization of `garbage_` has got, in groups or objects.
 
         Connection                  connection_;
+        Metrics                     metrics_;
 
     public:
         static Region*& thread_local_instance() {
@@ -125,9 +453,11 @@ namespace mantle {
         }
     };
 
-    inline void Region::start_increment_operation(Object&, Operation operation) {
-        assert(state_ != State::STOPPED);
-        assert(operation.type() == OperationType::INCREMENT);
+    inline void Region::write_operation(Operation operation) {
+        if (UNLIKELY(apply_local_operations_) && (operation.object()->region_id() == id_)) {
+            local_operations_[local_cursor_ % SPILL_HISTORY].write(operation);
+            return;
+        }
 
         // Fast-path: The operation can be added to the current transaction.
         if (LIKELY(ledger_.write(operation))) {
@@ -137,16 +467,131 @@ namespace mantle {
         flush_operation(operation);
     }
 
-    inline void Region::start_decrement_operation(Object&, Operation operation) {
+    inline size_t Region::to_byte_cost_filter_bit(const Object& object) {
+        uintptr_t ptr;
+        const Object* address = &object;
+        memcpy(&ptr, &address, sizeof(ptr));
+        return ((ptr >> 4) * 0x9e3779b97f4a7c15ull) >> (64 - log2_floor(BYTE_COST_FILTER_BITS));
+    }
+
+    inline bool Region::has_byte_cost(const Object& object) const {
+        const size_t bit = to_byte_cost_filter_bit(object);
+        return byte_cost_filter_[bit / 64] & (uint64_t{1} << (bit % 64));
+    }
+
+    inline void Region::start_increment_operation(Object&, Operation operation) {
+        assert(state_ != State::STOPPED);
+        assert(operation.type() == OperationType::INCREMENT);
+
+        if (combiner_.is_enabled()) {
+            combiner_.write(operation, [this](Operation evicted) { write_operation(evicted); return true; });
+            return;
+        }
+
+        write_operation(operation);
+    }
+
+    inline void Region::start_decrement_operation(Object& object, Operation operation) {
         assert(state_ != State::STOPPED);
         assert(operation.type() == OperationType::DECREMENT);
 
-        // Fast-path: The operation can be added to the current transaction.
-        if (LIKELY(ledger_.write(operation))) {
+        if (UNLIKELY(pressure_bytes_) && has_byte_cost(object)) {
+            drop_byte_cost(object);
+        }
+
+        if (combiner_.is_enabled()) {
+            combiner_.write(operation, [this](Operation evicted) { write_operation(evicted); return true; });
             return;
         }
 
-        flush_operation(operation);
+        write_operation(operation);
+    }
+
+    inline void Region::start_operations(std::span<const Operation> operations) {
+        assert(state_ != State::STOPPED);
+
+        if (UNLIKELY(pressure_bytes_)) {
+            drop_byte_costs(operations);
+        }
+
+        if (combiner_.is_enabled()) {
+            for (const Operation operation: operations) {
+                combiner_.write(operation, [this](Operation evicted) { write_operation(evicted); return true; });
+            }
+            return;
+        }
+
+        if (UNLIKELY(apply_local_operations_)) {
+            for (const Operation operation: operations) {
+                write_operation(operation);
+            }
+            return;
+        }
+
+        while (true) {
+            // Fast-path: The operations can all be added to the current transaction.
+            operations = operations.subspan(ledger_.write(operations));
+            if (LIKELY(operations.empty())) {
+                return;
+            }
+
+            // Make room, then carry on with the rest.
+            flush_operation(operations.front());
+            operations = operations.subspan(1);
+        }
+    }
+
+    inline void Object::start_increment_operation(Operation operation) {
+        assert(operation.type() == OperationType::INCREMENT);
+
+        if (Region* region = Region::thread_local_instance(); LIKELY(region)) {
+            region->start_increment_operation(*this, operation);
+        }
+        else if (FallbackLedger* fallback_ledger = FallbackLedger::instance()) {
+            fallback_ledger->write(operation);
+        }
+        else {
+            // Leak.
+        }
+    }
+
+    inline void Object::start_decrement_operation(Operation operation) {
+        assert(operation.type() == OperationType::DECREMENT);
+
+        if (Region* region = Region::thread_local_instance(); LIKELY(region)) {
+            region->start_decrement_operation(*this, operation);
+        }
+        else if (FallbackLedger* fallback_ledger = FallbackLedger::instance()) {
+            fallback_ledger->write(operation);
+        }
+        else {
+            // Leak.
+        }
+    }
+
+    inline void Region::start_sharded_operation(Operation operation) {
+        assert(state_ != State::STOPPED);
+
+        Object* object = operation.mutable_object();
+        assert(object);
+
+        auto it = shards_.find(object);
+        if (UNLIKELY(it == shards_.end())) {
+            // Take the weight before the shard exists, so that a step while making room for it can't
+            // give the shard back before its weight has been written.
+            write_operation(make_increment_operation(object, Operation::EXPONENT_MAX));
+            it = shards_.try_emplace(object).first;
+            metrics_.shard_count += 1;
+        }
+
+        Shard& shard = it->second;
+        shard.delta += operation.value();
+        shard.touched = true;
+        metrics_.sharded_count += 1;
+
+        if (UNLIKELY((shard.delta >= SHARD_LIMIT) || (shard.delta <= -SHARD_LIMIT))) {
+            flush_shard(*object);
+        }
     }
 
     std::string_view to_string(RegionState state);
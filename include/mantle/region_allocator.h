@@ -0,0 +1,142 @@
+#pragma once
+
+#include <span>
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <new>
+#include <type_traits>
+#include <cstdint>
+#include <cstddef>
+#include "mantle/types.h"
+#include "mantle/util.h"
+#include "mantle/object.h"
+#include "mantle/object_finalizer.h"
+#include "mantle/handle.h"
+
+namespace mantle {
+
+    struct RegionAllocatorMetrics {
+        // The number of objects constructed and finalized since the allocator was created, so the
+        // difference is how many are alive. Constructors that throw aren't counted.
+        size_t allocated_count = 0;
+        size_t finalized_count = 0;
+
+        // Slabs are only given back when the allocator is destroyed.
+        size_t slab_count      = 0;
+    };
+
+    // A slab allocator for objects that belong to a single region, which also acts as the
+    // region's finalizer. Objects are allocated and finalized on the region's thread, so the
+    // free lists are plain thread-local lists with no synchronization.
+    //
+    // Each object's group is set to its size class. The region hands dead objects over one
+    // group at a time, so finalizing a batch ends with a single splice onto one free list.
+    //
+    // NOTE: Every object bound in a region that uses this finalizer must come from here.
+    //
+    class RegionAllocator final : public ObjectFinalizer {
+    public:
+        using Metrics = RegionAllocatorMetrics;
+
+        // Slots are powers of two from 32 bytes up to a whole slab. Slabs are aligned to their
+        // size, so any address inside a slot can be rounded down to find its header.
+        static constexpr size_t MIN_SLOT_SHIFT   = 5;
+        static constexpr size_t SLAB_SHIFT       = 16;
+        static constexpr size_t SLAB_SIZE        = 1ull << SLAB_SHIFT;
+        static constexpr size_t SIZE_CLASS_COUNT = SLAB_SHIFT - MIN_SLOT_SHIFT + 1;
+
+        RegionAllocator();
+        ~RegionAllocator() override;
+
+        RegionAllocator(RegionAllocator&&) = delete;
+        RegionAllocator(const RegionAllocator&) = delete;
+        RegionAllocator& operator=(RegionAllocator&&) = delete;
+        RegionAllocator& operator=(const RegionAllocator&) = delete;
+
+        // Construct an object in a slot of the right size class. The object still needs to be
+        // bound to a handle before it is managed.
+        template<typename T, typename... Args>
+        T& allocate(Args&&... args);
+
+        template<typename T, typename Policy = DefaultReferencePolicy, typename... Args>
+        Handle<T, Policy> make_handle(Args&&... args) {
+            return mantle::make_handle<Policy>(allocate<T>(std::forward<Args>(args)...));
+        }
+
+        template<typename T>
+        static constexpr ObjectGroup size_class();
+
+        [[nodiscard]]
+        static constexpr size_t slot_size(ObjectGroup size_class) {
+            return 1ull << (MIN_SLOT_SHIFT + size_class);
+        }
+
+        [[nodiscard]]
+        const Metrics& metrics() const;
+
+        void finalize(ObjectGroup group, std::span<Object*> objects) noexcept override;
+
+    private:
+        using Destructor = void (*)(Object*) noexcept;
+
+        // Live slots remember how to destroy their object, free slots are chained together.
+        struct alignas(alignof(Object)) SlotHeader {
+            Destructor  destructor;
+            SlotHeader* next;
+        };
+
+        struct SizeClass {
+            SlotHeader* free_list = nullptr;
+            std::byte*  bump      = nullptr; // The unused tail of the newest slab.
+            std::byte*  bump_end  = nullptr;
+        };
+
+        [[nodiscard]]
+        void* allocate_slot(ObjectGroup size_class, Destructor destructor);
+        void deallocate_slot(ObjectGroup size_class, void* memory);
+
+        [[nodiscard]]
+        static SlotHeader* to_slot(const Object* object, ObjectGroup size_class);
+
+    private:
+        std::array<SizeClass, SIZE_CLASS_COUNT> size_classes_;
+        std::vector<std::byte*>                 slabs_;
+        Metrics                                 metrics_;
+    };
+
+    template<typename T>
+    constexpr ObjectGroup RegionAllocator::size_class() {
+        static_assert(std::is_base_of_v<Object, T>, "Object is a required base class");
+        static_assert(alignof(T) <= alignof(SlotHeader), "Over-aligned objects are not supported");
+
+        constexpr size_t size = std::max<size_t>(sizeof(SlotHeader) + sizeof(T), 1ull << MIN_SLOT_SHIFT);
+        static_assert(size <= SLAB_SIZE, "Object is too large for a slab");
+
+        return static_cast<ObjectGroup>(log2_ceil(size) - MIN_SLOT_SHIFT);
+    }
+
+    template<typename T, typename... Args>
+    T& RegionAllocator::allocate(Args&&... args) {
+        constexpr ObjectGroup SIZE_CLASS = size_class<T>();
+
+        void* memory = allocate_slot(SIZE_CLASS, [](Object* object) noexcept {
+            static_cast<T*>(object)->~T();
+        });
+
+        T* object;
+        try {
+            object = new (memory) T(std::forward<Args>(args)...);
+        }
+        catch (...) {
+            deallocate_slot(SIZE_CLASS, memory);
+            throw;
+        }
+
+        static_cast<Object&>(*object).group_ = SIZE_CLASS;
+        metrics_.allocated_count += 1;
+        return *object;
+    }
+
+}
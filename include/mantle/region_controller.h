@@ -7,6 +7,7 @@
 #include <string_view>
 #include <vector>
 #include <compare>
+#include <chrono>
 #include <cstdint>
 #include <cstddef>
 #include "mantle/types.h"
@@ -18,6 +19,9 @@
 #include "mantle/operation.h"
 #include "mantle/operation_ledger.h"
 #include "mantle/operation_grouper.h"
+#include "mantle/operation_partition.h"
+#include "mantle/reference_count_table.h"
+#include "mantle/heap_census.h"
 
 #define MANTLE_REGION_CONTROLLER_ACTIONS(X) \
     X(SEND)                                 \
@@ -41,6 +45,7 @@
     X(STOPPING)                            \
     X(STOPPED)                             \
     X(SHUTDOWN)                            \
+    X(VACANT)                              \
 
 namespace mantle {
 
@@ -101,6 +106,10 @@ namespace mantle {
     ;
 
     // A survey of the states of controllers and the actions they are trying to take.
+    //
+    // The domain keeps one up to date as its controllers transition, so checking a barrier doesn't
+    // walk every controller. It only holds counts, so taking a snapshot of it is cheap too.
+    //
     class RegionControllerCensus {
     public:
         using State = RegionControllerState;
@@ -114,6 +123,13 @@ namespace mantle {
 
         void add(const RegionController& controller);
         void add(const RegionControllerGroup& controllers);
+        void add(const RegionControllerCensus& census);
+
+        // Move a controller that has been added from one count to another as it transitions.
+        void update(State state, State next_state);
+        void update(Phase phase, Phase next_phase);
+        void update(Cycle cycle, Cycle next_cycle);
+        void update_urgent(bool urgent, bool next_urgent);
 
         size_t count() const;
 
@@ -129,15 +145,34 @@ namespace mantle {
         bool any(Action action) const;
         bool all(Action action) const;
 
+        // Returns true if any controller's region asked for the cycle it is waiting on to start right away.
+        bool any_urgent() const;
+
         auto operator<=>(const RegionControllerCensus&) const noexcept = default;
 
+    private:
+        struct CycleCount {
+            Cycle  cycle = 0;
+            size_t count = 0;
+
+            auto operator<=>(const CycleCount&) const noexcept = default;
+        };
+
+        // Controllers that take part in cycles are at most one apart, and those that haven't started
+        // yet are all at the initial cycle, so only a few distinct cycles are ever counted.
+        static constexpr size_t CYCLE_COUNT_CAPACITY = 8;
+
+        void add(Cycle cycle, size_t count = 1);
+        void remove(Cycle cycle);
+
     private:
         size_t                                             count_;
-        Cycle                                              min_cycle_;
-        Cycle                                              max_cycle_;
+        size_t                                             cycle_count_size_;
+        std::array<CycleCount, CYCLE_COUNT_CAPACITY>       cycle_counts_; // Ascending, unused ones zeroed.
         std::array<size_t, REGION_CONTROLLER_STATE_COUNT>  state_counts_;
         std::array<size_t, REGION_CONTROLLER_PHASE_COUNT>  phase_counts_;
         std::array<size_t, REGION_CONTROLLER_ACTION_COUNT> action_counts_;
+        size_t                                             urgent_count_;
     };
 
     struct RegionControllerMetrics {
@@ -146,6 +181,28 @@ namespace mantle {
         size_t increment_count;
         size_t decrement_count;
 
+        // The number of objects whose reference counts were updated, and the time spent doing it.
+        size_t                   applied_count;
+        std::chrono::nanoseconds apply_duration;
+
+        // The number of cycles completed, and the time spent in each phase of them.
+        size_t                                                              cycle_count;
+        std::array<std::chrono::nanoseconds, REGION_CONTROLLER_PHASE_COUNT> phase_durations;
+
+        // Ledger entries held by the transactions submitted in the last cycle, out of its capacity.
+        size_t ledger_occupancy;
+        size_t ledger_capacity;
+
+        // The number of objects the region had finalized when it last submitted.
+        size_t finalized_count;
+
+        // The number of objects the region had bound when it last submitted, and how many of its
+        // objects have died since, here or on the region itself. Once a region has left, its slot is
+        // reused when these match.
+        size_t bound_count;
+        size_t released_count;
+        size_t local_released_count;
+
         RegionControllerMetrics(
             const OperationGrouper& operation_grouper,
             const ObjectGrouper& object_grouper
@@ -154,8 +211,27 @@ namespace mantle {
             , object_grouper(object_grouper.metrics())
             , increment_count(0)
             , decrement_count(0)
+            , applied_count(0)
+            , apply_duration(std::chrono::nanoseconds::zero())
+            , cycle_count(0)
+            , phase_durations{}
+            , ledger_occupancy(0)
+            , ledger_capacity(0)
+            , finalized_count(0)
+            , bound_count(0)
+            , released_count(0)
+            , local_released_count(0)
         {
         }
+
+        [[nodiscard]]
+        double applied_objects_per_second() const {
+            if (apply_duration.count() <= 0) {
+                return 0.0;
+            }
+
+            return static_cast<double>(applied_count) / std::chrono::duration<double>(apply_duration).count();
+        }
     };
 
     class RegionController {
@@ -170,7 +246,8 @@ namespace mantle {
             RegionId region_id,
             RegionControllerGroup& controllers,
             const OperationLedger& ledger,
-            const Config& config
+            const Config& config,
+            ReferenceCountTable* reference_count_table = nullptr
         );
 
         RegionController(RegionController&&) = delete;
@@ -181,6 +258,10 @@ namespace mantle {
         RegionId region_id() const;
         const Metrics& metrics() const;
 
+        // Our region's objects by group, with `Config::heap_census_interval`. Null otherwise.
+        [[nodiscard]]
+        const HeapCensus* heap_census() const;
+
         bool is_quiescent() const;
 
         State state() const;
@@ -191,39 +272,147 @@ namespace mantle {
         void start(Cycle cycle);
         void stop();
 
+        // Returns true once the region has left. The controller keeps taking part in cycles, so the
+        // region's objects that are still alive keep being counted, and the domain finalizes them.
+        [[nodiscard]]
+        bool is_detached() const;
+
+        // Returns true if the region has left and nothing it owned is left alive or in flight.
+        [[nodiscard]]
+        bool is_drained() const;
+
+        // Mark a drained controller as free to manage a new region, and hand it to that region.
+        void vacate();
+        void attach(const OperationLedger& ledger, Cycle cycle);
+
+        // Start a cycle on behalf of the region, as if it had sent a START message.
+        void request_start();
+
+        // Returns true if the region asked for the cycle it is waiting on to start right away.
+        [[nodiscard]]
+        bool is_start_urgent() const;
+
+        // Returns true if operations the region submitted recently are still making their way
+        // through the pipeline, and more cycles are needed before they are all applied.
+        [[nodiscard]]
+        bool has_pending_operations() const;
+
+        // These do the heavy lifting of the SUBMIT_BARRIER and RETIRE_BARRIER phases when
+        // `Config::domain_worker_count` is non-zero. The domain calls them from its worker pool
+        // once every controller has reached the barrier, before synchronizing.
+        //
+        // Routing only touches the inbox slot belonging to `worker_index` in other controllers, and
+        // applying only touches objects owned by this controller's region, so routing can run in
+        // parallel across controllers and so can applying.
+        //
+        // With `Config::pipeline_cycles` both happen on the way out of SUBMIT_BARRIER. Applying reads
+        // what was routed in the previous cycle, which was set aside when it retired, so it can also
+        // run in parallel with routing.
+        //
+        void route_operations(size_t worker_index);
+        void apply_operations();
+
         std::optional<Message> send_message();
         void receive_message(const Message& message);
         void synchronize(const RegionControllerCensus& census);
 
+        // Add this controller to the census and keep it up to date from now on. The census has to
+        // outlive the controller.
+        void track(RegionControllerCensus& census);
+
     private:
         void transition(State next_state);
         void transition(Phase next_phase);
         void transition(Cycle next_cycle);
+        void set_start_urgent(bool urgent);
+
+        // The phase that follows the current one. RETIRE_BARRIER is skipped when cycles are pipelined.
+        [[nodiscard]]
+        Phase next_phase() const;
+
+        // Set aside everything routed to us so far, to be applied in the next cycle.
+        void retire_operations();
+
+        template<typename Sink>
+        size_t route_operations(OperationType type, SequenceRange range, Sink&& sink);
+
+        template<typename Sink>
+        size_t route_operations(OperationType type, const OperationPartition& partition, Sink&& sink);
+
+        template<typename Sink>
+        size_t route_operations(std::span<const Operation> operations, Sink&& sink);
+
+        // Route everything the region submitted this cycle, recording it if there is a recorder.
+        template<typename Sink>
+        void route_submitted_operations(Sink&& sink);
+
+        template<typename Sink>
+        void route_committed_operations(Sink&& sink);
+
+        // Tell the recorder, if there is one, that one of our objects has died.
+        void record_release(const Object& object);
 
-        size_t route_operations(OperationType type, SequenceRange range);
+        // Add the objects applied to in this cycle to the heap census, if it is a sampled one.
+        void sample_heap_census();
+
+        [[nodiscard]]
+        bool has_worker_pool() const;
+
+        [[nodiscard]]
+        bool is_pipelined() const;
+
+        // Whether operations still grouped in the cache should be applied anyway.
+        [[nodiscard]]
+        bool is_flush_forced() const;
 
     private:
+        // Operations routed to this controller by one domain worker, and those set aside to be applied.
+        struct alignas(CACHE_LINE_SIZE) Inbox {
+            std::vector<Operation> operations;
+            std::vector<Operation> retired_operations;
+        };
+
         RegionId               region_id_;
         RegionControllerGroup& controllers_;
-        const OperationLedger& ledger_;
+        const OperationLedger* ledger_;
         const Config&          config_;
+        ReferenceCountTable*   reference_count_table_; // Where our objects' counts are kept, if not in the objects.
+        RegionControllerCensus* census_; // Kept up to date with our transitions, if set.
 
         State                  state_;
         Phase                  phase_;
         Cycle                  cycle_;
+        bool                   start_urgent_;
+        std::optional<Cycle>   active_cycle_; // The last cycle that the region submitted operations in.
 
-    SequenceRange          submitted_increments_;
-        SequenceRange          submitted_decrements_;
+        std::chrono::steady_clock::time_point phase_start_;
 
+        SequenceRange             submitted_increments_;
+        SequenceRange             submitted_decrements_;
+        const OperationPartition* submitted_increment_partition_;
+        const OperationPartition* submitted_decrement_partition_;
+        const OperationSpill*     submitted_increment_spill_;
+        const OperationSpill*     submitted_decrement_spill_;
+        const WriteBarrier*       submitted_barrier_;
+
+        std::vector<Inbox>     inboxes_;
         OperationGrouper       operation_grouper_;
         ObjectGrouper          object_grouper_;
 
+        std::vector<ReferenceCountTable::Slot> released_slots_; // Handed back to the table after each apply.
+
+        std::optional<HeapCensus> heap_census_;
+
         Metrics                metrics_;
     };
 
     // Synchronizes a group of region controllers.
     RegionControllerCensus synchronize(RegionControllerGroup& controllers);
 
+    // Returns true if synchronizing against `census` would move any of the controllers counted in `cluster`.
+    [[nodiscard]]
+    bool can_synchronize(const RegionControllerCensus& cluster, const RegionControllerCensus& census);
+
     std::string_view to_string(RegionControllerState state);
     std::string_view to_string(RegionControllerPhase phase);
     std::string_view to_string(RegionControllerAction action);
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include "mantle/region.h"
+
+namespace mantle {
+
+    class Domain;
+    class ObjectFinalizer;
+
+    // Regions for threads that come and go, like those of an elastic task pool. Constructing a region
+    // allocates its ledger and connection and opens its eventfds. Pooled regions keep all of that when
+    // their thread is done with them, and the next thread to acquire one only has to join a cycle.
+    //
+    // Releasing a region still stops it, so whatever its thread dropped is finalized before another
+    // thread can adopt it. That way a parked region doesn't hold up the cycles of the others.
+    //
+    // NOTE: Every region shares the finalizer, which has to be safe to call from any of them. The pool
+    //       must be destroyed before the domain.
+    //
+    class RegionPool {
+        RegionPool(RegionPool&&) = delete;
+        RegionPool(const RegionPool&) = delete;
+        RegionPool& operator=(RegionPool&&) = delete;
+        RegionPool& operator=(const RegionPool&) = delete;
+
+    public:
+        // The region of the thread that holds it. It is parked again when the lease is destroyed,
+        // which must happen on the same thread.
+        class Lease {
+        public:
+            Lease(Lease&& other)
+                : pool_(std::exchange(other.pool_, nullptr))
+                , region_(std::move(other.region_))
+            {
+            }
+
+            Lease& operator=(Lease&& other) {
+                if (this != &other) {
+                    reset();
+                    pool_ = std::exchange(other.pool_, nullptr);
+                    region_ = std::move(other.region_);
+                }
+
+                return *this;
+            }
+
+            Lease(const Lease&) = delete;
+            Lease& operator=(const Lease&) = delete;
+
+            ~Lease() {
+                reset();
+            }
+
+            Region& operator*() const {
+                return *region_;
+            }
+
+            Region* operator->() const {
+                return region_.get();
+            }
+
+            // Park the region now.
+            void reset() {
+                if (pool_) {
+                    std::exchange(pool_, nullptr)->release(std::move(region_));
+                }
+            }
+
+        private:
+            friend class RegionPool;
+
+            Lease(RegionPool& pool, std::unique_ptr<Region> region)
+                : pool_(&pool)
+                , region_(std::move(region))
+            {
+            }
+
+        private:
+            RegionPool*             pool_;
+            std::unique_ptr<Region> region_;
+        };
+
+        // At most `capacity` regions are kept around. Any more are destroyed when they're released.
+        RegionPool(Domain& domain, ObjectFinalizer& finalizer, size_t capacity);
+        ~RegionPool();
+
+        // Adopt a parked region on this thread, or construct one if none are left.
+        // Throws `std::runtime_error` if the thread already has a region.
+        [[nodiscard]]
+        Lease acquire();
+
+        [[nodiscard]]
+        size_t parked_count() const;
+
+    private:
+        void release(std::unique_ptr<Region> region);
+
+    private:
+        Domain&                              domain_;
+        ObjectFinalizer&                     finalizer_;
+        size_t                               capacity_;
+        mutable std::mutex                   mutex_;
+        std::vector<std::unique_ptr<Region>> parked_;
+    };
+
+}
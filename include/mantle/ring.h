@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <vector>
 #include <cstdint>
 #include <cstddef>
@@ -7,10 +8,12 @@
 
 namespace mantle {
 
-    template<typename T>
+    template<typename T, typename Allocator = std::allocator<T>>
     class Ring {
     public:
-        explicit Ring(size_t minimum_size) {
+        explicit Ring(size_t minimum_size, const Allocator& allocator = Allocator())
+            : data_(allocator)
+        {
             size_t size = 1;
             while (size < minimum_size) {
                 size = size * 2;
@@ -39,8 +42,8 @@ namespace mantle {
         }
 
     private:
-        std::vector<T> data_;
-        size_t         mask_;
+        std::vector<T, Allocator> data_;
+        size_t                    mask_;
     };
 
 }
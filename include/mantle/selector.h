@@ -2,6 +2,8 @@
 
 #include <span>
 #include <array>
+#include <chrono>
+#include <optional>
 
 namespace mantle {
 
@@ -15,9 +17,15 @@ namespace mantle {
         Selector();
         ~Selector();        
 
+        // Becomes readable while any of the watched file descriptors are.
+        int file_descriptor() const;
+
         // Returns an array of user-data corresponding to file descriptors that are ready-to-read.
         std::span<void*> poll(bool non_blocking);
 
+        // Like the above, but gives up after the timeout. An empty timeout waits forever.
+        std::span<void*> poll(std::optional<std::chrono::nanoseconds> timeout);
+
         void add_watch(int file_descriptor, void* user_data);
         void modify_watch(int file_descriptor, void* user_data);
         void delete_watch(int file_descriptor);
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <span>
+#include <atomic>
+#include <vector>
+#include <optional>
+#include <cstddef>
+
+namespace mantle {
+
+    // CPUs that share their last level cache, usually an L3.
+    struct CacheGroup {
+        std::vector<size_t>   cpus; // Ascending.
+        std::optional<size_t> numa_node;
+    };
+
+    // The CPUs this process may run on, grouped by the last level cache they share.
+    class CpuTopology {
+    public:
+        explicit CpuTopology(std::vector<CacheGroup> groups);
+
+        // Read the topology from sysfs. CPUs without cache information get a group of their own.
+        // Throws `std::runtime_error` if no usable CPU can be found.
+        [[nodiscard]]
+        static CpuTopology detect();
+
+        // Ordered by their first CPU.
+        [[nodiscard]]
+        std::span<const CacheGroup> cache_groups() const;
+
+        [[nodiscard]]
+        size_t cpu_count() const;
+
+    private:
+        std::vector<CacheGroup> groups_;
+    };
+
+    // Decides where the domain and region threads run, so the domain thread shares its cache with as
+    // many regions as possible. The domain takes CPUs at the end of the largest cache group, and region
+    // threads fill the rest of that group before they move on to groups on the same NUMA node, and then
+    // to the others. Once every CPU has a thread the placement starts over.
+    //
+    // Threads pick their CPU with `place_thread`, so this can be shared by any number of them.
+    //
+    class ThreadPlacement {
+        ThreadPlacement(ThreadPlacement&&) = delete;
+        ThreadPlacement(const ThreadPlacement&) = delete;
+        ThreadPlacement& operator=(ThreadPlacement&&) = delete;
+        ThreadPlacement& operator=(const ThreadPlacement&) = delete;
+
+    public:
+        // Keep this many CPUs for the domain thread and its workers. If that is all of them, region
+        // threads are put on the domain's CPUs as well.
+        explicit ThreadPlacement(const CpuTopology& topology, size_t domain_cpu_count = 1);
+
+        [[nodiscard]]
+        std::span<const size_t> domain_cpus() const;
+
+        [[nodiscard]]
+        std::optional<size_t> domain_numa_node() const;
+
+        // The CPUs handed to region threads, in the order they are handed out.
+        [[nodiscard]]
+        std::span<const size_t> thread_cpus() const;
+
+        // Returns the CPU for the next thread.
+        [[nodiscard]]
+        size_t next_thread_cpu();
+
+        // Pin the calling thread to the next CPU, and return it.
+        size_t place_thread();
+
+    private:
+        std::vector<size_t>   domain_cpus_;
+        std::optional<size_t> domain_numa_node_;
+        std::vector<size_t>   thread_cpus_;
+        std::atomic_size_t    next_thread_index_;
+    };
+
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <span>
+#include <memory>
+#include <vector>
+#include <string_view>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <cstdint>
+#include <cstddef>
+#include "mantle/types.h"
+#include "mantle/config.h"
+#include "mantle/util.h"
+#include "mantle/ring.h"
+
+#define MANTLE_TRACE_EVENT_TYPES(X) \
+    X(PHASE)                        \
+    X(STATE)                        \
+    X(CYCLE)                        \
+    X(SEND)                         \
+    X(RECEIVE)                      \
+    X(ROUTE)                        \
+    X(FINALIZE)                     \
+
+namespace mantle {
+
+    enum class TraceEventType : uint8_t {
+#define X(MANTLE_TRACE_EVENT_TYPE) \
+        MANTLE_TRACE_EVENT_TYPE,   \
+
+        MANTLE_TRACE_EVENT_TYPES(X)
+#undef X
+    };
+
+    // Which state machine recorded the event.
+    enum class TraceSource : uint8_t {
+        REGION,
+        CONTROLLER,
+    };
+
+    // The meaning of `argument` and `value` depends on the type:
+    //   PHASE:    argument is the phase being entered, value is the cycle.
+    //   STATE:    argument is the state being entered.
+    //   CYCLE:    value is the cycle being entered.
+    //   SEND:     argument is the message type.
+    //   RECEIVE:  argument is the message type.
+    //   ROUTE:    value is the number of operations routed.
+    //   FINALIZE: value is the number of objects finalized.
+    //
+    struct TraceEvent {
+        uint64_t       timestamp; // Nanoseconds on the steady clock.
+        uint64_t       value;
+        RegionId       region_id;
+        TraceSource    source;
+        TraceEventType type;
+        uint32_t       argument;
+    };
+
+    static_assert(sizeof(TraceEvent) == 24);
+
+    // A fixed-size ring of recent events, written by a single thread. Old events are overwritten,
+    // so recording never allocates or blocks. Other threads can take a snapshot at any time.
+    class TraceRing {
+    public:
+        explicit TraceRing(size_t capacity)
+            : events_(capacity)
+            , head_(0)
+        {
+        }
+
+        TraceRing(TraceRing&&) = delete;
+        TraceRing(const TraceRing&) = delete;
+        TraceRing& operator=(TraceRing&&) = delete;
+        TraceRing& operator=(const TraceRing&) = delete;
+
+        [[nodiscard]]
+        size_t capacity() const {
+            return events_.size();
+        }
+
+        MANTLE_HOT void record(const TraceEvent& event) {
+            const Sequence head = head_.load(std::memory_order_relaxed);
+
+            // The slot mustn't be overwritten before the previous head is visible, or a snapshot
+            // could read a torn event without seeing that it was reused.
+            std::atomic_thread_fence(std::memory_order_release);
+            events_[head] = event;
+            head_.store(head + 1, std::memory_order_release);
+        }
+
+        // Appends the events still in the ring to `events`, oldest first. That is at most one fewer
+        // than the capacity, since the oldest slot may be in the middle of being overwritten.
+        //
+        // NOTE: The writer doesn't wait for readers. Events that may have been overwritten
+        //       while they were being copied are discarded.
+        //
+        void snapshot(std::vector<TraceEvent>& events) const;
+
+        // The ring that events recorded on this thread go to. It is taken on first use and handed back
+        // when the thread exits, so a thread's events can still be exported after it is gone, until
+        // another thread takes the ring over.
+        static TraceRing& thread_local_instance() {
+            thread_local Owner owner;
+            return owner.ring();
+        }
+
+    private:
+        // Holds a thread's ring, and gives it back to the registry for reuse when the thread exits.
+        class Owner {
+        public:
+            Owner();
+            ~Owner();
+
+            Owner(Owner&&) = delete;
+            Owner(const Owner&) = delete;
+            Owner& operator=(Owner&&) = delete;
+            Owner& operator=(const Owner&) = delete;
+
+            TraceRing& ring() const {
+                return *ring_;
+            }
+
+        private:
+            TraceRing* ring_;
+        };
+
+    private:
+        Ring<TraceEvent>      events_;
+        std::atomic<Sequence> head_;
+    };
+
+    inline void trace(
+        const TraceSource source,
+        const RegionId region_id,
+        const TraceEventType type,
+        const uint32_t argument = 0,
+        const uint64_t value = 0
+    ) {
+        if constexpr (ENABLE_TRACE) {
+            const auto timestamp = std::chrono::steady_clock::now().time_since_epoch();
+
+            TraceRing::thread_local_instance().record(TraceEvent {
+                .timestamp = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(timestamp).count()),
+                .value     = value,
+                .region_id = region_id,
+                .source    = source,
+                .type      = type,
+                .argument  = argument,
+            });
+        }
+    }
+
+    // Returns how many rings have been created. Rings are reused once their thread exits, so this
+    // is bounded by the number of threads that have been tracing at the same time.
+    size_t trace_ring_count();
+
+    // Returns the events of every thread's ring, ordered by time.
+    std::vector<TraceEvent> collect_trace();
+
+    // Writes the events of every thread's ring in the Chrome trace event format, which Perfetto
+    // and chrome://tracing can open. Regions and their controllers get a track each, with a
+    // slice per phase, so a region holding up a barrier shows up as a slice that doesn't end.
+    void write_chrome_trace(std::ostream& stream);
+    void write_chrome_trace(std::ostream& stream, std::span<const TraceEvent> events);
+
+    std::string_view to_string(TraceEventType type);
+
+}
@@ -17,7 +17,7 @@ namespace mantle {
 
     using RegionId        = uint16_t;
     using ObjectGroup     = uint16_t;
-    using ObjectGroupMask = std::array<uint64_t, std::numeric_limits<ObjectGroup>::max() / (sizeof(uint64_t) * CHAR_BIT)>;
+    using ObjectGroupMask = std::array<uint64_t, (std::numeric_limits<ObjectGroup>::max() + 1) / (sizeof(uint64_t) * CHAR_BIT)>;
     using AtomicSequence  = std::atomic_uint64_t;
     using Sequence        = AtomicSequence::value_type;
 
@@ -36,6 +36,22 @@ namespace mantle {
 
     constexpr SequenceRange EMPTY_SEQUENCE_RANGE = { .head=0, .tail=0 };
 
+    constexpr size_t OBJECT_GROUP_MASK_WORD_BITS = sizeof(ObjectGroupMask::value_type) * CHAR_BIT;
+
+    // Visit the groups set in the mask in ascending order, only looking at the words that cover the range.
+    template<typename Visitor>
+    inline void for_each_group(const ObjectGroupMask& mask, const ObjectGroup group_min, const ObjectGroup group_max, Visitor&& visitor) {
+        if (group_min > group_max) {
+            return;
+        }
+
+        for (size_t word = group_min / OBJECT_GROUP_MASK_WORD_BITS; word <= (group_max / OBJECT_GROUP_MASK_WORD_BITS); ++word) {
+            for (uint64_t bits = mask[word]; bits; bits &= bits - 1) {
+                visitor(static_cast<ObjectGroup>((word * OBJECT_GROUP_MASK_WORD_BITS) + static_cast<size_t>(__builtin_ctzll(bits))));
+            }
+        }
+    }
+
     // TODO: Move this into a separate file. It knows too much aabout other classes.
     struct ObjectGroups {
         Object**         objects;
@@ -43,26 +59,32 @@ namespace mantle {
         ObjectGroup      group_min;     // Inclusive.
         ObjectGroup      group_max;     // Inclusive.
         size_t*          group_offsets; // Offsets into the objects array (where to find members).
+        size_t*          group_sizes;   // The number of members. Like the offsets, only valid for non-empty groups.
         ObjectGroupMask* group_mask;    // A bitset of non-empty groups.
 
         [[nodiscard]]
-        size_t group_member_count(ObjectGroup group) const {
+        bool has_group(ObjectGroup group) const {
             if constexpr (!ENABLE_OBJECT_GROUPING) {
                 abort();
             }
 
-            return group_offsets[static_cast<size_t>(group) + 1] - group_offsets[group];
+            return (((*group_mask)[group / OBJECT_GROUP_MASK_WORD_BITS] >> (group % OBJECT_GROUP_MASK_WORD_BITS)) & 1) != 0;
+        }
+
+        [[nodiscard]]
+        size_t group_member_count(ObjectGroup group) const {
+            return has_group(group) ? group_sizes[group] : 0;
         }
 
         [[nodiscard]]
         std::span<Object*> group_members(ObjectGroup group) {
-            if constexpr (!ENABLE_OBJECT_GROUPING) {
-                abort();
+            if (!has_group(group)) {
+                return {};
             }
 
             return {
-                &objects[group],
-                group_member_count(group)
+                &objects[group_offsets[group]],
+                group_sizes[group]
             };
         }
 
@@ -72,11 +94,9 @@ namespace mantle {
                 abort();
             }
 
-            for (ObjectGroup group = group_min; group <= group_max; ++group) {
-                if (std::span<Object*> members = group_members(group); !members.empty()) {
-                    visitor(group, members);
-                }
-            }
+            mantle::for_each_group(*group_mask, group_min, group_max, [&](ObjectGroup group) {
+                visitor(group, std::span<Object*>(&objects[group_offsets[group]], group_sizes[group]));
+            });
         }
     };
 
@@ -2,6 +2,10 @@
 
 #include <span>
 #include <thread>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <optional>
 #include <stdexcept>
 #include <cstring>
 #include <cstddef>
@@ -55,7 +59,35 @@ namespace mantle {
         return log2_floor(value - 1) + 1;
     }
 
-    inline void set_cpu_affinity(std::span<size_t> cpus) {
+    // Hint that the cache line holding this address is about to be read. Unlike the one below,
+    // this leaves the line shared with other cores.
+    MANTLE_HOT void prefetch_for_read(const void* address) {
+#ifdef __GNUC__
+        __builtin_prefetch(address, 0, 3);
+#else
+        (void)address;
+#endif
+    }
+
+    // Hint that the cache line holding this address is about to be written.
+    MANTLE_HOT void prefetch_for_write(const void* address) {
+#ifdef __GNUC__
+        __builtin_prefetch(address, 1, 3);
+#else
+        (void)address;
+#endif
+    }
+
+    // Tell the CPU we are in a spin loop, so it can back off and save power.
+    MANTLE_HOT void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+    inline void set_cpu_affinity(std::span<const size_t> cpus) {
         cpu_set_t set;
         CPU_ZERO(&set);
 
@@ -70,6 +102,65 @@ namespace mantle {
         std::this_thread::yield();
     }
 
+    // The NUMA node of the CPU this thread is running on right now.
+    inline std::optional<size_t> current_numa_node() {
+        unsigned cpu = 0;
+        unsigned node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) < 0) {
+            return std::nullopt;
+        }
+
+        return node;
+    }
+
+    // Parse a CPU list the way sysfs writes them, e.g. "0-3,8-11".
+    inline std::vector<size_t> parse_cpu_list(const std::string& list) {
+        std::vector<size_t> cpus;
+        for (size_t offset = 0; offset < list.size();) {
+            size_t end = list.find(',', offset);
+            if (end == std::string::npos) {
+                end = list.size();
+            }
+
+            const std::string range = list.substr(offset, end - offset);
+            const size_t dash = range.find('-');
+            const size_t first = std::stoul(range.substr(0, dash));
+            const size_t last = (dash == std::string::npos) ? first : std::stoul(range.substr(dash + 1));
+            for (size_t cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+
+            offset = end + 1;
+        }
+
+        return cpus;
+    }
+
+    // The CPUs belonging to a NUMA node, as listed by sysfs.
+    inline std::vector<size_t> numa_node_cpus(const size_t node) {
+        std::ifstream stream("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+
+        std::string list;
+        if (!std::getline(stream, list)) {
+            throw std::runtime_error("Failed to read the cpus of numa node " + std::to_string(node));
+        }
+
+        // Nodes with only memory have an empty list. Threads pinned to it wouldn't be pinned at all.
+        std::vector<size_t> cpus;
+        try {
+            cpus = parse_cpu_list(list);
+        }
+        catch (const std::logic_error&) {
+            throw std::runtime_error("Failed to parse the cpus of numa node " + std::to_string(node) + ": " + list);
+        }
+
+        if (cpus.empty()) {
+            throw std::runtime_error("Numa node " + std::to_string(node) + " has no cpus");
+        }
+
+        return cpus;
+    }
+
     inline pid_t get_tid() {
         return syscall(SYS_gettid);
     }
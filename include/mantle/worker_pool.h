@@ -0,0 +1,63 @@
+#pragma once
+
+#include <span>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <type_traits>
+#include <cstdint>
+#include <cstddef>
+
+namespace mantle {
+
+    // A small fork-join pool used by the `Domain` to spread work across helper threads.
+    // The thread calling `run` participates as worker zero, so a pool without helper
+    // threads simply runs every task inline.
+    class WorkerPool {
+        WorkerPool(WorkerPool&&) = delete;
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(WorkerPool&&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+
+    public:
+        // Helper threads are restricted to these CPUs, unless the span is empty.
+        explicit WorkerPool(size_t helper_thread_count, std::span<const size_t> cpu_affinity = {});
+        ~WorkerPool();
+
+        // The number of distinct worker indices passed to tasks (helpers and the caller).
+        [[nodiscard]]
+        size_t worker_count() const;
+
+        // Invoke `task(task_index, worker_index)` for every task index in `[0, task_count)`
+        // and wait for all of them to complete. Tasks must not throw.
+        template<typename Task>
+        void run(size_t task_count, Task&& task) {
+            auto trampoline = [](void* context, size_t task_index, size_t worker_index) {
+                (*static_cast<std::remove_reference_t<Task>*>(context))(task_index, worker_index);
+            };
+
+            run(task_count, trampoline, &task);
+        }
+
+    private:
+        using TaskFunction = void (*)(void* context, size_t task_index, size_t worker_index);
+
+        void run(size_t task_count, TaskFunction function, void* context);
+        void work(size_t worker_index);
+        void helper_main(size_t worker_index);
+
+    private:
+        TaskFunction             function_;
+        void*                    context_;
+        size_t                   task_count_;
+
+        std::atomic<bool>        stopping_;
+        std::atomic<uint64_t>    generation_;
+        std::atomic<size_t>      next_task_;
+        std::atomic<size_t>      busy_count_;
+
+        std::vector<std::thread> threads_;
+    };
+
+}
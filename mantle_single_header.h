@@ -2,19 +2,36 @@
 
 #define MANTLE_SINGLE_HEADER
 
+#include <algorithm>
 #include <array>
 #include <atomic>
+#include <bit>
 #include <cassert>
+#include <cctype>
+#include <chrono>
 #include <climits>
 #include <compare>
+#include <coroutine>
 #include <cstddef>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
-#include <emmintrin.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <fmt/core.h>
+#include <fstream>
+#include <functional>
 #include <future>
 #include <iostream>
+#include <istream>
+#include <iterator>
 #include <limits>
+#include <linux/futex.h>
+#include <linux/mempolicy.h>
+#include <linux/mman.h>
+#include <linux/userfaultfd.h>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <new>
@@ -29,39 +46,285 @@
 #include <string_view>
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/user.h>
+#include <sys/wait.h>
 #include <thread>
 #include <type_traits>
 #include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
 // include/mantle/config.h
 
 
+// The size of a cache line on the target. Most x86-64 and aarch64 parts, Graviton included, use
+// 64 bytes. Apple's aarch64 cores use 128, and so do POWER cores. Define this at build time, e.g.
+// through the `MANTLE_CACHE_LINE_SIZE` CMake option, for targets these defaults get wrong.
+#if !defined(MANTLE_CACHE_LINE_SIZE)
+#  if (defined(__aarch64__) && defined(__APPLE__)) || defined(__powerpc64__)
+#    define MANTLE_CACHE_LINE_SIZE 128
+#  else
+#    define MANTLE_CACHE_LINE_SIZE 64
+#  endif
+#endif
+
+// aarch64 kernels can be built with 4, 16 or 64 KiB pages, so glibc doesn't define this there.
+#if !defined(PAGE_SIZE)
+#  if defined(MANTLE_PAGE_SIZE)
+#    define PAGE_SIZE MANTLE_PAGE_SIZE
+#  else
+#    define PAGE_SIZE 4096ul
+#  endif
+#endif
+
 // TODO: Use macros for the global variables instead of global variables.
 
 namespace mantle {
 
-    // This flag enables weighted reference counting in handles.
+    // This flag makes weighted reference counting the default policy for handles.
     constexpr bool ENABLE_WEIGHTED_REFERENCE_COUNTING = false;
     constexpr bool ENABLE_OBJECT_GROUPING = true;
 
+    // Phase transitions, messages and other cycle events are recorded in a per-thread ring
+    // that can be exported with `write_chrome_trace`.
+    constexpr bool ENABLE_TRACE = true;
+    constexpr size_t TRACE_RING_CAPACITY = 16 * 1024;
+
     // The number of messages that can be queued between `Domain` and `Region` endpoints.
     constexpr size_t STREAM_CAPACITY = 4096;
 
+    // The number of handles that can be queued in a `Channel` by default.
+    constexpr size_t CHANNEL_CAPACITY = 4096;
+
+    // Hot shared state is padded to this, and operation batches are one line each.
+    constexpr size_t CACHE_LINE_SIZE = MANTLE_CACHE_LINE_SIZE;
+    static_assert((CACHE_LINE_SIZE >= 32) && !(CACHE_LINE_SIZE & (CACHE_LINE_SIZE - 1)), "Cache lines must be a power of two of at least 32 bytes");
+
+    // Only the default huge page size is used. This is 2 MiB on x86-64 and on aarch64 with 4 KiB pages.
+    constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    constexpr size_t WRITE_BARRIER_CAPACITY = 128 * 1024;
+
+    // Idle write barrier segments are kept resident between these watermarks. Below the low one the pool
+    // is refilled ahead of demand, and above the high one the excess memory is handed back to the OS.
+    constexpr size_t WRITE_BARRIER_POOL_LOW_WATERMARK  = 4;
+    constexpr size_t WRITE_BARRIER_POOL_HIGH_WATERMARK = 16;
+
+    // Ledger pages are committed as the writer first touches them. Once a region has stayed below this
+    // fraction of its ledger capacity for a number of cycles, the pages it isn't using are decommitted.
+    constexpr double LEDGER_DECOMMIT_FILL   = 0.125;
+    constexpr size_t LEDGER_DECOMMIT_CYCLES = 16;
+
+    // How many objects ahead of the one being updated the apply loops prefetch by default.
+    // This should roughly cover memory latency divided by the cost of applying one operation.
+    constexpr size_t APPLY_PREFETCH_DISTANCE = 8;
+
+    // The largest batch of objects handed to a finalizer at once when finalization is time-budgeted.
+    // The deadline is only checked between batches.
+    constexpr size_t FINALIZATION_BATCH_SIZE = 256;
 
-    // FIXME: Some architectures have cache lines that are 128 bytes. We should detect this.
-    constexpr size_t CACHE_LINE_SIZE = 64;
+    // The number of operation groups in each controller's grouper by default.
+    constexpr size_t OPERATION_GROUPER_CACHE_SIZE = 512;
+
+    enum class HugePagePolicy {
+        NONE,        // Regular pages.
+        TRANSPARENT, // Huge page aligned and advised with MADV_HUGEPAGE, if THP is set to madvise or always.
+        EXPLICIT,    // Reserved hugetlb pages, falling back to TRANSPARENT when none are available.
+    };
+
+    // How operations are stored in a region's ledger.
+    enum class LedgerEncoding {
+        FULL,    // Every operation is a full tagged pointer.
+        COMPACT, // Operations take half the space as offsets from a base, and objects far from it take one and a half times.
+    };
+
+    enum class WakeupPolicy {
+        EVENTFD, // Every message rings an eventfd, so the receiver can wait on a file descriptor.
+        FUTEX,   // Messages only wake the receiver when it is blocked, through a futex. There's no file descriptor.
+    };
+
+    enum class LedgerBackend {
+        OPERATION_LEDGER, // Only handles record operations, in each region's operation ledger.
+        WRITE_BARRIER,    // Refs also record operations, with a plain store into guard-paged segments.
+    };
+
+    // How the operation grouper makes room for new groups, and which groups it keeps across cycles.
+    enum class GrouperEvictionPolicy {
+        SMALLEST_DELTA, // Replace the group with the smallest net delta. Groups that keep getting hit outlive a cycle.
+        FEWEST_HITS,    // Replace the group that has been hit the least. Groups that keep getting hit outlive a cycle.
+        EVERY_CYCLE,    // Replace the group with the smallest net delta, and flush every group at the end of a cycle.
+    };
+
+    // How the operation grouper combines operations on the same object.
+    enum class GrouperEngine {
+        CACHE, // Groups operations in a set-associative cache. Objects that don't fit aren't combined.
+        RADIX, // Radix sorts each cycle's operations by object, so every duplicate is merged and applied in address order.
+    };
+
+    class LedgerRecorder;
 
     struct Config {
+        // Run the domain thread and its workers on these CPUs. An empty list is rejected rather than
+        // leaving the threads unpinned.
         std::optional<std::span<size_t>> domain_cpu_affinity;
 
+        // Run the domain thread and its workers on the CPUs of this NUMA node. `domain_cpu_affinity` takes
+        // precedence when both are set. Nodes without any CPUs are rejected.
+        std::optional<size_t> domain_numa_node;
+
+        // Pin the domain thread and its workers to CPUs that share a cache with the most region threads,
+        // as read from sysfs. Region threads get matching CPUs from `Domain::placement`. The two options
+        // above take precedence when either is set.
+        bool topology_placement = false;
+
+        // Bind memory to the NUMA node of the thread that mostly uses it, instead of wherever it is first
+        // touched. Ledgers and region-bound streams go to the region thread's node, and domain-bound streams
+        // to the domain's node. Controllers are only touched by the domain thread and its workers, so they
+        // follow `domain_numa_node`.
+        bool numa_placement = false;
+
+        // Handles always record their operations in the operation ledger. With `WRITE_BARRIER`, regions
+        // also set up a write barrier ledger that `Ref`s record into, and the domain runs a thread to
+        // swap in fresh segments when a write runs into a guard page. This needs userfaultfd, so
+        // constructing the domain throws where it isn't available.
+        LedgerBackend ledger_backend = LedgerBackend::OPERATION_LEDGER;
+
+        // How many idle write barrier segments the domain keeps resident. See `WRITE_BARRIER_POOL_LOW_WATERMARK`.
+        size_t write_barrier_pool_low_watermark  = WRITE_BARRIER_POOL_LOW_WATERMARK;
+        size_t write_barrier_pool_high_watermark = WRITE_BARRIER_POOL_HIGH_WATERMARK;
+
+        // Keep reference counts in a dense table per region instead of in the objects, so that applying
+        // operations doesn't dirty the cache lines of live objects. Each region can have at most
+        // `reference_count_table_capacity` live objects. The table's pages are only populated as needed.
+        bool   reference_count_table          = false;
+        size_t reference_count_table_capacity = 16 * 1024 * 1024;
+
         // The maximum number of pending operations per-region.
         size_t ledger_capacity = 1024 * 1024;
 
+        // How long a region has to stay below `ledger_decommit_fill` before it gives back the pages of
+        // its ledger it isn't using. Zero keeps every page that was ever written.
+        double ledger_decommit_fill   = LEDGER_DECOMMIT_FILL;
+        size_t ledger_decommit_cycles = LEDGER_DECOMMIT_CYCLES;
+
+        // When the ledger is full, operations spill into per-transaction overflow buffers that grow
+        // as needed, instead of stalling the writing thread until the domain has caught up.
+        bool ledger_overflow = false;
+
+        // Operations from threads without a region go to a process-wide fallback ledger, which this
+        // domain's regions drain into their own transactions, instead of being leaked. Only one domain
+        // per process can enable this. See `DomainMetrics::fallback_operation_count`.
+        bool fallback_ledger = false;
+
+        // Fold operations on the same object together on the region thread before they reach the ledger,
+        // in a direct-mapped cache of this many objects. Only the net deltas of a transaction are written,
+        // so handles that are copied and dropped again cost no ledger bandwidth. Zero disables this.
+        size_t region_combining_cache_size = 0;
+
+        // Apply operations on objects bound to the writing region on the region thread, instead of
+        // sending them through the domain. Only operations on other regions' objects are submitted, so
+        // mostly local workloads hardly load the domain. This is ignored with `reference_count_table`.
+        bool local_operations = false;
+
+        // Back ledger storage with huge pages. The domain reads every region's ledger each cycle, so a
+        // large `ledger_capacity` spends much of that time in TLB misses with regular pages.
+        HugePagePolicy ledger_huge_pages = HugePagePolicy::NONE;
+
+        // Write half-size operations to the ledger, which halves the memory traffic of writing them on
+        // the region and reading them on the domain. Objects more than a couple of GiB from the first one
+        // a region writes are stored in full and take up three entries. `ledger_capacity` counts entries.
+        LedgerEncoding ledger_encoding = LedgerEncoding::FULL;
+
+        // When non-zero, the domain checks region streams in a busy loop for this long before blocking,
+        // and regions skip the doorbell while it is. This takes syscalls out of busy cycles at the
+        // cost of keeping the domain thread's core busy, so pair it with `domain_cpu_affinity`.
+        std::chrono::nanoseconds domain_spin_duration = std::chrono::nanoseconds::zero();
+
+        // Don't give the domain a thread of its own. Whoever created it drives it with `Domain::step`
+        // instead, e.g. from an event loop watching `Domain::file_descriptor`. Regions on that thread
+        // step the domain themselves whenever they would block, so they can still be created and
+        // stopped there. The domain's CPU affinity isn't applied, since the thread isn't its own.
+        bool domain_embedded = false;
+
+        // How the domain wakes up regions blocked in `Region::step`. With futexes the sender skips the
+        // system call unless the region is actually asleep, so a busy cycle costs no syscalls on either
+        // side. `Region::file_descriptor` never becomes readable then, so keep eventfds for event loops.
+        WakeupPolicy region_wakeups = WakeupPolicy::EVENTFD;
+
+        // The number of helper threads the domain uses to route and apply operations in parallel.
+        // Zero keeps all of this work on the domain thread.
+        size_t domain_worker_count = 0;
+
+        // The domain splits its controllers into clusters of this many consecutive regions, e.g. one per
+        // L3 cache, and keeps a census for each. Barrier state is combined from the clusters, and clusters
+        // with nothing to send or synchronize are skipped as a whole. With `domain_worker_count`, each
+        // cluster also delivers, synchronizes and sends for its own regions on the workers, leaving the
+        // domain thread with only the combined census to act on. Zero keeps a single cluster.
+        size_t domain_cluster_size = 0;
+
+        // How many objects ahead the reference count apply loops prefetch. Zero disables prefetching.
+        size_t apply_prefetch_distance = APPLY_PREFETCH_DISTANCE;
+
+        // Regions sort operations by owning region when they commit a transaction, so the domain
+        // can route them without reading every object.
+        bool partition_operations = false;
+
+        // Overlap each cycle's routing with applying the operations routed in the cycle before, so a
+        // cycle only has one barrier to wait on after submitting. Operations take an extra cycle to be
+        // applied, but cycles are shorter and routing and applying share one pass over the workers.
+        bool pipeline_cycles = false;
+
         // This enables the grouper which tries to consolidate operations on the same object.
         // and net their effects to reduce the number of operations that need to be retired/applied.
         bool operation_grouper_enabled = true;
+
+        // The number of operation groups each controller keeps, rounded up to a power of two. If the maximum
+        // is larger, the cache doubles at a cycle boundary when groups were evicted before they could combine,
+        // and halves back towards `operation_grouper_cache_size` once it has been mostly empty for a while.
+        size_t                operation_grouper_cache_size     = OPERATION_GROUPER_CACHE_SIZE;
+        size_t                operation_grouper_cache_size_max = OPERATION_GROUPER_CACHE_SIZE;
+        GrouperEvictionPolicy operation_grouper_eviction       = GrouperEvictionPolicy::SMALLEST_DELTA;
+        GrouperEngine         operation_grouper_engine         = GrouperEngine::CACHE;
+
+        // Bounds how much finalization a single `Region::step` call will do. Garbage that
+        // doesn't fit in the budget is carried over to the next step, and the region's file
+        // descriptor stays readable until it has been dealt with. Zero means unbounded.
+        size_t                   finalization_budget_objects = 0;
+        std::chrono::nanoseconds finalization_budget_time    = std::chrono::nanoseconds::zero();
+
+        // Regions ask for a cycle whenever they have pending operations. The domain holds a request
+        // until `cycle_interval_min` has passed since the previous cycle started, so busy regions get
+        // fewer, larger cycles. A region whose ledger is at least `cycle_urgent_fill` full is not held.
+        std::chrono::nanoseconds cycle_interval_min = std::chrono::nanoseconds::zero();
+        double                   cycle_urgent_fill  = 0.5;
+
+        // Operations stay in flight for a few cycles after they are submitted. If no region asks for
+        // a cycle within `cycle_interval_max` the domain starts one itself, so memory is reclaimed
+        // promptly once the application goes idle. Zero disables this.
+        std::chrono::nanoseconds cycle_interval_max = std::chrono::nanoseconds::zero();
+
+        // Objects can be bound with a rough byte cost. Once the objects a region dropped in cycles that
+        // haven't been applied yet add up to `cycle_pressure_bytes`, its cycles aren't held back either.
+        // The domain does the same while the resident set of the process is above `cycle_pressure_rss`
+        // bytes. Zero disables either.
+        size_t                   cycle_pressure_bytes = 0;
+        size_t                   cycle_pressure_rss   = 0;
+
+        // Record every operation the domain routes, with the cycles they were routed in, so the workload
+        // can be replayed offline with `LedgerReplay`. The recorder has to outlive the domain.
+        LedgerRecorder* ledger_recorder = nullptr;
+
+        // Take a census of live objects by group every `heap_census_interval` cycles, which is published
+        // with the domain's metrics. Counting live objects costs a little at every bind and death, and a
+        // sampled cycle also looks at every object it applied operations to. Zero disables it.
+        size_t heap_census_interval = 0;
     };
 }
 
@@ -75,7 +338,7 @@ namespace mantle {
 
     using RegionId        = uint16_t;
     using ObjectGroup     = uint16_t;
-    using ObjectGroupMask = std::array<uint64_t, std::numeric_limits<ObjectGroup>::max() / (sizeof(uint64_t) * CHAR_BIT)>;
+    using ObjectGroupMask = std::array<uint64_t, (std::numeric_limits<ObjectGroup>::max() + 1) / (sizeof(uint64_t) * CHAR_BIT)>;
     using AtomicSequence  = std::atomic_uint64_t;
     using Sequence        = AtomicSequence::value_type;
 
@@ -94,6 +357,22 @@ namespace mantle {
 
     constexpr SequenceRange EMPTY_SEQUENCE_RANGE = { .head=0, .tail=0 };
 
+    constexpr size_t OBJECT_GROUP_MASK_WORD_BITS = sizeof(ObjectGroupMask::value_type) * CHAR_BIT;
+
+    // Visit the groups set in the mask in ascending order, only looking at the words that cover the range.
+    template<typename Visitor>
+    inline void for_each_group(const ObjectGroupMask& mask, const ObjectGroup group_min, const ObjectGroup group_max, Visitor&& visitor) {
+        if (group_min > group_max) {
+            return;
+        }
+
+        for (size_t word = group_min / OBJECT_GROUP_MASK_WORD_BITS; word <= (group_max / OBJECT_GROUP_MASK_WORD_BITS); ++word) {
+            for (uint64_t bits = mask[word]; bits; bits &= bits - 1) {
+                visitor(static_cast<ObjectGroup>((word * OBJECT_GROUP_MASK_WORD_BITS) + static_cast<size_t>(__builtin_ctzll(bits))));
+            }
+        }
+    }
+
     // TODO: Move this into a separate file. It knows too much aabout other classes.
     struct ObjectGroups {
         Object**         objects;
@@ -101,26 +380,32 @@ namespace mantle {
         ObjectGroup      group_min;     // Inclusive.
         ObjectGroup      group_max;     // Inclusive.
         size_t*          group_offsets; // Offsets into the objects array (where to find members).
+        size_t*          group_sizes;   // The number of members. Like the offsets, only valid for non-empty groups.
         ObjectGroupMask* group_mask;    // A bitset of non-empty groups.
 
         [[nodiscard]]
-        size_t group_member_count(ObjectGroup group) const {
+        bool has_group(ObjectGroup group) const {
             if constexpr (!ENABLE_OBJECT_GROUPING) {
                 abort();
             }
 
-            return group_offsets[static_cast<size_t>(group) + 1] - group_offsets[group];
+            return (((*group_mask)[group / OBJECT_GROUP_MASK_WORD_BITS] >> (group % OBJECT_GROUP_MASK_WORD_BITS)) & 1) != 0;
+        }
+
+        [[nodiscard]]
+        size_t group_member_count(ObjectGroup group) const {
+            return has_group(group) ? group_sizes[group] : 0;
         }
 
         [[nodiscard]]
         std::span<Object*> group_members(ObjectGroup group) {
-            if constexpr (!ENABLE_OBJECT_GROUPING) {
-                abort();
+            if (!has_group(group)) {
+                return {};
             }
 
             return {
-                &objects[group],
-                group_member_count(group)
+                &objects[group_offsets[group]],
+                group_sizes[group]
             };
         }
 
@@ -130,11 +415,9 @@ namespace mantle {
                 abort();
             }
 
-            for (ObjectGroup group = group_min; group <= group_max; ++group) {
-                if (std::span<Object*> members = group_members(group); !members.empty()) {
-                    visitor(group, members);
-                }
-            }
+            mantle::for_each_group(*group_mask, group_min, group_max, [&](ObjectGroup group) {
+                visitor(group, std::span<Object*>(&objects[group_offsets[group]], group_sizes[group]));
+            });
         }
     };
 
@@ -191,7 +474,35 @@ namespace mantle {
         return log2_floor(value - 1) + 1;
     }
 
-    inline void set_cpu_affinity(std::span<size_t> cpus) {
+    // Hint that the cache line holding this address is about to be read. Unlike the one below,
+    // this leaves the line shared with other cores.
+    MANTLE_HOT void prefetch_for_read(const void* address) {
+#ifdef __GNUC__
+        __builtin_prefetch(address, 0, 3);
+#else
+        (void)address;
+#endif
+    }
+
+    // Hint that the cache line holding this address is about to be written.
+    MANTLE_HOT void prefetch_for_write(const void* address) {
+#ifdef __GNUC__
+        __builtin_prefetch(address, 1, 3);
+#else
+        (void)address;
+#endif
+    }
+
+    // Tell the CPU we are in a spin loop, so it can back off and save power.
+    MANTLE_HOT void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+    inline void set_cpu_affinity(std::span<const size_t> cpus) {
         cpu_set_t set;
         CPU_ZERO(&set);
 
@@ -206,6 +517,69 @@ namespace mantle {
         std::this_thread::yield();
     }
 
+    // The NUMA node of the CPU this thread is running on right now.
+    inline std::optional<size_t> current_numa_node() {
+        unsigned cpu = 0;
+        unsigned node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) < 0) {
+            return std::nullopt;
+        }
+
+        return node;
+    }
+
+    // Parse a CPU list the way sysfs writes them, e.g. "0-3,8-11".
+    inline std::vector<size_t> parse_cpu_list(const std::string& list) {
+        std::vector<size_t> cpus;
+        for (size_t offset = 0; offset < list.size();) {
+            size_t end = list.find(',', offset);
+            if (end == std::string::npos) {
+                end = list.size();
+            }
+
+            const std::string range = list.substr(offset, end - offset);
+            const size_t dash = range.find('-');
+            const size_t first = std::stoul(range.substr(0, dash));
+            const size_t last = (dash == std::string::npos) ? first : std::stoul(range.substr(dash + 1));
+            for (size_t cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+
+            offset = end + 1;
+        }
+
+        return cpus;
+    }
+
+    // The CPUs belonging to a NUMA node, as listed by sysfs.
+    inline std::vector<size_t> numa_node_cpus(const size_t node) {
+        std::ifstream stream("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+
+        std::string list;
+        if (!std::getline(stream, list)) {
+            throw std::runtime_error("Failed to read the cpus of numa node " + std::to_string(node));
+        }
+
+        // Nodes with only memory have an empty list. Threads pinned to it wouldn't be pinned at all.
+        std::vector<size_t> cpus;
+        try {
+            cpus = parse_cpu_list(list);
+        }
+        catch (const std::logic_error&) {
+            throw std::runtime_error("Failed to parse the cpus of numa node " + std::to_string(node) + ": " + list);
+        }
+
+        if (cpus.empty()) {
+            throw std::runtime_error("Numa node " + std::to_string(node) + " has no cpus");
+        }
+
+        return cpus;
+    }
+
+    inline pid_t get_tid() {
+        return syscall(SYS_gettid);
+    }
+
 }
 
 
@@ -303,7 +677,9 @@ namespace mantle {
     static_assert(std::is_trivial_v<Operation>, "Operation must be a trivial type.");
 
     // NOTE: `capacity == size` since it is always padded by null operations.
-    struct alignas(64) OperationBatch {
+    struct alignas(CACHE_LINE_SIZE) OperationBatch {
+        using Entry = Operation;
+
         static constexpr size_t SIZE  = CACHE_LINE_SIZE / sizeof(Operation);
         static constexpr size_t SHIFT = log2_floor(SIZE);
         static constexpr size_t MASK  = SIZE - 1; // TODO: Remove this.
@@ -381,200 +757,111 @@ namespace mantle {
 }
 
 
-// include/mantle/object.h
+// include/mantle/compact_operation.h
 
 
 namespace mantle {
 
-    // This alignment gives us 4 tag bits to use in the encoding of an operation.
-    class alignas(16) Object {
-    public:
-        explicit Object(ObjectGroup group = 0);
-        ~Object();
-
-        Object(Object&&) = delete;
-        Object(const Object&) = delete;
-        Object& operator=(Object&&) = delete;
-        Object& operator=(const Object&) = delete;
-
-        [[nodiscard]]
-        bool is_managed() const;
+    // Half an operation, which keeps the tag but stores the object as an offset from a base address,
+    // in units of the object alignment. Zero is a null operation, like it is for a full one.
+    //
+    // Objects outside the window of the base are escaped: the entry holds `ESCAPE` instead of an offset,
+    // and the next two entries hold the low and high half of the full operation.
+    //
+    struct CompactOperation {
+        static constexpr uint32_t OFFSET_SHIFT = Operation::TAG_BITS;
+        static constexpr uint32_t OFFSET_BITS  = (sizeof(uint32_t) * CHAR_BIT) - OFFSET_SHIFT;
+        static constexpr uint32_t ESCAPE       = (1u << OFFSET_BITS) - 1;
 
-        [[nodiscard]]
-        RegionId region_id() const;
+        // The number of entries an escaped operation takes up.
+        static constexpr size_t ESCAPED_SIZE = 3;
 
         [[nodiscard]]
-        ObjectGroup group() const;
-
-    private:
-        template<typename T>
-        friend class Handle;
-        friend class Region;
-        friend class RegionController;
-
-        // Associate this `Object` to the local `Region`. Reference counting
-        // and object finalization will be handled by that `Region. An `Object`
-        // can only be bound once, when a handle to it is first created.
-        //
-        void bind(RegionId region_id);
-
-        // Submit an operation to the `Region` who will forward it to the `Domain`.
-        void start_increment_operation(uint8_t exponent);
-        void start_increment_operation(Operation operation);
-        void start_decrement_operation(uint8_t exponent);
-        void start_decrement_operation(Operation operation);
-
-        // Update the reference count of this `Object` by the given magnitude.
-        // These functions return `true` if the reference count remains positive.
-        bool apply_increment(uint32_t delta_magnitude);
-        bool apply_decrement(uint32_t delta_magnitude);
+        bool is_escape() const noexcept {
+            return (bits >> OFFSET_SHIFT) == ESCAPE;
+        }
 
-    private:
-        uint32_t    reference_count_;
-        RegionId    region_id_;
-        ObjectGroup group_;
+        uint32_t bits;
     };
+    static_assert(std::is_trivial_v<CompactOperation>, "CompactOperation must be a trivial type.");
 
-    // Ensure that we can pack a tag and pointer into an Operation.
-    static_assert(alignof(Object) >= (1ull << Operation::TAG_BITS));
-    static_assert(sizeof(Object*) == sizeof(Operation));
-
-}
-
-
-// include/mantle/object_cache.h
-
-
-namespace mantle {
-
-    // TODO: SSE2 probing.
-    // TODO: Live mask that we can `&` with the probe result.
-    //
-    template<typename T, size_t CACHE_SIZE, size_t CACHE_WAYS>
-    class ObjectCache {
-    public:
-        static_assert(is_power_of_2(CACHE_SIZE));
-        static_assert(is_power_of_2(CACHE_WAYS));
+    // NOTE: `capacity == size` since it is always padded by null operations.
+    struct alignas(CACHE_LINE_SIZE) CompactOperationBatch {
+        using Entry = CompactOperation;
 
-        static constexpr size_t CACHE_SETS = CACHE_SIZE / CACHE_WAYS;
+        static constexpr size_t SIZE  = CACHE_LINE_SIZE / sizeof(CompactOperation);
+        static constexpr size_t SHIFT = log2_floor(SIZE);
+        static constexpr size_t MASK  = SIZE - 1;
 
-        static constexpr uintptr_t SET_SHIFT = log2_floor(alignof(Object));
-        static constexpr uintptr_t SET_BITS  = log2_floor(CACHE_SETS);
-        static constexpr uintptr_t SET_MASK  = (1ull << SET_BITS) - 1;
+        CompactOperation operations[SIZE];
+    };
+    static_assert(sizeof(CompactOperationBatch) == sizeof(OperationBatch));
 
+    // Converts between full and compact operations around a base address, which is picked so the
+    // first object encoded lands in the middle of the window. It never moves after that, so entries
+    // stay readable for as long as the ledger that holds them.
+    class CompactOperationCodec {
     public:
-        struct Entry {
-            Object* key;
-            T       val;
-
-            auto operator<=>(const Entry&) const noexcept = default;
-        };
-
-        class Cursor {
-        public:
-            explicit Cursor(const size_t pos = 0)
-                : pos_(pos)
-            {
-                assert(pos_ <= CACHE_SIZE);
-            }
-
-            Cursor(const size_t set, const size_t way)
-                : Cursor((set * CACHE_WAYS) + way)
-            {
-                assert(pos_ <= CACHE_SIZE);
-            }
-
-            auto operator<=>(const Cursor&) const noexcept = default;
-
-            explicit operator bool() const {
-                return pos_ < CACHE_SIZE;
-            }
-
-            [[nodiscard]]
-            size_t set() const {
-                return pos_ / CACHE_WAYS;
-            }
-
-            [[nodiscard]]
-            size_t way() const {
-                return pos_ % CACHE_WAYS;
-            }
+        static constexpr uintptr_t WINDOW_SIZE = uintptr_t{1} << (CompactOperation::OFFSET_BITS + CompactOperation::OFFSET_SHIFT);
 
-            std::optional<Cursor> next() const {
-                if (Cursor cursor = *this; cursor.advance()) {
-                    return cursor;
-                }
+        CompactOperationCodec()
+            : base_(0)
+            , has_base_(false)
+        {
+        }
 
-                return std::nullopt;
+        // Returns false if the operation has to be escaped.
+        [[nodiscard]] MANTLE_HOT bool encode(const Operation operation, CompactOperation& entry) {
+            const uintptr_t pointer = operation.tagged_pointer_ & Operation::POINTER_MASK;
+            if (UNLIKELY(!has_base_)) {
+                base_ = (pointer > (WINDOW_SIZE / 2)) ? ((pointer - (WINDOW_SIZE / 2)) & Operation::POINTER_MASK) : 0;
+                has_base_ = true;
             }
 
-            bool advance() {
-                assert(*this);
+            const uintptr_t offset = (pointer - base_) >> CompactOperation::OFFSET_SHIFT;
 
-                pos_ += 1;
-                return static_cast<bool>(*this);
+            // Offsets wrap around below the base, and the smallest one would read as a null operation.
+            if (UNLIKELY((pointer <= base_) || (offset >= CompactOperation::ESCAPE))) {
+                return false;
             }
 
-        private:
-            size_t pos_;
-        };
+            entry.bits = static_cast<uint32_t>((offset << CompactOperation::OFFSET_SHIFT) | (operation.tagged_pointer_ & Operation::TAG_MASK));
+            return true;
+        }
 
-    public:
-        ObjectCache() {
-            reset();
+        // The entries an escaped operation is written as.
+        [[nodiscard]]
+        static std::array<CompactOperation, CompactOperation::ESCAPED_SIZE> escape(const Operation operation) {
+            return {{
+                { .bits = CompactOperation::ESCAPE << CompactOperation::OFFSET_SHIFT },
+                { .bits = static_cast<uint32_t>(operation.tagged_pointer_) },
+                { .bits = static_cast<uint32_t>(operation.tagged_pointer_ >> 32) },
+            }};
         }
 
-        std::pair<Cursor, Cursor> equal_range(Object* key) const {
-            size_t set = to_set(key);
+        [[nodiscard]] MANTLE_HOT Operation decode(const CompactOperation entry) const {
+            assert(!entry.is_escape());
 
+            const uintptr_t offset = uintptr_t{entry.bits} & ~Operation::TAG_MASK;
+            const uintptr_t tag = uintptr_t{entry.bits} & Operation::TAG_MASK;
+
+            // Null entries have to decode to a null operation rather than the base.
+            const uintptr_t live = -static_cast<uintptr_t>(entry.bits != 0);
             return {
-                Cursor(set, 0),
-                Cursor(set + 1, 0),
+                .tagged_pointer_ = (base_ + offset + tag) & live,
             };
         }
 
-        Entry load(Cursor cursor) {
-            size_t set = cursor.set();
-            size_t way = cursor.way();
-
+        [[nodiscard]]
+        static Operation unescape(const CompactOperation low, const CompactOperation high) {
             return {
-                .key = keys_[set][way],
-                .val = vals_[set][way],
+                .tagged_pointer_ = uintptr_t{low.bits} | (uintptr_t{high.bits} << 32),
             };
         }
 
-        void store(Cursor cursor, Entry entry) {
-            size_t set = cursor.set();
-            size_t way = cursor.way();
-
-            keys_[set][way] = entry.key;
-            vals_[set][way] = entry.val;
-        }
-
-        void reset(Cursor cursor) {
-            size_t set = cursor.set();
-            size_t way = cursor.way();
-
-            keys_[set][way] = nullptr;
-            vals_[set][way] = T{};
-        }
-
-        void reset() {
-            for (Cursor cursor; cursor; cursor.advance()) {
-                reset(cursor);
-            }
-        }
-
-    private:
-        static size_t to_set(Object* key) {
-            uintptr_t ptr;
-            memcpy(&ptr, &key, sizeof(ptr));
-            return (ptr >> SET_SHIFT) & SET_MASK;
-        }
-
     private:
-        Object* keys_[CACHE_SETS][CACHE_WAYS];
-        T       vals_[CACHE_SETS][CACHE_WAYS];
+        uintptr_t base_;
+        bool      has_base_;
     };
 
 }
@@ -583,13 +870,23 @@ namespace mantle {
 // include/mantle/operation_writer.h
 
 
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#elif defined(__aarch64__)
+#  include <arm_neon.h>
+#endif
+
+
 namespace mantle {
 
-    // This class streams batches of operations to memory, bypassing the CPU cache hierarchy.
-    template<typename Storage_>
+    // This class streams batches of operations to memory, bypassing the CPU cache hierarchy. The batch
+    // decides how operations are encoded, and the storage hands out batches by index.
+    template<typename Storage_, typename Batch_ = OperationBatch>
     class OperationWriter {
     public:
         using Storage = Storage_;
+        using Batch = Batch_;
+        using Entry = typename Batch::Entry;
 
         OperationWriter(Storage& storage, Sequence head = 0, Sequence tail = 0)
             : storage_(storage)
@@ -610,35 +907,56 @@ namespace mantle {
             return head_;
         }
 
+        // The number of entries that can still be written before running into the tail.
+        size_t available() const {
+            return tail_ - head_;
+        }
+
         // TODO: Look at the code-gen for this. I think it might suck.
         //       We want a fairly short instruction sequence so it can inline.
-        MANTLE_HOT bool write(Operation operation) {
+        MANTLE_HOT bool write(Entry operation) {
             if (head_ == tail_) {
                 return false;
             }
 
-            size_t operation_index = head_ & OperationBatch::MASK;
+            size_t operation_index = head_ & Batch::MASK;
             batch_.operations[operation_index] = operation;
 
             // Stream the batch to memory if we just completed it.
-            if (operation_index == OperationBatch::MASK) {
-                size_t batch_index = head_ >> OperationBatch::SHIFT;
+            if (operation_index == Batch::MASK) {
+                size_t batch_index = head_ >> Batch::SHIFT;
+                stream_batch(storage_[batch_index], batch_.operations);
+            }
+
+            head_ += 1;
+
+            return true;
+        }
 
-                OperationBatch* target_batch = &storage_[batch_index];
-                __m128i* target_pointer = (__m128i*)target_batch;
+        // Write as many of the operations as there is room for, and return how many that was. The bounds
+        // are only checked once, and whole batches go straight from the operations to memory.
+        MANTLE_HOT size_t write(std::span<const Entry> operations) {
+            const size_t count = std::min<size_t>(operations.size(), tail_ - head_);
+            size_t index = 0;
+
+            // Top up the batch we're in the middle of.
+            while ((index < count) && (head_ & Batch::MASK)) {
+                write(operations[index++]);
+            }
 
-                const OperationBatch* source_batch = &batch_;
-                const __m128i* source_pointer = (const __m128i*)source_batch;
+            while ((count - index) >= Batch::SIZE) {
+                // The operations needn't be aligned to a batch.
+                stream_batch(storage_[head_ >> Batch::SHIFT], &operations[index]);
 
-                _mm_stream_si128(target_pointer+0, _mm_load_si128(source_pointer+0));
-                _mm_stream_si128(target_pointer+1, _mm_load_si128(source_pointer+1));
-                _mm_stream_si128(target_pointer+2, _mm_load_si128(source_pointer+2));
-                _mm_stream_si128(target_pointer+3, _mm_load_si128(source_pointer+3));
+                head_ += Batch::SIZE;
+                index += Batch::SIZE;
             }
 
-            head_ += 1;
+            while (index < count) {
+                write(operations[index++]);
+            }
 
-            return true;
+            return count;
         }
 
         // Pad the current batch with null operations and write it out if it is partially full.
@@ -646,30 +964,69 @@ namespace mantle {
         // !!! This must be called to make prior writes visible in other threads. !!!
         //
         void flush() {
-            while (head_ & OperationBatch::MASK) {
-                write(make_null_operation());
+            // Null entries are all zero, whatever the encoding.
+            while (head_ & Batch::MASK) {
+                write(Entry {});
             }
 
-            _mm_sfence();
+            store_fence();
         }
 
         void reset(Sequence head = 0, Sequence tail = 0) {
-            assert(!(head & OperationBatch::MASK));
-            assert(!(tail & OperationBatch::MASK));
+            assert(!(head & Batch::MASK));
+            assert(!(tail & Batch::MASK));
 
             head_ = head;
             tail_ = tail;
         }
 
     private:
-        Storage&       storage_;
-        Sequence       head_;
-        Sequence       tail_;
-        OperationBatch batch_;
-    };
-
-    using OperationVector = std::vector<OperationBatch>;
-
+        // Copy a whole batch to memory without pulling its cache line into the cache. The source only
+        // needs to be aligned like an entry.
+        MANTLE_HOT static void stream_batch(Batch& target, const Entry* source) {
+#if defined(__SSE2__)
+            __m128i* target_pointer = reinterpret_cast<__m128i*>(&target);
+            const __m128i* source_pointer = reinterpret_cast<const __m128i*>(source);
+
+            for (size_t i = 0; i < (sizeof(Batch) / sizeof(__m128i)); ++i) {
+                _mm_stream_si128(target_pointer + i, _mm_loadu_si128(source_pointer + i));
+            }
+#elif defined(__aarch64__)
+            // STNP stores a pair of registers with a hint that they won't be read again soon.
+            std::byte* target_pointer = reinterpret_cast<std::byte*>(&target);
+            const uint64_t* source_pointer = reinterpret_cast<const uint64_t*>(source);
+
+            for (size_t i = 0; i < (sizeof(Batch) / (2 * sizeof(uint64x2_t))); ++i) {
+                const uint64x2_t low = vld1q_u64(source_pointer + (4 * i) + 0);
+                const uint64x2_t high = vld1q_u64(source_pointer + (4 * i) + 2);
+                asm volatile("stnp %q0, %q1, [%2]" :: "w"(low), "w"(high), "r"(target_pointer + (i * 2 * sizeof(uint64x2_t))) : "memory");
+            }
+#else
+            memcpy(&target, source, sizeof(Batch));
+#endif
+        }
+
+        // Order the streamed stores before whatever publishes them. Non-temporal stores are weakly
+        // ordered on x86, and a store barrier covers STNP on aarch64.
+        static void store_fence() {
+#if defined(__SSE2__)
+            _mm_sfence();
+#elif defined(__aarch64__)
+            asm volatile("dmb ishst" ::: "memory");
+#else
+            std::atomic_thread_fence(std::memory_order_release);
+#endif
+        }
+
+    private:
+        Storage&       storage_;
+        Sequence       head_;
+        Sequence       tail_;
+        Batch          batch_;
+    };
+
+    using OperationVector = std::vector<OperationBatch>;
+
     class OperationVectorWriter : private OperationWriter<OperationVector> {
     public:
         using Base = OperationWriter<OperationVector>;
@@ -738,15 +1095,96 @@ namespace mantle {
 }
 
 
-// include/mantle/ring.h
+// include/mantle/memory_mapping.h
 
 
 namespace mantle {
 
+    // Map private anonymous memory of at least `size` bytes. With a huge page policy the mapping is
+    // rounded up to whole huge pages and aligned to them. Explicit huge pages fall back to transparent
+    // ones when the hugetlb pool can't satisfy the request. If a NUMA node is given the memory prefers
+    // it, but can still come from other nodes when it is short. Throws `std::bad_alloc` on failure.
+    std::span<std::byte> map_memory(size_t size, HugePagePolicy policy, std::optional<size_t> numa_node = std::nullopt);
+
+    // Unmap memory returned by `map_memory` with the same size and policy.
+    void unmap_memory(std::span<std::byte> memory, HugePagePolicy policy);
+
+    // Hand the pages within this range of a mapping back to the OS, so they read as zero and are only
+    // committed again once they're touched. Pages that are only partly inside the range are kept.
+    void decommit_memory(std::span<std::byte> memory, HugePagePolicy policy);
+
+    // The size of the mapping `map_memory` creates for `size` bytes under this policy.
+    [[nodiscard]]
+    size_t mapping_size(size_t size, HugePagePolicy policy);
+
+    // The resident set size of this process in bytes, or zero if it can't be read.
+    [[nodiscard]]
+    size_t resident_memory_size();
+
+    // A standard allocator that gives every allocation its own mapping, so large buffers can be
+    // backed by huge pages. Only use this for a few big, long-lived allocations.
     template<typename T>
+    class MappedAllocator {
+    public:
+        using value_type = T;
+
+        explicit MappedAllocator(HugePagePolicy policy = HugePagePolicy::NONE, std::optional<size_t> numa_node = std::nullopt)
+            : policy_(policy)
+            , numa_node_(numa_node)
+        {
+        }
+
+        template<typename U>
+        MappedAllocator(const MappedAllocator<U>& other)
+            : policy_(other.policy())
+            , numa_node_(other.numa_node())
+        {
+        }
+
+        [[nodiscard]]
+        HugePagePolicy policy() const {
+            return policy_;
+        }
+
+        [[nodiscard]]
+        std::optional<size_t> numa_node() const {
+            return numa_node_;
+        }
+
+        [[nodiscard]]
+        T* allocate(size_t count) {
+            static_assert(alignof(T) <= PAGE_SIZE);
+            return reinterpret_cast<T*>(map_memory(count * sizeof(T), policy_, numa_node_).data());
+        }
+
+        void deallocate(T* pointer, size_t count) {
+            unmap_memory({ reinterpret_cast<std::byte*>(pointer), count * sizeof(T) }, policy_);
+        }
+
+        template<typename U>
+        bool operator==(const MappedAllocator<U>& other) const {
+            return (policy_ == other.policy()) && (numa_node_ == other.numa_node());
+        }
+
+    private:
+        HugePagePolicy        policy_;
+        std::optional<size_t> numa_node_;
+    };
+
+}
+
+
+// include/mantle/ring.h
+
+
+namespace mantle {
+
+    template<typename T, typename Allocator = std::allocator<T>>
     class Ring {
     public:
-        explicit Ring(size_t minimum_size) {
+        explicit Ring(size_t minimum_size, const Allocator& allocator = Allocator())
+            : data_(allocator)
+        {
             size_t size = 1;
             while (size < minimum_size) {
                 size = size * 2;
@@ -775,286 +1213,311 @@ namespace mantle {
         }
 
     private:
-        std::vector<T> data_;
-        size_t         mask_;
+        std::vector<T, Allocator> data_;
+        size_t                    mask_;
     };
 
 }
 
 
-// include/mantle/doorbell.h
+// include/mantle/object.h
 
 
 namespace mantle {
 
-    class Doorbell {
-        Doorbell(Doorbell&&) = delete;
-        Doorbell(const Doorbell&) = delete;
-        Doorbell& operator=(Doorbell&&) = delete;
-        Doorbell& operator=(const Doorbell&) = delete;
-
+    // This alignment gives us 4 tag bits to use in the encoding of an operation.
+    class alignas(16) Object {
     public:
-        Doorbell();
-        ~Doorbell();
+        explicit Object(ObjectGroup group = 0);
+        ~Object();
 
-        // Returns file descriptor that will indicate when the doorbell is ringing.
-        int file_descriptor();
+        Object(Object&&) = delete;
+        Object(const Object&) = delete;
+        Object& operator=(Object&&) = delete;
+        Object& operator=(const Object&) = delete;
 
-        // Ring the doorbell a number of times.
-        void ring(uint64_t count = 1);
+        [[nodiscard]]
+        bool is_managed() const;
 
-        // Return the number of times the doorbell has been rung since last polled.
-        uint64_t poll(bool non_blocking);
+        [[nodiscard]]
+        RegionId region_id() const;
+
+        [[nodiscard]]
+        ObjectGroup group() const;
 
     private:
-        int file_descriptor_;
+        template<typename T>
+        friend class Ref;
+        template<typename T, typename Policy>
+        friend class Handle;
+        template<typename T>
+        friend class Borrow;
+        template<typename T, typename Policy>
+        friend class AtomicHandle;
+        friend class Region;
+        friend class RegionController;
+        friend class RegionAllocator;
+        friend class LedgerReplay;
+
+        // Associate this `Object` to the local `Region`. Reference counting
+        // and object finalization will be handled by that `Region. An `Object`
+        // can only be bound once, when a handle to it is first created.
+        //
+        void bind(RegionId region_id);
+
+        // Submit an operation to the `Region` who will forward it to the `Domain`. The ones that take an
+        // operation are the fast path behind every handle copy and drop, so they're defined in region.h
+        // where they can inline all the way down to the ledger write.
+        void start_increment_operation(uint8_t exponent);
+        inline void start_increment_operation(Operation operation);
+        void start_decrement_operation(uint8_t exponent);
+        inline void start_decrement_operation(Operation operation);
+
+        // Update the reference count of this `Object` by the given magnitude.
+        // These functions return `true` if the reference count remains positive.
+        bool apply_increment(uint32_t delta_magnitude);
+        bool apply_decrement(uint32_t delta_magnitude);
+
+        // Drop the association with a region once the object has died.
+        void unbind();
+
+        // With `Config::reference_count_table` the count is kept in the region's table instead, and
+        // the field holds the slot it was given there.
+        [[nodiscard]]
+        uint32_t reference_count_slot() const;
+        void set_reference_count_slot(uint32_t slot);
+
+    private:
+        uint32_t    reference_count_;
+        RegionId    region_id_;
+        ObjectGroup group_;
     };
 
-}
+    // Ensure that we can pack a tag and pointer into an Operation.
+    static_assert(alignof(Object) >= (1ull << Operation::TAG_BITS));
+    static_assert(sizeof(Object*) == sizeof(Operation));
 
+}
 
-// include/mantle/message.h
 
+// include/mantle/operation_ledger.h
 
-#define MANTLE_MESSAGE_TYPES(X) \
-    X(START)                    \
-    X(ENTER)                    \
-    X(SUBMIT)                   \
-    X(RETIRE)                   \
-    X(LEAVE)                    \
 
 namespace mantle {
 
-    enum class MessageType {
-#define X(MANTLE_MESSAGE_TYPE) \
-        MANTLE_MESSAGE_TYPE,   \
+    class SequenceRangeHistory {
+    public:
+        explicit SequenceRangeHistory(size_t capacity)
+            : next_slot_(0)
+            , data_(capacity)
+        {
+            data_.fill(0);
+        }
 
-        MANTLE_MESSAGE_TYPES(X)
-#undef X
-    };
+        [[nodiscard]]
+        size_t capacity() const {
+            return data_.size();
+        }
 
-    union Message {
-        MessageType type;
+        [[nodiscard]]
+        SequenceRange select(int age = 0) const {
+            const Sequence prev_slot = next_slot_ - 1;
 
-        // region -> domain
-        struct Start {
-            MessageType type;
-        } start;
+            return {
+                .head = data_[prev_slot - age - 1],
+                .tail = data_[prev_slot - age - 0],
+            };
+        }
 
-        // domain -> region
-        struct Enter {
-            MessageType type;
-            Sequence    cycle;
-        } enter;
+        // NOTE: The `head` of the new range is implicitly the `tail` of the
+        //       previously inserted `SequenceRange`.
+        void insert(const Sequence tail) {
+            data_[next_slot_++] = tail;
+        }
 
-        // region -> domain
-        struct Submit {
-            MessageType   type;
-            bool          stop; // The region is ready to stop.
-            SequenceRange increments;
-            SequenceRange decrements;
-        } submit;
+    private:
+        Sequence       next_slot_;
+        Ring<Sequence> data_;
+    };
 
-        // domain -> region
-        struct Retire {
-            MessageType  type;
-            ObjectGroups garbage;
-        } retire;
+    // Operations written while the ledger was full, kept per transaction. These are submitted
+    // alongside the ledger's ranges and must outlive the cycles that submit them.
+    struct OperationSpill {
+        std::vector<Operation> increments;
+        std::vector<Operation> decrements;
 
-        // domain -> region
-        struct Leave {
-            MessageType type;
-            bool        stop; // The domain is ready to stop.
-        } leave;
-    };
+        [[nodiscard]]
+        bool is_empty() const {
+            return increments.empty() && decrements.empty();
+        }
 
-    constexpr Message make_start_message() {
-        return {
-            .start = {
-                .type = MessageType::START,
+        void write(const Operation operation) {
+            if (operation.type() == OperationType::INCREMENT) {
+                increments.push_back(operation);
             }
-        };
-    }
-
-    constexpr Message make_enter_message(Sequence cycle) {
-        return {
-            .enter = {
-                .type  = MessageType::ENTER,
-                .cycle = cycle,
+            else {
+                decrements.push_back(operation);
             }
-        };
-    }
+        }
 
-    constexpr Message make_leave_message(bool stop) {
-        return {
-            .leave = {
-                .type = MessageType::LEAVE,
-                .stop = stop,
-            }
-        };
-    }
+        void clear() {
+            increments.clear();
+            decrements.clear();
+        }
+    };
 
-    constexpr std::string_view to_string(MessageType type) {
-        using namespace std::literals;
+    // A ring of operation batches in a mapping that is reserved up front. Pages are only committed as
+    // batches are first written, and can be decommitted again while they aren't in use.
+    class LedgerStorage {
+    public:
+        LedgerStorage(size_t batch_count, HugePagePolicy huge_pages, std::optional<size_t> numa_node)
+            : memory_(map_memory(std::bit_ceil(batch_count) * sizeof(OperationBatch), huge_pages, numa_node))
+            , huge_pages_(huge_pages)
+            , mask_(std::bit_ceil(batch_count) - 1)
+        {
+        }
 
-        switch (type) {
-#define X(MANTLE_MESSAGE_TYPE)                     \
-            case MessageType::MANTLE_MESSAGE_TYPE: \
-                return #MANTLE_MESSAGE_TYPE ##sv;  \
+        ~LedgerStorage() {
+            unmap_memory(memory_, huge_pages_);
+        }
 
-            MANTLE_MESSAGE_TYPES(X)
-#undef X
+        LedgerStorage(LedgerStorage&&) = delete;
+        LedgerStorage(const LedgerStorage&) = delete;
+        LedgerStorage& operator=(LedgerStorage&&) = delete;
+        LedgerStorage& operator=(const LedgerStorage&) = delete;
+
+        // The number of batches in the ring.
+        [[nodiscard]]
+        size_t size() const {
+            return mask_ + 1;
         }
 
-        abort();
-    }
+        [[nodiscard]]
+        std::span<const std::byte> memory() const {
+            return memory_;
+        }
 
-}
+        OperationBatch& operator[](const Sequence batch) {
+            return batches()[batch & mask_];
+        }
 
+        const OperationBatch& operator[](const Sequence batch) const {
+            return batches()[batch & mask_];
+        }
 
-// include/mantle/operation_grouper.h
+        // The same lines, with a compact encoding.
+        CompactOperationBatch& compact_batch(const Sequence batch) {
+            return compact_batches()[batch & mask_];
+        }
 
+        const CompactOperationBatch& compact_batch(const Sequence batch) const {
+            return compact_batches()[batch & mask_];
+        }
 
-namespace mantle {
+        // Decommit the pages that only hold batches in this range. It can't be longer than the ring.
+        void decommit(const Sequence head_batch, const Sequence tail_batch) {
+            assert((tail_batch - head_batch) <= size());
 
-    struct OperationGrouperMetrics {
-        size_t grouped_count           = 0;
+            const size_t head = head_batch & mask_;
+            const size_t count = tail_batch - head_batch;
+            const size_t first_count = std::min(count, size() - head);
 
-        size_t written_count           = 0;
-        size_t written_increment_count = 0;
-        size_t written_decrement_count = 0;
-
-        size_t flushed_count           = 0;
-        size_t flushed_increment_count = 0;
-        size_t flushed_decrement_count = 0;
-    };
-
-    // This class attempts to reduce the number of random memory writes needed to update reference counts
-    // by combining operations on the same object into a single write. Grouped operations are not
-    // imediately applied.
-    //
-    // This has two major benefits:
-    //   1. Increments can be applied before decrements.
-    //   2. The prefetcher should have an easier time predicting what will be touched next.
-    //
-    class OperationGrouper {
-        static constexpr size_t CACHE_SIZE = 512;
-        static constexpr size_t CACHE_WAYS = 8;
-
-        struct OperationGroup {
-            int64_t delta = 0;
-            size_t  hit_count = 0;
-            size_t  hit_decay = 0;
-        };
-
-        using Cache       = ObjectCache<OperationGroup, CACHE_SIZE, CACHE_WAYS>;
-        using CacheEntry  = Cache::Entry;
-        using CacheCursor = Cache::Cursor;
-
-    public:
-        using Metrics = OperationGrouperMetrics;
-
-        OperationGrouper();
-
-        [[nodiscard]]
-        const Metrics& metrics() const;
-
-        // Returns true if there are operations missing from the increment/decrement collections
-        // because they have yet to be flushed.
-        [[nodiscard]]
-        bool is_dirty() const;
-
-        [[nodiscard]]
-        std::span<std::pair<Object*, int64_t>> increments();
-
-        [[nodiscard]]
-        std::span<std::pair<Object*, int64_t>> decrements();
-
-        // Write an operation to the cache. If flush is true, the operation is immediately written to the
-        // increment or decrement collection. Otherwise, the operation is grouped with other operations.
-        void write(Operation operation, bool flush = false);
-
-        // Flush operations from the cache to the increment and decrement collections.
-        // The force parameter will cause all operations to be flushed regardless of the hit count,
-        // which is useful during shutdown.
-        void flush(bool force = false);
-
-        // Clear the increment and decrement collections.
-        void clear();
-
-        // Equivelent to calling flush(true) and then clear().
-        void reset();
+            decommit_memory(memory_.subspan(head * sizeof(OperationBatch), first_count * sizeof(OperationBatch)), huge_pages_);
+            decommit_memory(memory_.first((count - first_count) * sizeof(OperationBatch)), huge_pages_);
+        }
 
     private:
-        // Select a cache entry for this object using a bunch of heuristics.
-        CacheCursor choose_way(Object* object);
-
-        void flush_group(CacheCursor cursor, bool force);
-        void reset_group(CacheCursor cursor);
+        OperationBatch* batches() const {
+            return reinterpret_cast<OperationBatch*>(memory_.data());
+        }
 
-        void note_operation_written(Operation operation);
-        void note_operation_flushed(Operation operation);
+        CompactOperationBatch* compact_batches() const {
+            return reinterpret_cast<CompactOperationBatch*>(memory_.data());
+        }
 
     private:
-        std::vector<std::pair<Object*, int64_t>> increments_;
-        std::vector<std::pair<Object*, int64_t>> decrements_;
-        size_t                                   cache_size_;
-        Metrics                                  metrics_;
-        Cache                                    cache_;
+        std::span<std::byte> memory_;
+        HugePagePolicy       huge_pages_;
+        size_t               mask_;
     };
 
-}
-
-
-// include/mantle/operation_ledger.h
+    // Writes the ledger's lines as compact batches.
+    class CompactLedgerStorage {
+    public:
+        explicit CompactLedgerStorage(LedgerStorage& storage)
+            : storage_(storage)
+        {
+        }
 
+        CompactOperationBatch& operator[](const Sequence batch) {
+            return storage_.compact_batch(batch);
+        }
 
-namespace mantle {
+    private:
+        LedgerStorage& storage_;
+    };
 
-    class SequenceRangeHistory {
+    // With `LedgerEncoding::COMPACT` every entry is a `CompactOperation`, so the capacity counts those,
+    // and an operation that has to be escaped takes up several entries. Readers go through
+    // `for_each_operation`, which decodes either encoding.
+    class OperationLedger {
     public:
-        explicit SequenceRangeHistory(size_t capacity)
-            : next_slot_(0)
-            , data_(capacity)
+        // Pages are given back once fewer than `decommit_fill` of the entries have been in use for
+        // `decommit_cycles` transactions in a row, and are never given back if that is zero.
+        explicit OperationLedger(
+            size_t                ledger_capacity,
+            HugePagePolicy        huge_pages      = HugePagePolicy::NONE,
+            std::optional<size_t> numa_node       = std::nullopt,
+            double                decommit_fill   = LEDGER_DECOMMIT_FILL,
+            size_t                decommit_cycles = LEDGER_DECOMMIT_CYCLES,
+            LedgerEncoding        encoding        = LedgerEncoding::FULL
+        )
+            : compact_(encoding == LedgerEncoding::COMPACT)
+            , batch_shift_(compact_ ? CompactOperationBatch::SHIFT : OperationBatch::SHIFT)
+            , capacity_(std::bit_ceil(std::max(ledger_capacity, size_t{1} << batch_shift_)))
+            , storage_(capacity_ >> batch_shift_, huge_pages, numa_node)
+            , compact_storage_(storage_)
+            , transaction_log_(TRANSACTION_LOG_HISTORY)
+            , transaction_head_(0)
+            , transaction_tail_(capacity_)
+            , writer_(storage_, transaction_head_, transaction_tail_)
+            , compact_writer_(compact_storage_, transaction_head_, transaction_tail_)
+            , escaped_count_(0)
+            , decommit_entries_(static_cast<size_t>(static_cast<double>(capacity_) * std::clamp(decommit_fill, 0.0, 1.0)))
+            , decommit_cycles_(decommit_cycles)
+            , low_cycle_count_(0)
+            , decommit_cursor_(0)
+            , decommit_count_(0)
         {
-            data_.fill(0);
         }
 
+        // The number of entries that can be held by uncommitted and unretired transactions.
         [[nodiscard]]
         size_t capacity() const {
-            return data_.size();
+            return capacity_;
         }
 
+        // The mapping behind the ledger, of which only the pages in use are committed.
         [[nodiscard]]
-        SequenceRange select(int age = 0) const {
-            const Sequence prev_slot = next_slot_ - 1;
-
-            return {
-                .head = data_[prev_slot - age - 1],
-                .tail = data_[prev_slot - age - 0],
-            };
+        std::span<const std::byte> memory() const {
+            return storage_.memory();
         }
 
-        // NOTE: The `head` of the new range is implicitly the `tail` of the
-        //       previously inserted `SequenceRange`.
-        void insert(const Sequence tail) {
-            data_[next_slot_++] = tail;
+        // The number of times unused pages were given back.
+        [[nodiscard]]
+        size_t decommit_count() const {
+            return decommit_count_;
         }
 
-    private:
-        Sequence       next_slot_;
-        Ring<Sequence> data_;
-    };
+        [[nodiscard]]
+        LedgerEncoding encoding() const {
+            return compact_ ? LedgerEncoding::COMPACT : LedgerEncoding::FULL;
+        }
 
-    class OperationLedger {
-    public:
-        explicit OperationLedger(size_t ledger_capacity)
-            : storage_(ledger_capacity)
-            , transaction_log_(TRANSACTION_LOG_HISTORY)
-            , transaction_head_(0)
-            , transaction_tail_(storage_.size())
-            , writer_(storage_, transaction_head_, transaction_tail_)
-        {
+        // The number of operations that were too far from the others to be compacted.
+        [[nodiscard]]
+        size_t escaped_count() const {
+            return escaped_count_;
         }
 
         [[nodiscard]]
@@ -1064,19 +1527,36 @@ namespace mantle {
 
         [[nodiscard]]
         bool is_empty() const {
-            return (transaction_tail_ - writer_.tell()) == storage_.size();
+            return (transaction_tail_ - tell()) == capacity_;
         }
 
         void begin_transaction() {
-            transaction_head_ = writer_.tell();
-            transaction_tail_ = transaction_log_.select(-1).tail + storage_.size();
+            const Sequence retired = transaction_log_.select(-1).tail;
 
-            writer_.reset(transaction_head_, transaction_tail_);
+            transaction_head_ = tell();
+            transaction_tail_ = retired + capacity_;
+
+            if (compact_) {
+                compact_writer_.reset(transaction_head_, transaction_tail_);
+            }
+            else {
+                writer_.reset(transaction_head_, transaction_tail_);
+            }
+
+            if (decommit_cycles_ > 0) {
+                maybe_decommit(retired);
+            }
         }
 
         SequenceRange commit_transaction() {
-            writer_.flush();
-            transaction_log_.insert(writer_.tell());
+            if (compact_) {
+                compact_writer_.flush();
+            }
+            else {
+                writer_.flush();
+            }
+
+            transaction_log_.insert(tell());
             return transaction_log_.select(0);
         }
 
@@ -1086,10 +1566,12 @@ namespace mantle {
         //
         [[nodiscard]]
         const OperationBatch& read_batch(const Sequence sequence) const {
+            assert(!compact_);
             return storage_[sequence >> OperationBatch::SHIFT];
         }
 
-        // Returns a reference to the operation corresponding to this sequence.
+        // Returns a reference to the operation corresponding to this sequence. Compact ledgers can
+        // only be read in order, with `for_each_operation`.
         //
         // NOTE: Reading an operation that hasn't been published in a transaction is undefined behavior.
         //
@@ -1098,1106 +1580,9176 @@ namespace mantle {
             return read_batch(sequence).operations[sequence & OperationBatch::MASK];
         }
 
+        // Visit every operation in a committed range, including the null ones that pad it.
+        template<typename Visitor>
+        MANTLE_HOT void for_each_operation(const SequenceRange range, Visitor&& visitor) const {
+            if (LIKELY(!compact_)) {
+                for (Sequence sequence = range.head; sequence != range.tail; ++sequence) {
+                    visitor(read(sequence));
+                }
+                return;
+            }
+
+            // Whole lines are decoded at a time, and escapes never leave the range they were written in.
+            Sequence sequence = range.head;
+            while (sequence != range.tail) {
+                const CompactOperationBatch& batch = storage_.compact_batch(sequence >> CompactOperationBatch::SHIFT);
+                const size_t first = sequence & CompactOperationBatch::MASK;
+                const size_t last = std::min<size_t>(CompactOperationBatch::SIZE, first + (range.tail - sequence));
+
+                size_t index = first;
+                while (index < last) {
+                    const CompactOperation entry = batch.operations[index];
+                    if (UNLIKELY(entry.is_escape())) {
+                        const Sequence escaped = sequence + (index - first);
+                        visitor(CompactOperationCodec::unescape(read_compact(escaped + 1), read_compact(escaped + 2)));
+                        index += CompactOperation::ESCAPED_SIZE;
+                        continue;
+                    }
+
+                    visitor(codec_.decode(entry));
+                    index += 1;
+                }
+
+                // An escape can run into the next line.
+                sequence += index - first;
+            }
+        }
+
         // Adds an operation to the current, uncommitted transaction.
         // This can fail and return false if the ledger is full.
         MANTLE_HOT bool write(const Operation operation) {
-            return writer_.write(operation);
+            if (LIKELY(!compact_)) {
+                return writer_.write(operation);
+            }
+
+            return write_compact(operation);
+        }
+
+        // Adds as many of the operations as fit to the current transaction, and returns how many that was.
+        MANTLE_HOT size_t write(const std::span<const Operation> operations) {
+            if (LIKELY(!compact_)) {
+                return writer_.write(operations);
+            }
+
+            size_t count = 0;
+            while ((count < operations.size()) && write_compact(operations[count])) {
+                count += 1;
+            }
+
+            return count;
         }
 
         // Return the number of entries that can still be written to the current transaction.
         [[nodiscard]]
         size_t writable_transaction_entries() const {
-            const Sequence ceiling = transaction_log_.select(-1).tail + storage_.size();
-            return ceiling - writer_.tell();
+            const Sequence ceiling = transaction_log_.select(-1).tail + capacity_;
+            return ceiling - tell();
+        }
+
+    private:
+        Sequence tell() const {
+            return compact_ ? compact_writer_.tell() : writer_.tell();
+        }
+
+        [[nodiscard]]
+        CompactOperation read_compact(const Sequence sequence) const {
+            return storage_.compact_batch(sequence >> CompactOperationBatch::SHIFT).operations[sequence & CompactOperationBatch::MASK];
+        }
+
+        MANTLE_HOT bool write_compact(const Operation operation) {
+            CompactOperation entry;
+            if (LIKELY(codec_.encode(operation, entry))) {
+                return compact_writer_.write(entry);
+            }
+
+            // Escapes are written whole, or not at all.
+            if (compact_writer_.available() < CompactOperation::ESCAPED_SIZE) {
+                return false;
+            }
+
+            // Entry by entry, as the batched write streams whole batches out of its input.
+            for (const CompactOperation& escaped: CompactOperationCodec::escape(operation)) {
+                compact_writer_.write(escaped);
+            }
+            escaped_count_ += 1;
+            return true;
+        }
+
+        // Everything before `retired` has been retired, and everything from the writer on is unwritten.
+        // Only pages that were written since they were last decommitted are worth giving back.
+        void maybe_decommit(const Sequence retired) {
+            const Sequence head = tell();
+            if ((head - retired) >= decommit_entries_) {
+                low_cycle_count_ = 0;
+                return;
+            }
+
+            if (++low_cycle_count_ < decommit_cycles_) {
+                return;
+            }
+
+            // The ring has wrapped around since it was last decommitted if this is more than its size.
+            const Sequence first = std::max(decommit_cursor_, head - std::min(head, static_cast<Sequence>(capacity_)));
+            if ((retired - std::min(retired, first)) >= (MINIMUM_DECOMMIT_BATCHES << batch_shift_)) {
+                storage_.decommit(first >> batch_shift_, retired >> batch_shift_);
+                decommit_cursor_ = retired;
+                decommit_count_ += 1;
+            }
+
+            low_cycle_count_ = 0;
         }
 
     private:
         static constexpr size_t TRANSACTION_LOG_HISTORY = 4;
 
-        using Storage = Ring<OperationBatch>;
+        // Don't bother giving back less than a page's worth of entries.
+        static constexpr size_t MINIMUM_DECOMMIT_BATCHES = PAGE_SIZE / sizeof(OperationBatch);
+
+        using Storage = LedgerStorage;
         using Writer = OperationWriter<Storage>;
+        using CompactWriter = OperationWriter<CompactLedgerStorage, CompactOperationBatch>;
 
+        bool                  compact_;
+        size_t                batch_shift_;
+        size_t                capacity_;
         Storage               storage_;
+        CompactLedgerStorage  compact_storage_;
         SequenceRangeHistory  transaction_log_;
         Sequence              transaction_head_;
         Sequence              transaction_tail_;
-        Writer                writer_;
+        Writer                writer_;         // Only without a compact encoding.
+        CompactWriter         compact_writer_; // Only with one.
+        CompactOperationCodec codec_;
+        size_t                escaped_count_;
+
+        // Private to `maybe_decommit`.
+        size_t                decommit_entries_;
+        size_t                decommit_cycles_;
+        size_t                low_cycle_count_;
+        Sequence              decommit_cursor_;
+        size_t                decommit_count_;
     };
 
 }
 
 
-// include/mantle/object_grouper.h
+// include/mantle/page_fault_handler.h
 
 
-namespace mantle {
 
-    struct ObjectGrouperMetrics {
-        size_t      object_count = 0;
-        ObjectGroup group_min = std::numeric_limits<ObjectGroup>::max();
-        ObjectGroup group_max = std::numeric_limits<ObjectGroup>::min();
-    };
+namespace mantle {
 
-    // This class groups objects for more efficient finalization.
-    class ObjectGrouper {
+    class PageFaultHandler {
     public:
-        using Metrics = ObjectGrouperMetrics;
+        enum class Mode {
+            MISSING,
+            WRITE_PROTECT,
+        };
 
-        ObjectGrouper()
-            : group_min_(std::numeric_limits<ObjectGroup>::max())
-            , group_max_(std::numeric_limits<ObjectGroup>::min())
+        PageFaultHandler()
+            : uffd_(-1)
+            , has_feature_thread_id_(false)
+            , has_feature_exact_address_(false)
         {
-            for (size_t& bucket: group_buckets_) {
-                bucket = 0;
+            uffd_ = static_cast<int>(syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY));
+            if (uffd_ < 0) {
+                throw std::runtime_error("Failed to create userfaultfd");
             }
-        }
 
-        [[nodiscard]]
-        const Metrics& metrics() const {
-            return metrics_;
+            // API handshake and feature detection must happen before we use the file descriptor.
+            {
+                constexpr uint64_t required_features = 0;
+                constexpr uint64_t optional_features = UFFD_FEATURE_THREAD_ID|UFFD_FEATURE_EXACT_ADDRESS;
+
+                struct uffdio_api uffdio_api;
+                memset(&uffdio_api, 0, sizeof(uffdio_api));
+                uffdio_api.api = UFFD_API;
+                uffdio_api.features = required_features|optional_features;
+                uffdio_api.ioctls = _UFFDIO_API | _UFFDIO_REGISTER | _UFFDIO_UNREGISTER;
+
+                if (ioctl(uffd_, UFFDIO_API, &uffdio_api) < 0) {
+                    throw std::runtime_error("FaultHandler API handshake failed");
+                }
+                if ((uffdio_api.features & required_features) != required_features) {
+                    throw std::runtime_error("FaultHandler API missing required features");
+                }
+
+                has_feature_thread_id_ = static_cast<bool>(uffdio_api.features & UFFD_FEATURE_THREAD_ID);
+                has_feature_exact_address_ = static_cast<bool>(uffdio_api.features & UFFD_FEATURE_EXACT_ADDRESS);
+
+                assert(uffdio_api.ioctls & (1ull << _UFFDIO_API));
+                assert(uffdio_api.ioctls & (1ull << _UFFDIO_REGISTER));
+                assert(uffdio_api.ioctls & (1ull << _UFFDIO_UNREGISTER));
+            }
         }
 
-        void write(Object& object) {
-            const ObjectGroup group = object.group();
+        ~PageFaultHandler() {
+            const int result = close(uffd_);
+            assert(result >= 0);
+        }
 
-            group_buckets_[group] += 1;
-            group_min_ = std::min(group, group_min_);
-            group_max_ = std::max(group, group_max_);
+        PageFaultHandler(PageFaultHandler&&) = delete;
+        PageFaultHandler(const PageFaultHandler&) = delete;
+        PageFaultHandler& operator=(PageFaultHandler&&) = delete;
+        PageFaultHandler& operator=(const PageFaultHandler&) = delete;
 
-            input_.push_back(&object);
+        int file_descriptor() const {
+            return uffd_;
         }
 
-        [[nodiscard]]
-        ObjectGroups flush() {
-            ObjectGroups groups = {};
+        // TODO: Iterate on this API. It's a little rough right now.
+        template<typename Handler>
+        bool poll(Handler&& handler) {
+            struct uffd_msg msg = {};
 
-            metrics_.object_count += input_.size();
-            metrics_.group_min = std::min(group_min_, metrics_.group_min);
-            metrics_.group_max = std::max(group_max_, metrics_.group_max);
+            ssize_t bytes_read;
+            do {
+                bytes_read = read(uffd_, &msg, sizeof(msg));
+            } while ((bytes_read < 0) && (errno == EINTR));
 
-            if constexpr (ENABLE_OBJECT_GROUPING) {
-                // Reset working memory.
-                output_.resize(input_.size());
-                for (size_t& offset: group_offsets_) {
-                    offset = 0;
-                }
-                for (uint64_t& chunk: group_mask_) {
-                    chunk = 0;
+            if (bytes_read < 0) {
+                switch (errno) {
+                    case EAGAIN:
+                        return false;
+                    default:
+                        throw std::runtime_error("Failed to read userfaultfd");
                 }
+            }
 
-                // Calculate group offsets and initialize the group mask.
-                {
-                    size_t offset = 0;
-                    for (ObjectGroup group = group_min_; group <= group_max_; ++group) {
-                        const size_t group_size = group_buckets_[group];
-                        const uint64_t group_populated = !!group_size;
+            if (static_cast<size_t>(bytes_read) < sizeof(msg)) {
+                throw std::runtime_error("Failed to read userfaultfd (short read)");
+            }
 
-                        group_offsets_[group] = offset;
-                        group_mask_[group / 64] |= (group_populated << (group % 64));
+            switch (msg.event) {
+                case UFFD_EVENT_PAGEFAULT: {
+                    std::span memory = {
+                        reinterpret_cast<std::byte*>(msg.arg.pagefault.address & ~(PAGE_SIZE - 1)),
+                        PAGE_SIZE
+                    };
 
-                        offset += group_size;
+                    if ((msg.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WRITE) == UFFD_PAGEFAULT_FLAG_WRITE) {
+                        handler(memory, Mode::WRITE_PROTECT);
                     }
-
-                    // The cumulative offset is stored at the end (not the back).
-                    assert(offset == input_.size());
-                    group_offsets_[static_cast<size_t>(group_max_) + 1] = offset;
+                    else {
+                        handler(memory, Mode::MISSING);
+                    }
+                    break;
                 }
+                default: {
+                    // Ignore other events for now. Eventually we'll want to handle virtual memory changes
+                    // to allow segments to cope with segments being resized.
+                    break;
+                }
+            }
 
-                // Group objects in O(n) using radix sort.
-                for (Object* object: input_) {
-                    const ObjectGroup group = object->group();
+            return true;
+        }
 
-                    const size_t offset = group_offsets_[group];
-                    size_t& bucket = group_buckets_[group];
-                    assert(bucket);
+        void register_memory(std::span<const std::byte> memory, const std::initializer_list<Mode> modes) {
+            struct uffdio_register uffdio_register = {};
+            uffdio_register.mode = translate(modes);
+            uffdio_register.range = {
+                .start = reinterpret_cast<uintptr_t>(memory.data()),
+                .len = memory.size_bytes(),
+            };
 
-                    bucket -= 1;
-                    output_[offset + bucket] = object;
-                }
+            assert((uffdio_register.range.start % PAGE_SIZE) == 0);
 
-                groups = ObjectGroups {
-                    .objects       = output_.data(),
-                    .object_count  = output_.size(),
-                    .group_min     = group_min_,
-                    .group_max     = group_max_,
-                    .group_offsets = group_offsets_.data(),
-                    .group_mask    = &group_mask_,
-                };
+            if (ioctl(uffd_, UFFDIO_REGISTER, &uffdio_register) < 0) {
+                throw std::runtime_error("Failed to register memory region");
+            }
+        }
 
-#ifdef MANTLE_AUDIT
-                // Sanity check group membership.
-                for (ObjectGroup group = group_min_; group <= group_max_; ++group) {
-                    const std::span<Object*> group_members = groups.group_members(group);
-                    assert(group_members.size() <= groups.object_count);
+        void unregister_memory(std::span<const std::byte> memory, const std::initializer_list<Mode> modes) {
+            struct uffdio_register uffdio_register = {};
+            uffdio_register.mode = translate(modes);
+            uffdio_register.range = {
+                .start = reinterpret_cast<uintptr_t>(memory.data()),
+                .len = memory.size_bytes(),
+            };
 
-                    for (const Object* object: group_members) {
-                        assert(object->group() == group);
-                        assert(object->is_managed());
-                    }
-                }
-#endif
-            }
-            else {
-                output_ = input_;
+            assert((uffdio_register.range.start % PAGE_SIZE) == 0);
 
-                groups = ObjectGroups {
-                    .objects       = output_.data(),
-                    .object_count  = output_.size(),
-                    .group_min     = group_min_,
-                    .group_max     = group_max_,
-                    .group_offsets = nullptr,
-                    .group_mask    = nullptr,
-                };
+            if (ioctl(uffd_, UFFDIO_UNREGISTER, &uffdio_register) < 0) {
+                throw std::runtime_error("Failed to unregister memory region");
             }
+        }
 
-            input_.clear();
-            group_min_ = std::numeric_limits<ObjectGroup>::max();
-            group_max_ = std::numeric_limits<ObjectGroup>::min();
-            for (size_t& bucket: group_buckets_) {
-                bucket = 0;
+        void write_protect_memory(std::span<const std::byte> memory) {
+            struct uffdio_writeprotect uffdio_writeprotect = {
+                .range = {
+                    .start = reinterpret_cast<uintptr_t>(memory.data()),
+                    .len = memory.size_bytes(),
+                },
+                .mode = UFFDIO_WRITEPROTECT_MODE_WP,
+            };
+
+            assert((uffdio_writeprotect.range.start % PAGE_SIZE) == 0);
+
+            if (ioctl(uffd_, UFFDIO_WRITEPROTECT, &uffdio_writeprotect) < 0) {
+                throw std::runtime_error("Failed to write protect memory region");
             }
+        }
 
-            return groups;
+        void write_unprotect_memory(std::span<const std::byte> memory) {
+            struct uffdio_writeprotect uffdio_writeprotect = {
+                .range = {
+                    .start = reinterpret_cast<uintptr_t>(memory.data()),
+                    .len = memory.size_bytes(),
+                },
+                .mode = 0,
+            };
+
+            assert((uffdio_writeprotect.range.start % PAGE_SIZE) == 0);
+
+            if (ioctl(uffd_, UFFDIO_WRITEPROTECT, &uffdio_writeprotect) < 0) {
+                throw std::runtime_error("Failed to write unprotect memory region");
+            }
         }
 
     private:
-        using GroupBucketArray = std::array<size_t, std::numeric_limits<ObjectGroup>::max() + 0>;
-        using GroupOffsetArray = std::array<size_t, std::numeric_limits<ObjectGroup>::max() + 1>;
+        static uint64_t translate(const Mode mode) {
+            switch (mode) {
+                case Mode::MISSING: {
+                    return UFFDIO_REGISTER_MODE_MISSING;
+                }
+                case Mode::WRITE_PROTECT: {
+                    return UFFDIO_REGISTER_MODE_WP;
+                }
+            }
 
-        std::vector<Object*> input_;
-        ObjectGroup          group_min_;
-        ObjectGroup          group_max_;
-        GroupBucketArray     group_buckets_;
+            __builtin_unreachable();
+        }
+
+        static uint64_t translate(const std::initializer_list<Mode> modes) {
+            uint64_t mask = 0;
+
+            for (const Mode mode : modes) {
+                mask |= translate(mode);
+            }
 
-        std::vector<Object*> output_;
-        GroupOffsetArray     group_offsets_;
-        ObjectGroupMask      group_mask_;
+            return mask;
+        }
 
-        Metrics              metrics_;
+    private:
+        int  uffd_;
+        bool has_feature_thread_id_;
+        bool has_feature_exact_address_;
     };
 
 }
 
 
-// include/mantle/connection.h
+// include/mantle/doorbell.h
 
 
 namespace mantle {
 
-    class Stream {
-        Stream(Stream&&) = delete;
-        Stream(const Stream&) = delete;
-        Stream& operator=(Stream&&) = delete;
-        Stream& operator=(const Stream&) = delete;
+    class Doorbell {
+        Doorbell(Doorbell&&) = delete;
+        Doorbell(const Doorbell&) = delete;
+        Doorbell& operator=(Doorbell&&) = delete;
+        Doorbell& operator=(const Doorbell&) = delete;
 
     public:
-        Stream(size_t minimum_capacity = STREAM_CAPACITY)
-            : mask_()
-            , head_(0)
-            , tail_(0)
-            , private_head_(0)
-            , private_tail_(0)
-        {
-            size_t capacity = 1;
-            while (capacity < minimum_capacity) {
-                capacity *= 2;
-            }
+        Doorbell();
+        ~Doorbell();
 
-            mask_ = capacity - 1;
-            ring_.resize(capacity);
-        }
+        // Returns file descriptor that will indicate when the doorbell is ringing.
+        int file_descriptor();
 
-        size_t capacity() const {
-            return ring_.size();
-        }
+        // Ring the doorbell a number of times.
+        void ring(uint64_t count = 1);
 
-        bool send(const Message& message) {
-            uint64_t head = head_.load(std::memory_order_acquire);
-            if ((private_tail_ - head) == ring_.size()) {
-                return false; // Stream is full.
-            }
+        // Return the number of times the doorbell has been rung since last polled.
+        uint64_t poll(bool non_blocking);
 
-            Slot& slot = ring_[private_tail_ & mask_];
-            slot.message = message;
+    private:
+        int file_descriptor_;
+    };
 
-            private_tail_ += 1;
-            tail_.store(private_tail_, std::memory_order_release);
-            return true;
-        }
+    // Block while `word` still holds `expected`. This can return spuriously, so check again after.
+    void futex_wait(std::atomic_uint32_t& word, uint32_t expected);
 
-        size_t receive(std::vector<Message>& messages) {
-            Sequence tail = tail_.load(std::memory_order_acquire);
-            size_t count = tail - private_head_;
-            assert(count <= ring_.size());
+    // Wake up a thread blocked in `futex_wait` on this word, if there is one.
+    void futex_wake(std::atomic_uint32_t& word);
 
-            for (size_t i = 0; i < count; ++i) {
-                messages.push_back(
-                    ring_[(private_head_ + i) & mask_].message
-                );
-            }
+}
 
-            private_head_ += count;
-            head_.store(private_head_, std::memory_order_release);
-            return count;
-        }
 
-    private:
-        struct alignas(CACHE_LINE_SIZE) Slot {
-            Message message;
-        };
+// include/mantle/message.h
 
-        std::vector<Slot> ring_;
-        size_t            mask_;
 
-        alignas(CACHE_LINE_SIZE) AtomicSequence head_;
-        alignas(CACHE_LINE_SIZE) AtomicSequence tail_;
+#define MANTLE_MESSAGE_TYPES(X) \
+    X(START)                    \
+    X(ENTER)                    \
+    X(SUBMIT)                   \
+    X(RETIRE)                   \
+    X(LEAVE)                    \
 
-        alignas(CACHE_LINE_SIZE) Sequence private_head_; // Private to receive.
-        alignas(CACHE_LINE_SIZE) Sequence private_tail_; // Private to send.
-    };
+namespace mantle {
 
-    class Endpoint {
-        Endpoint(Endpoint&&) = delete;
-        Endpoint(const Endpoint&) = delete;
-        Endpoint& operator=(Endpoint&&) = delete;
-        Endpoint& operator=(const Endpoint&) = delete;
+    class OperationPartition;
+    struct OperationSpill;
+    class WriteBarrier;
+    struct HeapCensusDelta;
 
-    public:
-        explicit Endpoint(Endpoint& remote_endpoint)
-            : remote_endpoint_(remote_endpoint)
-        {
-            temp_messages_.reserve(stream_.capacity());
-        }
+    enum class MessageType {
+#define X(MANTLE_MESSAGE_TYPE) \
+        MANTLE_MESSAGE_TYPE,   \
 
-        int file_descriptor() {
-            return doorbell_.file_descriptor();
-        }
+        MANTLE_MESSAGE_TYPES(X)
+#undef X
+    };
 
-        Stream& stream() {
-            return stream_;
-        }
+    union Message {
+        MessageType type;
 
-        bool send_message(const Message& message) {
-            if (!remote_endpoint_.stream_.send(message)) {
-                return false;
-            }
+        // region -> domain
+        struct Start {
+            MessageType type;
+            bool        urgent; // The region's ledger is filling up, don't hold the cycle back.
+        } start;
 
-            remote_endpoint_.doorbell_.ring();
-            return true;
-        }
+        // domain -> region
+        struct Enter {
+            MessageType type;
+            Sequence    cycle;
+        } enter;
 
-        std::span<const Message> receive_messages(bool non_blocking) {
-            doorbell_.poll(non_blocking);
+        // region -> domain
+        struct Submit {
+            MessageType   type;
+            bool          stop; // The region is ready to stop.
+            SequenceRange increments;
+            SequenceRange decrements;
 
-            temp_messages_.clear();
-            size_t count = stream_.receive(temp_messages_);
-            assert(count == temp_messages_.size());
+            // Set when the region partitioned the submitted operations by owning region.
+            const OperationPartition* increment_partition;
+            const OperationPartition* decrement_partition;
 
-            return {
-                temp_messages_.data(),
-                temp_messages_.size(),
-            };
-        }
+            // Set when operations overflowed the ledger. These are routed in addition to the ranges.
+            const OperationSpill* increment_spill;
+            const OperationSpill* decrement_spill;
 
-    private:
-        Endpoint&            remote_endpoint_;
-        Doorbell             doorbell_;
-        Stream               stream_;
-        std::vector<Message> temp_messages_;
-    };
+            // Set when the region records `Ref` operations. These are also routed in addition to the ranges.
+            const WriteBarrier* barrier;
 
-    // A pair of endpoints linked with bidirectional message streams.
-    class Connection {
-    public:
-        Connection()
-            : client_endpoint_(server_endpoint_)
-            , server_endpoint_(client_endpoint_)
-        {
-        }
+            size_t finalized_count; // The number of objects the region has finalized so far.
+            size_t bound_count;     // The number of objects the region has bound so far.
+            size_t released_count;  // The number of those that died on the region, with `Config::local_operations`.
 
-        Endpoint& client_endpoint() {
-            return client_endpoint_;
-        }
+            // Set with `Config::heap_census_interval`, holding what was bound and released since the last submission.
+            const HeapCensusDelta* heap_census;
+        } submit;
 
-        Endpoint& server_endpoint() {
-            return server_endpoint_;
-        }
+        // domain -> region
+        struct Retire {
+            MessageType  type;
+            ObjectGroups garbage;
+        } retire;
 
-    private:
-        Endpoint client_endpoint_;
-        Endpoint server_endpoint_;
+        // domain -> region
+        struct Leave {
+            MessageType type;
+            bool        stop; // The domain is ready to stop.
+        } leave;
     };
 
-}
+    constexpr Message make_start_message(bool urgent = false) {
+        return {
+            .start = {
+                .type   = MessageType::START,
+                .urgent = urgent,
+            }
+        };
+    }
 
+    constexpr Message make_enter_message(Sequence cycle) {
+        return {
+            .enter = {
+                .type  = MessageType::ENTER,
+                .cycle = cycle,
+            }
+        };
+    }
 
-// include/mantle/region_controller.h
+    constexpr Message make_leave_message(bool stop) {
+        return {
+            .leave = {
+                .type = MessageType::LEAVE,
+                .stop = stop,
+            }
+        };
+    }
 
+    constexpr std::string_view to_string(MessageType type) {
+        using namespace std::literals;
 
-#define MANTLE_REGION_CONTROLLER_ACTIONS(X) \
-    X(SEND)                                 \
-    X(RECEIVE)                              \
-    X(BARRIER_ANY)                          \
-    X(BARRIER_ALL)                          \
+        switch (type) {
+#define X(MANTLE_MESSAGE_TYPE)                     \
+            case MessageType::MANTLE_MESSAGE_TYPE: \
+                return #MANTLE_MESSAGE_TYPE ##sv;  \
 
-#define MANTLE_REGION_CONTROLLER_PHASES(X)  \
-    X(START,          RECEIVE)              \
-    X(START_BARRIER,  BARRIER_ANY)          \
-    X(ENTER,          SEND)                 \
-    X(SUBMIT,         RECEIVE)              \
-    X(SUBMIT_BARRIER, BARRIER_ALL)          \
-    X(RETIRE_BARRIER, BARRIER_ALL)          \
-    X(RETIRE,         SEND)                 \
-    X(LEAVE,          SEND)                 \
+            MANTLE_MESSAGE_TYPES(X)
+#undef X
+        }
 
-#define MANTLE_REGION_CONTROLLER_STATES(X) \
-    X(STARTING)                            \
-    X(RUNNING)                             \
-    X(STOPPING)                            \
-    X(STOPPED)                             \
-    X(SHUTDOWN)                            \
+        abort();
+    }
 
-namespace mantle {
+}
 
-    class Region;
-    class RegionController;
 
-    using RegionControllerGroup = std::vector<std::unique_ptr<RegionController>>;
+// include/mantle/object_cache.h
 
-    // What we are doing in this part of the cycle.
-    enum class RegionControllerAction {
-#define X(MANTLE_REGION_CONTROLLER_ACTION)                                 \
-        MANTLE_REGION_CONTROLLER_ACTION,                                   \
 
-        MANTLE_REGION_CONTROLLER_ACTIONS(X)
-#undef X
-    };
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#elif defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
 
-    // Which part of the cycle we are in.
-    enum class RegionControllerPhase {
-#define X(MANTLE_REGION_CONTROLLER_PHASE, MANTLE_REGION_CONTROLLER_ACTION) \
-        MANTLE_REGION_CONTROLLER_PHASE,                                    \
+namespace mantle {
 
-        MANTLE_REGION_CONTROLLER_PHASES(X)
-#undef X
-    };
+    // A set-associative cache keyed by object address. Each set tracks which of its ways
+    // are live, and lookups compare every key in a set at once when SIMD is available.
+    // The number of sets is chosen at construction, so owners can size it to their workload.
+    //
+    template<typename T, size_t CACHE_WAYS>
+    class ObjectCache {
+    public:
+        static_assert(is_power_of_2(CACHE_WAYS));
+        static_assert(CACHE_WAYS <= 32, "Way masks are 32 bits wide");
 
-    // High level state related to starting and stopping.
-    enum class RegionControllerState {
-#define X(MANTLE_REGION_CONTROLLER_STATE) \
-        MANTLE_REGION_CONTROLLER_STATE,   \
+        static constexpr uintptr_t SET_SHIFT = log2_floor(alignof(Object));
 
-        MANTLE_REGION_CONTROLLER_STATES(X)
-#undef X
-    };
+        // A bitset of ways within a set.
+        using WayMask = uint32_t;
 
-    constexpr size_t REGION_CONTROLLER_ACTION_COUNT = 0
-#define X(MANTLE_REGION_CONTROLLER_ACTION)                                 \
-        + 1                                                                \
+        static constexpr WayMask ALL_WAYS = static_cast<WayMask>((1ull << CACHE_WAYS) - 1);
 
-        MANTLE_REGION_CONTROLLER_ACTIONS(X)
-#undef X
-    ;
+    public:
+        struct Entry {
+            Object* key;
+            T       val;
 
-    constexpr size_t REGION_CONTROLLER_PHASE_COUNT = 0
-#define X(MANTLE_REGION_CONTROLLER_PHASE, MANTLE_REGION_CONTROLLER_ACTION) \
-        + 1                                                                \
+            auto operator<=>(const Entry&) const noexcept = default;
+        };
 
-        MANTLE_REGION_CONTROLLER_PHASES(X)
-#undef X
-    ;
+        class Cursor {
+        public:
+            explicit Cursor(const size_t pos = 0)
+                : pos_(pos)
+            {
+            }
 
-    constexpr size_t REGION_CONTROLLER_STATE_COUNT = 0
-#define X(MANTLE_REGION_CONTROLLER_STATE) \
-        + 1                               \
+            Cursor(const size_t set, const size_t way)
+                : Cursor((set * CACHE_WAYS) + way)
+            {
+                assert(way < CACHE_WAYS);
+            }
 
-        MANTLE_REGION_CONTROLLER_STATES(X)
-#undef X
-    ;
+            auto operator<=>(const Cursor&) const noexcept = default;
 
-    // A survey of the states of controllers and the actions they are trying to take.
-    class RegionControllerCensus {
-    public:
-        using State = RegionControllerState;
-        using Phase = RegionControllerPhase;
-        using Cycle = Sequence;
-        using Action = RegionControllerAction;
+            [[nodiscard]]
+            size_t set() const {
+                return pos_ / CACHE_WAYS;
+            }
 
-        RegionControllerCensus();
-        explicit RegionControllerCensus(const RegionController& controller);
-        explicit RegionControllerCensus(const RegionControllerGroup& controllers);
+            [[nodiscard]]
+            size_t way() const {
+                return pos_ % CACHE_WAYS;
+            }
 
-        void add(const RegionController& controller);
-        void add(const RegionControllerGroup& controllers);
+            void advance() {
+                pos_ += 1;
+            }
 
-        size_t count() const;
+        private:
+            size_t pos_;
+        };
 
-        Cycle min_cycle() const;
-        Cycle max_cycle() const;
+    private:
+        // The keys of a set are loaded together, so they're aligned for the widest load that covers them.
+        struct alignas(std::min(CACHE_LINE_SIZE, CACHE_WAYS * sizeof(Object*))) KeySet {
+            Object* keys[CACHE_WAYS];
+        };
 
-        bool any(State state) const;
-        bool all(State state) const;
+    public:
+        // The size is the total number of entries, and is rounded up to whole sets.
+        explicit ObjectCache(const size_t size)
+            : keys_(std::bit_ceil(std::max(size, CACHE_WAYS)) / CACHE_WAYS)
+            , vals_(keys_.size())
+            , live_(keys_.size())
+            , set_mask_(keys_.size() - 1)
+        {
+            reset();
+        }
 
-        bool any(Phase phase) const;
-        bool all(Phase phase) const;
- 
-        bool any(Action action) const;
-        bool all(Action action) const;
+        [[nodiscard]]
+        size_t size() const {
+            return keys_.size() * CACHE_WAYS;
+        }
 
-        auto operator<=>(const RegionControllerCensus&) const noexcept = default;
+        [[nodiscard]]
+        size_t sets() const {
+            return keys_.size();
+        }
 
-    private:
-        size_t                                             count_;
-        Cycle                                              min_cycle_;
-        Cycle                                              max_cycle_;
-        std::array<size_t, REGION_CONTROLLER_STATE_COUNT>  state_counts_;
-        std::array<size_t, REGION_CONTROLLER_PHASE_COUNT>  phase_counts_;
-        std::array<size_t, REGION_CONTROLLER_ACTION_COUNT> action_counts_;
-    };
+        [[nodiscard]]
+        Cursor begin() const {
+            return Cursor(0);
+        }
 
-    struct RegionControllerMetrics {
-        const OperationGrouper::Metrics& operation_grouper;
-        const ObjectGrouper::Metrics& object_grouper;
-        size_t increment_count;
-        size_t decrement_count;
+        [[nodiscard]]
+        Cursor end() const {
+            return Cursor(size());
+        }
 
-        RegionControllerMetrics(
-            const OperationGrouper& operation_grouper,
-            const ObjectGrouper& object_grouper
-        )
-            : operation_grouper(operation_grouper.metrics())
-            , object_grouper(object_grouper.metrics())
-            , increment_count(0)
-            , decrement_count(0)
-        {
+        [[nodiscard]]
+        size_t to_set(Object* key) const {
+            uintptr_t ptr;
+            memcpy(&ptr, &key, sizeof(ptr));
+            return (ptr >> SET_SHIFT) & set_mask_;
         }
-    };
 
-    class RegionController {
-    public:
-        using State   = RegionControllerState;
-        using Phase   = RegionControllerPhase;
-        using Cycle   = Sequence;
-        using Action  = RegionControllerAction;
-        using Metrics = RegionControllerMetrics;
+        // Returns the ways in this set that currently hold an entry.
+        [[nodiscard]]
+        WayMask live_ways(const size_t set) const {
+            return live_[set];
+        }
 
-        RegionController(
-            RegionId region_id,
-            RegionControllerGroup& controllers,
-            const OperationLedger& ledger,
-            const Config& config
-        );
+        // Returns the live ways in this set whose key matches.
+        [[nodiscard]]
+        MANTLE_HOT WayMask matching_ways(const size_t set, Object* key) const {
+            uintptr_t needle;
+            memcpy(&needle, &key, sizeof(needle));
+
+            const Object* const* keys = keys_[set].keys;
+            WayMask mask = 0;
+
+#if defined(__AVX2__)
+            if constexpr ((CACHE_WAYS % 4) == 0) {
+                const __m256i needles = _mm256_set1_epi64x(static_cast<long long>(needle));
+                for (size_t way = 0; way < CACHE_WAYS; way += 4) {
+                    const __m256i haystack = _mm256_load_si256(reinterpret_cast<const __m256i*>(&keys[way]));
+                    const __m256i matches = _mm256_cmpeq_epi64(haystack, needles);
+                    mask |= static_cast<WayMask>(_mm256_movemask_pd(_mm256_castsi256_pd(matches))) << way;
+                }
 
-        RegionController(RegionController&&) = delete;
-        RegionController(const RegionController&) = delete;
-        RegionController& operator=(RegionController&&) = delete;
-        RegionController& operator=(const RegionController&) = delete;
+                return mask & live_[set];
+            }
+#endif
+#if defined(__SSE2__)
+            if constexpr ((CACHE_WAYS % 2) == 0) {
+                // SSE2 doesn't have a 64-bit compare. A key matches when both 32-bit halves do.
+                const __m128i needles = _mm_set1_epi64x(static_cast<long long>(needle));
+                for (size_t way = 0; way < CACHE_WAYS; way += 2) {
+                    const __m128i haystack = _mm_load_si128(reinterpret_cast<const __m128i*>(&keys[way]));
+                    const __m128i half_matches = _mm_cmpeq_epi32(haystack, needles);
+                    const __m128i matches = _mm_and_si128(half_matches, _mm_shuffle_epi32(half_matches, _MM_SHUFFLE(2, 3, 0, 1)));
+                    mask |= static_cast<WayMask>(_mm_movemask_pd(_mm_castsi128_pd(matches))) << way;
+                }
 
-        RegionId region_id() const;
-        const Metrics& metrics() const;
+                return mask & live_[set];
+            }
+#endif
+            for (size_t way = 0; way < CACHE_WAYS; ++way) {
+                mask |= static_cast<WayMask>(keys[way] == key) << way;
+            }
 
-        bool is_quiescent() const;
+            return mask & live_[set];
+        }
 
-        State state() const;
-        Phase phase() const;
-        Cycle cycle() const;
-        Action action() const;
+        std::pair<Cursor, Cursor> equal_range(Object* key) const {
+            size_t set = to_set(key);
 
-        void start(Cycle cycle);
-        void stop();
+            return {
+                Cursor(set, 0),
+                Cursor(set + 1, 0),
+            };
+        }
 
-        std::optional<Message> send_message();
-        void receive_message(const Message& message);
-        void synchronize(const RegionControllerCensus& census);
+        Entry load(Cursor cursor) {
+            size_t set = cursor.set();
+            size_t way = cursor.way();
 
-    private:
-        void transition(State next_state);
-        void transition(Phase next_phase);
-        void transition(Cycle next_cycle);
+            return {
+                .key = keys_[set].keys[way],
+                .val = vals_[set][way],
+            };
+        }
 
-        size_t route_operations(OperationType type, SequenceRange range);
+        void store(Cursor cursor, Entry entry) {
+            size_t set = cursor.set();
+            size_t way = cursor.way();
 
-    private:
-        RegionId               region_id_;
-        RegionControllerGroup& controllers_;
-        const OperationLedger& ledger_;
-        const Config&          config_;
+            keys_[set].keys[way] = entry.key;
+            vals_[set][way] = entry.val;
 
-        State                  state_;
-        Phase                  phase_;
-        Cycle                  cycle_;
+            if (entry.key) {
+                live_[set] |= (WayMask{1} << way);
+            }
+            else {
+                live_[set] &= ~(WayMask{1} << way);
+            }
+        }
 
-    SequenceRange          submitted_increments_;
-        SequenceRange          submitted_decrements_;
+        void reset(Cursor cursor) {
+            size_t set = cursor.set();
+            size_t way = cursor.way();
 
-        OperationGrouper       operation_grouper_;
-        ObjectGrouper          object_grouper_;
+            keys_[set].keys[way] = nullptr;
+            vals_[set][way] = T{};
+            live_[set] &= ~(WayMask{1} << way);
+        }
 
-        Metrics                metrics_;
-    };
+        void reset() {
+            for (WayMask& mask: live_) {
+                mask = 0;
+            }
 
-    // Synchronizes a group of region controllers.
-    RegionControllerCensus synchronize(RegionControllerGroup& controllers);
+            for (Cursor cursor = begin(); cursor != end(); cursor.advance()) {
+                reset(cursor);
+            }
+        }
 
-    std::string_view to_string(RegionControllerState state);
-    std::string_view to_string(RegionControllerPhase phase);
-    std::string_view to_string(RegionControllerAction action);
+    private:
+        std::vector<KeySet>                    keys_;
+        std::vector<std::array<T, CACHE_WAYS>> vals_;
+        std::vector<WayMask>                   live_;
+        uintptr_t                              set_mask_;
+    };
 
 }
 
 
-// include/mantle/region.h
-
-
-#define MANTLE_REGION_STATES(X) \
-    X(RUNNING)                  \
-    X(STOPPING)                 \
-    X(STOPPED)                  \
+// include/mantle/heap_census.h
 
-#define MANTLE_REGION_PHASES(X) \
-    X(RECV_ENTER)               \
-    X(RECV_ENTER_SENT_START)    \
-    X(RECV_RETIRE)              \
-    X(RECV_LEAVE)               \
 
 namespace mantle {
 
-    class Domain;
     class Object;
-    class ObjectFinalizer;
 
-    enum class RegionState {
-#define X(MANTLE_REGION_STATE) \
-        MANTLE_REGION_STATE,   \
+    // Objects are bucketed by how many references they hold: one, two or three, four to seven, and so
+    // on, with the last bucket holding everything above.
+    constexpr size_t HEAP_CENSUS_BUCKET_COUNT = 8;
 
-        MANTLE_REGION_STATES(X)
-#undef X
+    // What a census found for one object group.
+    struct ObjectGroupCensus {
+        ObjectGroup group = 0;
+
+        // Objects that have been bound and haven't died yet, whether or not they are still referenced.
+        size_t live_count = 0;
+
+        // Objects that had decrements applied in the sampled cycle, including those that died from them.
+        size_t pending_decrement_count = 0;
+
+        // Objects that died in the sampled cycle, and were handed over to be finalized.
+        size_t finalized_count = 0;
+
+        // The reference counts of objects that were updated in the sampled cycle and survived it.
+        std::array<size_t, HEAP_CENSUS_BUCKET_COUNT> reference_counts = {};
     };
 
-    enum class RegionPhase {
-#define X(MANTLE_REGION_PHASE) \
-        MANTLE_REGION_PHASE,   \
+    // The groups of objects a region bound, and of those that died on it with `Config::local_operations`,
+    // since its last submission. Regions hand these to their controller along with their operations.
+    struct HeapCensusDelta {
+        std::vector<ObjectGroup> bound_groups;
+        std::vector<ObjectGroup> released_groups;
 
-        MANTLE_REGION_PHASES(X)
-#undef X
+        void clear() {
+            bound_groups.clear();
+            released_groups.clear();
+        }
     };
 
-    class Region {
+    // Counts a controller's objects by group, with `Config::heap_census_interval`. Live objects are
+    // counted in every cycle from what the region bound and what died, which costs nothing per
+    // operation. Every `interval` cycles the controller also looks at the objects it applied operations
+    // to, and once the cycle's garbage is known the census is taken.
+    class HeapCensus {
     public:
-        using State = RegionState;
-        using Phase = RegionPhase;
-        using Cycle = Sequence;
+        explicit HeapCensus(size_t interval);
 
-        Region(Domain& domain, ObjectFinalizer& finalizer);
-        ~Region();
+        [[nodiscard]]
+        bool is_sampled(Sequence cycle) const {
+            return (cycle % interval_) == 0;
+        }
 
-        Region(Region&&) = delete;
-        Region(const Region&) = delete;
-        Region& operator=(Region&&) = delete;
-        Region& operator=(const Region&) = delete;
+        // What the region submitted in `cycle`.
+        void add(Sequence cycle, const HeapCensusDelta& delta);
 
-        RegionId id() const;
+        // Objects that operations were applied to in a sampled cycle. Survivors are counted by how many
+        // references they hold. The grouper can hand over an object more than once, but it only counts once.
+        void add_decremented(const Object& object);
+        void add_survivor(const Object& object, uint64_t reference_count);
 
-        State state() const;
-        Phase phase() const;
-        Cycle cycle() const;
+        // Objects that died in `cycle`, which takes the census if it is a sampled one.
+        void add_garbage(Sequence cycle, ObjectGroups garbage);
 
-        // Call step when this becomes readable.
-        int file_descriptor();
+        // The last finished sample, ordered by group, and the cycle it was taken in. It isn't updated
+        // while the domain is idle, so objects that died since then may still be counted as live.
+        [[nodiscard]]
+        std::span<const ObjectGroupCensus> sample() const;
 
-        void stop();
-        void step(bool non_blocking);
+        [[nodiscard]]
+        std::optional<Sequence> sample_cycle() const;
+
+        // Adds the groups of `census` to those of `total`, both ordered by group.
+        static void merge(std::vector<ObjectGroupCensus>& total, std::span<const ObjectGroupCensus> census);
 
     private:
-        template<typename T>
-        friend class Handle;
-        friend class Object;
-
-        MANTLE_HOT void start_increment_operation(Object& object, Operation operation);
-        MANTLE_HOT void start_decrement_operation(Object& object, Operation operation);
-
-        MANTLE_COLD void flush_operation(Operation operation);
-
-    private:
-        friend class Domain;
-
-        const OperationLedger& ledger() const;
-
-        Endpoint& domain_endpoint();
-        Endpoint& region_endpoint();
+        [[nodiscard]]
+        static size_t to_bucket(uint64_t reference_count);
 
-    private:
-        void handle_message(const Message& message);
+        [[nodiscard]]
+        ObjectGroupCensus& group(ObjectGroup group);
 
-        void transition(State next_state);
-        void transition(Phase next_phase);
-        void transition(Cycle next_cycle);
+        void release(ObjectGroup group, size_t count, bool sampled);
 
-        void finalize_garbage();
+        void take_sample(Sequence cycle);
 
     private:
-        static constexpr State INITIAL_STATE = State::RUNNING;
-        static constexpr Phase INITIAL_PHASE = Phase::RECV_ENTER;
-        static constexpr Cycle INITIAL_CYCLE = 0;
+        size_t                                             interval_;
+        std::unordered_map<ObjectGroup, ObjectGroupCensus> groups_;
+        std::unordered_set<const Object*>                  decremented_; // Seen in the sampled cycle so far.
+        std::unordered_set<const Object*>                  survivors_;
+        std::vector<ObjectGroupCensus>                     sample_;
+        std::optional<Sequence>                            sample_cycle_;
+    };
 
-        Domain&                     domain_;
-        RegionId                    id_;
+}
 
-        State                       state_;
-        Phase                       phase_;
-        Cycle                       cycle_;
-        size_t                      depth_;
 
-        ObjectFinalizer&            finalizer_;
-        OperationLedger             ledger_;
+// include/mantle/reference_count_table.h
 
-        std::optional<ObjectGroups> garbage_;
-        std::vector<Object*>        garbage_pile_;
 
-        Connection                  connection_;
+namespace mantle {
 
+    // Reference counts of the objects that a region owns, kept out of the objects themselves. Objects
+    // store the index of their slot instead, so applying operations only writes to this dense table
+    // and the cache lines of live objects stay with the threads that use them.
+    //
+    // Slots are handed out by the owning region's thread, and their counts are only touched by whoever
+    // applies the region's operations. Dead objects give their slots back in batches, which the region
+    // picks up once it runs out of its own.
+    //
+    class ReferenceCountTable {
     public:
-        static Region*& thread_local_instance() {
-            thread_local Region* instance = nullptr;
-            return instance;
+        using Slot  = uint32_t;
+        using Count = uint32_t;
+
+        // The table is only ever written by the domain, so it should live on the domain's NUMA node.
+        // The mapping is reserved up front, and pages are only populated as slots are first used.
+        explicit ReferenceCountTable(const size_t capacity, const std::optional<size_t> numa_node = std::nullopt)
+            : counts_(map_memory(capacity * sizeof(Count), HugePagePolicy::NONE, numa_node))
+            , capacity_(capacity)
+            , next_slot_(0)
+            , has_released_slots_(false)
+        {
         }
-    };
 
-    inline void Region::start_increment_operation(Object&, Operation operation) {
-        assert(state_ != State::STOPPED);
-        assert(operation.type() == OperationType::INCREMENT);
-
-        // Fast-path: The operation can be added to the current transaction.
-        if (LIKELY(ledger_.write(operation))) {
-            return;
+        ~ReferenceCountTable() {
+            unmap_memory(counts_, HugePagePolicy::NONE);
         }
 
-        flush_operation(operation);
-    }
-
-    inline void Region::start_decrement_operation(Object&, Operation operation) {
-        assert(state_ != State::STOPPED);
-        assert(operation.type() == OperationType::DECREMENT);
+        ReferenceCountTable(ReferenceCountTable&&) = delete;
+        ReferenceCountTable(const ReferenceCountTable&) = delete;
+        ReferenceCountTable& operator=(ReferenceCountTable&&) = delete;
+        ReferenceCountTable& operator=(const ReferenceCountTable&) = delete;
 
-        // Fast-path: The operation can be added to the current transaction.
-        if (LIKELY(ledger_.write(operation))) {
-            return;
+        [[nodiscard]]
+        size_t capacity() const {
+            return capacity_;
         }
 
-        flush_operation(operation);
-    }
+        [[nodiscard]]
+        Count count(const Slot slot) const {
+            assert(slot < capacity_);
+            return counts()[slot];
+        }
 
-    std::string_view to_string(RegionState state);
-    std::string_view to_string(RegionPhase phase);
+        // Only the owning region's thread may call this. Released slots are always zero.
+        [[nodiscard]]
+        Slot allocate() {
+            if (UNLIKELY(free_slots_.empty()) && has_released_slots_.load(std::memory_order_acquire)) {
+                std::scoped_lock lock(released_slots_mutex_);
+                std::swap(free_slots_, released_slots_);
+                has_released_slots_.store(false, std::memory_order_relaxed);
+            }
 
-}
+            if (LIKELY(!free_slots_.empty())) {
+                const Slot slot = free_slots_.back();
+                free_slots_.pop_back();
+                return slot;
+            }
 
+            if (UNLIKELY(next_slot_ == capacity_)) {
+                abort(); // Raise `Config::reference_count_table_capacity`.
+            }
 
-// include/mantle/selector.h
+            return static_cast<Slot>(next_slot_++);
+        }
 
+        // Give back the slots of objects that have died.
+        void release(const std::span<const Slot> slots) {
+            if (slots.empty()) {
+                return;
+            }
 
-namespace mantle {
+            std::scoped_lock lock(released_slots_mutex_);
+            released_slots_.insert(released_slots_.end(), slots.begin(), slots.end());
+            has_released_slots_.store(true, std::memory_order_release);
+        }
 
-    class Selector {
-        Selector(Selector&&);
-        Selector(const Selector&);
-        Selector& operator=(Selector&&);
-        Selector& operator=(const Selector&);
+        // These return `true` if the reference count remains positive, like `Object::apply_increment`
+        // and `Object::apply_decrement`. A slot that drops to zero can be released.
+        bool apply_increment(const Slot slot, const Count delta_magnitude) {
+            counts()[slot] += delta_magnitude;
+            return true;
+        }
 
-    public:
-        Selector();
-        ~Selector();        
+        bool apply_decrement(const Slot slot, const Count delta_magnitude) {
+            Count& count = counts()[slot];
+            if (count < delta_magnitude) {
+                count = 0;
+                return false;
+            }
 
-        // Returns an array of user-data corresponding to file descriptors that are ready-to-read.
-        std::span<void*> poll(bool non_blocking);
+            count -= delta_magnitude;
+            return true;
+        }
 
-        void add_watch(int file_descriptor, void* user_data);
-        void modify_watch(int file_descriptor, void* user_data);
-        void delete_watch(int file_descriptor);
+    private:
+        Count* counts() const {
+            return reinterpret_cast<Count*>(counts_.data());
+        }
 
     private:
-        static constexpr size_t MAX_EVENT_COUNT = 16;
+        std::span<std::byte> counts_;
+        size_t               capacity_;
 
-        int                                epoll_fd_;
-        std::array<void*, MAX_EVENT_COUNT> poll_results_;
-    };
+        // Private to the owning region.
+        size_t               next_slot_;
+        std::vector<Slot>    free_slots_;
 
-    void wait_for_readable(int file_descriptor);
+        // Shared with whoever applies the region's operations.
+        std::mutex           released_slots_mutex_;
+        std::vector<Slot>    released_slots_;
+        std::atomic_bool     has_released_slots_;
+    };
 
 }
 
 
-// include/mantle/domain.h
+// include/mantle/operation_partition.h
 
 
 namespace mantle {
 
-    class Region;
+    // The operations of a committed transaction, sorted by the region that owns their objects
+    // and by type. Regions build these while committing so that the domain can hand each
+    // controller its slice without dereferencing any objects during routing.
+    class OperationPartition {
+    public:
+        OperationPartition() = default;
 
-    class Domain {
-        friend class Region;
+        OperationPartition(OperationPartition&&) = delete;
+        OperationPartition(const OperationPartition&) = delete;
+        OperationPartition& operator=(OperationPartition&&) = delete;
+        OperationPartition& operator=(const OperationPartition&) = delete;
 
-    public:
-        explicit Domain(const Config& config = Config());
-        ~Domain();
+        [[nodiscard]]
+        size_t size() const {
+            return operations_.size();
+        }
 
-        Domain(Domain&&) = delete;
-        Domain(const Domain&) = delete;
-        Domain& operator=(Domain&&) = delete;
-        Domain& operator=(const Domain&) = delete;
+        // Operations on objects that aren't bound to any region. These can't be routed, and are left
+        // out of every slice.
+        [[nodiscard]]
+        size_t unowned_count() const {
+            return unowned_count_;
+        }
 
+        // One more than the largest region id with operations in this partition.
         [[nodiscard]]
-        const Config& config() const;
+        size_t region_count() const {
+            // The last region's keys may not all be present, so round up.
+            return offsets_.empty() ? 0 : ((offsets_.size() - 1 + OPERATION_TYPE_COUNT - 1) / OPERATION_TYPE_COUNT);
+        }
 
-    private:
-        void run();
+        [[nodiscard]]
+        std::span<const Operation> slice(const RegionId region_id, const OperationType type) const {
+            const size_t key = to_key(region_id, type);
+            if ((key + 1) >= offsets_.size()) {
+                return {};
+            }
 
-        void handle_event(void* user_data);
+            return {
+                operations_.data() + offsets_[key],
+                offsets_[key + 1] - offsets_[key],
+            };
+        }
 
-        void update_controllers(const RegionControllerCensus& census);
-        void start_controllers(const RegionControllerCensus& census, std::scoped_lock<std::mutex>&);
-        void stop_controllers(const RegionControllerCensus& census, std::scoped_lock<std::mutex>&);
+        // Rebuild the partition from a committed range of the ledger.
+        void assign(const OperationLedger& ledger, const SequenceRange range) {
+            clear();
 
-        RegionId bind(Region& region);
+            // Bucket operations by destination and type. We've probably just touched these objects,
+            // so reading their region here should be much cheaper than it would be on the domain.
+            size_t key_count = 0;
+            ledger.for_each_operation(range, [&](const Operation operation) {
+                const Object* object = operation.object();
+                if (!object) {
+                    return; // Padding.
+                }
 
-    private:
-        Config                 config_;
-        std::thread            thread_;
+                const RegionId region_id = object->region_id();
+                if (UNLIKELY(region_id == INVALID_REGION_ID)) {
+                    unowned_count_ += 1;
+                    return;
+                }
 
-        std::mutex             regions_mutex_;
-        std::vector<Region*>   regions_;
-        RegionControllerGroup  controllers_;
+                const size_t key = to_key(region_id, operation.type());
+                if (key >= key_count) {
+                    key_count = key + 1;
+                    counts_.resize(key_count, 0);
+                }
 
-        bool                   running_;
-        Doorbell               doorbell_;
-        Selector               selector_;
-    };
+                counts_[key] += 1;
+                scratch_.push_back({key, operation});
+            });
 
-}
+            // Calculate offsets. The cumulative offset is stored at the end.
+            offsets_.resize(key_count + 1);
+            {
+                size_t offset = 0;
+                for (size_t key = 0; key < key_count; ++key) {
+                    offsets_[key] = offset;
+                    offset += counts_[key];
+                }
+                offsets_[key_count] = offset;
+            }
 
+            // Scatter operations into their slices.
+            operations_.resize(scratch_.size());
+            for (auto&& [key, operation]: scratch_) {
+                operations_[offsets_[key + 1] - counts_[key]] = operation;
+                counts_[key] -= 1;
+            }
 
-// include/mantle/handle.h
+            scratch_.clear();
+        }
 
+        void clear() {
+            operations_.clear();
+            offsets_.clear();
+            counts_.clear();
+            scratch_.clear();
+            unowned_count_ = 0;
+        }
 
-namespace mantle {
+    private:
+        static size_t to_key(const RegionId region_id, const OperationType type) {
+            return (static_cast<size_t>(region_id) * OPERATION_TYPE_COUNT) + to_index(type);
+        }
 
-    // This class holds a strong reference to an Object derived class instance.
-    // It implements a smart-pointer like interface and has semantics similar to std::shared_ptr.
-    //
-    // NOTE: We've got an extra `OperationType` bit we can use for a flag if needed.
-    // NOTE: The exponent is never saturated at rest. We can use the high bit for a flag if needed.
-    // TODO: Think about renaming this to `Ref<T>` for brevity.
-    //
-    template<typename T>
-    class Handle {
-        static_assert(std::is_base_of_v<Object, T>, "Object is a required base class");
+    private:
+        std::vector<Operation>                     operations_;
+        std::vector<size_t>                        offsets_;
+        std::vector<size_t>                        counts_;
+        std::vector<std::pair<size_t, Operation>>  scratch_;
+        size_t                                     unowned_count_ = 0;
+    };
 
-        friend Handle<T> make_handle<T>(T& object) noexcept;
+}
 
-        // Bind an `Object` subclass to the local `Region` and return a managed `Handle` to it.
-        static Handle bind(T& object) noexcept {
-            Region* region = Region::thread_local_instance();
-            assert(region);
 
-            static_cast<Object&>(object).bind(region->id());
+// include/mantle/operation_combiner.h
 
-            return Handle(make_decrement_operation(&object, Operation::EXPONENT_MIN));
-        }
 
-        explicit Handle(Operation operation) noexcept
-            : operation_(operation)
-        {
-        }
+namespace mantle {
 
+    // A small direct-mapped cache on the region thread that folds operations on the same object
+    // together before they reach the ledger. Copying a handle and dropping it again within one
+    // transaction then costs no ledger entries at all.
+    //
+    // Each object maps to a single slot. An object that lands on a slot held by another one evicts
+    // it, and the evicted net delta is written out straight away. Folding only ever replaces a
+    // region's own operations with their sum, so the counts the domain applies are unchanged.
+    //
+    class OperationCombiner {
     public:
-        Handle() noexcept
-            : operation_(make_null_operation())
+        // The capacity is rounded up to a power of two. Zero disables the cache.
+        explicit OperationCombiner(const size_t capacity = 0)
+            : entries_(capacity ? std::bit_ceil(capacity) : 0)
+            , mask_(entries_.empty() ? 0 : (entries_.size() - 1))
+            , written_count_(0)
+            , emitted_count_(0)
         {
+            occupied_.reserve(entries_.size());
         }
 
-        Handle(std::nullptr_t) noexcept
-            : Handle()
-        {
+        [[nodiscard]]
+        bool is_enabled() const {
+            return !entries_.empty();
         }
 
-        Handle(Handle&& other) noexcept
-            : operation_(make_null_operation())
-        {
-            std::swap(operation_, other.operation_);
+        [[nodiscard]]
+        size_t capacity() const {
+            return entries_.size();
         }
 
-        template<typename U>
-        Handle(Handle<U>&& other) noexcept
-            : operation_(make_null_operation())
-        {
-            std::swap(operation_, other.operation_);
+        // Returns true if no operations are waiting to be written out.
+        [[nodiscard]]
+        bool is_empty() const {
+            return occupied_.empty();
         }
 
-        Handle(const Handle& other) noexcept
-            : Handle(other.copy_reference())
-        {
+        // The number of operations that went into the cache, and the number that came out of it.
+        [[nodiscard]]
+        size_t written_count() const {
+            return written_count_;
         }
 
-        template<typename U>
-        Handle(const Handle<U>& other) noexcept
-            : operation_(other.copy_reference())
-        {
-            static_assert(std::is_base_of_v<T, U>);
+        [[nodiscard]]
+        size_t emitted_count() const {
+            return emitted_count_;
         }
 
-        Handle& operator=(Handle&& that) noexcept {
-            if (operation_.object() != that.operation_.object()) {
-                reset();
-                std::swap(operation_, that.operation_);
+        // Fold an operation into its object's slot. An object that held the slot before is evicted,
+        // and its net delta is handed to the sink, which must take every operation it's given.
+        //
+        // NOTE: The sink may call back into the combiner, so the slot is reassigned before the
+        //       evicted delta is written out.
+        template<typename Sink>
+        MANTLE_HOT void write(const Operation operation, Sink&& sink) {
+            assert(is_enabled());
+
+            Object* object = operation.mutable_object();
+            assert(object);
+
+            written_count_ += 1;
+
+            const size_t index = to_index(object);
+            Entry& entry = entries_[index];
+            if (LIKELY(entry.key == object)) {
+                entry.delta += operation.value();
+                return;
             }
 
-            return *this;
+            const Entry evicted = std::exchange(entry, Entry { .key = object, .delta = operation.value() });
+            if (!evicted.key) {
+                occupied_.push_back(index);
+                return;
+            }
+
+            [[maybe_unused]] const int64_t remainder = emit(evicted, sink);
+            assert(remainder == 0);
         }
 
-        template<typename U>
-        Handle& operator=(Handle<U>&& that) noexcept {
-            static_assert(std::is_base_of_v<T, U>);
+        // Hand the net delta of every slot to the sink, which returns false once it can't take any
+        // more. Whatever is left stays in the cache. Returns true if the cache was emptied.
+        template<typename Sink>
+        bool flush(Sink&& sink) {
+            while (!occupied_.empty()) {
+                const size_t index = occupied_.back();
+                occupied_.pop_back();
 
-            if (operation_.object() != that.operation_.object()) {
-                reset();
-                std::swap(operation_, that.operation_);
+                const Entry entry = std::exchange(entries_[index], Entry {});
+                if (const int64_t remainder = emit(entry, sink)) {
+                    entries_[index] = { .key = entry.key, .delta = remainder };
+                    occupied_.push_back(index);
+                    return false;
+                }
             }
 
-            return *this;
+            return true;
         }
 
-        Handle& operator=(const Handle& that) noexcept {
-            if (operation_.object() != that.operation_.object()) {
-                reset();
-                operation_ = that.copy_reference();
-            }
+    private:
+        struct Entry {
+            Object* key   = nullptr;
+            int64_t delta = 0;
+        };
 
-            return *this;
+        size_t to_index(Object* key) const {
+            uintptr_t ptr;
+            memcpy(&ptr, &key, sizeof(ptr));
+            return (ptr >> SHIFT) & mask_;
         }
 
-        template<typename U>
-        Handle& operator=(const Handle<U>& that) noexcept {
-            static_assert(std::is_base_of_v<T, U>);
+        // Write a net delta out as operations that sum to it, each taking the delta to the nearest power
+        // of two. That way a delta never needs more operations than went into it, e.g. 127 is +128 -1.
+        // Returns the part of the delta the sink didn't take.
+        template<typename Sink>
+        int64_t emit(const Entry entry, Sink&& sink) {
+            int64_t delta = entry.delta;
 
-            if (operation_.object() != that.operation_.object()) {
-                reset();
-                operation_ = that.copy_reference();
+            while (delta != 0) {
+                const OperationType type = (delta > 0) ? OperationType::INCREMENT : OperationType::DECREMENT;
+                const uint64_t magnitude = static_cast<uint64_t>((delta > 0) ? delta : -delta);
+
+                uint64_t exponent = log2_floor(magnitude);
+                if ((magnitude - (uint64_t{1} << exponent)) > ((uint64_t{2} << exponent) - magnitude)) {
+                    exponent += 1;
+                }
+                exponent = std::min<uint64_t>(exponent, Operation::EXPONENT_MAX);
+
+                const Operation operation = make_operation(entry.key, type, static_cast<uint8_t>(exponent));
+                if (!sink(operation)) {
+                    break;
+                }
+
+                emitted_count_ += 1;
+                delta -= operation.value();
             }
 
-            return *this;
+            return delta;
+        }
+
+    private:
+        static constexpr uintptr_t SHIFT = log2_floor(alignof(Object));
+
+        std::vector<Entry>  entries_;
+        std::vector<size_t> occupied_; // Slots that hold an object, each listed once.
+        size_t              mask_;
+        size_t              written_count_;
+        size_t              emitted_count_;
+    };
+
+}
+
+
+// include/mantle/fallback_ledger.h
+
+
+namespace mantle {
+
+    // Operations from threads that don't run a region, which would otherwise be leaked. Any thread can
+    // write to it, and the next region of its domain to commit a transaction moves everything written
+    // so far into that transaction's spill, as if it had written the operations itself. Decrements are
+    // then submitted two transactions later like the region's own, so this is as safe as a region
+    // ledger, just slower.
+    //
+    // Objects don't know which domain they belong to, so only one domain at a time can have one.
+    // See `Config::fallback_ledger`.
+    //
+    class FallbackLedger {
+        FallbackLedger(FallbackLedger&&) = delete;
+        FallbackLedger(const FallbackLedger&) = delete;
+        FallbackLedger& operator=(FallbackLedger&&) = delete;
+        FallbackLedger& operator=(const FallbackLedger&) = delete;
+
+    public:
+        // Throws `std::runtime_error` if another domain has one.
+        FallbackLedger();
+        ~FallbackLedger();
+
+        // Returns the ledger of the domain that has one, if any.
+        static FallbackLedger* instance() {
+            return installed_instance().load(std::memory_order_acquire);
+        }
+
+        void write(Operation operation);
+        void write(std::span<const Operation> operations);
+
+        // Returns true if operations have been written since the last drain. Regions check this
+        // every step, so it doesn't take the lock.
+        [[nodiscard]]
+        bool has_operations() const {
+            return has_operations_.load(std::memory_order_relaxed);
+        }
+
+        // Move everything written so far into the spill.
+        void drain(OperationSpill& spill);
+
+        // The number of operations that have been written, which is how much traffic takes this path.
+        [[nodiscard]]
+        size_t written_count() const {
+            return written_count_.load(std::memory_order_relaxed);
+        }
+
+    private:
+        static std::atomic<FallbackLedger*>& installed_instance() {
+            static std::atomic<FallbackLedger*> instance = nullptr;
+            return instance;
+        }
+
+    private:
+        std::mutex             mutex_;
+        std::vector<Operation> operations_;
+        std::atomic_bool       has_operations_;
+        std::atomic_size_t     written_count_;
+    };
+
+}
+
+
+// include/mantle/ledger.h
+
+
+
+#define WRITE_BARRIER_PHASES(X) \
+    X(STORE_DECREMENTS)         \
+    X(DELAY)                    \
+    X(STORE_INCREMENTS)         \
+    X(APPLY)                    \
+
+namespace mantle {
+
+    class Ledger;
+    class WriteBarrier;
+
+    enum class WriteBarrierPhase {
+#define X(WRITE_BARRIER_PHASE) WRITE_BARRIER_PHASE,
+        WRITE_BARRIER_PHASES(X)
+#undef X
+    };
+
+    constexpr size_t WRITE_BARRIER_PHASE_COUNT = 0
+#define X(WRITE_BARRIER_PHASE) + 1
+        WRITE_BARRIER_PHASES(X)
+#undef X
+    ;
+
+    // This is a simple RAII wrapper around a private anonymous memory mapping.
+    class PrivateMemoryMapping {
+    public:
+        explicit PrivateMemoryMapping(size_t size, bool populate = true);
+        ~PrivateMemoryMapping();
+
+        PrivateMemoryMapping(PrivateMemoryMapping&&) = delete;
+        PrivateMemoryMapping(const PrivateMemoryMapping&) = delete;
+        PrivateMemoryMapping& operator=(PrivateMemoryMapping&&) = delete;
+        PrivateMemoryMapping& operator=(const PrivateMemoryMapping&) = delete;
+
+        [[nodiscard]]
+        std::span<std::byte> memory();
+
+        [[nodiscard]]
+        std::span<const std::byte> memory() const;
+
+        // Fault in the first `size` bytes, so that writing to them doesn't have to.
+        void populate(size_t size);
+
+        // Hand the first `size` bytes back to the OS. They read as zero once touched again.
+        void release(size_t size);
+
+    private:
+        std::span<std::byte> memory_;
+    };
+
+    // Operations are stored as they are written, with decrements first since they are delayed.
+    // The last page is write protected, so running into it swaps in a fresh segment.
+    struct WriteBarrierSegment {
+        WriteBarrierSegment* prev;
+        WriteBarrier*        barrier;
+        bool                 primed;
+        bool                 resident; // Whether the pages before the guard page are populated.
+        size_t               increment_count;
+        size_t               decrement_count;
+        PrivateMemoryMapping mapping;
+
+        WriteBarrierSegment();
+
+        WriteBarrierSegment(WriteBarrierSegment&&) = delete;
+        WriteBarrierSegment(const WriteBarrierSegment&) = delete;
+        WriteBarrierSegment& operator=(WriteBarrierSegment&&) = delete;
+        WriteBarrierSegment& operator=(const WriteBarrierSegment&) = delete;
+
+        Operation* cursor();
+        const Operation* cursor() const;
+        std::span<Operation> operations();
+        std::span<std::byte> guard_page();
+
+        // Populate or release the pages before the guard page, which stays primed either way.
+        void populate();
+        void release();
+
+        // The operations committed to this segment.
+        [[nodiscard]]
+        std::span<const Operation> committed_operations() const;
+    };
+
+    // Rename to WriteBarrierStack?
+    class WriteBarrier {
+    public:
+        using Phase = WriteBarrierPhase;
+
+        explicit WriteBarrier(Ledger& ledger, size_t phase_shift);
+        ~WriteBarrier();
+
+        WriteBarrier(WriteBarrier&&) = delete;
+        WriteBarrier(const WriteBarrier&) = delete;
+        WriteBarrier& operator=(WriteBarrier&&) = delete;
+        WriteBarrier& operator=(const WriteBarrier&) = delete;
+
+        Ledger& ledger();
+
+        [[nodiscard]]
+        Phase phase() const;
+
+        [[nodiscard]]
+        bool is_empty() const;
+        WriteBarrierSegment* back();
+        const WriteBarrierSegment* back() const;
+        void push_back(WriteBarrierSegment& segment);
+        WriteBarrierSegment* pop_back();
+
+        void commit(bool pending_write);
+
+        // NOTE: This is O(N).
+        [[nodiscard]]
+        size_t increment_count() const;
+
+        // NOTE: This is O(N).
+        [[nodiscard]]
+        size_t decrement_count() const;
+
+        // Visit the operations committed to each segment.
+        template<typename Visitor>
+        void for_each_segment(Visitor&& visitor) const {
+            for (const WriteBarrierSegment* segment = stack_; segment; segment = segment->prev) {
+                visitor(*segment);
+            }
+        }
+
+    private:
+        Ledger&              ledger_;
+        size_t               phase_shift_;
+        WriteBarrierSegment* stack_;
+    };
+
+    struct WriteBarrierPoolMetrics {
+        size_t segment_count           = 0; // Every segment allocated so far.
+        size_t resident_count          = 0; // Idle segments that are ready to be handed out.
+        size_t released_count          = 0; // Idle segments whose memory was handed back to the OS.
+        size_t demand_allocation_count = 0; // Times a segment had to be created or populated on demand.
+    };
+
+    // Hands out segments and swaps them when a write runs into a guard page. Someone has to call
+    // `poll` whenever the file descriptor is readable, since faulting threads are stuck until then.
+    //
+    // Idle segments are kept between two watermarks. Handing out and taking back segments only moves
+    // them between lists, and rings the maintenance doorbell when the pool leaves the watermarks. Whoever
+    // watches it calls `maintain`, which populates or releases segments away from the writing threads.
+    class WriteBarrierManager {
+    public:
+        using Metrics = WriteBarrierPoolMetrics;
+
+        explicit WriteBarrierManager(size_t low_watermark = WRITE_BARRIER_POOL_LOW_WATERMARK, size_t high_watermark = WRITE_BARRIER_POOL_HIGH_WATERMARK);
+
+        [[nodiscard]]
+        int file_descriptor();
+
+        [[nodiscard]]
+        int maintenance_file_descriptor();
+
+        // Handle one pending fault. Returns false if there weren't any.
+        bool poll();
+
+        // Bring the resident idle segments back between the watermarks.
+        void maintain();
+
+        [[nodiscard]]
+        Metrics metrics();
+
+        void attach(WriteBarrier& barrier);
+        void detach(WriteBarrier& barrier);
+
+        // Give back every segment but a fresh one, once the operations in the barrier have been consumed.
+        void reset(WriteBarrier& barrier);
+
+    private:
+        void prime_guard_page(WriteBarrierSegment& segment);
+
+        WriteBarrierSegment& create_segment();
+        WriteBarrierSegment& allocate_segment();
+        void deallocate_segment(WriteBarrierSegment& segment);
+
+        // Must be called with the pool locked.
+        void request_maintenance();
+
+    private:
+        PageFaultHandler                                  page_fault_handler_;
+        size_t                                            low_watermark_;
+        size_t                                            high_watermark_;
+        Doorbell                                          maintenance_doorbell_;
+
+        std::mutex                                        segment_pool_mutex_;
+        std::vector<WriteBarrierSegment*>                 segment_pool_;          // Resident.
+        std::vector<WriteBarrierSegment*>                 released_segment_pool_; // Handed back to the OS.
+        std::vector<std::unique_ptr<WriteBarrierSegment>> segment_pool_storage_;
+        bool                                              maintenance_requested_;
+        size_t                                            demand_allocation_count_;
+    };
+
+    // Records the operations of `Ref`s on this thread. Write barriers rotate through the phases each
+    // time the ledger steps, so the barrier in the APPLY phase always holds the increments of the last
+    // transaction and the decrements of the one two before it.
+    //
+    // NOTE: The cursors are thread local, so there can only be one ledger per thread.
+    //
+    class Ledger {
+    public:
+        // Conceptually a `std::atomic<std::vector<Operation>::iterator>`.
+        using Cursor = std::atomic<Operation*>;
+
+        static Cursor& local_increment_cursor() {
+            thread_local Cursor cursor = nullptr;
+            return cursor;
+        }
+
+        static Cursor& local_decrement_cursor() {
+            thread_local Cursor cursor = nullptr;
+            return cursor;
+        }
+
+        explicit Ledger(WriteBarrierManager& write_barrier_manager);
+        ~Ledger();
+
+        Ledger(Ledger&&) = delete;
+        Ledger(const Ledger&) = delete;
+        Ledger& operator=(Ledger&&) = delete;
+        Ledger& operator=(const Ledger&) = delete;
+
+        [[nodiscard]]
+        Sequence sequence() const;
+
+        Cursor& increment_cursor();
+        Cursor& decrement_cursor();
+
+        // Find the barrier in the corresponding phase.
+        WriteBarrier& barrier(WriteBarrierPhase phase);
+        const WriteBarrier& barrier(WriteBarrierPhase phase) const;
+        WriteBarrier& increment_barrier();
+        WriteBarrier& decrement_barrier();
+        WriteBarrier& apply_barrier();
+
+        // Returns true if nothing has been written since the barrier in the APPLY phase was committed.
+        [[nodiscard]]
+        bool is_empty() const;
+
+        // Commit the current transaction. The operations in the APPLY phase must have been consumed
+        // since the last step, because that barrier starts collecting decrements again.
+        void step();
+
+    private:
+        AtomicSequence       sequence_;
+        Cursor&              increment_cursor_;
+        Cursor&              decrement_cursor_;
+        WriteBarrier         write_barriers_[WRITE_BARRIER_PHASE_COUNT];
+        WriteBarrierManager& write_barrier_manager_;
+    };
+
+    // These are a plain store. There is no bounds check, since running off the end of a segment
+    // faults on its guard page and the write barrier manager swaps in the next one.
+    MANTLE_HOT
+    void increment_ref_cnt(Object& object) {
+        Ledger::Cursor& cursor = Ledger::local_increment_cursor();
+        Operation* record = cursor.load(std::memory_order_acquire); // Doesn't need to be a fetch-add.
+        cursor.store(record + 1, std::memory_order_release);
+        *record = make_increment_operation(&object, Operation::EXPONENT_MIN);
+    }
+
+    MANTLE_HOT
+    void decrement_ref_cnt(Object& object) {
+        Ledger::Cursor& cursor = Ledger::local_decrement_cursor();
+        Operation* record = cursor.load(std::memory_order_acquire); // Doesn't need to be a fetch-add.
+        cursor.store(record + 1, std::memory_order_release);
+        *record = make_decrement_operation(&object, Operation::EXPONENT_MIN);
+    }
+
+}
+
+
+// include/mantle/connection.h
+
+
+namespace mantle {
+
+    // A single producer, single consumer ring of trivially copyable values. Regions and the domain
+    // exchange `Message`s over these, and channels use them to pass handles around.
+    template<typename T>
+    class BasicStream {
+        static_assert(std::is_trivially_copyable_v<T>);
+
+        BasicStream(BasicStream&&) = delete;
+        BasicStream(const BasicStream&) = delete;
+        BasicStream& operator=(BasicStream&&) = delete;
+        BasicStream& operator=(const BasicStream&) = delete;
+
+    public:
+        using Value = T;
+
+        // Values that have been received but not released yet. They are read in place,
+        // so there are two spans when they wrap around the end of the ring.
+        struct Window {
+            std::span<const T> first;
+            std::span<const T> second;
+        };
+
+        // The ring is only ever read by the receiver, so it should live on the receiver's NUMA node.
+        explicit BasicStream(size_t minimum_capacity = STREAM_CAPACITY, std::optional<size_t> numa_node = std::nullopt)
+            : ring_(MappedAllocator<T>(HugePagePolicy::NONE, numa_node))
+            , mask_()
+            , head_(0)
+            , tail_(0)
+            , private_head_(0)
+            , private_window_count_(0)
+            , private_tail_(0)
+            , private_cached_head_(0)
+        {
+            size_t capacity = 1;
+            while (capacity < minimum_capacity) {
+                capacity *= 2;
+            }
+
+            mask_ = capacity - 1;
+            ring_.resize(capacity);
+        }
+
+        size_t capacity() const {
+            return ring_.size();
+        }
+
+        bool send(const T& value) {
+            // Only look at where the receiver is when we appear to be full. The receiver has
+            // probably moved on since we last checked.
+            if ((private_tail_ - private_cached_head_) == ring_.size()) {
+                private_cached_head_ = head_.load(std::memory_order_acquire);
+                if ((private_tail_ - private_cached_head_) == ring_.size()) {
+                    return false; // Stream is full.
+                }
+            }
+
+            ring_[private_tail_ & mask_] = value;
+
+            private_tail_ += 1;
+            tail_.store(private_tail_, std::memory_order_release);
+            return true;
+        }
+
+        // Returns true if there are values that haven't been received yet. Only the receiver may call this.
+        [[nodiscard]]
+        bool has_messages() const {
+            return tail_.load(std::memory_order_acquire) != private_head_;
+        }
+
+        // Returns the values that arrived since the last call. They stay valid until `release`
+        // has been called once for each `receive`, which is when the sender can reuse their slots.
+        Window receive() {
+            const Sequence tail = tail_.load(std::memory_order_acquire);
+            const size_t count = tail - private_head_;
+            assert(count <= ring_.size());
+
+            const size_t offset = private_head_ & mask_;
+            const size_t first_count = std::min(count, ring_.size() - offset);
+
+            private_head_ = tail;
+            private_window_count_ += 1;
+
+            return {
+                .first  = { ring_.data() + offset, first_count },
+                .second = { ring_.data(), count - first_count },
+            };
+        }
+
+        // Windows can be nested, so the slots are only handed back once the outermost one is released.
+        void release() {
+            assert(private_window_count_ > 0);
+
+            if (--private_window_count_ == 0) {
+                head_.store(private_head_, std::memory_order_release);
+            }
+        }
+
+    private:
+        std::vector<T, MappedAllocator<T>> ring_;
+        size_t                             mask_;
+
+        alignas(CACHE_LINE_SIZE) AtomicSequence head_;
+        alignas(CACHE_LINE_SIZE) AtomicSequence tail_;
+
+        // Private to receive.
+        alignas(CACHE_LINE_SIZE) Sequence private_head_;
+        size_t                            private_window_count_;
+
+        // Private to send.
+        alignas(CACHE_LINE_SIZE) Sequence private_tail_;
+        Sequence                          private_cached_head_;
+    };
+
+    using Stream = BasicStream<Message>;
+
+    // Received messages, read in place from the stream. The slots are released when this is destroyed.
+    class MessageBatch {
+    public:
+        class Iterator {
+        public:
+            Iterator(const MessageBatch& batch, size_t index)
+                : batch_(&batch)
+                , index_(index)
+            {
+            }
+
+            const Message& operator*() const {
+                return (*batch_)[index_];
+            }
+
+            Iterator& operator++() {
+                index_ += 1;
+                return *this;
+            }
+
+            bool operator==(const Iterator& other) const {
+                return index_ == other.index_;
+            }
+
+        private:
+            const MessageBatch* batch_;
+            size_t              index_;
+        };
+
+        MessageBatch()
+            : stream_(nullptr)
+            , window_()
+        {
+        }
+
+        MessageBatch(Stream& stream, Stream::Window window)
+            : stream_(&stream)
+            , window_(window)
+        {
+        }
+
+        MessageBatch(MessageBatch&& other)
+            : stream_(std::exchange(other.stream_, nullptr))
+            , window_(std::exchange(other.window_, {}))
+        {
+        }
+
+        MessageBatch& operator=(MessageBatch&& other) {
+            if (this != &other) {
+                reset();
+                stream_ = std::exchange(other.stream_, nullptr);
+                window_ = std::exchange(other.window_, {});
+            }
+
+            return *this;
+        }
+
+        MessageBatch(const MessageBatch&) = delete;
+        MessageBatch& operator=(const MessageBatch&) = delete;
+
+        ~MessageBatch() {
+            reset();
+        }
+
+        [[nodiscard]]
+        size_t size() const {
+            return window_.first.size() + window_.second.size();
+        }
+
+        [[nodiscard]]
+        bool empty() const {
+            return size() == 0;
+        }
+
+        const Message& operator[](size_t index) const {
+            const size_t first_count = window_.first.size();
+            return (index < first_count) ? window_.first[index] : window_.second[index - first_count];
+        }
+
+        Iterator begin() const {
+            return { *this, 0 };
+        }
+
+        Iterator end() const {
+            return { *this, size() };
+        }
+
+        void reset() {
+            if (stream_) {
+                std::exchange(stream_, nullptr)->release();
+                window_ = {};
+            }
+        }
+
+    private:
+        Stream*        stream_;
+        Stream::Window window_;
+    };
+
+    class Endpoint {
+        Endpoint(Endpoint&&) = delete;
+        Endpoint(const Endpoint&) = delete;
+        Endpoint& operator=(Endpoint&&) = delete;
+        Endpoint& operator=(const Endpoint&) = delete;
+
+    public:
+        // The NUMA node is where messages sent to this endpoint are kept. The wakeup policy is how
+        // senders wake up this endpoint when it is blocked waiting for messages.
+        explicit Endpoint(Endpoint& remote_endpoint, std::optional<size_t> numa_node = std::nullopt, WakeupPolicy wakeups = WakeupPolicy::EVENTFD)
+            : remote_endpoint_(remote_endpoint)
+            , stream_(STREAM_CAPACITY, numa_node)
+            , wakeups_(wakeups)
+            , spinning_(false)
+            , rung_(false)
+            , sleeping_(0)
+            , notified_(false)
+        {
+        }
+
+        // Only becomes readable with `WakeupPolicy::EVENTFD`.
+        int file_descriptor() {
+            return doorbell_.file_descriptor();
+        }
+
+        Stream& stream() {
+            return stream_;
+        }
+
+        // Ring our own doorbell so that the file descriptor stays readable, and the next
+        // blocking receive doesn't block.
+        void notify() {
+            if (wakeups_ == WakeupPolicy::FUTEX) {
+                notified_ = true;
+            }
+            else {
+                doorbell_.ring();
+                rung_.store(true, std::memory_order_relaxed);
+            }
+        }
+
+        bool send_message(const Message& message) {
+            if (!remote_endpoint_.stream_.send(message)) {
+                return false;
+            }
+
+            // Pairs with the fence in `set_spinning`. Either the receiver sees the message when it
+            // checks one last time, or we see that it has stopped spinning and ring the doorbell.
+            // Futexes work the same way with the flag the receiver raises before it goes to sleep.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (remote_endpoint_.wakeups_ == WakeupPolicy::FUTEX) {
+                if (remote_endpoint_.sleeping_.load(std::memory_order_relaxed) && remote_endpoint_.sleeping_.exchange(0, std::memory_order_relaxed)) {
+                    futex_wake(remote_endpoint_.sleeping_);
+                }
+            }
+            else if (!remote_endpoint_.spinning_.load(std::memory_order_relaxed)) {
+                // The flag is raised after ringing, so seeing it down means the ring has been read
+                // or is about to be followed by the flag, and the doorbell can be left alone.
+                remote_endpoint_.doorbell_.ring();
+                remote_endpoint_.rung_.store(true, std::memory_order_relaxed);
+            }
+
+            return true;
+        }
+
+        // While spinning, the receiver promises to check the stream without being woken up. It must
+        // check once more after it stops, since senders may not have rung the doorbell.
+        void set_spinning(bool spinning) {
+            spinning_.store(spinning, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+
+        [[nodiscard]]
+        bool has_messages() const {
+            return stream_.has_messages();
+        }
+
+        // Returns true if a receive could find anything, or has a doorbell ring to clear. This
+        // doesn't make a system call, so receivers can check it before every receive.
+        [[nodiscard]]
+        bool has_pending() const {
+            return stream_.has_messages() || notified_ || rung_.load(std::memory_order_relaxed);
+        }
+
+        // NOTE: The sender can't reuse the slots of these messages until the batch is destroyed,
+        //       so don't hold on to it for longer than it takes to handle them.
+        MessageBatch receive_messages(bool non_blocking) {
+            if (wakeups_ == WakeupPolicy::FUTEX) {
+                wait_for_messages(non_blocking);
+            }
+            else {
+                rung_.store(false, std::memory_order_relaxed);
+                doorbell_.poll(non_blocking);
+            }
+
+            return { stream_, stream_.receive() };
+        }
+
+        // Like the above, but leaves the doorbell alone. This is for receivers that are spinning.
+        MessageBatch receive_pending_messages() {
+            return { stream_, stream_.receive() };
+        }
+
+    private:
+        // Like polling the doorbell. A notification lets one receive through, and so does a message.
+        void wait_for_messages(const bool non_blocking) {
+            if (std::exchange(notified_, false) || non_blocking) {
+                return;
+            }
+
+            while (!stream_.has_messages()) {
+                sleeping_.store(1, std::memory_order_relaxed);
+
+                // Pairs with the fence in `send_message`. Either we see the message, or the sender
+                // sees that we're sleeping and wakes us up.
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (!stream_.has_messages()) {
+                    futex_wait(sleeping_, 1);
+                }
+
+                sleeping_.store(0, std::memory_order_relaxed);
+            }
+        }
+
+    private:
+        Endpoint&                                     remote_endpoint_;
+        Doorbell                                      doorbell_;
+        Stream                                        stream_;
+        WakeupPolicy                                  wakeups_;
+        alignas(CACHE_LINE_SIZE) std::atomic_bool     spinning_;
+        alignas(CACHE_LINE_SIZE) std::atomic_bool     rung_; // Raised by whoever rings the doorbell.
+        alignas(CACHE_LINE_SIZE) std::atomic_uint32_t sleeping_;
+        bool                                          notified_; // Private to the receiver.
+    };
+
+    // A pair of endpoints linked with bidirectional message streams.
+    class Connection {
+    public:
+        // NOTE: The endpoints refer to each other, so one of them has to be bound before it
+        //       is constructed. Going through the accessor keeps GCC from flagging this.
+        explicit Connection(
+            std::optional<size_t> client_numa_node = std::nullopt,
+            std::optional<size_t> server_numa_node = std::nullopt,
+            WakeupPolicy          client_wakeups   = WakeupPolicy::EVENTFD
+        )
+            : client_endpoint_(server_endpoint(), client_numa_node, client_wakeups)
+            , server_endpoint_(client_endpoint(), server_numa_node)
+        {
+        }
+
+        Endpoint& client_endpoint() {
+            return client_endpoint_;
+        }
+
+        const Endpoint& client_endpoint() const {
+            return client_endpoint_;
+        }
+
+        Endpoint& server_endpoint() {
+            return server_endpoint_;
+        }
+
+        const Endpoint& server_endpoint() const {
+            return server_endpoint_;
+        }
+
+    private:
+        Endpoint client_endpoint_;
+        Endpoint server_endpoint_;
+    };
+
+}
+
+
+// include/mantle/operation_grouper.h
+
+
+namespace mantle {
+
+    struct OperationGrouperMetrics {
+        size_t grouped_count           = 0; // Operations merged into another by the radix engine.
+
+        size_t written_count           = 0;
+        size_t written_increment_count = 0;
+        size_t written_decrement_count = 0;
+
+        size_t flushed_count           = 0;
+        size_t flushed_increment_count = 0;
+        size_t flushed_decrement_count = 0;
+
+        size_t evicted_count           = 0; // Groups flushed early to make room for another object.
+        size_t cache_capacity          = 0;
+        size_t resize_count            = 0;
+    };
+
+    // This class attempts to reduce the number of random memory writes needed to update reference counts
+    // by combining operations on the same object into a single write. Grouped operations are not
+    // imediately applied.
+    //
+    // This has two major benefits:
+    //   1. Increments can be applied before decrements.
+    //   2. The prefetcher should have an easier time predicting what will be touched next.
+    //
+    // With `GrouperEngine::RADIX` the cache isn't used. Every operation goes straight to the collections,
+    // which are sorted by object and merged when they're flushed.
+    //
+    // The cache can be resized at cycle boundaries. It grows when a cycle evicts a quarter of its capacity
+    // or more, and shrinks when it has stayed below an eighth of its capacity for a number of cycles.
+    //
+    class OperationGrouper {
+        static constexpr size_t CACHE_WAYS = 8;
+
+        static constexpr size_t GROW_EVICTION_DIVISOR = 4;
+        static constexpr size_t SHRINK_FILL_DIVISOR   = 8;
+        static constexpr size_t SHRINK_CYCLES         = 16;
+
+        // Radix sorting goes through the operations once per digit. Smaller collections are sorted in place.
+        static constexpr size_t RADIX_BITS     = 8;
+        static constexpr size_t RADIX_SORT_MIN = 256;
+
+        struct OperationGroup {
+            int64_t delta = 0;
+            size_t  hit_count = 0;
+            size_t  hit_decay = 0;
+        };
+
+        using Cache       = ObjectCache<OperationGroup, CACHE_WAYS>;
+        using CacheEntry  = Cache::Entry;
+        using CacheCursor = Cache::Cursor;
+
+    public:
+        using Metrics = OperationGrouperMetrics;
+
+        // A maximum size no larger than the initial one keeps the cache at a fixed size.
+        explicit OperationGrouper(
+            size_t                cache_size     = OPERATION_GROUPER_CACHE_SIZE,
+            size_t                cache_size_max = 0,
+            GrouperEvictionPolicy eviction       = GrouperEvictionPolicy::SMALLEST_DELTA,
+            GrouperEngine         engine         = GrouperEngine::CACHE
+        );
+
+        [[nodiscard]]
+        const Metrics& metrics() const;
+
+        // Returns true if there are operations missing from the increment/decrement collections
+        // because they have yet to be flushed.
+        [[nodiscard]]
+        bool is_dirty() const;
+
+        [[nodiscard]]
+        std::span<std::pair<Object*, int64_t>> increments();
+
+        [[nodiscard]]
+        std::span<std::pair<Object*, int64_t>> decrements();
+
+        // Write an operation to the cache. If flush is true, the operation is immediately written to the
+        // increment or decrement collection. Otherwise, the operation is grouped with other operations.
+        void write(Operation operation, bool flush = false);
+
+        // Flush operations from the cache to the increment and decrement collections.
+        // The force parameter will cause all operations to be flushed regardless of the hit count,
+        // which is useful during shutdown.
+        void flush(bool force = false);
+
+        // Clear the increment and decrement collections.
+        void clear();
+
+        // Flush operations and set the increment and decrement collections aside, so that new operations
+        // can be written while these are applied. Anything set aside earlier must be cleared first.
+        void retire(bool force = false);
+
+        // Returns true if retired operations haven't been cleared yet.
+        [[nodiscard]]
+        bool has_retired() const;
+
+        [[nodiscard]]
+        std::span<std::pair<Object*, int64_t>> retired_increments();
+
+        [[nodiscard]]
+        std::span<std::pair<Object*, int64_t>> retired_decrements();
+
+        // Clear the retired increment and decrement collections.
+        void clear_retired();
+
+        // Equivelent to calling flush(true) and then clear().
+        void reset();
+
+        // The number of groups the cache can hold right now.
+        [[nodiscard]]
+        size_t cache_capacity() const;
+
+    private:
+        // Select a cache entry for this object using a bunch of heuristics.
+        CacheCursor choose_way(Object* object);
+
+        // Sort the increment and decrement collections by object, and merge operations on the same one.
+        void merge_collections();
+
+        // Sort by object address, using the scratch space as a second buffer.
+        static void sort_by_object(std::vector<std::pair<Object*, int64_t>>& values, std::vector<std::pair<Object*, int64_t>>& scratch);
+
+        // Decide whether the cache should be resized, based on the cycle that just ended.
+        void maybe_resize();
+
+        void flush_group(CacheCursor cursor, bool force);
+        void reset_group(CacheCursor cursor);
+
+        void note_operation_written(Operation operation);
+        void note_operation_flushed(Operation operation);
+
+    private:
+        std::vector<std::pair<Object*, int64_t>> increments_;
+        std::vector<std::pair<Object*, int64_t>> decrements_;
+        std::vector<std::pair<Object*, int64_t>> retired_increments_;
+        std::vector<std::pair<Object*, int64_t>> retired_decrements_;
+        std::vector<std::pair<Object*, int64_t>> merge_buffer_;  // Private to `merge_collections`.
+        std::vector<std::pair<Object*, int64_t>> merge_scratch_;
+        size_t                                   cache_size_;
+        size_t                                   cache_size_min_;
+        size_t                                   cache_size_max_;
+        GrouperEvictionPolicy                    eviction_;
+        GrouperEngine                            engine_;
+        Metrics                                  metrics_;
+        Cache                                    cache_;
+
+        // What happened to the cache since the last cycle boundary.
+        size_t                                   cycle_evicted_count_;
+        size_t                                   cycle_peak_size_;
+        size_t                                   low_cycle_count_;
+    };
+
+}
+
+
+// include/mantle/object_grouper.h
+
+
+namespace mantle {
+
+    struct ObjectGrouperMetrics {
+        size_t      object_count = 0;
+        ObjectGroup group_min = std::numeric_limits<ObjectGroup>::max();
+        ObjectGroup group_max = std::numeric_limits<ObjectGroup>::min();
+    };
+
+    // This class groups objects for more efficient finalization.
+    //
+    // Only a handful of groups tend to be in use at a time, out of the tens of thousands an object can
+    // belong to. The grouper keeps track of which groups it has touched, so the work done by `flush`
+    // is proportional to the number of objects and groups actually used, rather than all of them.
+    //
+    class ObjectGrouper {
+        static constexpr size_t GROUP_COUNT = static_cast<size_t>(std::numeric_limits<ObjectGroup>::max()) + 1;
+
+    public:
+        using Metrics = ObjectGrouperMetrics;
+
+        ObjectGrouper()
+            : group_min_(std::numeric_limits<ObjectGroup>::max())
+            , group_max_(std::numeric_limits<ObjectGroup>::min())
+            , group_counts_(std::make_unique<size_t[]>(GROUP_COUNT))
+            , group_offsets_(std::make_unique_for_overwrite<size_t[]>(GROUP_COUNT))
+            , group_sizes_(std::make_unique_for_overwrite<size_t[]>(GROUP_COUNT))
+            , group_mask_{}
+        {
+        }
+
+        [[nodiscard]]
+        const Metrics& metrics() const {
+            return metrics_;
+        }
+
+        void write(Object& object) {
+            const ObjectGroup group = object.group();
+
+            if (group_counts_[group]++ == 0) {
+                touched_groups_.push_back(group);
+            }
+            group_min_ = std::min(group, group_min_);
+            group_max_ = std::max(group, group_max_);
+
+            input_.push_back(&object);
+        }
+
+        [[nodiscard]]
+        ObjectGroups flush() {
+            ObjectGroups groups = {};
+
+            metrics_.object_count += input_.size();
+            metrics_.group_min = std::min(group_min_, metrics_.group_min);
+            metrics_.group_max = std::max(group_max_, metrics_.group_max);
+
+            if constexpr (ENABLE_OBJECT_GROUPING) {
+                output_.resize(input_.size());
+
+                // Forget the groups from the last flush and mark the ones we've touched since.
+                for (const ObjectGroup group: flushed_groups_) {
+                    group_mask_[group / OBJECT_GROUP_MASK_WORD_BITS] = 0;
+                }
+                for (const ObjectGroup group: touched_groups_) {
+                    group_mask_[group / OBJECT_GROUP_MASK_WORD_BITS] |= uint64_t(1) << (group % OBJECT_GROUP_MASK_WORD_BITS);
+                }
+                flushed_groups_.swap(touched_groups_);
+                touched_groups_.clear();
+
+                // Calculate group offsets in group order.
+                {
+                    size_t offset = 0;
+                    for_each_group(group_mask_, group_min_, group_max_, [&](const ObjectGroup group) {
+                        const size_t group_size = group_counts_[group];
+
+                        group_offsets_[group] = offset;
+                        group_sizes_[group] = group_size;
+
+                        offset += group_size;
+                    });
+
+                    assert(offset == input_.size());
+                }
+
+                // Group objects in O(n) using radix sort. This leaves every count at zero again.
+                for (Object* object: input_) {
+                    const ObjectGroup group = object->group();
+
+                    const size_t offset = group_offsets_[group];
+                    size_t& count = group_counts_[group];
+                    assert(count);
+
+                    count -= 1;
+                    output_[offset + count] = object;
+                }
+
+                groups = ObjectGroups {
+                    .objects       = output_.data(),
+                    .object_count  = output_.size(),
+                    .group_min     = group_min_,
+                    .group_max     = group_max_,
+                    .group_offsets = group_offsets_.get(),
+                    .group_sizes   = group_sizes_.get(),
+                    .group_mask    = &group_mask_,
+                };
+
+#ifdef MANTLE_AUDIT
+                // Sanity check group membership.
+                size_t member_count = 0;
+                groups.for_each_group([&](ObjectGroup group, std::span<Object*> group_members) {
+                    assert(group_members.size() <= groups.object_count);
+                    member_count += group_members.size();
+
+                    for (const Object* object: group_members) {
+                        assert(object->group() == group);
+                        assert(object->is_managed());
+                    }
+                });
+                assert(member_count == groups.object_count);
+#endif
+            }
+            else {
+                output_ = input_;
+
+                // Counts are only reset by grouping.
+                for (const ObjectGroup group: touched_groups_) {
+                    group_counts_[group] = 0;
+                }
+                touched_groups_.clear();
+
+                groups = ObjectGroups {
+                    .objects       = output_.data(),
+                    .object_count  = output_.size(),
+                    .group_min     = group_min_,
+                    .group_max     = group_max_,
+                    .group_offsets = nullptr,
+                    .group_sizes   = nullptr,
+                    .group_mask    = nullptr,
+                };
+            }
+
+            input_.clear();
+            group_min_ = std::numeric_limits<ObjectGroup>::max();
+            group_max_ = std::numeric_limits<ObjectGroup>::min();
+
+            return groups;
+        }
+
+    private:
+        // Counts are zero for every group that hasn't been touched since the last flush. Offsets and
+        // sizes are only meaningful for the groups set in the mask.
+        std::vector<Object*>      input_;
+        ObjectGroup               group_min_;
+        ObjectGroup               group_max_;
+        std::unique_ptr<size_t[]> group_counts_;
+        std::vector<ObjectGroup>  touched_groups_;
+
+        std::vector<Object*>      output_;
+        std::unique_ptr<size_t[]> group_offsets_;
+        std::unique_ptr<size_t[]> group_sizes_;
+        ObjectGroupMask           group_mask_;
+        std::vector<ObjectGroup>  flushed_groups_;
+
+        Metrics                   metrics_;
+    };
+
+}
+
+
+// include/mantle/region.h
+
+
+#define MANTLE_REGION_STATES(X) \
+    X(RUNNING)                  \
+    X(STOPPING)                 \
+    X(STOPPED)                  \
+
+#define MANTLE_REGION_PHASES(X) \
+    X(RECV_ENTER)               \
+    X(RECV_ENTER_SENT_START)    \
+    X(RECV_RETIRE)              \
+    X(RECV_LEAVE)               \
+
+namespace mantle {
+
+    class Domain;
+    class Object;
+    class ObjectFinalizer;
+    class RegionPool;
+
+    enum class RegionState {
+#define X(MANTLE_REGION_STATE) \
+        MANTLE_REGION_STATE,   \
+
+        MANTLE_REGION_STATES(X)
+#undef X
+    };
+
+    enum class RegionPhase {
+#define X(MANTLE_REGION_PHASE) \
+        MANTLE_REGION_PHASE,   \
+
+        MANTLE_REGION_PHASES(X)
+#undef X
+    };
+
+    struct RegionMetrics {
+        // The number of times a weighted handle on this thread ran out of weight and had to
+        // submit a real increment to the ledger.
+        size_t weight_refill_count = 0;
+
+        // The number of transactions that overflowed the ledger, and the operations that were spilled.
+        size_t overflow_count = 0;
+        size_t spilled_count  = 0;
+
+        // The number of operations folded away by the combining cache before they reached the ledger.
+        size_t combined_count = 0;
+
+        // The number of objects handed to the finalizer.
+        size_t finalized_count = 0;
+
+        // The number of objects bound to this region.
+        size_t bound_count = 0;
+
+        // The number of cycles asked for early because dropped objects held too many bytes.
+        size_t pressure_start_count = 0;
+
+        // The number of retired allocations that have been freed.
+        size_t retired_count = 0;
+
+        // The number of operations applied here with `Config::local_operations`, and of the objects
+        // that died from them.
+        size_t local_count          = 0;
+        size_t local_released_count = 0;
+
+        // The number of operations on `ShardedReferencePolicy` handles that were absorbed by a shard,
+        // and the number of shards that have been taken.
+        size_t sharded_count = 0;
+        size_t shard_count   = 0;
+    };
+
+    class Region {
+    public:
+        using State = RegionState;
+        using Phase = RegionPhase;
+        using Cycle = Sequence;
+        using Epoch = Sequence;
+        using Metrics = RegionMetrics;
+
+        // The finalizer is used for objects this region bound even after it has left, so it must
+        // outlive the region. See `ObjectFinalizer`.
+        Region(Domain& domain, ObjectFinalizer& finalizer);
+        ~Region();
+
+        Region(Region&&) = delete;
+        Region(const Region&) = delete;
+        Region& operator=(Region&&) = delete;
+        Region& operator=(const Region&) = delete;
+
+        RegionId id() const;
+
+        State state() const;
+        Phase phase() const;
+        Cycle cycle() const;
+
+        // Counts calls to `step`, which is how long a `Borrow` stays valid.
+        Epoch epoch() const;
+
+        [[nodiscard]]
+        const Metrics& metrics() const;
+
+        // Call step when this becomes readable. This is never readable with `WakeupPolicy::FUTEX`,
+        // so only block in step then.
+        int file_descriptor();
+
+        void stop();
+        void step(bool non_blocking);
+
+        // Returns true if `step` has anything to do, without making a system call. Non-blocking
+        // steps return straight away when it doesn't, so loops can call them as often as they like.
+        [[nodiscard]]
+        bool has_work() const;
+
+        // Lets a coroutine on this region's thread wait for the region instead of spinning on `step`.
+        // It is resumed from within `step`, once the LEAVE message it is waiting for has arrived.
+        class Awaiter {
+        public:
+            [[nodiscard]]
+            bool await_ready() const;
+            void await_suspend(std::coroutine_handle<> handle);
+            void await_resume() const noexcept {}
+
+        private:
+            friend class Region;
+
+            Awaiter(Region& region, Cycle cycle, bool quiesce)
+                : region_(region)
+                , cycle_(cycle)
+                , quiesce_(quiesce)
+            {
+            }
+
+            Region& region_;
+            Cycle   cycle_;
+            bool    quiesce_;
+        };
+
+        // Resumes once a cycle that operations written from now on take part in has finished.
+        [[nodiscard]]
+        Awaiter next_cycle();
+
+        // Resumes once everything written so far has been applied, and our garbage finalized.
+        [[nodiscard]]
+        Awaiter quiesce();
+
+        // Free memory that isn't an `Object` once every region has taken part in a cycle that started
+        // after this call. Readers of lock-free containers can't hold on to a pointer past their next
+        // step, so this takes the place of hazard pointers without readers having to publish anything.
+        //
+        // NOTE: Every thread that reads the memory must run a region, like threads that copy handles.
+        //       Memory retired by finalizers while the region is shutting down is leaked.
+        //
+        void retire(void* pointer, void (*deleter)(void*));
+
+        template<typename T>
+        void retire(T* pointer) {
+            retire(static_cast<void*>(pointer), [](void* retired) { delete static_cast<T*>(retired); });
+        }
+
+    private:
+        template<typename T, typename Policy>
+        friend class Handle;
+        template<typename T>
+        friend class Ref;
+        friend class Object;
+        friend class RegionPool;
+
+        // Become the region on this thread, and take part in cycles until ours matches the domain's.
+        void attach_thread();
+        void join();
+
+        // Stop and let go of this thread, keeping the ledger and connection so `adopt` can reuse them.
+        // An adopted region joins under a new id, like a newly constructed one.
+        void park();
+        void adopt();
+
+        void bind_object(Object& object, size_t byte_cost = 0);
+
+        MANTLE_HOT void start_increment_operation(Object& object, Operation operation);
+        MANTLE_HOT void start_decrement_operation(Object& object, Operation operation);
+
+        // Like the above, but for many operations of either type at once.
+        MANTLE_HOT void start_operations(std::span<const Operation> operations);
+
+        // Count an operation of a `ShardedReferencePolicy` handle against our shard of the object.
+        MANTLE_HOT void start_sharded_operation(Operation operation);
+
+        // Give back shards we haven't used since the last cycle. Objects can only die once every region
+        // has given its shard back. This runs while the domain waits for us to submit, so a shard whose
+        // operations don't fit is kept until the next transaction.
+        void reconcile_shards();
+
+        // Write out the delta of a shard that has grown too large. This only waits for room once the
+        // copies it holds could outgrow the shard's weight, and never with the delta taken out of it.
+        MANTLE_COLD void flush_shard(Object& object);
+
+        // Returns true if we hold shards, which need cycles to be given back.
+        bool has_shards() const;
+
+        // Write a delta as operations of up to the largest weight, as far as there is room for them
+        // without waiting. Returns what is left to write.
+        [[nodiscard]]
+        int64_t try_write_delta(Object& object, int64_t delta);
+
+        // Add an operation to the current transaction, making room for it if needed.
+        MANTLE_HOT void write_operation(Operation operation);
+
+        // Like the above, but returns false instead of waiting for room.
+        [[nodiscard]]
+        bool try_write_operation(Operation operation);
+
+        MANTLE_COLD void flush_operation(Operation operation);
+
+        // Returns true if the object may have been bound with a byte cost. This only looks at the filter.
+        bool has_byte_cost(const Object& object) const;
+
+        // Any decrement may be the last one, so the object's bytes are counted, once, until its latest
+        // decrement has been applied.
+        void drop_byte_cost(const Object& object);
+
+        // Like the above, for the decrements among `operations`.
+        void drop_byte_costs(std::span<const Operation> operations);
+
+        // Write out the net deltas of the combining cache, as far as the ledger has room for them.
+        void flush_combined_operations();
+
+        // Returns true if the combining cache holds operations that haven't been written out yet.
+        bool has_combined_operations() const;
+
+        // Returns true if spilled operations haven't all been submitted yet.
+        bool has_spilled_operations() const;
+
+        // Apply the increments committed this cycle and the decrements committed two cycles ago to our
+        // own objects. This runs when RETIRE arrives, since the domain doesn't touch them again until
+        // we've submitted next, and follows the same schedule as the domain.
+        void apply_local_operations();
+
+        // Returns true if operations on our own objects haven't all been applied yet.
+        bool has_local_operations() const;
+
+        // Returns true if threads without a region have written operations this region can take over.
+        bool has_fallback_operations() const;
+
+        // Returns true if `Ref`s can be used on this thread.
+        bool has_write_barriers() const;
+
+        // Returns true if `Ref` operations haven't all been submitted yet.
+        bool has_barrier_operations() const;
+
+        // Returns true if there's a reason to start a cycle, once the previous one is over.
+        bool wants_cycle() const;
+
+        // Returns true if operations written here or memory retired here are still waiting on a cycle.
+        bool has_pending_work() const;
+
+        // Returns true if nothing written here is in flight, and there's no garbage left to finalize.
+        bool is_quiescent() const;
+
+        // Returns true if a coroutine waiting for this could be resumed now.
+        bool is_awaited(Cycle cycle, bool quiesce) const;
+
+        // Resume coroutines waiting on us, once they can be. Stopping resumes all of them.
+        void resume_awaiters(bool stopped);
+
+        // Returns true if retired memory is waiting for other regions to move on.
+        bool has_retired_memory() const;
+
+        // Free the retired memory that no region can be using anymore.
+        void free_retired_memory();
+
+    private:
+        friend class Domain;
+
+        const OperationLedger& ledger() const;
+
+        Endpoint& domain_endpoint();
+        Endpoint& region_endpoint();
+
+    private:
+        void handle_message(const Message& message);
+
+        void transition(State next_state);
+        void transition(Phase next_phase);
+        void transition(Cycle next_cycle);
+
+        // Returns true if the current transaction is full enough that the domain shouldn't hold back the next cycle.
+        bool is_ledger_pressured() const;
+
+        // Returns true if objects dropped in transactions that haven't been applied yet hold enough bytes
+        // that the domain shouldn't hold back the next cycle either.
+        bool is_memory_pressured() const;
+
+        // Returns true if either of the above holds.
+        bool is_pressured() const;
+        void send_start(bool urgent);
+
+        // Returns true if there is garbage waiting to be finalized.
+        bool has_garbage() const;
+
+        // Copy garbage out of the domain's buffers so it can be finalized later.
+        void stash_garbage();
+        void finalize_garbage();
+        void finalize_objects(ObjectGroup group, std::span<Object*> objects);
+
+    private:
+        static constexpr State INITIAL_STATE = State::RUNNING;
+        static constexpr Phase INITIAL_PHASE = Phase::RECV_ENTER;
+        static constexpr Cycle INITIAL_CYCLE = 0;
+
+        static constexpr size_t PARTITION_HISTORY = 4;
+        using PartitionHistory = std::array<OperationPartition, PARTITION_HISTORY>;
+
+        static constexpr size_t SPILL_HISTORY = 4;
+        using SpillHistory = std::array<OperationSpill, SPILL_HISTORY>;
+
+        static constexpr size_t DROPPED_BYTES_HISTORY = 4;
+        using DroppedBytesHistory = std::array<size_t, DROPPED_BYTES_HISTORY>;
+
+        struct ByteCost {
+            size_t   bytes = 0;
+            bool     is_dropped = false;
+            Sequence dropped_cursor = 0; // The history entry the bytes were last counted in.
+        };
+
+        static constexpr size_t BYTE_COST_FILTER_BITS = 4096;
+        using ByteCostFilter = std::array<uint64_t, BYTE_COST_FILTER_BITS / 64>;
+
+        static size_t to_byte_cost_filter_bit(const Object& object);
+
+        Domain&                     domain_;
+        RegionId                    id_;
+
+        State                       state_;
+        Phase                       phase_;
+        Cycle                       cycle_;
+        Epoch                       epoch_;
+        size_t                      depth_;
+
+        ObjectFinalizer&            finalizer_;
+        std::optional<size_t>       numa_node_; // Where memory used by this thread is placed, if anywhere.
+        OperationLedger             ledger_;
+        OperationCombiner           combiner_; // Disabled unless `Config::region_combining_cache_size` is set.
+        std::optional<Ledger>       barrier_ledger_; // Only with the write barrier backend.
+        ReferenceCountTable*        reference_count_table_; // Set by the domain, if counts are kept out of objects.
+        size_t                      urgent_start_entries_; // Ask for an urgent cycle below this many writable entries.
+        bool                        sent_urgent_start_;
+
+        // Bytes held by objects dropped in recent transactions, indexed like the partitions below. A
+        // threshold of zero disables this, so objects aren't touched when their handles are dropped.
+        size_t                      pressure_bytes_;
+        size_t                      dropped_bytes_; // The sum of the history.
+        Sequence                    dropped_cursor_;
+        DroppedBytesHistory         dropped_bytes_history_;
+
+        // Costs are kept here rather than in the objects, so they don't grow. The filter lets drops of
+        // objects without a cost skip the lookup. Objects dropped on other threads aren't counted.
+        std::unordered_map<const Object*, ByteCost> byte_costs_;
+        ByteCostFilter              byte_cost_filter_;
+
+        // Partitions of recently committed transactions. These must outlive the cycles that submit them.
+        bool                        partition_operations_;
+        Sequence                    partition_cursor_;
+        PartitionHistory            partitions_;
+
+        // Overflow buffers of recent transactions, indexed like the partitions above. Operations drained
+        // from the fallback ledger go in here too.
+        bool                        ledger_overflow_;
+        FallbackLedger*             fallback_ledger_;
+        bool                        spill_operations_; // Set with either of the above.
+        Sequence                    spill_cursor_;
+        SpillHistory                spills_;
+
+        // Each shard holds a reference of `SHARD_WEIGHT` in the object's count, which covers references
+        // that were copied here but not written yet. The delta is written out before it can reach that.
+        struct Shard {
+            int64_t                 delta   = 0;
+            bool                    touched = true;
+        };
+
+        static constexpr int64_t SHARD_WEIGHT = int64_t{1} << Operation::EXPONENT_MAX;
+        static constexpr int64_t SHARD_LIMIT  = SHARD_WEIGHT / 2;
+
+        std::unordered_map<Object*, Shard> shards_;
+
+        // Operations on our own objects of recent transactions, indexed by transaction like the spills.
+        bool                        apply_local_operations_;
+        Sequence                    local_cursor_;
+        SpillHistory                local_operations_;
+        std::vector<Object*>        local_garbage_;
+
+        // The groups bound and released since the last submission, with `Config::heap_census_interval`.
+        // The previous one is read by our controller until the next cycle starts.
+        bool                            heap_census_;
+        Sequence                        heap_census_cursor_;
+        std::array<HeapCensusDelta, 2>  heap_census_deltas_;
+
+        bool                        drives_domain_; // Set on the thread that steps an embedded domain.
+
+        struct AwaitingCoroutine {
+            Cycle                   cycle;
+            bool                    quiesce;
+            std::coroutine_handle<> handle;
+        };
+
+        std::vector<AwaitingCoroutine> awaiting_;
+
+        struct RetiredMemory {
+            void*                   pointer;
+            void                    (*deleter)(void*);
+            Cycle                   cycle; // Freed once this cycle has been submitted by every region.
+        };
+
+        std::vector<RetiredMemory>  retired_memory_; // Cycle ordered.
+
+        std::optional<ObjectGroups> garbage_;
+        std::vector<Object*>        garbage_pile_;
+        std::vector<Object*>        garbage_pile_round_; // The part of the pile being finalized.
+        std::vector<Object*>        garbage_backlog_; // Group ordered, carried over between steps.
+        size_t                      garbage_backlog_offset_;
+        size_t                      garbage_cursor_; // How far finalization of `garbage_` has got, in groups or objects.
+
+        Connection                  connection_;
+        Metrics                     metrics_;
+
+    public:
+        static Region*& thread_local_instance() {
+            thread_local Region* instance = nullptr;
+            return instance;
+        }
+    };
+
+    inline void Region::write_operation(Operation operation) {
+        if (UNLIKELY(apply_local_operations_) && (operation.object()->region_id() == id_)) {
+            local_operations_[local_cursor_ % SPILL_HISTORY].write(operation);
+            return;
+        }
+
+        // Fast-path: The operation can be added to the current transaction.
+        if (LIKELY(ledger_.write(operation))) {
+            return;
+        }
+
+        flush_operation(operation);
+    }
+
+    inline size_t Region::to_byte_cost_filter_bit(const Object& object) {
+        uintptr_t ptr;
+        const Object* address = &object;
+        memcpy(&ptr, &address, sizeof(ptr));
+        return ((ptr >> 4) * 0x9e3779b97f4a7c15ull) >> (64 - log2_floor(BYTE_COST_FILTER_BITS));
+    }
+
+    inline bool Region::has_byte_cost(const Object& object) const {
+        const size_t bit = to_byte_cost_filter_bit(object);
+        return byte_cost_filter_[bit / 64] & (uint64_t{1} << (bit % 64));
+    }
+
+    inline void Region::start_increment_operation(Object&, Operation operation) {
+        assert(state_ != State::STOPPED);
+        assert(operation.type() == OperationType::INCREMENT);
+
+        if (combiner_.is_enabled()) {
+            combiner_.write(operation, [this](Operation evicted) { write_operation(evicted); return true; });
+            return;
+        }
+
+        write_operation(operation);
+    }
+
+    inline void Region::start_decrement_operation(Object& object, Operation operation) {
+        assert(state_ != State::STOPPED);
+        assert(operation.type() == OperationType::DECREMENT);
+
+        if (UNLIKELY(pressure_bytes_) && has_byte_cost(object)) {
+            drop_byte_cost(object);
+        }
+
+        if (combiner_.is_enabled()) {
+            combiner_.write(operation, [this](Operation evicted) { write_operation(evicted); return true; });
+            return;
+        }
+
+        write_operation(operation);
+    }
+
+    inline void Region::start_operations(std::span<const Operation> operations) {
+        assert(state_ != State::STOPPED);
+
+        if (UNLIKELY(pressure_bytes_)) {
+            drop_byte_costs(operations);
+        }
+
+        if (combiner_.is_enabled()) {
+            for (const Operation operation: operations) {
+                combiner_.write(operation, [this](Operation evicted) { write_operation(evicted); return true; });
+            }
+            return;
+        }
+
+        if (UNLIKELY(apply_local_operations_)) {
+            for (const Operation operation: operations) {
+                write_operation(operation);
+            }
+            return;
+        }
+
+        while (true) {
+            // Fast-path: The operations can all be added to the current transaction.
+            operations = operations.subspan(ledger_.write(operations));
+            if (LIKELY(operations.empty())) {
+                return;
+            }
+
+            // Make room, then carry on with the rest.
+            flush_operation(operations.front());
+            operations = operations.subspan(1);
+        }
+    }
+
+    inline void Object::start_increment_operation(Operation operation) {
+        assert(operation.type() == OperationType::INCREMENT);
+
+        if (Region* region = Region::thread_local_instance(); LIKELY(region)) {
+            region->start_increment_operation(*this, operation);
+        }
+        else if (FallbackLedger* fallback_ledger = FallbackLedger::instance()) {
+            fallback_ledger->write(operation);
+        }
+        else {
+            // Leak.
+        }
+    }
+
+    inline void Object::start_decrement_operation(Operation operation) {
+        assert(operation.type() == OperationType::DECREMENT);
+
+        if (Region* region = Region::thread_local_instance(); LIKELY(region)) {
+            region->start_decrement_operation(*this, operation);
+        }
+        else if (FallbackLedger* fallback_ledger = FallbackLedger::instance()) {
+            fallback_ledger->write(operation);
+        }
+        else {
+            // Leak.
+        }
+    }
+
+    inline void Region::start_sharded_operation(Operation operation) {
+        assert(state_ != State::STOPPED);
+
+        Object* object = operation.mutable_object();
+        assert(object);
+
+        auto it = shards_.find(object);
+        if (UNLIKELY(it == shards_.end())) {
+            // Take the weight before the shard exists, so that a step while making room for it can't
+            // give the shard back before its weight has been written.
+            write_operation(make_increment_operation(object, Operation::EXPONENT_MAX));
+            it = shards_.try_emplace(object).first;
+            metrics_.shard_count += 1;
+        }
+
+        Shard& shard = it->second;
+        shard.delta += operation.value();
+        shard.touched = true;
+        metrics_.sharded_count += 1;
+
+        if (UNLIKELY((shard.delta >= SHARD_LIMIT) || (shard.delta <= -SHARD_LIMIT))) {
+            flush_shard(*object);
+        }
+    }
+
+    std::string_view to_string(RegionState state);
+    std::string_view to_string(RegionPhase phase);
+
+}
+
+
+// include/mantle/region_controller.h
+
+
+#define MANTLE_REGION_CONTROLLER_ACTIONS(X) \
+    X(SEND)                                 \
+    X(RECEIVE)                              \
+    X(BARRIER_ANY)                          \
+    X(BARRIER_ALL)                          \
+
+#define MANTLE_REGION_CONTROLLER_PHASES(X)  \
+    X(START,          RECEIVE)              \
+    X(START_BARRIER,  BARRIER_ANY)          \
+    X(ENTER,          SEND)                 \
+    X(SUBMIT,         RECEIVE)              \
+    X(SUBMIT_BARRIER, BARRIER_ALL)          \
+    X(RETIRE_BARRIER, BARRIER_ALL)          \
+    X(RETIRE,         SEND)                 \
+    X(LEAVE,          SEND)                 \
+
+#define MANTLE_REGION_CONTROLLER_STATES(X) \
+    X(STARTING)                            \
+    X(RUNNING)                             \
+    X(STOPPING)                            \
+    X(STOPPED)                             \
+    X(SHUTDOWN)                            \
+    X(VACANT)                              \
+
+namespace mantle {
+
+    class Region;
+    class RegionController;
+
+    using RegionControllerGroup = std::vector<std::unique_ptr<RegionController>>;
+
+    // What we are doing in this part of the cycle.
+    enum class RegionControllerAction {
+#define X(MANTLE_REGION_CONTROLLER_ACTION)                                 \
+        MANTLE_REGION_CONTROLLER_ACTION,                                   \
+
+        MANTLE_REGION_CONTROLLER_ACTIONS(X)
+#undef X
+    };
+
+    // Which part of the cycle we are in.
+    enum class RegionControllerPhase {
+#define X(MANTLE_REGION_CONTROLLER_PHASE, MANTLE_REGION_CONTROLLER_ACTION) \
+        MANTLE_REGION_CONTROLLER_PHASE,                                    \
+
+        MANTLE_REGION_CONTROLLER_PHASES(X)
+#undef X
+    };
+
+    // High level state related to starting and stopping.
+    enum class RegionControllerState {
+#define X(MANTLE_REGION_CONTROLLER_STATE) \
+        MANTLE_REGION_CONTROLLER_STATE,   \
+
+        MANTLE_REGION_CONTROLLER_STATES(X)
+#undef X
+    };
+
+    constexpr size_t REGION_CONTROLLER_ACTION_COUNT = 0
+#define X(MANTLE_REGION_CONTROLLER_ACTION)                                 \
+        + 1                                                                \
+
+        MANTLE_REGION_CONTROLLER_ACTIONS(X)
+#undef X
+    ;
+
+    constexpr size_t REGION_CONTROLLER_PHASE_COUNT = 0
+#define X(MANTLE_REGION_CONTROLLER_PHASE, MANTLE_REGION_CONTROLLER_ACTION) \
+        + 1                                                                \
+
+        MANTLE_REGION_CONTROLLER_PHASES(X)
+#undef X
+    ;
+
+    constexpr size_t REGION_CONTROLLER_STATE_COUNT = 0
+#define X(MANTLE_REGION_CONTROLLER_STATE) \
+        + 1                               \
+
+        MANTLE_REGION_CONTROLLER_STATES(X)
+#undef X
+    ;
+
+    // A survey of the states of controllers and the actions they are trying to take.
+    //
+    // The domain keeps one up to date as its controllers transition, so checking a barrier doesn't
+    // walk every controller. It only holds counts, so taking a snapshot of it is cheap too.
+    //
+    class RegionControllerCensus {
+    public:
+        using State = RegionControllerState;
+        using Phase = RegionControllerPhase;
+        using Cycle = Sequence;
+        using Action = RegionControllerAction;
+
+        RegionControllerCensus();
+        explicit RegionControllerCensus(const RegionController& controller);
+        explicit RegionControllerCensus(const RegionControllerGroup& controllers);
+
+        void add(const RegionController& controller);
+        void add(const RegionControllerGroup& controllers);
+        void add(const RegionControllerCensus& census);
+
+        // Move a controller that has been added from one count to another as it transitions.
+        void update(State state, State next_state);
+        void update(Phase phase, Phase next_phase);
+        void update(Cycle cycle, Cycle next_cycle);
+        void update_urgent(bool urgent, bool next_urgent);
+
+        size_t count() const;
+
+        Cycle min_cycle() const;
+        Cycle max_cycle() const;
+
+        bool any(State state) const;
+        bool all(State state) const;
+
+        bool any(Phase phase) const;
+        bool all(Phase phase) const;
+ 
+        bool any(Action action) const;
+        bool all(Action action) const;
+
+        // Returns true if any controller's region asked for the cycle it is waiting on to start right away.
+        bool any_urgent() const;
+
+        auto operator<=>(const RegionControllerCensus&) const noexcept = default;
+
+    private:
+        struct CycleCount {
+            Cycle  cycle = 0;
+            size_t count = 0;
+
+            auto operator<=>(const CycleCount&) const noexcept = default;
+        };
+
+        // Controllers that take part in cycles are at most one apart, and those that haven't started
+        // yet are all at the initial cycle, so only a few distinct cycles are ever counted.
+        static constexpr size_t CYCLE_COUNT_CAPACITY = 8;
+
+        void add(Cycle cycle, size_t count = 1);
+        void remove(Cycle cycle);
+
+    private:
+        size_t                                             count_;
+        size_t                                             cycle_count_size_;
+        std::array<CycleCount, CYCLE_COUNT_CAPACITY>       cycle_counts_; // Ascending, unused ones zeroed.
+        std::array<size_t, REGION_CONTROLLER_STATE_COUNT>  state_counts_;
+        std::array<size_t, REGION_CONTROLLER_PHASE_COUNT>  phase_counts_;
+        std::array<size_t, REGION_CONTROLLER_ACTION_COUNT> action_counts_;
+        size_t                                             urgent_count_;
+    };
+
+    struct RegionControllerMetrics {
+        const OperationGrouper::Metrics& operation_grouper;
+        const ObjectGrouper::Metrics& object_grouper;
+        size_t increment_count;
+        size_t decrement_count;
+
+        // The number of objects whose reference counts were updated, and the time spent doing it.
+        size_t                   applied_count;
+        std::chrono::nanoseconds apply_duration;
+
+        // The number of cycles completed, and the time spent in each phase of them.
+        size_t                                                              cycle_count;
+        std::array<std::chrono::nanoseconds, REGION_CONTROLLER_PHASE_COUNT> phase_durations;
+
+        // Ledger entries held by the transactions submitted in the last cycle, out of its capacity.
+        size_t ledger_occupancy;
+        size_t ledger_capacity;
+
+        // The number of objects the region had finalized when it last submitted.
+        size_t finalized_count;
+
+        // The number of objects the region had bound when it last submitted, and how many of its
+        // objects have died since, here or on the region itself. Once a region has left, its slot is
+        // reused when these match.
+        size_t bound_count;
+        size_t released_count;
+        size_t local_released_count;
+
+        RegionControllerMetrics(
+            const OperationGrouper& operation_grouper,
+            const ObjectGrouper& object_grouper
+        )
+            : operation_grouper(operation_grouper.metrics())
+            , object_grouper(object_grouper.metrics())
+            , increment_count(0)
+            , decrement_count(0)
+            , applied_count(0)
+            , apply_duration(std::chrono::nanoseconds::zero())
+            , cycle_count(0)
+            , phase_durations{}
+            , ledger_occupancy(0)
+            , ledger_capacity(0)
+            , finalized_count(0)
+            , bound_count(0)
+            , released_count(0)
+            , local_released_count(0)
+        {
+        }
+
+        [[nodiscard]]
+        double applied_objects_per_second() const {
+            if (apply_duration.count() <= 0) {
+                return 0.0;
+            }
+
+            return static_cast<double>(applied_count) / std::chrono::duration<double>(apply_duration).count();
+        }
+    };
+
+    class RegionController {
+    public:
+        using State   = RegionControllerState;
+        using Phase   = RegionControllerPhase;
+        using Cycle   = Sequence;
+        using Action  = RegionControllerAction;
+        using Metrics = RegionControllerMetrics;
+
+        RegionController(
+            RegionId region_id,
+            RegionControllerGroup& controllers,
+            const OperationLedger& ledger,
+            const Config& config,
+            ReferenceCountTable* reference_count_table = nullptr
+        );
+
+        RegionController(RegionController&&) = delete;
+        RegionController(const RegionController&) = delete;
+        RegionController& operator=(RegionController&&) = delete;
+        RegionController& operator=(const RegionController&) = delete;
+
+        RegionId region_id() const;
+        const Metrics& metrics() const;
+
+        // Our region's objects by group, with `Config::heap_census_interval`. Null otherwise.
+        [[nodiscard]]
+        const HeapCensus* heap_census() const;
+
+        bool is_quiescent() const;
+
+        State state() const;
+        Phase phase() const;
+        Cycle cycle() const;
+        Action action() const;
+
+        void start(Cycle cycle);
+        void stop();
+
+        // Returns true once the region has left. The controller keeps taking part in cycles, so the
+        // region's objects that are still alive keep being counted, and the domain finalizes them.
+        [[nodiscard]]
+        bool is_detached() const;
+
+        // Returns true if the region has left and nothing it owned is left alive or in flight.
+        [[nodiscard]]
+        bool is_drained() const;
+
+        // Mark a drained controller as free to manage a new region, and hand it to that region.
+        void vacate();
+        void attach(const OperationLedger& ledger, Cycle cycle);
+
+        // Start a cycle on behalf of the region, as if it had sent a START message.
+        void request_start();
+
+        // Returns true if the region asked for the cycle it is waiting on to start right away.
+        [[nodiscard]]
+        bool is_start_urgent() const;
+
+        // Returns true if operations the region submitted recently are still making their way
+        // through the pipeline, and more cycles are needed before they are all applied.
+        [[nodiscard]]
+        bool has_pending_operations() const;
+
+        // These do the heavy lifting of the SUBMIT_BARRIER and RETIRE_BARRIER phases when
+        // `Config::domain_worker_count` is non-zero. The domain calls them from its worker pool
+        // once every controller has reached the barrier, before synchronizing.
+        //
+        // Routing only touches the inbox slot belonging to `worker_index` in other controllers, and
+        // applying only touches objects owned by this controller's region, so routing can run in
+        // parallel across controllers and so can applying.
+        //
+        // With `Config::pipeline_cycles` both happen on the way out of SUBMIT_BARRIER. Applying reads
+        // what was routed in the previous cycle, which was set aside when it retired, so it can also
+        // run in parallel with routing.
+        //
+        void route_operations(size_t worker_index);
+        void apply_operations();
+
+        std::optional<Message> send_message();
+        void receive_message(const Message& message);
+        void synchronize(const RegionControllerCensus& census);
+
+        // Add this controller to the census and keep it up to date from now on. The census has to
+        // outlive the controller.
+        void track(RegionControllerCensus& census);
+
+    private:
+        void transition(State next_state);
+        void transition(Phase next_phase);
+        void transition(Cycle next_cycle);
+        void set_start_urgent(bool urgent);
+
+        // The phase that follows the current one. RETIRE_BARRIER is skipped when cycles are pipelined.
+        [[nodiscard]]
+        Phase next_phase() const;
+
+        // Set aside everything routed to us so far, to be applied in the next cycle.
+        void retire_operations();
+
+        template<typename Sink>
+        size_t route_operations(OperationType type, SequenceRange range, Sink&& sink);
+
+        template<typename Sink>
+        size_t route_operations(OperationType type, const OperationPartition& partition, Sink&& sink);
+
+        template<typename Sink>
+        size_t route_operations(std::span<const Operation> operations, Sink&& sink);
+
+        // Route everything the region submitted this cycle, recording it if there is a recorder.
+        template<typename Sink>
+        void route_submitted_operations(Sink&& sink);
+
+        template<typename Sink>
+        void route_committed_operations(Sink&& sink);
+
+        // Tell the recorder, if there is one, that one of our objects has died.
+        void record_release(const Object& object);
+
+        // Add the objects applied to in this cycle to the heap census, if it is a sampled one.
+        void sample_heap_census();
+
+        [[nodiscard]]
+        bool has_worker_pool() const;
+
+        [[nodiscard]]
+        bool is_pipelined() const;
+
+        // Whether operations still grouped in the cache should be applied anyway.
+        [[nodiscard]]
+        bool is_flush_forced() const;
+
+    private:
+        // Operations routed to this controller by one domain worker, and those set aside to be applied.
+        struct alignas(CACHE_LINE_SIZE) Inbox {
+            std::vector<Operation> operations;
+            std::vector<Operation> retired_operations;
+        };
+
+        RegionId               region_id_;
+        RegionControllerGroup& controllers_;
+        const OperationLedger* ledger_;
+        const Config&          config_;
+        ReferenceCountTable*   reference_count_table_; // Where our objects' counts are kept, if not in the objects.
+        RegionControllerCensus* census_; // Kept up to date with our transitions, if set.
+
+        State                  state_;
+        Phase                  phase_;
+        Cycle                  cycle_;
+        bool                   start_urgent_;
+        std::optional<Cycle>   active_cycle_; // The last cycle that the region submitted operations in.
+
+        std::chrono::steady_clock::time_point phase_start_;
+
+        SequenceRange             submitted_increments_;
+        SequenceRange             submitted_decrements_;
+        const OperationPartition* submitted_increment_partition_;
+        const OperationPartition* submitted_decrement_partition_;
+        const OperationSpill*     submitted_increment_spill_;
+        const OperationSpill*     submitted_decrement_spill_;
+        const WriteBarrier*       submitted_barrier_;
+
+        std::vector<Inbox>     inboxes_;
+        OperationGrouper       operation_grouper_;
+        ObjectGrouper          object_grouper_;
+
+        std::vector<ReferenceCountTable::Slot> released_slots_; // Handed back to the table after each apply.
+
+        std::optional<HeapCensus> heap_census_;
+
+        Metrics                metrics_;
+    };
+
+    // Synchronizes a group of region controllers.
+    RegionControllerCensus synchronize(RegionControllerGroup& controllers);
+
+    // Returns true if synchronizing against `census` would move any of the controllers counted in `cluster`.
+    [[nodiscard]]
+    bool can_synchronize(const RegionControllerCensus& cluster, const RegionControllerCensus& census);
+
+    std::string_view to_string(RegionControllerState state);
+    std::string_view to_string(RegionControllerPhase phase);
+    std::string_view to_string(RegionControllerAction action);
+
+}
+
+
+// include/mantle/handle.h
+
+
+namespace mantle {
+
+    // Every copy of a handle is paired with an increment and a decrement in the ledger.
+    struct CountedReferencePolicy {
+        static constexpr bool WEIGHTED = false;
+        static constexpr bool SHARDED  = false;
+    };
+
+    // A copy splits the handle's weight in half and the new handle takes the other half, so
+    // copies stay local to the handle. The ledger is only touched when the weight runs out.
+    // This is a good fit for types that are copied far more often than they are dropped.
+    struct WeightedReferencePolicy {
+        static constexpr bool WEIGHTED = true;
+        static constexpr bool SHARDED  = false;
+    };
+
+    // Copies and drops are counted against the region's shard of the object instead of going to the
+    // ledger. The shard holds a reference of its own, and only net deltas are written, so objects that
+    // every region touches all the time, like a global config, don't load their owner's controller.
+    // Shards are given back once a region hasn't used one for a cycle, so objects die a cycle later.
+    //
+    // NOTE: Handles can't be converted to or from other policies, since their references may only
+    //       exist in a shard.
+    //
+    struct ShardedReferencePolicy {
+        static constexpr bool WEIGHTED = false;
+        static constexpr bool SHARDED  = true;
+    };
+
+    using DefaultReferencePolicy = std::conditional_t<
+        ENABLE_WEIGHTED_REFERENCE_COUNTING,
+        WeightedReferencePolicy,
+        CountedReferencePolicy
+    >;
+
+    template<typename T, typename Policy = DefaultReferencePolicy>
+    class Handle;
+
+    template<typename Policy = DefaultReferencePolicy, typename T>
+    Handle<T, Policy> make_handle(T& object) noexcept;
+
+    // Like the above, but with a rough count of the bytes that are freed once the object is finalized.
+    // See `Config::cycle_pressure_bytes`.
+    template<typename Policy = DefaultReferencePolicy, typename T>
+    Handle<T, Policy> make_handle(T& object, size_t byte_cost) noexcept;
+
+    // Return a handle to an object that outlives every region, like a `static` singleton. Copies and
+    // drops of it never submit any operations, and it is never finalized. The object is left unbound,
+    // so it must never be passed to `make_handle`.
+    template<typename Policy = DefaultReferencePolicy, typename T>
+    Handle<T, Policy> make_immortal_handle(T& object) noexcept;
+
+    // The handles are taken from `clones`, so vectors of handles can be passed as they are.
+    template<typename T, typename Policy>
+    void clone_handles(std::type_identity_t<std::span<const Handle<T, Policy>>> handles, std::vector<Handle<T, Policy>>& clones);
+
+    template<typename T, typename Policy>
+    void drop_handles(std::span<Handle<T, Policy>> handles) noexcept;
+
+    template<typename T>
+    class Borrow;
+
+    template<typename T, typename Policy>
+    class AtomicHandle;
+
+    // This class holds a strong reference to an Object derived class instance.
+    // It implements a smart-pointer like interface and has semantics similar to std::shared_ptr.
+    //
+    // A handle at rest holds the decrement that is submitted when it is dropped. Immortal handles hold an
+    // increment instead, which is never submitted, so copies and drops only need to check the type bit.
+    // The null handle is an increment too, so that one check covers it as well.
+    //
+    // NOTE: The exponent is never saturated at rest. We can use the high bit for a flag if needed.
+    // TODO: Think about renaming this to `Ref<T>` for brevity.
+    //
+    // The policy only decides what happens when a handle is copied, and a copy follows the policy
+    // of the handle it was copied from. Handles with different policies all hold a decrement of
+    // some weight, so they can point to the same objects and be converted into one another freely.
+    //
+    template<typename T, typename Policy>
+    class Handle {
+        static_assert(std::is_base_of_v<Object, T>, "Object is a required base class");
+
+        template<typename U, typename OtherPolicy>
+        friend class Handle;
+
+        template<typename OtherPolicy, typename U>
+        friend Handle<U, OtherPolicy> make_handle(U& object) noexcept;
+
+        template<typename OtherPolicy, typename U>
+        friend Handle<U, OtherPolicy> make_handle(U& object, size_t byte_cost) noexcept;
+
+        template<typename OtherPolicy, typename U>
+        friend Handle<U, OtherPolicy> make_immortal_handle(U& object) noexcept;
+
+        template<typename U, typename OtherPolicy>
+        friend void clone_handles(std::type_identity_t<std::span<const Handle<U, OtherPolicy>>> handles, std::vector<Handle<U, OtherPolicy>>& clones);
+
+        template<typename U, typename OtherPolicy>
+        friend void drop_handles(std::span<Handle<U, OtherPolicy>> handles) noexcept;
+
+        template<typename U>
+        friend class Borrow;
+
+        template<typename U, typename OtherPolicy>
+        friend class AtomicHandle;
+
+        template<typename U>
+        friend class Channel;
+
+        template<typename U>
+        friend class MpscChannel;
+
+        // Bind an `Object` subclass to the local `Region` and return a managed `Handle` to it.
+        static Handle bind(T& object, const size_t byte_cost = 0) noexcept {
+            Region* region = Region::thread_local_instance();
+            assert(region);
+
+            region->bind_object(object, byte_cost);
+
+            return Handle(make_decrement_operation(&object, Operation::EXPONENT_MIN));
+        }
+
+        explicit Handle(Operation operation) noexcept
+            : operation_(operation)
+        {
+        }
+
+    public:
+        Handle() noexcept
+            : operation_(make_null_operation())
+        {
+        }
+
+        Handle(std::nullptr_t) noexcept
+            : Handle()
+        {
+        }
+
+        Handle(Handle&& other) noexcept
+            : operation_(make_null_operation())
+        {
+            std::swap(operation_, other.operation_);
+        }
+
+        template<typename U, typename OtherPolicy>
+        Handle(Handle<U, OtherPolicy>&& other) noexcept
+            : operation_(make_null_operation())
+        {
+            static_assert(Policy::SHARDED == OtherPolicy::SHARDED);
+            std::swap(operation_, other.operation_);
+        }
+
+        Handle(const Handle& other) noexcept
+            : Handle(other.copy_reference())
+        {
+        }
+
+        template<typename U, typename OtherPolicy>
+        Handle(const Handle<U, OtherPolicy>& other) noexcept
+            : operation_(other.copy_reference())
+        {
+            static_assert(std::is_base_of_v<T, U>);
+            static_assert(Policy::SHARDED == OtherPolicy::SHARDED);
+        }
+
+        Handle& operator=(Handle&& that) noexcept {
+            if (operation_.object() != that.operation_.object()) {
+                reset();
+                std::swap(operation_, that.operation_);
+            }
+
+            return *this;
+        }
+
+        template<typename U, typename OtherPolicy>
+        Handle& operator=(Handle<U, OtherPolicy>&& that) noexcept {
+            static_assert(std::is_base_of_v<T, U>);
+            static_assert(Policy::SHARDED == OtherPolicy::SHARDED);
+
+            if (operation_.object() != that.operation_.object()) {
+                reset();
+                std::swap(operation_, that.operation_);
+            }
+
+            return *this;
+        }
+
+        Handle& operator=(const Handle& that) noexcept {
+            if (operation_.object() != that.operation_.object()) {
+                reset();
+                operation_ = that.copy_reference();
+            }
+
+            return *this;
+        }
+
+        template<typename U, typename OtherPolicy>
+        Handle& operator=(const Handle<U, OtherPolicy>& that) noexcept {
+            static_assert(std::is_base_of_v<T, U>);
+            static_assert(Policy::SHARDED == OtherPolicy::SHARDED);
+
+            if (operation_.object() != that.operation_.object()) {
+                reset();
+                operation_ = that.copy_reference();
+            }
+
+            return *this;
+        }
+
+        ~Handle() noexcept {
+            reset();
+        }
+
+        T* get() noexcept {
+            return static_cast<T*>(operation_.mutable_object());
+        }
+
+        const T* get() const noexcept {
+            return static_cast<const T*>(operation_.object());
+        }
+
+        T* operator->() noexcept {
+            assert(*this);
+
+            return get();
+        }
+
+        const T* operator->() const noexcept {
+            assert(*this);
+
+            return get();
+        }
+
+        T& operator*() noexcept {
+            assert(*this);
+
+            return *get();
+        }
+
+        const T& operator*() const noexcept {
+            assert(*this);
+
+            return *get();
+        }
+
+        explicit operator bool() const noexcept {
+            return static_cast<bool>(operation_);
+        }
+
+        void reset() noexcept {
+            if (holds_reference()) {
+                Object* object = operation_.mutable_object();
+                assert(object);
+                start_decrement_operation(*object, operation_);
+            }
+
+            // Immortal handles are dropped without submitting anything.
+            operation_ = make_null_operation();
+        }
+
+        // Returns true if this is a handle to an object made with `make_immortal_handle`.
+        [[nodiscard]]
+        bool is_immortal() const noexcept {
+            return operation_ && !holds_reference();
+        }
+
+    public:
+        uint8_t weight() const {
+            return operation_.exponent();
+        }
+
+    private:
+        // Returns false for null and immortal handles, which have nothing to submit.
+        [[nodiscard]] MANTLE_HOT bool holds_reference() const noexcept {
+            return operation_.type() == OperationType::DECREMENT;
+        }
+
+        [[nodiscard]] MANTLE_HOT Operation copy_reference() const {
+            if (UNLIKELY(!holds_reference())) {
+                return operation_;
+            }
+
+            Object* object = operation_.mutable_object();
+            assert(object);
+
+            if constexpr (Policy::WEIGHTED) {
+                // Check if we need to gain additional weight.
+                if (UNLIKELY(weight() == 0)) {
+                    if (Region* region = Region::thread_local_instance(); LIKELY(region)) {
+                        region->metrics_.weight_refill_count += 1;
+                    }
+
+                    // NOTE: Submit the new operation before the old operation.
+                    object->start_increment_operation(make_increment_operation(object, Operation::EXPONENT_MAX));
+                    object->start_decrement_operation(operation_);
+                    operation_ = make_decrement_operation(object, Operation::EXPONENT_MAX);
+                }
+
+                // Split our weight in half by reducing the exponent by one.
+                operation_ = make_decrement_operation(object, weight() - 1);
+                return operation_;
+            }
+            else {
+                // Create a paired increment and decrement.
+                Operation increment = make_increment_operation(object);
+                Operation decrement = make_decrement_operation(object);
+
+                // The increment can be started immediately.
+                start_increment_operation(*object, increment);
+
+                // The decrement will be started once the new reference is dropped.
+                return decrement;
+            }
+        }
+
+        // The bulk functions below stage this many operations at a time before writing them out.
+        static constexpr size_t BULK_BATCH_SIZE = 32 * OperationBatch::SIZE;
+
+        // Without a region, sharded handles submit their operations like any other.
+        MANTLE_HOT static void start_increment_operation(Object& object, const Operation operation) noexcept {
+            if constexpr (Policy::SHARDED) {
+                if (Region* region = Region::thread_local_instance(); LIKELY(region)) {
+                    region->start_sharded_operation(operation);
+                    return;
+                }
+            }
+
+            object.start_increment_operation(operation);
+        }
+
+        MANTLE_HOT static void start_decrement_operation(Object& object, const Operation operation) noexcept {
+            if constexpr (Policy::SHARDED) {
+                if (Region* region = Region::thread_local_instance(); LIKELY(region)) {
+                    region->start_sharded_operation(operation);
+                    return;
+                }
+            }
+
+            object.start_decrement_operation(operation);
+        }
+
+        // Submit operations of either type, and handle them like single operations without a region.
+        static void start_operations(std::span<const Operation> operations) noexcept {
+            if (Region* region = Region::thread_local_instance(); LIKELY(region)) {
+                if constexpr (Policy::SHARDED) {
+                    for (const Operation operation: operations) {
+                        region->start_sharded_operation(operation);
+                    }
+                }
+                else {
+                    region->start_operations(operations);
+                }
+            }
+            else if (FallbackLedger* fallback_ledger = FallbackLedger::instance()) {
+                fallback_ledger->write(operations);
+            }
+            else {
+                // Leak.
+            }
+        }
+
+    private:
+        mutable Operation operation_;
+    };
+
+    template<typename Policy, typename T>
+    inline Handle<T, Policy> make_handle(T& object) noexcept {
+        return Handle<T, Policy>::bind(object);
+    }
+
+    template<typename Policy, typename T>
+    inline Handle<T, Policy> make_handle(T& object, const size_t byte_cost) noexcept {
+        return Handle<T, Policy>::bind(object, byte_cost);
+    }
+
+    template<typename Policy, typename T>
+    inline Handle<T, Policy> make_immortal_handle(T& object) noexcept {
+        assert(!object.is_managed());
+        return Handle<T, Policy>(make_increment_operation(&object));
+    }
+
+    // Append a copy of each handle to `clones`. This is the same as copying them one by one, but the
+    // increments are written to the ledger in bulk so there's a single bounds check per batch.
+    template<typename T, typename Policy>
+    void clone_handles(const std::type_identity_t<std::span<const Handle<T, Policy>>> handles, std::vector<Handle<T, Policy>>& clones) {
+        using HandleType = Handle<T, Policy>;
+
+        clones.reserve(clones.size() + handles.size());
+
+        // Weighted copies rarely touch the ledger, so there is nothing to batch.
+        if constexpr (Policy::WEIGHTED) {
+            clones.insert(clones.end(), handles.begin(), handles.end());
+        }
+        else {
+            std::array<Operation, HandleType::BULK_BATCH_SIZE> increments;
+
+            for (size_t offset = 0; offset < handles.size(); offset += increments.size()) {
+                const size_t count = std::min(increments.size(), handles.size() - offset);
+
+                size_t increment_count = 0;
+                for (const HandleType& handle: handles.subspan(offset, count)) {
+                    if (!handle.holds_reference()) {
+                        clones.push_back(HandleType(handle.operation_));
+                        continue;
+                    }
+
+                    Object* object = handle.operation_.mutable_object();
+
+                    increments[increment_count++] = make_increment_operation(object);
+                    clones.push_back(HandleType(make_decrement_operation(object)));
+                }
+
+                HandleType::start_operations({increments.data(), increment_count});
+            }
+        }
+    }
+
+    // Reset every handle. This is the same as resetting them one by one, but the decrements are
+    // written to the ledger in bulk.
+    template<typename T, typename Policy>
+    void drop_handles(const std::span<Handle<T, Policy>> handles) noexcept {
+        using HandleType = Handle<T, Policy>;
+
+        std::array<Operation, HandleType::BULK_BATCH_SIZE> decrements;
+        size_t decrement_count = 0;
+
+        for (HandleType& handle: handles) {
+            if (!handle.holds_reference()) {
+                handle.operation_ = make_null_operation();
+                continue;
+            }
+
+            decrements[decrement_count++] = std::exchange(handle.operation_, make_null_operation());
+            if (decrement_count == decrements.size()) {
+                HandleType::start_operations(decrements);
+                decrement_count = 0;
+            }
+        }
+
+        HandleType::start_operations({decrements.data(), decrement_count});
+    }
+
+    // A reference that borrows from a handle for a while and never touches the ledger. Objects only
+    // die once decrements have gone through a cycle, and this region can't finish one without calling
+    // `Region::step`, so whatever a live handle points to stays alive until then. That's how long a
+    // borrow is valid, which makes it a good fit for arguments that are only read during a request.
+    //
+    // NOTE: Builds with assertions check that borrows aren't used after the region has stepped.
+    //       Call `handle` to hold on to the object for longer. The epoch is recorded either way,
+    //       so the layout doesn't depend on `NDEBUG`.
+    //
+    template<typename T>
+    class Borrow {
+        static_assert(std::is_base_of_v<Object, T>, "Object is a required base class");
+
+    public:
+        Borrow() noexcept
+            : object_(nullptr)
+            , epoch_(0)
+        {
+        }
+
+        Borrow(std::nullptr_t) noexcept
+            : Borrow()
+        {
+        }
+
+        template<typename U, typename Policy>
+        Borrow(const Handle<U, Policy>& handle) noexcept
+            : object_(handle.operation_.mutable_object())
+            , epoch_(current_epoch())
+        {
+            static_assert(std::is_base_of_v<T, U>);
+        }
+
+        template<typename U>
+        Borrow(const Borrow<U>& other) noexcept
+            : object_(other.object_)
+            , epoch_(other.epoch_)
+        {
+            static_assert(std::is_base_of_v<T, U>);
+        }
+
+        T* get() const noexcept {
+            assert(is_valid());
+
+            return static_cast<T*>(object_);
+        }
+
+        T* operator->() const noexcept {
+            assert(*this);
+
+            return get();
+        }
+
+        T& operator*() const noexcept {
+            assert(*this);
+
+            return *get();
+        }
+
+        explicit operator bool() const noexcept {
+            return object_ != nullptr;
+        }
+
+        // Take a reference of our own, which stays valid after the borrow expires.
+        template<typename Policy = DefaultReferencePolicy>
+        [[nodiscard]] Handle<T, Policy> handle() const noexcept {
+            assert(is_valid());
+
+            if (!object_) {
+                return {};
+            }
+
+            // Only immortal objects are borrowed without being bound.
+            if (UNLIKELY(!object_->is_managed())) {
+                return Handle<T, Policy>(make_increment_operation(object_));
+            }
+
+            object_->start_increment_operation(make_increment_operation(object_));
+            return Handle<T, Policy>(make_decrement_operation(object_));
+        }
+
+    private:
+        template<typename U>
+        friend class Borrow;
+
+        static Region::Epoch current_epoch() noexcept {
+            const Region* region = Region::thread_local_instance();
+            return region ? region->epoch() : 0;
+        }
+
+        [[nodiscard]]
+        bool is_valid() const noexcept {
+            return !object_ || (epoch_ == current_epoch());
+        }
+
+    private:
+        Object*       object_;
+        Region::Epoch epoch_;
+    };
+
+}
+
+
+// include/mantle/object_finalizer.h
+
+
+namespace mantle {
+
+    // An interface for cleaning up objects once they are no longer referenced.
+    //
+    // A region's finalizer is called on the region's thread, from `Region::step`. Objects the region
+    // bound can outlive it when other regions still hold them, and once it has left those are
+    // finalized on the domain's thread instead. So a finalizer must outlive its region, until the
+    // domain is destroyed or a new region takes over the region's id, and must not rely on running on
+    // the region's thread.
+    //
+    class ObjectFinalizer {
+    public:
+        virtual ~ObjectFinalizer() = default;
+
+        // Objects are finalized in batches based on group membership.
+        //
+        // NOTE: The span may be reused once a finalizer steps its region, so be done with it first.
+        //
+        virtual void finalize(ObjectGroup group, std::span<Object*> objects) noexcept = 0;
+    };
+
+    // Declares that every object in `GROUP` is a `T`, for `TypedObjectFinalizer`.
+    template<ObjectGroup GROUP, typename T>
+    struct ObjectGroupType {
+        static_assert(std::is_base_of_v<Object, T>, "Object is a required base class");
+
+        static constexpr ObjectGroup group = GROUP;
+        using Type = T;
+    };
+
+    // A finalizer for groups whose objects each have one known type. Groups are looked up in a table
+    // that is built at compile time, and their objects handed to `Derived::finalize(std::span<T*>)`.
+    // Since the type is known the calls can be inlined, so there is one indirect call per group and
+    // none per object. Objects in groups that aren't listed are a bug.
+    //
+    // NOTE: Objects are converted in batches of up to `FINALIZATION_BATCH_SIZE`, so a group can be
+    //       handed to the typed overload in more than one call.
+    //
+    template<typename Derived, typename... GroupTypes>
+    class TypedObjectFinalizer : public ObjectFinalizer {
+        static_assert(sizeof...(GroupTypes) > 0);
+
+    public:
+        void finalize(const ObjectGroup group, const std::span<Object*> objects) noexcept final {
+            if (UNLIKELY(group >= GROUP_COUNT) || UNLIKELY(!DISPATCH_TABLE[group])) {
+                abort(); // The group wasn't registered.
+            }
+
+            DISPATCH_TABLE[group](static_cast<Derived&>(*this), objects);
+        }
+
+    private:
+        using Thunk = void (*)(Derived&, std::span<Object*>) noexcept;
+
+        static constexpr size_t GROUP_COUNT = size_t{std::max({GroupTypes::group...})} + 1;
+
+        template<typename T>
+        static void finalize_typed(Derived& derived, const std::span<Object*> objects) noexcept {
+            // The `Object` base need not be at the start of `T`, so pointers can't be cast in place.
+            std::array<T*, FINALIZATION_BATCH_SIZE> batch;
+
+            for (size_t offset = 0; offset < objects.size(); offset += batch.size()) {
+                const size_t count = std::min(batch.size(), objects.size() - offset);
+                for (size_t i = 0; i < count; ++i) {
+                    batch[i] = static_cast<T*>(objects[offset + i]);
+                }
+
+                derived.finalize(std::span<T*>(batch.data(), count));
+            }
+        }
+
+        static constexpr std::array<Thunk, GROUP_COUNT> make_dispatch_table() {
+            std::array<Thunk, GROUP_COUNT> table = {};
+            ((table[GroupTypes::group] = &finalize_typed<typename GroupTypes::Type>), ...);
+            return table;
+        }
+
+        static constexpr bool has_unique_groups() {
+            std::array<ObjectGroup, sizeof...(GroupTypes)> groups = { GroupTypes::group... };
+            std::sort(groups.begin(), groups.end());
+            return std::adjacent_find(groups.begin(), groups.end()) == groups.end();
+        }
+
+        static_assert(has_unique_groups(), "Each group can only have one type");
+
+        static constexpr std::array<Thunk, GROUP_COUNT> DISPATCH_TABLE = make_dispatch_table();
+    };
+
+}
+
+
+// include/mantle/cycle_scheduler.h
+
+
+namespace mantle {
+
+    // Decides when the domain lets a coherence cycle start.
+    class CycleScheduler {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        explicit CycleScheduler(const Config& config)
+            : interval_min_(config.cycle_interval_min)
+            , interval_max_(config.cycle_interval_max)
+            , last_start_(Clock::time_point::min())
+        {
+        }
+
+        // Returns true if a cycle that was asked for can start now.
+        [[nodiscard]]
+        bool may_start(const Clock::time_point now, const bool urgent) const {
+            return urgent || elapsed(now) >= interval_min_;
+        }
+
+        // Returns true if it has been long enough that the domain should start a cycle by itself.
+        [[nodiscard]]
+        bool is_overdue(const Clock::time_point now) const {
+            return (interval_max_ > std::chrono::nanoseconds::zero()) && (elapsed(now) >= interval_max_);
+        }
+
+        void start(const Clock::time_point now) {
+            last_start_ = now;
+        }
+
+        // How long the domain can sleep before one of the above changes its answer.
+        [[nodiscard]]
+        std::optional<std::chrono::nanoseconds> timeout(const Clock::time_point now, const bool holding, const bool pending) const {
+            if (holding) {
+                return interval_min_ - elapsed(now);
+            }
+
+            if (pending && (interval_max_ > std::chrono::nanoseconds::zero())) {
+                return interval_max_ - elapsed(now);
+            }
+
+            return std::nullopt;
+        }
+
+    private:
+        [[nodiscard]]
+        std::chrono::nanoseconds elapsed(const Clock::time_point now) const {
+            if (last_start_ == Clock::time_point::min()) {
+                return std::chrono::nanoseconds::max();
+            }
+
+            return now - last_start_;
+        }
+
+    private:
+        std::chrono::nanoseconds interval_min_;
+        std::chrono::nanoseconds interval_max_;
+        Clock::time_point        last_start_;
+    };
+
+}
+
+
+// include/mantle/worker_pool.h
+
+
+namespace mantle {
+
+    // A small fork-join pool used by the `Domain` to spread work across helper threads.
+    // The thread calling `run` participates as worker zero, so a pool without helper
+    // threads simply runs every task inline.
+    class WorkerPool {
+        WorkerPool(WorkerPool&&) = delete;
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(WorkerPool&&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+
+    public:
+        // Helper threads are restricted to these CPUs, unless the span is empty.
+        explicit WorkerPool(size_t helper_thread_count, std::span<const size_t> cpu_affinity = {});
+        ~WorkerPool();
+
+        // The number of distinct worker indices passed to tasks (helpers and the caller).
+        [[nodiscard]]
+        size_t worker_count() const;
+
+        // Invoke `task(task_index, worker_index)` for every task index in `[0, task_count)`
+        // and wait for all of them to complete. Tasks must not throw.
+        template<typename Task>
+        void run(size_t task_count, Task&& task) {
+            auto trampoline = [](void* context, size_t task_index, size_t worker_index) {
+                (*static_cast<std::remove_reference_t<Task>*>(context))(task_index, worker_index);
+            };
+
+            run(task_count, trampoline, &task);
+        }
+
+    private:
+        using TaskFunction = void (*)(void* context, size_t task_index, size_t worker_index);
+
+        void run(size_t task_count, TaskFunction function, void* context);
+        void work(size_t worker_index);
+        void helper_main(size_t worker_index);
+
+    private:
+        TaskFunction             function_;
+        void*                    context_;
+        size_t                   task_count_;
+
+        std::atomic<bool>        stopping_;
+        std::atomic<uint64_t>    generation_;
+        std::atomic<size_t>      next_task_;
+        std::atomic<size_t>      busy_count_;
+
+        std::vector<std::thread> threads_;
+    };
+
+}
+
+
+// include/mantle/topology.h
+
+
+namespace mantle {
+
+    // CPUs that share their last level cache, usually an L3.
+    struct CacheGroup {
+        std::vector<size_t>   cpus; // Ascending.
+        std::optional<size_t> numa_node;
+    };
+
+    // The CPUs this process may run on, grouped by the last level cache they share.
+    class CpuTopology {
+    public:
+        explicit CpuTopology(std::vector<CacheGroup> groups);
+
+        // Read the topology from sysfs. CPUs without cache information get a group of their own.
+        // Throws `std::runtime_error` if no usable CPU can be found.
+        [[nodiscard]]
+        static CpuTopology detect();
+
+        // Ordered by their first CPU.
+        [[nodiscard]]
+        std::span<const CacheGroup> cache_groups() const;
+
+        [[nodiscard]]
+        size_t cpu_count() const;
+
+    private:
+        std::vector<CacheGroup> groups_;
+    };
+
+    // Decides where the domain and region threads run, so the domain thread shares its cache with as
+    // many regions as possible. The domain takes CPUs at the end of the largest cache group, and region
+    // threads fill the rest of that group before they move on to groups on the same NUMA node, and then
+    // to the others. Once every CPU has a thread the placement starts over.
+    //
+    // Threads pick their CPU with `place_thread`, so this can be shared by any number of them.
+    //
+    class ThreadPlacement {
+        ThreadPlacement(ThreadPlacement&&) = delete;
+        ThreadPlacement(const ThreadPlacement&) = delete;
+        ThreadPlacement& operator=(ThreadPlacement&&) = delete;
+        ThreadPlacement& operator=(const ThreadPlacement&) = delete;
+
+    public:
+        // Keep this many CPUs for the domain thread and its workers. If that is all of them, region
+        // threads are put on the domain's CPUs as well.
+        explicit ThreadPlacement(const CpuTopology& topology, size_t domain_cpu_count = 1);
+
+        [[nodiscard]]
+        std::span<const size_t> domain_cpus() const;
+
+        [[nodiscard]]
+        std::optional<size_t> domain_numa_node() const;
+
+        // The CPUs handed to region threads, in the order they are handed out.
+        [[nodiscard]]
+        std::span<const size_t> thread_cpus() const;
+
+        // Returns the CPU for the next thread.
+        [[nodiscard]]
+        size_t next_thread_cpu();
+
+        // Pin the calling thread to the next CPU, and return it.
+        size_t place_thread();
+
+    private:
+        std::vector<size_t>   domain_cpus_;
+        std::optional<size_t> domain_numa_node_;
+        std::vector<size_t>   thread_cpus_;
+        std::atomic_size_t    next_thread_index_;
+    };
+
+}
+
+
+// include/mantle/selector.h
+
+
+namespace mantle {
+
+    class Selector {
+        Selector(Selector&&);
+        Selector(const Selector&);
+        Selector& operator=(Selector&&);
+        Selector& operator=(const Selector&);
+
+    public:
+        Selector();
+        ~Selector();        
+
+        // Becomes readable while any of the watched file descriptors are.
+        int file_descriptor() const;
+
+        // Returns an array of user-data corresponding to file descriptors that are ready-to-read.
+        std::span<void*> poll(bool non_blocking);
+
+        // Like the above, but gives up after the timeout. An empty timeout waits forever.
+        std::span<void*> poll(std::optional<std::chrono::nanoseconds> timeout);
+
+        void add_watch(int file_descriptor, void* user_data);
+        void modify_watch(int file_descriptor, void* user_data);
+        void delete_watch(int file_descriptor);
+
+    private:
+        static constexpr size_t MAX_EVENT_COUNT = 16;
+
+        int                                epoll_fd_;
+        std::array<void*, MAX_EVENT_COUNT> poll_results_;
+    };
+
+    void wait_for_readable(int file_descriptor);
+
+}
+
+
+// include/mantle/ref.h
+
+
+namespace mantle {
+
+    template<typename T>
+    class Ref {
+        static_assert(std::is_base_of_v<Object, T>, "Object is a required base class");
+
+        friend Ref<T> bind<T>(T& object) noexcept;
+
+        Ref(T& object)
+            : object_(&object)
+        {
+            Region* region = Region::thread_local_instance();
+            assert(region);
+            assert(region->has_write_barriers());
+
+            region->bind_object(object);
+        }
+
+    public:
+        Ref() = delete;
+
+        Ref(const Ref& other) noexcept
+            : object_(other.object_)
+        {
+            increment_ref_cnt(*object_);
+        }
+
+        template<typename U>
+        Ref(const Ref<U>& other) noexcept
+            : object_(other.object_)
+        {
+            static_assert(std::is_base_of_v<T, U>); // TODO: lift this into a concept.
+
+            increment_ref_cnt(*object_);
+        }
+
+        Ref& operator=(const Ref& that) noexcept {
+            // We don't need to check if `this != that`.
+            // The increment will be reordered before the decrement.
+            decrement_ref_cnt(*object_);
+            object_ = that.object_;
+            increment_ref_cnt(*object_);
+
+            return *this;
+        }
+
+        template<typename U>
+        Ref& operator=(const Ref<U>& that) noexcept {
+            static_assert(std::is_base_of_v<T, U>);
+
+            decrement_ref_cnt(*object_);
+            object_ = that.object_;
+            increment_ref_cnt(*object_);
+
+            return *this;
+        }
+
+        ~Ref() noexcept {
+            decrement_ref_cnt(*object_);
+        }
+
+        T& operator*() noexcept {
+            return *object_;
+        }
+
+        const T& operator*() const noexcept {
+            return *object_;
+        }
+
+        T* operator->() noexcept {
+            return object_;
+        }
+
+        const T* operator->() const noexcept {
+            return object_;
+        }
+
+    private:
+        T* object_;
+    };
+
+    template<typename T>
+    inline Ref<T> bind(T& object) noexcept {
+        return Ref<T>(object);
+    }
+
+}
+
+namespace std {
+
+    // TODO: Use a null pointer to represent std::nullopt.
+    // template<typename T>
+    // class optional<Ref<T>> {
+    // public:
+    // };
+
+}
+
+
+// include/mantle/ledger_recording.h
+
+
+namespace mantle {
+
+    class Object;
+
+    // An operation with its object replaced by the id the recording gave it.
+    struct RecordedOperation {
+        uint64_t object_id;
+        uint8_t  tag; // The type and exponent, encoded like they are in an `Operation`.
+    };
+
+    // What the recording knows about an object.
+    struct RecordedObject {
+        RegionId    region_id;
+        ObjectGroup group;
+    };
+
+    // The operations one region submitted in a cycle.
+    struct RecordedSubmission {
+        RegionId                       region_id;
+        std::vector<RecordedOperation> operations;
+    };
+
+    struct RecordedCycle {
+        Sequence                        cycle;
+        std::vector<RecordedSubmission> submissions;
+    };
+
+    // A recording read back in full. Object ids index `objects`, in the order they first appeared.
+    struct LedgerRecording {
+        std::vector<RecordedObject> objects;
+        std::vector<RecordedCycle>  cycles;
+
+        // A recording that was cut short, e.g. because the process died, is read up to its last whole
+        // record. Throws `std::runtime_error` if the stream doesn't hold a recording at all.
+        [[nodiscard]]
+        static LedgerRecording read(std::istream& stream);
+
+        [[nodiscard]]
+        size_t region_count() const;
+
+        [[nodiscard]]
+        size_t operation_count() const;
+    };
+
+    // Records the operations routed by a domain's controllers, so a production workload can be fed
+    // through controllers again offline with `LedgerReplay`. Install it with `Config::ledger_recorder`.
+    //
+    // Objects are written as dense ids along with their region and group, so no addresses end up in
+    // the file. Once the domain sees an object die its id is retired, and an object that is allocated
+    // at the same address later gets a new one. Objects that die on their own region with
+    // `Config::local_operations` aren't seen, so record without it.
+    //
+    // Controllers record into buffers of their own while they route, and the domain thread writes them
+    // out between steps, so recording doesn't need a lock even with domain workers.
+    //
+    class LedgerRecorder {
+    public:
+        explicit LedgerRecorder(std::ostream& stream);
+        ~LedgerRecorder();
+
+        LedgerRecorder(LedgerRecorder&&) = delete;
+        LedgerRecorder(const LedgerRecorder&) = delete;
+        LedgerRecorder& operator=(LedgerRecorder&&) = delete;
+        LedgerRecorder& operator=(const LedgerRecorder&) = delete;
+
+        // The number of operations and objects written so far.
+        [[nodiscard]]
+        size_t operation_count() const;
+
+        [[nodiscard]]
+        size_t object_count() const;
+
+    private:
+        friend class Domain;
+        friend class RegionController;
+
+        // Called by a controller when it is created, before it routes anything.
+        void add_region(RegionId region_id);
+
+        // Called by the controller of `region_id` for every operation it routes, and for every
+        // object of its region that dies.
+        MANTLE_HOT void record_operation(const RegionId region_id, const Sequence cycle, const Operation operation, const RegionId owner_id) {
+            Buffer& buffer = *buffers_[region_id];
+            buffer.cycle = cycle;
+            buffer.operations.push_back({ .operation = operation, .owner_id = owner_id });
+        }
+
+        void record_release(const RegionId region_id, const Object& object) {
+            buffers_[region_id]->released_objects.push_back(&object);
+        }
+
+        // Write out everything recorded since the last call. The domain calls this between steps,
+        // while none of its controllers are routing or applying.
+        void flush();
+
+    private:
+        struct RoutedOperation {
+            Operation operation;
+            RegionId  owner_id; // The object may have died by the time it is written out.
+        };
+
+        struct alignas(CACHE_LINE_SIZE) Buffer {
+            Sequence                     cycle = 0;
+            std::vector<RoutedOperation> operations;
+            std::vector<const Object*>   released_objects;
+        };
+
+        std::ostream&                                stream_;
+        std::vector<std::unique_ptr<Buffer>>         buffers_; // Indexed by region id.
+        std::unordered_map<const Object*, uint64_t> object_ids_;
+        std::optional<Sequence>                      cycle_; // The last cycle written.
+        std::vector<uint8_t>                         record_;
+        size_t                                       object_count_;
+        size_t                                       operation_count_;
+    };
+
+    struct LedgerReplayMetrics {
+        size_t cycle_count     = 0;
+        size_t operation_count = 0;
+
+        // Summed over every controller.
+        OperationGrouperMetrics operation_grouper;
+
+        // The number of objects whose reference counts were updated, and the time spent doing it.
+        size_t                   applied_count  = 0;
+        std::chrono::nanoseconds apply_duration = std::chrono::nanoseconds::zero();
+
+        // The number of dead objects handed back by controllers, and the time spent finalizing them.
+        size_t                   finalized_count   = 0;
+        std::chrono::nanoseconds finalize_duration = std::chrono::nanoseconds::zero();
+
+        // Objects that were used again after they died in the replay. This is only non-zero when
+        // deaths were missed while recording.
+        size_t revived_count = 0;
+
+        std::chrono::nanoseconds duration = std::chrono::nanoseconds::zero();
+
+        // The fraction of routed operations that grouping saved a reference count update for, either by
+        // folding them into another operation on the same object or because they cancelled out.
+        [[nodiscard]]
+        double grouper_hit_rate() const {
+            if (operation_count == 0) {
+                return 0.0;
+            }
+
+            const size_t update_count = std::min(applied_count, operation_count);
+            return 1.0 - (static_cast<double>(update_count) / static_cast<double>(operation_count));
+        }
+
+        [[nodiscard]]
+        double applied_objects_per_second() const {
+            if (apply_duration.count() <= 0) {
+                return 0.0;
+            }
+
+            return static_cast<double>(applied_count) / std::chrono::duration<double>(apply_duration).count();
+        }
+    };
+
+    // Feeds a recording through a group of controllers on the calling thread, the way the domain
+    // would without workers. Each recorded cycle runs as one cycle, in which every region submits
+    // what it submitted then, and once the recording ends cycles keep running until nothing is in
+    // flight. Objects are created when they are first used and deleted when they are finalized.
+    //
+    // The controllers use `config`, so one recording can be compared across grouper and apply options.
+    // Domain workers, reference count tables and heap censuses are not used.
+    //
+    class LedgerReplay {
+    public:
+        LedgerReplay(const LedgerRecording& recording, const Config& config);
+        ~LedgerReplay();
+
+        LedgerReplay(LedgerReplay&&) = delete;
+        LedgerReplay(const LedgerReplay&) = delete;
+        LedgerReplay& operator=(LedgerReplay&&) = delete;
+        LedgerReplay& operator=(const LedgerReplay&) = delete;
+
+        // Play the whole recording. This can only be done once.
+        //
+        // Throws `std::runtime_error` if a cycle doesn't fit in the ledgers, which are sized from the
+        // recording and `Config::ledger_capacity`.
+        //
+        [[nodiscard]]
+        LedgerReplayMetrics run();
+
+    private:
+        struct ReplayedObject;
+
+        // The object behind an id, created and bound to its region if it isn't alive.
+        [[nodiscard]]
+        Object& object(uint64_t object_id);
+
+        // Run one cycle, in which regions submit what they did in `cycle`, or nothing if it is null.
+        void run_cycle(const RecordedCycle* cycle);
+
+        void finalize(ObjectGroups garbage);
+
+    private:
+        const LedgerRecording& recording_;
+        Config                 config_;
+        LedgerReplayMetrics    metrics_;
+        bool                   finished_;
+
+        std::vector<ReplayedObject*>                  objects_; // Indexed by object id, null until used and once finalized.
+        std::vector<bool>                             created_;
+        std::vector<std::unique_ptr<OperationLedger>> ledgers_;
+        std::vector<SequenceRange>                    submitted_ranges_;
+        RegionControllerGroup                         controllers_;
+    };
+
+}
+
+
+// include/mantle/trace.h
+
+
+#define MANTLE_TRACE_EVENT_TYPES(X) \
+    X(PHASE)                        \
+    X(STATE)                        \
+    X(CYCLE)                        \
+    X(SEND)                         \
+    X(RECEIVE)                      \
+    X(ROUTE)                        \
+    X(FINALIZE)                     \
+
+namespace mantle {
+
+    enum class TraceEventType : uint8_t {
+#define X(MANTLE_TRACE_EVENT_TYPE) \
+        MANTLE_TRACE_EVENT_TYPE,   \
+
+        MANTLE_TRACE_EVENT_TYPES(X)
+#undef X
+    };
+
+    // Which state machine recorded the event.
+    enum class TraceSource : uint8_t {
+        REGION,
+        CONTROLLER,
+    };
+
+    // The meaning of `argument` and `value` depends on the type:
+    //   PHASE:    argument is the phase being entered, value is the cycle.
+    //   STATE:    argument is the state being entered.
+    //   CYCLE:    value is the cycle being entered.
+    //   SEND:     argument is the message type.
+    //   RECEIVE:  argument is the message type.
+    //   ROUTE:    value is the number of operations routed.
+    //   FINALIZE: value is the number of objects finalized.
+    //
+    struct TraceEvent {
+        uint64_t       timestamp; // Nanoseconds on the steady clock.
+        uint64_t       value;
+        RegionId       region_id;
+        TraceSource    source;
+        TraceEventType type;
+        uint32_t       argument;
+    };
+
+    static_assert(sizeof(TraceEvent) == 24);
+
+    // A fixed-size ring of recent events, written by a single thread. Old events are overwritten,
+    // so recording never allocates or blocks. Other threads can take a snapshot at any time.
+    class TraceRing {
+    public:
+        explicit TraceRing(size_t capacity)
+            : events_(capacity)
+            , head_(0)
+        {
+        }
+
+        TraceRing(TraceRing&&) = delete;
+        TraceRing(const TraceRing&) = delete;
+        TraceRing& operator=(TraceRing&&) = delete;
+        TraceRing& operator=(const TraceRing&) = delete;
+
+        [[nodiscard]]
+        size_t capacity() const {
+            return events_.size();
+        }
+
+        MANTLE_HOT void record(const TraceEvent& event) {
+            const Sequence head = head_.load(std::memory_order_relaxed);
+
+            // The slot mustn't be overwritten before the previous head is visible, or a snapshot
+            // could read a torn event without seeing that it was reused.
+            std::atomic_thread_fence(std::memory_order_release);
+            events_[head] = event;
+            head_.store(head + 1, std::memory_order_release);
+        }
+
+        // Appends the events still in the ring to `events`, oldest first. That is at most one fewer
+        // than the capacity, since the oldest slot may be in the middle of being overwritten.
+        //
+        // NOTE: The writer doesn't wait for readers. Events that may have been overwritten
+        //       while they were being copied are discarded.
+        //
+        void snapshot(std::vector<TraceEvent>& events) const;
+
+        // The ring that events recorded on this thread go to. It is taken on first use and handed back
+        // when the thread exits, so a thread's events can still be exported after it is gone, until
+        // another thread takes the ring over.
+        static TraceRing& thread_local_instance() {
+            thread_local Owner owner;
+            return owner.ring();
+        }
+
+    private:
+        // Holds a thread's ring, and gives it back to the registry for reuse when the thread exits.
+        class Owner {
+        public:
+            Owner();
+            ~Owner();
+
+            Owner(Owner&&) = delete;
+            Owner(const Owner&) = delete;
+            Owner& operator=(Owner&&) = delete;
+            Owner& operator=(const Owner&) = delete;
+
+            TraceRing& ring() const {
+                return *ring_;
+            }
+
+        private:
+            TraceRing* ring_;
+        };
+
+    private:
+        Ring<TraceEvent>      events_;
+        std::atomic<Sequence> head_;
+    };
+
+    inline void trace(
+        const TraceSource source,
+        const RegionId region_id,
+        const TraceEventType type,
+        const uint32_t argument = 0,
+        const uint64_t value = 0
+    ) {
+        if constexpr (ENABLE_TRACE) {
+            const auto timestamp = std::chrono::steady_clock::now().time_since_epoch();
+
+            TraceRing::thread_local_instance().record(TraceEvent {
+                .timestamp = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(timestamp).count()),
+                .value     = value,
+                .region_id = region_id,
+                .source    = source,
+                .type      = type,
+                .argument  = argument,
+            });
+        }
+    }
+
+    // Returns how many rings have been created. Rings are reused once their thread exits, so this
+    // is bounded by the number of threads that have been tracing at the same time.
+    size_t trace_ring_count();
+
+    // Returns the events of every thread's ring, ordered by time.
+    std::vector<TraceEvent> collect_trace();
+
+    // Writes the events of every thread's ring in the Chrome trace event format, which Perfetto
+    // and chrome://tracing can open. Regions and their controllers get a track each, with a
+    // slice per phase, so a region holding up a barrier shows up as a slice that doesn't end.
+    void write_chrome_trace(std::ostream& stream);
+    void write_chrome_trace(std::ostream& stream, std::span<const TraceEvent> events);
+
+    std::string_view to_string(TraceEventType type);
+
+}
+
+
+// include/mantle/region_allocator.h
+
+
+namespace mantle {
+
+    struct RegionAllocatorMetrics {
+        // The number of objects constructed and finalized since the allocator was created, so the
+        // difference is how many are alive. Constructors that throw aren't counted.
+        size_t allocated_count = 0;
+        size_t finalized_count = 0;
+
+        // Slabs are only given back when the allocator is destroyed.
+        size_t slab_count      = 0;
+    };
+
+    // A slab allocator for objects that belong to a single region, which also acts as the
+    // region's finalizer. Objects are allocated and finalized on the region's thread, so the
+    // free lists are plain thread-local lists with no synchronization.
+    //
+    // Each object's group is set to its size class. The region hands dead objects over one
+    // group at a time, so finalizing a batch ends with a single splice onto one free list.
+    //
+    // NOTE: Every object bound in a region that uses this finalizer must come from here.
+    //
+    class RegionAllocator final : public ObjectFinalizer {
+    public:
+        using Metrics = RegionAllocatorMetrics;
+
+        // Slots are powers of two from 32 bytes up to a whole slab. Slabs are aligned to their
+        // size, so any address inside a slot can be rounded down to find its header.
+        static constexpr size_t MIN_SLOT_SHIFT   = 5;
+        static constexpr size_t SLAB_SHIFT       = 16;
+        static constexpr size_t SLAB_SIZE        = 1ull << SLAB_SHIFT;
+        static constexpr size_t SIZE_CLASS_COUNT = SLAB_SHIFT - MIN_SLOT_SHIFT + 1;
+
+        RegionAllocator();
+        ~RegionAllocator() override;
+
+        RegionAllocator(RegionAllocator&&) = delete;
+        RegionAllocator(const RegionAllocator&) = delete;
+        RegionAllocator& operator=(RegionAllocator&&) = delete;
+        RegionAllocator& operator=(const RegionAllocator&) = delete;
+
+        // Construct an object in a slot of the right size class. The object still needs to be
+        // bound to a handle before it is managed.
+        template<typename T, typename... Args>
+        T& allocate(Args&&... args);
+
+        template<typename T, typename Policy = DefaultReferencePolicy, typename... Args>
+        Handle<T, Policy> make_handle(Args&&... args) {
+            return mantle::make_handle<Policy>(allocate<T>(std::forward<Args>(args)...));
+        }
+
+        template<typename T>
+        static constexpr ObjectGroup size_class();
+
+        [[nodiscard]]
+        static constexpr size_t slot_size(ObjectGroup size_class) {
+            return 1ull << (MIN_SLOT_SHIFT + size_class);
+        }
+
+        [[nodiscard]]
+        const Metrics& metrics() const;
+
+        void finalize(ObjectGroup group, std::span<Object*> objects) noexcept override;
+
+    private:
+        using Destructor = void (*)(Object*) noexcept;
+
+        // Live slots remember how to destroy their object, free slots are chained together.
+        struct alignas(alignof(Object)) SlotHeader {
+            Destructor  destructor;
+            SlotHeader* next;
+        };
+
+        struct SizeClass {
+            SlotHeader* free_list = nullptr;
+            std::byte*  bump      = nullptr; // The unused tail of the newest slab.
+            std::byte*  bump_end  = nullptr;
+        };
+
+        [[nodiscard]]
+        void* allocate_slot(ObjectGroup size_class, Destructor destructor);
+        void deallocate_slot(ObjectGroup size_class, void* memory);
+
+        [[nodiscard]]
+        static SlotHeader* to_slot(const Object* object, ObjectGroup size_class);
+
+    private:
+        std::array<SizeClass, SIZE_CLASS_COUNT> size_classes_;
+        std::vector<std::byte*>                 slabs_;
+        Metrics                                 metrics_;
+    };
+
+    template<typename T>
+    constexpr ObjectGroup RegionAllocator::size_class() {
+        static_assert(std::is_base_of_v<Object, T>, "Object is a required base class");
+        static_assert(alignof(T) <= alignof(SlotHeader), "Over-aligned objects are not supported");
+
+        constexpr size_t size = std::max<size_t>(sizeof(SlotHeader) + sizeof(T), 1ull << MIN_SLOT_SHIFT);
+        static_assert(size <= SLAB_SIZE, "Object is too large for a slab");
+
+        return static_cast<ObjectGroup>(log2_ceil(size) - MIN_SLOT_SHIFT);
+    }
+
+    template<typename T, typename... Args>
+    T& RegionAllocator::allocate(Args&&... args) {
+        constexpr ObjectGroup SIZE_CLASS = size_class<T>();
+
+        void* memory = allocate_slot(SIZE_CLASS, [](Object* object) noexcept {
+            static_cast<T*>(object)->~T();
+        });
+
+        T* object;
+        try {
+            object = new (memory) T(std::forward<Args>(args)...);
+        }
+        catch (...) {
+            deallocate_slot(SIZE_CLASS, memory);
+            throw;
+        }
+
+        static_cast<Object&>(*object).group_ = SIZE_CLASS;
+        metrics_.allocated_count += 1;
+        return *object;
+    }
+
+}
+
+
+// include/mantle/channel.h
+
+
+namespace mantle {
+
+    // Wakes up the receiver of a channel through a doorbell, but only when it has gone back to its
+    // event loop. Senders that find it busy draining the channel skip the system call.
+    class ChannelSignal {
+        ChannelSignal(ChannelSignal&&) = delete;
+        ChannelSignal(const ChannelSignal&) = delete;
+        ChannelSignal& operator=(ChannelSignal&&) = delete;
+        ChannelSignal& operator=(const ChannelSignal&) = delete;
+
+    public:
+        ChannelSignal()
+            : armed_(true)
+        {
+        }
+
+        int file_descriptor() {
+            return doorbell_.file_descriptor();
+        }
+
+        // Senders call this after every value they send.
+        void notify() {
+            // Pairs with the fence in `arm`. Either the receiver sees the value when it checks one
+            // last time, or we see that it is armed and ring the doorbell.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (armed_.load(std::memory_order_relaxed) && armed_.exchange(false, std::memory_order_relaxed)) {
+                doorbell_.ring();
+            }
+        }
+
+        // The receiver calls this before draining the channel.
+        void disarm(const bool non_blocking) {
+            doorbell_.poll(non_blocking);
+            armed_.store(false, std::memory_order_relaxed);
+        }
+
+        // The receiver calls this once it has drained the channel, and must pass a check for values
+        // that arrived in the meantime. They may not have rung the doorbell, so we ring it for them.
+        template<typename HasValues>
+        void arm(HasValues&& has_values) {
+            armed_.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (has_values() && armed_.exchange(false, std::memory_order_relaxed)) {
+                doorbell_.ring();
+            }
+        }
+
+    private:
+        Doorbell                                  doorbell_;
+        alignas(CACHE_LINE_SIZE) std::atomic_bool armed_;
+    };
+
+    template<typename T>
+    class Channel;
+
+    template<typename T>
+    class MpscChannel;
+
+    // Passes handles from one thread to another. Handles are moved through the channel as they are,
+    // so a handoff never touches the ledger. This is a `Stream` of the handles' operations with
+    // a doorbell that can be polled from an event loop.
+    //
+    // NOTE: There can only be one sender and one receiver at a time. See `MpscChannel` for more senders.
+    //
+    template<typename T, typename Policy>
+    class Channel<Handle<T, Policy>> {
+        Channel(Channel&&) = delete;
+        Channel(const Channel&) = delete;
+        Channel& operator=(Channel&&) = delete;
+        Channel& operator=(const Channel&) = delete;
+
+    public:
+        using HandleType = Handle<T, Policy>;
+
+        // The ring is only ever read by the receiver, so it should live on the receiver's NUMA node.
+        explicit Channel(size_t minimum_capacity = CHANNEL_CAPACITY, std::optional<size_t> numa_node = std::nullopt)
+            : stream_(minimum_capacity, numa_node)
+        {
+        }
+
+        // Handles that were never received are dropped by whoever destroys the channel.
+        ~Channel() {
+            std::vector<HandleType> handles;
+            receive(handles, true);
+        }
+
+        size_t capacity() const {
+            return stream_.capacity();
+        }
+
+        // Becomes readable when there are handles to receive.
+        int file_descriptor() {
+            return signal_.file_descriptor();
+        }
+
+        // Returns false if the channel is full, in which case the handle is left as it was.
+        bool send(HandleType&& handle) {
+            if (!stream_.send(handle.operation_)) {
+                return false;
+            }
+
+            handle.operation_ = make_null_operation();
+            signal_.notify();
+            return true;
+        }
+
+        // Append the handles that have arrived. This blocks until the doorbell rings unless
+        // `non_blocking` is set, and can still come back empty-handed when it does.
+        size_t receive(std::vector<HandleType>& handles, const bool non_blocking) {
+            signal_.disarm(non_blocking);
+
+            const size_t count = handles.size();
+            while (stream_.has_messages()) {
+                const typename Stream::Window window = stream_.receive();
+                for (const std::span<const Operation> operations: { window.first, window.second }) {
+                    for (const Operation operation: operations) {
+                        handles.push_back(HandleType(operation));
+                    }
+                }
+                stream_.release();
+            }
+
+            signal_.arm([&] { return stream_.has_messages(); });
+            return handles.size() - count;
+        }
+
+    private:
+        using Stream = BasicStream<Operation>;
+
+        Stream        stream_;
+        ChannelSignal signal_;
+    };
+
+    // Like `Channel`, but any number of threads can send at the same time. Senders claim slots in
+    // the ring with a compare and swap, and mark them as written with a sequence number of their own.
+    template<typename T, typename Policy>
+    class MpscChannel<Handle<T, Policy>> {
+        MpscChannel(MpscChannel&&) = delete;
+        MpscChannel(const MpscChannel&) = delete;
+        MpscChannel& operator=(MpscChannel&&) = delete;
+        MpscChannel& operator=(const MpscChannel&) = delete;
+
+        struct Slot {
+            AtomicSequence sequence;
+            Operation      operation;
+        };
+
+    public:
+        using HandleType = Handle<T, Policy>;
+
+        explicit MpscChannel(size_t minimum_capacity = CHANNEL_CAPACITY, std::optional<size_t> numa_node = std::nullopt)
+            : ring_(std::bit_ceil(std::max<size_t>(minimum_capacity, 1)), MappedAllocator<Slot>(HugePagePolicy::NONE, numa_node))
+            , mask_(ring_.size() - 1)
+            , head_(0)
+            , tail_(0)
+        {
+            for (Sequence sequence = 0; sequence < ring_.size(); ++sequence) {
+                ring_[sequence].sequence.store(sequence, std::memory_order_relaxed);
+            }
+        }
+
+        // Handles that were never received are dropped by whoever destroys the channel.
+        ~MpscChannel() {
+            std::vector<HandleType> handles;
+            receive(handles, true);
+        }
+
+        size_t capacity() const {
+            return ring_.size();
+        }
+
+        // Becomes readable when there are handles to receive.
+        int file_descriptor() {
+            return signal_.file_descriptor();
+        }
+
+        // Returns false if the channel is full, in which case the handle is left as it was.
+        bool send(HandleType&& handle) {
+            Sequence tail = tail_.load(std::memory_order_relaxed);
+            Slot* slot;
+            while (true) {
+                slot = &ring_[tail & mask_];
+
+                // The slot is free for this lap once the receiver has moved its sequence up to ours.
+                const Sequence sequence = slot->sequence.load(std::memory_order_acquire);
+                const auto lag = static_cast<std::make_signed_t<Sequence>>(sequence - tail);
+                if (lag == 0) {
+                    if (tail_.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                }
+                else if (lag < 0) {
+                    return false; // Channel is full.
+                }
+                else {
+                    tail = tail_.load(std::memory_order_relaxed);
+                }
+            }
+
+            slot->operation = std::exchange(handle.operation_, make_null_operation());
+            slot->sequence.store(tail + 1, std::memory_order_release);
+
+            signal_.notify();
+            return true;
+        }
+
+        // Append the handles that have arrived. This blocks until the doorbell rings unless
+        // `non_blocking` is set, and can still come back empty-handed when it does.
+        //
+        // NOTE: A sender that has claimed a slot but not written it yet holds back the ones after it.
+        //
+        size_t receive(std::vector<HandleType>& handles, const bool non_blocking) {
+            signal_.disarm(non_blocking);
+
+            const size_t count = handles.size();
+            while (has_handles()) {
+                Slot& slot = ring_[head_ & mask_];
+                handles.push_back(HandleType(slot.operation));
+
+                // Hand the slot to whoever sends in it on the next lap.
+                slot.sequence.store(head_ + ring_.size(), std::memory_order_release);
+                head_ += 1;
+            }
+
+            signal_.arm([&] { return has_handles(); });
+            return handles.size() - count;
+        }
+
+    private:
+        // Only the receiver may call this.
+        bool has_handles() const {
+            return ring_[head_ & mask_].sequence.load(std::memory_order_acquire) == (head_ + 1);
+        }
+
+    private:
+        std::vector<Slot, MappedAllocator<Slot>> ring_;
+        size_t                                   mask_;
+
+        // Private to receive.
+        alignas(CACHE_LINE_SIZE) Sequence        head_;
+
+        alignas(CACHE_LINE_SIZE) AtomicSequence  tail_;
+        ChannelSignal                            signal_;
+    };
+
+}
+
+
+// include/mantle/atomic_handle.h
+
+
+namespace mantle {
+
+    // A handle that can be loaded and replaced from any number of threads at once, which makes it a
+    // good fit for publishing read-mostly values like configuration snapshots or routing tables.
+    //
+    // A load is one atomic read followed by an increment in the reader's own ledger, so readers never
+    // write to shared memory and don't contend with each other. A value that is replaced is dropped
+    // like any other handle. Its decrement is only applied after a cycle, which no region can finish
+    // while it's in the middle of a load, so whatever a reader sees stays alive until its increment
+    // has been counted. This is the same reasoning that makes a `Borrow` safe.
+    //
+    // NOTE: Threads that load must run a region, like threads that copy handles.
+    //
+    template<typename T, typename Policy = DefaultReferencePolicy>
+    class AtomicHandle {
+        static_assert(std::is_base_of_v<Object, T>, "Object is a required base class");
+        static_assert(std::atomic<Operation>::is_always_lock_free);
+        static_assert(!Policy::SHARDED, "Sharded references can't be published");
+
+        AtomicHandle(AtomicHandle&&) = delete;
+        AtomicHandle(const AtomicHandle&) = delete;
+        AtomicHandle& operator=(AtomicHandle&&) = delete;
+        AtomicHandle& operator=(const AtomicHandle&) = delete;
+
+    public:
+        using HandleType = Handle<T, Policy>;
+
+        AtomicHandle() noexcept
+            : operation_(make_null_operation())
+        {
+        }
+
+        AtomicHandle(std::nullptr_t) noexcept
+            : AtomicHandle()
+        {
+        }
+
+        explicit AtomicHandle(HandleType handle) noexcept
+            : operation_(take_reference(handle))
+        {
+        }
+
+        // Drops the current value.
+        ~AtomicHandle() noexcept {
+            HandleType value(operation_.load(std::memory_order_acquire));
+        }
+
+        // Take a reference of our own to the current value.
+        [[nodiscard]] HandleType load() const noexcept {
+            const Operation operation = operation_.load(std::memory_order_acquire);
+            if (operation.type() != OperationType::DECREMENT) {
+                return HandleType(operation); // Null or immortal.
+            }
+
+            Object* object = operation.mutable_object();
+
+            object->start_increment_operation(make_increment_operation(object));
+            return HandleType(make_decrement_operation(object));
+        }
+
+        // Replace the current value, which is dropped.
+        void store(HandleType handle) noexcept {
+            (void)exchange(std::move(handle));
+        }
+
+        // Replace the current value and return it.
+        [[nodiscard]] HandleType exchange(HandleType handle) noexcept {
+            return HandleType(operation_.exchange(take_reference(handle), std::memory_order_acq_rel));
+        }
+
+    private:
+        // The handle's weight moves in along with the reference.
+        static Operation take_reference(HandleType& handle) noexcept {
+            return std::exchange(handle.operation_, make_null_operation());
+        }
+
+    private:
+        std::atomic<Operation> operation_;
+    };
+
+}
+
+
+// include/mantle/region_pool.h
+
+
+namespace mantle {
+
+    class Domain;
+    class ObjectFinalizer;
+
+    // Regions for threads that come and go, like those of an elastic task pool. Constructing a region
+    // allocates its ledger and connection and opens its eventfds. Pooled regions keep all of that when
+    // their thread is done with them, and the next thread to acquire one only has to join a cycle.
+    //
+    // Releasing a region still stops it, so whatever its thread dropped is finalized before another
+    // thread can adopt it. That way a parked region doesn't hold up the cycles of the others.
+    //
+    // NOTE: Every region shares the finalizer, which has to be safe to call from any of them. The pool
+    //       must be destroyed before the domain.
+    //
+    class RegionPool {
+        RegionPool(RegionPool&&) = delete;
+        RegionPool(const RegionPool&) = delete;
+        RegionPool& operator=(RegionPool&&) = delete;
+        RegionPool& operator=(const RegionPool&) = delete;
+
+    public:
+        // The region of the thread that holds it. It is parked again when the lease is destroyed,
+        // which must happen on the same thread.
+        class Lease {
+        public:
+            Lease(Lease&& other)
+                : pool_(std::exchange(other.pool_, nullptr))
+                , region_(std::move(other.region_))
+            {
+            }
+
+            Lease& operator=(Lease&& other) {
+                if (this != &other) {
+                    reset();
+                    pool_ = std::exchange(other.pool_, nullptr);
+                    region_ = std::move(other.region_);
+                }
+
+                return *this;
+            }
+
+            Lease(const Lease&) = delete;
+            Lease& operator=(const Lease&) = delete;
+
+            ~Lease() {
+                reset();
+            }
+
+            Region& operator*() const {
+                return *region_;
+            }
+
+            Region* operator->() const {
+                return region_.get();
+            }
+
+            // Park the region now.
+            void reset() {
+                if (pool_) {
+                    std::exchange(pool_, nullptr)->release(std::move(region_));
+                }
+            }
+
+        private:
+            friend class RegionPool;
+
+            Lease(RegionPool& pool, std::unique_ptr<Region> region)
+                : pool_(&pool)
+                , region_(std::move(region))
+            {
+            }
+
+        private:
+            RegionPool*             pool_;
+            std::unique_ptr<Region> region_;
+        };
+
+        // At most `capacity` regions are kept around. Any more are destroyed when they're released.
+        RegionPool(Domain& domain, ObjectFinalizer& finalizer, size_t capacity);
+        ~RegionPool();
+
+        // Adopt a parked region on this thread, or construct one if none are left.
+        // Throws `std::runtime_error` if the thread already has a region.
+        [[nodiscard]]
+        Lease acquire();
+
+        [[nodiscard]]
+        size_t parked_count() const;
+
+    private:
+        void release(std::unique_ptr<Region> region);
+
+    private:
+        Domain&                              domain_;
+        ObjectFinalizer&                     finalizer_;
+        size_t                               capacity_;
+        mutable std::mutex                   mutex_;
+        std::vector<std::unique_ptr<Region>> parked_;
+    };
+
+}
+
+
+// include/mantle/domain.h
+
+
+namespace mantle {
+
+    class Region;
+
+    // A copy of one region's metrics, taken by the domain between cycles.
+    struct RegionMetricsSnapshot {
+        RegionId              region_id = INVALID_REGION_ID;
+        RegionControllerState state     = RegionControllerState::STARTING;
+
+        size_t                                                              cycle_count = 0;
+        std::array<std::chrono::nanoseconds, REGION_CONTROLLER_PHASE_COUNT> phase_durations = {};
+
+        size_t                   increment_count = 0;
+        size_t                   decrement_count = 0;
+        size_t                   applied_count   = 0;
+        std::chrono::nanoseconds apply_duration  = std::chrono::nanoseconds::zero();
+
+        size_t ledger_occupancy = 0;
+        size_t ledger_capacity  = 0;
+
+        // Objects retired by the domain are counted by the object grouper.
+        size_t finalized_count = 0;
+
+        OperationGrouperMetrics operation_grouper;
+        ObjectGrouperMetrics    object_grouper;
+
+        // The region's last heap census, with `Config::heap_census_interval`.
+        std::vector<ObjectGroupCensus> heap_census;
+    };
+
+    struct DomainMetrics {
+        // The cycle every region had reached when the snapshot was taken.
+        Sequence                           cycle = 0;
+        std::vector<RegionMetricsSnapshot> regions;
+
+        // Operations written by threads without a region so far, with `Config::fallback_ledger`.
+        size_t fallback_operation_count = 0;
+
+        // Every region's last heap census summed by group, with `Config::heap_census_interval`. Regions
+        // take theirs in the same cycles, but one that joined late may not have taken one yet.
+        std::vector<ObjectGroupCensus> heap_census;
+        std::optional<Sequence>        heap_census_cycle;
+    };
+
+    class Domain {
+        friend class Region;
+
+    public:
+        using Metrics = DomainMetrics;
+
+        explicit Domain(const Config& config = Config());
+        ~Domain();
+
+        Domain(Domain&&) = delete;
+        Domain(const Domain&) = delete;
+        Domain& operator=(Domain&&) = delete;
+        Domain& operator=(const Domain&) = delete;
+
+        [[nodiscard]]
+        const Config& config() const;
+
+        // Returns the metrics of every region as of the last cycle to finish. This is safe to
+        // call from any thread, and doesn't synchronize with regions.
+        [[nodiscard]]
+        Metrics snapshot_metrics() const;
+
+        // With `Config::domain_embedded`, call step from the thread that created the domain when this
+        // becomes readable, or once `timeout` has passed since the last step, whichever comes first.
+        int file_descriptor();
+        void step(bool non_blocking);
+
+        [[nodiscard]]
+        std::optional<std::chrono::nanoseconds> timeout() const;
+
+        // Returns true if regions on the calling thread have to step the domain themselves.
+        [[nodiscard]]
+        bool is_driven_here() const;
+
+        // Where region threads should run to share a cache with the domain thread. Call `place_thread`
+        // on it from each region thread. Only with `Config::topology_placement`.
+        [[nodiscard]]
+        ThreadPlacement* placement();
+
+    private:
+        // The node that memory only the domain reads should be placed on, if placement is enabled.
+        [[nodiscard]]
+        std::optional<size_t> numa_node() const;
+
+        void run();
+
+        // One pass of the domain loop: wait for messages, handle them and let controllers make progress.
+        void iterate(bool non_blocking);
+
+        // Swaps segments in for regions' write barriers until the doorbell rings. This runs on its own
+        // thread, since region threads that run into a guard page are stuck until it does.
+        void service_write_barriers();
+        WriteBarrierManager& write_barrier_manager();
+
+        // Only with `Config::fallback_ledger`.
+        FallbackLedger* fallback_ledger();
+
+        void handle_event(void* user_data);
+        void deliver_messages(Region& region, const MessageBatch& messages);
+        void send_messages(RegionId region_id);
+
+        // Finalize garbage on behalf of a region that has left.
+        void finalize_garbage(RegionId region_id, ObjectGroups garbage);
+
+        // Busy-waits for messages for up to `Config::domain_spin_duration` and handles them. Returns
+        // false if none arrived and the domain should block. The time spent is taken off `timeout`.
+        bool spin(std::optional<std::chrono::nanoseconds>& timeout);
+        bool receive_pending_messages();
+        void set_spinning(bool spinning);
+
+        void update_controllers(const RegionControllerCensus& census);
+
+        // Returns false if the cycle some region asked for should be held back for now.
+        bool schedule_cycle(const RegionControllerCensus& census);
+        std::optional<std::chrono::nanoseconds> schedule_timeout(const RegionControllerCensus& census) const;
+        bool is_start_urgent(const RegionControllerCensus& census) const;
+        bool has_pending_operations() const;
+        void parallelize_controllers(const RegionControllerCensus& census);
+        void start_controllers(const RegionControllerCensus& census, std::scoped_lock<std::mutex>&);
+        void stop_controllers(const RegionControllerCensus& census, std::scoped_lock<std::mutex>&);
+        void detach_region(RegionId region_id, const Message& message);
+        void publish_metrics(const RegionControllerCensus& census);
+
+        // Returns true if no region is joining or leaving, so the cadence is up to the scheduler.
+        [[nodiscard]]
+        bool is_steady(const RegionControllerCensus& census) const;
+
+        // Combine the censuses of every cluster into one that covers all controllers.
+        RegionControllerCensus combine_censuses() const;
+
+        // The controllers in a cluster are the ones with consecutive region ids starting here.
+        std::span<const std::unique_ptr<RegionController>> cluster_controllers(size_t cluster_index) const;
+
+        // Returns true if clusters coordinate their controllers on the worker pool, rather than all
+        // of them on the domain thread. Each cluster delivers, synchronizes and sends for its own
+        // controllers, which only touches them and the census of the cluster.
+        [[nodiscard]]
+        bool has_cluster_workers() const;
+
+        // Call `pass(cluster_index)` for every cluster, in parallel if clusters have workers.
+        template<typename Pass>
+        void for_each_cluster(Pass&& pass);
+
+        // Returns true if a cluster can send the controller's messages. Regions that are leaving or
+        // have left are answered for on the domain thread, since that touches state shared by all of them.
+        [[nodiscard]]
+        bool is_sent_by_cluster(const RegionController& controller) const;
+
+        // Regions can join and leave between any two cycles. A leaving region has to wait for the
+        // domain to be done with it before it goes away, which is what `unbind` is for. Binding
+        // gives the region its id before the domain can see it, as it is looked up when messages arrive.
+        void bind(Region& region);
+        void unbind(Region& region);
+
+    private:
+        Config                 config_;
+        std::vector<size_t>    cpu_affinity_; // Shared by the domain thread and its workers.
+        std::unique_ptr<ThreadPlacement> placement_; // Only with `Config::topology_placement`.
+        std::optional<size_t>  numa_node_;
+        std::thread            thread_; // Not started when embedded.
+        std::thread::id        driver_thread_id_;
+
+        // Shared with regions that are joining or leaving.
+        std::mutex                                  regions_mutex_;
+        std::vector<std::pair<RegionId, Region*>>   joining_regions_;
+        std::vector<RegionId>                       vacant_region_ids_;
+
+        // Indexed by region id, with `Config::reference_count_table`. Like controllers, these are
+        // taken over by regions that reuse an id, since objects can outlive the region that owns them.
+        std::vector<std::unique_ptr<ReferenceCountTable>> reference_count_tables_;
+        RegionId                                    next_region_id_;
+        std::atomic_bool                            stop_requested_;
+
+        // Private to the domain thread. Regions are indexed like their controllers, and are null
+        // once they have left. Their finalizers stay around for the objects they leave behind.
+        std::vector<Region*>          regions_;
+        std::vector<ObjectFinalizer*> finalizers_;
+        size_t                        attached_region_count_;
+        RegionControllerGroup         controllers_;
+
+        // Controllers keep the census of their cluster up to date as they transition. The addresses
+        // must stay put, since controllers hold on to them.
+        size_t                                               cluster_size_;
+        std::vector<std::unique_ptr<RegionControllerCensus>> cluster_censuses_;
+        std::vector<std::vector<Region*>>                    cluster_arrivals_; // Regions with messages, when clusters have workers.
+        std::atomic_size_t            bound_region_count_; // Lets a spinning domain notice new regions.
+        size_t                        spin_region_count_;
+
+        bool                        running_;
+        std::optional<std::chrono::nanoseconds> timeout_; // How long the next blocking pass may wait.
+        Doorbell                    doorbell_;
+        Selector                    selector_;
+        std::unique_ptr<WorkerPool> worker_pool_;
+
+        // Only with the write barrier backend.
+        std::unique_ptr<WriteBarrierManager> write_barrier_manager_;
+        std::unique_ptr<Doorbell>            write_barrier_doorbell_;
+        std::thread                          write_barrier_thread_;
+
+        std::unique_ptr<FallbackLedger>      fallback_ledger_; // Only with `Config::fallback_ledger`.
+
+        CycleScheduler                               scheduler_;
+        std::optional<RegionControllerCensus::Cycle> admitted_cycle_;
+        bool                                         idle_cycle_armed_;
+
+        mutable std::mutex                           metrics_mutex_;
+        Metrics                                      metrics_;
+        std::optional<RegionControllerCensus::Cycle> published_cycle_;
+    };
+
+}
+
+
+// include/mantle/mantle.h
+
+
+
+
+// include/mantle/debug.h
+
+
+#define MANTLE_INFO  0
+#define MANTLE_DEBUG 0
+#define MANTLE_AUDIT 0
+
+namespace mantle {
+
+    inline std::ostream& operator<<(std::ostream& stream, const Operation& operation) {
+        Operation mutable_operation = operation;
+
+        std::stringstream ss;
+        ss << "Operation(object:" << static_cast<const void*>(mutable_operation.object());
+        ss << ", value:" << static_cast<int>(mutable_operation.value()) << ")";
+
+        stream << ss.str();
+        return stream;
+    }
+
+    inline std::ostream& operator<<(std::ostream& stream, const OperationBatch& batch) {
+        std::stringstream ss;
+        ss << "OperationBatch(\n";
+        ss << "  operations: [";
+        for (Operation operation: batch.operations) {
+            if (operation) {
+                ss << operation << ", ";
+            }
+        }
+        ss << "]";
+
+        stream << ss.str();
+        return stream;
+    }
+
+    inline std::ostream& operator<<(std::ostream& stream, const RegionControllerGroup& controllers) {
+        std::stringstream ss;
+        ss << "RegionControllerGroup(\n";
+        for (RegionId region_id = 0; region_id < controllers.size(); ++region_id) {
+            auto&& controller = *controllers[region_id];
+
+            ss << "  RegionController(id:" << region_id;
+            ss << ", phase:" << to_string(controller.phase());
+            ss << ", action:" << to_string(controller.action()) << ")\n";
+        }
+        ss << ")";
+
+        stream << ss.str();
+        return stream;
+    }
+
+    template<typename... Args>
+    inline void debug(const char* fmt, Args&&... args) {
+#if MANTLE_DEBUG
+        std::string log_line = fmt::format(fmt::runtime(fmt), std::forward<Args>(args)...) + '\n';
+        ssize_t count = write(1, log_line.c_str(), log_line.size());
+        (void)count;
+#else
+        (void)fmt;
+        ((void)args, ...); // This is ridiculous. Turn off the warning.
+#endif
+    }
+
+    template<typename... Args>
+    inline void info(const char* fmt, Args&&... args) {
+#if MANTLE_INFO
+        std::string log_line = fmt::format(fmt::runtime(fmt), std::forward<Args>(args)...) + '\n';
+        ssize_t count = write(1, log_line.c_str(), log_line.size());
+        (void)count;
+#else
+        (void)fmt;
+        ((void)args, ...); // This is ridiculous. Turn off the warning.
+#endif
+    }
+
+    template<typename... Args>
+    inline void warning(const char* fmt, Args&&... args) {
+#if MANTLE_INFO
+        std::string log_line = fmt::format(fmt::runtime(fmt), std::forward<Args>(args)...) + '\n';
+        ssize_t count = write(1, log_line.c_str(), log_line.size());
+        (void)count;
+#else
+        (void)fmt;
+        ((void)args, ...); // This is ridiculous. Turn off the warning.
+#endif
+    }
+
+}
+
+
+// src/mantle.cpp
+
+
+
+// src/fallback_ledger.cpp
+
+namespace mantle {
+
+inline
+    FallbackLedger::FallbackLedger()
+        : has_operations_(false)
+        , written_count_(0)
+    {
+        FallbackLedger* expected = nullptr;
+        if (!installed_instance().compare_exchange_strong(expected, this, std::memory_order_acq_rel)) {
+            throw std::runtime_error("Cannot have more than one fallback ledger per process");
+        }
+    }
+
+inline
+    FallbackLedger::~FallbackLedger() {
+        installed_instance().store(nullptr, std::memory_order_release);
+    }
+
+inline
+    void FallbackLedger::write(const Operation operation) {
+        write(std::span{&operation, 1});
+    }
+
+inline
+    void FallbackLedger::write(const std::span<const Operation> operations) {
+        if (operations.empty()) {
+            return;
+        }
+
+        // Regions that are handed an object after this see the flag, since whatever hands it over
+        // synchronizes with us. They drain the operations before their own get submitted.
+        {
+            std::scoped_lock lock(mutex_);
+            operations_.insert(operations_.end(), operations.begin(), operations.end());
+            has_operations_.store(true, std::memory_order_relaxed);
+        }
+
+        written_count_.fetch_add(operations.size(), std::memory_order_relaxed);
+    }
+
+inline
+    void FallbackLedger::drain(OperationSpill& spill) {
+        std::scoped_lock lock(mutex_);
+
+        for (const Operation operation: operations_) {
+            spill.write(operation);
+        }
+
+        operations_.clear();
+        has_operations_.store(false, std::memory_order_relaxed);
+    }
+
+}
+
+
+// src/doorbell.cpp
+
+namespace mantle {
+
+inline
+    Doorbell::Doorbell()
+        : file_descriptor_(eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK))
+    {
+        if (file_descriptor_ < 0) {
+            throw std::runtime_error("Failed to create doorbell eventfd");
+        }
+    }
+
+inline
+    Doorbell::~Doorbell() {
+        close(file_descriptor_);
+    }
+
+inline
+    int Doorbell::file_descriptor() {
+        return file_descriptor_;
+    }
+
+inline
+    void Doorbell::ring(uint64_t count) {
+        ssize_t bytes_written = 0;
+        do {
+            bytes_written = write(file_descriptor_, &count, sizeof(count));
+        } while ((bytes_written < 0) && (errno == EINTR));
+
+        if (bytes_written != static_cast<ssize_t>(sizeof(count))) {
+            abort();
+        }
+    }
+
+inline
+    uint64_t Doorbell::poll(bool non_blocking) {
+        if (!non_blocking) {
+            wait_for_readable(file_descriptor_);
+        }
+
+        uint64_t count = 0;
+        ssize_t bytes_read = 0;
+        do {
+            bytes_read = read(file_descriptor_, &count, sizeof(count));
+        } while ((bytes_read < 0) && (errno == EINTR));
+
+        if (bytes_read != static_cast<ssize_t>(sizeof(count))) {
+            if (bytes_read < 0) {
+                if (errno == EAGAIN) {
+                    return 0;
+                }
+            }
+
+            abort();
+        }
+
+        return count;
+    }
+
+inline
+    void futex_wait(std::atomic_uint32_t& word, const uint32_t expected) {
+        static_assert(sizeof(std::atomic_uint32_t) == sizeof(uint32_t));
+
+        // EAGAIN means the word had already changed, and EINTR is a spurious wakeup.
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+    }
+
+inline
+    void futex_wake(std::atomic_uint32_t& word) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+
+}
+
+
+// src/worker_pool.cpp
+
+namespace mantle {
+
+inline
+    WorkerPool::WorkerPool(const size_t helper_thread_count, const std::span<const size_t> cpu_affinity)
+        : function_(nullptr)
+        , context_(nullptr)
+        , task_count_(0)
+        , stopping_(false)
+        , generation_(0)
+        , next_task_(0)
+        , busy_count_(0)
+    {
+        threads_.reserve(helper_thread_count);
+        for (size_t i = 0; i < helper_thread_count; ++i) {
+            threads_.emplace_back([this, worker_index = i + 1, cpus = std::vector<size_t>(cpu_affinity.begin(), cpu_affinity.end())]() {
+                if (!cpus.empty()) {
+                    set_cpu_affinity(cpus);
+                }
+
+                helper_main(worker_index);
+            });
+        }
+    }
+
+inline
+    WorkerPool::~WorkerPool() {
+        stopping_.store(true, std::memory_order_release);
+        generation_.fetch_add(1, std::memory_order_acq_rel);
+        generation_.notify_all();
+
+        for (std::thread& thread: threads_) {
+            thread.join();
+        }
+    }
+
+inline
+    size_t WorkerPool::worker_count() const {
+        return threads_.size() + 1;
+    }
+
+inline
+    void WorkerPool::run(const size_t task_count, const TaskFunction function, void* context) {
+        assert(busy_count_.load(std::memory_order_acquire) == 0);
+
+        function_   = function;
+        context_    = context;
+        task_count_ = task_count;
+        next_task_.store(0, std::memory_order_relaxed);
+
+        if (!threads_.empty()) {
+            // Publish the job and wake up the helpers.
+            busy_count_.store(threads_.size(), std::memory_order_relaxed);
+            generation_.fetch_add(1, std::memory_order_acq_rel);
+            generation_.notify_all();
+        }
+
+        work(0);
+
+        // Wait for the helpers to finish their share of the tasks.
+        for (size_t busy_count; (busy_count = busy_count_.load(std::memory_order_acquire)) != 0;) {
+            busy_count_.wait(busy_count, std::memory_order_acquire);
+        }
+    }
+
+inline
+    void WorkerPool::work(const size_t worker_index) {
+        while (true) {
+            const size_t task_index = next_task_.fetch_add(1, std::memory_order_relaxed);
+            if (task_index >= task_count_) {
+                return;
+            }
+
+            function_(context_, task_index, worker_index);
+        }
+    }
+
+inline
+    void WorkerPool::helper_main(const size_t worker_index) {
+        uint64_t generation = 0;
+
+        while (true) {
+            generation_.wait(generation, std::memory_order_acquire);
+            generation = generation_.load(std::memory_order_acquire);
+
+            if (stopping_.load(std::memory_order_acquire)) {
+                return;
+            }
+
+            work(worker_index);
+
+            if (busy_count_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                busy_count_.notify_one();
+            }
+        }
+    }
+
+}
+
+
+// src/domain.cpp
+
+namespace mantle {
+
+inline
+    Domain::Domain(const Config& config)
+        : config_(config)
+        , numa_node_(config_.domain_numa_node)
+        , next_region_id_(0)
+        , stop_requested_(false)
+        , attached_region_count_(0)
+        , cluster_size_(config_.domain_cluster_size ? config_.domain_cluster_size : std::numeric_limits<size_t>::max())
+        , bound_region_count_(0)
+        , spin_region_count_(0)
+        , running_(false)
+        , timeout_(std::nullopt)
+        , scheduler_(config_)
+        , admitted_cycle_(std::nullopt)
+        , idle_cycle_armed_(false)
+        , published_cycle_(std::nullopt)
+    {
+        if (config_.fallback_ledger) {
+            fallback_ledger_ = std::make_unique<FallbackLedger>();
+        }
+
+        selector_.add_watch(doorbell_.file_descriptor(), &doorbell_);
+
+        if (config_.domain_cpu_affinity) {
+            if (config_.domain_cpu_affinity->empty()) {
+                throw std::runtime_error("Config::domain_cpu_affinity has no cpus");
+            }
+
+            cpu_affinity_.assign(config_.domain_cpu_affinity->begin(), config_.domain_cpu_affinity->end());
+        }
+        else if (config_.domain_numa_node) {
+            cpu_affinity_ = numa_node_cpus(*config_.domain_numa_node);
+        }
+        else if (config_.topology_placement) {
+            placement_ = std::make_unique<ThreadPlacement>(CpuTopology::detect(), config_.domain_worker_count + 1);
+            cpu_affinity_.assign(placement_->domain_cpus().begin(), placement_->domain_cpus().end());
+            if (config_.numa_placement) {
+                numa_node_ = placement_->domain_numa_node();
+            }
+        }
+
+        if (config_.domain_worker_count) {
+            worker_pool_ = std::make_unique<WorkerPool>(config_.domain_worker_count, cpu_affinity_);
+        }
+
+        if (config_.ledger_backend == LedgerBackend::WRITE_BARRIER) {
+            write_barrier_manager_ = std::make_unique<WriteBarrierManager>(config_.write_barrier_pool_low_watermark, config_.write_barrier_pool_high_watermark);
+            write_barrier_doorbell_ = std::make_unique<Doorbell>();
+            write_barrier_thread_ = std::thread([this]() {
+                debug("[domain] servicing write barriers");
+                service_write_barriers();
+            });
+        }
+
+        if (config_.domain_embedded) {
+            driver_thread_id_ = std::this_thread::get_id();
+            if (config_.numa_placement && !numa_node_) {
+                numa_node_ = current_numa_node();
+            }
+
+            running_ = true;
+            return;
+        }
+
+        std::promise<void> init_promise;
+        std::future<void> init_future = init_promise.get_future();
+
+        thread_ = std::thread([init_promise = std::move(init_promise), this]() mutable {
+            try {
+                debug("[domain] initializing thread");
+                if (!cpu_affinity_.empty()) {
+                    set_cpu_affinity(cpu_affinity_);
+                }
+
+                // Without a configured node, place the domain's memory wherever the thread ended up.
+                if (config_.numa_placement && !numa_node_) {
+                    numa_node_ = current_numa_node();
+                }
+
+                init_promise.set_value();
+            }
+            catch (...) {
+                init_promise.set_exception(std::current_exception());
+                return;
+            }
+
+            debug("[domain] starting");
+            driver_thread_id_ = std::this_thread::get_id();
+            run();
+            debug("[domain] stopping");
+        });
+
+        init_future.get();
+    }
+
+inline
+    Domain::~Domain() {
+        // The domain keeps running until every region has left.
+        stop_requested_.store(true, std::memory_order_release);
+        doorbell_.ring();
+
+        if (config_.domain_embedded) {
+            while (running_) {
+                constexpr bool non_blocking = false;
+                iterate(non_blocking);
+            }
+        }
+        else {
+            thread_.join();
+        }
+
+        // Every region has left by now, so no more faults can happen.
+        if (write_barrier_thread_.joinable()) {
+            write_barrier_doorbell_->ring();
+            write_barrier_thread_.join();
+        }
+    }
+
+inline
+    const Config& Domain::config() const {
+        return config_;
+    }
+
+inline
+    auto Domain::snapshot_metrics() const -> Metrics {
+        std::scoped_lock lock(metrics_mutex_);
+
+        Metrics metrics = metrics_;
+        if (fallback_ledger_) {
+            metrics.fallback_operation_count = fallback_ledger_->written_count();
+        }
+
+        return metrics;
+    }
+
+inline
+    int Domain::file_descriptor() {
+        return selector_.file_descriptor();
+    }
+
+inline
+    void Domain::step(const bool non_blocking) {
+        assert(config_.domain_embedded && is_driven_here());
+
+        if (running_) {
+            iterate(non_blocking);
+        }
+    }
+
+inline
+    std::optional<std::chrono::nanoseconds> Domain::timeout() const {
+        return timeout_;
+    }
+
+inline
+    bool Domain::is_driven_here() const {
+        return config_.domain_embedded && (std::this_thread::get_id() == driver_thread_id_);
+    }
+
+inline
+    std::optional<size_t> Domain::numa_node() const {
+        return config_.numa_placement ? numa_node_ : std::nullopt;
+    }
+
+inline
+    void Domain::service_write_barriers() {
+        WriteBarrierManager& manager = *write_barrier_manager_;
+        int maintenance = 0; // Only its address is used, to tell the events apart.
+
+        Selector selector;
+        selector.add_watch(manager.file_descriptor(), &manager);
+        selector.add_watch(manager.maintenance_file_descriptor(), &maintenance);
+        selector.add_watch(write_barrier_doorbell_->file_descriptor(), write_barrier_doorbell_.get());
+
+        while (true) {
+            constexpr bool non_blocking = false;
+            for (void* user_data: selector.poll(non_blocking)) {
+                if (user_data == write_barrier_doorbell_.get()) {
+                    return;
+                }
+
+                if (user_data == &maintenance) {
+                    manager.maintain();
+                    continue;
+                }
+
+                while (manager.poll()) {
+                    // Handle every pending fault before going back to sleep.
+                }
+            }
+        }
+    }
+
+inline
+    WriteBarrierManager& Domain::write_barrier_manager() {
+        assert(write_barrier_manager_);
+        return *write_barrier_manager_;
+    }
+
+inline
+    ThreadPlacement* Domain::placement() {
+        return placement_.get();
+    }
+
+inline
+    FallbackLedger* Domain::fallback_ledger() {
+        return fallback_ledger_.get();
+    }
+
+inline
+    void Domain::run() {
+        running_ = true;
+
+        while (running_) {
+            constexpr bool non_blocking = false;
+            iterate(non_blocking);
+        }
+    }
+
+inline
+    void Domain::iterate(const bool non_blocking) {
+        std::optional<std::chrono::nanoseconds> timeout = non_blocking ? std::chrono::nanoseconds::zero() : timeout_;
+        if (non_blocking || !spin(timeout)) {
+            for (void* user_data: selector_.poll(timeout)) {
+                handle_event(user_data);
+            }
+
+            // Clusters with workers deliver what arrived for their regions themselves.
+            if (has_cluster_workers()) {
+                for_each_cluster([this](const size_t cluster_index) {
+                    for (Region* region: cluster_arrivals_[cluster_index]) {
+                        constexpr bool non_blocking = true;
+                        deliver_messages(*region, region->domain_endpoint().receive_messages(non_blocking));
+                    }
+
+                    cluster_arrivals_[cluster_index].clear();
+                });
+            }
+        }
+
+        // Alternate between checking if controllers need to transmit and 
+        // updating controller state until quiescent.
+        RegionControllerCensus census = combine_censuses();
+        while (true) {
+            update_controllers(census);
+
+            // Only controllers about to send have anything to do here.
+            for_each_cluster([this](const size_t cluster_index) {
+                if (!cluster_censuses_[cluster_index]->any(RegionControllerAction::SEND)) {
+                    return;
+                }
+
+                for (auto&& controller: cluster_controllers(cluster_index)) {
+                    if (is_sent_by_cluster(*controller)) {
+                        send_messages(controller->region_id());
+                    }
+                }
+            });
+
+            // Clusters leave regions that are leaving or have left to us.
+            for (size_t cluster_index = 0; cluster_index < cluster_censuses_.size(); ++cluster_index) {
+                const RegionControllerCensus& cluster_census = *cluster_censuses_[cluster_index];
+                if (!cluster_census.any(RegionControllerAction::SEND)) {
+                    continue;
+                }
+
+                if (!cluster_census.any(RegionControllerState::STOPPED) && !cluster_census.any(RegionControllerState::SHUTDOWN) && !cluster_census.any(RegionControllerState::VACANT)) {
+                    continue;
+                }
+
+                for (auto&& controller: cluster_controllers(cluster_index)) {
+                    if (!is_sent_by_cluster(*controller)) {
+                        send_messages(controller->region_id());
+                    }
+                }
+            }
+
+            // Take a fresh snapshot of the census and break if nothing changed.
+            if (std::exchange(census, combine_censuses()) == census) {
+                break;
+            }
+        }
+
+        // Every controller is between cycles, so their metrics are consistent with each other.
+        if (!controllers_.empty() && census.all(RegionControllerPhase::START) && (published_cycle_ != census.max_cycle())) {
+            publish_metrics(census);
+        }
+
+        // Wake up when the scheduler's answer could change, even if no messages arrive.
+        timeout_ = schedule_timeout(census);
+    }
+
+inline
+    void Domain::handle_event(void* user_data) {
+        constexpr bool non_blocking = true;
+
+        if (user_data == &doorbell_) {
+            // We'll add a controller for the new region later.
+            // Re-arm the doorbell now that we've awoken.
+            doorbell_.poll(non_blocking);
+        }
+        else if (has_cluster_workers()) {
+            Region* region = static_cast<Region*>(user_data);
+            cluster_arrivals_[region->id() / cluster_size_].push_back(region);
+        }
+        else {
+            Region& region = *static_cast<Region*>(user_data);
+            deliver_messages(region, region.domain_endpoint().receive_messages(non_blocking));
+        }
+    }
+
+inline
+    void Domain::deliver_messages(Region& region, const MessageBatch& messages) {
+        RegionController& controller = *controllers_[region.id()];
+        for (const Message& message: messages) {
+            debug("[region_controller:{}] received {}", region.id(), to_string(message.type));
+            trace(TraceSource::CONTROLLER, region.id(), TraceEventType::RECEIVE, static_cast<uint32_t>(message.type));
+            controller.receive_message(message);
+        }
+    }
+
+inline
+    void Domain::send_messages(const RegionId region_id) {
+        RegionController& controller = *controllers_[region_id];
+
+        while (std::optional<Message> message = controller.send_message()) {
+            Region* region = regions_[region_id];
+            if (!region) {
+                // The region has left, so we answer for it.
+                if (message->type == MessageType::RETIRE) {
+                    finalize_garbage(region_id, message->retire.garbage);
+                }
+                continue;
+            }
+
+            if ((message->type == MessageType::LEAVE) && message->leave.stop) {
+                detach_region(region_id, *message);
+            }
+            else if (region->domain_endpoint().send_message(*message)) {
+                debug("[region_controller:{}] sent {}", region_id, to_string(message->type));
+                trace(TraceSource::CONTROLLER, region_id, TraceEventType::SEND, static_cast<uint32_t>(message->type));
+            }
+            else {
+                abort();
+            }
+        }
+    }
+
+inline
+    void Domain::finalize_garbage(const RegionId region_id, ObjectGroups garbage) {
+        ObjectFinalizer& finalizer = *finalizers_[region_id];
+
+        garbage.for_each_group([&finalizer](ObjectGroup group, std::span<Object*> members) {
+            finalizer.finalize(group, members);
+        });
+
+        trace(TraceSource::CONTROLLER, region_id, TraceEventType::FINALIZE, 0, garbage.object_count);
+    }
+
+inline
+    bool Domain::spin(std::optional<std::chrono::nanoseconds>& timeout) {
+        using Clock = std::chrono::steady_clock;
+
+        if (config_.domain_spin_duration <= std::chrono::nanoseconds::zero()) {
+            return false;
+        }
+
+        const std::chrono::nanoseconds limit = timeout ? std::min(*timeout, config_.domain_spin_duration) : config_.domain_spin_duration;
+        const Clock::time_point start = Clock::now();
+
+        // Regions stay quiet while we spin, even when we leave to handle what arrived. We only
+        // let them know to ring again right before blocking.
+        set_spinning(true);
+
+        std::chrono::nanoseconds elapsed = std::chrono::nanoseconds::zero();
+        while (true) {
+            if (receive_pending_messages()) {
+                return true;
+            }
+
+            elapsed = Clock::now() - start;
+            if (elapsed >= limit) {
+                break;
+            }
+
+            cpu_relax();
+        }
+
+        set_spinning(false);
+
+        // A region may have sent something before it saw that we stopped, and not rung the doorbell.
+        if (receive_pending_messages()) {
+            return true;
+        }
+
+        if (timeout) {
+            timeout = std::max(*timeout - elapsed, std::chrono::nanoseconds::zero());
+        }
+
+        return false;
+    }
+
+inline
+    bool Domain::receive_pending_messages() {
+        bool received = false;
+
+        for (Region* region: regions_) {
+            if (!region) {
+                continue;
+            }
+
+            Endpoint& endpoint = region->domain_endpoint();
+            if (endpoint.has_messages()) {
+                deliver_messages(*region, endpoint.receive_pending_messages());
+                received = true;
+            }
+        }
+
+        // New regions ring the doorbell, which we don't want to read while spinning.
+        if (const size_t region_count = bound_region_count_.load(std::memory_order_acquire); region_count != spin_region_count_) {
+            spin_region_count_ = region_count;
+            received = true;
+        }
+
+        return received;
+    }
+
+inline
+    void Domain::set_spinning(const bool spinning) {
+        for (Region* region: regions_) {
+            if (region) {
+                region->domain_endpoint().set_spinning(spinning);
+            }
+        }
+    }
+
+inline
+    void Domain::update_controllers(const RegionControllerCensus& census) {
+        // Check if there are controllers that need to be started or stopped.
+        // This is safe to do while there isn't an active cycle.
+        if (controllers_.empty() || census.any(RegionControllerPhase::START)) {
+            std::scoped_lock lock(regions_mutex_);
+
+            if (!joining_regions_.empty()) {
+                start_controllers(census, lock);
+            }
+
+            stop_controllers(census, lock);
+
+            if (stop_requested_.load(std::memory_order_acquire) && (attached_region_count_ == 0) && joining_regions_.empty()) {
+                running_ = false;
+            }
+        }
+
+        if (!schedule_cycle(census)) {
+            return;
+        }
+
+        if (worker_pool_) {
+            parallelize_controllers(census);
+        }
+
+        // Synchronize at barrier phases, skipping clusters where no controller would move.
+        for_each_cluster([this, &census](const size_t cluster_index) {
+            if (!can_synchronize(*cluster_censuses_[cluster_index], census)) {
+                return;
+            }
+
+            for (auto&& controller: cluster_controllers(cluster_index)) {
+                controller->synchronize(census);
+            }
+        });
+
+        // Everything routed or applied in this step is done by now, workers included.
+        if (config_.ledger_recorder) {
+            config_.ledger_recorder->flush();
+        }
+    }
+
+inline
+    bool Domain::schedule_cycle(const RegionControllerCensus& census) {
+        if (controllers_.empty()) {
+            return true;
+        }
+
+        const CycleScheduler::Clock::time_point now = CycleScheduler::Clock::now();
+
+        if (census.all(RegionControllerPhase::START)) {
+            // Nobody has asked for a cycle. Start one anyway if it has been a while and operations
+            // may be in flight, otherwise they wait for the application to step again. Regions can
+            // have written operations we haven't seen yet, so one cycle is started after every
+            // requested one even if nothing was submitted.
+            const bool overdue = is_steady(census) && scheduler_.is_overdue(now);
+            if (overdue && (idle_cycle_armed_ || has_pending_operations())) {
+                controllers_.front()->request_start();
+
+                scheduler_.start(now);
+                admitted_cycle_ = census.max_cycle();
+                idle_cycle_armed_ = false;
+            }
+
+            return true;
+        }
+
+        if (census.any(RegionControllerPhase::START_BARRIER) && (admitted_cycle_ != census.max_cycle())) {
+            if (!scheduler_.may_start(now, false) && !is_start_urgent(census)) {
+                return false;
+            }
+
+            scheduler_.start(now);
+            admitted_cycle_ = census.max_cycle();
+            idle_cycle_armed_ = true;
+        }
+
+        return true;
+    }
+
+inline
+    std::optional<std::chrono::nanoseconds> Domain::schedule_timeout(const RegionControllerCensus& census) const {
+        if (controllers_.empty()) {
+            return std::nullopt;
+        }
+
+        const bool holding = census.any(RegionControllerPhase::START_BARRIER) && (admitted_cycle_ != census.max_cycle());
+        const bool pending = census.all(RegionControllerPhase::START)
+            && is_steady(census)
+            && (idle_cycle_armed_ || has_pending_operations());
+
+        return scheduler_.timeout(CycleScheduler::Clock::now(), holding, pending);
+    }
+
+inline
+    bool Domain::is_steady(const RegionControllerCensus& census) const {
+        return !census.any(RegionControllerState::STARTING)
+            && !census.any(RegionControllerState::STOPPING)
+            && !census.any(RegionControllerState::STOPPED);
+    }
+
+inline
+    RegionControllerCensus Domain::combine_censuses() const {
+        RegionControllerCensus census;
+        for (auto&& cluster_census: cluster_censuses_) {
+            census.add(*cluster_census);
+        }
+
+        return census;
+    }
+
+inline
+    std::span<const std::unique_ptr<RegionController>> Domain::cluster_controllers(const size_t cluster_index) const {
+        const size_t first = std::min(cluster_index * cluster_size_, controllers_.size());
+        return std::span(controllers_).subspan(first, std::min(cluster_size_, controllers_.size() - first));
+    }
+
+inline
+    bool Domain::has_cluster_workers() const {
+        return worker_pool_ && (cluster_censuses_.size() > 1);
+    }
+
+    template<typename Pass>
+    void Domain::for_each_cluster(Pass&& pass) {
+        if (has_cluster_workers()) {
+            worker_pool_->run(cluster_censuses_.size(), [&pass](const size_t cluster_index, size_t) {
+                pass(cluster_index);
+            });
+            return;
+        }
+
+        for (size_t cluster_index = 0; cluster_index < cluster_censuses_.size(); ++cluster_index) {
+            pass(cluster_index);
+        }
+    }
+
+inline
+    bool Domain::is_sent_by_cluster(const RegionController& controller) const {
+        // A stopped region is detached by its next message, and a region that has left has its garbage
+        // finalized here, possibly with a finalizer that other regions share.
+        return regions_[controller.region_id()] && (controller.state() != RegionControllerState::STOPPED);
+    }
+
+inline
+    bool Domain::is_start_urgent(const RegionControllerCensus& census) const {
+        // Don't hold up regions that are joining or leaving.
+        if (census.any(RegionControllerState::STARTING) || census.any(RegionControllerState::STOPPING)) {
+            return true;
+        }
+
+        if (census.any_urgent()) {
+            return true;
+        }
+
+        // Checked last, since it has to ask the kernel.
+        if (config_.cycle_pressure_rss && (resident_memory_size() >= config_.cycle_pressure_rss)) {
+            return true;
+        }
+
+        return false;
+    }
+
+inline
+    bool Domain::has_pending_operations() const {
+        for (auto&& controller: controllers_) {
+            if (controller->has_pending_operations()) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+inline
+    void Domain::parallelize_controllers(const RegionControllerCensus& census) {
+        // Every controller is about to leave the barrier in this round of synchronization.
+        // Do the work they would have done on their way out in parallel.
+        if (census.all(RegionControllerPhase::SUBMIT_BARRIER)) {
+            // Pipelined cycles apply what was routed in the previous cycle in the same pass.
+            const bool pipelined = config_.pipeline_cycles;
+            worker_pool_->run(controllers_.size(), [this, pipelined](size_t task_index, size_t worker_index) {
+                if (pipelined) {
+                    controllers_[task_index]->apply_operations();
+                }
+
+                controllers_[task_index]->route_operations(worker_index);
+            });
+        }
+        else if (census.all(RegionControllerPhase::RETIRE_BARRIER)) {
+            worker_pool_->run(controllers_.size(), [this](size_t task_index, size_t) {
+                controllers_[task_index]->apply_operations();
+            });
+        }
+    }
+
+inline
+    void Domain::start_controllers(const RegionControllerCensus& census, std::scoped_lock<std::mutex>&) {
+        std::vector<std::pair<RegionId, Region*>> deferred_regions;
+
+        for (auto [region_id, region]: joining_regions_) {
+            if (region_id < controllers_.size()) {
+                // Take over the controller of a region that has left, once it is between cycles.
+                RegionController& controller = *controllers_[region_id];
+                if (controller.phase() != RegionControllerPhase::START) {
+                    deferred_regions.emplace_back(region_id, region);
+                    continue;
+                }
+
+                controller.attach(region->ledger(), census.max_cycle());
+                regions_[region_id] = region;
+                finalizers_[region_id] = &region->finalizer_;
+            }
+            else {
+                // Create a controller to manage the region. New ids are handed out in order.
+                assert(region_id == controllers_.size());
+
+                ReferenceCountTable* reference_count_table = config_.reference_count_table ? reference_count_tables_[region_id].get() : nullptr;
+
+                auto controller = std::make_unique<RegionController>(region_id, controllers_, region->ledger(), config_, reference_count_table);
+                controller->start(census.max_cycle());
+
+                const size_t cluster_index = region_id / cluster_size_;
+                if (cluster_index == cluster_censuses_.size()) {
+                    cluster_censuses_.push_back(std::make_unique<RegionControllerCensus>());
+                    cluster_arrivals_.emplace_back();
+                }
+                controller->track(*cluster_censuses_[cluster_index]);
+
+                controllers_.push_back(std::move(controller));
+                regions_.push_back(region);
+                finalizers_.push_back(&region->finalizer_);
+            }
+
+            attached_region_count_ += 1;
+
+            // Monitor the connection associated with this region so we can wake up
+            // when it is readable and check for messages.
+            selector_.add_watch(region->domain_endpoint().file_descriptor(), region);
+        }
+
+        joining_regions_ = std::move(deferred_regions);
+    }
+
+inline
+    void Domain::stop_controllers(const RegionControllerCensus&, std::scoped_lock<std::mutex>&) {
+        // Each region stops as soon as its own operations have been flushed, whatever the others are doing.
+        for (size_t cluster_index = 0; cluster_index < cluster_censuses_.size(); ++cluster_index) {
+            const RegionControllerCensus& cluster_census = *cluster_censuses_[cluster_index];
+            if (!cluster_census.any(RegionControllerState::STOPPING) && !cluster_census.any(RegionControllerState::SHUTDOWN)) {
+                continue;
+            }
+
+            for (auto&& controller: cluster_controllers(cluster_index)) {
+                if ((controller->state() == RegionControllerState::STOPPING) && controller->is_quiescent()) {
+                    controller->stop();
+                }
+                else if ((controller->state() == RegionControllerState::SHUTDOWN) && controller->is_drained()) {
+                    controller->vacate();
+                    vacant_region_ids_.push_back(controller->region_id());
+                }
+            }
+        }
+    }
+
+inline
+    void Domain::detach_region(const RegionId region_id, const Message& message) {
+        std::scoped_lock lock(regions_mutex_);
+
+        // The region may go away as soon as it sees this message, even before we're done sending it.
+        // It waits for us in `unbind`, and we stop watching it before its file descriptor is closed.
+        Region& region = *regions_[region_id];
+        selector_.delete_watch(region.domain_endpoint().file_descriptor());
+
+        if (!region.domain_endpoint().send_message(message)) {
+            abort();
+        }
+        debug("[region_controller:{}] sent {}", region_id, to_string(message.type));
+        trace(TraceSource::CONTROLLER, region_id, TraceEventType::SEND, static_cast<uint32_t>(message.type));
+
+        regions_[region_id] = nullptr;
+        attached_region_count_ -= 1;
+    }
+
+inline
+    void Domain::publish_metrics(const RegionControllerCensus& census) {
+        std::scoped_lock lock(metrics_mutex_);
+
+        metrics_.cycle = census.max_cycle();
+        metrics_.regions.resize(controllers_.size());
+        metrics_.heap_census.clear();
+        for (size_t i = 0; i < controllers_.size(); ++i) {
+            const RegionController& controller = *controllers_[i];
+            const RegionController::Metrics& metrics = controller.metrics();
+
+            metrics_.regions[i] = RegionMetricsSnapshot {
+                .region_id         = controller.region_id(),
+                .state             = controller.state(),
+                .cycle_count       = metrics.cycle_count,
+                .phase_durations   = metrics.phase_durations,
+                .increment_count   = metrics.increment_count,
+                .decrement_count   = metrics.decrement_count,
+                .applied_count     = metrics.applied_count,
+                .apply_duration    = metrics.apply_duration,
+                .ledger_occupancy  = metrics.ledger_occupancy,
+                .ledger_capacity   = metrics.ledger_capacity,
+                .finalized_count   = metrics.finalized_count,
+                .operation_grouper = metrics.operation_grouper,
+                .object_grouper    = metrics.object_grouper,
+                .heap_census       = {},
+            };
+
+            if (const HeapCensus* heap_census = controller.heap_census()) {
+                metrics_.regions[i].heap_census.assign(heap_census->sample().begin(), heap_census->sample().end());
+                HeapCensus::merge(metrics_.heap_census, heap_census->sample());
+                if (heap_census->sample_cycle()) {
+                    metrics_.heap_census_cycle = std::max(metrics_.heap_census_cycle.value_or(0), *heap_census->sample_cycle());
+                }
+            }
+        }
+
+        published_cycle_ = census.max_cycle();
+    }
+
+inline
+    void Domain::bind(Region& region) {
+        std::scoped_lock lock(regions_mutex_);
+
+        RegionId region_id;
+        if (!vacant_region_ids_.empty()) {
+            region_id = vacant_region_ids_.back();
+            vacant_region_ids_.pop_back();
+        }
+        else {
+            region_id = next_region_id_++;
+        }
+
+        if (config_.reference_count_table) {
+            if (region_id == reference_count_tables_.size()) {
+                reference_count_tables_.push_back(std::make_unique<ReferenceCountTable>(config_.reference_count_table_capacity, numa_node()));
+            }
+
+            region.reference_count_table_ = reference_count_tables_[region_id].get();
+        }
+
+        region.id_ = region_id;
+        joining_regions_.emplace_back(region_id, &region);
+        bound_region_count_.fetch_add(1, std::memory_order_release);
+        doorbell_.ring();
+    }
+
+inline
+    void Domain::unbind(Region&) {
+        // The domain holds the lock while it detaches a region, so this returns once it is done.
+        std::scoped_lock lock(regions_mutex_);
+    }
+
+}
+
+
+// src/ledger_recording.cpp
+
+namespace mantle {
+
+    // A recording starts with a magic number and a version, followed by records that each start with
+    // one of the tags below. Integers are unsigned LEB128 varints:
+    //
+    //   CYCLE:     cycle                    Submissions that follow were routed in this cycle.
+    //   OBJECT:    region, group            Declares the next object id, counting up from zero.
+    //   SUBMIT:    region, count, ops...    The operations a region submitted. Each is the difference to
+    //                                       the previous object id in the record, zigzag encoded and
+    //                                       shifted left to make room for the tag of the operation.
+    //
+    inline constexpr std::array<uint8_t, 8> LEDGER_RECORDING_MAGIC = { 'M', 'A', 'N', 'T', 'L', 'E', 'L', 'R' };
+    inline constexpr uint8_t LEDGER_RECORDING_VERSION = 1;
+
+    inline constexpr uint8_t LEDGER_RECORDING_CYCLE  = 'C';
+    inline constexpr uint8_t LEDGER_RECORDING_OBJECT = 'O';
+    inline constexpr uint8_t LEDGER_RECORDING_SUBMIT = 'S';
+
+    inline void write_varint(std::vector<uint8_t>& record, uint64_t value) {
+        while (value >= 0x80) {
+            record.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+
+        record.push_back(static_cast<uint8_t>(value));
+    }
+
+    inline uint64_t to_zigzag(const int64_t value) {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    inline int64_t from_zigzag(const uint64_t value) {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    // Reads a recording from memory, failing softly at the end so a truncated record can be dropped.
+    class LedgerRecordingCursor {
+    public:
+        explicit LedgerRecordingCursor(std::span<const uint8_t> bytes)
+            : bytes_(bytes)
+            , offset_(0)
+        {
+        }
+
+        [[nodiscard]]
+        bool is_done() const {
+            return offset_ == bytes_.size();
+        }
+
+        [[nodiscard]]
+        bool read_byte(uint8_t& value) {
+            if (is_done()) {
+                return false;
+            }
+
+            value = bytes_[offset_++];
+            return true;
+        }
+
+        [[nodiscard]]
+        bool read_varint(uint64_t& value) {
+            value = 0;
+            for (uint32_t shift = 0; shift < 64; shift += 7) {
+                uint8_t byte;
+                if (!read_byte(byte)) {
+                    return false;
+                }
+
+                value |= uint64_t{byte & 0x7fu} << shift;
+                if ((byte & 0x80) == 0) {
+                    return true;
+                }
+            }
+
+            throw std::runtime_error("Malformed integer in ledger recording");
+        }
+
+    private:
+        std::span<const uint8_t> bytes_;
+        size_t                   offset_;
+    };
+
+inline
+    LedgerRecording LedgerRecording::read(std::istream& stream) {
+        const std::vector<uint8_t> bytes{std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>()};
+
+        if ((bytes.size() <= LEDGER_RECORDING_MAGIC.size()) || !std::equal(LEDGER_RECORDING_MAGIC.begin(), LEDGER_RECORDING_MAGIC.end(), bytes.begin())) {
+            throw std::runtime_error("Not a ledger recording");
+        }
+
+        if (bytes[LEDGER_RECORDING_MAGIC.size()] != LEDGER_RECORDING_VERSION) {
+            throw std::runtime_error("Unsupported ledger recording version");
+        }
+
+        LedgerRecording recording;
+        LedgerRecordingCursor cursor(std::span<const uint8_t>(bytes).subspan(LEDGER_RECORDING_MAGIC.size() + 1));
+
+        while (!cursor.is_done()) {
+            uint8_t tag;
+            if (!cursor.read_byte(tag)) {
+                break;
+            }
+
+            if (tag == LEDGER_RECORDING_CYCLE) {
+                uint64_t cycle;
+                if (!cursor.read_varint(cycle)) {
+                    break;
+                }
+
+                recording.cycles.push_back({ .cycle = cycle, .submissions = {} });
+            }
+            else if (tag == LEDGER_RECORDING_OBJECT) {
+                uint64_t region_id;
+                uint64_t group;
+                if (!cursor.read_varint(region_id) || !cursor.read_varint(group)) {
+                    break;
+                }
+
+                if ((region_id >= INVALID_REGION_ID) || (group > std::numeric_limits<ObjectGroup>::max())) {
+                    throw std::runtime_error("Malformed object in ledger recording");
+                }
+
+                recording.objects.push_back({
+                    .region_id = static_cast<RegionId>(region_id),
+                    .group     = static_cast<ObjectGroup>(group),
+                });
+            }
+            else if (tag == LEDGER_RECORDING_SUBMIT) {
+                uint64_t region_id;
+                uint64_t count;
+                if (!cursor.read_varint(region_id) || !cursor.read_varint(count)) {
+                    break;
+                }
+
+                if (recording.cycles.empty() || (region_id >= INVALID_REGION_ID)) {
+                    throw std::runtime_error("Malformed submission in ledger recording");
+                }
+
+                RecordedSubmission submission = {
+                    .region_id  = static_cast<RegionId>(region_id),
+                    .operations = {},
+                };
+
+                bool complete = true;
+                uint64_t object_id = 0;
+                for (uint64_t i = 0; i < count; ++i) {
+                    uint64_t value;
+                    if (!cursor.read_varint(value)) {
+                        complete = false;
+                        break;
+                    }
+
+                    object_id += static_cast<uint64_t>(from_zigzag(value >> Operation::TAG_BITS));
+                    if (object_id >= recording.objects.size()) {
+                        throw std::runtime_error("Undeclared object in ledger recording");
+                    }
+
+                    submission.operations.push_back({
+                        .object_id = object_id,
+                        .tag       = static_cast<uint8_t>(value & Operation::TAG_MASK),
+                    });
+                }
+
+                if (!complete) {
+                    break;
+                }
+
+                recording.cycles.back().submissions.push_back(std::move(submission));
+            }
+            else {
+                throw std::runtime_error("Unknown record in ledger recording");
+            }
+        }
+
+        return recording;
+    }
+
+inline
+    size_t LedgerRecording::region_count() const {
+        size_t count = 0;
+        for (const RecordedObject& object: objects) {
+            count = std::max<size_t>(count, object.region_id + 1);
+        }
+
+        for (const RecordedCycle& cycle: cycles) {
+            for (const RecordedSubmission& submission: cycle.submissions) {
+                count = std::max<size_t>(count, submission.region_id + 1);
+            }
+        }
+
+        return count;
+    }
+
+inline
+    size_t LedgerRecording::operation_count() const {
+        size_t count = 0;
+        for (const RecordedCycle& cycle: cycles) {
+            for (const RecordedSubmission& submission: cycle.submissions) {
+                count += submission.operations.size();
+            }
+        }
+
+        return count;
+    }
+
+inline
+    LedgerRecorder::LedgerRecorder(std::ostream& stream)
+        : stream_(stream)
+        , object_count_(0)
+        , operation_count_(0)
+    {
+        stream_.write(reinterpret_cast<const char*>(LEDGER_RECORDING_MAGIC.data()), LEDGER_RECORDING_MAGIC.size());
+        stream_.put(static_cast<char>(LEDGER_RECORDING_VERSION));
+    }
+
+inline
+    LedgerRecorder::~LedgerRecorder() {
+        flush();
+        stream_.flush();
+    }
+
+inline
+    size_t LedgerRecorder::operation_count() const {
+        return operation_count_;
+    }
+
+inline
+    size_t LedgerRecorder::object_count() const {
+        return object_count_;
+    }
+
+inline
+    void LedgerRecorder::add_region(const RegionId region_id) {
+        while (buffers_.size() <= region_id) {
+            buffers_.push_back(std::make_unique<Buffer>());
+        }
+    }
+
+inline
+    void LedgerRecorder::flush() {
+        record_.clear();
+
+        for (size_t region_id = 0; region_id < buffers_.size(); ++region_id) {
+            Buffer& buffer = *buffers_[region_id];
+            if (buffer.operations.empty()) {
+                continue;
+            }
+
+            if (cycle_ != buffer.cycle) {
+                record_.push_back(LEDGER_RECORDING_CYCLE);
+                write_varint(record_, buffer.cycle);
+                cycle_ = buffer.cycle;
+            }
+
+            // Objects are declared before the submission that first uses them.
+            for (const RoutedOperation& routed: buffer.operations) {
+                const Object* object = routed.operation.object();
+                if (object_ids_.try_emplace(object, object_count_).second) {
+                    record_.push_back(LEDGER_RECORDING_OBJECT);
+                    write_varint(record_, routed.owner_id);
+                    write_varint(record_, object->group());
+                    object_count_ += 1;
+                }
+            }
+
+            record_.push_back(LEDGER_RECORDING_SUBMIT);
+            write_varint(record_, region_id);
+            write_varint(record_, buffer.operations.size());
+
+            uint64_t previous_id = 0;
+            for (const RoutedOperation& routed: buffer.operations) {
+                const Operation operation = routed.operation;
+                const uint64_t object_id = object_ids_.find(operation.object())->second;
+
+                const uint64_t delta = to_zigzag(static_cast<int64_t>(object_id - previous_id));
+                write_varint(record_, (delta << Operation::TAG_BITS) | (operation.tagged_pointer_ & Operation::TAG_MASK));
+                previous_id = object_id;
+            }
+
+            operation_count_ += buffer.operations.size();
+            buffer.operations.clear();
+        }
+
+        // The dead can't have been routed to after they died, so this is safe to do after the above.
+        // Their addresses may be reused once they are finalized.
+        for (const std::unique_ptr<Buffer>& buffer: buffers_) {
+            for (const Object* object: buffer->released_objects) {
+                object_ids_.erase(object);
+            }
+
+            buffer->released_objects.clear();
+        }
+
+        if (!record_.empty()) {
+            stream_.write(reinterpret_cast<const char*>(record_.data()), static_cast<std::streamsize>(record_.size()));
+        }
+    }
+
+    struct LedgerReplay::ReplayedObject : Object {
+        ReplayedObject(const ObjectGroup group, const uint64_t id)
+            : Object(group)
+            , id(id)
+        {
+        }
+
+        uint64_t id;
+    };
+
+inline
+    LedgerReplay::LedgerReplay(const LedgerRecording& recording, const Config& config)
+        : recording_(recording)
+        , config_(config)
+        , metrics_{}
+        , finished_(false)
+        , objects_(recording.objects.size(), nullptr)
+        , created_(recording.objects.size(), false)
+    {
+        config_.domain_worker_count = 0;
+        config_.reference_count_table = false;
+        config_.ledger_recorder = nullptr;
+        config_.heap_census_interval = 0;
+
+        const size_t region_count = recording.region_count();
+
+        // Every region's ledger holds its two most recent submissions, padded and possibly escaped.
+        std::vector<size_t> largest_submissions(region_count, 0);
+        for (const RecordedCycle& cycle: recording.cycles) {
+            for (const RecordedSubmission& submission: cycle.submissions) {
+                size_t& largest = largest_submissions[submission.region_id];
+                largest = std::max(largest, submission.operations.size());
+            }
+        }
+
+        const size_t entry_count = (config_.ledger_encoding == LedgerEncoding::COMPACT) ? CompactOperation::ESCAPED_SIZE : 1;
+        for (RegionId region_id = 0; region_id < region_count; ++region_id) {
+            const size_t capacity = 2 * ((largest_submissions[region_id] * entry_count) + CompactOperationBatch::SIZE);
+
+            ledgers_.push_back(std::make_unique<OperationLedger>(
+                std::max(config_.ledger_capacity, capacity),
+                config_.ledger_huge_pages,
+                std::nullopt,
+                config_.ledger_decommit_fill,
+                config_.ledger_decommit_cycles,
+                config_.ledger_encoding
+            ));
+
+            controllers_.push_back(std::make_unique<RegionController>(region_id, controllers_, *ledgers_.back(), config_));
+        }
+
+        submitted_ranges_.assign(region_count, EMPTY_SEQUENCE_RANGE);
+    }
+
+inline
+    LedgerReplay::~LedgerReplay() {
+        // Whatever is still alive was still referenced when the recording ended.
+        for (ReplayedObject* object: objects_) {
+            delete object;
+        }
+    }
+
+inline
+    LedgerReplayMetrics LedgerReplay::run() {
+        if (finished_) {
+            throw std::logic_error("A ledger replay can only be run once");
+        }
+        finished_ = true;
+
+        const auto start = std::chrono::steady_clock::now();
+
+        for (const RecordedCycle& cycle: recording_.cycles) {
+            run_cycle(&cycle);
+        }
+
+        // Keep going until the last decrements have made their way through the pipeline.
+        auto is_pending = [this]() {
+            return std::any_of(controllers_.begin(), controllers_.end(), [](const std::unique_ptr<RegionController>& controller) {
+                return controller->has_pending_operations();
+            });
+        };
+
+        while (is_pending()) {
+            run_cycle(nullptr);
+        }
+
+        metrics_.duration = std::chrono::steady_clock::now() - start;
+
+        for (const std::unique_ptr<RegionController>& controller: controllers_) {
+            const RegionControllerMetrics& metrics = controller->metrics();
+
+            metrics_.operation_count += metrics.increment_count + metrics.decrement_count;
+            metrics_.applied_count += metrics.applied_count;
+            metrics_.apply_duration += metrics.apply_duration;
+
+            metrics_.operation_grouper.grouped_count += metrics.operation_grouper.grouped_count;
+            metrics_.operation_grouper.written_count += metrics.operation_grouper.written_count;
+            metrics_.operation_grouper.written_increment_count += metrics.operation_grouper.written_increment_count;
+            metrics_.operation_grouper.written_decrement_count += metrics.operation_grouper.written_decrement_count;
+            metrics_.operation_grouper.flushed_count += metrics.operation_grouper.flushed_count;
+            metrics_.operation_grouper.flushed_increment_count += metrics.operation_grouper.flushed_increment_count;
+            metrics_.operation_grouper.flushed_decrement_count += metrics.operation_grouper.flushed_decrement_count;
+            metrics_.operation_grouper.evicted_count += metrics.operation_grouper.evicted_count;
+            metrics_.operation_grouper.cache_capacity += metrics.operation_grouper.cache_capacity;
+            metrics_.operation_grouper.resize_count += metrics.operation_grouper.resize_count;
+        }
+
+        return metrics_;
+    }
+
+inline
+    Object& LedgerReplay::object(const uint64_t object_id) {
+        ReplayedObject*& object = objects_[object_id];
+        if (!object) {
+            const RecordedObject& recorded = recording_.objects[object_id];
+
+            object = new ReplayedObject(recorded.group, object_id);
+            object->bind(recorded.region_id);
+
+            if (created_[object_id]) {
+                metrics_.revived_count += 1;
+            }
+            created_[object_id] = true;
+        }
+
+        return *object;
+    }
+
+inline
+    void LedgerReplay::run_cycle(const RecordedCycle* cycle) {
+        using Phase = RegionControllerPhase;
+
+        // Regions write their transactions before the cycle starts, like they would between steps.
+        for (RegionId region_id = 0; region_id < ledgers_.size(); ++region_id) {
+            ledgers_[region_id]->begin_transaction();
+        }
+
+        if (cycle) {
+            for (const RecordedSubmission& submission: cycle->submissions) {
+                OperationLedger& ledger = *ledgers_[submission.region_id];
+
+                for (const RecordedOperation& recorded: submission.operations) {
+                    const Operation operation = {
+                        .tagged_pointer_ = reinterpret_cast<uintptr_t>(&object(recorded.object_id)) | recorded.tag,
+                    };
+
+                    if (!ledger.write(operation)) {
+                        throw std::runtime_error("Ledger recording doesn't fit in the replay ledger");
+                    }
+                }
+            }
+        }
+
+        for (RegionId region_id = 0; region_id < ledgers_.size(); ++region_id) {
+            submitted_ranges_[region_id] = ledgers_[region_id]->commit_transaction();
+        }
+
+        // Routing skips operations of the other type, so the whole range is submitted as both.
+        const Sequence next_cycle = controllers_.front()->cycle() + 1;
+        controllers_.front()->request_start();
+
+        for (;;) {
+            const RegionControllerCensus census = synchronize(controllers_);
+            if (census.all(Phase::START) && (census.min_cycle() == next_cycle)) {
+                break;
+            }
+
+            for (const std::unique_ptr<RegionController>& controller: controllers_) {
+                while (const std::optional<Message> message = controller->send_message()) {
+                    if (message->type == MessageType::RETIRE) {
+                        finalize(message->retire.garbage);
+                    }
+                }
+
+                if (controller->phase() == Phase::SUBMIT) {
+                    const SequenceRange range = submitted_ranges_[controller->region_id()];
+
+                    controller->receive_message(Message {
+                        .submit = {
+                            .type                = MessageType::SUBMIT,
+                            .stop                = false,
+                            .increments          = range,
+                            .decrements          = range,
+                            .increment_partition = nullptr,
+                            .decrement_partition = nullptr,
+                            .increment_spill     = nullptr,
+                            .decrement_spill     = nullptr,
+                            .barrier             = nullptr,
+                            .finalized_count     = metrics_.finalized_count,
+                            .bound_count         = 0,
+                            .released_count      = 0,
+                            .heap_census         = nullptr,
+                        },
+                    });
+                }
+            }
+        }
+
+        metrics_.cycle_count += 1;
+    }
+
+inline
+    void LedgerReplay::finalize(ObjectGroups garbage) {
+        const auto start = std::chrono::steady_clock::now();
+
+        garbage.for_each_group([this](ObjectGroup, std::span<Object*> members) {
+            for (Object* member: members) {
+                ReplayedObject* object = static_cast<ReplayedObject*>(member);
+                objects_[object->id] = nullptr;
+                delete object;
+            }
+        });
+
+        metrics_.finalized_count += garbage.object_count;
+        metrics_.finalize_duration += std::chrono::steady_clock::now() - start;
+    }
+
+}
+
+
+// src/ledger.cpp
+
+namespace mantle {
+
+    PrivateMemoryMapping::PrivateMemoryMapping(const size_t size, const bool populate) {
+        assert(size >= PAGE_SIZE);
+        assert((size % PAGE_SIZE) == 0);
+
+        void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (address == MAP_FAILED) {
+            throw std::runtime_error("mmap failed");
+        }
+
+        memory_ = std::span(static_cast<std::byte*>(address), size);
+
+        if (populate) {
+            this->populate(size);
+        }
+    }
+
+    PrivateMemoryMapping::~PrivateMemoryMapping() {
+        const int result = munmap(memory_.data(), memory_.size());
+        assert(result >= 0);
+    }
+
+    std::span<std::byte> PrivateMemoryMapping::memory() {
+        return memory_;
+    }
+
+    std::span<const std::byte> PrivateMemoryMapping::memory() const {
+        return memory_;
+    }
+
+    void PrivateMemoryMapping::populate(const size_t size) {
+        assert(size <= memory_.size());
+
+        // Kernels before 5.14 don't know this advice, so fall back to touching each page.
+        if (madvise(memory_.data(), size, MADV_POPULATE_WRITE) == 0) {
+            return;
+        }
+
+        for (size_t i = 0; i < size; i += PAGE_SIZE) {
+            const_cast<volatile std::byte&>(memory_[i]) = std::byte{0};
+        }
+    }
+
+    void PrivateMemoryMapping::release(const size_t size) {
+        assert(size <= memory_.size());
+        assert((size % PAGE_SIZE) == 0);
+
+        // Unlike MADV_FREE, this takes the pages off our RSS straight away.
+        const int result = madvise(memory_.data(), size, MADV_DONTNEED);
+        assert(result >= 0);
+        (void)result;
+    }
+
+    WriteBarrierSegment::WriteBarrierSegment()
+        : prev(nullptr)
+        , barrier(nullptr)
+        , primed(false)
+        , resident(true)
+        , increment_count(0)
+        , decrement_count(0)
+        , mapping(WRITE_BARRIER_CAPACITY * sizeof(Operation), true)
+    {
+    }
+
+    Operation* WriteBarrierSegment::cursor() {
+        return &operations()[increment_count + decrement_count];
+    }
+
+    const Operation* WriteBarrierSegment::cursor() const {
+        return reinterpret_cast<const Operation*>(mapping.memory().data()) + increment_count + decrement_count;
+    }
+
+    std::span<Operation> WriteBarrierSegment::operations() {
+        return std::span{reinterpret_cast<Operation*>(mapping.memory().data()), mapping.memory().size_bytes() / sizeof(Operation)};
+    }
+
+    std::span<std::byte> WriteBarrierSegment::guard_page() {
+        return mapping.memory().last(PAGE_SIZE);
+    }
+
+    void WriteBarrierSegment::populate() {
+        if (!resident) {
+            mapping.populate(mapping.memory().size() - PAGE_SIZE);
+            resident = true;
+        }
+    }
+
+    void WriteBarrierSegment::release() {
+        if (resident) {
+            mapping.release(mapping.memory().size() - PAGE_SIZE);
+            resident = false;
+        }
+    }
+
+    std::span<const Operation> WriteBarrierSegment::committed_operations() const {
+        return std::span{reinterpret_cast<const Operation*>(mapping.memory().data()), increment_count + decrement_count};
+    }
+
+    WriteBarrier::WriteBarrier(Ledger& ledger, const size_t phase_shift)
+        : ledger_(ledger)
+        , phase_shift_(phase_shift)
+        , stack_(nullptr)
+    {
+        assert(phase_shift_ < WRITE_BARRIER_PHASE_COUNT);
+    }
+
+    WriteBarrier::~WriteBarrier() {
+        assert(is_empty());
+    }
+
+    Ledger& WriteBarrier::ledger() {
+        return ledger_;
+    }
+
+    auto WriteBarrier::phase() const -> Phase {
+        return static_cast<Phase>((ledger_.sequence() + phase_shift_) % WRITE_BARRIER_PHASE_COUNT);
+    }
+
+    bool WriteBarrier::is_empty() const {
+        return stack_ == nullptr;
+    }
+
+    WriteBarrierSegment* WriteBarrier::back() {
+        return stack_;
+    }
+
+    const WriteBarrierSegment* WriteBarrier::back() const {
+        return stack_;
+    }
+
+    void WriteBarrier::push_back(WriteBarrierSegment& segment) {
+        assert(!segment.barrier);
+        assert(!segment.prev);
+        assert(segment.increment_count == 0);
+        assert(segment.decrement_count == 0);
+        assert(segment.primed);
+
+        segment.barrier = this;
+        segment.prev = stack_;
+
+        switch (phase()) {
+            case WriteBarrierPhase::STORE_INCREMENTS: {
+                ledger_.increment_cursor().store(segment.cursor(), std::memory_order_release);
+                break;
+            }
+            case WriteBarrierPhase::STORE_DECREMENTS: {
+                ledger_.decrement_cursor().store(segment.cursor(), std::memory_order_release);
+                break;
+            }
+            default: {
+                break; // This segment is not active.
+            }
+        }
+
+        stack_ = &segment;
+    }
+
+    WriteBarrierSegment* WriteBarrier::pop_back() {
+        if (!stack_) {
+            return nullptr;
+        }
+
+        switch (phase()) {
+            case WriteBarrierPhase::STORE_INCREMENTS: {
+                ledger_.increment_cursor().store(nullptr, std::memory_order_release);
+                break;
+            }
+            case WriteBarrierPhase::STORE_DECREMENTS: {
+                ledger_.decrement_cursor().store(nullptr, std::memory_order_release);
+                break;
+            }
+            default: {
+                break; // This segment is not active.
+            }
+        }
+
+        return std::exchange(stack_, stack_->prev);
+    }
+
+    void WriteBarrier::commit(const bool pending_write) {
+        assert(stack_);
+
+        if (pending_write) {
+            stack_->primed = false;
+        }
+
+        switch (phase()) {
+            case Phase::STORE_INCREMENTS: {
+                auto first = stack_->cursor();
+                auto last = ledger_.increment_cursor().load(std::memory_order_acquire);
+                stack_->increment_count = last - first;
+                break;
+            }
+            case Phase::STORE_DECREMENTS: {
+                auto first = stack_->cursor();
+                auto last = ledger_.decrement_cursor().load(std::memory_order_acquire);
+                stack_->decrement_count = last - first;
+                break;
+            }
+            default: {
+                abort();
+            }
+        }
+    }
+
+    size_t WriteBarrier::increment_count() const {
+        size_t count = 0;
+
+        for (const WriteBarrierSegment* segment = stack_; segment; segment = segment->prev) {
+            count += segment->increment_count;
+        }
+
+        return count;
+    }
+
+    size_t WriteBarrier::decrement_count() const {
+        size_t count = 0;
+
+        for (const WriteBarrierSegment* segment = stack_; segment; segment = segment->prev) {
+            count += segment->decrement_count;
+        }
+
+        return count;
+    }
+
+    WriteBarrierManager::WriteBarrierManager(const size_t low_watermark, const size_t high_watermark)
+        : low_watermark_(low_watermark)
+        , high_watermark_(std::max(low_watermark, high_watermark))
+        , maintenance_requested_(false)
+        , demand_allocation_count_(0)
+    {
+        // Fill the pool on the first call to `maintain`.
+        if (low_watermark_ > 0) {
+            std::scoped_lock lock(segment_pool_mutex_);
+            request_maintenance();
+        }
+    }
+
+    int WriteBarrierManager::file_descriptor() {
+        return page_fault_handler_.file_descriptor();
+    }
+
+    int WriteBarrierManager::maintenance_file_descriptor() {
+        return maintenance_doorbell_.file_descriptor();
+    }
+
+    bool WriteBarrierManager::poll() {
+        return page_fault_handler_.poll([this](std::span<const std::byte> memory, PageFaultHandler::Mode mode) {
+            if (mode == PageFaultHandler::Mode::WRITE_PROTECT) {
+                WriteBarrierSegment* prev_segment;
+                memcpy(&prev_segment, memory.data(), sizeof(prev_segment));
+
+                WriteBarrier& barrier = *prev_segment->barrier;
+                barrier.commit(true);
+
+                WriteBarrierSegment& next_segment = allocate_segment();
+                assert(next_segment.primed);
+                barrier.push_back(next_segment);
+
+                // Allow the pending write to proceed now that the next segment has been installed.
+                page_fault_handler_.write_unprotect_memory(prev_segment->guard_page());
+            }
+            else {
+                abort();
+            }
+        });
+    }
+
+    void WriteBarrierManager::maintain() {
+        {
+            std::scoped_lock lock(segment_pool_mutex_);
+
+            constexpr bool non_blocking = true;
+            maintenance_doorbell_.poll(non_blocking);
+            maintenance_requested_ = false;
+        }
+
+        // Segments are taken out of the pool while their pages are populated or released, so that
+        // the (slow) system calls don't hold up threads that are swapping segments.
+        std::vector<WriteBarrierSegment*> unprimed_segments;
+        {
+            std::scoped_lock lock(segment_pool_mutex_);
+            std::erase_if(segment_pool_, [&](WriteBarrierSegment* segment) {
+                if (segment->primed) {
+                    return false;
+                }
+
+                unprimed_segments.push_back(segment);
+                return true;
+            });
+        }
+
+        // Segments come back unprimed when a write ran into their guard page.
+        for (WriteBarrierSegment* segment: unprimed_segments) {
+            prime_guard_page(*segment);
+
+            std::scoped_lock lock(segment_pool_mutex_);
+            segment_pool_.push_back(segment);
+        }
+
+        while (true) {
+            WriteBarrierSegment* segment = nullptr;
+            {
+                std::scoped_lock lock(segment_pool_mutex_);
+                if (segment_pool_.size() <= high_watermark_) {
+                    break;
+                }
+
+                segment = segment_pool_.back();
+                segment_pool_.pop_back();
+            }
+
+            segment->release();
+
+            std::scoped_lock lock(segment_pool_mutex_);
+            released_segment_pool_.push_back(segment);
+        }
+
+        while (true) {
+            WriteBarrierSegment* segment = nullptr;
+            {
+                std::scoped_lock lock(segment_pool_mutex_);
+                if (segment_pool_.size() >= low_watermark_) {
+                    break;
+                }
+
+                if (!released_segment_pool_.empty()) {
+                    segment = released_segment_pool_.back();
+                    released_segment_pool_.pop_back();
+                }
+            }
+
+            if (segment) {
+                segment->populate();
+            }
+            else {
+                segment = &create_segment();
+            }
+
+            std::scoped_lock lock(segment_pool_mutex_);
+            segment_pool_.push_back(segment);
+        }
+    }
+
+    auto WriteBarrierManager::metrics() -> Metrics {
+        std::scoped_lock lock(segment_pool_mutex_);
+
+        return {
+            .segment_count           = segment_pool_storage_.size(),
+            .resident_count          = segment_pool_.size(),
+            .released_count          = released_segment_pool_.size(),
+            .demand_allocation_count = demand_allocation_count_,
+        };
+    }
+
+    void WriteBarrierManager::attach(WriteBarrier& barrier) {
+        WriteBarrierSegment& segment = allocate_segment();
+        barrier.push_back(segment);
+    }
+
+    void WriteBarrierManager::detach(WriteBarrier& barrier) {
+        while (WriteBarrierSegment* segment = barrier.pop_back()) {
+            deallocate_segment(*segment);
+        }
+    }
+
+    void WriteBarrierManager::reset(WriteBarrier& barrier) {
+        // Segments go back on top of the pool, so this usually hands back the one we just returned.
+        detach(barrier);
+        attach(barrier);
+    }
+
+    void WriteBarrierManager::prime_guard_page(WriteBarrierSegment& segment) {
+        if (segment.primed) {
+            return;
+        }
+
+        const WriteBarrierSegment* segment_address = &segment;
+        std::span<std::byte> guard_page = segment.guard_page();
+        memcpy(guard_page.data(), &segment_address, sizeof(segment_address));
+
+        page_fault_handler_.write_protect_memory(guard_page);
+        segment.primed = true;
+    }
+
+    WriteBarrierSegment& WriteBarrierManager::create_segment() {
+        auto segment = std::make_unique<WriteBarrierSegment>();
+        page_fault_handler_.register_memory(segment->guard_page(), {PageFaultHandler::Mode::WRITE_PROTECT});
+        prime_guard_page(*segment);
+
+        std::scoped_lock lock(segment_pool_mutex_);
+        return *segment_pool_storage_.emplace_back(std::move(segment));
+    }
+
+    WriteBarrierSegment& WriteBarrierManager::allocate_segment() {
+        WriteBarrierSegment* segment = nullptr;
+        {
+            std::scoped_lock lock(segment_pool_mutex_);
+
+            if (LIKELY(!segment_pool_.empty())) {
+                segment = segment_pool_.back();
+                segment_pool_.pop_back();
+            }
+            else if (!released_segment_pool_.empty()) {
+                segment = released_segment_pool_.back();
+                released_segment_pool_.pop_back();
+                demand_allocation_count_ += 1;
+            }
+            else {
+                demand_allocation_count_ += 1;
+            }
+
+            if (segment_pool_.size() < low_watermark_) {
+                request_maintenance();
+            }
+        }
+
+        if (UNLIKELY(!segment)) {
+            return create_segment();
+        }
+
+        segment->populate();
+        prime_guard_page(*segment);
+        return *segment;
+    }
+
+    void WriteBarrierManager::deallocate_segment(WriteBarrierSegment& segment) {
+        std::scoped_lock lock(segment_pool_mutex_);
+
+        segment.barrier = nullptr;
+        segment.prev = nullptr;
+        segment.increment_count = 0;
+        segment.decrement_count = 0;
+
+        segment_pool_.push_back(&segment);
+        if (!segment.primed || (segment_pool_.size() > high_watermark_)) {
+            request_maintenance();
+        }
+    }
+
+    void WriteBarrierManager::request_maintenance() {
+        // Only ring once per call to `maintain`, since this happens on the writing threads.
+        if (!maintenance_requested_) {
+            maintenance_requested_ = true;
+            maintenance_doorbell_.ring();
+        }
+    }
+
+    Ledger::Ledger(WriteBarrierManager& write_barrier_manager)
+        : sequence_(0)
+        , increment_cursor_(local_increment_cursor())
+        , decrement_cursor_(local_decrement_cursor())
+        , write_barriers_{
+            WriteBarrier{*this, 0},
+            WriteBarrier{*this, 1},
+            WriteBarrier{*this, 2},
+            WriteBarrier{*this, 3},
+        }
+        , write_barrier_manager_(write_barrier_manager)
+    {
+        for (auto&& barrier : write_barriers_) {
+            write_barrier_manager_.attach(barrier);
+        }
+    }
+
+    Ledger::~Ledger() {
+        for (auto&& barrier : write_barriers_) {
+            write_barrier_manager_.detach(barrier);
+        }
+    }
+
+    Sequence Ledger::sequence() const {
+        return sequence_.load(std::memory_order_acquire);
+    }
+
+    auto Ledger::increment_cursor() -> Cursor& {
+        return increment_cursor_;
+    }
+
+    auto Ledger::decrement_cursor() -> Cursor& {
+        return decrement_cursor_;
+    }
+
+    WriteBarrier& Ledger::barrier(const WriteBarrierPhase phase) {
+        return const_cast<WriteBarrier&>(std::as_const(*this).barrier(phase));
+    }
+
+    const WriteBarrier& Ledger::barrier(const WriteBarrierPhase phase) const {
+        const Sequence sequence = sequence_.load(std::memory_order_acquire);
+
+        const WriteBarrier& barrier = write_barriers_[(static_cast<uint64_t>(phase) - sequence) % WRITE_BARRIER_PHASE_COUNT];
+        assert(phase == barrier.phase());
+        return barrier;
+    }
+
+    WriteBarrier& Ledger::increment_barrier() {
+        return barrier(WriteBarrierPhase::STORE_INCREMENTS);
+    }
+
+    WriteBarrier& Ledger::decrement_barrier() {
+        return barrier(WriteBarrierPhase::STORE_DECREMENTS);
+    }
+
+    WriteBarrier& Ledger::apply_barrier() {
+        return barrier(WriteBarrierPhase::APPLY);
+    }
+
+    bool Ledger::is_empty() const {
+        for (const WriteBarrier& barrier: write_barriers_) {
+            // The barrier in the APPLY phase has already been committed.
+            if (barrier.phase() == WriteBarrierPhase::APPLY) {
+                continue;
+            }
+
+            if ((barrier.increment_count() != 0) || (barrier.decrement_count() != 0)) {
+                return false;
+            }
+        }
+
+        // Check for operations written since the last step.
+        const bool has_increments = increment_cursor_.load(std::memory_order_acquire) != barrier(WriteBarrierPhase::STORE_INCREMENTS).back()->cursor();
+        const bool has_decrements = decrement_cursor_.load(std::memory_order_acquire) != barrier(WriteBarrierPhase::STORE_DECREMENTS).back()->cursor();
+        return !has_increments && !has_decrements;
+    }
+
+    void Ledger::step() {
+        increment_barrier().commit(false);
+        decrement_barrier().commit(false);
+
+        sequence_.fetch_add(1, std::memory_order_acq_rel);
+
+        // The barrier that was applied last time starts over, collecting decrements.
+        write_barrier_manager_.reset(decrement_barrier());
+
+        increment_cursor_.store(increment_barrier().back()->cursor(), std::memory_order_release);
+        decrement_cursor_.store(decrement_barrier().back()->cursor(), std::memory_order_release);
+    }
+
+}
+
+
+// src/topology.cpp
+
+namespace mantle {
+
+    inline std::optional<std::string> read_sysfs_line(const std::string& path) {
+        std::ifstream stream(path);
+
+        std::string line;
+        if (!std::getline(stream, line)) {
+            return std::nullopt;
+        }
+
+        return line;
+    }
+
+    // The CPUs that are online and that this process is allowed to run on.
+    inline std::vector<size_t> usable_cpus() {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+            throw std::runtime_error("Failed to get cpu affinity");
+        }
+
+        std::vector<size_t> cpus;
+        if (const std::optional<std::string> online = read_sysfs_line("/sys/devices/system/cpu/online")) {
+            cpus = parse_cpu_list(*online);
+        }
+        else {
+            for (size_t cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        }
+
+        std::erase_if(cpus, [&](const size_t cpu) {
+            return (cpu >= CPU_SETSIZE) || !CPU_ISSET(cpu, &allowed);
+        });
+
+        return cpus;
+    }
+
+    // The CPUs that share the highest level data or unified cache of this one.
+    inline std::optional<std::string> last_level_cache(const size_t cpu) {
+        std::optional<std::string> shared_cpus;
+        size_t shared_level = 0;
+
+        for (size_t index = 0;; ++index) {
+            const std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/cache/index" + std::to_string(index) + "/";
+
+            const std::optional<std::string> level = read_sysfs_line(path + "level");
+            if (!level) {
+                break;
+            }
+
+            if (read_sysfs_line(path + "type") == "Instruction") {
+                continue;
+            }
+
+            const size_t value = std::stoul(*level);
+            if (const std::optional<std::string> list = read_sysfs_line(path + "shared_cpu_list"); list && (value >= shared_level)) {
+                shared_cpus = list;
+                shared_level = value;
+            }
+        }
+
+        return shared_cpus;
+    }
+
+    inline std::map<size_t, size_t> numa_nodes_by_cpu() {
+        std::map<size_t, size_t> nodes;
+
+        std::error_code error;
+        for (const std::filesystem::directory_entry& entry: std::filesystem::directory_iterator("/sys/devices/system/node", error)) {
+            const std::string name = entry.path().filename().string();
+            if (!name.starts_with("node") || (name.size() == 4) || !std::all_of(name.begin() + 4, name.end(), [](const char c) { return std::isdigit(static_cast<unsigned char>(c)) != 0; })) {
+                continue;
+            }
+
+            const size_t node = std::stoul(name.substr(4));
+            if (const std::optional<std::string> list = read_sysfs_line(entry.path().string() + "/cpulist")) {
+                for (const size_t cpu: parse_cpu_list(*list)) {
+                    nodes[cpu] = node;
+                }
+            }
+        }
+
+        return nodes;
+    }
+
+inline
+    CpuTopology::CpuTopology(std::vector<CacheGroup> groups)
+        : groups_(std::move(groups))
+    {
+        std::erase_if(groups_, [](const CacheGroup& group) { return group.cpus.empty(); });
+
+        for (CacheGroup& group: groups_) {
+            std::sort(group.cpus.begin(), group.cpus.end());
+        }
+
+        std::sort(groups_.begin(), groups_.end(), [](const CacheGroup& lhs, const CacheGroup& rhs) {
+            return lhs.cpus.front() < rhs.cpus.front();
+        });
+    }
+
+inline
+    CpuTopology CpuTopology::detect() {
+        const std::map<size_t, size_t> nodes = numa_nodes_by_cpu();
+
+        // Keyed by the list of CPUs sharing the cache, including ones we can't use.
+        std::map<std::string, CacheGroup> groups;
+        for (const size_t cpu: usable_cpus()) {
+            const std::string key = last_level_cache(cpu).value_or("cpu" + std::to_string(cpu));
+
+            CacheGroup& group = groups[key];
+            group.cpus.push_back(cpu);
+
+            if (!group.numa_node) {
+                if (auto it = nodes.find(cpu); it != nodes.end()) {
+                    group.numa_node = it->second;
+                }
+            }
+        }
+
+        if (groups.empty()) {
+            throw std::runtime_error("Failed to find any usable cpus");
+        }
+
+        std::vector<CacheGroup> cache_groups;
+        for (auto& [key, group]: groups) {
+            cache_groups.push_back(std::move(group));
+        }
+
+        return CpuTopology(std::move(cache_groups));
+    }
+
+inline
+    std::span<const CacheGroup> CpuTopology::cache_groups() const {
+        return groups_;
+    }
+
+inline
+    size_t CpuTopology::cpu_count() const {
+        size_t count = 0;
+        for (const CacheGroup& group: groups_) {
+            count += group.cpus.size();
+        }
+
+        return count;
+    }
+
+inline
+    ThreadPlacement::ThreadPlacement(const CpuTopology& topology, const size_t domain_cpu_count)
+        : next_thread_index_(0)
+    {
+        const std::span<const CacheGroup> groups = topology.cache_groups();
+        if (groups.empty()) {
+            throw std::runtime_error("Cannot place threads without any cpus");
+        }
+
+        // The first of the largest groups, since that's where most region threads will go.
+        const CacheGroup& domain_group = *std::max_element(groups.begin(), groups.end(), [](const CacheGroup& lhs, const CacheGroup& rhs) {
+            return lhs.cpus.size() < rhs.cpus.size();
+        });
+
+        const size_t count = std::clamp<size_t>(domain_cpu_count, 1, domain_group.cpus.size());
+        domain_cpus_.assign(domain_group.cpus.end() - count, domain_group.cpus.end());
+        domain_numa_node_ = domain_group.numa_node;
+
+        thread_cpus_.assign(domain_group.cpus.begin(), domain_group.cpus.end() - count);
+        for (const bool same_node: {true, false}) {
+            for (const CacheGroup& group: groups) {
+                if ((&group != &domain_group) && ((group.numa_node == domain_numa_node_) == same_node)) {
+                    thread_cpus_.insert(thread_cpus_.end(), group.cpus.begin(), group.cpus.end());
+                }
+            }
+        }
+
+        if (thread_cpus_.empty()) {
+            thread_cpus_ = domain_cpus_;
+        }
+    }
+
+inline
+    std::span<const size_t> ThreadPlacement::domain_cpus() const {
+        return domain_cpus_;
+    }
+
+inline
+    std::optional<size_t> ThreadPlacement::domain_numa_node() const {
+        return domain_numa_node_;
+    }
+
+inline
+    std::span<const size_t> ThreadPlacement::thread_cpus() const {
+        return thread_cpus_;
+    }
+
+inline
+    size_t ThreadPlacement::next_thread_cpu() {
+        const size_t index = next_thread_index_.fetch_add(1, std::memory_order_relaxed);
+        return thread_cpus_[index % thread_cpus_.size()];
+    }
+
+inline
+    size_t ThreadPlacement::place_thread() {
+        const size_t cpu = next_thread_cpu();
+        set_cpu_affinity({&cpu, 1});
+        return cpu;
+    }
+
+}
+
+
+// src/selector.cpp
+
+namespace mantle {
+
+inline
+    Selector::Selector()
+         : epoll_fd_(epoll_create1(EPOLL_CLOEXEC))
+    {
+        if (epoll_fd_ < 0) {
+            throw std::runtime_error("Failed to create epoll file descriptor");
+        }
+    }
+
+inline
+    Selector::~Selector() {
+        int result = close(epoll_fd_);
+        assert(result >= 0);
+        epoll_fd_ = -1;
+    }
+
+inline
+    int Selector::file_descriptor() const {
+        return epoll_fd_;
+    }
+
+inline
+    std::span<void*> Selector::poll(bool non_blocking) {
+        if (non_blocking) {
+            return poll(std::chrono::nanoseconds::zero());
+        }
+
+        return poll(std::nullopt);
+    }
+
+inline
+    std::span<void*> Selector::poll(const std::optional<std::chrono::nanoseconds> timeout) {
+        std::array<struct epoll_event, MAX_EVENT_COUNT> events;
+
+        // Round up to whole milliseconds so we never wake up before the timeout.
+        int timeout_ms = -1;
+        if (timeout) {
+            const auto milliseconds = std::chrono::ceil<std::chrono::milliseconds>(std::max(*timeout, std::chrono::nanoseconds::zero()));
+            timeout_ms = static_cast<int>(std::min<std::chrono::milliseconds::rep>(milliseconds.count(), INT_MAX));
+        }
+
+        int event_count = 0;
+        do {
+            event_count = epoll_wait(epoll_fd_, events.data(), events.size(), timeout_ms);
+        } while ((event_count < 0) && (errno == EINTR));
+
+        if (event_count < 0) {
+            throw std::runtime_error("Failed to wait for epoll events");
+        }
+
+        for (int i = 0; i < event_count; ++i) {
+            assert(events[i].events & EPOLLIN);
+
+            poll_results_[i] = events[i].data.ptr;
+        }
+
+        return {
+            poll_results_.data(),
+            static_cast<size_t>(event_count)
+        };
+    }
+
+inline
+    void Selector::add_watch(int file_descriptor, void* user_data) {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.ptr = user_data;
+
+        int result = 0;
+        do {
+            result = epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, file_descriptor, &event);
+        } while ((result < 0) && (errno == EINTR));
+
+        if (result < 0) {
+            throw std::runtime_error("Failed to add epoll watch");
+        }
+    }
+
+inline
+    void Selector::modify_watch(int file_descriptor, void* user_data) {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.ptr = user_data;
+
+        int result = 0;
+        do {
+            result = epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, file_descriptor, &event);
+        } while ((result < 0) && (errno == EINTR));
+
+        if (result < 0) {
+            throw std::runtime_error("Failed to modify epoll watch");
+        }
+    }
+
+inline
+    void Selector::delete_watch(int file_descriptor) {
+        int result = 0;
+        do {
+            result = epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, file_descriptor, nullptr);
+        } while ((result < 0) && (errno == EINTR));
+
+        if (result < 0) {
+            throw std::runtime_error("Failed to delete epoll watch");
+        }
+    }
+
+inline
+    void wait_for_readable(int file_descriptor) {
+        struct pollfd event;
+        memset(&event, 0, sizeof(event));
+        event.fd = file_descriptor;
+        event.events = POLLIN;
+
+        int result = 0;
+        do {
+            result = ::poll(&event, 1, -1);
+        } while ((result < 0) && (errno == EINTR));
+
+        if (result < 0) {
+            throw std::runtime_error("Failed to poll file descriptor for readability");
+        }
+
+        assert(event.revents & POLLIN);
+    }
+
+}
+
+
+// src/region_controller.cpp
+
+namespace mantle {
+
+    inline RegionControllerAction to_action(RegionControllerPhase phase) {
+        switch (phase) {
+#define X(MANTLE_REGION_CONTROLLER_PHASE, MANTLE_REGION_CONTROLLER_ACTION)      \
+            case RegionControllerPhase::MANTLE_REGION_CONTROLLER_PHASE: {       \
+                return RegionControllerAction::MANTLE_REGION_CONTROLLER_ACTION; \
+            }                                                                   \
+
+            MANTLE_REGION_CONTROLLER_PHASES(X)
+#undef X
+        }
+
+        abort(); // Unreachable.
+    }
+
+    inline RegionControllerPhase next(RegionControllerPhase phase) {
+        return static_cast<RegionControllerPhase>(
+            (static_cast<size_t>(phase) + 1) % REGION_CONTROLLER_PHASE_COUNT
+        );
+    }
+
+    // Visit grouped operations while prefetching the objects `distance` entries ahead. The objects
+    // are scattered across worker heaps, so this hides most of the latency of the dependent loads.
+    //
+    // Objects are only read when their counts are kept in a table, and prefetching them for writing
+    // would take their cache lines away from the cores that own them.
+    template<bool FOR_WRITE = true, typename Visitor>
+    inline void for_each_prefetched(std::span<std::pair<Object*, int64_t>> operations, const size_t distance, Visitor&& visitor) {
+        const size_t count = operations.size();
+        const auto prefetch = [](const Object* object) {
+            if constexpr (FOR_WRITE) {
+                prefetch_for_write(object);
+            }
+            else {
+                prefetch_for_read(object);
+            }
+        };
+
+        for (size_t i = 0; i < std::min(distance, count); ++i) {
+            prefetch(operations[i].first);
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            if ((i + distance) < count) {
+                prefetch(operations[i + distance].first);
+            }
+
+            auto&& [object, delta] = operations[i];
+            visitor(object, delta);
+        }
+    }
+
+inline
+    RegionControllerCensus::RegionControllerCensus()
+        : count_(0)
+        , cycle_count_size_(0)
+        , cycle_counts_{}
+        , urgent_count_(0)
+    {
+        for (size_t& counter: state_counts_) {
+            counter = 0;
+        }
+        for (size_t& counter: phase_counts_) {
+            counter = 0;
+        }
+        for (size_t& counter: action_counts_) {
+            counter = 0;
+        }
+    }
+
+inline
+    RegionControllerCensus::RegionControllerCensus(const RegionControllerGroup& controllers)
+        : RegionControllerCensus()
+    {
+        add(controllers);
+    }
+
+inline
+    void RegionControllerCensus::add(const RegionController& controller) {
+        count_ += 1;
+        add(controller.cycle());
+        state_counts_[static_cast<size_t>(controller.state())] += 1;
+        phase_counts_[static_cast<size_t>(controller.phase())] += 1;
+        action_counts_[static_cast<size_t>(controller.action())] += 1;
+        urgent_count_ += controller.is_start_urgent() ? 1 : 0;
+    }
+
+inline
+    void RegionControllerCensus::add(const RegionControllerGroup& controllers) {
+        for (const std::unique_ptr<RegionController>& controller: controllers) {
+            add(*controller);
+        }
+    }
+
+inline
+    void RegionControllerCensus::add(const RegionControllerCensus& census) {
+        count_ += census.count_;
+        for (size_t i = 0; i < census.cycle_count_size_; ++i) {
+            add(census.cycle_counts_[i].cycle, census.cycle_counts_[i].count);
+        }
+        for (size_t i = 0; i < state_counts_.size(); ++i) {
+            state_counts_[i] += census.state_counts_[i];
+        }
+        for (size_t i = 0; i < phase_counts_.size(); ++i) {
+            phase_counts_[i] += census.phase_counts_[i];
+        }
+        for (size_t i = 0; i < action_counts_.size(); ++i) {
+            action_counts_[i] += census.action_counts_[i];
+        }
+        urgent_count_ += census.urgent_count_;
+    }
+
+inline
+    void RegionControllerCensus::update(const State state, const State next_state) {
+        assert(state_counts_[static_cast<size_t>(state)] > 0);
+        state_counts_[static_cast<size_t>(state)] -= 1;
+        state_counts_[static_cast<size_t>(next_state)] += 1;
+    }
+
+inline
+    void RegionControllerCensus::update(const Phase phase, const Phase next_phase) {
+        assert(phase_counts_[static_cast<size_t>(phase)] > 0);
+        phase_counts_[static_cast<size_t>(phase)] -= 1;
+        phase_counts_[static_cast<size_t>(next_phase)] += 1;
+
+        assert(action_counts_[static_cast<size_t>(to_action(phase))] > 0);
+        action_counts_[static_cast<size_t>(to_action(phase))] -= 1;
+        action_counts_[static_cast<size_t>(to_action(next_phase))] += 1;
+    }
+
+inline
+    void RegionControllerCensus::update(const Cycle cycle, const Cycle next_cycle) {
+        remove(cycle);
+        add(next_cycle);
+    }
+
+inline
+    void RegionControllerCensus::update_urgent(const bool urgent, const bool next_urgent) {
+        assert(!urgent || (urgent_count_ > 0));
+        urgent_count_ -= urgent ? 1 : 0;
+        urgent_count_ += next_urgent ? 1 : 0;
+    }
+
+inline
+    void RegionControllerCensus::add(const Cycle cycle, const size_t count) {
+        size_t index = 0;
+        while ((index < cycle_count_size_) && (cycle_counts_[index].cycle < cycle)) {
+            index += 1;
+        }
+
+        if ((index < cycle_count_size_) && (cycle_counts_[index].cycle == cycle)) {
+            cycle_counts_[index].count += count;
+            return;
+        }
+
+        if (UNLIKELY(cycle_count_size_ == CYCLE_COUNT_CAPACITY)) {
+            abort(); // Controllers have drifted too far apart.
+        }
+
+        std::copy_backward(cycle_counts_.begin() + index, cycle_counts_.begin() + cycle_count_size_, cycle_counts_.begin() + cycle_count_size_ + 1);
+        cycle_counts_[index] = { .cycle = cycle, .count = count };
+        cycle_count_size_ += 1;
+    }
+
+inline
+    void RegionControllerCensus::remove(const Cycle cycle) {
+        size_t index = 0;
+        while ((index < cycle_count_size_) && (cycle_counts_[index].cycle != cycle)) {
+            index += 1;
+        }
+
+        assert(index < cycle_count_size_);
+        if ((index == cycle_count_size_) || (--cycle_counts_[index].count > 0)) {
+            return;
+        }
+
+        std::copy(cycle_counts_.begin() + index + 1, cycle_counts_.begin() + cycle_count_size_, cycle_counts_.begin() + index);
+        cycle_count_size_ -= 1;
+        cycle_counts_[cycle_count_size_] = {};
+    }
+
+inline
+    size_t RegionControllerCensus::count() const {
+        return count_;
+    }
+
+inline
+    auto RegionControllerCensus::min_cycle() const -> Cycle {
+        return cycle_count_size_ ? cycle_counts_[0].cycle : std::numeric_limits<Cycle>::max();
+    }
+
+inline
+    auto RegionControllerCensus::max_cycle() const -> Cycle {
+        return cycle_count_size_ ? cycle_counts_[cycle_count_size_ - 1].cycle : std::numeric_limits<Cycle>::min();
+    }
+
+inline
+    bool RegionControllerCensus::any(State state) const {
+        return state_counts_[static_cast<size_t>(state)] != 0;
+    }
+
+inline
+    bool RegionControllerCensus::all(State state) const {
+        return (count_ > 0) && state_counts_[static_cast<size_t>(state)] == count_;
+    }
+
+inline
+    bool RegionControllerCensus::any(Phase phase) const {
+        return phase_counts_[static_cast<size_t>(phase)] != 0;
+    }
+
+inline
+    bool RegionControllerCensus::all(Phase phase) const {
+        return (count_ > 0) && phase_counts_[static_cast<size_t>(phase)] == count_;
+    }
+
+inline
+    bool RegionControllerCensus::any(Action action) const {
+        return action_counts_[static_cast<size_t>(action)] != 0;
+    }
+
+inline
+    bool RegionControllerCensus::all(Action action) const {
+        return (count_ > 0) && action_counts_[static_cast<size_t>(action)] == count_;
+    }
+
+inline
+    bool RegionControllerCensus::any_urgent() const {
+        return urgent_count_ != 0;
+    }
+
+inline
+    RegionController::RegionController(
+        const RegionId region_id,
+        RegionControllerGroup& controllers,
+        const OperationLedger& ledger,
+        const Config& config,
+        ReferenceCountTable* reference_count_table
+    )
+        : region_id_(region_id)
+        , controllers_(controllers)
+        , ledger_(&ledger)
+        , config_(config)
+        , reference_count_table_(reference_count_table)
+        , census_(nullptr)
+        , state_(State::STARTING)
+        , phase_(Phase::START)
+        , cycle_(0)
+        , start_urgent_(false)
+        , active_cycle_(std::nullopt)
+        , phase_start_(std::chrono::steady_clock::now())
+        , submitted_increments_(EMPTY_SEQUENCE_RANGE)
+        , submitted_decrements_(EMPTY_SEQUENCE_RANGE)
+        , submitted_increment_partition_(nullptr)
+        , submitted_decrement_partition_(nullptr)
+        , submitted_increment_spill_(nullptr)
+        , submitted_decrement_spill_(nullptr)
+        , submitted_barrier_(nullptr)
+        , inboxes_(config.domain_worker_count ? (config.domain_worker_count + 1) : 0)
+        , operation_grouper_(config.operation_grouper_cache_size, config.operation_grouper_cache_size_max, config.operation_grouper_eviction, config.operation_grouper_engine)
+        , metrics_(operation_grouper_, object_grouper_)
+    {
+        metrics_.ledger_capacity = ledger_->capacity();
+
+        if (config_.ledger_recorder) {
+            config_.ledger_recorder->add_region(region_id_);
+        }
+
+        if (config_.heap_census_interval) {
+            heap_census_.emplace(config_.heap_census_interval);
+        }
+    }
+
+inline
+    RegionId RegionController::region_id() const {
+        return region_id_;
+    }
+
+inline
+    auto RegionController::metrics() const -> const Metrics& {
+        return metrics_;
+    }
+
+inline
+    const HeapCensus* RegionController::heap_census() const {
+        return heap_census_ ? &*heap_census_ : nullptr;
+    }
+
+inline
+    bool RegionController::is_quiescent() const {
+        if (operation_grouper_.is_dirty() || operation_grouper_.has_retired()) {
+            return false;
+        }
+
+        // Operations routed by workers that are waiting for the next cycle to be applied.
+        for (const Inbox& inbox: inboxes_) {
+            if (!inbox.retired_operations.empty()) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+inline
+    auto RegionController::state() const -> State {
+        return state_;
+    }
+
+inline
+    auto RegionController::phase() const -> Phase {
+        return phase_;
+    }
+
+inline
+    auto RegionController::cycle() const -> Cycle {
+        return cycle_;
+    }
+
+inline
+    auto RegionController::action() const -> Action {
+        return to_action(phase_);
+    }
+
+inline
+    void RegionController::start(const Cycle cycle) {
+        if (state_ != State::STARTING) {
+            assert(false);
+            return;
+        }
+
+        transition(cycle);
+        transition(State::RUNNING);
+    }
+
+inline
+    void RegionController::stop() {
+        if (state_ != State::STOPPING) {
+            assert(false);
+            return;
+        }
+
+        transition(State::STOPPED);
+    }
+
+inline
+    bool RegionController::is_detached() const {
+        return (state_ == State::SHUTDOWN) || (state_ == State::VACANT);
+    }
+
+inline
+    bool RegionController::is_drained() const {
+        return is_detached() && ((metrics_.released_count + metrics_.local_released_count) == metrics_.bound_count) && !has_pending_operations();
+    }
+
+inline
+    void RegionController::vacate() {
+        if (!is_drained() || (state_ != State::SHUTDOWN)) {
+            assert(false);
+            return;
+        }
+
+        transition(State::VACANT);
+    }
+
+inline
+    void RegionController::attach(const OperationLedger& ledger, const Cycle cycle) {
+        if ((state_ != State::VACANT) || (phase_ != Phase::START)) {
+            assert(false);
+            return;
+        }
+
+        ledger_ = &ledger;
+        active_cycle_ = std::nullopt;
+        metrics_.ledger_capacity = ledger_->capacity();
+        metrics_.bound_count = 0;
+        metrics_.released_count = 0;
+        metrics_.local_released_count = 0;
+
+        transition(State::STARTING);
+        start(cycle);
+    }
+
+inline
+    void RegionController::request_start() {
+        if (phase_ == Phase::START) {
+            transition(Phase::START_BARRIER);
+        }
+    }
+
+inline
+    bool RegionController::is_start_urgent() const {
+        return start_urgent_;
+    }
+
+inline
+    bool RegionController::has_pending_operations() const {
+        // Decrements are submitted two cycles after the transaction they were written in, and pipelined
+        // cycles apply operations one cycle after they are submitted.
+        const Cycle pipeline_depth = is_pipelined() ? 3 : 2;
+
+        return !is_quiescent() || (active_cycle_ && (cycle_ <= (*active_cycle_ + pipeline_depth)));
+    }
+
+inline
+    void RegionController::route_operations(const size_t worker_index) {
+        assert(phase_ == Phase::SUBMIT_BARRIER);
+        assert(worker_index < inboxes_.size());
+
+        route_submitted_operations([worker_index](RegionController& controller, const Operation operation) {
+            controller.inboxes_[worker_index].operations.push_back(operation);
+        });
+    }
+
+inline
+    void RegionController::apply_operations() {
+        assert(phase_ == (is_pipelined() ? Phase::SUBMIT_BARRIER : Phase::RETIRE_BARRIER));
+
+        // All submitted operations have been routed. Unless cycles are pipelined, apply them right away.
+        if (!is_pipelined()) {
+            retire_operations();
+        }
+
+        // Collect operations that were routed to us by domain workers. Nothing else writes to our
+        // grouper when there are workers, so they can be set aside again straight away.
+        if (has_worker_pool()) {
+            for (Inbox& inbox: inboxes_) {
+                for (const Operation operation: inbox.retired_operations) {
+                    operation_grouper_.write(operation, true);
+                }
+
+                inbox.retired_operations.clear();
+            }
+
+            operation_grouper_.retire(is_flush_forced());
+        }
+
+        const auto apply_start = std::chrono::steady_clock::now();
+        const size_t prefetch_distance = config_.apply_prefetch_distance;
+
+        if (reference_count_table_) {
+            ReferenceCountTable& table = *reference_count_table_;
+
+            // Objects are only read for their slot. The one write is when they die.
+            constexpr bool for_write = false;
+
+            for_each_prefetched<for_write>(operation_grouper_.retired_increments(), prefetch_distance, [&table](Object* object, int64_t delta) {
+                assert(delta >= 0);
+                const auto delta_magnitude = static_cast<uint32_t>(+delta);
+                if (!table.apply_increment(object->reference_count_slot(), delta_magnitude)) {
+                    abort();
+                }
+            });
+
+            for_each_prefetched<for_write>(operation_grouper_.retired_decrements(), prefetch_distance, [this, &table](Object* object, int64_t delta) {
+                assert(delta <= 0);
+                const auto delta_magnitude = static_cast<uint32_t>(-delta);
+                if (!table.apply_decrement(object->reference_count_slot(), delta_magnitude)) {
+                    record_release(*object);
+                    released_slots_.push_back(object->reference_count_slot());
+                    object->unbind();
+                    object_grouper_.write(*object);
+                    metrics_.released_count += 1;
+                }
+            });
+
+            table.release(released_slots_);
+            released_slots_.clear();
+        }
+        else {
+            // Increments first to avoid premature death.
+            for_each_prefetched(operation_grouper_.retired_increments(), prefetch_distance, [](Object* object, int64_t delta) {
+                assert(delta >= 0);
+                const auto delta_magnitude = static_cast<uint32_t>(+delta);
+                if (!object->apply_increment(delta_magnitude)) {
+                    abort();
+                }
+            });
+
+            // Apply decrements and group dead objects for finalization.
+            for_each_prefetched(operation_grouper_.retired_decrements(), prefetch_distance, [this](Object* object, int64_t delta) {
+                assert(delta <= 0);
+                const auto delta_magnitude = static_cast<uint32_t>(-delta);
+                if (!object->apply_decrement(delta_magnitude)) {
+                    record_release(*object);
+                    object_grouper_.write(*object);
+                    metrics_.released_count += 1;
+                }
+            });
+        }
+
+        metrics_.applied_count += operation_grouper_.retired_increments().size() + operation_grouper_.retired_decrements().size();
+        metrics_.apply_duration += std::chrono::steady_clock::now() - apply_start;
+
+        if (UNLIKELY(heap_census_) && heap_census_->is_sampled(cycle_)) {
+            sample_heap_census();
+        }
+
+        operation_grouper_.clear_retired();
+    }
+
+inline
+    auto RegionController::send_message() -> std::optional<Message> {
+        switch (phase_) {
+            case Phase::START: {
+                break;
+            }
+            case Phase::START_BARRIER: {
+                break;
+            }
+            case Phase::ENTER: {
+                transition(Phase::SUBMIT);
+
+                if (is_detached()) {
+                    // Nobody is left to answer, so submit nothing on the region's behalf.
+                    submitted_increments_ = EMPTY_SEQUENCE_RANGE;
+                    submitted_decrements_ = EMPTY_SEQUENCE_RANGE;
+                    submitted_increment_partition_ = nullptr;
+                    submitted_decrement_partition_ = nullptr;
+                    submitted_increment_spill_ = nullptr;
+                    submitted_decrement_spill_ = nullptr;
+                    submitted_barrier_ = nullptr;
+                    transition(Phase::SUBMIT_BARRIER);
+                    break;
+                }
+
+                return Message {
+                    .enter = {
+                        .type  = MessageType::ENTER,
+                        .cycle = cycle_,
+                    },
+                };
+            }
+            case Phase::SUBMIT: {
+                break;
+            }
+            case Phase::SUBMIT_BARRIER: {
+                break;
+            }
+            case Phase::RETIRE_BARRIER: {
+                break;
+            }
+            case Phase::RETIRE: {
+                transition(Phase::LEAVE);
+
+                // Every controller has finished routing this cycle's operations to us.
+                if (is_pipelined()) {
+                    retire_operations();
+                }
+
+                const ObjectGroups garbage = object_grouper_.flush();
+                if (UNLIKELY(heap_census_)) {
+                    heap_census_->add_garbage(cycle_, garbage);
+                }
+
+                return Message {
+                    .retire = {
+                        .type    = MessageType::RETIRE,
+                        .garbage = garbage,
+                    },
+                };
+            }
+            case Phase::LEAVE: {
+                const bool detached = is_detached();
+
+                transition(Phase::START);
+                if (detached) {
+                    break;
+                }
+
+                if (state_ == State::STOPPED) {
+                    transition(State::SHUTDOWN);
+                }
+
+                return Message {
+                    .leave = {
+                        .type = MessageType::LEAVE,
+                        .stop = state_ == State::SHUTDOWN,
+                    },
+                };
+            }
+        }
+
+        return std::nullopt;
+    }
+
+inline
+    void RegionController::receive_message(const Message& message) {
+        switch (phase_) {
+            case Phase::START: {
+                if (message.type == MessageType::START) {
+                    set_start_urgent(start_urgent_ || message.start.urgent);
+                    transition(Phase::START_BARRIER);
+                }
+                break;
+            }
+            case Phase::START_BARRIER: {
+                // Redundant start messages are dropped, but they can still make the start urgent.
+                if (message.type == MessageType::START) {
+                    set_start_urgent(start_urgent_ || message.start.urgent);
+                }
+                break;
+            }
+            case Phase::ENTER: {
+                break; // Redundant start messages are dropped.
+            }
+            case Phase::SUBMIT: {
+                if (message.type == MessageType::SUBMIT) {
+                    transition(Phase::SUBMIT_BARRIER);
+
+                    if (message.submit.stop) {
+                        if (state_ == State::STOPPED) {
+                            // The region is reaffirming that wants to stop.
+                        }
+                        else {
+                            transition(State::STOPPING);
+                        }
+                    }
+                    else {
+                        // The region is not quiescent anymore. We should
+                        // stop shutting down until it is again.
+                        transition(State::RUNNING);
+                    }
+
+                    submitted_increments_ = message.submit.increments;
+                    submitted_decrements_ = message.submit.decrements;
+                    metrics_.ledger_occupancy = submitted_increments_.tail - submitted_decrements_.head;
+                    metrics_.finalized_count = message.submit.finalized_count;
+                    metrics_.bound_count = message.submit.bound_count;
+                    metrics_.local_released_count = message.submit.released_count;
+                    if (heap_census_ && message.submit.heap_census) {
+                        heap_census_->add(cycle_, *message.submit.heap_census);
+                    }
+                    if ((submitted_increments_.size() != 0) || (submitted_decrements_.size() != 0)) {
+                        active_cycle_ = cycle_;
+                    }
+                    submitted_increment_partition_ = message.submit.increment_partition;
+                    submitted_decrement_partition_ = message.submit.decrement_partition;
+                    submitted_increment_spill_ = message.submit.increment_spill;
+                    submitted_decrement_spill_ = message.submit.decrement_spill;
+                    if (submitted_increment_spill_ && !submitted_increment_spill_->increments.empty()) {
+                        active_cycle_ = cycle_;
+                    }
+                    if (submitted_decrement_spill_ && !submitted_decrement_spill_->decrements.empty()) {
+                        active_cycle_ = cycle_;
+                    }
+                    submitted_barrier_ = message.submit.barrier;
+                    if (submitted_barrier_ && ((submitted_barrier_->increment_count() != 0) || (submitted_barrier_->decrement_count() != 0))) {
+                        active_cycle_ = cycle_;
+                    }
+                }
+                break; // Redundant start messages are dropped.
+            }
+            case Phase::SUBMIT_BARRIER: {
+                break;
+            }
+            case Phase::RETIRE_BARRIER: {
+                break;
+            }
+            case Phase::RETIRE: {
+                break;
+            }
+            case Phase::LEAVE: {
+                break;
+            }
+        }
+    }
+
+inline
+    void RegionController::synchronize(const RegionControllerCensus& census) {
+        Phase next_phase = this->next_phase();
+        Action next_action = to_action(next_phase);
+
+        if (census.all(Action::BARRIER_ALL) || census.all(Action::BARRIER_ANY)) {
+            // Sanity check that the cycle matches while synchronized.
+            assert(census.min_cycle() == census.max_cycle());
+
+            transition(next_phase);
+        }
+        else if (census.any(next_phase) && (next_action == Action::BARRIER_ANY)) {
+            transition(next_phase);
+        }
+    }
+
+inline
+    void RegionController::track(RegionControllerCensus& census) {
+        assert(!census_);
+
+        census.add(*this);
+        census_ = &census;
+    }
+
+inline
+    void RegionController::transition(State next_state) {
+        if (state_ == next_state) {
+            return;
+        }
+
+        if (census_) {
+            census_->update(state_, next_state);
+        }
+
+        debug("[region_controller:{}] transition state {} to {}", region_id_, to_string(state_), to_string(next_state));
+        trace(TraceSource::CONTROLLER, region_id_, TraceEventType::STATE, static_cast<uint32_t>(next_state));
+        state_ = next_state;
+    }
+
+inline
+    void RegionController::transition(Phase next_phase) {
+        if (phase_ == next_phase) {
+            return;
+        }
+
+        {
+            const auto now = std::chrono::steady_clock::now();
+            metrics_.phase_durations[static_cast<size_t>(phase_)] += now - phase_start_;
+            phase_start_ = now;
+        }
+
+        switch (phase_) {
+            case Phase::START: {
+                // Some region asked the domain to start a coherence cycle.
+                break;
+            }
+            case Phase::START_BARRIER: {
+                // All controllers have started.
+                set_start_urgent(false);
+                break;
+            }
+            case Phase::ENTER: {
+                // Ask the region to submit operations.
+                break;
+            }
+            case Phase::SUBMIT: {
+                // The region has submitted operations for us to route.
+                break;
+            }
+            case Phase::SUBMIT_BARRIER: {
+                // We are waiting for all regions to respond. When cycles are pipelined, the operations
+                // routed in the previous cycle are applied now, while this cycle's are being routed.
+                if (!has_worker_pool()) {
+                    if (is_pipelined()) {
+                        apply_operations();
+                    }
+
+                    route_submitted_operations([](RegionController& controller, const Operation operation) {
+                        controller.operation_grouper_.write(operation, true);
+                    });
+                }
+                break;
+            }
+            case Phase::RETIRE_BARRIER: {
+                assert(!is_pipelined());
+                if (!has_worker_pool()) {
+                    apply_operations();
+                }
+                break;
+            }
+            case Phase::RETIRE: {
+                break;
+            }
+            case Phase::LEAVE: {
+                transition(cycle_ + 1);
+                metrics_.cycle_count += 1;
+                break;
+            }
+        }
+
+        if (census_) {
+            census_->update(phase_, next_phase);
+        }
+
+        debug("[region_controller:{}] transition phase {} to {}", region_id_, to_string(phase_), to_string(next_phase));
+        trace(TraceSource::CONTROLLER, region_id_, TraceEventType::PHASE, static_cast<uint32_t>(next_phase), cycle_);
+        phase_ = next_phase;
+    }
+
+inline
+    void RegionController::transition(Cycle next_cycle) {
+        if (cycle_ == next_cycle) {
+            return;
+        }
+
+        if (census_) {
+            census_->update(cycle_, next_cycle);
+        }
+
+        debug("[region_controller:{}] transition cycle {} to {}", region_id_, cycle_, next_cycle);
+        trace(TraceSource::CONTROLLER, region_id_, TraceEventType::CYCLE, 0, next_cycle);
+        cycle_ = next_cycle;
+    }
+
+inline
+    void RegionController::set_start_urgent(const bool urgent) {
+        if (start_urgent_ == urgent) {
+            return;
+        }
+
+        if (census_) {
+            census_->update_urgent(start_urgent_, urgent);
+        }
+
+        start_urgent_ = urgent;
+    }
+
+inline
+    auto RegionController::next_phase() const -> Phase {
+        const Phase phase = next(phase_);
+        if (is_pipelined() && (phase == Phase::RETIRE_BARRIER)) {
+            return next(phase);
+        }
+
+        return phase;
+    }
+
+inline
+    void RegionController::retire_operations() {
+        if (has_worker_pool()) {
+            // Workers keep routing into the other side of each inbox.
+            for (Inbox& inbox: inboxes_) {
+                assert(inbox.retired_operations.empty());
+                inbox.operations.swap(inbox.retired_operations);
+            }
+        }
+        else {
+            operation_grouper_.retire(is_flush_forced());
+        }
+    }
+
+    template<typename Sink>
+    size_t RegionController::route_operations(const OperationType type, SequenceRange range, Sink&& sink) {
+        size_t count = 0;
+
+        ledger_->for_each_operation(range, [&](const Operation operation) {
+            if (type != operation.type()) {
+                return;
+            }
+
+            const Object* object = operation.object();
+            if (!object) {
+                return;
+            }
+
+            const RegionId region_id = object->region_id();
+            if (UNLIKELY(region_id >= controllers_.size())) {
+                abort();
+            }
+
+            sink(*controllers_[region_id], operation);
+
+            count += 1;
+        });
+
+        return count;
+    }
+
+    template<typename Sink>
+    size_t RegionController::route_operations(const OperationType type, const OperationPartition& partition, Sink&& sink) {
+        size_t count = 0;
+
+        // Like an operation on an unbound object in the ledger, which has nowhere to go.
+        if (UNLIKELY(partition.unowned_count() != 0)) {
+            abort();
+        }
+
+        for (RegionId region_id = 0; region_id < partition.region_count(); ++region_id) {
+            const std::span<const Operation> operations = partition.slice(region_id, type);
+            if (operations.empty()) {
+                continue;
+            }
+
+            if (UNLIKELY(region_id >= controllers_.size())) {
+                abort();
+            }
+
+            RegionController& controller = *controllers_[region_id];
+            for (const Operation operation: operations) {
+                sink(controller, operation);
+            }
+
+            count += operations.size();
+        }
+
+        return count;
+    }
+
+    template<typename Sink>
+    size_t RegionController::route_operations(const std::span<const Operation> operations, Sink&& sink) {
+        for (const Operation operation: operations) {
+            const RegionId region_id = operation.object()->region_id();
+            if (UNLIKELY(region_id >= controllers_.size())) {
+                abort();
+            }
+
+            sink(*controllers_[region_id], operation);
+        }
+
+        return operations.size();
+    }
+
+    template<typename Sink>
+    void RegionController::route_submitted_operations(Sink&& sink) {
+        LedgerRecorder* recorder = config_.ledger_recorder;
+        if (LIKELY(!recorder)) {
+            route_committed_operations(sink);
+            return;
+        }
+
+        route_committed_operations([this, recorder, &sink](RegionController& controller, const Operation operation) {
+            recorder->record_operation(region_id_, cycle_, operation, controller.region_id_);
+            sink(controller, operation);
+        });
+    }
+
+    template<typename Sink>
+    void RegionController::route_committed_operations(Sink&& sink) {
+        const size_t previous_count = metrics_.increment_count + metrics_.decrement_count;
+
+        if (submitted_increment_partition_) {
+            metrics_.increment_count += route_operations(OperationType::INCREMENT, *submitted_increment_partition_, sink);
+        }
+        else {
+            metrics_.increment_count += route_operations(OperationType::INCREMENT, submitted_increments_, sink);
+        }
+
+        if (submitted_decrement_partition_) {
+            metrics_.decrement_count += route_operations(OperationType::DECREMENT, *submitted_decrement_partition_, sink);
+        }
+        else {
+            metrics_.decrement_count += route_operations(OperationType::DECREMENT, submitted_decrements_, sink);
         }
 
-        ~Handle() noexcept {
-            reset();
+        // Spilled operations are never null, and are already split by type.
+        if (submitted_increment_spill_) {
+            metrics_.increment_count += route_operations(std::span<const Operation>(submitted_increment_spill_->increments), sink);
         }
 
-        T* get() noexcept {
-            return static_cast<T*>(operation_.mutable_object());
+        if (submitted_decrement_spill_) {
+            metrics_.decrement_count += route_operations(std::span<const Operation>(submitted_decrement_spill_->decrements), sink);
         }
 
-        const T* get() const noexcept {
-            return static_cast<const T*>(operation_.object());
+        // Operations recorded by `Ref`s are tagged with their type, and each segment holds both.
+        if (submitted_barrier_) {
+            submitted_barrier_->for_each_segment([&](const WriteBarrierSegment& segment) {
+                metrics_.increment_count += segment.increment_count;
+                metrics_.decrement_count += segment.decrement_count;
+                route_operations(segment.committed_operations(), sink);
+            });
         }
 
-        T* operator->() noexcept {
-            assert(*this);
+        trace(TraceSource::CONTROLLER, region_id_, TraceEventType::ROUTE, 0, metrics_.increment_count + metrics_.decrement_count - previous_count);
+    }
 
-            return get();
+inline
+    void RegionController::record_release(const Object& object) {
+        if (UNLIKELY(config_.ledger_recorder)) {
+            config_.ledger_recorder->record_release(region_id_, object);
         }
+    }
 
-        const T* operator->() const noexcept {
-            assert(*this);
+inline
+    void RegionController::sample_heap_census() {
+        HeapCensus& census = *heap_census_;
 
-            return get();
-        }
+        // Objects that died are already on their way to the object grouper, and are counted with it.
+        const auto reference_count = [this](const Object& object) -> uint64_t {
+            const uint32_t count = reference_count_table_ ? reference_count_table_->count(object.reference_count_slot()) : object.reference_count_;
+            return uint64_t{count} + 1;
+        };
 
-        T& operator*() noexcept {
-            assert(*this);
+        for (const auto& [object, delta]: operation_grouper_.retired_decrements()) {
+            census.add_decremented(*object);
+            if (object->is_managed()) {
+                census.add_survivor(*object, reference_count(*object));
+            }
+        }
 
-            return *get();
+        for (const auto& [object, delta]: operation_grouper_.retired_increments()) {
+            if (object->is_managed()) {
+                census.add_survivor(*object, reference_count(*object));
+            }
         }
+    }
 
-        const T& operator*() const noexcept {
-            assert(*this);
+inline
+    bool RegionController::has_worker_pool() const {
+        return !inboxes_.empty();
+    }
 
-            return *get();
-        }
+inline
+    bool RegionController::is_pipelined() const {
+        return config_.pipeline_cycles;
+    }
 
-        explicit operator bool() const noexcept {
-            return static_cast<bool>(operation_);
-        }
+inline
+    bool RegionController::is_flush_forced() const {
+        return (state_ != State::STARTING) && (state_ != State::RUNNING);
+    }
 
-        void reset() noexcept {
-            if (operation_) {
-                Object* object = operation_.mutable_object();
-                assert(object);
-                object->start_decrement_operation(operation_);
+inline
+    RegionControllerCensus synchronize(RegionControllerGroup& controllers) {
+        RegionControllerCensus old_census;
+        RegionControllerCensus new_census;
 
-                operation_ = make_null_operation();
+        // Synchronizing until we can no longer make forward progress without sending or receiving.
+        do {
+            old_census = RegionControllerCensus(controllers);
+
+            for (auto&& controller: controllers) {
+                controller->synchronize(old_census);
             }
 
-            assert(!operation_);
-        }
+            new_census = RegionControllerCensus(controllers);
+        } while (old_census != new_census);
 
-    public:
-        uint8_t weight() const {
-            return operation_.exponent();
+        return new_census;
+    }
+
+inline
+    bool can_synchronize(const RegionControllerCensus& cluster, const RegionControllerCensus& census) {
+        using Phase = RegionControllerPhase;
+        using Action = RegionControllerAction;
+
+        // These mirror the conditions in `RegionController::synchronize`. Pipelined cycles skip
+        // RETIRE_BARRIER, but neither it nor the phase after it waits on any controller, so the
+        // plain order of phases is enough here.
+        if (census.all(Action::BARRIER_ALL) || census.all(Action::BARRIER_ANY)) {
+            return cluster.count() > 0;
         }
 
-    private:
-        [[nodiscard]] MANTLE_HOT Operation copy_reference() const {
-            Object* object = operation_.mutable_object();
-            if (!object) {
-                return make_null_operation();
+        for (size_t i = 0; i < REGION_CONTROLLER_PHASE_COUNT; ++i) {
+            const Phase phase = static_cast<Phase>(i);
+            const Phase next_phase = next(phase);
+            if (cluster.any(phase) && (to_action(next_phase) == Action::BARRIER_ANY) && census.any(next_phase)) {
+                return true;
             }
+        }
 
-            if constexpr (ENABLE_WEIGHTED_REFERENCE_COUNTING) {
-                // Check if we need to gain additional weight.
-                if (weight() == 0) {
-                    // NOTE: Submit the new operation before the old operation.
-                    object->start_increment_operation(make_increment_operation(object, Operation::EXPONENT_MAX));
-                    object->start_decrement_operation(operation_);
-                    operation_ = make_decrement_operation(object, Operation::EXPONENT_MAX);
-                }
+        return false;
+    }
 
-                // Split our weight in half by reducing the exponent by one.
-                operation_ = make_decrement_operation(object, weight() - 1);
-                return operation_;
-            }
-            else {
-                // Create a paired increment and decrement.
-                Operation increment = make_increment_operation(object);
-                Operation decrement = make_decrement_operation(object);
+inline
+    std::string_view to_string(RegionControllerState state) {
+        using namespace std::literals;
 
-                // The increment can be started immediately.
-                object->start_increment_operation(increment);
+        switch (state) {
+#define X(MANTLE_REGION_CONTROLLER_STATE)                               \
+            case RegionControllerState::MANTLE_REGION_CONTROLLER_STATE: \
+                return #MANTLE_REGION_CONTROLLER_STATE ##sv;            \
 
-                // The decrement will be started once the new reference is dropped.
-                return decrement;
-            }
+        MANTLE_REGION_CONTROLLER_STATES(X)
+#undef X
         }
 
-    private:
-        mutable Operation operation_;
-    };
-
-    template<typename T>
-    inline Handle<T> make_handle(T& object) noexcept {
-        return Handle<T>::bind(object);
+        abort();
     }
 
-}
-
+inline
+    std::string_view to_string(RegionControllerPhase phase) {
+        using namespace std::literals;
 
-// include/mantle/object_finalizer.h
+        switch (phase) {
+#define X(MANTLE_REGION_CONTROLLER_PHASE, MANTLE_REGION_CONTROLLER_ACTION) \
+            case RegionControllerPhase::MANTLE_REGION_CONTROLLER_PHASE:    \
+                return #MANTLE_REGION_CONTROLLER_PHASE ##sv;               \
 
+        MANTLE_REGION_CONTROLLER_PHASES(X)
+#undef X
+        }
 
-namespace mantle {
+        abort();
+    }
 
-    // An interface for cleaning up objects once they are no longer referenced.
-    class ObjectFinalizer {
-    public:
-        virtual ~ObjectFinalizer() = default;
+inline
+    std::string_view to_string(RegionControllerAction action) {
+        using namespace std::literals;
 
-        // Objects are finalized in batches based on group membership.
-        virtual void finalize(ObjectGroup group, std::span<Object*> objects) noexcept = 0;
-    };
+        switch (action) {
+#define X(MANTLE_REGION_CONTROLLER_ACTION)                                \
+            case RegionControllerAction::MANTLE_REGION_CONTROLLER_ACTION: \
+                return #MANTLE_REGION_CONTROLLER_ACTION ##sv;             \
 
-}
+        MANTLE_REGION_CONTROLLER_ACTIONS(X)
+#undef X
+        }
 
+        abort();
+    }
 
-// include/mantle/debug.h
+}
 
 
-#define MANTLE_INFO  0
-#define MANTLE_DEBUG 0
-#define MANTLE_AUDIT 0
+// src/object.cpp
 
 namespace mantle {
 
-    inline std::ostream& operator<<(std::ostream& stream, const Operation& operation) {
-        Operation mutable_operation = operation;
+inline
+    Object::Object(ObjectGroup group)
+        : reference_count_(0)
+        , region_id_(INVALID_REGION_ID)
+        , group_(group)
+    {
+    }
 
-        std::stringstream ss;
-        ss << "Operation(object:" << static_cast<const void*>(mutable_operation.object());
-        ss << ", value:" << static_cast<int>(mutable_operation.value()) << ")";
+inline
+    Object::~Object() {
+#if MANTLE_AUDIT
+        bool halting = !has_region();
+        bool dropped = reference_count_ == 0;
 
-        stream << ss.str();
-        return stream;
+        assert(halting || dropped);
+#endif
     }
 
-    inline std::ostream& operator<<(std::ostream& stream, const OperationBatch& batch) {
-        std::stringstream ss;
-        ss << "OperationBatch(\n";
-        ss << "  operations: [";
-        for (Operation operation: batch.operations) {
-            if (operation) {
-                ss << operation << ", ";
-            }
-        }
-        ss << "]";
+inline
+    bool Object::is_managed() const {
+        return region_id_ != INVALID_REGION_ID;
+    }
 
-        stream << ss.str();
-        return stream;
+inline
+    RegionId Object::region_id() const {
+        return region_id_;
     }
 
-    inline std::ostream& operator<<(std::ostream& stream, const RegionControllerGroup& controllers) {
-        std::stringstream ss;
-        ss << "RegionControllerGroup(\n";
-        for (RegionId region_id = 0; region_id < controllers.size(); ++region_id) {
-            auto&& controller = *controllers[region_id];
+inline
+    ObjectGroup Object::group() const {
+        return group_;
+    }
 
-            ss << "  RegionController(id:" << region_id;
-            ss << ", phase:" << to_string(controller.phase());
-            ss << ", action:" << to_string(controller.action()) << ")\n";
+inline
+    void Object::bind(RegionId region_id) {
+        if (UNLIKELY(is_managed())) {
+            abort(); // Don't bind an object more than once.
         }
-        ss << ")";
 
-        stream << ss.str();
-        return stream;
+        region_id_ = region_id;
     }
 
-    template<typename... Args>
-    inline void debug(const char* fmt, Args&&... args) {
-#if MANTLE_DEBUG
-        std::string log_line = fmt::format(fmt::runtime(fmt), std::forward<Args>(args)...) + '\n';
-        ssize_t count = write(1, log_line.c_str(), log_line.size());
-        (void)count;
-#else
-        (void)fmt;
-        ((void)args, ...); // This is ridiculous. Turn off the warning.
-#endif
+inline
+    void Object::start_increment_operation(uint8_t exponent) {
+        start_increment_operation(make_increment_operation(this, exponent));
     }
 
-    template<typename... Args>
-    inline void info(const char* fmt, Args&&... args) {
-#if MANTLE_INFO
-        std::string log_line = fmt::format(fmt::runtime(fmt), std::forward<Args>(args)...) + '\n';
-        ssize_t count = write(1, log_line.c_str(), log_line.size());
-        (void)count;
-#else
-        (void)fmt;
-        ((void)args, ...); // This is ridiculous. Turn off the warning.
-#endif
+inline
+    void Object::start_decrement_operation(uint8_t exponent) {
+        start_decrement_operation(make_decrement_operation(this, exponent));
     }
 
-    template<typename... Args>
-    inline void warning(const char* fmt, Args&&... args) {
-#if MANTLE_INFO
-        std::string log_line = fmt::format(fmt::runtime(fmt), std::forward<Args>(args)...) + '\n';
-        ssize_t count = write(1, log_line.c_str(), log_line.size());
-        (void)count;
-#else
-        (void)fmt;
-        ((void)args, ...); // This is ridiculous. Turn off the warning.
-#endif
+inline
+    bool Object::apply_increment(const uint32_t delta_magnitude) {
+        reference_count_ += delta_magnitude;
+        return true;
+    }
+
+inline
+    bool Object::apply_decrement(const uint32_t delta_magnitude) {
+        if (reference_count_ < delta_magnitude) {
+            reference_count_ = 0;
+            unbind();
+            return false;
+        }
+
+        reference_count_ -= delta_magnitude;
+        return true;
     }
 
-}
+inline
+    void Object::unbind() {
+        region_id_ = INVALID_REGION_ID;
+    }
 
+inline
+    uint32_t Object::reference_count_slot() const {
+        return reference_count_;
+    }
 
-// include/mantle/mantle.h
+inline
+    void Object::set_reference_count_slot(const uint32_t slot) {
+        reference_count_ = slot;
+    }
 
+}
 
 
 // src/region.cpp
@@ -2229,6 +10781,58 @@ namespace mantle {
         Counter& counter_;
     };
 
+    // Tracks how much finalization work a `Region::step` call is still allowed to do.
+    class FinalizationBudget {
+        using Clock = std::chrono::steady_clock;
+
+    public:
+        explicit FinalizationBudget(const Config& config)
+            : object_count_(config.finalization_budget_objects)
+            , has_object_limit_(config.finalization_budget_objects > 0)
+            , has_deadline_(config.finalization_budget_time > std::chrono::nanoseconds::zero())
+            , deadline_(has_deadline_ ? (Clock::now() + config.finalization_budget_time) : Clock::time_point::max())
+        {
+        }
+
+        [[nodiscard]]
+        bool is_unbounded() const {
+            return !has_object_limit_ && !has_deadline_;
+        }
+
+        [[nodiscard]]
+        bool is_exhausted() const {
+            if (has_object_limit_ && (object_count_ == 0)) {
+                return true;
+            }
+
+            return has_deadline_ && (Clock::now() >= deadline_);
+        }
+
+        // The largest batch of objects that can be finalized before checking the budget again.
+        [[nodiscard]]
+        size_t batch_limit() const {
+            size_t limit = has_object_limit_ ? object_count_ : std::numeric_limits<size_t>::max();
+            if (has_deadline_) {
+                limit = std::min(limit, FINALIZATION_BATCH_SIZE);
+            }
+
+            return limit;
+        }
+
+        void spend(const size_t count) {
+            if (has_object_limit_) {
+                assert(count <= object_count_);
+                object_count_ -= count;
+            }
+        }
+
+    private:
+        size_t            object_count_;
+        bool              has_object_limit_;
+        bool              has_deadline_;
+        Clock::time_point deadline_;
+    };
+
 inline
     Region::Region(Domain& domain, ObjectFinalizer& finalizer)
         : domain_(domain)
@@ -2236,37 +10840,104 @@ inline
         , state_(INITIAL_STATE)
         , phase_(INITIAL_PHASE)
         , cycle_(INITIAL_CYCLE)
+        , epoch_(0)
         , depth_(0)
         , finalizer_(finalizer)
-        , ledger_(domain.config().ledger_capacity)
+        , numa_node_(domain.config().numa_placement ? current_numa_node() : std::nullopt)
+        , ledger_(domain.config().ledger_capacity, domain.config().ledger_huge_pages, numa_node_, domain.config().ledger_decommit_fill, domain.config().ledger_decommit_cycles, domain.config().ledger_encoding)
+        , combiner_(domain.config().region_combining_cache_size)
+        , reference_count_table_(nullptr)
+        , urgent_start_entries_(static_cast<size_t>(static_cast<double>(domain.config().ledger_capacity) * std::clamp(1.0 - domain.config().cycle_urgent_fill, 0.0, 1.0)))
+        , sent_urgent_start_(false)
+        , pressure_bytes_(domain.config().cycle_pressure_bytes)
+        , dropped_bytes_(0)
+        , dropped_cursor_(0)
+        , dropped_bytes_history_()
+        , byte_cost_filter_()
+        , partition_operations_(domain.config().partition_operations)
+        , partition_cursor_(0)
+        , ledger_overflow_(domain.config().ledger_overflow)
+        , fallback_ledger_(domain.fallback_ledger())
+        , spill_operations_(ledger_overflow_ || fallback_ledger_)
+        , spill_cursor_(0)
+        , apply_local_operations_(domain.config().local_operations && !domain.config().reference_count_table)
+        , local_cursor_(0)
+        , heap_census_(domain.config().heap_census_interval != 0)
+        , heap_census_cursor_(0)
+        , drives_domain_(domain.is_driven_here())
+        , garbage_backlog_offset_(0)
+        , garbage_cursor_(0)
+        , connection_(numa_node_, domain.numa_node(), domain.config().region_wakeups)
+        , metrics_()
     {
-        // Register ourselves as the region on this thread.
-        {
-            Region*& instance = thread_local_instance();
-            if (instance) {
-                throw std::runtime_error("Cannot have more than one region per thread");
-            }
+        attach_thread();
+
+        if (domain_.config().ledger_backend == LedgerBackend::WRITE_BARRIER) {
+            barrier_ledger_.emplace(domain_.write_barrier_manager());
+        }
+
+        join();
+    }
+
+inline
+    Region::~Region() {
+        stop();
+
+        // Parked regions are destroyed by whichever thread owns the pool.
+        if (thread_local_instance() == this) {
+            thread_local_instance() = nullptr;
+        }
+    }
 
-            instance = this;
+inline
+    void Region::attach_thread() {
+        Region*& instance = thread_local_instance();
+        if (instance) {
+            throw std::runtime_error("Cannot have more than one region per thread");
         }
 
+        instance = this;
+    }
+
+inline
+    void Region::join() {
         // Synchronize with other regions until our cycle and phase match.
-        {
-            ledger_.begin_transaction();
+        ledger_.begin_transaction();
 
-            id_ = domain_.bind(*this);
-            while (cycle_ == INITIAL_CYCLE) {
-                constexpr bool non_blocking = false;
-                step(non_blocking);
-            }
+        domain_.bind(*this);
+        while (cycle_ == INITIAL_CYCLE) {
+            constexpr bool non_blocking = false;
+            step(non_blocking);
         }
     }
 
 inline
-    Region::~Region() {
+    void Region::park() {
+        // Everything we wrote has been applied and finalized once this returns.
         stop();
 
-        thread_local_instance() = nullptr;
+        if (thread_local_instance() == this) {
+            thread_local_instance() = nullptr;
+        }
+    }
+
+inline
+    void Region::adopt() {
+        assert(state_ == State::STOPPED);
+        assert(ledger_.is_empty() && !has_spilled_operations() && !has_combined_operations() && !has_garbage());
+
+        attach_thread();
+
+        // The domain counts what is bound to each id from zero, and sees this as a new region.
+        id_ = std::numeric_limits<RegionId>::max();
+        state_ = INITIAL_STATE;
+        phase_ = INITIAL_PHASE;
+        cycle_ = INITIAL_CYCLE;
+        sent_urgent_start_ = false;
+        drives_domain_ = domain_.is_driven_here();
+        metrics_ = {};
+
+        join();
     }
 
 inline
@@ -2289,6 +10960,16 @@ inline
         return cycle_;
     }
 
+inline
+    auto Region::epoch() const -> Epoch {
+        return epoch_;
+    }
+
+inline
+    auto Region::metrics() const -> const Metrics& {
+        return metrics_;
+    }
+
 inline
     int Region::file_descriptor() {
         return connection_.client_endpoint().file_descriptor();
@@ -2300,1503 +10981,1977 @@ inline
             return;
         }
 
-        // Flag that we want to stop and participate until the domain
-        // indicates that it is safe to do so.
-        state_ = State::STOPPING;
+        // Flag that we want to stop and participate until the domain indicates that our operations
+        // have been drained. Other regions keep going, and don't have to be stopping as well.
+        transition(State::STOPPING);
         while (state_ != State::STOPPED) {
             constexpr bool non_blocking = false;
             step(non_blocking);
         }
+
+        // Make sure the domain is done with our connection before it goes away.
+        domain_.unbind(*this);
+
+        // Garbage from the final cycle may have been carried over.
+        while (has_garbage()) {
+            finalize_garbage();
+        }
+
+        // Nothing is going to happen to us anymore, so don't leave anyone waiting.
+        resume_awaiters(true);
     }
 
 inline
     void Region::step(const bool non_blocking) {
+        // Borrowed objects may die once we've taken part in a cycle.
+        epoch_ += 1;
+
+        // Fast-path: Nothing has arrived, and there's nothing to send or finalize.
+        if (non_blocking && !has_work()) {
+            return;
+        }
+
         // Start a new cycle if needed. We need to be in the initial phase, and have a reason to do it.
         bool start_cycle = true;
         start_cycle &= phase_ == INITIAL_PHASE;
-        start_cycle &= cycle_ == INITIAL_CYCLE || (state_ == State::STOPPING || !ledger_.is_empty());
+        start_cycle &= wants_cycle();
         if (start_cycle) {
-            region_endpoint().send_message(
-                Message {
-                    .start = {
-                        .type = MessageType::START,
-                    },
-                }
-            );
-
+            send_start((cycle_ == INITIAL_CYCLE) || (state_ == State::STOPPING) || is_pressured());
             transition(Phase::RECV_ENTER_SENT_START);
         }
+        else if (phase_ == Phase::RECV_ENTER_SENT_START && !sent_urgent_start_ && (is_pressured() || (state_ == State::STOPPING))) {
+            // The domain may be holding our request back. Let it know we can't wait much longer,
+            // and that a stopping region shouldn't wait at all.
+            send_start(true);
+        }
+
+        // Nobody else is going to step an embedded domain while we wait, so do it until it has
+        // something for us. It only sends from this thread, so there's no need to block on our own doorbell.
+        const bool drive_domain = drives_domain_ && !non_blocking;
+        if (drive_domain) {
+            domain_.step(true);
+            while (!connection_.client_endpoint().has_pending()) {
+                domain_.step(false);
+            }
+        }
 
-        for (const Message& message: region_endpoint().receive_messages(non_blocking)) {
+        for (const Message& message: region_endpoint().receive_messages(non_blocking || drive_domain)) {
             debug("[region:{}] received {}", id_, to_string(message.type));
+            trace(TraceSource::REGION, id_, TraceEventType::RECEIVE, static_cast<uint32_t>(message.type));
             handle_message(message);
         }
 
         finalize_garbage();
+
+        // Coroutines may write operations or step again, so only resume them once we're done.
+        resume_awaiters(false);
     }
 
 inline
-    void Region::flush_operation(Operation operation) {
-        do {
-            constexpr bool non_blocking = false;
-            step(non_blocking);
-        } while (!ledger_.write(operation));
+    bool Region::has_work() const {
+        if (connection_.client_endpoint().has_pending() || has_garbage()) {
+            return true;
+        }
+
+        // These mirror the conditions for sending a start in `step`.
+        if (phase_ == INITIAL_PHASE) {
+            return wants_cycle();
+        }
+
+        return (phase_ == Phase::RECV_ENTER_SENT_START) && !sent_urgent_start_ && (is_pressured() || (state_ == State::STOPPING));
     }
 
 inline
-    const OperationLedger& Region::ledger() const {
-        return ledger_;
+    bool Region::Awaiter::await_ready() const {
+        return region_.is_awaited(cycle_, quiesce_);
     }
 
 inline
-    Endpoint& Region::domain_endpoint() {
-        return connection_.server_endpoint();
+    void Region::Awaiter::await_suspend(const std::coroutine_handle<> handle) {
+        region_.awaiting_.push_back({ .cycle = cycle_, .quiesce = quiesce_, .handle = handle });
     }
 
 inline
-    Endpoint& Region::region_endpoint() {
-        return connection_.client_endpoint();
+    auto Region::next_cycle() -> Awaiter {
+        // Operations written now go into the transaction submitted in the cycle after the current one.
+        return Awaiter(*this, cycle_ + 1, false);
     }
 
 inline
-    void Region::handle_message(const Message& message) {
-        assert(state_ != State::STOPPED);
+    auto Region::quiesce() -> Awaiter {
+        return Awaiter(*this, cycle_, true);
+    }
 
-        switch (message.type) {
-            case MessageType::START: {
-                abort();
-            }
-            case MessageType::ENTER: {
-                assert((phase_ == Phase::RECV_ENTER) || (phase_ == Phase::RECV_ENTER_SENT_START));
+inline
+    bool Region::wants_cycle() const {
+        return (cycle_ == INITIAL_CYCLE) || (state_ == State::STOPPING) || has_pending_work() || !awaiting_.empty();
+    }
 
-                // Wrap up the current transaction and submit ranges of operations
-                // that can be applied.
-                ledger_.commit_transaction();
-                {
-                    // Check if the region is ready to stop.
-                    bool stop = true;
-                    stop &= state_ == State::STOPPING;
-                    stop &= ledger_.is_empty();
+inline
+    bool Region::has_pending_work() const {
+        bool pending = false;
+        pending |= !ledger_.is_empty();
+        pending |= has_spilled_operations();
+        pending |= has_fallback_operations();
+        pending |= has_local_operations();
+        pending |= has_shards();
+        pending |= has_combined_operations();
+        pending |= has_barrier_operations();
+        pending |= has_retired_memory();
+        return pending;
+    }
 
-                    region_endpoint().send_message(
-                        Message {
-                            .submit = {
-                                .type       = MessageType::SUBMIT,
-                                .stop       = stop,
-                                .increments = ledger_.transaction_log().select(0),
-                                .decrements = ledger_.transaction_log().select(2),
-                            },
-                        }
-                    );
-                }
-                ledger_.begin_transaction();
+inline
+    bool Region::is_quiescent() const {
+        return !has_pending_work() && !has_garbage();
+    }
 
-                transition(message.enter.cycle);
-                transition(Phase::RECV_RETIRE);
-                break;
-            }
-            case MessageType::SUBMIT: {
-                abort();
-            }
-            case MessageType::RETIRE: {
-                assert(phase_ == Phase::RECV_RETIRE);
+inline
+    bool Region::is_awaited(const Cycle cycle, const bool quiesce) const {
+        if (state_ == State::STOPPED) {
+            return true;
+        }
 
-                assert(!garbage_);
-                garbage_ = message.retire.garbage;
+        if (quiesce) {
+            return is_quiescent();
+        }
 
-                transition(Phase::RECV_LEAVE);
-                break;
-            }
-            case MessageType::LEAVE: {
-                assert(phase_ == Phase::RECV_LEAVE);
+        return (phase_ == INITIAL_PHASE) && (cycle_ >= cycle);
+    }
 
-                if (message.leave.stop) {
-                    transition(RegionState::STOPPED);
-                }
+inline
+    void Region::resume_awaiters(const bool stopped) {
+        if (awaiting_.empty()) {
+            return;
+        }
 
-                transition(INITIAL_PHASE);
-                break;
+        // Resumed coroutines can wait on us again, so take the ready ones out before resuming any.
+        std::vector<std::coroutine_handle<>> ready;
+        std::erase_if(awaiting_, [&](const AwaitingCoroutine& awaiting) {
+            if (!stopped && !is_awaited(awaiting.cycle, awaiting.quiesce)) {
+                return false;
             }
+
+            ready.push_back(awaiting.handle);
+            return true;
+        });
+
+        for (const std::coroutine_handle<> handle: ready) {
+            handle.resume();
         }
     }
 
 inline
-    void Region::transition(const State next_state) {
-        if (state_ == next_state) {
-            return;
+    void Region::retire(void* pointer, void (*deleter)(void*)) {
+        assert(pointer && deleter);
+
+        // Readers may have loaded the pointer just now, and regions that submitted the next cycle
+        // may have done so before that. The submit of the cycle after it follows ours, and ours only
+        // follows this call, so once every region has sent it nobody can still be reading.
+        retired_memory_.push_back({ .pointer = pointer, .deleter = deleter, .cycle = cycle_ + 2 });
+    }
+
+inline
+    bool Region::has_retired_memory() const {
+        return !retired_memory_.empty();
+    }
+
+inline
+    void Region::free_retired_memory() {
+        // The domain only retires a cycle once it has every submit, so being past that point is enough.
+        const bool retired_cycle = phase_ != Phase::RECV_RETIRE;
+
+        // Deleters may retire more memory, so iterate by index.
+        size_t i = 0;
+        for (; i < retired_memory_.size(); ++i) {
+            const RetiredMemory retired = retired_memory_[i];
+            if ((retired.cycle > cycle_) || ((retired.cycle == cycle_) && !retired_cycle)) {
+                break;
+            }
+
+            retired.deleter(retired.pointer);
         }
 
-        debug("[region:{}] transition state {} to {}", id_, to_string(state_), to_string(next_state));
-        state_ = next_state;
+        retired_memory_.erase(retired_memory_.begin(), retired_memory_.begin() + i);
+        metrics_.retired_count += i;
     }
 
 inline
-    void Region::transition(const Phase next_phase) {
-        if (phase_ == next_phase) {
-            return;
+    void Region::bind_object(Object& object, const size_t byte_cost) {
+        object.bind(id_);
+        if (reference_count_table_) {
+            object.set_reference_count_slot(reference_count_table_->allocate());
         }
 
-        debug("[region:{}] transition phase {} to {}", id_, to_string(phase_), to_string(next_phase));
-        phase_ = next_phase;
+        if (pressure_bytes_ && byte_cost) {
+            const size_t bit = to_byte_cost_filter_bit(object);
+            byte_cost_filter_[bit / 64] |= uint64_t{1} << (bit % 64);
+            byte_costs_[&object] = ByteCost{ .bytes = byte_cost };
+        }
+
+        if (heap_census_) {
+            heap_census_deltas_[heap_census_cursor_ % heap_census_deltas_.size()].bound_groups.push_back(object.group());
+        }
+
+        metrics_.bound_count += 1;
     }
 
 inline
-    void Region::transition(const Cycle next_cycle) {
-        if (cycle_ == next_cycle) {
+    void Region::flush_operation(Operation operation) {
+        if (ledger_overflow_) {
+            OperationSpill& spill = spills_[spill_cursor_ % SPILL_HISTORY];
+            if (spill.is_empty()) {
+                metrics_.overflow_count += 1;
+            }
+
+            spill.write(operation);
+            metrics_.spilled_count += 1;
             return;
         }
 
-        debug("[region:{}] transition cycle {} to {}", id_, cycle_, next_cycle);
-        cycle_ = next_cycle;
+        do {
+            constexpr bool non_blocking = false;
+            step(non_blocking);
+        } while (!ledger_.write(operation));
     }
 
 inline
-    void Region::finalize_garbage() {
-        if (depth_) {
-            // `Region::step` and `ObjectFinalizer::finalize` are co-recursive.
-            // Short circuiting object finalization in nested `Region::step` calls
-            // prevents unbounded stack usage.
-            assert(depth_ == 1);
+    bool Region::try_write_operation(const Operation operation) {
+        if (UNLIKELY(apply_local_operations_) && (operation.object()->region_id() == id_)) {
+            write_operation(operation);
+            return true;
+        }
 
-            if (garbage_) {
-                // Add garbage to the pile until we can safely deal with it.
-                garbage_->for_each_group([this](ObjectGroup, std::span<Object*> members) {
-                    garbage_pile_.insert(
-                        garbage_pile_.end(),
-                        members.begin(),
-                        members.end()
-                    );
-                });
+        if (LIKELY(ledger_.write(operation))) {
+            return true;
+        }
 
-                garbage_.reset();
-            }
+        if (ledger_overflow_) {
+            flush_operation(operation);
+            return true;
         }
-        else {
-            ScopedIncrement lock(depth_);
 
-            if (garbage_) {
-                if constexpr (ENABLE_OBJECT_GROUPING) {
-                    assert(garbage_->object_count == garbage_->group_offsets[garbage_->group_max + 1]);
+        return false;
+    }
 
-                    garbage_->for_each_group([this](ObjectGroup group, std::span<Object*> members) {
-                        finalizer_.finalize(group, members);
-                    });
-                }
-                else {
-                    for (size_t i = 0; i < garbage_->object_count; ++i) {
-                        Object* object = garbage_->objects[i];
-                        finalizer_.finalize(object->group(), std::span{&object, 1});
-                    }
-                }
+inline
+    void Region::drop_byte_cost(const Object& object) {
+        const auto it = byte_costs_.find(&object);
+        if (it == byte_costs_.end()) {
+            return;
+        }
 
-                garbage_.reset();
-            }
+        // Bytes still counted for an earlier decrement move to this transaction, rather than being added twice.
+        ByteCost& cost = it->second;
+        if (cost.is_dropped && ((dropped_cursor_ - cost.dropped_cursor) < (DROPPED_BYTES_HISTORY - 1))) {
+            dropped_bytes_history_[cost.dropped_cursor % DROPPED_BYTES_HISTORY] -= cost.bytes;
+        }
+        else {
+            dropped_bytes_ += cost.bytes;
+        }
 
-            if (UNLIKELY(!garbage_pile_.empty())) {
-                // This collection can be modified while we are iterating over it.
-                // Use index-based iteration to avoid invalidation issues.
-                for (size_t i = 0; i < garbage_pile_.size(); ++i) {
-                    Object* object = garbage_pile_[i];
-                    finalizer_.finalize(object->group(), std::span{&object, 1});
-                }
+        dropped_bytes_history_[dropped_cursor_ % DROPPED_BYTES_HISTORY] += cost.bytes;
+        cost.is_dropped = true;
+        cost.dropped_cursor = dropped_cursor_;
+    }
 
-                garbage_pile_.clear();
+inline
+    void Region::drop_byte_costs(const std::span<const Operation> operations) {
+        for (const Operation operation: operations) {
+            if ((operation.type() == OperationType::DECREMENT) && has_byte_cost(*operation.object())) {
+                drop_byte_cost(*operation.object());
             }
         }
     }
 
 inline
-    std::string_view to_string(RegionState state) {
-        using namespace std::literals;
+    void Region::flush_combined_operations() {
+        // This runs while the domain waits for us to submit, so unlike `flush_operation` it can't
+        // wait for room. Whatever doesn't fit is written to a later transaction instead, which is
+        // what a stalled write would have ended up doing too.
+        combiner_.flush([this](const Operation operation) {
+            return try_write_operation(operation);
+        });
 
-        switch (state) {
-#define X(MANTLE_REGION_STATE)                     \
-            case RegionState::MANTLE_REGION_STATE: \
-                return #MANTLE_REGION_STATE ##sv;  \
+        metrics_.combined_count = combiner_.written_count() - std::min(combiner_.written_count(), combiner_.emitted_count());
+    }
+
+inline
+    bool Region::has_combined_operations() const {
+        return !combiner_.is_empty();
+    }
 
-        MANTLE_REGION_STATES(X)
-#undef X
+inline
+    bool Region::has_spilled_operations() const {
+        if (!spill_operations_) {
+            return false;
         }
 
-        abort();
+        // Decrements of the previous two transactions have yet to be submitted, and those of the one
+        // before may not have been applied yet.
+        bool spilled = false;
+        spilled |= !spills_[spill_cursor_ % SPILL_HISTORY].is_empty();
+        spilled |= !spills_[(spill_cursor_ - 1) % SPILL_HISTORY].decrements.empty();
+        spilled |= !spills_[(spill_cursor_ - 2) % SPILL_HISTORY].decrements.empty();
+        spilled |= !spills_[(spill_cursor_ - 3) % SPILL_HISTORY].decrements.empty();
+        return spilled;
     }
 
 inline
-    std::string_view to_string(RegionPhase phase) {
-        using namespace std::literals;
+    void Region::reconcile_shards() {
+        for (auto it = shards_.begin(); it != shards_.end();) {
+            auto& [object, shard] = *it;
 
-        switch (phase) {
-#define X(MANTLE_REGION_PHASE)                     \
-            case RegionPhase::MANTLE_REGION_PHASE: \
-                return #MANTLE_REGION_PHASE ##sv;  \
+            if (std::exchange(shard.touched, false)) {
+                ++it;
+                continue;
+            }
 
-        MANTLE_REGION_PHASES(X)
-#undef X
-        }
+            // The delta's increments are applied before the shard's decrement, like any other. If the
+            // decrement doesn't make it into this transaction, nothing of the shard is lost by keeping
+            // it, but it must not be written ahead of the delta.
+            shard.delta = try_write_delta(*object, shard.delta);
+            if ((shard.delta != 0) || !try_write_operation(make_decrement_operation(object, Operation::EXPONENT_MAX))) {
+                ++it;
+                continue;
+            }
 
-        abort();
+            it = shards_.erase(it);
+        }
     }
 
-}
+inline
+    void Region::flush_shard(Object& object) {
+        while (true) {
+            // A step may have given the shard back, delta and all.
+            const auto it = shards_.find(&object);
+            if (it == shards_.end()) {
+                return;
+            }
 
+            Shard& shard = it->second;
+            shard.delta = try_write_delta(object, shard.delta);
 
-// src/operation_grouper.cpp
+            // Drops can wait for room, since the shard's weight covers them. Copies can't grow much further.
+            if (shard.delta < SHARD_LIMIT) {
+                return;
+            }
 
-namespace mantle {
+            shard.touched = true;
 
-inline
-    OperationGrouper::OperationGrouper()
-        : cache_size_(0)
-    {
+            constexpr bool non_blocking = false;
+            step(non_blocking);
+        }
     }
 
 inline
-    auto OperationGrouper::metrics() const -> const Metrics& {
-        return metrics_;
+    bool Region::has_shards() const {
+        return !shards_.empty();
     }
 
 inline
-    bool OperationGrouper::is_dirty() const {
-        return cache_size_ > 0;
-    }
+    int64_t Region::try_write_delta(Object& object, int64_t delta) {
+        while (delta != 0) {
+            const OperationType type = (delta > 0) ? OperationType::INCREMENT : OperationType::DECREMENT;
+            const uint64_t magnitude = static_cast<uint64_t>((delta > 0) ? delta : -delta);
+            const uint8_t exponent = static_cast<uint8_t>(std::min<uint64_t>(log2_floor(magnitude), Operation::EXPONENT_MAX));
+
+            const Operation operation = make_operation(&object, type, exponent);
+            if (!try_write_operation(operation)) {
+                break;
+            }
+            delta -= operation.value();
+        }
 
-inline
-    std::span<std::pair<Object*, int64_t>> OperationGrouper::increments() {
-        return increments_;
+        return delta;
     }
 
 inline
-    std::span<std::pair<Object*, int64_t>> OperationGrouper::decrements() {
-        return decrements_;
-    }
+    void Region::apply_local_operations() {
+        // Like the domain, apply increments first so nothing dies early.
+        OperationSpill& committed = local_operations_[(local_cursor_ - 1) % SPILL_HISTORY];
+        for (const Operation operation: committed.increments) {
+            operation.mutable_object()->apply_increment(operation.magnitude());
+        }
+
+        OperationSpill& retired = local_operations_[(local_cursor_ - 3) % SPILL_HISTORY];
+        for (const Operation operation: retired.decrements) {
+            Object* object = operation.mutable_object();
+            if (!object->apply_decrement(operation.magnitude())) {
+                local_garbage_.push_back(object);
+            }
+        }
 
-inline
-    void OperationGrouper::write(const Operation operation, const bool flush) {
-        Object* object = operation.mutable_object();
+        metrics_.local_count += committed.increments.size() + retired.decrements.size();
+        committed.increments.clear();
+        retired.decrements.clear();
 
-        // Ignore no-ops.
-        if (UNLIKELY(!object)) {
+        if (local_garbage_.empty()) {
             return;
         }
 
-        if (flush) {
-            // Bypass the cache and immediately flush the operation.
-            // The operation doesn't need to be re-encoded which makes this
-            // much simpler than flushing an operation group.
-            if (operation.type() == OperationType::INCREMENT) {
-                increments_.emplace_back(operation.mutable_object(), operation.value());
-            }
-            else {
-                decrements_.emplace_back(operation.mutable_object(), operation.value());
+        // Finalize the dead in group-sized batches, along with whatever the domain found this cycle.
+        std::sort(local_garbage_.begin(), local_garbage_.end(), [](const Object* lhs, const Object* rhs) {
+            return lhs->group() < rhs->group();
+        });
+
+        std::vector<Object*>& target = depth_ ? garbage_pile_ : garbage_backlog_;
+        target.insert(target.end(), local_garbage_.begin(), local_garbage_.end());
+
+        if (heap_census_) {
+            std::vector<ObjectGroup>& released_groups = heap_census_deltas_[heap_census_cursor_ % heap_census_deltas_.size()].released_groups;
+            for (const Object* object: local_garbage_) {
+                released_groups.push_back(object->group());
             }
         }
-        else {
-            CacheCursor cursor = choose_way(object);
-            CacheEntry entry = cache_.load(cursor);
 
-            if (entry.key == object) {
-                // Update an existing group.
-                entry.val.delta += operation.value();
-                entry.val.hit_count += 1;
-                if (entry.val.delta) {
-                    cache_.store(cursor, entry);
-                }
-                else {
-                    cache_.reset(cursor);
-                    cache_size_ -= 1;
-                }
-            }
-            else if (entry.key) {
-                // Replace an existing group.
-                const bool force = true;
-                flush_group(cursor, force);
+        metrics_.local_released_count += local_garbage_.size();
+        local_garbage_.clear();
+    }
 
-                cache_.store(cursor, CacheEntry {
-                    .key = object,
-                    .val = {
-                        .delta     = operation.value(),
-                        .hit_count = 0,
-                        .hit_decay = 1,
-                    },
-                });
+inline
+    bool Region::has_local_operations() const {
+        if (!apply_local_operations_) {
+            return false;
+        }
 
-                cache_size_ += 1;
-            }
-            else {
-                // Insert a new group.
-                cache_.store(cursor, CacheEntry {
-                    .key = object,
-                    .val = {
-                        .delta     = operation.value(),
-                        .hit_count = 0,
-                        .hit_decay = 1,
-                    },
-                });
+        return std::ranges::any_of(local_operations_, [](const OperationSpill& spill) { return !spill.is_empty(); });
+    }
 
-                cache_size_ += 1;
-            }
+inline
+    bool Region::has_fallback_operations() const {
+        return fallback_ledger_ && fallback_ledger_->has_operations();
+    }
 
-            note_operation_written(operation);
-        }
+inline
+    bool Region::has_write_barriers() const {
+        return barrier_ledger_.has_value();
     }
 
 inline
-    void OperationGrouper::flush(const bool force) {
-        for (CacheCursor cursor; cursor; cursor.advance()) {
-            flush_group(cursor, force);
-        }
+    bool Region::has_barrier_operations() const {
+        return barrier_ledger_ && !barrier_ledger_->is_empty();
     }
 
 inline
-    void OperationGrouper::clear() {
-        increments_.clear();
-        decrements_.clear();
+    const OperationLedger& Region::ledger() const {
+        return ledger_;
     }
 
 inline
-    void OperationGrouper::reset() {
-        for (CacheCursor cursor; cursor; cursor.advance()) {
-            reset_group(cursor);
-        }
-        assert(cache_size_ == 0);
+    Endpoint& Region::domain_endpoint() {
+        return connection_.server_endpoint();
+    }
 
-        clear();
+inline
+    Endpoint& Region::region_endpoint() {
+        return connection_.client_endpoint();
     }
 
 inline
-    auto OperationGrouper::choose_way(Object* object) -> CacheCursor {
-        // Find the set that maps to this object.
-        std::pair<CacheCursor, CacheCursor> set = cache_.equal_range(object);
+    void Region::handle_message(const Message& message) {
+        assert(state_ != State::STOPPED);
 
-        // Check if an entry for the object already exists in the set.
-        for (CacheCursor cursor = set.first; cursor != set.second; cursor.advance()) {
-            if (auto&& [key, _] = cache_.load(cursor); key == object) {
-                return cursor;
+        switch (message.type) {
+            case MessageType::START: {
+                abort();
             }
-        }
+            case MessageType::ENTER: {
+                assert((phase_ == Phase::RECV_ENTER) || (phase_ == Phase::RECV_ENTER_SENT_START));
 
-        // Look for an empty entry.
-        for (CacheCursor cursor = set.first; cursor != set.second; cursor.advance()) {
-            if (auto&& [key, _] = cache_.load(cursor); !key) {
-                return cursor;
-            }
-        }
+                // The domain is free to reuse the memory backing our garbage once we've submitted.
+                stash_garbage();
 
-        // Find the entry with the lowest delta magnitude. Break ties by choosing the lowest way.
-        {
-            CacheCursor min_cursor = set.first;
-            int64_t min_delta_magnitude = std::numeric_limits<int64_t>::max();
+                // Wrap up the current transaction and submit ranges of operations
+                // that can be applied. Operations folded together on our side only go in now.
+                if (has_shards()) {
+                    reconcile_shards();
+                }
+                flush_combined_operations();
+                ledger_.commit_transaction();
 
-            for (CacheCursor cursor = set.first; cursor != set.second; cursor.advance()) {
-                auto&& [key, group] = cache_.load(cursor);
+                // Take over whatever threads without a region have written, as if it were part of this
+                // transaction. Anything they dropped was handed to them through some region, and that
+                // region's own decrement is still two transactions away when it sees their writes here.
+                if (has_fallback_operations()) {
+                    fallback_ledger_->drain(spills_[spill_cursor_ % SPILL_HISTORY]);
+                }
 
-                const int64_t delta = group.delta;
-                const int64_t delta_magnitude = delta < 0 ? -delta : +delta;
+                // The barrier that was submitted last time has been routed by now, so it can be recycled.
+                if (barrier_ledger_) {
+                    barrier_ledger_->step();
+                }
 
-                if (delta_magnitude < min_delta_magnitude) {
-                    min_cursor = cursor;
-                    min_delta_magnitude = delta_magnitude;
+                const OperationPartition* increment_partition = nullptr;
+                const OperationPartition* decrement_partition = nullptr;
+                if (partition_operations_) {
+                    // Increments are submitted straight away, and decrements two transactions later.
+                    partition_cursor_ += 1;
+
+                    OperationPartition& partition = partitions_[partition_cursor_ % PARTITION_HISTORY];
+                    partition.assign(ledger_, ledger_.transaction_log().select(0));
+
+                    increment_partition = &partition;
+                    decrement_partition = &partitions_[(partition_cursor_ - 2) % PARTITION_HISTORY];
                 }
-            }
 
-            return min_cursor;
-        }
-    }
+                // Spilled operations follow the same schedule as the ledger's.
+                const OperationSpill* increment_spill = nullptr;
+                const OperationSpill* decrement_spill = nullptr;
+                if (spill_operations_) {
+                    increment_spill = &spills_[spill_cursor_ % SPILL_HISTORY];
+                    decrement_spill = &spills_[(spill_cursor_ - 2) % SPILL_HISTORY];
+                }
 
-inline
-    void OperationGrouper::flush_group(const CacheCursor cursor, const bool force) {
-        auto&& [key, group] = cache_.load(cursor);
-        if (!key) {
-            return;
-        }
+                {
+                    // Check if the region is ready to stop.
+                    bool stop = true;
+                    stop &= state_ == State::STOPPING;
+                    stop &= is_quiescent();
 
-        // Operation groups need an exponential number of hits to avoid being flushed.
-        group.hit_decay *= 2;
-        if (group.hit_decay < group.hit_count && !force) {
-            return; // Seems active, keep this group alive for now.
-        }
+                    region_endpoint().send_message(
+                        Message {
+                            .submit = {
+                                .type       = MessageType::SUBMIT,
+                                .stop       = stop,
+                                .increments = ledger_.transaction_log().select(0),
+                                .decrements = ledger_.transaction_log().select(2),
+                                .increment_partition = increment_partition,
+                                .decrement_partition = decrement_partition,
+                                .increment_spill     = increment_spill,
+                                .decrement_spill     = decrement_spill,
+                                .barrier             = barrier_ledger_ ? &barrier_ledger_->apply_barrier() : nullptr,
+                                .finalized_count     = metrics_.finalized_count,
+                                .bound_count         = metrics_.bound_count,
+                                .released_count      = metrics_.local_released_count,
+                                .heap_census         = heap_census_ ? &heap_census_deltas_[heap_census_cursor_ % heap_census_deltas_.size()] : nullptr,
+                            },
+                        }
+                    );
+                    trace(TraceSource::REGION, id_, TraceEventType::SEND, static_cast<uint32_t>(MessageType::SUBMIT));
+                }
+                ledger_.begin_transaction();
 
-        std::vector<std::pair<Object*, int64_t>>& collection = group.delta >= 0 ? increments_ : decrements_;
-        collection.emplace_back(key, group.delta);
+                if (heap_census_) {
+                    // The delta before the one just submitted has been read by now.
+                    heap_census_cursor_ += 1;
+                    heap_census_deltas_[heap_census_cursor_ % heap_census_deltas_.size()].clear();
+                }
 
-        reset_group(cursor);
-    }
+                if (apply_local_operations_) {
+                    // Operations from now on are applied two cycles from now at the earliest.
+                    local_cursor_ += 1;
+                }
 
-inline
-    void OperationGrouper::reset_group(const CacheCursor cursor) {
-        if (auto&& [key, _] = cache_.load(cursor); key) {
-            assert(cache_size_ > 0);
-            cache_.reset(cursor);
-            cache_size_ -= 1;
-        }
-    }
+                if (spill_operations_) {
+                    // The entry is reused after three transactions. Its spill was last submitted with the
+                    // decrements of the transaction before this one, and has been routed by now.
+                    spill_cursor_ += 1;
+                    spills_[spill_cursor_ % SPILL_HISTORY].clear();
+                }
 
-inline
-    void OperationGrouper::note_operation_written(const Operation operation) {
-        metrics_.written_count += 1;
+                if (pressure_bytes_) {
+                    // Decrements from two transactions ago were just submitted, so whatever they dropped
+                    // is reclaimed by this cycle unless it is still referenced.
+                    dropped_cursor_ += 1;
+                    dropped_bytes_ -= std::exchange(dropped_bytes_history_[(dropped_cursor_ - 3) % DROPPED_BYTES_HISTORY], 0);
+                }
 
-        switch (operation.type()) {
-            case OperationType::INCREMENT: {
-                metrics_.written_increment_count += 1;
+                transition(message.enter.cycle);
+                transition(Phase::RECV_RETIRE);
                 break;
             }
-            case OperationType::DECREMENT: {
-                metrics_.written_decrement_count += 1;
-                break;
+            case MessageType::SUBMIT: {
+                abort();
             }
-        }
-    }
+            case MessageType::RETIRE: {
+                assert(phase_ == Phase::RECV_RETIRE);
 
-inline
-    void OperationGrouper::note_operation_flushed(const Operation operation) {
-        metrics_.flushed_count += 1;
+                assert(!garbage_);
+                garbage_ = message.retire.garbage;
 
-        switch (operation.type()) {
-            case OperationType::INCREMENT: {
-                metrics_.flushed_increment_count += 1;
+                if (apply_local_operations_) {
+                    apply_local_operations();
+                }
+
+                transition(Phase::RECV_LEAVE);
                 break;
             }
-            case OperationType::DECREMENT: {
-                metrics_.flushed_decrement_count += 1;
+            case MessageType::LEAVE: {
+                assert(phase_ == Phase::RECV_LEAVE);
+
+                if (message.leave.stop) {
+                    transition(RegionState::STOPPED);
+                }
+
+                transition(INITIAL_PHASE);
                 break;
             }
         }
     }
 
-}
-
-
-// src/object.cpp
+inline
+    void Region::transition(const State next_state) {
+        if (state_ == next_state) {
+            return;
+        }
 
-namespace mantle {
+        debug("[region:{}] transition state {} to {}", id_, to_string(state_), to_string(next_state));
+        trace(TraceSource::REGION, id_, TraceEventType::STATE, static_cast<uint32_t>(next_state));
+        state_ = next_state;
+    }
 
 inline
-    Object::Object(ObjectGroup group)
-        : reference_count_(0)
-        , region_id_(INVALID_REGION_ID)
-        , group_(group)
-    {
+    void Region::transition(const Phase next_phase) {
+        if (phase_ == next_phase) {
+            return;
+        }
+
+        debug("[region:{}] transition phase {} to {}", id_, to_string(phase_), to_string(next_phase));
+        trace(TraceSource::REGION, id_, TraceEventType::PHASE, static_cast<uint32_t>(next_phase), cycle_);
+        phase_ = next_phase;
     }
 
 inline
-    Object::~Object() {
-#if MANTLE_AUDIT
-        bool halting = !has_region();
-        bool dropped = reference_count_ == 0;
+    void Region::transition(const Cycle next_cycle) {
+        if (cycle_ == next_cycle) {
+            return;
+        }
 
-        assert(halting || dropped);
-#endif
+        debug("[region:{}] transition cycle {} to {}", id_, cycle_, next_cycle);
+        trace(TraceSource::REGION, id_, TraceEventType::CYCLE, 0, next_cycle);
+        cycle_ = next_cycle;
     }
 
 inline
-    bool Object::is_managed() const {
-        return region_id_ != INVALID_REGION_ID;
+    bool Region::is_ledger_pressured() const {
+        return ledger_.writable_transaction_entries() <= urgent_start_entries_;
     }
 
 inline
-    RegionId Object::region_id() const {
-        return region_id_;
+    bool Region::is_memory_pressured() const {
+        return pressure_bytes_ && (dropped_bytes_ >= pressure_bytes_);
     }
 
 inline
-    ObjectGroup Object::group() const {
-        return group_;
+    bool Region::is_pressured() const {
+        return is_ledger_pressured() || is_memory_pressured();
     }
 
 inline
-    void Object::bind(RegionId region_id) {
-        if (UNLIKELY(is_managed())) {
-            abort(); // Don't bind an object more than once.
+    void Region::send_start(const bool urgent) {
+        if (urgent && !is_ledger_pressured() && is_memory_pressured()) {
+            metrics_.pressure_start_count += 1;
         }
 
-        region_id_ = region_id;
+        region_endpoint().send_message(make_start_message(urgent));
+        trace(TraceSource::REGION, id_, TraceEventType::SEND, static_cast<uint32_t>(MessageType::START));
+
+        sent_urgent_start_ = urgent;
     }
 
 inline
-    void Object::start_increment_operation(uint8_t exponent) {
-        start_increment_operation(make_increment_operation(this, exponent));
+    bool Region::has_garbage() const {
+        return garbage_ || (garbage_backlog_offset_ < garbage_backlog_.size()) || !garbage_pile_.empty();
     }
 
 inline
-    void Object::start_increment_operation(Operation operation) {
-        assert(operation.type() == OperationType::INCREMENT);
+    void Region::stash_garbage() {
+        if (!garbage_) {
+            return;
+        }
 
-        if (Region* region = Region::thread_local_instance(); LIKELY(region)) {
-            region->start_increment_operation(*this, operation);
+        // The backlog is being iterated over while finalization is in progress. Garbage
+        // received by nested `Region::step` calls goes on the pile instead.
+        std::vector<Object*>& target = depth_ ? garbage_pile_ : garbage_backlog_;
+
+        // Leave out whatever finalization has already got to.
+        if constexpr (ENABLE_OBJECT_GROUPING) {
+            garbage_->for_each_group([&](ObjectGroup group, std::span<Object*> members) {
+                if (group >= garbage_cursor_) {
+                    target.insert(target.end(), members.begin(), members.end());
+                }
+            });
         }
         else {
-            // Leak.
+            target.insert(target.end(), garbage_->objects + garbage_cursor_, garbage_->objects + garbage_->object_count);
         }
-    }
 
-inline
-    void Object::start_decrement_operation(uint8_t exponent) {
-        start_decrement_operation(make_decrement_operation(this, exponent));
+        garbage_.reset();
+        garbage_cursor_ = 0;
     }
 
 inline
-    void Object::start_decrement_operation(Operation operation) {
-        assert(operation.type() == OperationType::DECREMENT);
+    void Region::finalize_garbage() {
+        if (depth_) {
+            // `Region::step` and `ObjectFinalizer::finalize` are co-recursive.
+            // Short circuiting object finalization in nested `Region::step` calls
+            // prevents unbounded stack usage.
+            assert(depth_ == 1);
 
-        if (Region* region = Region::thread_local_instance(); LIKELY(region)) {
-            region->start_decrement_operation(*this, operation);
+            // Add garbage to the pile until we can safely deal with it.
+            stash_garbage();
         }
         else {
-            // Leak.
+            ScopedIncrement lock(depth_);
+            FinalizationBudget budget(domain_.config());
+
+            // Budgeted finalization can stop part way through, so garbage is copied somewhere
+            // that will still be valid during the next step.
+            if (garbage_ && !budget.is_unbounded()) {
+                stash_garbage();
+            }
+
+            // Finalize carried over garbage in group-sized batches.
+            while ((garbage_backlog_offset_ < garbage_backlog_.size()) && !budget.is_exhausted()) {
+                const size_t first = garbage_backlog_offset_;
+                const size_t limit = first + std::min(garbage_backlog_.size() - first, budget.batch_limit());
+                const ObjectGroup group = garbage_backlog_[first]->group();
+
+                size_t last = first + 1;
+                while ((last < limit) && (garbage_backlog_[last]->group() == group)) {
+                    last += 1;
+                }
+
+                garbage_backlog_offset_ = last;
+                budget.spend(last - first);
+                finalize_objects(group, std::span{&garbage_backlog_[first], last - first});
+            }
+            if (garbage_backlog_offset_ == garbage_backlog_.size()) {
+                garbage_backlog_.clear();
+                garbage_backlog_offset_ = 0;
+            }
+
+            if (garbage_) {
+                assert(budget.is_unbounded());
+
+                // A finalizer that steps can take us into the next cycle, which stashes the rest of the
+                // garbage and lets the domain reuse it. Stop reading it as soon as that happens.
+                ObjectGroups garbage = *garbage_;
+                if constexpr (ENABLE_OBJECT_GROUPING) {
+                    for (size_t word = garbage.group_min / OBJECT_GROUP_MASK_WORD_BITS; garbage_ && (word <= (garbage.group_max / OBJECT_GROUP_MASK_WORD_BITS)); ++word) {
+                        for (uint64_t bits = (*garbage.group_mask)[word]; garbage_ && bits; bits &= bits - 1) {
+                            const ObjectGroup group = static_cast<ObjectGroup>((word * OBJECT_GROUP_MASK_WORD_BITS) + static_cast<size_t>(__builtin_ctzll(bits)));
+                            garbage_cursor_ = size_t{group} + 1;
+                            finalize_objects(group, garbage.group_members(group));
+                        }
+                    }
+                }
+                else {
+                    for (size_t i = 0; garbage_ && (i < garbage.object_count); ++i) {
+                        garbage_cursor_ = i + 1;
+                        Object* object = garbage.objects[i];
+                        finalize_objects(object->group(), std::span{&object, 1});
+                    }
+                }
+
+                garbage_.reset();
+                garbage_cursor_ = 0;
+            }
+
+            // Finalizers keep adding to the pile while it is being finalized, e.g. when tearing down a
+            // tree. Take it over a round at a time, and finalize each round in group-sized batches.
+            while (UNLIKELY(!garbage_pile_.empty()) && !budget.is_exhausted()) {
+                std::vector<Object*>& round = garbage_pile_round_;
+                assert(round.empty());
+                round.swap(garbage_pile_);
+
+                // Each stash is group ordered, but a round can hold many of them.
+                std::sort(round.begin(), round.end(), [](const Object* lhs, const Object* rhs) {
+                    return lhs->group() < rhs->group();
+                });
+
+                size_t first = 0;
+                while ((first < round.size()) && !budget.is_exhausted()) {
+                    const size_t limit = first + std::min(round.size() - first, budget.batch_limit());
+                    const ObjectGroup group = round[first]->group();
+
+                    size_t last = first + 1;
+                    while ((last < limit) && (round[last]->group() == group)) {
+                        last += 1;
+                    }
+
+                    budget.spend(last - first);
+                    finalize_objects(group, std::span{&round[first], last - first});
+                    first = last;
+                }
+
+                // What the budget didn't cover goes before anything the round added.
+                garbage_pile_.insert(garbage_pile_.begin(), round.begin() + first, round.end());
+                round.clear();
+            }
+
+            if (has_retired_memory()) {
+                free_retired_memory();
+            }
+
+            // Stay readable so that we get stepped again.
+            if (has_garbage()) {
+                region_endpoint().notify();
+            }
         }
     }
 
 inline
-    bool Object::apply_increment(const uint32_t delta_magnitude) {
-        reference_count_ += delta_magnitude;
-        return true;
-    }
+    void Region::finalize_objects(const ObjectGroup group, const std::span<Object*> objects) {
+        metrics_.finalized_count += objects.size();
+        trace(TraceSource::REGION, id_, TraceEventType::FINALIZE, 0, objects.size());
+
+        if (!byte_costs_.empty()) {
+            for (const Object* object: objects) {
+                if (has_byte_cost(*object)) {
+                    byte_costs_.erase(object);
+                }
+            }
 
-inline
-    bool Object::apply_decrement(const uint32_t delta_magnitude) {
-        if (reference_count_ < delta_magnitude) {
-            reference_count_ = 0;
-            region_id_ = INVALID_REGION_ID;
-            return false;
+            // Bits can't be taken out one by one, since objects share them.
+            if (byte_costs_.empty()) {
+                byte_cost_filter_ = {};
+            }
         }
 
-        reference_count_ -= delta_magnitude;
-        return true;
+        finalizer_.finalize(group, objects);
     }
 
-}
+inline
+    std::string_view to_string(RegionState state) {
+        using namespace std::literals;
 
+        switch (state) {
+#define X(MANTLE_REGION_STATE)                     \
+            case RegionState::MANTLE_REGION_STATE: \
+                return #MANTLE_REGION_STATE ##sv;  \
 
-// src/region_controller.cpp
+        MANTLE_REGION_STATES(X)
+#undef X
+        }
 
-namespace mantle {
+        abort();
+    }
+
+inline
+    std::string_view to_string(RegionPhase phase) {
+        using namespace std::literals;
 
-    inline RegionControllerAction to_action(RegionControllerPhase phase) {
         switch (phase) {
-#define X(MANTLE_REGION_CONTROLLER_PHASE, MANTLE_REGION_CONTROLLER_ACTION)      \
-            case RegionControllerPhase::MANTLE_REGION_CONTROLLER_PHASE: {       \
-                return RegionControllerAction::MANTLE_REGION_CONTROLLER_ACTION; \
-            }                                                                   \
+#define X(MANTLE_REGION_PHASE)                     \
+            case RegionPhase::MANTLE_REGION_PHASE: \
+                return #MANTLE_REGION_PHASE ##sv;  \
 
-            MANTLE_REGION_CONTROLLER_PHASES(X)
+        MANTLE_REGION_PHASES(X)
 #undef X
         }
 
-        abort(); // Unreachable.
+        abort();
     }
 
-    inline RegionControllerPhase next(RegionControllerPhase phase) {
-        return static_cast<RegionControllerPhase>(
-            (static_cast<size_t>(phase) + 1) % REGION_CONTROLLER_PHASE_COUNT
-        );
-    }
+}
 
-inline
-    RegionControllerCensus::RegionControllerCensus()
-        : count_(0)
-        , min_cycle_(std::numeric_limits<Cycle>::max())
-        , max_cycle_(std::numeric_limits<Cycle>::min())
-    {
-        for (size_t& counter: state_counts_) {
-            counter = 0;
-        }
-        for (size_t& counter: phase_counts_) {
-            counter = 0;
-        }
-        for (size_t& counter: action_counts_) {
-            counter = 0;
-        }
-    }
+
+// src/region_pool.cpp
+
+namespace mantle {
 
 inline
-    RegionControllerCensus::RegionControllerCensus(const RegionControllerGroup& controllers)
-        : RegionControllerCensus()
+    RegionPool::RegionPool(Domain& domain, ObjectFinalizer& finalizer, const size_t capacity)
+        : domain_(domain)
+        , finalizer_(finalizer)
+        , capacity_(capacity)
     {
-        add(controllers);
+        parked_.reserve(capacity_);
     }
 
 inline
-    void RegionControllerCensus::add(const RegionController& controller) {
-        count_ += 1;
-        min_cycle_ = std::min(controller.cycle(), min_cycle_);
-        max_cycle_ = std::max(controller.cycle(), max_cycle_);
-        state_counts_[static_cast<size_t>(controller.state())] += 1;
-        phase_counts_[static_cast<size_t>(controller.phase())] += 1;
-        action_counts_[static_cast<size_t>(controller.action())] += 1;
-    }
+    RegionPool::~RegionPool() = default;
 
 inline
-    void RegionControllerCensus::add(const RegionControllerGroup& controllers) {
-        for (const std::unique_ptr<RegionController>& controller: controllers) {
-            add(*controller);
+    auto RegionPool::acquire() -> Lease {
+        std::unique_ptr<Region> region;
+        {
+            std::scoped_lock lock(mutex_);
+            if (!parked_.empty()) {
+                region = std::move(parked_.back());
+                parked_.pop_back();
+            }
         }
-    }
 
-inline
-    size_t RegionControllerCensus::count() const {
-        return count_;
-    }
+        if (!region) {
+            return { *this, std::make_unique<Region>(domain_, finalizer_) };
+        }
 
-inline
-    auto RegionControllerCensus::min_cycle() const -> Cycle {
-        return min_cycle_;
-    }
+        try {
+            region->adopt();
+        }
+        catch (...) {
+            release(std::move(region));
+            throw;
+        }
 
-inline
-    auto RegionControllerCensus::max_cycle() const -> Cycle {
-        return max_cycle_;
+        return { *this, std::move(region) };
     }
 
 inline
-    bool RegionControllerCensus::any(State state) const {
-        return state_counts_[static_cast<size_t>(state)] != 0;
-    }
+    size_t RegionPool::parked_count() const {
+        std::scoped_lock lock(mutex_);
 
-inline
-    bool RegionControllerCensus::all(State state) const {
-        return (count_ > 0) && state_counts_[static_cast<size_t>(state)] == count_;
+        return parked_.size();
     }
 
 inline
-    bool RegionControllerCensus::any(Phase phase) const {
-        return phase_counts_[static_cast<size_t>(phase)] != 0;
-    }
+    void RegionPool::release(std::unique_ptr<Region> region) {
+        region->park();
 
-inline
-    bool RegionControllerCensus::all(Phase phase) const {
-        return (count_ > 0) && phase_counts_[static_cast<size_t>(phase)] == count_;
+        std::scoped_lock lock(mutex_);
+        if (parked_.size() < capacity_) {
+            parked_.push_back(std::move(region));
+        }
     }
 
-inline
-    bool RegionControllerCensus::any(Action action) const {
-        return action_counts_[static_cast<size_t>(action)] != 0;
+}
+
+
+// src/trace.cpp
+
+namespace mantle {
+
+    // Every ring that has been created, so that rings of threads that have exited can still be read,
+    // and the ones that no thread is writing to anymore.
+    struct TraceRegistry {
+        std::mutex                              mutex;
+        std::vector<std::unique_ptr<TraceRing>> rings;
+        std::vector<TraceRing*>                 free_rings;
+    };
+
+    inline TraceRegistry& trace_registry() {
+        static TraceRegistry registry;
+        return registry;
     }
 
-inline
-    bool RegionControllerCensus::all(Action action) const {
-        return (count_ > 0) && action_counts_[static_cast<size_t>(action)] == count_;
+    // Regions and controllers are shown as threads of two separate processes.
+    inline int to_trace_process_id(const TraceSource source) {
+        return (source == TraceSource::REGION) ? 1 : 2;
     }
 
-inline
-    RegionController::RegionController(
-        const RegionId region_id,
-        RegionControllerGroup& controllers,
-        const OperationLedger& ledger,
-        const Config& config
-    )
-        : region_id_(region_id)
-        , controllers_(controllers)
-        , ledger_(ledger)
-        , config_(config)
-        , state_(State::STARTING)
-        , phase_(Phase::START)
-        , cycle_(0)
-        , submitted_increments_(EMPTY_SEQUENCE_RANGE)
-        , submitted_decrements_(EMPTY_SEQUENCE_RANGE)
-        , metrics_(operation_grouper_, object_grouper_)
-    {
+    inline uint32_t to_trace_track_key(const TraceEvent& event) {
+        return (static_cast<uint32_t>(event.source) << 16) | event.region_id;
     }
 
-inline
-    RegionId RegionController::region_id() const {
-        return region_id_;
+    inline std::string_view to_trace_phase_name(const TraceEvent& event) {
+        if (event.source == TraceSource::REGION) {
+            return to_string(static_cast<RegionPhase>(event.argument));
+        }
+        else {
+            return to_string(static_cast<RegionControllerPhase>(event.argument));
+        }
     }
 
-inline
-    auto RegionController::metrics() const -> const Metrics& {
-        return metrics_;
+    inline std::string_view to_trace_state_name(const TraceEvent& event) {
+        if (event.source == TraceSource::REGION) {
+            return to_string(static_cast<RegionState>(event.argument));
+        }
+        else {
+            return to_string(static_cast<RegionControllerState>(event.argument));
+        }
     }
 
 inline
-    bool RegionController::is_quiescent() const {
-        return !operation_grouper_.is_dirty();
-    }
+    TraceRing::Owner::Owner() {
+        TraceRegistry& registry = trace_registry();
+        std::scoped_lock lock(registry.mutex);
+
+        // The events of the thread that gave the ring back are kept until they are overwritten.
+        if (!registry.free_rings.empty()) {
+            ring_ = registry.free_rings.back();
+            registry.free_rings.pop_back();
+            return;
+        }
 
-inline
-    auto RegionController::state() const -> State {
-        return state_;
+        registry.rings.push_back(std::make_unique<TraceRing>(TRACE_RING_CAPACITY));
+        ring_ = registry.rings.back().get();
     }
 
 inline
-    auto RegionController::phase() const -> Phase {
-        return phase_;
+    TraceRing::Owner::~Owner() {
+        TraceRegistry& registry = trace_registry();
+        std::scoped_lock lock(registry.mutex);
+        registry.free_rings.push_back(ring_);
     }
 
 inline
-    auto RegionController::cycle() const -> Cycle {
-        return cycle_;
-    }
+    void TraceRing::snapshot(std::vector<TraceEvent>& events) const {
+        // The oldest slot is skipped once the ring is full, as the next event may be going into it.
+        const Sequence tail = head_.load(std::memory_order_acquire);
+        const Sequence head = (tail >= capacity()) ? (tail - capacity() + 1) : 0;
 
-inline
-    auto RegionController::action() const -> Action {
-        return to_action(phase_);
-    }
+        const size_t offset = events.size();
+        for (Sequence sequence = head; sequence != tail; ++sequence) {
+            events.push_back(events_[sequence]);
+        }
 
-inline
-    void RegionController::start(const Cycle cycle) {
-        if (state_ != State::STARTING) {
-            assert(false);
+        // Nothing was recorded while we were copying, so nothing can be torn.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const Sequence after = head_.load(std::memory_order_relaxed);
+        if (after == tail) {
             return;
         }
 
-        transition(cycle);
-        transition(State::RUNNING);
+        // Otherwise drop whatever was overwritten since, which includes the slot of the event at
+        // `after`, since events are written before the head moves past them.
+        if ((after + 1) > (head + capacity())) {
+            const size_t discard = std::min(after + 1 - capacity() - head, tail - head);
+            events.erase(events.begin() + offset, events.begin() + offset + discard);
+        }
     }
 
 inline
-    void RegionController::stop() {
-        if (state_ != State::STOPPING) {
-            assert(false);
-            return;
-        }
-
-        transition(State::STOPPED);
+    size_t trace_ring_count() {
+        TraceRegistry& registry = trace_registry();
+        std::scoped_lock lock(registry.mutex);
+        return registry.rings.size();
     }
 
 inline
-    auto RegionController::send_message() -> std::optional<Message> {
-        switch (phase_) {
-            case Phase::START: {
-                break;
-            }
-            case Phase::START_BARRIER: {
-                break;
-            }
-            case Phase::ENTER: {
-                transition(Phase::SUBMIT);
+    std::vector<TraceEvent> collect_trace() {
+        std::vector<TraceEvent> events;
+        {
+            TraceRegistry& registry = trace_registry();
+            std::scoped_lock lock(registry.mutex);
 
-                return Message {
-                    .enter = {
-                        .type  = MessageType::ENTER,
-                        .cycle = cycle_,
-                    },
-                };
+            for (const std::unique_ptr<TraceRing>& ring: registry.rings) {
+                ring->snapshot(events);
             }
-            case Phase::SUBMIT: {
-                break;
-            }
-            case Phase::SUBMIT_BARRIER: {
-                break;
-            }
-            case Phase::RETIRE_BARRIER: {
-                break;
-            }
-            case Phase::RETIRE: {
-                transition(Phase::LEAVE);
+        }
 
-                return Message {
-                    .retire = {
-                        .type    = MessageType::RETIRE,
-                        .garbage = object_grouper_.flush(),
-                    },
-                };
-            }
-            case Phase::LEAVE: {
-                transition(Phase::START);
-                if (state_ == State::STOPPED) {
-                    transition(State::SHUTDOWN);
-                }
+        std::stable_sort(events.begin(), events.end(), [](const TraceEvent& lhs, const TraceEvent& rhs) {
+            return lhs.timestamp < rhs.timestamp;
+        });
 
-                return Message {
-                    .leave = {
-                        .type = MessageType::LEAVE,
-                        .stop = state_ == State::SHUTDOWN,
-                    },
-                };
-            }
-        }
+        return events;
+    }
 
-        return std::nullopt;
+inline
+    void write_chrome_trace(std::ostream& stream) {
+        const std::vector<TraceEvent> events = collect_trace();
+        write_chrome_trace(stream, events);
     }
 
 inline
-    void RegionController::receive_message(const Message& message) {
-        switch (phase_) {
-            case Phase::START: {
-                if (message.type == MessageType::START) {
-                    transition(Phase::START_BARRIER);
-                }
-                break;
-            }
-            case Phase::START_BARRIER: {
-                break; // Redundant start messages are dropped.
-            }
-            case Phase::ENTER: {
-                break; // Redundant start messages are dropped.
+    void write_chrome_trace(std::ostream& stream, const std::span<const TraceEvent> events) {
+        const uint64_t origin = events.empty() ? 0 : events.front().timestamp;
+
+        bool first = true;
+        auto emit = [&](const std::string& line) {
+            stream << (first ? "\n" : ",\n") << line;
+            first = false;
+        };
+
+        stream << "{\"traceEvents\":[";
+
+        emit(R"({"name":"process_name","ph":"M","pid":1,"args":{"name":"regions"}})");
+        emit(R"({"name":"process_name","ph":"M","pid":2,"args":{"name":"region controllers"}})");
+
+        std::unordered_set<uint32_t> named_tracks;
+        std::unordered_set<uint32_t> open_tracks;
+        for (const TraceEvent& event: events) {
+            const uint32_t track = to_trace_track_key(event);
+            const int pid = to_trace_process_id(event.source);
+            const RegionId tid = event.region_id;
+            const double ts = static_cast<double>(event.timestamp - origin) / 1000.0;
+
+            if (named_tracks.insert(track).second) {
+                const std::string_view prefix = (event.source == TraceSource::REGION) ? "region" : "region_controller";
+                emit(fmt::format(R"({{"name":"thread_name","ph":"M","pid":{},"tid":{},"args":{{"name":"{}:{}"}}}})", pid, tid, prefix, tid));
             }
-            case Phase::SUBMIT: {
-                if (message.type == MessageType::SUBMIT) {
-                    transition(Phase::SUBMIT_BARRIER);
 
-                    if (message.submit.stop) {
-                        if (state_ == State::STOPPED) {
-                            // The region is reaffirming that wants to stop.
-                        }
-                        else {
-                            transition(State::STOPPING);
-                        }
-                    }
-                    else {
-                        // The region is not quiescent anymore. We should
-                        // stop shutting down until it is again.
-                        transition(State::RUNNING);
+            switch (event.type) {
+                case TraceEventType::PHASE: {
+                    // Each phase is a slice that ends when the next one begins.
+                    if (open_tracks.erase(track)) {
+                        emit(fmt::format(R"({{"ph":"E","ts":{:.3f},"pid":{},"tid":{}}})", ts, pid, tid));
                     }
 
-                    submitted_increments_ = message.submit.increments;
-                    submitted_decrements_ = message.submit.decrements;
+                    emit(fmt::format(R"({{"name":"{}","cat":"phase","ph":"B","ts":{:.3f},"pid":{},"tid":{},"args":{{"cycle":{}}}}})",
+                        to_trace_phase_name(event), ts, pid, tid, event.value));
+                    open_tracks.insert(track);
+                    break;
+                }
+                case TraceEventType::STATE: {
+                    emit(fmt::format(R"({{"name":"{}","cat":"state","ph":"i","s":"t","ts":{:.3f},"pid":{},"tid":{}}})",
+                        to_trace_state_name(event), ts, pid, tid));
+                    break;
+                }
+                case TraceEventType::CYCLE: {
+                    emit(fmt::format(R"({{"name":"CYCLE","cat":"cycle","ph":"i","s":"t","ts":{:.3f},"pid":{},"tid":{},"args":{{"cycle":{}}}}})",
+                        ts, pid, tid, event.value));
+                    break;
+                }
+                case TraceEventType::SEND:
+                case TraceEventType::RECEIVE: {
+                    emit(fmt::format(R"({{"name":"{} {}","cat":"message","ph":"i","s":"t","ts":{:.3f},"pid":{},"tid":{}}})",
+                        to_string(event.type), to_string(static_cast<MessageType>(event.argument)), ts, pid, tid));
+                    break;
+                }
+                case TraceEventType::ROUTE:
+                case TraceEventType::FINALIZE: {
+                    emit(fmt::format(R"({{"name":"{}","cat":"work","ph":"i","s":"t","ts":{:.3f},"pid":{},"tid":{},"args":{{"count":{}}}}})",
+                        to_string(event.type), ts, pid, tid, event.value));
+                    break;
                 }
-                break; // Redundant start messages are dropped.
-            }
-            case Phase::SUBMIT_BARRIER: {
-                break;
-            }
-            case Phase::RETIRE_BARRIER: {
-                break;
-            }
-            case Phase::RETIRE: {
-                break;
-            }
-            case Phase::LEAVE: {
-                break;
             }
         }
+
+        stream << "\n]}\n";
     }
 
 inline
-    void RegionController::synchronize(const RegionControllerCensus& census) {
-        Phase next_phase = next(phase_);
-        Action next_action = to_action(next_phase);
+    std::string_view to_string(TraceEventType type) {
+        using namespace std::literals;
 
-        if (census.all(Action::BARRIER_ALL) || census.all(Action::BARRIER_ANY)) {
-            // Sanity check that the cycle matches while synchronized.
-            assert(census.min_cycle() == census.max_cycle());
+        switch (type) {
+#define X(MANTLE_TRACE_EVENT_TYPE)                        \
+            case TraceEventType::MANTLE_TRACE_EVENT_TYPE: \
+                return #MANTLE_TRACE_EVENT_TYPE ##sv;     \
 
-            transition(next_phase);
-        }
-        else if (census.any(next_phase) && (next_action == Action::BARRIER_ANY)) {
-            transition(next_phase);
+            MANTLE_TRACE_EVENT_TYPES(X)
+#undef X
         }
+
+        abort(); // Unreachable.
     }
 
-inline
-    void RegionController::transition(State next_state) {
-        if (state_ == next_state) {
-            return;
-        }
+}
 
-        debug("[region_controller:{}] transition state {} to {}", region_id_, to_string(state_), to_string(next_state));
-        state_ = next_state;
-    }
 
-inline
-    void RegionController::transition(Phase next_phase) {
-        if (phase_ == next_phase) {
-            return;
-        }
+// src/heap_census.cpp
 
-        switch (phase_) {
-            case Phase::START: {
-                // Some region asked the domain to start a coherence cycle.
-                break;
-            }
-            case Phase::START_BARRIER: {
-                // All controllers have started.
-                break;
-            }
-            case Phase::ENTER: {
-                // Ask the region to submit operations.
-                break;
-            }
-            case Phase::SUBMIT: {
-                // The region has submitted operations for us to route.
-                break;
-            }
-            case Phase::SUBMIT_BARRIER: {
-                // We are waiting for all regions to respond.
-                // NOTE: This phase can be combined with the next if we double buffer retired operations.
-                metrics_.increment_count += route_operations(
-                    OperationType::INCREMENT,
-                    submitted_increments_
-                );
-                metrics_.decrement_count += route_operations(
-                    OperationType::DECREMENT,
-                    submitted_decrements_
-                );
-                break;
-            }
-            case Phase::RETIRE_BARRIER: {
-                // All submitted operations have been routed. Flush and apply operations.
-                const bool force = (state_ == State::STOPPING) || (state_ == State::STOPPED);
-                operation_grouper_.flush(force);
-
-                // Increments first to avoid premature death.
-                for (auto&& [object, delta]: operation_grouper_.increments()) {
-                    assert(delta >= 0);
-                    const auto delta_magnitude = static_cast<uint32_t>(+delta);
-                    if (!object->apply_increment(delta_magnitude)) {
-                        abort();
-                    }
-                }
+namespace mantle {
 
-                // Apply decrements and group dead objects for finalization.
-                for (auto&& [object, delta]: operation_grouper_.decrements()) {
-                    assert(delta <= 0);
-                    const auto delta_magnitude = static_cast<uint32_t>(-delta);
-                    if (!object->apply_decrement(delta_magnitude)) {
-                        object_grouper_.write(*object);
-                    }
-                }
+inline
+    HeapCensus::HeapCensus(const size_t interval)
+        : interval_(std::max<size_t>(interval, 1))
+    {
+    }
 
-                operation_grouper_.clear();
-                break;
-            }
-            case Phase::RETIRE: {
-                break;
-            }
-            case Phase::LEAVE: {
-                transition(cycle_ + 1);
-                break;
-            }
+inline
+    void HeapCensus::add(const Sequence cycle, const HeapCensusDelta& delta) {
+        for (const ObjectGroup bound_group: delta.bound_groups) {
+            group(bound_group).live_count += 1;
         }
 
-        debug("[region_controller:{}] transition phase {} to {}", region_id_, to_string(phase_), to_string(next_phase));
-        phase_ = next_phase;
+        // Objects that died on the region were finalized there, in the cycle they were submitted in.
+        const bool sampled = is_sampled(cycle);
+        for (const ObjectGroup released_group: delta.released_groups) {
+            release(released_group, 1, sampled);
+        }
     }
 
 inline
-    void RegionController::transition(Cycle next_cycle) {
-        if (cycle_ == next_cycle) {
+    void HeapCensus::add_decremented(const Object& object) {
+        if (!decremented_.insert(&object).second) {
             return;
         }
 
-        debug("[region_controller:{}] transition cycle {} to {}", region_id_, cycle_, next_cycle);
-        cycle_ = next_cycle;
+        group(object.group()).pending_decrement_count += 1;
     }
 
 inline
-    size_t RegionController::route_operations(const OperationType type, SequenceRange range) {
-        size_t count = 0;
-
-        for (Sequence sequence = range.head; sequence != range.tail; ++sequence) {
-            Operation operation = ledger_.read(sequence);
-            if (type != operation.type()) {
-                continue;
-            }
-
-            const Object* object = operation.object();
-            if (!object) {
-                continue;
-            }
-
-            const RegionId region_id = object->region_id();
-            if (UNLIKELY(region_id >= controllers_.size())) {
-                abort();
-            }
-
-            RegionController& controller = *controllers_[region_id];
-            controller.operation_grouper_.write(operation, true);
-
-            count += 1;
+    void HeapCensus::add_survivor(const Object& object, const uint64_t reference_count) {
+        if (!survivors_.insert(&object).second) {
+            return;
         }
 
-        return count;
+        group(object.group()).reference_counts[to_bucket(reference_count)] += 1;
     }
 
 inline
-    RegionControllerCensus synchronize(RegionControllerGroup& controllers) {
-        RegionControllerCensus old_census;
-        RegionControllerCensus new_census;
+    void HeapCensus::add_garbage(const Sequence cycle, ObjectGroups garbage) {
+        const bool sampled = is_sampled(cycle);
 
-        // Synchronizing until we can no longer make forward progress without sending or receiving.
-        do {
-            old_census = RegionControllerCensus(controllers);
-
-            for (auto&& controller: controllers) {
-                controller->synchronize(old_census);
+        if constexpr (ENABLE_OBJECT_GROUPING) {
+            if (garbage.object_count != 0) {
+                garbage.for_each_group([&](const ObjectGroup garbage_group, const std::span<Object*> members) {
+                    release(garbage_group, members.size(), sampled);
+                });
+            }
+        }
+        else {
+            for (size_t i = 0; i < garbage.object_count; ++i) {
+                release(garbage.objects[i]->group(), 1, sampled);
             }
+        }
 
-            new_census = RegionControllerCensus(controllers);
-        } while (old_census != new_census);
+        if (sampled) {
+            take_sample(cycle);
+        }
+    }
 
-        return new_census;
+inline
+    std::span<const ObjectGroupCensus> HeapCensus::sample() const {
+        return sample_;
     }
 
 inline
-    std::string_view to_string(RegionControllerState state) {
-        using namespace std::literals;
+    std::optional<Sequence> HeapCensus::sample_cycle() const {
+        return sample_cycle_;
+    }
 
-        switch (state) {
-#define X(MANTLE_REGION_CONTROLLER_STATE)                               \
-            case RegionControllerState::MANTLE_REGION_CONTROLLER_STATE: \
-                return #MANTLE_REGION_CONTROLLER_STATE ##sv;            \
+inline
+    void HeapCensus::merge(std::vector<ObjectGroupCensus>& total, const std::span<const ObjectGroupCensus> census) {
+        std::vector<ObjectGroupCensus> merged;
+        merged.reserve(total.size() + census.size());
+
+        auto lhs = total.begin();
+        auto rhs = census.begin();
+        while ((lhs != total.end()) || (rhs != census.end())) {
+            if ((rhs == census.end()) || ((lhs != total.end()) && (lhs->group < rhs->group))) {
+                merged.push_back(*lhs++);
+                continue;
+            }
+            if ((lhs == total.end()) || (rhs->group < lhs->group)) {
+                merged.push_back(*rhs++);
+                continue;
+            }
 
-        MANTLE_REGION_CONTROLLER_STATES(X)
-#undef X
+            ObjectGroupCensus& sum = merged.emplace_back(*lhs++);
+            sum.live_count += rhs->live_count;
+            sum.pending_decrement_count += rhs->pending_decrement_count;
+            sum.finalized_count += rhs->finalized_count;
+            for (size_t i = 0; i < HEAP_CENSUS_BUCKET_COUNT; ++i) {
+                sum.reference_counts[i] += rhs->reference_counts[i];
+            }
+            ++rhs;
         }
 
-        abort();
+        total = std::move(merged);
     }
 
 inline
-    std::string_view to_string(RegionControllerPhase phase) {
-        using namespace std::literals;
-
-        switch (phase) {
-#define X(MANTLE_REGION_CONTROLLER_PHASE, MANTLE_REGION_CONTROLLER_ACTION) \
-            case RegionControllerPhase::MANTLE_REGION_CONTROLLER_PHASE:    \
-                return #MANTLE_REGION_CONTROLLER_PHASE ##sv;               \
+    size_t HeapCensus::to_bucket(const uint64_t reference_count) {
+        assert(reference_count != 0);
+        return std::min<size_t>(static_cast<size_t>(std::bit_width(reference_count)) - 1, HEAP_CENSUS_BUCKET_COUNT - 1);
+    }
 
-        MANTLE_REGION_CONTROLLER_PHASES(X)
-#undef X
+inline
+    ObjectGroupCensus& HeapCensus::group(const ObjectGroup group) {
+        auto [it, inserted] = groups_.try_emplace(group);
+        if (inserted) {
+            it->second.group = group;
         }
 
-        abort();
+        return it->second;
     }
 
 inline
-    std::string_view to_string(RegionControllerAction action) {
-        using namespace std::literals;
+    void HeapCensus::release(const ObjectGroup released_group, const size_t count, const bool sampled) {
+        ObjectGroupCensus& census = group(released_group);
 
-        switch (action) {
-#define X(MANTLE_REGION_CONTROLLER_ACTION)                                \
-            case RegionControllerAction::MANTLE_REGION_CONTROLLER_ACTION: \
-                return #MANTLE_REGION_CONTROLLER_ACTION ##sv;             \
+        // Objects that were bound before the census saw their region, e.g. by hand in tests, aren't counted.
+        census.live_count -= std::min(census.live_count, count);
+        if (sampled) {
+            census.finalized_count += count;
+        }
+    }
 
-        MANTLE_REGION_CONTROLLER_ACTIONS(X)
-#undef X
+inline
+    void HeapCensus::take_sample(const Sequence cycle) {
+        sample_.clear();
+        for (auto it = groups_.begin(); it != groups_.end();) {
+            ObjectGroupCensus& census = it->second;
+            sample_.push_back(census);
+
+            // Only live objects carry over to the next sample.
+            census.pending_decrement_count = 0;
+            census.finalized_count = 0;
+            census.reference_counts = {};
+
+            if (census.live_count == 0) {
+                it = groups_.erase(it);
+            }
+            else {
+                ++it;
+            }
         }
 
-        abort();
+        std::sort(sample_.begin(), sample_.end(), [](const ObjectGroupCensus& lhs, const ObjectGroupCensus& rhs) {
+            return lhs.group < rhs.group;
+        });
+
+        decremented_.clear();
+        survivors_.clear();
+        sample_cycle_ = cycle;
     }
 
 }
 
 
-// src/doorbell.cpp
+// src/region_allocator.cpp
 
 namespace mantle {
 
 inline
-    Doorbell::Doorbell()
-        : file_descriptor_(eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK))
+    RegionAllocator::RegionAllocator()
+        : size_classes_()
+        , metrics_()
     {
-        if (file_descriptor_ < 0) {
-            throw std::runtime_error("Failed to create doorbell eventfd");
-        }
     }
 
 inline
-    Doorbell::~Doorbell() {
-        close(file_descriptor_);
+    RegionAllocator::~RegionAllocator() {
+        // NOTE: Objects that are still alive at this point are leaked, not destroyed.
+        for (std::byte* slab: slabs_) {
+            ::operator delete(slab, std::align_val_t(SLAB_SIZE));
+        }
     }
 
 inline
-    int Doorbell::file_descriptor() {
-        return file_descriptor_;
+    auto RegionAllocator::metrics() const -> const Metrics& {
+        return metrics_;
     }
 
 inline
-    void Doorbell::ring(uint64_t count) {
-        ssize_t bytes_written = 0;
-        do {
-            bytes_written = write(file_descriptor_, &count, sizeof(count));
-        } while ((bytes_written < 0) && (errno == EINTR));
+    void RegionAllocator::finalize(const ObjectGroup group, const std::span<Object*> objects) noexcept {
+        if (UNLIKELY(group >= SIZE_CLASS_COUNT)) {
+            abort(); // This object wasn't allocated by us.
+        }
 
-        if (bytes_written != static_cast<ssize_t>(sizeof(count))) {
-            abort();
+        SizeClass& size_class = size_classes_[group];
+
+        // Destroy the objects and chain their slots together, then splice the chain in one go.
+        SlotHeader* head = size_class.free_list;
+        for (Object* object: objects) {
+            SlotHeader* slot = to_slot(object, group);
+            slot->destructor(object);
+            slot->next = head;
+            head = slot;
         }
+
+        size_class.free_list = head;
+        metrics_.finalized_count += objects.size();
     }
 
 inline
-    uint64_t Doorbell::poll(bool non_blocking) {
-        if (!non_blocking) {
-            wait_for_readable(file_descriptor_);
-        }
+    void* RegionAllocator::allocate_slot(const ObjectGroup group, const Destructor destructor) {
+        assert(group < SIZE_CLASS_COUNT);
 
-        uint64_t count = 0;
-        ssize_t bytes_read = 0;
-        do {
-            bytes_read = read(file_descriptor_, &count, sizeof(count));
-        } while ((bytes_read < 0) && (errno == EINTR));
+        SizeClass& size_class = size_classes_[group];
 
-        if (bytes_read != static_cast<ssize_t>(sizeof(count))) {
-            if (bytes_read < 0) {
-                if (errno == EAGAIN) {
-                    return 0;
-                }
+        SlotHeader* slot = size_class.free_list;
+        if (slot) {
+            size_class.free_list = slot->next;
+        }
+        else {
+            if (size_class.bump == size_class.bump_end) {
+                std::byte* slab = static_cast<std::byte*>(::operator new(SLAB_SIZE, std::align_val_t(SLAB_SIZE)));
+                slabs_.push_back(slab);
+                metrics_.slab_count += 1;
+
+                size_class.bump = slab;
+                size_class.bump_end = slab + SLAB_SIZE;
             }
 
-            abort();
+            slot = new (size_class.bump) SlotHeader;
+            size_class.bump += slot_size(group);
         }
 
-        return count;
+        slot->destructor = destructor;
+        slot->next = nullptr;
+
+        return reinterpret_cast<std::byte*>(slot) + sizeof(SlotHeader);
     }
 
-}
+inline
+    void RegionAllocator::deallocate_slot(const ObjectGroup group, void* memory) {
+        SizeClass& size_class = size_classes_[group];
 
+        SlotHeader* slot = reinterpret_cast<SlotHeader*>(static_cast<std::byte*>(memory) - sizeof(SlotHeader));
+        slot->next = size_class.free_list;
+        size_class.free_list = slot;
+    }
 
-// src/mantle.cpp
+inline
+    auto RegionAllocator::to_slot(const Object* object, const ObjectGroup group) -> SlotHeader* {
+        // The object may not be the first base of its class, so round down rather than subtracting.
+        uintptr_t address = reinterpret_cast<uintptr_t>(object);
+        address &= ~(static_cast<uintptr_t>(slot_size(group)) - 1);
 
+        return reinterpret_cast<SlotHeader*>(address);
+    }
 
+}
 
-// src/domain.cpp
+
+// src/operation_grouper.cpp
 
 namespace mantle {
 
 inline
-    Domain::Domain(const Config& config)
-        : config_(config)
-        , running_(false)
+    OperationGrouper::OperationGrouper(const size_t cache_size, const size_t cache_size_max, const GrouperEvictionPolicy eviction, const GrouperEngine engine)
+        : cache_size_(0)
+        , cache_size_min_(0)
+        , cache_size_max_(0)
+        , eviction_(eviction)
+        , engine_(engine)
+        , cache_(cache_size)
+        , cycle_evicted_count_(0)
+        , cycle_peak_size_(0)
+        , low_cycle_count_(0)
     {
-        selector_.add_watch(doorbell_.file_descriptor(), &doorbell_);
+        cache_size_min_ = cache_.size();
+        cache_size_max_ = std::max(cache_size_min_, std::bit_ceil(cache_size_max));
+        metrics_.cache_capacity = cache_.size();
+    }
 
-        std::promise<void> init_promise;
-        std::future<void> init_future = init_promise.get_future();
+inline
+    auto OperationGrouper::metrics() const -> const Metrics& {
+        return metrics_;
+    }
 
-        thread_ = std::thread([init_promise = std::move(init_promise), this]() mutable {
-            try {
-                debug("[domain] initializing thread");
-                if (config_.domain_cpu_affinity) {
-                    set_cpu_affinity(*config_.domain_cpu_affinity);
-                }
+inline
+    bool OperationGrouper::is_dirty() const {
+        return cache_size_ > 0;
+    }
 
-                init_promise.set_value();
+inline
+    std::span<std::pair<Object*, int64_t>> OperationGrouper::increments() {
+        return increments_;
+    }
+
+inline
+    std::span<std::pair<Object*, int64_t>> OperationGrouper::decrements() {
+        return decrements_;
+    }
+
+inline
+    void OperationGrouper::write(const Operation operation, const bool flush) {
+        Object* object = operation.mutable_object();
+
+        // Ignore no-ops.
+        if (UNLIKELY(!object)) {
+            return;
+        }
+
+        if (flush || (engine_ == GrouperEngine::RADIX)) {
+            // Bypass the cache and immediately flush the operation.
+            // The operation doesn't need to be re-encoded which makes this
+            // much simpler than flushing an operation group.
+            if (operation.type() == OperationType::INCREMENT) {
+                increments_.emplace_back(operation.mutable_object(), operation.value());
             }
-            catch (...) {
-                init_promise.set_exception(std::current_exception());
-                return;
+            else {
+                decrements_.emplace_back(operation.mutable_object(), operation.value());
             }
+        }
+        else {
+            CacheCursor cursor = choose_way(object);
+            CacheEntry entry = cache_.load(cursor);
 
-            debug("[domain] starting");
-            run();
-            debug("[domain] stopping");
-        });
+            if (entry.key == object) {
+                // Update an existing group.
+                entry.val.delta += operation.value();
+                entry.val.hit_count += 1;
+                if (entry.val.delta) {
+                    cache_.store(cursor, entry);
+                }
+                else {
+                    cache_.reset(cursor);
+                    cache_size_ -= 1;
+                }
+            }
+            else if (entry.key) {
+                // Replace an existing group.
+                const bool force = true;
+                flush_group(cursor, force);
 
-        init_future.get();
+                metrics_.evicted_count += 1;
+                cycle_evicted_count_ += 1;
+
+                cache_.store(cursor, CacheEntry {
+                    .key = object,
+                    .val = {
+                        .delta     = operation.value(),
+                        .hit_count = 0,
+                        .hit_decay = 1,
+                    },
+                });
+
+                cache_size_ += 1;
+            }
+            else {
+                // Insert a new group.
+                cache_.store(cursor, CacheEntry {
+                    .key = object,
+                    .val = {
+                        .delta     = operation.value(),
+                        .hit_count = 0,
+                        .hit_decay = 1,
+                    },
+                });
+
+                cache_size_ += 1;
+                cycle_peak_size_ = std::max(cycle_peak_size_, cache_size_);
+            }
+
+            note_operation_written(operation);
+        }
     }
 
 inline
-    Domain::~Domain() {
-        thread_.join();
+    void OperationGrouper::flush(const bool force) {
+        if (engine_ == GrouperEngine::RADIX) {
+            merge_collections();
+            return;
+        }
+
+        for (CacheCursor cursor = cache_.begin(); cursor != cache_.end(); cursor.advance()) {
+            flush_group(cursor, force);
+        }
     }
 
 inline
-    const Config& Domain::config() const {
-        return config_;
+    void OperationGrouper::clear() {
+        increments_.clear();
+        decrements_.clear();
     }
 
 inline
-    void Domain::run() {
-        running_ = true;
+    void OperationGrouper::retire(const bool force) {
+        assert(!has_retired());
 
-        while (running_) {
-            constexpr bool non_blocking = false;
-            for (void* user_data: selector_.poll(non_blocking)) {
-                handle_event(user_data);
-            }
+        flush(force);
+        if (engine_ == GrouperEngine::CACHE) {
+            maybe_resize();
+        }
 
-            // Alternate between checking if controllers need to transmit and 
-            // updating controller state until quiescent.
-            RegionControllerCensus census(controllers_);
-            while (true) {
-                update_controllers(census);
+        // Swapping keeps the capacity of both collections around for the next cycle.
+        increments_.swap(retired_increments_);
+        decrements_.swap(retired_decrements_);
+        clear();
+    }
 
-                for (RegionId region_id = 0; size_t{region_id} < controllers_.size(); ++region_id) {
-                    Region& region = *regions_[region_id];
-                    RegionController& controller = *controllers_[region_id];
+inline
+    bool OperationGrouper::has_retired() const {
+        return !retired_increments_.empty() || !retired_decrements_.empty();
+    }
 
-                    while (std::optional<Message> message = controller.send_message()) {
-                        if (region.domain_endpoint().send_message(*message)) {
-                            debug("[region_controller:{}] sent {}", region_id, to_string(message->type));
-                        }
-                        else {
-                            abort();
-                        }
-                    }
-                }
+inline
+    std::span<std::pair<Object*, int64_t>> OperationGrouper::retired_increments() {
+        return retired_increments_;
+    }
 
-                // Update the census and break if nothing changed.
-                if (std::exchange(census, RegionControllerCensus(controllers_)) == census) {
-                    break;
-                }
-            }
-        }
+inline
+    std::span<std::pair<Object*, int64_t>> OperationGrouper::retired_decrements() {
+        return retired_decrements_;
     }
 
 inline
-    void Domain::handle_event(void* user_data) {
-        constexpr bool non_blocking = true;
+    void OperationGrouper::clear_retired() {
+        retired_increments_.clear();
+        retired_decrements_.clear();
+    }
 
-        if (user_data == &doorbell_) {
-            // We'll add a controller for the new region later.
-            // Re-arm the doorbell now that we've awoken.
-            doorbell_.poll(non_blocking);
-        }
-        else {
-            Region& region = *static_cast<Region*>(user_data);
-            RegionController& controller = *controllers_[region.id()];
-            for (const Message& message: region.domain_endpoint().receive_messages(non_blocking)) {
-                debug("[region_controller:{}] received {}", region.id(), to_string(message.type));
-                controller.receive_message(message);
-            }
+inline
+    void OperationGrouper::reset() {
+        for (CacheCursor cursor = cache_.begin(); cursor != cache_.end(); cursor.advance()) {
+            reset_group(cursor);
         }
+        assert(cache_size_ == 0);
+
+        clear();
+    }
+
+inline
+    size_t OperationGrouper::cache_capacity() const {
+        return cache_.size();
     }
 
 inline
-    void Domain::update_controllers(const RegionControllerCensus& census) {
-        // Check if there are controllers that need to be started or stopped.
-        // This is safe to do while there isn't an active cycle.
-        if (controllers_.empty() || census.any(RegionControllerPhase::START)) {
-            std::scoped_lock lock(regions_mutex_);
+    void OperationGrouper::merge_collections() {
+        const size_t written_count = increments_.size() + decrements_.size();
+        if (written_count < 2) {
+            return;
+        }
 
-            if (controllers_.size() < regions_.size()) {
-                start_controllers(census, lock);
+        merge_buffer_.clear();
+        merge_buffer_.insert(merge_buffer_.end(), increments_.begin(), increments_.end());
+        merge_buffer_.insert(merge_buffer_.end(), decrements_.begin(), decrements_.end());
+        increments_.clear();
+        decrements_.clear();
+
+        sort_by_object(merge_buffer_, merge_scratch_);
+
+        // Increments are applied before decrements, so an object dies either way only if its net delta
+        // takes it below zero. Merging them is exact, and deltas that cancel out need no write at all.
+        for (size_t head = 0; head < merge_buffer_.size();) {
+            Object* object = merge_buffer_[head].first;
+            int64_t delta = 0;
+
+            size_t tail = head;
+            for (; (tail < merge_buffer_.size()) && (merge_buffer_[tail].first == object); ++tail) {
+                delta += merge_buffer_[tail].second;
             }
-            else if (census.all(RegionControllerState::STOPPING)) {
-                stop_controllers(census, lock);
+
+            if (delta > 0) {
+                increments_.emplace_back(object, delta);
             }
-            else if (census.all(RegionControllerState::SHUTDOWN)) {
-                running_ = false;
+            else if (delta < 0) {
+                decrements_.emplace_back(object, delta);
             }
-        }
 
-        // Synchronize at barrier phases.
-        for (auto&& controller: controllers_) {
-            controller->synchronize(census);
+            head = tail;
         }
+
+        metrics_.grouped_count += written_count - (increments_.size() + decrements_.size());
     }
 
 inline
-    void Domain::start_controllers(const RegionControllerCensus& census, std::scoped_lock<std::mutex>&) {
-        for (RegionId region_id = controllers_.size(); region_id < regions_.size(); ++region_id) {
-            Region& region = *regions_[region_id];
+    void OperationGrouper::sort_by_object(std::vector<std::pair<Object*, int64_t>>& values, std::vector<std::pair<Object*, int64_t>>& scratch) {
+        // Operations on the same object are summed, so their order among each other doesn't matter.
+        if (values.size() < RADIX_SORT_MIN) {
+            std::sort(values.begin(), values.end(), [](const auto& lhs, const auto& rhs) {
+                return std::less<Object*>()(lhs.first, rhs.first);
+            });
+            return;
+        }
 
-            // Create a controller to manage the region.
-            {
-                auto controller = std::make_unique<RegionController>(region_id, controllers_, region.ledger(), config_);
-                controller->start(census.max_cycle());
-                controllers_.push_back(std::move(controller));
+        // Only the bits that differ between any two objects need sorting on. Objects tend to
+        // share their upper bits, and the lower ones are always clear because of their alignment.
+        const uintptr_t first = std::bit_cast<uintptr_t>(values.front().first);
+        uintptr_t differing = 0;
+        for (auto&& [object, _]: values) {
+            differing |= std::bit_cast<uintptr_t>(object) ^ first;
+        }
+
+        if (differing == 0) {
+            return;
+        }
+
+        const size_t low_bit  = static_cast<size_t>(std::countr_zero(differing));
+        const size_t high_bit = static_cast<size_t>(std::bit_width(differing));
+
+        scratch.resize(values.size());
+
+        for (size_t shift = low_bit; shift < high_bit; shift += RADIX_BITS) {
+            std::array<size_t, (size_t{1} << RADIX_BITS)> offsets = {};
+
+            auto digit = [shift](Object* object) {
+                return (std::bit_cast<uintptr_t>(object) >> shift) & ((uintptr_t{1} << RADIX_BITS) - 1);
+            };
+
+            for (auto&& [object, _]: values) {
+                offsets[digit(object)] += 1;
             }
 
-            // Monitor the connection associated with this region so we can wake up
-            // when it is readable and check for messages.
-            selector_.add_watch(region.domain_endpoint().file_descriptor(), &region);
+            size_t offset = 0;
+            for (size_t& count: offsets) {
+                offset += std::exchange(count, offset);
+            }
+
+            // LSD passes have to be stable, or the order from the digits before is lost.
+            for (const auto& value: values) {
+                scratch[offsets[digit(value.first)]++] = value;
+            }
+
+            values.swap(scratch);
         }
     }
 
 inline
-    void Domain::stop_controllers(const RegionControllerCensus&, std::scoped_lock<std::mutex>&) {
-        bool is_quiescent = true;
-        for (auto&& controller: controllers_) {
-            is_quiescent &= controller->is_quiescent();
-        }
-
-        if (is_quiescent) {
-            for (auto&& controller: controllers_) {
-                controller->stop();
+    void OperationGrouper::maybe_resize() {
+        const size_t capacity = cache_.size();
+        size_t new_capacity = capacity;
+
+        if (cycle_evicted_count_ >= (capacity / GROW_EVICTION_DIVISOR) && capacity < cache_size_max_) {
+            // Groups are being thrown out before they get a chance to combine.
+            new_capacity = capacity * 2;
+            low_cycle_count_ = 0;
+        }
+        else if (cycle_peak_size_ < (capacity / SHRINK_FILL_DIVISOR) && capacity > cache_size_min_) {
+            // Mostly empty cache sets only cost memory and cache misses when flushing.
+            if (++low_cycle_count_ >= SHRINK_CYCLES) {
+                new_capacity = capacity / 2;
+                low_cycle_count_ = 0;
             }
         }
         else {
-            // One or more controllers are still flushing operations.
+            low_cycle_count_ = 0;
+        }
+
+        cycle_evicted_count_ = 0;
+        cycle_peak_size_ = cache_size_;
+
+        if (new_capacity == capacity) {
+            return;
         }
+
+        // Objects map to different sets once the cache is resized, so whatever survived the flush has to go too.
+        const bool force = true;
+        flush(force);
+
+        cache_ = Cache(new_capacity);
+        metrics_.cache_capacity = cache_.size();
+        metrics_.resize_count += 1;
+        cycle_peak_size_ = 0;
     }
 
 inline
-    RegionId Domain::bind(Region& region) {
-        std::scoped_lock lock(regions_mutex_);
+    auto OperationGrouper::choose_way(Object* object) -> CacheCursor {
+        // Find the set that maps to this object.
+        const size_t set = cache_.to_set(object);
 
-        const RegionId region_id = regions_.size();
-        regions_.push_back(&region);
-        doorbell_.ring();
+        // Check if an entry for the object already exists in the set.
+        if (const Cache::WayMask matches = cache_.matching_ways(set, object)) {
+            return CacheCursor(set, static_cast<size_t>(__builtin_ctz(matches)));
+        }
 
-        return region_id;
-    }
+        // Look for an empty entry.
+        if (const Cache::WayMask vacancies = ~cache_.live_ways(set) & Cache::ALL_WAYS) {
+            return CacheCursor(set, static_cast<size_t>(__builtin_ctz(vacancies)));
+        }
 
-}
+        // Find the entry with the fewest hits. Break ties by choosing the lowest way.
+        if (eviction_ == GrouperEvictionPolicy::FEWEST_HITS) {
+            std::pair<CacheCursor, CacheCursor> ways = cache_.equal_range(object);
 
+            CacheCursor min_cursor = ways.first;
+            size_t min_hit_count = std::numeric_limits<size_t>::max();
 
-// src/selector.cpp
+            for (CacheCursor cursor = ways.first; cursor != ways.second; cursor.advance()) {
+                auto&& [key, group] = cache_.load(cursor);
 
-namespace mantle {
+                if (group.hit_count < min_hit_count) {
+                    min_cursor = cursor;
+                    min_hit_count = group.hit_count;
+                }
+            }
 
-inline
-    Selector::Selector()
-         : epoll_fd_(epoll_create1(EPOLL_CLOEXEC))
-    {
-        if (epoll_fd_ < 0) {
-            throw std::runtime_error("Failed to create epoll file descriptor");
+            return min_cursor;
         }
-    }
 
-inline
-    Selector::~Selector() {
-        int result = close(epoll_fd_);
-        assert(result >= 0);
-        epoll_fd_ = -1;
-    }
+        // Find the entry with the lowest delta magnitude. Break ties by choosing the lowest way.
+        {
+            std::pair<CacheCursor, CacheCursor> ways = cache_.equal_range(object);
 
-inline
-    std::span<void*> Selector::poll(bool non_blocking) {
-        std::array<struct epoll_event, MAX_EVENT_COUNT> events;
+            CacheCursor min_cursor = ways.first;
+            int64_t min_delta_magnitude = std::numeric_limits<int64_t>::max();
 
-        int event_count = 0;
-        do {
-            event_count = epoll_wait(epoll_fd_, events.data(), events.size(), non_blocking ? 0 : -1);
-        } while ((event_count < 0) && (errno == EINTR));
+            for (CacheCursor cursor = ways.first; cursor != ways.second; cursor.advance()) {
+                auto&& [key, group] = cache_.load(cursor);
 
-        if (event_count < 0) {
-            throw std::runtime_error("Failed to wait for epoll events");
-        }
+                const int64_t delta = group.delta;
+                const int64_t delta_magnitude = delta < 0 ? -delta : +delta;
 
-        for (int i = 0; i < event_count; ++i) {
-            assert(events[i].events & EPOLLIN);
+                if (delta_magnitude < min_delta_magnitude) {
+                    min_cursor = cursor;
+                    min_delta_magnitude = delta_magnitude;
+                }
+            }
 
-            poll_results_[i] = events[i].data.ptr;
+            return min_cursor;
         }
-
-        return {
-            poll_results_.data(),
-            static_cast<size_t>(event_count)
-        };
     }
 
 inline
-    void Selector::add_watch(int file_descriptor, void* user_data) {
-        struct epoll_event event;
-        memset(&event, 0, sizeof(event));
-        event.events = EPOLLIN;
-        event.data.ptr = user_data;
-
-        int result = 0;
-        do {
-            result = epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, file_descriptor, &event);
-        } while ((result < 0) && (errno == EINTR));
+    void OperationGrouper::flush_group(const CacheCursor cursor, const bool force) {
+        auto&& [key, group] = cache_.load(cursor);
+        if (!key) {
+            return;
+        }
 
-        if (result < 0) {
-            throw std::runtime_error("Failed to add epoll watch");
+        // Operation groups need an exponential number of hits to avoid being flushed.
+        group.hit_decay *= 2;
+        if (group.hit_decay < group.hit_count && !force && eviction_ != GrouperEvictionPolicy::EVERY_CYCLE) {
+            return; // Seems active, keep this group alive for now.
         }
-    }
 
-inline
-    void Selector::modify_watch(int file_descriptor, void* user_data) {
-        struct epoll_event event;
-        memset(&event, 0, sizeof(event));
-        event.events = EPOLLIN;
-        event.data.ptr = user_data;
+        std::vector<std::pair<Object*, int64_t>>& collection = group.delta >= 0 ? increments_ : decrements_;
+        collection.emplace_back(key, group.delta);
 
-        int result = 0;
-        do {
-            result = epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, file_descriptor, &event);
-        } while ((result < 0) && (errno == EINTR));
+        reset_group(cursor);
+    }
 
-        if (result < 0) {
-            throw std::runtime_error("Failed to modify epoll watch");
+inline
+    void OperationGrouper::reset_group(const CacheCursor cursor) {
+        if (auto&& [key, _] = cache_.load(cursor); key) {
+            assert(cache_size_ > 0);
+            cache_.reset(cursor);
+            cache_size_ -= 1;
         }
     }
 
 inline
-    void Selector::delete_watch(int file_descriptor) {
-        int result = 0;
-        do {
-            result = epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, file_descriptor, nullptr);
-        } while ((result < 0) && (errno == EINTR));
+    void OperationGrouper::note_operation_written(const Operation operation) {
+        metrics_.written_count += 1;
 
-        if (result < 0) {
-            throw std::runtime_error("Failed to delete epoll watch");
+        switch (operation.type()) {
+            case OperationType::INCREMENT: {
+                metrics_.written_increment_count += 1;
+                break;
+            }
+            case OperationType::DECREMENT: {
+                metrics_.written_decrement_count += 1;
+                break;
+            }
         }
     }
 
 inline
-    void wait_for_readable(int file_descriptor) {
-        struct pollfd event;
-        memset(&event, 0, sizeof(event));
-        event.fd = file_descriptor;
-        event.events = POLLIN;
-
-        int result = 0;
-        do {
-            result = ::poll(&event, 1, -1);
-        } while ((result < 0) && (errno == EINTR));
+    void OperationGrouper::note_operation_flushed(const Operation operation) {
+        metrics_.flushed_count += 1;
 
-        if (result < 0) {
-            throw std::runtime_error("Failed to poll file descriptor for readability");
+        switch (operation.type()) {
+            case OperationType::INCREMENT: {
+                metrics_.flushed_increment_count += 1;
+                break;
+            }
+            case OperationType::DECREMENT: {
+                metrics_.flushed_decrement_count += 1;
+                break;
+            }
         }
-
-        assert(event.revents & POLLIN);
     }
 
 }
 
 
-// include/mantle/ledger.h
-
+// src/memory_mapping.cpp
 
 namespace mantle {
 
-    struct LedgerSegment {
-        void**  objects;
-        size_t  offset;
-        size_t  increment_count;
-        size_t  decrement_count;
-        bool    increment_spill;
-        bool    decrement_spill;
-    };
+    inline size_t round_up(const size_t size, const size_t alignment) {
+        return (size + alignment - 1) & ~(alignment - 1);
+    }
 
-    struct Ledger {
-        static Ledger*& local_instance() {
-            thread_local Ledger* instance = nullptr;
-            return instance;
+    // Over-map by a huge page and trim both ends, since mmap only guarantees page alignment.
+    inline void* map_huge_page_aligned_memory(const size_t size) {
+        const size_t padded_size = size + HUGE_PAGE_SIZE;
+
+        void* address = mmap(nullptr, padded_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (address == MAP_FAILED) {
+            return MAP_FAILED;
         }
 
-        LedgerSegment* mutable_increment_segment;
-        LedgerSegment* mutable_decrement_segment;
-    };
+        std::byte* first = static_cast<std::byte*>(address);
+        std::byte* aligned = reinterpret_cast<std::byte*>(round_up(reinterpret_cast<uintptr_t>(first), HUGE_PAGE_SIZE));
+        std::byte* last = first + padded_size;
+
+        if (aligned != first) {
+            munmap(first, aligned - first);
+        }
+
+        if ((aligned + size) != last) {
+            munmap(aligned + size, last - (aligned + size));
+        }
 
-    inline void write_increment(void* object) {
-        LedgerSegment* segment = Ledger::local_instance()->mutable_increment_segment;
-        segment->objects[segment->offset++] = object;
+        return aligned;
     }
 
-    inline void write_decrement(void* object) {
-        LedgerSegment* segment = Ledger::local_instance()->mutable_decrement_segment;
-        segment->objects[segment->offset++] = object;
+    // Set a preferred node before anything is touched, so that pages are allocated there. This is best
+    // effort, and fails harmlessly on kernels without NUMA support.
+    inline void prefer_numa_node(void* address, const size_t size, const size_t node) {
+        constexpr size_t BITS_PER_WORD = 8 * sizeof(unsigned long);
+
+        std::vector<unsigned long> mask((node / BITS_PER_WORD) + 1, 0);
+        mask[node / BITS_PER_WORD] |= 1ul << (node % BITS_PER_WORD);
+
+        // The kernel expects one more than the number of bits in the mask.
+        syscall(SYS_mbind, address, size, MPOL_PREFERRED, mask.data(), (mask.size() * BITS_PER_WORD) + 1, 0);
     }
 
-    class Ref {
-    public:
-        explicit Ref(void* object) noexcept
-            : object_(object)
-        {
+inline
+    size_t mapping_size(const size_t size, const HugePagePolicy policy) {
+        return round_up(size, (policy == HugePagePolicy::NONE) ? PAGE_SIZE : HUGE_PAGE_SIZE);
+    }
+
+inline
+    std::span<std::byte> map_memory(const size_t size, const HugePagePolicy policy, const std::optional<size_t> numa_node) {
+        const size_t length = mapping_size(size, policy);
+
+        void* address = MAP_FAILED;
+        switch (policy) {
+            case HugePagePolicy::EXPLICIT: {
+                // This fails with ENOMEM when hugetlbfs has too few pages reserved.
+                address = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+                if (address != MAP_FAILED) {
+                    break;
+                }
+
+                [[fallthrough]];
+            }
+            case HugePagePolicy::TRANSPARENT: {
+                address = map_huge_page_aligned_memory(length);
+                if (address != MAP_FAILED) {
+                    // This is only advice. It fails harmlessly when THP is disabled.
+                    madvise(address, length, MADV_HUGEPAGE);
+                }
+                break;
+            }
+            case HugePagePolicy::NONE: {
+                address = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                break;
+            }
         }
 
-        Ref(const Ref& that) noexcept
-            : object_(that.object_)
-        {
-            write_increment(object_);
+        if (address == MAP_FAILED) {
+            throw std::bad_alloc();
         }
 
-        ~Ref() noexcept {
-            write_decrement(object_);
+        if (numa_node) {
+            prefer_numa_node(address, length, *numa_node);
         }
 
-        Ref& operator=(const Ref& that) noexcept {
-            if (this != &that) {
-                write_decrement(object_);
-                write_increment(that.object_);
-                object_ = that.object_;
-            }
+        return { static_cast<std::byte*>(address), length };
+    }
 
-            return *this;
+inline
+    void decommit_memory(const std::span<std::byte> memory, const HugePagePolicy policy) {
+        const size_t page_size = (policy == HugePagePolicy::NONE) ? PAGE_SIZE : HUGE_PAGE_SIZE;
+
+        const uintptr_t first = round_up(reinterpret_cast<uintptr_t>(memory.data()), page_size);
+        const uintptr_t last = (reinterpret_cast<uintptr_t>(memory.data()) + memory.size()) & ~(page_size - 1);
+        if (first >= last) {
+            return;
         }
 
-        void* object() const noexcept {
-            return object_;
+        const int result = madvise(reinterpret_cast<void*>(first), last - first, MADV_DONTNEED);
+        assert(result >= 0);
+        (void)result;
+    }
+
+inline
+    void unmap_memory(const std::span<std::byte> memory, const HugePagePolicy policy) {
+        const int result = munmap(memory.data(), mapping_size(memory.size(), policy));
+        assert(result >= 0);
+        (void)result;
+    }
+
+inline
+    size_t resident_memory_size() {
+        // The file stays open, so each read is a single system call.
+        static const int fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return 0;
         }
 
-    private:
-        void* object_;
-    };
+        char buffer[128];
+        const ssize_t length = pread(fd, buffer, sizeof(buffer) - 1, 0);
+        if (length <= 0) {
+            return 0;
+        }
+        buffer[length] = '\0';
+
+        // The second field counts resident pages.
+        size_t total_pages = 0;
+        size_t resident_pages = 0;
+        if (sscanf(buffer, "%zu %zu", &total_pages, &resident_pages) != 2) {
+            return 0;
+        }
+
+        return resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    }
 
 }
 
 
+// src/page_fault_handler.cpp
+
+
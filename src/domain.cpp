@@ -1,7 +1,14 @@
 #include "mantle/domain.h"
 #include "mantle/util.h"
 #include "mantle/debug.h"
+#include "mantle/trace.h"
+#include "mantle/object_finalizer.h"
+#include "mantle/memory_mapping.h"
+#include "mantle/ledger_recording.h"
 #include <future>
+#include <limits>
+#include <stdexcept>
+#include <algorithm>
 #include <cstdlib>
 #include <cassert>
 
@@ -10,18 +17,80 @@ namespace mantle {
     MANTLE_SOURCE_INLINE
     Domain::Domain(const Config& config)
         : config_(config)
+        , numa_node_(config_.domain_numa_node)
+        , next_region_id_(0)
+        , stop_requested_(false)
+        , attached_region_count_(0)
+        , cluster_size_(config_.domain_cluster_size ? config_.domain_cluster_size : std::numeric_limits<size_t>::max())
+        , bound_region_count_(0)
+        , spin_region_count_(0)
         , running_(false)
+        , timeout_(std::nullopt)
+        , scheduler_(config_)
+        , admitted_cycle_(std::nullopt)
+        , idle_cycle_armed_(false)
+        , published_cycle_(std::nullopt)
     {
+        if (config_.fallback_ledger) {
+            fallback_ledger_ = std::make_unique<FallbackLedger>();
+        }
+
         selector_.add_watch(doorbell_.file_descriptor(), &doorbell_);
 
+        if (config_.domain_cpu_affinity) {
+            if (config_.domain_cpu_affinity->empty()) {
+                throw std::runtime_error("Config::domain_cpu_affinity has no cpus");
+            }
+
+            cpu_affinity_.assign(config_.domain_cpu_affinity->begin(), config_.domain_cpu_affinity->end());
+        }
+        else if (config_.domain_numa_node) {
+            cpu_affinity_ = numa_node_cpus(*config_.domain_numa_node);
+        }
+        else if (config_.topology_placement) {
+            placement_ = std::make_unique<ThreadPlacement>(CpuTopology::detect(), config_.domain_worker_count + 1);
+            cpu_affinity_.assign(placement_->domain_cpus().begin(), placement_->domain_cpus().end());
+            if (config_.numa_placement) {
+                numa_node_ = placement_->domain_numa_node();
+            }
+        }
+
+        if (config_.domain_worker_count) {
+            worker_pool_ = std::make_unique<WorkerPool>(config_.domain_worker_count, cpu_affinity_);
+        }
+
+        if (config_.ledger_backend == LedgerBackend::WRITE_BARRIER) {
+            write_barrier_manager_ = std::make_unique<WriteBarrierManager>(config_.write_barrier_pool_low_watermark, config_.write_barrier_pool_high_watermark);
+            write_barrier_doorbell_ = std::make_unique<Doorbell>();
+            write_barrier_thread_ = std::thread([this]() {
+                debug("[domain] servicing write barriers");
+                service_write_barriers();
+            });
+        }
+
+        if (config_.domain_embedded) {
+            driver_thread_id_ = std::this_thread::get_id();
+            if (config_.numa_placement && !numa_node_) {
+                numa_node_ = current_numa_node();
+            }
+
+            running_ = true;
+            return;
+        }
+
         std::promise<void> init_promise;
         std::future<void> init_future = init_promise.get_future();
 
         thread_ = std::thread([init_promise = std::move(init_promise), this]() mutable {
             try {
                 debug("[domain] initializing thread");
-                if (config_.domain_cpu_affinity) {
-                    set_cpu_affinity(*config_.domain_cpu_affinity);
+                if (!cpu_affinity_.empty()) {
+                    set_cpu_affinity(cpu_affinity_);
+                }
+
+                // Without a configured node, place the domain's memory wherever the thread ended up.
+                if (config_.numa_placement && !numa_node_) {
+                    numa_node_ = current_numa_node();
                 }
 
                 init_promise.set_value();
@@ -32,6 +101,7 @@ namespace mantle {
             }
 
             debug("[domain] starting");
+            driver_thread_id_ = std::this_thread::get_id();
             run();
             debug("[domain] stopping");
         });
@@ -41,7 +111,25 @@ namespace mantle {
 
     MANTLE_SOURCE_INLINE
     Domain::~Domain() {
-        thread_.join();
+        // The domain keeps running until every region has left.
+        stop_requested_.store(true, std::memory_order_release);
+        doorbell_.ring();
+
+        if (config_.domain_embedded) {
+            while (running_) {
+                constexpr bool non_blocking = false;
+                iterate(non_blocking);
+            }
+        }
+        else {
+            thread_.join();
+        }
+
+        // Every region has left by now, so no more faults can happen.
+        if (write_barrier_thread_.joinable()) {
+            write_barrier_doorbell_->ring();
+            write_barrier_thread_.join();
+        }
     }
 
     MANTLE_SOURCE_INLINE
@@ -49,42 +137,173 @@ namespace mantle {
         return config_;
     }
 
+    MANTLE_SOURCE_INLINE
+    auto Domain::snapshot_metrics() const -> Metrics {
+        std::scoped_lock lock(metrics_mutex_);
+
+        Metrics metrics = metrics_;
+        if (fallback_ledger_) {
+            metrics.fallback_operation_count = fallback_ledger_->written_count();
+        }
+
+        return metrics;
+    }
+
+    MANTLE_SOURCE_INLINE
+    int Domain::file_descriptor() {
+        return selector_.file_descriptor();
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Domain::step(const bool non_blocking) {
+        assert(config_.domain_embedded && is_driven_here());
+
+        if (running_) {
+            iterate(non_blocking);
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    std::optional<std::chrono::nanoseconds> Domain::timeout() const {
+        return timeout_;
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Domain::is_driven_here() const {
+        return config_.domain_embedded && (std::this_thread::get_id() == driver_thread_id_);
+    }
+
+    MANTLE_SOURCE_INLINE
+    std::optional<size_t> Domain::numa_node() const {
+        return config_.numa_placement ? numa_node_ : std::nullopt;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Domain::service_write_barriers() {
+        WriteBarrierManager& manager = *write_barrier_manager_;
+        int maintenance = 0; // Only its address is used, to tell the events apart.
+
+        Selector selector;
+        selector.add_watch(manager.file_descriptor(), &manager);
+        selector.add_watch(manager.maintenance_file_descriptor(), &maintenance);
+        selector.add_watch(write_barrier_doorbell_->file_descriptor(), write_barrier_doorbell_.get());
+
+        while (true) {
+            constexpr bool non_blocking = false;
+            for (void* user_data: selector.poll(non_blocking)) {
+                if (user_data == write_barrier_doorbell_.get()) {
+                    return;
+                }
+
+                if (user_data == &maintenance) {
+                    manager.maintain();
+                    continue;
+                }
+
+                while (manager.poll()) {
+                    // Handle every pending fault before going back to sleep.
+                }
+            }
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    WriteBarrierManager& Domain::write_barrier_manager() {
+        assert(write_barrier_manager_);
+        return *write_barrier_manager_;
+    }
+
+    MANTLE_SOURCE_INLINE
+    ThreadPlacement* Domain::placement() {
+        return placement_.get();
+    }
+
+    MANTLE_SOURCE_INLINE
+    FallbackLedger* Domain::fallback_ledger() {
+        return fallback_ledger_.get();
+    }
+
     MANTLE_SOURCE_INLINE
     void Domain::run() {
         running_ = true;
 
         while (running_) {
             constexpr bool non_blocking = false;
-            for (void* user_data: selector_.poll(non_blocking)) {
+            iterate(non_blocking);
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Domain::iterate(const bool non_blocking) {
+        std::optional<std::chrono::nanoseconds> timeout = non_blocking ? std::chrono::nanoseconds::zero() : timeout_;
+        if (non_blocking || !spin(timeout)) {
+            for (void* user_data: selector_.poll(timeout)) {
                 handle_event(user_data);
             }
 
-            // Alternate between checking if controllers need to transmit and 
-            // updating controller state until quiescent.
-            RegionControllerCensus census(controllers_);
-            while (true) {
-                update_controllers(census);
+            // Clusters with workers deliver what arrived for their regions themselves.
+            if (has_cluster_workers()) {
+                for_each_cluster([this](const size_t cluster_index) {
+                    for (Region* region: cluster_arrivals_[cluster_index]) {
+                        constexpr bool non_blocking = true;
+                        deliver_messages(*region, region->domain_endpoint().receive_messages(non_blocking));
+                    }
 
-                for (RegionId region_id = 0; size_t{region_id} < controllers_.size(); ++region_id) {
-                    Region& region = *regions_[region_id];
-                    RegionController& controller = *controllers_[region_id];
+                    cluster_arrivals_[cluster_index].clear();
+                });
+            }
+        }
+
+        // Alternate between checking if controllers need to transmit and 
+        // updating controller state until quiescent.
+        RegionControllerCensus census = combine_censuses();
+        while (true) {
+            update_controllers(census);
+
+            // Only controllers about to send have anything to do here.
+            for_each_cluster([this](const size_t cluster_index) {
+                if (!cluster_censuses_[cluster_index]->any(RegionControllerAction::SEND)) {
+                    return;
+                }
 
-                    while (std::optional<Message> message = controller.send_message()) {
-                        if (region.domain_endpoint().send_message(*message)) {
-                            debug("[region_controller:{}] sent {}", region_id, to_string(message->type));
-                        }
-                        else {
-                            abort();
-                        }
+                for (auto&& controller: cluster_controllers(cluster_index)) {
+                    if (is_sent_by_cluster(*controller)) {
+                        send_messages(controller->region_id());
                     }
                 }
+            });
+
+            // Clusters leave regions that are leaving or have left to us.
+            for (size_t cluster_index = 0; cluster_index < cluster_censuses_.size(); ++cluster_index) {
+                const RegionControllerCensus& cluster_census = *cluster_censuses_[cluster_index];
+                if (!cluster_census.any(RegionControllerAction::SEND)) {
+                    continue;
+                }
+
+                if (!cluster_census.any(RegionControllerState::STOPPED) && !cluster_census.any(RegionControllerState::SHUTDOWN) && !cluster_census.any(RegionControllerState::VACANT)) {
+                    continue;
+                }
 
-                // Update the census and break if nothing changed.
-                if (std::exchange(census, RegionControllerCensus(controllers_)) == census) {
-                    break;
+                for (auto&& controller: cluster_controllers(cluster_index)) {
+                    if (!is_sent_by_cluster(*controller)) {
+                        send_messages(controller->region_id());
+                    }
                 }
             }
+
+            // Take a fresh snapshot of the census and break if nothing changed.
+            if (std::exchange(census, combine_censuses()) == census) {
+                break;
+            }
         }
+
+        // Every controller is between cycles, so their metrics are consistent with each other.
+        if (!controllers_.empty() && census.all(RegionControllerPhase::START) && (published_cycle_ != census.max_cycle())) {
+            publish_metrics(census);
+        }
+
+        // Wake up when the scheduler's answer could change, even if no messages arrive.
+        timeout_ = schedule_timeout(census);
     }
 
     MANTLE_SOURCE_INLINE
@@ -96,12 +315,137 @@ namespace mantle {
             // Re-arm the doorbell now that we've awoken.
             doorbell_.poll(non_blocking);
         }
+        else if (has_cluster_workers()) {
+            Region* region = static_cast<Region*>(user_data);
+            cluster_arrivals_[region->id() / cluster_size_].push_back(region);
+        }
         else {
             Region& region = *static_cast<Region*>(user_data);
-            RegionController& controller = *controllers_[region.id()];
-            for (const Message& message: region.domain_endpoint().receive_messages(non_blocking)) {
-                debug("[region_controller:{}] received {}", region.id(), to_string(message.type));
-                controller.receive_message(message);
+            deliver_messages(region, region.domain_endpoint().receive_messages(non_blocking));
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Domain::deliver_messages(Region& region, const MessageBatch& messages) {
+        RegionController& controller = *controllers_[region.id()];
+        for (const Message& message: messages) {
+            debug("[region_controller:{}] received {}", region.id(), to_string(message.type));
+            trace(TraceSource::CONTROLLER, region.id(), TraceEventType::RECEIVE, static_cast<uint32_t>(message.type));
+            controller.receive_message(message);
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Domain::send_messages(const RegionId region_id) {
+        RegionController& controller = *controllers_[region_id];
+
+        while (std::optional<Message> message = controller.send_message()) {
+            Region* region = regions_[region_id];
+            if (!region) {
+                // The region has left, so we answer for it.
+                if (message->type == MessageType::RETIRE) {
+                    finalize_garbage(region_id, message->retire.garbage);
+                }
+                continue;
+            }
+
+            if ((message->type == MessageType::LEAVE) && message->leave.stop) {
+                detach_region(region_id, *message);
+            }
+            else if (region->domain_endpoint().send_message(*message)) {
+                debug("[region_controller:{}] sent {}", region_id, to_string(message->type));
+                trace(TraceSource::CONTROLLER, region_id, TraceEventType::SEND, static_cast<uint32_t>(message->type));
+            }
+            else {
+                abort();
+            }
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Domain::finalize_garbage(const RegionId region_id, ObjectGroups garbage) {
+        ObjectFinalizer& finalizer = *finalizers_[region_id];
+
+        garbage.for_each_group([&finalizer](ObjectGroup group, std::span<Object*> members) {
+            finalizer.finalize(group, members);
+        });
+
+        trace(TraceSource::CONTROLLER, region_id, TraceEventType::FINALIZE, 0, garbage.object_count);
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Domain::spin(std::optional<std::chrono::nanoseconds>& timeout) {
+        using Clock = std::chrono::steady_clock;
+
+        if (config_.domain_spin_duration <= std::chrono::nanoseconds::zero()) {
+            return false;
+        }
+
+        const std::chrono::nanoseconds limit = timeout ? std::min(*timeout, config_.domain_spin_duration) : config_.domain_spin_duration;
+        const Clock::time_point start = Clock::now();
+
+        // Regions stay quiet while we spin, even when we leave to handle what arrived. We only
+        // let them know to ring again right before blocking.
+        set_spinning(true);
+
+        std::chrono::nanoseconds elapsed = std::chrono::nanoseconds::zero();
+        while (true) {
+            if (receive_pending_messages()) {
+                return true;
+            }
+
+            elapsed = Clock::now() - start;
+            if (elapsed >= limit) {
+                break;
+            }
+
+            cpu_relax();
+        }
+
+        set_spinning(false);
+
+        // A region may have sent something before it saw that we stopped, and not rung the doorbell.
+        if (receive_pending_messages()) {
+            return true;
+        }
+
+        if (timeout) {
+            timeout = std::max(*timeout - elapsed, std::chrono::nanoseconds::zero());
+        }
+
+        return false;
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Domain::receive_pending_messages() {
+        bool received = false;
+
+        for (Region* region: regions_) {
+            if (!region) {
+                continue;
+            }
+
+            Endpoint& endpoint = region->domain_endpoint();
+            if (endpoint.has_messages()) {
+                deliver_messages(*region, endpoint.receive_pending_messages());
+                received = true;
+            }
+        }
+
+        // New regions ring the doorbell, which we don't want to read while spinning.
+        if (const size_t region_count = bound_region_count_.load(std::memory_order_acquire); region_count != spin_region_count_) {
+            spin_region_count_ = region_count;
+            received = true;
+        }
+
+        return received;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Domain::set_spinning(const bool spinning) {
+        for (Region* region: regions_) {
+            if (region) {
+                region->domain_endpoint().set_spinning(spinning);
             }
         }
     }
@@ -113,67 +457,354 @@ namespace mantle {
         if (controllers_.empty() || census.any(RegionControllerPhase::START)) {
             std::scoped_lock lock(regions_mutex_);
 
-            if (controllers_.size() < regions_.size()) {
+            if (!joining_regions_.empty()) {
                 start_controllers(census, lock);
             }
-            else if (census.all(RegionControllerState::STOPPING)) {
-                stop_controllers(census, lock);
-            }
-            else if (census.all(RegionControllerState::SHUTDOWN)) {
+
+            stop_controllers(census, lock);
+
+            if (stop_requested_.load(std::memory_order_acquire) && (attached_region_count_ == 0) && joining_regions_.empty()) {
                 running_ = false;
             }
         }
 
-        // Synchronize at barrier phases.
+        if (!schedule_cycle(census)) {
+            return;
+        }
+
+        if (worker_pool_) {
+            parallelize_controllers(census);
+        }
+
+        // Synchronize at barrier phases, skipping clusters where no controller would move.
+        for_each_cluster([this, &census](const size_t cluster_index) {
+            if (!can_synchronize(*cluster_censuses_[cluster_index], census)) {
+                return;
+            }
+
+            for (auto&& controller: cluster_controllers(cluster_index)) {
+                controller->synchronize(census);
+            }
+        });
+
+        // Everything routed or applied in this step is done by now, workers included.
+        if (config_.ledger_recorder) {
+            config_.ledger_recorder->flush();
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Domain::schedule_cycle(const RegionControllerCensus& census) {
+        if (controllers_.empty()) {
+            return true;
+        }
+
+        const CycleScheduler::Clock::time_point now = CycleScheduler::Clock::now();
+
+        if (census.all(RegionControllerPhase::START)) {
+            // Nobody has asked for a cycle. Start one anyway if it has been a while and operations
+            // may be in flight, otherwise they wait for the application to step again. Regions can
+            // have written operations we haven't seen yet, so one cycle is started after every
+            // requested one even if nothing was submitted.
+            const bool overdue = is_steady(census) && scheduler_.is_overdue(now);
+            if (overdue && (idle_cycle_armed_ || has_pending_operations())) {
+                controllers_.front()->request_start();
+
+                scheduler_.start(now);
+                admitted_cycle_ = census.max_cycle();
+                idle_cycle_armed_ = false;
+            }
+
+            return true;
+        }
+
+        if (census.any(RegionControllerPhase::START_BARRIER) && (admitted_cycle_ != census.max_cycle())) {
+            if (!scheduler_.may_start(now, false) && !is_start_urgent(census)) {
+                return false;
+            }
+
+            scheduler_.start(now);
+            admitted_cycle_ = census.max_cycle();
+            idle_cycle_armed_ = true;
+        }
+
+        return true;
+    }
+
+    MANTLE_SOURCE_INLINE
+    std::optional<std::chrono::nanoseconds> Domain::schedule_timeout(const RegionControllerCensus& census) const {
+        if (controllers_.empty()) {
+            return std::nullopt;
+        }
+
+        const bool holding = census.any(RegionControllerPhase::START_BARRIER) && (admitted_cycle_ != census.max_cycle());
+        const bool pending = census.all(RegionControllerPhase::START)
+            && is_steady(census)
+            && (idle_cycle_armed_ || has_pending_operations());
+
+        return scheduler_.timeout(CycleScheduler::Clock::now(), holding, pending);
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Domain::is_steady(const RegionControllerCensus& census) const {
+        return !census.any(RegionControllerState::STARTING)
+            && !census.any(RegionControllerState::STOPPING)
+            && !census.any(RegionControllerState::STOPPED);
+    }
+
+    MANTLE_SOURCE_INLINE
+    RegionControllerCensus Domain::combine_censuses() const {
+        RegionControllerCensus census;
+        for (auto&& cluster_census: cluster_censuses_) {
+            census.add(*cluster_census);
+        }
+
+        return census;
+    }
+
+    MANTLE_SOURCE_INLINE
+    std::span<const std::unique_ptr<RegionController>> Domain::cluster_controllers(const size_t cluster_index) const {
+        const size_t first = std::min(cluster_index * cluster_size_, controllers_.size());
+        return std::span(controllers_).subspan(first, std::min(cluster_size_, controllers_.size() - first));
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Domain::has_cluster_workers() const {
+        return worker_pool_ && (cluster_censuses_.size() > 1);
+    }
+
+    template<typename Pass>
+    void Domain::for_each_cluster(Pass&& pass) {
+        if (has_cluster_workers()) {
+            worker_pool_->run(cluster_censuses_.size(), [&pass](const size_t cluster_index, size_t) {
+                pass(cluster_index);
+            });
+            return;
+        }
+
+        for (size_t cluster_index = 0; cluster_index < cluster_censuses_.size(); ++cluster_index) {
+            pass(cluster_index);
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Domain::is_sent_by_cluster(const RegionController& controller) const {
+        // A stopped region is detached by its next message, and a region that has left has its garbage
+        // finalized here, possibly with a finalizer that other regions share.
+        return regions_[controller.region_id()] && (controller.state() != RegionControllerState::STOPPED);
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Domain::is_start_urgent(const RegionControllerCensus& census) const {
+        // Don't hold up regions that are joining or leaving.
+        if (census.any(RegionControllerState::STARTING) || census.any(RegionControllerState::STOPPING)) {
+            return true;
+        }
+
+        if (census.any_urgent()) {
+            return true;
+        }
+
+        // Checked last, since it has to ask the kernel.
+        if (config_.cycle_pressure_rss && (resident_memory_size() >= config_.cycle_pressure_rss)) {
+            return true;
+        }
+
+        return false;
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Domain::has_pending_operations() const {
         for (auto&& controller: controllers_) {
-            controller->synchronize(census);
+            if (controller->has_pending_operations()) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Domain::parallelize_controllers(const RegionControllerCensus& census) {
+        // Every controller is about to leave the barrier in this round of synchronization.
+        // Do the work they would have done on their way out in parallel.
+        if (census.all(RegionControllerPhase::SUBMIT_BARRIER)) {
+            // Pipelined cycles apply what was routed in the previous cycle in the same pass.
+            const bool pipelined = config_.pipeline_cycles;
+            worker_pool_->run(controllers_.size(), [this, pipelined](size_t task_index, size_t worker_index) {
+                if (pipelined) {
+                    controllers_[task_index]->apply_operations();
+                }
+
+                controllers_[task_index]->route_operations(worker_index);
+            });
+        }
+        else if (census.all(RegionControllerPhase::RETIRE_BARRIER)) {
+            worker_pool_->run(controllers_.size(), [this](size_t task_index, size_t) {
+                controllers_[task_index]->apply_operations();
+            });
         }
     }
 
     MANTLE_SOURCE_INLINE
     void Domain::start_controllers(const RegionControllerCensus& census, std::scoped_lock<std::mutex>&) {
-        for (RegionId region_id = controllers_.size(); region_id < regions_.size(); ++region_id) {
-            Region& region = *regions_[region_id];
+        std::vector<std::pair<RegionId, Region*>> deferred_regions;
+
+        for (auto [region_id, region]: joining_regions_) {
+            if (region_id < controllers_.size()) {
+                // Take over the controller of a region that has left, once it is between cycles.
+                RegionController& controller = *controllers_[region_id];
+                if (controller.phase() != RegionControllerPhase::START) {
+                    deferred_regions.emplace_back(region_id, region);
+                    continue;
+                }
 
-            // Create a controller to manage the region.
-            {
-                auto controller = std::make_unique<RegionController>(region_id, controllers_, region.ledger(), config_);
+                controller.attach(region->ledger(), census.max_cycle());
+                regions_[region_id] = region;
+                finalizers_[region_id] = &region->finalizer_;
+            }
+            else {
+                // Create a controller to manage the region. New ids are handed out in order.
+                assert(region_id == controllers_.size());
+
+                ReferenceCountTable* reference_count_table = config_.reference_count_table ? reference_count_tables_[region_id].get() : nullptr;
+
+                auto controller = std::make_unique<RegionController>(region_id, controllers_, region->ledger(), config_, reference_count_table);
                 controller->start(census.max_cycle());
+
+                const size_t cluster_index = region_id / cluster_size_;
+                if (cluster_index == cluster_censuses_.size()) {
+                    cluster_censuses_.push_back(std::make_unique<RegionControllerCensus>());
+                    cluster_arrivals_.emplace_back();
+                }
+                controller->track(*cluster_censuses_[cluster_index]);
+
                 controllers_.push_back(std::move(controller));
+                regions_.push_back(region);
+                finalizers_.push_back(&region->finalizer_);
             }
 
+            attached_region_count_ += 1;
+
             // Monitor the connection associated with this region so we can wake up
             // when it is readable and check for messages.
-            selector_.add_watch(region.domain_endpoint().file_descriptor(), &region);
+            selector_.add_watch(region->domain_endpoint().file_descriptor(), region);
         }
+
+        joining_regions_ = std::move(deferred_regions);
     }
 
     MANTLE_SOURCE_INLINE
     void Domain::stop_controllers(const RegionControllerCensus&, std::scoped_lock<std::mutex>&) {
-        bool is_quiescent = true;
-        for (auto&& controller: controllers_) {
-            is_quiescent &= controller->is_quiescent();
-        }
+        // Each region stops as soon as its own operations have been flushed, whatever the others are doing.
+        for (size_t cluster_index = 0; cluster_index < cluster_censuses_.size(); ++cluster_index) {
+            const RegionControllerCensus& cluster_census = *cluster_censuses_[cluster_index];
+            if (!cluster_census.any(RegionControllerState::STOPPING) && !cluster_census.any(RegionControllerState::SHUTDOWN)) {
+                continue;
+            }
 
-        if (is_quiescent) {
-            for (auto&& controller: controllers_) {
-                controller->stop();
+            for (auto&& controller: cluster_controllers(cluster_index)) {
+                if ((controller->state() == RegionControllerState::STOPPING) && controller->is_quiescent()) {
+                    controller->stop();
+                }
+                else if ((controller->state() == RegionControllerState::SHUTDOWN) && controller->is_drained()) {
+                    controller->vacate();
+                    vacant_region_ids_.push_back(controller->region_id());
+                }
             }
         }
-        else {
-            // One or more controllers are still flushing operations.
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Domain::detach_region(const RegionId region_id, const Message& message) {
+        std::scoped_lock lock(regions_mutex_);
+
+        // The region may go away as soon as it sees this message, even before we're done sending it.
+        // It waits for us in `unbind`, and we stop watching it before its file descriptor is closed.
+        Region& region = *regions_[region_id];
+        selector_.delete_watch(region.domain_endpoint().file_descriptor());
+
+        if (!region.domain_endpoint().send_message(message)) {
+            abort();
         }
+        debug("[region_controller:{}] sent {}", region_id, to_string(message.type));
+        trace(TraceSource::CONTROLLER, region_id, TraceEventType::SEND, static_cast<uint32_t>(message.type));
+
+        regions_[region_id] = nullptr;
+        attached_region_count_ -= 1;
     }
 
     MANTLE_SOURCE_INLINE
-    RegionId Domain::bind(Region& region) {
+    void Domain::publish_metrics(const RegionControllerCensus& census) {
+        std::scoped_lock lock(metrics_mutex_);
+
+        metrics_.cycle = census.max_cycle();
+        metrics_.regions.resize(controllers_.size());
+        metrics_.heap_census.clear();
+        for (size_t i = 0; i < controllers_.size(); ++i) {
+            const RegionController& controller = *controllers_[i];
+            const RegionController::Metrics& metrics = controller.metrics();
+
+            metrics_.regions[i] = RegionMetricsSnapshot {
+                .region_id         = controller.region_id(),
+                .state             = controller.state(),
+                .cycle_count       = metrics.cycle_count,
+                .phase_durations   = metrics.phase_durations,
+                .increment_count   = metrics.increment_count,
+                .decrement_count   = metrics.decrement_count,
+                .applied_count     = metrics.applied_count,
+                .apply_duration    = metrics.apply_duration,
+                .ledger_occupancy  = metrics.ledger_occupancy,
+                .ledger_capacity   = metrics.ledger_capacity,
+                .finalized_count   = metrics.finalized_count,
+                .operation_grouper = metrics.operation_grouper,
+                .object_grouper    = metrics.object_grouper,
+                .heap_census       = {},
+            };
+
+            if (const HeapCensus* heap_census = controller.heap_census()) {
+                metrics_.regions[i].heap_census.assign(heap_census->sample().begin(), heap_census->sample().end());
+                HeapCensus::merge(metrics_.heap_census, heap_census->sample());
+                if (heap_census->sample_cycle()) {
+                    metrics_.heap_census_cycle = std::max(metrics_.heap_census_cycle.value_or(0), *heap_census->sample_cycle());
+                }
+            }
+        }
+
+        published_cycle_ = census.max_cycle();
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Domain::bind(Region& region) {
         std::scoped_lock lock(regions_mutex_);
 
-        const RegionId region_id = regions_.size();
-        regions_.push_back(&region);
+        RegionId region_id;
+        if (!vacant_region_ids_.empty()) {
+            region_id = vacant_region_ids_.back();
+            vacant_region_ids_.pop_back();
+        }
+        else {
+            region_id = next_region_id_++;
+        }
+
+        if (config_.reference_count_table) {
+            if (region_id == reference_count_tables_.size()) {
+                reference_count_tables_.push_back(std::make_unique<ReferenceCountTable>(config_.reference_count_table_capacity, numa_node()));
+            }
+
+            region.reference_count_table_ = reference_count_tables_[region_id].get();
+        }
+
+        region.id_ = region_id;
+        joining_regions_.emplace_back(region_id, &region);
+        bound_region_count_.fetch_add(1, std::memory_order_release);
         doorbell_.ring();
+    }
 
-        return region_id;
+    MANTLE_SOURCE_INLINE
+    void Domain::unbind(Region&) {
+        // The domain holds the lock while it detaches a region, so this returns once it is done.
+        std::scoped_lock lock(regions_mutex_);
     }
 
 }
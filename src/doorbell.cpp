@@ -5,6 +5,8 @@
 #include <cstring>
 #include <unistd.h>
 #include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 namespace mantle {
 
@@ -64,4 +66,17 @@ namespace mantle {
         return count;
     }
 
+    MANTLE_SOURCE_INLINE
+    void futex_wait(std::atomic_uint32_t& word, const uint32_t expected) {
+        static_assert(sizeof(std::atomic_uint32_t) == sizeof(uint32_t));
+
+        // EAGAIN means the word had already changed, and EINTR is a spurious wakeup.
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+    }
+
+    MANTLE_SOURCE_INLINE
+    void futex_wake(std::atomic_uint32_t& word) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+
 }
@@ -0,0 +1,56 @@
+#include "mantle/fallback_ledger.h"
+#include <stdexcept>
+
+namespace mantle {
+
+    MANTLE_SOURCE_INLINE
+    FallbackLedger::FallbackLedger()
+        : has_operations_(false)
+        , written_count_(0)
+    {
+        FallbackLedger* expected = nullptr;
+        if (!installed_instance().compare_exchange_strong(expected, this, std::memory_order_acq_rel)) {
+            throw std::runtime_error("Cannot have more than one fallback ledger per process");
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    FallbackLedger::~FallbackLedger() {
+        installed_instance().store(nullptr, std::memory_order_release);
+    }
+
+    MANTLE_SOURCE_INLINE
+    void FallbackLedger::write(const Operation operation) {
+        write(std::span{&operation, 1});
+    }
+
+    MANTLE_SOURCE_INLINE
+    void FallbackLedger::write(const std::span<const Operation> operations) {
+        if (operations.empty()) {
+            return;
+        }
+
+        // Regions that are handed an object after this see the flag, since whatever hands it over
+        // synchronizes with us. They drain the operations before their own get submitted.
+        {
+            std::scoped_lock lock(mutex_);
+            operations_.insert(operations_.end(), operations.begin(), operations.end());
+            has_operations_.store(true, std::memory_order_relaxed);
+        }
+
+        written_count_.fetch_add(operations.size(), std::memory_order_relaxed);
+    }
+
+    MANTLE_SOURCE_INLINE
+    void FallbackLedger::drain(OperationSpill& spill) {
+        std::scoped_lock lock(mutex_);
+
+        for (const Operation operation: operations_) {
+            spill.write(operation);
+        }
+
+        operations_.clear();
+        has_operations_.store(false, std::memory_order_relaxed);
+    }
+
+}
@@ -0,0 +1,166 @@
+#include "mantle/heap_census.h"
+#include "mantle/object.h"
+#include "mantle/config.h"
+#include "mantle/util.h"
+#include <bit>
+#include <algorithm>
+#include <cassert>
+
+namespace mantle {
+
+    MANTLE_SOURCE_INLINE
+    HeapCensus::HeapCensus(const size_t interval)
+        : interval_(std::max<size_t>(interval, 1))
+    {
+    }
+
+    MANTLE_SOURCE_INLINE
+    void HeapCensus::add(const Sequence cycle, const HeapCensusDelta& delta) {
+        for (const ObjectGroup bound_group: delta.bound_groups) {
+            group(bound_group).live_count += 1;
+        }
+
+        // Objects that died on the region were finalized there, in the cycle they were submitted in.
+        const bool sampled = is_sampled(cycle);
+        for (const ObjectGroup released_group: delta.released_groups) {
+            release(released_group, 1, sampled);
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    void HeapCensus::add_decremented(const Object& object) {
+        if (!decremented_.insert(&object).second) {
+            return;
+        }
+
+        group(object.group()).pending_decrement_count += 1;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void HeapCensus::add_survivor(const Object& object, const uint64_t reference_count) {
+        if (!survivors_.insert(&object).second) {
+            return;
+        }
+
+        group(object.group()).reference_counts[to_bucket(reference_count)] += 1;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void HeapCensus::add_garbage(const Sequence cycle, ObjectGroups garbage) {
+        const bool sampled = is_sampled(cycle);
+
+        if constexpr (ENABLE_OBJECT_GROUPING) {
+            if (garbage.object_count != 0) {
+                garbage.for_each_group([&](const ObjectGroup garbage_group, const std::span<Object*> members) {
+                    release(garbage_group, members.size(), sampled);
+                });
+            }
+        }
+        else {
+            for (size_t i = 0; i < garbage.object_count; ++i) {
+                release(garbage.objects[i]->group(), 1, sampled);
+            }
+        }
+
+        if (sampled) {
+            take_sample(cycle);
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    std::span<const ObjectGroupCensus> HeapCensus::sample() const {
+        return sample_;
+    }
+
+    MANTLE_SOURCE_INLINE
+    std::optional<Sequence> HeapCensus::sample_cycle() const {
+        return sample_cycle_;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void HeapCensus::merge(std::vector<ObjectGroupCensus>& total, const std::span<const ObjectGroupCensus> census) {
+        std::vector<ObjectGroupCensus> merged;
+        merged.reserve(total.size() + census.size());
+
+        auto lhs = total.begin();
+        auto rhs = census.begin();
+        while ((lhs != total.end()) || (rhs != census.end())) {
+            if ((rhs == census.end()) || ((lhs != total.end()) && (lhs->group < rhs->group))) {
+                merged.push_back(*lhs++);
+                continue;
+            }
+            if ((lhs == total.end()) || (rhs->group < lhs->group)) {
+                merged.push_back(*rhs++);
+                continue;
+            }
+
+            ObjectGroupCensus& sum = merged.emplace_back(*lhs++);
+            sum.live_count += rhs->live_count;
+            sum.pending_decrement_count += rhs->pending_decrement_count;
+            sum.finalized_count += rhs->finalized_count;
+            for (size_t i = 0; i < HEAP_CENSUS_BUCKET_COUNT; ++i) {
+                sum.reference_counts[i] += rhs->reference_counts[i];
+            }
+            ++rhs;
+        }
+
+        total = std::move(merged);
+    }
+
+    MANTLE_SOURCE_INLINE
+    size_t HeapCensus::to_bucket(const uint64_t reference_count) {
+        assert(reference_count != 0);
+        return std::min<size_t>(static_cast<size_t>(std::bit_width(reference_count)) - 1, HEAP_CENSUS_BUCKET_COUNT - 1);
+    }
+
+    MANTLE_SOURCE_INLINE
+    ObjectGroupCensus& HeapCensus::group(const ObjectGroup group) {
+        auto [it, inserted] = groups_.try_emplace(group);
+        if (inserted) {
+            it->second.group = group;
+        }
+
+        return it->second;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void HeapCensus::release(const ObjectGroup released_group, const size_t count, const bool sampled) {
+        ObjectGroupCensus& census = group(released_group);
+
+        // Objects that were bound before the census saw their region, e.g. by hand in tests, aren't counted.
+        census.live_count -= std::min(census.live_count, count);
+        if (sampled) {
+            census.finalized_count += count;
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    void HeapCensus::take_sample(const Sequence cycle) {
+        sample_.clear();
+        for (auto it = groups_.begin(); it != groups_.end();) {
+            ObjectGroupCensus& census = it->second;
+            sample_.push_back(census);
+
+            // Only live objects carry over to the next sample.
+            census.pending_decrement_count = 0;
+            census.finalized_count = 0;
+            census.reference_counts = {};
+
+            if (census.live_count == 0) {
+                it = groups_.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+
+        std::sort(sample_.begin(), sample_.end(), [](const ObjectGroupCensus& lhs, const ObjectGroupCensus& rhs) {
+            return lhs.group < rhs.group;
+        });
+
+        decremented_.clear();
+        survivors_.clear();
+        sample_cycle_ = cycle;
+    }
+
+}
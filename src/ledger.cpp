@@ -2,6 +2,8 @@
 #include "mantle/page_fault_handler.h"
 #include <sys/mman.h>
 #include <cstring>
+#include <utility>
+#include <algorithm>
 #include <cassert>
 
 namespace mantle {
@@ -18,10 +20,7 @@ namespace mantle {
         memory_ = std::span(static_cast<std::byte*>(address), size);
 
         if (populate) {
-            // Touch the first byte of each page to pre-fault the memory.
-            for (size_t i = 0; i < memory_.size_bytes(); i += PAGE_SIZE) {
-                const_cast<volatile std::byte&>(memory_[i]) = std::byte{0};
-            }
+            this->populate(size);
         }
     }
 
@@ -38,28 +37,74 @@ namespace mantle {
         return memory_;
     }
 
+    void PrivateMemoryMapping::populate(const size_t size) {
+        assert(size <= memory_.size());
+
+        // Kernels before 5.14 don't know this advice, so fall back to touching each page.
+        if (madvise(memory_.data(), size, MADV_POPULATE_WRITE) == 0) {
+            return;
+        }
+
+        for (size_t i = 0; i < size; i += PAGE_SIZE) {
+            const_cast<volatile std::byte&>(memory_[i]) = std::byte{0};
+        }
+    }
+
+    void PrivateMemoryMapping::release(const size_t size) {
+        assert(size <= memory_.size());
+        assert((size % PAGE_SIZE) == 0);
+
+        // Unlike MADV_FREE, this takes the pages off our RSS straight away.
+        const int result = madvise(memory_.data(), size, MADV_DONTNEED);
+        assert(result >= 0);
+        (void)result;
+    }
+
     WriteBarrierSegment::WriteBarrierSegment()
         : prev(nullptr)
         , barrier(nullptr)
         , primed(false)
+        , resident(true)
         , increment_count(0)
         , decrement_count(0)
-        , mapping(WRITE_BARRIER_CAPACITY * sizeof(Object*), true)
+        , mapping(WRITE_BARRIER_CAPACITY * sizeof(Operation), true)
     {
     }
 
-    Object** WriteBarrierSegment::cursor() {
-        return &objects()[increment_count + decrement_count];
+    Operation* WriteBarrierSegment::cursor() {
+        return &operations()[increment_count + decrement_count];
+    }
+
+    const Operation* WriteBarrierSegment::cursor() const {
+        return reinterpret_cast<const Operation*>(mapping.memory().data()) + increment_count + decrement_count;
     }
 
-    std::span<Object*> WriteBarrierSegment::objects() {
-        return std::span{reinterpret_cast<Object**>(mapping.memory().data()), mapping.memory().size_bytes() / sizeof(Object*)};
+    std::span<Operation> WriteBarrierSegment::operations() {
+        return std::span{reinterpret_cast<Operation*>(mapping.memory().data()), mapping.memory().size_bytes() / sizeof(Operation)};
     }
 
     std::span<std::byte> WriteBarrierSegment::guard_page() {
         return mapping.memory().last(PAGE_SIZE);
     }
 
+    void WriteBarrierSegment::populate() {
+        if (!resident) {
+            mapping.populate(mapping.memory().size() - PAGE_SIZE);
+            resident = true;
+        }
+    }
+
+    void WriteBarrierSegment::release() {
+        if (resident) {
+            mapping.release(mapping.memory().size() - PAGE_SIZE);
+            resident = false;
+        }
+    }
+
+    std::span<const Operation> WriteBarrierSegment::committed_operations() const {
+        return std::span{reinterpret_cast<const Operation*>(mapping.memory().data()), increment_count + decrement_count};
+    }
+
     WriteBarrier::WriteBarrier(Ledger& ledger, const size_t phase_shift)
         : ledger_(ledger)
         , phase_shift_(phase_shift)
@@ -88,6 +133,10 @@ namespace mantle {
         return stack_;
     }
 
+    const WriteBarrierSegment* WriteBarrier::back() const {
+        return stack_;
+    }
+
     void WriteBarrier::push_back(WriteBarrierSegment& segment) {
         assert(!segment.barrier);
         assert(!segment.prev);
@@ -183,16 +232,29 @@ namespace mantle {
         return count;
     }
 
-    WriteBarrierManager::WriteBarrierManager() {
-        // TODO: Size the segment storage/pool based on the number of threads.
+    WriteBarrierManager::WriteBarrierManager(const size_t low_watermark, const size_t high_watermark)
+        : low_watermark_(low_watermark)
+        , high_watermark_(std::max(low_watermark, high_watermark))
+        , maintenance_requested_(false)
+        , demand_allocation_count_(0)
+    {
+        // Fill the pool on the first call to `maintain`.
+        if (low_watermark_ > 0) {
+            std::scoped_lock lock(segment_pool_mutex_);
+            request_maintenance();
+        }
     }
 
     int WriteBarrierManager::file_descriptor() {
         return page_fault_handler_.file_descriptor();
     }
 
-    void WriteBarrierManager::poll() {
-        page_fault_handler_.poll([this](std::span<const std::byte> memory, PageFaultHandler::Mode mode) {
+    int WriteBarrierManager::maintenance_file_descriptor() {
+        return maintenance_doorbell_.file_descriptor();
+    }
+
+    bool WriteBarrierManager::poll() {
+        return page_fault_handler_.poll([this](std::span<const std::byte> memory, PageFaultHandler::Mode mode) {
             if (mode == PageFaultHandler::Mode::WRITE_PROTECT) {
                 WriteBarrierSegment* prev_segment;
                 memcpy(&prev_segment, memory.data(), sizeof(prev_segment));
@@ -213,6 +275,93 @@ namespace mantle {
         });
     }
 
+    void WriteBarrierManager::maintain() {
+        {
+            std::scoped_lock lock(segment_pool_mutex_);
+
+            constexpr bool non_blocking = true;
+            maintenance_doorbell_.poll(non_blocking);
+            maintenance_requested_ = false;
+        }
+
+        // Segments are taken out of the pool while their pages are populated or released, so that
+        // the (slow) system calls don't hold up threads that are swapping segments.
+        std::vector<WriteBarrierSegment*> unprimed_segments;
+        {
+            std::scoped_lock lock(segment_pool_mutex_);
+            std::erase_if(segment_pool_, [&](WriteBarrierSegment* segment) {
+                if (segment->primed) {
+                    return false;
+                }
+
+                unprimed_segments.push_back(segment);
+                return true;
+            });
+        }
+
+        // Segments come back unprimed when a write ran into their guard page.
+        for (WriteBarrierSegment* segment: unprimed_segments) {
+            prime_guard_page(*segment);
+
+            std::scoped_lock lock(segment_pool_mutex_);
+            segment_pool_.push_back(segment);
+        }
+
+        while (true) {
+            WriteBarrierSegment* segment = nullptr;
+            {
+                std::scoped_lock lock(segment_pool_mutex_);
+                if (segment_pool_.size() <= high_watermark_) {
+                    break;
+                }
+
+                segment = segment_pool_.back();
+                segment_pool_.pop_back();
+            }
+
+            segment->release();
+
+            std::scoped_lock lock(segment_pool_mutex_);
+            released_segment_pool_.push_back(segment);
+        }
+
+        while (true) {
+            WriteBarrierSegment* segment = nullptr;
+            {
+                std::scoped_lock lock(segment_pool_mutex_);
+                if (segment_pool_.size() >= low_watermark_) {
+                    break;
+                }
+
+                if (!released_segment_pool_.empty()) {
+                    segment = released_segment_pool_.back();
+                    released_segment_pool_.pop_back();
+                }
+            }
+
+            if (segment) {
+                segment->populate();
+            }
+            else {
+                segment = &create_segment();
+            }
+
+            std::scoped_lock lock(segment_pool_mutex_);
+            segment_pool_.push_back(segment);
+        }
+    }
+
+    auto WriteBarrierManager::metrics() -> Metrics {
+        std::scoped_lock lock(segment_pool_mutex_);
+
+        return {
+            .segment_count           = segment_pool_storage_.size(),
+            .resident_count          = segment_pool_.size(),
+            .released_count          = released_segment_pool_.size(),
+            .demand_allocation_count = demand_allocation_count_,
+        };
+    }
+
     void WriteBarrierManager::attach(WriteBarrier& barrier) {
         WriteBarrierSegment& segment = allocate_segment();
         barrier.push_back(segment);
@@ -224,6 +373,12 @@ namespace mantle {
         }
     }
 
+    void WriteBarrierManager::reset(WriteBarrier& barrier) {
+        // Segments go back on top of the pool, so this usually hands back the one we just returned.
+        detach(barrier);
+        attach(barrier);
+    }
+
     void WriteBarrierManager::prime_guard_page(WriteBarrierSegment& segment) {
         if (segment.primed) {
             return;
@@ -237,20 +392,43 @@ namespace mantle {
         segment.primed = true;
     }
 
-    WriteBarrierSegment& WriteBarrierManager::allocate_segment() {
+    WriteBarrierSegment& WriteBarrierManager::create_segment() {
+        auto segment = std::make_unique<WriteBarrierSegment>();
+        page_fault_handler_.register_memory(segment->guard_page(), {PageFaultHandler::Mode::WRITE_PROTECT});
+        prime_guard_page(*segment);
+
         std::scoped_lock lock(segment_pool_mutex_);
+        return *segment_pool_storage_.emplace_back(std::move(segment));
+    }
 
+    WriteBarrierSegment& WriteBarrierManager::allocate_segment() {
         WriteBarrierSegment* segment = nullptr;
+        {
+            std::scoped_lock lock(segment_pool_mutex_);
 
-        if (UNLIKELY(segment_pool_.empty())) {
-            segment = segment_pool_storage_.emplace_back(std::make_unique<WriteBarrierSegment>()).get();
-            page_fault_handler_.register_memory(segment->guard_page(), {PageFaultHandler::Mode::WRITE_PROTECT});
+            if (LIKELY(!segment_pool_.empty())) {
+                segment = segment_pool_.back();
+                segment_pool_.pop_back();
+            }
+            else if (!released_segment_pool_.empty()) {
+                segment = released_segment_pool_.back();
+                released_segment_pool_.pop_back();
+                demand_allocation_count_ += 1;
+            }
+            else {
+                demand_allocation_count_ += 1;
+            }
+
+            if (segment_pool_.size() < low_watermark_) {
+                request_maintenance();
+            }
         }
-        else {
-            segment = segment_pool_.back();
-            segment_pool_.pop_back();
+
+        if (UNLIKELY(!segment)) {
+            return create_segment();
         }
 
+        segment->populate();
         prime_guard_page(*segment);
         return *segment;
     }
@@ -264,6 +442,17 @@ namespace mantle {
         segment.decrement_count = 0;
 
         segment_pool_.push_back(&segment);
+        if (!segment.primed || (segment_pool_.size() > high_watermark_)) {
+            request_maintenance();
+        }
+    }
+
+    void WriteBarrierManager::request_maintenance() {
+        // Only ring once per call to `maintain`, since this happens on the writing threads.
+        if (!maintenance_requested_) {
+            maintenance_requested_ = true;
+            maintenance_doorbell_.ring();
+        }
     }
 
     Ledger::Ledger(WriteBarrierManager& write_barrier_manager)
@@ -302,9 +491,13 @@ namespace mantle {
     }
 
     WriteBarrier& Ledger::barrier(const WriteBarrierPhase phase) {
+        return const_cast<WriteBarrier&>(std::as_const(*this).barrier(phase));
+    }
+
+    const WriteBarrier& Ledger::barrier(const WriteBarrierPhase phase) const {
         const Sequence sequence = sequence_.load(std::memory_order_acquire);
 
-        WriteBarrier& barrier = write_barriers_[(static_cast<uint64_t>(phase) - sequence) % WRITE_BARRIER_PHASE_COUNT];
+        const WriteBarrier& barrier = write_barriers_[(static_cast<uint64_t>(phase) - sequence) % WRITE_BARRIER_PHASE_COUNT];
         assert(phase == barrier.phase());
         return barrier;
     }
@@ -317,12 +510,37 @@ namespace mantle {
         return barrier(WriteBarrierPhase::STORE_DECREMENTS);
     }
 
+    WriteBarrier& Ledger::apply_barrier() {
+        return barrier(WriteBarrierPhase::APPLY);
+    }
+
+    bool Ledger::is_empty() const {
+        for (const WriteBarrier& barrier: write_barriers_) {
+            // The barrier in the APPLY phase has already been committed.
+            if (barrier.phase() == WriteBarrierPhase::APPLY) {
+                continue;
+            }
+
+            if ((barrier.increment_count() != 0) || (barrier.decrement_count() != 0)) {
+                return false;
+            }
+        }
+
+        // Check for operations written since the last step.
+        const bool has_increments = increment_cursor_.load(std::memory_order_acquire) != barrier(WriteBarrierPhase::STORE_INCREMENTS).back()->cursor();
+        const bool has_decrements = decrement_cursor_.load(std::memory_order_acquire) != barrier(WriteBarrierPhase::STORE_DECREMENTS).back()->cursor();
+        return !has_increments && !has_decrements;
+    }
+
     void Ledger::step() {
         increment_barrier().commit(false);
         decrement_barrier().commit(false);
 
         sequence_.fetch_add(1, std::memory_order_acq_rel);
 
+        // The barrier that was applied last time starts over, collecting decrements.
+        write_barrier_manager_.reset(decrement_barrier());
+
         increment_cursor_.store(increment_barrier().back()->cursor(), std::memory_order_release);
         decrement_cursor_.store(decrement_barrier().back()->cursor(), std::memory_order_release);
     }
@@ -0,0 +1,527 @@
+#include "mantle/ledger_recording.h"
+#include "mantle/object.h"
+#include "mantle/compact_operation.h"
+#include <span>
+#include <array>
+#include <iterator>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include <cassert>
+
+namespace mantle {
+
+    // A recording starts with a magic number and a version, followed by records that each start with
+    // one of the tags below. Integers are unsigned LEB128 varints:
+    //
+    //   CYCLE:     cycle                    Submissions that follow were routed in this cycle.
+    //   OBJECT:    region, group            Declares the next object id, counting up from zero.
+    //   SUBMIT:    region, count, ops...    The operations a region submitted. Each is the difference to
+    //                                       the previous object id in the record, zigzag encoded and
+    //                                       shifted left to make room for the tag of the operation.
+    //
+    inline constexpr std::array<uint8_t, 8> LEDGER_RECORDING_MAGIC = { 'M', 'A', 'N', 'T', 'L', 'E', 'L', 'R' };
+    inline constexpr uint8_t LEDGER_RECORDING_VERSION = 1;
+
+    inline constexpr uint8_t LEDGER_RECORDING_CYCLE  = 'C';
+    inline constexpr uint8_t LEDGER_RECORDING_OBJECT = 'O';
+    inline constexpr uint8_t LEDGER_RECORDING_SUBMIT = 'S';
+
+    inline void write_varint(std::vector<uint8_t>& record, uint64_t value) {
+        while (value >= 0x80) {
+            record.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+
+        record.push_back(static_cast<uint8_t>(value));
+    }
+
+    inline uint64_t to_zigzag(const int64_t value) {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    inline int64_t from_zigzag(const uint64_t value) {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    // Reads a recording from memory, failing softly at the end so a truncated record can be dropped.
+    class LedgerRecordingCursor {
+    public:
+        explicit LedgerRecordingCursor(std::span<const uint8_t> bytes)
+            : bytes_(bytes)
+            , offset_(0)
+        {
+        }
+
+        [[nodiscard]]
+        bool is_done() const {
+            return offset_ == bytes_.size();
+        }
+
+        [[nodiscard]]
+        bool read_byte(uint8_t& value) {
+            if (is_done()) {
+                return false;
+            }
+
+            value = bytes_[offset_++];
+            return true;
+        }
+
+        [[nodiscard]]
+        bool read_varint(uint64_t& value) {
+            value = 0;
+            for (uint32_t shift = 0; shift < 64; shift += 7) {
+                uint8_t byte;
+                if (!read_byte(byte)) {
+                    return false;
+                }
+
+                value |= uint64_t{byte & 0x7fu} << shift;
+                if ((byte & 0x80) == 0) {
+                    return true;
+                }
+            }
+
+            throw std::runtime_error("Malformed integer in ledger recording");
+        }
+
+    private:
+        std::span<const uint8_t> bytes_;
+        size_t                   offset_;
+    };
+
+    MANTLE_SOURCE_INLINE
+    LedgerRecording LedgerRecording::read(std::istream& stream) {
+        const std::vector<uint8_t> bytes{std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>()};
+
+        if ((bytes.size() <= LEDGER_RECORDING_MAGIC.size()) || !std::equal(LEDGER_RECORDING_MAGIC.begin(), LEDGER_RECORDING_MAGIC.end(), bytes.begin())) {
+            throw std::runtime_error("Not a ledger recording");
+        }
+
+        if (bytes[LEDGER_RECORDING_MAGIC.size()] != LEDGER_RECORDING_VERSION) {
+            throw std::runtime_error("Unsupported ledger recording version");
+        }
+
+        LedgerRecording recording;
+        LedgerRecordingCursor cursor(std::span<const uint8_t>(bytes).subspan(LEDGER_RECORDING_MAGIC.size() + 1));
+
+        while (!cursor.is_done()) {
+            uint8_t tag;
+            if (!cursor.read_byte(tag)) {
+                break;
+            }
+
+            if (tag == LEDGER_RECORDING_CYCLE) {
+                uint64_t cycle;
+                if (!cursor.read_varint(cycle)) {
+                    break;
+                }
+
+                recording.cycles.push_back({ .cycle = cycle, .submissions = {} });
+            }
+            else if (tag == LEDGER_RECORDING_OBJECT) {
+                uint64_t region_id;
+                uint64_t group;
+                if (!cursor.read_varint(region_id) || !cursor.read_varint(group)) {
+                    break;
+                }
+
+                if ((region_id >= INVALID_REGION_ID) || (group > std::numeric_limits<ObjectGroup>::max())) {
+                    throw std::runtime_error("Malformed object in ledger recording");
+                }
+
+                recording.objects.push_back({
+                    .region_id = static_cast<RegionId>(region_id),
+                    .group     = static_cast<ObjectGroup>(group),
+                });
+            }
+            else if (tag == LEDGER_RECORDING_SUBMIT) {
+                uint64_t region_id;
+                uint64_t count;
+                if (!cursor.read_varint(region_id) || !cursor.read_varint(count)) {
+                    break;
+                }
+
+                if (recording.cycles.empty() || (region_id >= INVALID_REGION_ID)) {
+                    throw std::runtime_error("Malformed submission in ledger recording");
+                }
+
+                RecordedSubmission submission = {
+                    .region_id  = static_cast<RegionId>(region_id),
+                    .operations = {},
+                };
+
+                bool complete = true;
+                uint64_t object_id = 0;
+                for (uint64_t i = 0; i < count; ++i) {
+                    uint64_t value;
+                    if (!cursor.read_varint(value)) {
+                        complete = false;
+                        break;
+                    }
+
+                    object_id += static_cast<uint64_t>(from_zigzag(value >> Operation::TAG_BITS));
+                    if (object_id >= recording.objects.size()) {
+                        throw std::runtime_error("Undeclared object in ledger recording");
+                    }
+
+                    submission.operations.push_back({
+                        .object_id = object_id,
+                        .tag       = static_cast<uint8_t>(value & Operation::TAG_MASK),
+                    });
+                }
+
+                if (!complete) {
+                    break;
+                }
+
+                recording.cycles.back().submissions.push_back(std::move(submission));
+            }
+            else {
+                throw std::runtime_error("Unknown record in ledger recording");
+            }
+        }
+
+        return recording;
+    }
+
+    MANTLE_SOURCE_INLINE
+    size_t LedgerRecording::region_count() const {
+        size_t count = 0;
+        for (const RecordedObject& object: objects) {
+            count = std::max<size_t>(count, object.region_id + 1);
+        }
+
+        for (const RecordedCycle& cycle: cycles) {
+            for (const RecordedSubmission& submission: cycle.submissions) {
+                count = std::max<size_t>(count, submission.region_id + 1);
+            }
+        }
+
+        return count;
+    }
+
+    MANTLE_SOURCE_INLINE
+    size_t LedgerRecording::operation_count() const {
+        size_t count = 0;
+        for (const RecordedCycle& cycle: cycles) {
+            for (const RecordedSubmission& submission: cycle.submissions) {
+                count += submission.operations.size();
+            }
+        }
+
+        return count;
+    }
+
+    MANTLE_SOURCE_INLINE
+    LedgerRecorder::LedgerRecorder(std::ostream& stream)
+        : stream_(stream)
+        , object_count_(0)
+        , operation_count_(0)
+    {
+        stream_.write(reinterpret_cast<const char*>(LEDGER_RECORDING_MAGIC.data()), LEDGER_RECORDING_MAGIC.size());
+        stream_.put(static_cast<char>(LEDGER_RECORDING_VERSION));
+    }
+
+    MANTLE_SOURCE_INLINE
+    LedgerRecorder::~LedgerRecorder() {
+        flush();
+        stream_.flush();
+    }
+
+    MANTLE_SOURCE_INLINE
+    size_t LedgerRecorder::operation_count() const {
+        return operation_count_;
+    }
+
+    MANTLE_SOURCE_INLINE
+    size_t LedgerRecorder::object_count() const {
+        return object_count_;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void LedgerRecorder::add_region(const RegionId region_id) {
+        while (buffers_.size() <= region_id) {
+            buffers_.push_back(std::make_unique<Buffer>());
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    void LedgerRecorder::flush() {
+        record_.clear();
+
+        for (size_t region_id = 0; region_id < buffers_.size(); ++region_id) {
+            Buffer& buffer = *buffers_[region_id];
+            if (buffer.operations.empty()) {
+                continue;
+            }
+
+            if (cycle_ != buffer.cycle) {
+                record_.push_back(LEDGER_RECORDING_CYCLE);
+                write_varint(record_, buffer.cycle);
+                cycle_ = buffer.cycle;
+            }
+
+            // Objects are declared before the submission that first uses them.
+            for (const RoutedOperation& routed: buffer.operations) {
+                const Object* object = routed.operation.object();
+                if (object_ids_.try_emplace(object, object_count_).second) {
+                    record_.push_back(LEDGER_RECORDING_OBJECT);
+                    write_varint(record_, routed.owner_id);
+                    write_varint(record_, object->group());
+                    object_count_ += 1;
+                }
+            }
+
+            record_.push_back(LEDGER_RECORDING_SUBMIT);
+            write_varint(record_, region_id);
+            write_varint(record_, buffer.operations.size());
+
+            uint64_t previous_id = 0;
+            for (const RoutedOperation& routed: buffer.operations) {
+                const Operation operation = routed.operation;
+                const uint64_t object_id = object_ids_.find(operation.object())->second;
+
+                const uint64_t delta = to_zigzag(static_cast<int64_t>(object_id - previous_id));
+                write_varint(record_, (delta << Operation::TAG_BITS) | (operation.tagged_pointer_ & Operation::TAG_MASK));
+                previous_id = object_id;
+            }
+
+            operation_count_ += buffer.operations.size();
+            buffer.operations.clear();
+        }
+
+        // The dead can't have been routed to after they died, so this is safe to do after the above.
+        // Their addresses may be reused once they are finalized.
+        for (const std::unique_ptr<Buffer>& buffer: buffers_) {
+            for (const Object* object: buffer->released_objects) {
+                object_ids_.erase(object);
+            }
+
+            buffer->released_objects.clear();
+        }
+
+        if (!record_.empty()) {
+            stream_.write(reinterpret_cast<const char*>(record_.data()), static_cast<std::streamsize>(record_.size()));
+        }
+    }
+
+    struct LedgerReplay::ReplayedObject : Object {
+        ReplayedObject(const ObjectGroup group, const uint64_t id)
+            : Object(group)
+            , id(id)
+        {
+        }
+
+        uint64_t id;
+    };
+
+    MANTLE_SOURCE_INLINE
+    LedgerReplay::LedgerReplay(const LedgerRecording& recording, const Config& config)
+        : recording_(recording)
+        , config_(config)
+        , metrics_{}
+        , finished_(false)
+        , objects_(recording.objects.size(), nullptr)
+        , created_(recording.objects.size(), false)
+    {
+        config_.domain_worker_count = 0;
+        config_.reference_count_table = false;
+        config_.ledger_recorder = nullptr;
+        config_.heap_census_interval = 0;
+
+        const size_t region_count = recording.region_count();
+
+        // Every region's ledger holds its two most recent submissions, padded and possibly escaped.
+        std::vector<size_t> largest_submissions(region_count, 0);
+        for (const RecordedCycle& cycle: recording.cycles) {
+            for (const RecordedSubmission& submission: cycle.submissions) {
+                size_t& largest = largest_submissions[submission.region_id];
+                largest = std::max(largest, submission.operations.size());
+            }
+        }
+
+        const size_t entry_count = (config_.ledger_encoding == LedgerEncoding::COMPACT) ? CompactOperation::ESCAPED_SIZE : 1;
+        for (RegionId region_id = 0; region_id < region_count; ++region_id) {
+            const size_t capacity = 2 * ((largest_submissions[region_id] * entry_count) + CompactOperationBatch::SIZE);
+
+            ledgers_.push_back(std::make_unique<OperationLedger>(
+                std::max(config_.ledger_capacity, capacity),
+                config_.ledger_huge_pages,
+                std::nullopt,
+                config_.ledger_decommit_fill,
+                config_.ledger_decommit_cycles,
+                config_.ledger_encoding
+            ));
+
+            controllers_.push_back(std::make_unique<RegionController>(region_id, controllers_, *ledgers_.back(), config_));
+        }
+
+        submitted_ranges_.assign(region_count, EMPTY_SEQUENCE_RANGE);
+    }
+
+    MANTLE_SOURCE_INLINE
+    LedgerReplay::~LedgerReplay() {
+        // Whatever is still alive was still referenced when the recording ended.
+        for (ReplayedObject* object: objects_) {
+            delete object;
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    LedgerReplayMetrics LedgerReplay::run() {
+        if (finished_) {
+            throw std::logic_error("A ledger replay can only be run once");
+        }
+        finished_ = true;
+
+        const auto start = std::chrono::steady_clock::now();
+
+        for (const RecordedCycle& cycle: recording_.cycles) {
+            run_cycle(&cycle);
+        }
+
+        // Keep going until the last decrements have made their way through the pipeline.
+        auto is_pending = [this]() {
+            return std::any_of(controllers_.begin(), controllers_.end(), [](const std::unique_ptr<RegionController>& controller) {
+                return controller->has_pending_operations();
+            });
+        };
+
+        while (is_pending()) {
+            run_cycle(nullptr);
+        }
+
+        metrics_.duration = std::chrono::steady_clock::now() - start;
+
+        for (const std::unique_ptr<RegionController>& controller: controllers_) {
+            const RegionControllerMetrics& metrics = controller->metrics();
+
+            metrics_.operation_count += metrics.increment_count + metrics.decrement_count;
+            metrics_.applied_count += metrics.applied_count;
+            metrics_.apply_duration += metrics.apply_duration;
+
+            metrics_.operation_grouper.grouped_count += metrics.operation_grouper.grouped_count;
+            metrics_.operation_grouper.written_count += metrics.operation_grouper.written_count;
+            metrics_.operation_grouper.written_increment_count += metrics.operation_grouper.written_increment_count;
+            metrics_.operation_grouper.written_decrement_count += metrics.operation_grouper.written_decrement_count;
+            metrics_.operation_grouper.flushed_count += metrics.operation_grouper.flushed_count;
+            metrics_.operation_grouper.flushed_increment_count += metrics.operation_grouper.flushed_increment_count;
+            metrics_.operation_grouper.flushed_decrement_count += metrics.operation_grouper.flushed_decrement_count;
+            metrics_.operation_grouper.evicted_count += metrics.operation_grouper.evicted_count;
+            metrics_.operation_grouper.cache_capacity += metrics.operation_grouper.cache_capacity;
+            metrics_.operation_grouper.resize_count += metrics.operation_grouper.resize_count;
+        }
+
+        return metrics_;
+    }
+
+    MANTLE_SOURCE_INLINE
+    Object& LedgerReplay::object(const uint64_t object_id) {
+        ReplayedObject*& object = objects_[object_id];
+        if (!object) {
+            const RecordedObject& recorded = recording_.objects[object_id];
+
+            object = new ReplayedObject(recorded.group, object_id);
+            object->bind(recorded.region_id);
+
+            if (created_[object_id]) {
+                metrics_.revived_count += 1;
+            }
+            created_[object_id] = true;
+        }
+
+        return *object;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void LedgerReplay::run_cycle(const RecordedCycle* cycle) {
+        using Phase = RegionControllerPhase;
+
+        // Regions write their transactions before the cycle starts, like they would between steps.
+        for (RegionId region_id = 0; region_id < ledgers_.size(); ++region_id) {
+            ledgers_[region_id]->begin_transaction();
+        }
+
+        if (cycle) {
+            for (const RecordedSubmission& submission: cycle->submissions) {
+                OperationLedger& ledger = *ledgers_[submission.region_id];
+
+                for (const RecordedOperation& recorded: submission.operations) {
+                    const Operation operation = {
+                        .tagged_pointer_ = reinterpret_cast<uintptr_t>(&object(recorded.object_id)) | recorded.tag,
+                    };
+
+                    if (!ledger.write(operation)) {
+                        throw std::runtime_error("Ledger recording doesn't fit in the replay ledger");
+                    }
+                }
+            }
+        }
+
+        for (RegionId region_id = 0; region_id < ledgers_.size(); ++region_id) {
+            submitted_ranges_[region_id] = ledgers_[region_id]->commit_transaction();
+        }
+
+        // Routing skips operations of the other type, so the whole range is submitted as both.
+        const Sequence next_cycle = controllers_.front()->cycle() + 1;
+        controllers_.front()->request_start();
+
+        for (;;) {
+            const RegionControllerCensus census = synchronize(controllers_);
+            if (census.all(Phase::START) && (census.min_cycle() == next_cycle)) {
+                break;
+            }
+
+            for (const std::unique_ptr<RegionController>& controller: controllers_) {
+                while (const std::optional<Message> message = controller->send_message()) {
+                    if (message->type == MessageType::RETIRE) {
+                        finalize(message->retire.garbage);
+                    }
+                }
+
+                if (controller->phase() == Phase::SUBMIT) {
+                    const SequenceRange range = submitted_ranges_[controller->region_id()];
+
+                    controller->receive_message(Message {
+                        .submit = {
+                            .type                = MessageType::SUBMIT,
+                            .stop                = false,
+                            .increments          = range,
+                            .decrements          = range,
+                            .increment_partition = nullptr,
+                            .decrement_partition = nullptr,
+                            .increment_spill     = nullptr,
+                            .decrement_spill     = nullptr,
+                            .barrier             = nullptr,
+                            .finalized_count     = metrics_.finalized_count,
+                            .bound_count         = 0,
+                            .released_count      = 0,
+                            .heap_census         = nullptr,
+                        },
+                    });
+                }
+            }
+        }
+
+        metrics_.cycle_count += 1;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void LedgerReplay::finalize(ObjectGroups garbage) {
+        const auto start = std::chrono::steady_clock::now();
+
+        garbage.for_each_group([this](ObjectGroup, std::span<Object*> members) {
+            for (Object* member: members) {
+                ReplayedObject* object = static_cast<ReplayedObject*>(member);
+                objects_[object->id] = nullptr;
+                delete object;
+            }
+        });
+
+        metrics_.finalized_count += garbage.object_count;
+        metrics_.finalize_duration += std::chrono::steady_clock::now() - start;
+    }
+
+}
@@ -0,0 +1,147 @@
+#include "mantle/memory_mapping.h"
+#include <sys/mman.h>
+#include <linux/mman.h>
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstdio>
+#include <vector>
+#include <cassert>
+#include <cstdint>
+
+namespace mantle {
+
+    inline size_t round_up(const size_t size, const size_t alignment) {
+        return (size + alignment - 1) & ~(alignment - 1);
+    }
+
+    // Over-map by a huge page and trim both ends, since mmap only guarantees page alignment.
+    inline void* map_huge_page_aligned_memory(const size_t size) {
+        const size_t padded_size = size + HUGE_PAGE_SIZE;
+
+        void* address = mmap(nullptr, padded_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (address == MAP_FAILED) {
+            return MAP_FAILED;
+        }
+
+        std::byte* first = static_cast<std::byte*>(address);
+        std::byte* aligned = reinterpret_cast<std::byte*>(round_up(reinterpret_cast<uintptr_t>(first), HUGE_PAGE_SIZE));
+        std::byte* last = first + padded_size;
+
+        if (aligned != first) {
+            munmap(first, aligned - first);
+        }
+
+        if ((aligned + size) != last) {
+            munmap(aligned + size, last - (aligned + size));
+        }
+
+        return aligned;
+    }
+
+    // Set a preferred node before anything is touched, so that pages are allocated there. This is best
+    // effort, and fails harmlessly on kernels without NUMA support.
+    inline void prefer_numa_node(void* address, const size_t size, const size_t node) {
+        constexpr size_t BITS_PER_WORD = 8 * sizeof(unsigned long);
+
+        std::vector<unsigned long> mask((node / BITS_PER_WORD) + 1, 0);
+        mask[node / BITS_PER_WORD] |= 1ul << (node % BITS_PER_WORD);
+
+        // The kernel expects one more than the number of bits in the mask.
+        syscall(SYS_mbind, address, size, MPOL_PREFERRED, mask.data(), (mask.size() * BITS_PER_WORD) + 1, 0);
+    }
+
+    MANTLE_SOURCE_INLINE
+    size_t mapping_size(const size_t size, const HugePagePolicy policy) {
+        return round_up(size, (policy == HugePagePolicy::NONE) ? PAGE_SIZE : HUGE_PAGE_SIZE);
+    }
+
+    MANTLE_SOURCE_INLINE
+    std::span<std::byte> map_memory(const size_t size, const HugePagePolicy policy, const std::optional<size_t> numa_node) {
+        const size_t length = mapping_size(size, policy);
+
+        void* address = MAP_FAILED;
+        switch (policy) {
+            case HugePagePolicy::EXPLICIT: {
+                // This fails with ENOMEM when hugetlbfs has too few pages reserved.
+                address = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+                if (address != MAP_FAILED) {
+                    break;
+                }
+
+                [[fallthrough]];
+            }
+            case HugePagePolicy::TRANSPARENT: {
+                address = map_huge_page_aligned_memory(length);
+                if (address != MAP_FAILED) {
+                    // This is only advice. It fails harmlessly when THP is disabled.
+                    madvise(address, length, MADV_HUGEPAGE);
+                }
+                break;
+            }
+            case HugePagePolicy::NONE: {
+                address = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                break;
+            }
+        }
+
+        if (address == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+
+        if (numa_node) {
+            prefer_numa_node(address, length, *numa_node);
+        }
+
+        return { static_cast<std::byte*>(address), length };
+    }
+
+    MANTLE_SOURCE_INLINE
+    void decommit_memory(const std::span<std::byte> memory, const HugePagePolicy policy) {
+        const size_t page_size = (policy == HugePagePolicy::NONE) ? PAGE_SIZE : HUGE_PAGE_SIZE;
+
+        const uintptr_t first = round_up(reinterpret_cast<uintptr_t>(memory.data()), page_size);
+        const uintptr_t last = (reinterpret_cast<uintptr_t>(memory.data()) + memory.size()) & ~(page_size - 1);
+        if (first >= last) {
+            return;
+        }
+
+        const int result = madvise(reinterpret_cast<void*>(first), last - first, MADV_DONTNEED);
+        assert(result >= 0);
+        (void)result;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void unmap_memory(const std::span<std::byte> memory, const HugePagePolicy policy) {
+        const int result = munmap(memory.data(), mapping_size(memory.size(), policy));
+        assert(result >= 0);
+        (void)result;
+    }
+
+    MANTLE_SOURCE_INLINE
+    size_t resident_memory_size() {
+        // The file stays open, so each read is a single system call.
+        static const int fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return 0;
+        }
+
+        char buffer[128];
+        const ssize_t length = pread(fd, buffer, sizeof(buffer) - 1, 0);
+        if (length <= 0) {
+            return 0;
+        }
+        buffer[length] = '\0';
+
+        // The second field counts resident pages.
+        size_t total_pages = 0;
+        size_t resident_pages = 0;
+        if (sscanf(buffer, "%zu %zu", &total_pages, &resident_pages) != 2) {
+            return 0;
+        }
+
+        return resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    }
+
+}
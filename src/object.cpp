@@ -52,35 +52,11 @@ namespace mantle {
         start_increment_operation(make_increment_operation(this, exponent));
     }
 
-    MANTLE_SOURCE_INLINE
-    void Object::start_increment_operation(Operation operation) {
-        assert(operation.type() == OperationType::INCREMENT);
-
-        if (Region* region = Region::thread_local_instance(); LIKELY(region)) {
-            region->start_increment_operation(*this, operation);
-        }
-        else {
-            // Leak.
-        }
-    }
-
     MANTLE_SOURCE_INLINE
     void Object::start_decrement_operation(uint8_t exponent) {
         start_decrement_operation(make_decrement_operation(this, exponent));
     }
 
-    MANTLE_SOURCE_INLINE
-    void Object::start_decrement_operation(Operation operation) {
-        assert(operation.type() == OperationType::DECREMENT);
-
-        if (Region* region = Region::thread_local_instance(); LIKELY(region)) {
-            region->start_decrement_operation(*this, operation);
-        }
-        else {
-            // Leak.
-        }
-    }
-
     MANTLE_SOURCE_INLINE
     bool Object::apply_increment(const uint32_t delta_magnitude) {
         reference_count_ += delta_magnitude;
@@ -91,7 +67,7 @@ namespace mantle {
     bool Object::apply_decrement(const uint32_t delta_magnitude) {
         if (reference_count_ < delta_magnitude) {
             reference_count_ = 0;
-            region_id_ = INVALID_REGION_ID;
+            unbind();
             return false;
         }
 
@@ -99,4 +75,19 @@ namespace mantle {
         return true;
     }
 
+    MANTLE_SOURCE_INLINE
+    void Object::unbind() {
+        region_id_ = INVALID_REGION_ID;
+    }
+
+    MANTLE_SOURCE_INLINE
+    uint32_t Object::reference_count_slot() const {
+        return reference_count_;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Object::set_reference_count_slot(const uint32_t slot) {
+        reference_count_ = slot;
+    }
+
 }
@@ -1,12 +1,29 @@
 #include "mantle/operation_grouper.h"
+#include <bit>
+#include <array>
+#include <limits>
+#include <utility>
+#include <functional>
 #include <cassert>
+#include <algorithm>
 
 namespace mantle {
 
     MANTLE_SOURCE_INLINE
-    OperationGrouper::OperationGrouper()
+    OperationGrouper::OperationGrouper(const size_t cache_size, const size_t cache_size_max, const GrouperEvictionPolicy eviction, const GrouperEngine engine)
         : cache_size_(0)
+        , cache_size_min_(0)
+        , cache_size_max_(0)
+        , eviction_(eviction)
+        , engine_(engine)
+        , cache_(cache_size)
+        , cycle_evicted_count_(0)
+        , cycle_peak_size_(0)
+        , low_cycle_count_(0)
     {
+        cache_size_min_ = cache_.size();
+        cache_size_max_ = std::max(cache_size_min_, std::bit_ceil(cache_size_max));
+        metrics_.cache_capacity = cache_.size();
     }
 
     MANTLE_SOURCE_INLINE
@@ -38,7 +55,7 @@ namespace mantle {
             return;
         }
 
-        if (flush) {
+        if (flush || (engine_ == GrouperEngine::RADIX)) {
             // Bypass the cache and immediately flush the operation.
             // The operation doesn't need to be re-encoded which makes this
             // much simpler than flushing an operation group.
@@ -70,6 +87,9 @@ namespace mantle {
                 const bool force = true;
                 flush_group(cursor, force);
 
+                metrics_.evicted_count += 1;
+                cycle_evicted_count_ += 1;
+
                 cache_.store(cursor, CacheEntry {
                     .key = object,
                     .val = {
@@ -93,6 +113,7 @@ namespace mantle {
                 });
 
                 cache_size_ += 1;
+                cycle_peak_size_ = std::max(cycle_peak_size_, cache_size_);
             }
 
             note_operation_written(operation);
@@ -101,7 +122,12 @@ namespace mantle {
 
     MANTLE_SOURCE_INLINE
     void OperationGrouper::flush(const bool force) {
-        for (CacheCursor cursor; cursor; cursor.advance()) {
+        if (engine_ == GrouperEngine::RADIX) {
+            merge_collections();
+            return;
+        }
+
+        for (CacheCursor cursor = cache_.begin(); cursor != cache_.end(); cursor.advance()) {
             flush_group(cursor, force);
         }
     }
@@ -112,9 +138,45 @@ namespace mantle {
         decrements_.clear();
     }
 
+    MANTLE_SOURCE_INLINE
+    void OperationGrouper::retire(const bool force) {
+        assert(!has_retired());
+
+        flush(force);
+        if (engine_ == GrouperEngine::CACHE) {
+            maybe_resize();
+        }
+
+        // Swapping keeps the capacity of both collections around for the next cycle.
+        increments_.swap(retired_increments_);
+        decrements_.swap(retired_decrements_);
+        clear();
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool OperationGrouper::has_retired() const {
+        return !retired_increments_.empty() || !retired_decrements_.empty();
+    }
+
+    MANTLE_SOURCE_INLINE
+    std::span<std::pair<Object*, int64_t>> OperationGrouper::retired_increments() {
+        return retired_increments_;
+    }
+
+    MANTLE_SOURCE_INLINE
+    std::span<std::pair<Object*, int64_t>> OperationGrouper::retired_decrements() {
+        return retired_decrements_;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void OperationGrouper::clear_retired() {
+        retired_increments_.clear();
+        retired_decrements_.clear();
+    }
+
     MANTLE_SOURCE_INLINE
     void OperationGrouper::reset() {
-        for (CacheCursor cursor; cursor; cursor.advance()) {
+        for (CacheCursor cursor = cache_.begin(); cursor != cache_.end(); cursor.advance()) {
             reset_group(cursor);
         }
         assert(cache_size_ == 0);
@@ -122,31 +184,182 @@ namespace mantle {
         clear();
     }
 
+    MANTLE_SOURCE_INLINE
+    size_t OperationGrouper::cache_capacity() const {
+        return cache_.size();
+    }
+
+    MANTLE_SOURCE_INLINE
+    void OperationGrouper::merge_collections() {
+        const size_t written_count = increments_.size() + decrements_.size();
+        if (written_count < 2) {
+            return;
+        }
+
+        merge_buffer_.clear();
+        merge_buffer_.insert(merge_buffer_.end(), increments_.begin(), increments_.end());
+        merge_buffer_.insert(merge_buffer_.end(), decrements_.begin(), decrements_.end());
+        increments_.clear();
+        decrements_.clear();
+
+        sort_by_object(merge_buffer_, merge_scratch_);
+
+        // Increments are applied before decrements, so an object dies either way only if its net delta
+        // takes it below zero. Merging them is exact, and deltas that cancel out need no write at all.
+        for (size_t head = 0; head < merge_buffer_.size();) {
+            Object* object = merge_buffer_[head].first;
+            int64_t delta = 0;
+
+            size_t tail = head;
+            for (; (tail < merge_buffer_.size()) && (merge_buffer_[tail].first == object); ++tail) {
+                delta += merge_buffer_[tail].second;
+            }
+
+            if (delta > 0) {
+                increments_.emplace_back(object, delta);
+            }
+            else if (delta < 0) {
+                decrements_.emplace_back(object, delta);
+            }
+
+            head = tail;
+        }
+
+        metrics_.grouped_count += written_count - (increments_.size() + decrements_.size());
+    }
+
+    MANTLE_SOURCE_INLINE
+    void OperationGrouper::sort_by_object(std::vector<std::pair<Object*, int64_t>>& values, std::vector<std::pair<Object*, int64_t>>& scratch) {
+        // Operations on the same object are summed, so their order among each other doesn't matter.
+        if (values.size() < RADIX_SORT_MIN) {
+            std::sort(values.begin(), values.end(), [](const auto& lhs, const auto& rhs) {
+                return std::less<Object*>()(lhs.first, rhs.first);
+            });
+            return;
+        }
+
+        // Only the bits that differ between any two objects need sorting on. Objects tend to
+        // share their upper bits, and the lower ones are always clear because of their alignment.
+        const uintptr_t first = std::bit_cast<uintptr_t>(values.front().first);
+        uintptr_t differing = 0;
+        for (auto&& [object, _]: values) {
+            differing |= std::bit_cast<uintptr_t>(object) ^ first;
+        }
+
+        if (differing == 0) {
+            return;
+        }
+
+        const size_t low_bit  = static_cast<size_t>(std::countr_zero(differing));
+        const size_t high_bit = static_cast<size_t>(std::bit_width(differing));
+
+        scratch.resize(values.size());
+
+        for (size_t shift = low_bit; shift < high_bit; shift += RADIX_BITS) {
+            std::array<size_t, (size_t{1} << RADIX_BITS)> offsets = {};
+
+            auto digit = [shift](Object* object) {
+                return (std::bit_cast<uintptr_t>(object) >> shift) & ((uintptr_t{1} << RADIX_BITS) - 1);
+            };
+
+            for (auto&& [object, _]: values) {
+                offsets[digit(object)] += 1;
+            }
+
+            size_t offset = 0;
+            for (size_t& count: offsets) {
+                offset += std::exchange(count, offset);
+            }
+
+            // LSD passes have to be stable, or the order from the digits before is lost.
+            for (const auto& value: values) {
+                scratch[offsets[digit(value.first)]++] = value;
+            }
+
+            values.swap(scratch);
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    void OperationGrouper::maybe_resize() {
+        const size_t capacity = cache_.size();
+        size_t new_capacity = capacity;
+
+        if (cycle_evicted_count_ >= (capacity / GROW_EVICTION_DIVISOR) && capacity < cache_size_max_) {
+            // Groups are being thrown out before they get a chance to combine.
+            new_capacity = capacity * 2;
+            low_cycle_count_ = 0;
+        }
+        else if (cycle_peak_size_ < (capacity / SHRINK_FILL_DIVISOR) && capacity > cache_size_min_) {
+            // Mostly empty cache sets only cost memory and cache misses when flushing.
+            if (++low_cycle_count_ >= SHRINK_CYCLES) {
+                new_capacity = capacity / 2;
+                low_cycle_count_ = 0;
+            }
+        }
+        else {
+            low_cycle_count_ = 0;
+        }
+
+        cycle_evicted_count_ = 0;
+        cycle_peak_size_ = cache_size_;
+
+        if (new_capacity == capacity) {
+            return;
+        }
+
+        // Objects map to different sets once the cache is resized, so whatever survived the flush has to go too.
+        const bool force = true;
+        flush(force);
+
+        cache_ = Cache(new_capacity);
+        metrics_.cache_capacity = cache_.size();
+        metrics_.resize_count += 1;
+        cycle_peak_size_ = 0;
+    }
+
     MANTLE_SOURCE_INLINE
     auto OperationGrouper::choose_way(Object* object) -> CacheCursor {
         // Find the set that maps to this object.
-        std::pair<CacheCursor, CacheCursor> set = cache_.equal_range(object);
+        const size_t set = cache_.to_set(object);
 
         // Check if an entry for the object already exists in the set.
-        for (CacheCursor cursor = set.first; cursor != set.second; cursor.advance()) {
-            if (auto&& [key, _] = cache_.load(cursor); key == object) {
-                return cursor;
-            }
+        if (const Cache::WayMask matches = cache_.matching_ways(set, object)) {
+            return CacheCursor(set, static_cast<size_t>(__builtin_ctz(matches)));
         }
 
         // Look for an empty entry.
-        for (CacheCursor cursor = set.first; cursor != set.second; cursor.advance()) {
-            if (auto&& [key, _] = cache_.load(cursor); !key) {
-                return cursor;
+        if (const Cache::WayMask vacancies = ~cache_.live_ways(set) & Cache::ALL_WAYS) {
+            return CacheCursor(set, static_cast<size_t>(__builtin_ctz(vacancies)));
+        }
+
+        // Find the entry with the fewest hits. Break ties by choosing the lowest way.
+        if (eviction_ == GrouperEvictionPolicy::FEWEST_HITS) {
+            std::pair<CacheCursor, CacheCursor> ways = cache_.equal_range(object);
+
+            CacheCursor min_cursor = ways.first;
+            size_t min_hit_count = std::numeric_limits<size_t>::max();
+
+            for (CacheCursor cursor = ways.first; cursor != ways.second; cursor.advance()) {
+                auto&& [key, group] = cache_.load(cursor);
+
+                if (group.hit_count < min_hit_count) {
+                    min_cursor = cursor;
+                    min_hit_count = group.hit_count;
+                }
             }
+
+            return min_cursor;
         }
 
         // Find the entry with the lowest delta magnitude. Break ties by choosing the lowest way.
         {
-            CacheCursor min_cursor = set.first;
+            std::pair<CacheCursor, CacheCursor> ways = cache_.equal_range(object);
+
+            CacheCursor min_cursor = ways.first;
             int64_t min_delta_magnitude = std::numeric_limits<int64_t>::max();
 
-            for (CacheCursor cursor = set.first; cursor != set.second; cursor.advance()) {
+            for (CacheCursor cursor = ways.first; cursor != ways.second; cursor.advance()) {
                 auto&& [key, group] = cache_.load(cursor);
 
                 const int64_t delta = group.delta;
@@ -171,7 +384,7 @@ namespace mantle {
 
         // Operation groups need an exponential number of hits to avoid being flushed.
         group.hit_decay *= 2;
-        if (group.hit_decay < group.hit_count && !force) {
+        if (group.hit_decay < group.hit_count && !force && eviction_ != GrouperEvictionPolicy::EVERY_CYCLE) {
             return; // Seems active, keep this group alive for now.
         }
 
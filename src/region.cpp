@@ -4,6 +4,10 @@
 #include "mantle/object_finalizer.h"
 #include "mantle/config.h"
 #include "mantle/debug.h"
+#include "mantle/trace.h"
+#include <chrono>
+#include <limits>
+#include <algorithm>
 #include <cassert>
 
 namespace mantle {
@@ -33,6 +37,58 @@ namespace mantle {
         Counter& counter_;
     };
 
+    // Tracks how much finalization work a `Region::step` call is still allowed to do.
+    class FinalizationBudget {
+        using Clock = std::chrono::steady_clock;
+
+    public:
+        explicit FinalizationBudget(const Config& config)
+            : object_count_(config.finalization_budget_objects)
+            , has_object_limit_(config.finalization_budget_objects > 0)
+            , has_deadline_(config.finalization_budget_time > std::chrono::nanoseconds::zero())
+            , deadline_(has_deadline_ ? (Clock::now() + config.finalization_budget_time) : Clock::time_point::max())
+        {
+        }
+
+        [[nodiscard]]
+        bool is_unbounded() const {
+            return !has_object_limit_ && !has_deadline_;
+        }
+
+        [[nodiscard]]
+        bool is_exhausted() const {
+            if (has_object_limit_ && (object_count_ == 0)) {
+                return true;
+            }
+
+            return has_deadline_ && (Clock::now() >= deadline_);
+        }
+
+        // The largest batch of objects that can be finalized before checking the budget again.
+        [[nodiscard]]
+        size_t batch_limit() const {
+            size_t limit = has_object_limit_ ? object_count_ : std::numeric_limits<size_t>::max();
+            if (has_deadline_) {
+                limit = std::min(limit, FINALIZATION_BATCH_SIZE);
+            }
+
+            return limit;
+        }
+
+        void spend(const size_t count) {
+            if (has_object_limit_) {
+                assert(count <= object_count_);
+                object_count_ -= count;
+            }
+        }
+
+    private:
+        size_t            object_count_;
+        bool              has_object_limit_;
+        bool              has_deadline_;
+        Clock::time_point deadline_;
+    };
+
     MANTLE_SOURCE_INLINE
     Region::Region(Domain& domain, ObjectFinalizer& finalizer)
         : domain_(domain)
@@ -40,37 +96,104 @@ namespace mantle {
         , state_(INITIAL_STATE)
         , phase_(INITIAL_PHASE)
         , cycle_(INITIAL_CYCLE)
+        , epoch_(0)
         , depth_(0)
         , finalizer_(finalizer)
-        , ledger_(domain.config().ledger_capacity)
+        , numa_node_(domain.config().numa_placement ? current_numa_node() : std::nullopt)
+        , ledger_(domain.config().ledger_capacity, domain.config().ledger_huge_pages, numa_node_, domain.config().ledger_decommit_fill, domain.config().ledger_decommit_cycles, domain.config().ledger_encoding)
+        , combiner_(domain.config().region_combining_cache_size)
+        , reference_count_table_(nullptr)
+        , urgent_start_entries_(static_cast<size_t>(static_cast<double>(domain.config().ledger_capacity) * std::clamp(1.0 - domain.config().cycle_urgent_fill, 0.0, 1.0)))
+        , sent_urgent_start_(false)
+        , pressure_bytes_(domain.config().cycle_pressure_bytes)
+        , dropped_bytes_(0)
+        , dropped_cursor_(0)
+        , dropped_bytes_history_()
+        , byte_cost_filter_()
+        , partition_operations_(domain.config().partition_operations)
+        , partition_cursor_(0)
+        , ledger_overflow_(domain.config().ledger_overflow)
+        , fallback_ledger_(domain.fallback_ledger())
+        , spill_operations_(ledger_overflow_ || fallback_ledger_)
+        , spill_cursor_(0)
+        , apply_local_operations_(domain.config().local_operations && !domain.config().reference_count_table)
+        , local_cursor_(0)
+        , heap_census_(domain.config().heap_census_interval != 0)
+        , heap_census_cursor_(0)
+        , drives_domain_(domain.is_driven_here())
+        , garbage_backlog_offset_(0)
+        , garbage_cursor_(0)
+        , connection_(numa_node_, domain.numa_node(), domain.config().region_wakeups)
+        , metrics_()
     {
-        // Register ourselves as the region on this thread.
-        {
-            Region*& instance = thread_local_instance();
-            if (instance) {
-                throw std::runtime_error("Cannot have more than one region per thread");
-            }
+        attach_thread();
 
-            instance = this;
+        if (domain_.config().ledger_backend == LedgerBackend::WRITE_BARRIER) {
+            barrier_ledger_.emplace(domain_.write_barrier_manager());
         }
 
+        join();
+    }
+
+    MANTLE_SOURCE_INLINE
+    Region::~Region() {
+        stop();
+
+        // Parked regions are destroyed by whichever thread owns the pool.
+        if (thread_local_instance() == this) {
+            thread_local_instance() = nullptr;
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Region::attach_thread() {
+        Region*& instance = thread_local_instance();
+        if (instance) {
+            throw std::runtime_error("Cannot have more than one region per thread");
+        }
+
+        instance = this;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Region::join() {
         // Synchronize with other regions until our cycle and phase match.
-        {
-            ledger_.begin_transaction();
+        ledger_.begin_transaction();
 
-            id_ = domain_.bind(*this);
-            while (cycle_ == INITIAL_CYCLE) {
-                constexpr bool non_blocking = false;
-                step(non_blocking);
-            }
+        domain_.bind(*this);
+        while (cycle_ == INITIAL_CYCLE) {
+            constexpr bool non_blocking = false;
+            step(non_blocking);
         }
     }
 
     MANTLE_SOURCE_INLINE
-    Region::~Region() {
+    void Region::park() {
+        // Everything we wrote has been applied and finalized once this returns.
         stop();
 
-        thread_local_instance() = nullptr;
+        if (thread_local_instance() == this) {
+            thread_local_instance() = nullptr;
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Region::adopt() {
+        assert(state_ == State::STOPPED);
+        assert(ledger_.is_empty() && !has_spilled_operations() && !has_combined_operations() && !has_garbage());
+
+        attach_thread();
+
+        // The domain counts what is bound to each id from zero, and sees this as a new region.
+        id_ = std::numeric_limits<RegionId>::max();
+        state_ = INITIAL_STATE;
+        phase_ = INITIAL_PHASE;
+        cycle_ = INITIAL_CYCLE;
+        sent_urgent_start_ = false;
+        drives_domain_ = domain_.is_driven_here();
+        metrics_ = {};
+
+        join();
     }
 
     MANTLE_SOURCE_INLINE
@@ -93,6 +216,16 @@ namespace mantle {
         return cycle_;
     }
 
+    MANTLE_SOURCE_INLINE
+    auto Region::epoch() const -> Epoch {
+        return epoch_;
+    }
+
+    MANTLE_SOURCE_INLINE
+    auto Region::metrics() const -> const Metrics& {
+        return metrics_;
+    }
+
     MANTLE_SOURCE_INLINE
     int Region::file_descriptor() {
         return connection_.client_endpoint().file_descriptor();
@@ -104,49 +237,458 @@ namespace mantle {
             return;
         }
 
-        // Flag that we want to stop and participate until the domain
-        // indicates that it is safe to do so.
-        state_ = State::STOPPING;
+        // Flag that we want to stop and participate until the domain indicates that our operations
+        // have been drained. Other regions keep going, and don't have to be stopping as well.
+        transition(State::STOPPING);
         while (state_ != State::STOPPED) {
             constexpr bool non_blocking = false;
             step(non_blocking);
         }
+
+        // Make sure the domain is done with our connection before it goes away.
+        domain_.unbind(*this);
+
+        // Garbage from the final cycle may have been carried over.
+        while (has_garbage()) {
+            finalize_garbage();
+        }
+
+        // Nothing is going to happen to us anymore, so don't leave anyone waiting.
+        resume_awaiters(true);
     }
 
     MANTLE_SOURCE_INLINE
     void Region::step(const bool non_blocking) {
+        // Borrowed objects may die once we've taken part in a cycle.
+        epoch_ += 1;
+
+        // Fast-path: Nothing has arrived, and there's nothing to send or finalize.
+        if (non_blocking && !has_work()) {
+            return;
+        }
+
         // Start a new cycle if needed. We need to be in the initial phase, and have a reason to do it.
         bool start_cycle = true;
         start_cycle &= phase_ == INITIAL_PHASE;
-        start_cycle &= cycle_ == INITIAL_CYCLE || (state_ == State::STOPPING || !ledger_.is_empty());
+        start_cycle &= wants_cycle();
         if (start_cycle) {
-            region_endpoint().send_message(
-                Message {
-                    .start = {
-                        .type = MessageType::START,
-                    },
-                }
-            );
-
+            send_start((cycle_ == INITIAL_CYCLE) || (state_ == State::STOPPING) || is_pressured());
             transition(Phase::RECV_ENTER_SENT_START);
         }
+        else if (phase_ == Phase::RECV_ENTER_SENT_START && !sent_urgent_start_ && (is_pressured() || (state_ == State::STOPPING))) {
+            // The domain may be holding our request back. Let it know we can't wait much longer,
+            // and that a stopping region shouldn't wait at all.
+            send_start(true);
+        }
 
-        for (const Message& message: region_endpoint().receive_messages(non_blocking)) {
+        // Nobody else is going to step an embedded domain while we wait, so do it until it has
+        // something for us. It only sends from this thread, so there's no need to block on our own doorbell.
+        const bool drive_domain = drives_domain_ && !non_blocking;
+        if (drive_domain) {
+            domain_.step(true);
+            while (!connection_.client_endpoint().has_pending()) {
+                domain_.step(false);
+            }
+        }
+
+        for (const Message& message: region_endpoint().receive_messages(non_blocking || drive_domain)) {
             debug("[region:{}] received {}", id_, to_string(message.type));
+            trace(TraceSource::REGION, id_, TraceEventType::RECEIVE, static_cast<uint32_t>(message.type));
             handle_message(message);
         }
 
         finalize_garbage();
+
+        // Coroutines may write operations or step again, so only resume them once we're done.
+        resume_awaiters(false);
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Region::has_work() const {
+        if (connection_.client_endpoint().has_pending() || has_garbage()) {
+            return true;
+        }
+
+        // These mirror the conditions for sending a start in `step`.
+        if (phase_ == INITIAL_PHASE) {
+            return wants_cycle();
+        }
+
+        return (phase_ == Phase::RECV_ENTER_SENT_START) && !sent_urgent_start_ && (is_pressured() || (state_ == State::STOPPING));
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Region::Awaiter::await_ready() const {
+        return region_.is_awaited(cycle_, quiesce_);
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Region::Awaiter::await_suspend(const std::coroutine_handle<> handle) {
+        region_.awaiting_.push_back({ .cycle = cycle_, .quiesce = quiesce_, .handle = handle });
+    }
+
+    MANTLE_SOURCE_INLINE
+    auto Region::next_cycle() -> Awaiter {
+        // Operations written now go into the transaction submitted in the cycle after the current one.
+        return Awaiter(*this, cycle_ + 1, false);
+    }
+
+    MANTLE_SOURCE_INLINE
+    auto Region::quiesce() -> Awaiter {
+        return Awaiter(*this, cycle_, true);
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Region::wants_cycle() const {
+        return (cycle_ == INITIAL_CYCLE) || (state_ == State::STOPPING) || has_pending_work() || !awaiting_.empty();
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Region::has_pending_work() const {
+        bool pending = false;
+        pending |= !ledger_.is_empty();
+        pending |= has_spilled_operations();
+        pending |= has_fallback_operations();
+        pending |= has_local_operations();
+        pending |= has_shards();
+        pending |= has_combined_operations();
+        pending |= has_barrier_operations();
+        pending |= has_retired_memory();
+        return pending;
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Region::is_quiescent() const {
+        return !has_pending_work() && !has_garbage();
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Region::is_awaited(const Cycle cycle, const bool quiesce) const {
+        if (state_ == State::STOPPED) {
+            return true;
+        }
+
+        if (quiesce) {
+            return is_quiescent();
+        }
+
+        return (phase_ == INITIAL_PHASE) && (cycle_ >= cycle);
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Region::resume_awaiters(const bool stopped) {
+        if (awaiting_.empty()) {
+            return;
+        }
+
+        // Resumed coroutines can wait on us again, so take the ready ones out before resuming any.
+        std::vector<std::coroutine_handle<>> ready;
+        std::erase_if(awaiting_, [&](const AwaitingCoroutine& awaiting) {
+            if (!stopped && !is_awaited(awaiting.cycle, awaiting.quiesce)) {
+                return false;
+            }
+
+            ready.push_back(awaiting.handle);
+            return true;
+        });
+
+        for (const std::coroutine_handle<> handle: ready) {
+            handle.resume();
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Region::retire(void* pointer, void (*deleter)(void*)) {
+        assert(pointer && deleter);
+
+        // Readers may have loaded the pointer just now, and regions that submitted the next cycle
+        // may have done so before that. The submit of the cycle after it follows ours, and ours only
+        // follows this call, so once every region has sent it nobody can still be reading.
+        retired_memory_.push_back({ .pointer = pointer, .deleter = deleter, .cycle = cycle_ + 2 });
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Region::has_retired_memory() const {
+        return !retired_memory_.empty();
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Region::free_retired_memory() {
+        // The domain only retires a cycle once it has every submit, so being past that point is enough.
+        const bool retired_cycle = phase_ != Phase::RECV_RETIRE;
+
+        // Deleters may retire more memory, so iterate by index.
+        size_t i = 0;
+        for (; i < retired_memory_.size(); ++i) {
+            const RetiredMemory retired = retired_memory_[i];
+            if ((retired.cycle > cycle_) || ((retired.cycle == cycle_) && !retired_cycle)) {
+                break;
+            }
+
+            retired.deleter(retired.pointer);
+        }
+
+        retired_memory_.erase(retired_memory_.begin(), retired_memory_.begin() + i);
+        metrics_.retired_count += i;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Region::bind_object(Object& object, const size_t byte_cost) {
+        object.bind(id_);
+        if (reference_count_table_) {
+            object.set_reference_count_slot(reference_count_table_->allocate());
+        }
+
+        if (pressure_bytes_ && byte_cost) {
+            const size_t bit = to_byte_cost_filter_bit(object);
+            byte_cost_filter_[bit / 64] |= uint64_t{1} << (bit % 64);
+            byte_costs_[&object] = ByteCost{ .bytes = byte_cost };
+        }
+
+        if (heap_census_) {
+            heap_census_deltas_[heap_census_cursor_ % heap_census_deltas_.size()].bound_groups.push_back(object.group());
+        }
+
+        metrics_.bound_count += 1;
     }
 
     MANTLE_SOURCE_INLINE
     void Region::flush_operation(Operation operation) {
+        if (ledger_overflow_) {
+            OperationSpill& spill = spills_[spill_cursor_ % SPILL_HISTORY];
+            if (spill.is_empty()) {
+                metrics_.overflow_count += 1;
+            }
+
+            spill.write(operation);
+            metrics_.spilled_count += 1;
+            return;
+        }
+
         do {
             constexpr bool non_blocking = false;
             step(non_blocking);
         } while (!ledger_.write(operation));
     }
 
+    MANTLE_SOURCE_INLINE
+    bool Region::try_write_operation(const Operation operation) {
+        if (UNLIKELY(apply_local_operations_) && (operation.object()->region_id() == id_)) {
+            write_operation(operation);
+            return true;
+        }
+
+        if (LIKELY(ledger_.write(operation))) {
+            return true;
+        }
+
+        if (ledger_overflow_) {
+            flush_operation(operation);
+            return true;
+        }
+
+        return false;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Region::drop_byte_cost(const Object& object) {
+        const auto it = byte_costs_.find(&object);
+        if (it == byte_costs_.end()) {
+            return;
+        }
+
+        // Bytes still counted for an earlier decrement move to this transaction, rather than being added twice.
+        ByteCost& cost = it->second;
+        if (cost.is_dropped && ((dropped_cursor_ - cost.dropped_cursor) < (DROPPED_BYTES_HISTORY - 1))) {
+            dropped_bytes_history_[cost.dropped_cursor % DROPPED_BYTES_HISTORY] -= cost.bytes;
+        }
+        else {
+            dropped_bytes_ += cost.bytes;
+        }
+
+        dropped_bytes_history_[dropped_cursor_ % DROPPED_BYTES_HISTORY] += cost.bytes;
+        cost.is_dropped = true;
+        cost.dropped_cursor = dropped_cursor_;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Region::drop_byte_costs(const std::span<const Operation> operations) {
+        for (const Operation operation: operations) {
+            if ((operation.type() == OperationType::DECREMENT) && has_byte_cost(*operation.object())) {
+                drop_byte_cost(*operation.object());
+            }
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Region::flush_combined_operations() {
+        // This runs while the domain waits for us to submit, so unlike `flush_operation` it can't
+        // wait for room. Whatever doesn't fit is written to a later transaction instead, which is
+        // what a stalled write would have ended up doing too.
+        combiner_.flush([this](const Operation operation) {
+            return try_write_operation(operation);
+        });
+
+        metrics_.combined_count = combiner_.written_count() - std::min(combiner_.written_count(), combiner_.emitted_count());
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Region::has_combined_operations() const {
+        return !combiner_.is_empty();
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Region::has_spilled_operations() const {
+        if (!spill_operations_) {
+            return false;
+        }
+
+        // Decrements of the previous two transactions have yet to be submitted, and those of the one
+        // before may not have been applied yet.
+        bool spilled = false;
+        spilled |= !spills_[spill_cursor_ % SPILL_HISTORY].is_empty();
+        spilled |= !spills_[(spill_cursor_ - 1) % SPILL_HISTORY].decrements.empty();
+        spilled |= !spills_[(spill_cursor_ - 2) % SPILL_HISTORY].decrements.empty();
+        spilled |= !spills_[(spill_cursor_ - 3) % SPILL_HISTORY].decrements.empty();
+        return spilled;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Region::reconcile_shards() {
+        for (auto it = shards_.begin(); it != shards_.end();) {
+            auto& [object, shard] = *it;
+
+            if (std::exchange(shard.touched, false)) {
+                ++it;
+                continue;
+            }
+
+            // The delta's increments are applied before the shard's decrement, like any other. If the
+            // decrement doesn't make it into this transaction, nothing of the shard is lost by keeping
+            // it, but it must not be written ahead of the delta.
+            shard.delta = try_write_delta(*object, shard.delta);
+            if ((shard.delta != 0) || !try_write_operation(make_decrement_operation(object, Operation::EXPONENT_MAX))) {
+                ++it;
+                continue;
+            }
+
+            it = shards_.erase(it);
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Region::flush_shard(Object& object) {
+        while (true) {
+            // A step may have given the shard back, delta and all.
+            const auto it = shards_.find(&object);
+            if (it == shards_.end()) {
+                return;
+            }
+
+            Shard& shard = it->second;
+            shard.delta = try_write_delta(object, shard.delta);
+
+            // Drops can wait for room, since the shard's weight covers them. Copies can't grow much further.
+            if (shard.delta < SHARD_LIMIT) {
+                return;
+            }
+
+            shard.touched = true;
+
+            constexpr bool non_blocking = false;
+            step(non_blocking);
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Region::has_shards() const {
+        return !shards_.empty();
+    }
+
+    MANTLE_SOURCE_INLINE
+    int64_t Region::try_write_delta(Object& object, int64_t delta) {
+        while (delta != 0) {
+            const OperationType type = (delta > 0) ? OperationType::INCREMENT : OperationType::DECREMENT;
+            const uint64_t magnitude = static_cast<uint64_t>((delta > 0) ? delta : -delta);
+            const uint8_t exponent = static_cast<uint8_t>(std::min<uint64_t>(log2_floor(magnitude), Operation::EXPONENT_MAX));
+
+            const Operation operation = make_operation(&object, type, exponent);
+            if (!try_write_operation(operation)) {
+                break;
+            }
+            delta -= operation.value();
+        }
+
+        return delta;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Region::apply_local_operations() {
+        // Like the domain, apply increments first so nothing dies early.
+        OperationSpill& committed = local_operations_[(local_cursor_ - 1) % SPILL_HISTORY];
+        for (const Operation operation: committed.increments) {
+            operation.mutable_object()->apply_increment(operation.magnitude());
+        }
+
+        OperationSpill& retired = local_operations_[(local_cursor_ - 3) % SPILL_HISTORY];
+        for (const Operation operation: retired.decrements) {
+            Object* object = operation.mutable_object();
+            if (!object->apply_decrement(operation.magnitude())) {
+                local_garbage_.push_back(object);
+            }
+        }
+
+        metrics_.local_count += committed.increments.size() + retired.decrements.size();
+        committed.increments.clear();
+        retired.decrements.clear();
+
+        if (local_garbage_.empty()) {
+            return;
+        }
+
+        // Finalize the dead in group-sized batches, along with whatever the domain found this cycle.
+        std::sort(local_garbage_.begin(), local_garbage_.end(), [](const Object* lhs, const Object* rhs) {
+            return lhs->group() < rhs->group();
+        });
+
+        std::vector<Object*>& target = depth_ ? garbage_pile_ : garbage_backlog_;
+        target.insert(target.end(), local_garbage_.begin(), local_garbage_.end());
+
+        if (heap_census_) {
+            std::vector<ObjectGroup>& released_groups = heap_census_deltas_[heap_census_cursor_ % heap_census_deltas_.size()].released_groups;
+            for (const Object* object: local_garbage_) {
+                released_groups.push_back(object->group());
+            }
+        }
+
+        metrics_.local_released_count += local_garbage_.size();
+        local_garbage_.clear();
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Region::has_local_operations() const {
+        if (!apply_local_operations_) {
+            return false;
+        }
+
+        return std::ranges::any_of(local_operations_, [](const OperationSpill& spill) { return !spill.is_empty(); });
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Region::has_fallback_operations() const {
+        return fallback_ledger_ && fallback_ledger_->has_operations();
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Region::has_write_barriers() const {
+        return barrier_ledger_.has_value();
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Region::has_barrier_operations() const {
+        return barrier_ledger_ && !barrier_ledger_->is_empty();
+    }
+
     MANTLE_SOURCE_INLINE
     const OperationLedger& Region::ledger() const {
         return ledger_;
@@ -173,14 +715,55 @@ namespace mantle {
             case MessageType::ENTER: {
                 assert((phase_ == Phase::RECV_ENTER) || (phase_ == Phase::RECV_ENTER_SENT_START));
 
+                // The domain is free to reuse the memory backing our garbage once we've submitted.
+                stash_garbage();
+
                 // Wrap up the current transaction and submit ranges of operations
-                // that can be applied.
+                // that can be applied. Operations folded together on our side only go in now.
+                if (has_shards()) {
+                    reconcile_shards();
+                }
+                flush_combined_operations();
                 ledger_.commit_transaction();
+
+                // Take over whatever threads without a region have written, as if it were part of this
+                // transaction. Anything they dropped was handed to them through some region, and that
+                // region's own decrement is still two transactions away when it sees their writes here.
+                if (has_fallback_operations()) {
+                    fallback_ledger_->drain(spills_[spill_cursor_ % SPILL_HISTORY]);
+                }
+
+                // The barrier that was submitted last time has been routed by now, so it can be recycled.
+                if (barrier_ledger_) {
+                    barrier_ledger_->step();
+                }
+
+                const OperationPartition* increment_partition = nullptr;
+                const OperationPartition* decrement_partition = nullptr;
+                if (partition_operations_) {
+                    // Increments are submitted straight away, and decrements two transactions later.
+                    partition_cursor_ += 1;
+
+                    OperationPartition& partition = partitions_[partition_cursor_ % PARTITION_HISTORY];
+                    partition.assign(ledger_, ledger_.transaction_log().select(0));
+
+                    increment_partition = &partition;
+                    decrement_partition = &partitions_[(partition_cursor_ - 2) % PARTITION_HISTORY];
+                }
+
+                // Spilled operations follow the same schedule as the ledger's.
+                const OperationSpill* increment_spill = nullptr;
+                const OperationSpill* decrement_spill = nullptr;
+                if (spill_operations_) {
+                    increment_spill = &spills_[spill_cursor_ % SPILL_HISTORY];
+                    decrement_spill = &spills_[(spill_cursor_ - 2) % SPILL_HISTORY];
+                }
+
                 {
                     // Check if the region is ready to stop.
                     bool stop = true;
                     stop &= state_ == State::STOPPING;
-                    stop &= ledger_.is_empty();
+                    stop &= is_quiescent();
 
                     region_endpoint().send_message(
                         Message {
@@ -189,12 +772,47 @@ namespace mantle {
                                 .stop       = stop,
                                 .increments = ledger_.transaction_log().select(0),
                                 .decrements = ledger_.transaction_log().select(2),
+                                .increment_partition = increment_partition,
+                                .decrement_partition = decrement_partition,
+                                .increment_spill     = increment_spill,
+                                .decrement_spill     = decrement_spill,
+                                .barrier             = barrier_ledger_ ? &barrier_ledger_->apply_barrier() : nullptr,
+                                .finalized_count     = metrics_.finalized_count,
+                                .bound_count         = metrics_.bound_count,
+                                .released_count      = metrics_.local_released_count,
+                                .heap_census         = heap_census_ ? &heap_census_deltas_[heap_census_cursor_ % heap_census_deltas_.size()] : nullptr,
                             },
                         }
                     );
+                    trace(TraceSource::REGION, id_, TraceEventType::SEND, static_cast<uint32_t>(MessageType::SUBMIT));
                 }
                 ledger_.begin_transaction();
 
+                if (heap_census_) {
+                    // The delta before the one just submitted has been read by now.
+                    heap_census_cursor_ += 1;
+                    heap_census_deltas_[heap_census_cursor_ % heap_census_deltas_.size()].clear();
+                }
+
+                if (apply_local_operations_) {
+                    // Operations from now on are applied two cycles from now at the earliest.
+                    local_cursor_ += 1;
+                }
+
+                if (spill_operations_) {
+                    // The entry is reused after three transactions. Its spill was last submitted with the
+                    // decrements of the transaction before this one, and has been routed by now.
+                    spill_cursor_ += 1;
+                    spills_[spill_cursor_ % SPILL_HISTORY].clear();
+                }
+
+                if (pressure_bytes_) {
+                    // Decrements from two transactions ago were just submitted, so whatever they dropped
+                    // is reclaimed by this cycle unless it is still referenced.
+                    dropped_cursor_ += 1;
+                    dropped_bytes_ -= std::exchange(dropped_bytes_history_[(dropped_cursor_ - 3) % DROPPED_BYTES_HISTORY], 0);
+                }
+
                 transition(message.enter.cycle);
                 transition(Phase::RECV_RETIRE);
                 break;
@@ -208,6 +826,10 @@ namespace mantle {
                 assert(!garbage_);
                 garbage_ = message.retire.garbage;
 
+                if (apply_local_operations_) {
+                    apply_local_operations();
+                }
+
                 transition(Phase::RECV_LEAVE);
                 break;
             }
@@ -231,6 +853,7 @@ namespace mantle {
         }
 
         debug("[region:{}] transition state {} to {}", id_, to_string(state_), to_string(next_state));
+        trace(TraceSource::REGION, id_, TraceEventType::STATE, static_cast<uint32_t>(next_state));
         state_ = next_state;
     }
 
@@ -241,6 +864,7 @@ namespace mantle {
         }
 
         debug("[region:{}] transition phase {} to {}", id_, to_string(phase_), to_string(next_phase));
+        trace(TraceSource::REGION, id_, TraceEventType::PHASE, static_cast<uint32_t>(next_phase), cycle_);
         phase_ = next_phase;
     }
 
@@ -251,9 +875,68 @@ namespace mantle {
         }
 
         debug("[region:{}] transition cycle {} to {}", id_, cycle_, next_cycle);
+        trace(TraceSource::REGION, id_, TraceEventType::CYCLE, 0, next_cycle);
         cycle_ = next_cycle;
     }
 
+    MANTLE_SOURCE_INLINE
+    bool Region::is_ledger_pressured() const {
+        return ledger_.writable_transaction_entries() <= urgent_start_entries_;
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Region::is_memory_pressured() const {
+        return pressure_bytes_ && (dropped_bytes_ >= pressure_bytes_);
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Region::is_pressured() const {
+        return is_ledger_pressured() || is_memory_pressured();
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Region::send_start(const bool urgent) {
+        if (urgent && !is_ledger_pressured() && is_memory_pressured()) {
+            metrics_.pressure_start_count += 1;
+        }
+
+        region_endpoint().send_message(make_start_message(urgent));
+        trace(TraceSource::REGION, id_, TraceEventType::SEND, static_cast<uint32_t>(MessageType::START));
+
+        sent_urgent_start_ = urgent;
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool Region::has_garbage() const {
+        return garbage_ || (garbage_backlog_offset_ < garbage_backlog_.size()) || !garbage_pile_.empty();
+    }
+
+    MANTLE_SOURCE_INLINE
+    void Region::stash_garbage() {
+        if (!garbage_) {
+            return;
+        }
+
+        // The backlog is being iterated over while finalization is in progress. Garbage
+        // received by nested `Region::step` calls goes on the pile instead.
+        std::vector<Object*>& target = depth_ ? garbage_pile_ : garbage_backlog_;
+
+        // Leave out whatever finalization has already got to.
+        if constexpr (ENABLE_OBJECT_GROUPING) {
+            garbage_->for_each_group([&](ObjectGroup group, std::span<Object*> members) {
+                if (group >= garbage_cursor_) {
+                    target.insert(target.end(), members.begin(), members.end());
+                }
+            });
+        }
+        else {
+            target.insert(target.end(), garbage_->objects + garbage_cursor_, garbage_->objects + garbage_->object_count);
+        }
+
+        garbage_.reset();
+        garbage_cursor_ = 0;
+    }
+
     MANTLE_SOURCE_INLINE
     void Region::finalize_garbage() {
         if (depth_) {
@@ -262,53 +945,130 @@ namespace mantle {
             // prevents unbounded stack usage.
             assert(depth_ == 1);
 
-            if (garbage_) {
-                // Add garbage to the pile until we can safely deal with it.
-                garbage_->for_each_group([this](ObjectGroup, std::span<Object*> members) {
-                    garbage_pile_.insert(
-                        garbage_pile_.end(),
-                        members.begin(),
-                        members.end()
-                    );
-                });
-
-                garbage_.reset();
-            }
+            // Add garbage to the pile until we can safely deal with it.
+            stash_garbage();
         }
         else {
             ScopedIncrement lock(depth_);
+            FinalizationBudget budget(domain_.config());
+
+            // Budgeted finalization can stop part way through, so garbage is copied somewhere
+            // that will still be valid during the next step.
+            if (garbage_ && !budget.is_unbounded()) {
+                stash_garbage();
+            }
+
+            // Finalize carried over garbage in group-sized batches.
+            while ((garbage_backlog_offset_ < garbage_backlog_.size()) && !budget.is_exhausted()) {
+                const size_t first = garbage_backlog_offset_;
+                const size_t limit = first + std::min(garbage_backlog_.size() - first, budget.batch_limit());
+                const ObjectGroup group = garbage_backlog_[first]->group();
+
+                size_t last = first + 1;
+                while ((last < limit) && (garbage_backlog_[last]->group() == group)) {
+                    last += 1;
+                }
+
+                garbage_backlog_offset_ = last;
+                budget.spend(last - first);
+                finalize_objects(group, std::span{&garbage_backlog_[first], last - first});
+            }
+            if (garbage_backlog_offset_ == garbage_backlog_.size()) {
+                garbage_backlog_.clear();
+                garbage_backlog_offset_ = 0;
+            }
 
             if (garbage_) {
-                if constexpr (ENABLE_OBJECT_GROUPING) {
-                    assert(garbage_->object_count == garbage_->group_offsets[garbage_->group_max + 1]);
+                assert(budget.is_unbounded());
 
-                    garbage_->for_each_group([this](ObjectGroup group, std::span<Object*> members) {
-                        finalizer_.finalize(group, members);
-                    });
+                // A finalizer that steps can take us into the next cycle, which stashes the rest of the
+                // garbage and lets the domain reuse it. Stop reading it as soon as that happens.
+                ObjectGroups garbage = *garbage_;
+                if constexpr (ENABLE_OBJECT_GROUPING) {
+                    for (size_t word = garbage.group_min / OBJECT_GROUP_MASK_WORD_BITS; garbage_ && (word <= (garbage.group_max / OBJECT_GROUP_MASK_WORD_BITS)); ++word) {
+                        for (uint64_t bits = (*garbage.group_mask)[word]; garbage_ && bits; bits &= bits - 1) {
+                            const ObjectGroup group = static_cast<ObjectGroup>((word * OBJECT_GROUP_MASK_WORD_BITS) + static_cast<size_t>(__builtin_ctzll(bits)));
+                            garbage_cursor_ = size_t{group} + 1;
+                            finalize_objects(group, garbage.group_members(group));
+                        }
+                    }
                 }
                 else {
-                    for (size_t i = 0; i < garbage_->object_count; ++i) {
-                        Object* object = garbage_->objects[i];
-                        finalizer_.finalize(object->group(), std::span{&object, 1});
+                    for (size_t i = 0; garbage_ && (i < garbage.object_count); ++i) {
+                        garbage_cursor_ = i + 1;
+                        Object* object = garbage.objects[i];
+                        finalize_objects(object->group(), std::span{&object, 1});
                     }
                 }
 
                 garbage_.reset();
+                garbage_cursor_ = 0;
             }
 
-            if (UNLIKELY(!garbage_pile_.empty())) {
-                // This collection can be modified while we are iterating over it.
-                // Use index-based iteration to avoid invalidation issues.
-                for (size_t i = 0; i < garbage_pile_.size(); ++i) {
-                    Object* object = garbage_pile_[i];
-                    finalizer_.finalize(object->group(), std::span{&object, 1});
+            // Finalizers keep adding to the pile while it is being finalized, e.g. when tearing down a
+            // tree. Take it over a round at a time, and finalize each round in group-sized batches.
+            while (UNLIKELY(!garbage_pile_.empty()) && !budget.is_exhausted()) {
+                std::vector<Object*>& round = garbage_pile_round_;
+                assert(round.empty());
+                round.swap(garbage_pile_);
+
+                // Each stash is group ordered, but a round can hold many of them.
+                std::sort(round.begin(), round.end(), [](const Object* lhs, const Object* rhs) {
+                    return lhs->group() < rhs->group();
+                });
+
+                size_t first = 0;
+                while ((first < round.size()) && !budget.is_exhausted()) {
+                    const size_t limit = first + std::min(round.size() - first, budget.batch_limit());
+                    const ObjectGroup group = round[first]->group();
+
+                    size_t last = first + 1;
+                    while ((last < limit) && (round[last]->group() == group)) {
+                        last += 1;
+                    }
+
+                    budget.spend(last - first);
+                    finalize_objects(group, std::span{&round[first], last - first});
+                    first = last;
                 }
 
-                garbage_pile_.clear();
+                // What the budget didn't cover goes before anything the round added.
+                garbage_pile_.insert(garbage_pile_.begin(), round.begin() + first, round.end());
+                round.clear();
+            }
+
+            if (has_retired_memory()) {
+                free_retired_memory();
+            }
+
+            // Stay readable so that we get stepped again.
+            if (has_garbage()) {
+                region_endpoint().notify();
             }
         }
     }
 
+    MANTLE_SOURCE_INLINE
+    void Region::finalize_objects(const ObjectGroup group, const std::span<Object*> objects) {
+        metrics_.finalized_count += objects.size();
+        trace(TraceSource::REGION, id_, TraceEventType::FINALIZE, 0, objects.size());
+
+        if (!byte_costs_.empty()) {
+            for (const Object* object: objects) {
+                if (has_byte_cost(*object)) {
+                    byte_costs_.erase(object);
+                }
+            }
+
+            // Bits can't be taken out one by one, since objects share them.
+            if (byte_costs_.empty()) {
+                byte_cost_filter_ = {};
+            }
+        }
+
+        finalizer_.finalize(group, objects);
+    }
+
     MANTLE_SOURCE_INLINE
     std::string_view to_string(RegionState state) {
         using namespace std::literals;
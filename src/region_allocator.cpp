@@ -0,0 +1,95 @@
+#include "mantle/region_allocator.h"
+#include <cassert>
+
+namespace mantle {
+
+    MANTLE_SOURCE_INLINE
+    RegionAllocator::RegionAllocator()
+        : size_classes_()
+        , metrics_()
+    {
+    }
+
+    MANTLE_SOURCE_INLINE
+    RegionAllocator::~RegionAllocator() {
+        // NOTE: Objects that are still alive at this point are leaked, not destroyed.
+        for (std::byte* slab: slabs_) {
+            ::operator delete(slab, std::align_val_t(SLAB_SIZE));
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    auto RegionAllocator::metrics() const -> const Metrics& {
+        return metrics_;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void RegionAllocator::finalize(const ObjectGroup group, const std::span<Object*> objects) noexcept {
+        if (UNLIKELY(group >= SIZE_CLASS_COUNT)) {
+            abort(); // This object wasn't allocated by us.
+        }
+
+        SizeClass& size_class = size_classes_[group];
+
+        // Destroy the objects and chain their slots together, then splice the chain in one go.
+        SlotHeader* head = size_class.free_list;
+        for (Object* object: objects) {
+            SlotHeader* slot = to_slot(object, group);
+            slot->destructor(object);
+            slot->next = head;
+            head = slot;
+        }
+
+        size_class.free_list = head;
+        metrics_.finalized_count += objects.size();
+    }
+
+    MANTLE_SOURCE_INLINE
+    void* RegionAllocator::allocate_slot(const ObjectGroup group, const Destructor destructor) {
+        assert(group < SIZE_CLASS_COUNT);
+
+        SizeClass& size_class = size_classes_[group];
+
+        SlotHeader* slot = size_class.free_list;
+        if (slot) {
+            size_class.free_list = slot->next;
+        }
+        else {
+            if (size_class.bump == size_class.bump_end) {
+                std::byte* slab = static_cast<std::byte*>(::operator new(SLAB_SIZE, std::align_val_t(SLAB_SIZE)));
+                slabs_.push_back(slab);
+                metrics_.slab_count += 1;
+
+                size_class.bump = slab;
+                size_class.bump_end = slab + SLAB_SIZE;
+            }
+
+            slot = new (size_class.bump) SlotHeader;
+            size_class.bump += slot_size(group);
+        }
+
+        slot->destructor = destructor;
+        slot->next = nullptr;
+
+        return reinterpret_cast<std::byte*>(slot) + sizeof(SlotHeader);
+    }
+
+    MANTLE_SOURCE_INLINE
+    void RegionAllocator::deallocate_slot(const ObjectGroup group, void* memory) {
+        SizeClass& size_class = size_classes_[group];
+
+        SlotHeader* slot = reinterpret_cast<SlotHeader*>(static_cast<std::byte*>(memory) - sizeof(SlotHeader));
+        slot->next = size_class.free_list;
+        size_class.free_list = slot;
+    }
+
+    MANTLE_SOURCE_INLINE
+    auto RegionAllocator::to_slot(const Object* object, const ObjectGroup group) -> SlotHeader* {
+        // The object may not be the first base of its class, so round down rather than subtracting.
+        uintptr_t address = reinterpret_cast<uintptr_t>(object);
+        address &= ~(static_cast<uintptr_t>(slot_size(group)) - 1);
+
+        return reinterpret_cast<SlotHeader*>(address);
+    }
+
+}
@@ -1,9 +1,14 @@
 #include "mantle/region_controller.h"
 #include "mantle/region.h"
 #include "mantle/object.h"
+#include "mantle/ledger.h"
 #include "mantle/config.h"
 #include "mantle/debug.h"
+#include "mantle/trace.h"
+#include "mantle/ledger_recording.h"
 #include <limits>
+#include <chrono>
+#include <algorithm>
 #include <stdexcept>
 #include <cstring>
 #include <cstdlib>
@@ -31,11 +36,43 @@ namespace mantle {
         );
     }
 
+    // Visit grouped operations while prefetching the objects `distance` entries ahead. The objects
+    // are scattered across worker heaps, so this hides most of the latency of the dependent loads.
+    //
+    // Objects are only read when their counts are kept in a table, and prefetching them for writing
+    // would take their cache lines away from the cores that own them.
+    template<bool FOR_WRITE = true, typename Visitor>
+    inline void for_each_prefetched(std::span<std::pair<Object*, int64_t>> operations, const size_t distance, Visitor&& visitor) {
+        const size_t count = operations.size();
+        const auto prefetch = [](const Object* object) {
+            if constexpr (FOR_WRITE) {
+                prefetch_for_write(object);
+            }
+            else {
+                prefetch_for_read(object);
+            }
+        };
+
+        for (size_t i = 0; i < std::min(distance, count); ++i) {
+            prefetch(operations[i].first);
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            if ((i + distance) < count) {
+                prefetch(operations[i + distance].first);
+            }
+
+            auto&& [object, delta] = operations[i];
+            visitor(object, delta);
+        }
+    }
+
     MANTLE_SOURCE_INLINE
     RegionControllerCensus::RegionControllerCensus()
         : count_(0)
-        , min_cycle_(std::numeric_limits<Cycle>::max())
-        , max_cycle_(std::numeric_limits<Cycle>::min())
+        , cycle_count_size_(0)
+        , cycle_counts_{}
+        , urgent_count_(0)
     {
         for (size_t& counter: state_counts_) {
             counter = 0;
@@ -58,11 +95,11 @@ namespace mantle {
     MANTLE_SOURCE_INLINE
     void RegionControllerCensus::add(const RegionController& controller) {
         count_ += 1;
-        min_cycle_ = std::min(controller.cycle(), min_cycle_);
-        max_cycle_ = std::max(controller.cycle(), max_cycle_);
+        add(controller.cycle());
         state_counts_[static_cast<size_t>(controller.state())] += 1;
         phase_counts_[static_cast<size_t>(controller.phase())] += 1;
         action_counts_[static_cast<size_t>(controller.action())] += 1;
+        urgent_count_ += controller.is_start_urgent() ? 1 : 0;
     }
 
     MANTLE_SOURCE_INLINE
@@ -72,6 +109,93 @@ namespace mantle {
         }
     }
 
+    MANTLE_SOURCE_INLINE
+    void RegionControllerCensus::add(const RegionControllerCensus& census) {
+        count_ += census.count_;
+        for (size_t i = 0; i < census.cycle_count_size_; ++i) {
+            add(census.cycle_counts_[i].cycle, census.cycle_counts_[i].count);
+        }
+        for (size_t i = 0; i < state_counts_.size(); ++i) {
+            state_counts_[i] += census.state_counts_[i];
+        }
+        for (size_t i = 0; i < phase_counts_.size(); ++i) {
+            phase_counts_[i] += census.phase_counts_[i];
+        }
+        for (size_t i = 0; i < action_counts_.size(); ++i) {
+            action_counts_[i] += census.action_counts_[i];
+        }
+        urgent_count_ += census.urgent_count_;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void RegionControllerCensus::update(const State state, const State next_state) {
+        assert(state_counts_[static_cast<size_t>(state)] > 0);
+        state_counts_[static_cast<size_t>(state)] -= 1;
+        state_counts_[static_cast<size_t>(next_state)] += 1;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void RegionControllerCensus::update(const Phase phase, const Phase next_phase) {
+        assert(phase_counts_[static_cast<size_t>(phase)] > 0);
+        phase_counts_[static_cast<size_t>(phase)] -= 1;
+        phase_counts_[static_cast<size_t>(next_phase)] += 1;
+
+        assert(action_counts_[static_cast<size_t>(to_action(phase))] > 0);
+        action_counts_[static_cast<size_t>(to_action(phase))] -= 1;
+        action_counts_[static_cast<size_t>(to_action(next_phase))] += 1;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void RegionControllerCensus::update(const Cycle cycle, const Cycle next_cycle) {
+        remove(cycle);
+        add(next_cycle);
+    }
+
+    MANTLE_SOURCE_INLINE
+    void RegionControllerCensus::update_urgent(const bool urgent, const bool next_urgent) {
+        assert(!urgent || (urgent_count_ > 0));
+        urgent_count_ -= urgent ? 1 : 0;
+        urgent_count_ += next_urgent ? 1 : 0;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void RegionControllerCensus::add(const Cycle cycle, const size_t count) {
+        size_t index = 0;
+        while ((index < cycle_count_size_) && (cycle_counts_[index].cycle < cycle)) {
+            index += 1;
+        }
+
+        if ((index < cycle_count_size_) && (cycle_counts_[index].cycle == cycle)) {
+            cycle_counts_[index].count += count;
+            return;
+        }
+
+        if (UNLIKELY(cycle_count_size_ == CYCLE_COUNT_CAPACITY)) {
+            abort(); // Controllers have drifted too far apart.
+        }
+
+        std::copy_backward(cycle_counts_.begin() + index, cycle_counts_.begin() + cycle_count_size_, cycle_counts_.begin() + cycle_count_size_ + 1);
+        cycle_counts_[index] = { .cycle = cycle, .count = count };
+        cycle_count_size_ += 1;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void RegionControllerCensus::remove(const Cycle cycle) {
+        size_t index = 0;
+        while ((index < cycle_count_size_) && (cycle_counts_[index].cycle != cycle)) {
+            index += 1;
+        }
+
+        assert(index < cycle_count_size_);
+        if ((index == cycle_count_size_) || (--cycle_counts_[index].count > 0)) {
+            return;
+        }
+
+        std::copy(cycle_counts_.begin() + index + 1, cycle_counts_.begin() + cycle_count_size_, cycle_counts_.begin() + index);
+        cycle_count_size_ -= 1;
+        cycle_counts_[cycle_count_size_] = {};
+    }
+
     MANTLE_SOURCE_INLINE
     size_t RegionControllerCensus::count() const {
         return count_;
@@ -79,12 +203,12 @@ namespace mantle {
 
     MANTLE_SOURCE_INLINE
     auto RegionControllerCensus::min_cycle() const -> Cycle {
-        return min_cycle_;
+        return cycle_count_size_ ? cycle_counts_[0].cycle : std::numeric_limits<Cycle>::max();
     }
 
     MANTLE_SOURCE_INLINE
     auto RegionControllerCensus::max_cycle() const -> Cycle {
-        return max_cycle_;
+        return cycle_count_size_ ? cycle_counts_[cycle_count_size_ - 1].cycle : std::numeric_limits<Cycle>::min();
     }
 
     MANTLE_SOURCE_INLINE
@@ -117,24 +241,51 @@ namespace mantle {
         return (count_ > 0) && action_counts_[static_cast<size_t>(action)] == count_;
     }
 
+    MANTLE_SOURCE_INLINE
+    bool RegionControllerCensus::any_urgent() const {
+        return urgent_count_ != 0;
+    }
+
     MANTLE_SOURCE_INLINE
     RegionController::RegionController(
         const RegionId region_id,
         RegionControllerGroup& controllers,
         const OperationLedger& ledger,
-        const Config& config
+        const Config& config,
+        ReferenceCountTable* reference_count_table
     )
         : region_id_(region_id)
         , controllers_(controllers)
-        , ledger_(ledger)
+        , ledger_(&ledger)
         , config_(config)
+        , reference_count_table_(reference_count_table)
+        , census_(nullptr)
         , state_(State::STARTING)
         , phase_(Phase::START)
         , cycle_(0)
+        , start_urgent_(false)
+        , active_cycle_(std::nullopt)
+        , phase_start_(std::chrono::steady_clock::now())
         , submitted_increments_(EMPTY_SEQUENCE_RANGE)
         , submitted_decrements_(EMPTY_SEQUENCE_RANGE)
+        , submitted_increment_partition_(nullptr)
+        , submitted_decrement_partition_(nullptr)
+        , submitted_increment_spill_(nullptr)
+        , submitted_decrement_spill_(nullptr)
+        , submitted_barrier_(nullptr)
+        , inboxes_(config.domain_worker_count ? (config.domain_worker_count + 1) : 0)
+        , operation_grouper_(config.operation_grouper_cache_size, config.operation_grouper_cache_size_max, config.operation_grouper_eviction, config.operation_grouper_engine)
         , metrics_(operation_grouper_, object_grouper_)
     {
+        metrics_.ledger_capacity = ledger_->capacity();
+
+        if (config_.ledger_recorder) {
+            config_.ledger_recorder->add_region(region_id_);
+        }
+
+        if (config_.heap_census_interval) {
+            heap_census_.emplace(config_.heap_census_interval);
+        }
     }
 
     MANTLE_SOURCE_INLINE
@@ -147,9 +298,25 @@ namespace mantle {
         return metrics_;
     }
 
+    MANTLE_SOURCE_INLINE
+    const HeapCensus* RegionController::heap_census() const {
+        return heap_census_ ? &*heap_census_ : nullptr;
+    }
+
     MANTLE_SOURCE_INLINE
     bool RegionController::is_quiescent() const {
-        return !operation_grouper_.is_dirty();
+        if (operation_grouper_.is_dirty() || operation_grouper_.has_retired()) {
+            return false;
+        }
+
+        // Operations routed by workers that are waiting for the next cycle to be applied.
+        for (const Inbox& inbox: inboxes_) {
+            if (!inbox.retired_operations.empty()) {
+                return false;
+            }
+        }
+
+        return true;
     }
 
     MANTLE_SOURCE_INLINE
@@ -193,6 +360,162 @@ namespace mantle {
         transition(State::STOPPED);
     }
 
+    MANTLE_SOURCE_INLINE
+    bool RegionController::is_detached() const {
+        return (state_ == State::SHUTDOWN) || (state_ == State::VACANT);
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool RegionController::is_drained() const {
+        return is_detached() && ((metrics_.released_count + metrics_.local_released_count) == metrics_.bound_count) && !has_pending_operations();
+    }
+
+    MANTLE_SOURCE_INLINE
+    void RegionController::vacate() {
+        if (!is_drained() || (state_ != State::SHUTDOWN)) {
+            assert(false);
+            return;
+        }
+
+        transition(State::VACANT);
+    }
+
+    MANTLE_SOURCE_INLINE
+    void RegionController::attach(const OperationLedger& ledger, const Cycle cycle) {
+        if ((state_ != State::VACANT) || (phase_ != Phase::START)) {
+            assert(false);
+            return;
+        }
+
+        ledger_ = &ledger;
+        active_cycle_ = std::nullopt;
+        metrics_.ledger_capacity = ledger_->capacity();
+        metrics_.bound_count = 0;
+        metrics_.released_count = 0;
+        metrics_.local_released_count = 0;
+
+        transition(State::STARTING);
+        start(cycle);
+    }
+
+    MANTLE_SOURCE_INLINE
+    void RegionController::request_start() {
+        if (phase_ == Phase::START) {
+            transition(Phase::START_BARRIER);
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool RegionController::is_start_urgent() const {
+        return start_urgent_;
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool RegionController::has_pending_operations() const {
+        // Decrements are submitted two cycles after the transaction they were written in, and pipelined
+        // cycles apply operations one cycle after they are submitted.
+        const Cycle pipeline_depth = is_pipelined() ? 3 : 2;
+
+        return !is_quiescent() || (active_cycle_ && (cycle_ <= (*active_cycle_ + pipeline_depth)));
+    }
+
+    MANTLE_SOURCE_INLINE
+    void RegionController::route_operations(const size_t worker_index) {
+        assert(phase_ == Phase::SUBMIT_BARRIER);
+        assert(worker_index < inboxes_.size());
+
+        route_submitted_operations([worker_index](RegionController& controller, const Operation operation) {
+            controller.inboxes_[worker_index].operations.push_back(operation);
+        });
+    }
+
+    MANTLE_SOURCE_INLINE
+    void RegionController::apply_operations() {
+        assert(phase_ == (is_pipelined() ? Phase::SUBMIT_BARRIER : Phase::RETIRE_BARRIER));
+
+        // All submitted operations have been routed. Unless cycles are pipelined, apply them right away.
+        if (!is_pipelined()) {
+            retire_operations();
+        }
+
+        // Collect operations that were routed to us by domain workers. Nothing else writes to our
+        // grouper when there are workers, so they can be set aside again straight away.
+        if (has_worker_pool()) {
+            for (Inbox& inbox: inboxes_) {
+                for (const Operation operation: inbox.retired_operations) {
+                    operation_grouper_.write(operation, true);
+                }
+
+                inbox.retired_operations.clear();
+            }
+
+            operation_grouper_.retire(is_flush_forced());
+        }
+
+        const auto apply_start = std::chrono::steady_clock::now();
+        const size_t prefetch_distance = config_.apply_prefetch_distance;
+
+        if (reference_count_table_) {
+            ReferenceCountTable& table = *reference_count_table_;
+
+            // Objects are only read for their slot. The one write is when they die.
+            constexpr bool for_write = false;
+
+            for_each_prefetched<for_write>(operation_grouper_.retired_increments(), prefetch_distance, [&table](Object* object, int64_t delta) {
+                assert(delta >= 0);
+                const auto delta_magnitude = static_cast<uint32_t>(+delta);
+                if (!table.apply_increment(object->reference_count_slot(), delta_magnitude)) {
+                    abort();
+                }
+            });
+
+            for_each_prefetched<for_write>(operation_grouper_.retired_decrements(), prefetch_distance, [this, &table](Object* object, int64_t delta) {
+                assert(delta <= 0);
+                const auto delta_magnitude = static_cast<uint32_t>(-delta);
+                if (!table.apply_decrement(object->reference_count_slot(), delta_magnitude)) {
+                    record_release(*object);
+                    released_slots_.push_back(object->reference_count_slot());
+                    object->unbind();
+                    object_grouper_.write(*object);
+                    metrics_.released_count += 1;
+                }
+            });
+
+            table.release(released_slots_);
+            released_slots_.clear();
+        }
+        else {
+            // Increments first to avoid premature death.
+            for_each_prefetched(operation_grouper_.retired_increments(), prefetch_distance, [](Object* object, int64_t delta) {
+                assert(delta >= 0);
+                const auto delta_magnitude = static_cast<uint32_t>(+delta);
+                if (!object->apply_increment(delta_magnitude)) {
+                    abort();
+                }
+            });
+
+            // Apply decrements and group dead objects for finalization.
+            for_each_prefetched(operation_grouper_.retired_decrements(), prefetch_distance, [this](Object* object, int64_t delta) {
+                assert(delta <= 0);
+                const auto delta_magnitude = static_cast<uint32_t>(-delta);
+                if (!object->apply_decrement(delta_magnitude)) {
+                    record_release(*object);
+                    object_grouper_.write(*object);
+                    metrics_.released_count += 1;
+                }
+            });
+        }
+
+        metrics_.applied_count += operation_grouper_.retired_increments().size() + operation_grouper_.retired_decrements().size();
+        metrics_.apply_duration += std::chrono::steady_clock::now() - apply_start;
+
+        if (UNLIKELY(heap_census_) && heap_census_->is_sampled(cycle_)) {
+            sample_heap_census();
+        }
+
+        operation_grouper_.clear_retired();
+    }
+
     MANTLE_SOURCE_INLINE
     auto RegionController::send_message() -> std::optional<Message> {
         switch (phase_) {
@@ -205,6 +528,19 @@ namespace mantle {
             case Phase::ENTER: {
                 transition(Phase::SUBMIT);
 
+                if (is_detached()) {
+                    // Nobody is left to answer, so submit nothing on the region's behalf.
+                    submitted_increments_ = EMPTY_SEQUENCE_RANGE;
+                    submitted_decrements_ = EMPTY_SEQUENCE_RANGE;
+                    submitted_increment_partition_ = nullptr;
+                    submitted_decrement_partition_ = nullptr;
+                    submitted_increment_spill_ = nullptr;
+                    submitted_decrement_spill_ = nullptr;
+                    submitted_barrier_ = nullptr;
+                    transition(Phase::SUBMIT_BARRIER);
+                    break;
+                }
+
                 return Message {
                     .enter = {
                         .type  = MessageType::ENTER,
@@ -224,15 +560,31 @@ namespace mantle {
             case Phase::RETIRE: {
                 transition(Phase::LEAVE);
 
+                // Every controller has finished routing this cycle's operations to us.
+                if (is_pipelined()) {
+                    retire_operations();
+                }
+
+                const ObjectGroups garbage = object_grouper_.flush();
+                if (UNLIKELY(heap_census_)) {
+                    heap_census_->add_garbage(cycle_, garbage);
+                }
+
                 return Message {
                     .retire = {
                         .type    = MessageType::RETIRE,
-                        .garbage = object_grouper_.flush(),
+                        .garbage = garbage,
                     },
                 };
             }
             case Phase::LEAVE: {
+                const bool detached = is_detached();
+
                 transition(Phase::START);
+                if (detached) {
+                    break;
+                }
+
                 if (state_ == State::STOPPED) {
                     transition(State::SHUTDOWN);
                 }
@@ -254,12 +606,17 @@ namespace mantle {
         switch (phase_) {
             case Phase::START: {
                 if (message.type == MessageType::START) {
+                    set_start_urgent(start_urgent_ || message.start.urgent);
                     transition(Phase::START_BARRIER);
                 }
                 break;
             }
             case Phase::START_BARRIER: {
-                break; // Redundant start messages are dropped.
+                // Redundant start messages are dropped, but they can still make the start urgent.
+                if (message.type == MessageType::START) {
+                    set_start_urgent(start_urgent_ || message.start.urgent);
+                }
+                break;
             }
             case Phase::ENTER: {
                 break; // Redundant start messages are dropped.
@@ -284,6 +641,30 @@ namespace mantle {
 
                     submitted_increments_ = message.submit.increments;
                     submitted_decrements_ = message.submit.decrements;
+                    metrics_.ledger_occupancy = submitted_increments_.tail - submitted_decrements_.head;
+                    metrics_.finalized_count = message.submit.finalized_count;
+                    metrics_.bound_count = message.submit.bound_count;
+                    metrics_.local_released_count = message.submit.released_count;
+                    if (heap_census_ && message.submit.heap_census) {
+                        heap_census_->add(cycle_, *message.submit.heap_census);
+                    }
+                    if ((submitted_increments_.size() != 0) || (submitted_decrements_.size() != 0)) {
+                        active_cycle_ = cycle_;
+                    }
+                    submitted_increment_partition_ = message.submit.increment_partition;
+                    submitted_decrement_partition_ = message.submit.decrement_partition;
+                    submitted_increment_spill_ = message.submit.increment_spill;
+                    submitted_decrement_spill_ = message.submit.decrement_spill;
+                    if (submitted_increment_spill_ && !submitted_increment_spill_->increments.empty()) {
+                        active_cycle_ = cycle_;
+                    }
+                    if (submitted_decrement_spill_ && !submitted_decrement_spill_->decrements.empty()) {
+                        active_cycle_ = cycle_;
+                    }
+                    submitted_barrier_ = message.submit.barrier;
+                    if (submitted_barrier_ && ((submitted_barrier_->increment_count() != 0) || (submitted_barrier_->decrement_count() != 0))) {
+                        active_cycle_ = cycle_;
+                    }
                 }
                 break; // Redundant start messages are dropped.
             }
@@ -304,7 +685,7 @@ namespace mantle {
 
     MANTLE_SOURCE_INLINE
     void RegionController::synchronize(const RegionControllerCensus& census) {
-        Phase next_phase = next(phase_);
+        Phase next_phase = this->next_phase();
         Action next_action = to_action(next_phase);
 
         if (census.all(Action::BARRIER_ALL) || census.all(Action::BARRIER_ANY)) {
@@ -318,13 +699,26 @@ namespace mantle {
         }
     }
 
+    MANTLE_SOURCE_INLINE
+    void RegionController::track(RegionControllerCensus& census) {
+        assert(!census_);
+
+        census.add(*this);
+        census_ = &census;
+    }
+
     MANTLE_SOURCE_INLINE
     void RegionController::transition(State next_state) {
         if (state_ == next_state) {
             return;
         }
 
+        if (census_) {
+            census_->update(state_, next_state);
+        }
+
         debug("[region_controller:{}] transition state {} to {}", region_id_, to_string(state_), to_string(next_state));
+        trace(TraceSource::CONTROLLER, region_id_, TraceEventType::STATE, static_cast<uint32_t>(next_state));
         state_ = next_state;
     }
 
@@ -334,6 +728,12 @@ namespace mantle {
             return;
         }
 
+        {
+            const auto now = std::chrono::steady_clock::now();
+            metrics_.phase_durations[static_cast<size_t>(phase_)] += now - phase_start_;
+            phase_start_ = now;
+        }
+
         switch (phase_) {
             case Phase::START: {
                 // Some region asked the domain to start a coherence cycle.
@@ -341,6 +741,7 @@ namespace mantle {
             }
             case Phase::START_BARRIER: {
                 // All controllers have started.
+                set_start_urgent(false);
                 break;
             }
             case Phase::ENTER: {
@@ -352,42 +753,24 @@ namespace mantle {
                 break;
             }
             case Phase::SUBMIT_BARRIER: {
-                // We are waiting for all regions to respond.
-                // NOTE: This phase can be combined with the next if we double buffer retired operations.
-                metrics_.increment_count += route_operations(
-                    OperationType::INCREMENT,
-                    submitted_increments_
-                );
-                metrics_.decrement_count += route_operations(
-                    OperationType::DECREMENT,
-                    submitted_decrements_
-                );
+                // We are waiting for all regions to respond. When cycles are pipelined, the operations
+                // routed in the previous cycle are applied now, while this cycle's are being routed.
+                if (!has_worker_pool()) {
+                    if (is_pipelined()) {
+                        apply_operations();
+                    }
+
+                    route_submitted_operations([](RegionController& controller, const Operation operation) {
+                        controller.operation_grouper_.write(operation, true);
+                    });
+                }
                 break;
             }
             case Phase::RETIRE_BARRIER: {
-                // All submitted operations have been routed. Flush and apply operations.
-                const bool force = (state_ == State::STOPPING) || (state_ == State::STOPPED);
-                operation_grouper_.flush(force);
-
-                // Increments first to avoid premature death.
-                for (auto&& [object, delta]: operation_grouper_.increments()) {
-                    assert(delta >= 0);
-                    const auto delta_magnitude = static_cast<uint32_t>(+delta);
-                    if (!object->apply_increment(delta_magnitude)) {
-                        abort();
-                    }
-                }
-
-                // Apply decrements and group dead objects for finalization.
-                for (auto&& [object, delta]: operation_grouper_.decrements()) {
-                    assert(delta <= 0);
-                    const auto delta_magnitude = static_cast<uint32_t>(-delta);
-                    if (!object->apply_decrement(delta_magnitude)) {
-                        object_grouper_.write(*object);
-                    }
+                assert(!is_pipelined());
+                if (!has_worker_pool()) {
+                    apply_operations();
                 }
-
-                operation_grouper_.clear();
                 break;
             }
             case Phase::RETIRE: {
@@ -395,11 +778,17 @@ namespace mantle {
             }
             case Phase::LEAVE: {
                 transition(cycle_ + 1);
+                metrics_.cycle_count += 1;
                 break;
             }
         }
 
+        if (census_) {
+            census_->update(phase_, next_phase);
+        }
+
         debug("[region_controller:{}] transition phase {} to {}", region_id_, to_string(phase_), to_string(next_phase));
+        trace(TraceSource::CONTROLLER, region_id_, TraceEventType::PHASE, static_cast<uint32_t>(next_phase), cycle_);
         phase_ = next_phase;
     }
 
@@ -409,23 +798,64 @@ namespace mantle {
             return;
         }
 
+        if (census_) {
+            census_->update(cycle_, next_cycle);
+        }
+
         debug("[region_controller:{}] transition cycle {} to {}", region_id_, cycle_, next_cycle);
+        trace(TraceSource::CONTROLLER, region_id_, TraceEventType::CYCLE, 0, next_cycle);
         cycle_ = next_cycle;
     }
 
     MANTLE_SOURCE_INLINE
-    size_t RegionController::route_operations(const OperationType type, SequenceRange range) {
+    void RegionController::set_start_urgent(const bool urgent) {
+        if (start_urgent_ == urgent) {
+            return;
+        }
+
+        if (census_) {
+            census_->update_urgent(start_urgent_, urgent);
+        }
+
+        start_urgent_ = urgent;
+    }
+
+    MANTLE_SOURCE_INLINE
+    auto RegionController::next_phase() const -> Phase {
+        const Phase phase = next(phase_);
+        if (is_pipelined() && (phase == Phase::RETIRE_BARRIER)) {
+            return next(phase);
+        }
+
+        return phase;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void RegionController::retire_operations() {
+        if (has_worker_pool()) {
+            // Workers keep routing into the other side of each inbox.
+            for (Inbox& inbox: inboxes_) {
+                assert(inbox.retired_operations.empty());
+                inbox.operations.swap(inbox.retired_operations);
+            }
+        }
+        else {
+            operation_grouper_.retire(is_flush_forced());
+        }
+    }
+
+    template<typename Sink>
+    size_t RegionController::route_operations(const OperationType type, SequenceRange range, Sink&& sink) {
         size_t count = 0;
 
-        for (Sequence sequence = range.head; sequence != range.tail; ++sequence) {
-            Operation operation = ledger_.read(sequence);
+        ledger_->for_each_operation(range, [&](const Operation operation) {
             if (type != operation.type()) {
-                continue;
+                return;
             }
 
             const Object* object = operation.object();
             if (!object) {
-                continue;
+                return;
             }
 
             const RegionId region_id = object->region_id();
@@ -433,15 +863,157 @@ namespace mantle {
                 abort();
             }
 
-            RegionController& controller = *controllers_[region_id];
-            controller.operation_grouper_.write(operation, true);
+            sink(*controllers_[region_id], operation);
 
             count += 1;
+        });
+
+        return count;
+    }
+
+    template<typename Sink>
+    size_t RegionController::route_operations(const OperationType type, const OperationPartition& partition, Sink&& sink) {
+        size_t count = 0;
+
+        // Like an operation on an unbound object in the ledger, which has nowhere to go.
+        if (UNLIKELY(partition.unowned_count() != 0)) {
+            abort();
+        }
+
+        for (RegionId region_id = 0; region_id < partition.region_count(); ++region_id) {
+            const std::span<const Operation> operations = partition.slice(region_id, type);
+            if (operations.empty()) {
+                continue;
+            }
+
+            if (UNLIKELY(region_id >= controllers_.size())) {
+                abort();
+            }
+
+            RegionController& controller = *controllers_[region_id];
+            for (const Operation operation: operations) {
+                sink(controller, operation);
+            }
+
+            count += operations.size();
         }
 
         return count;
     }
 
+    template<typename Sink>
+    size_t RegionController::route_operations(const std::span<const Operation> operations, Sink&& sink) {
+        for (const Operation operation: operations) {
+            const RegionId region_id = operation.object()->region_id();
+            if (UNLIKELY(region_id >= controllers_.size())) {
+                abort();
+            }
+
+            sink(*controllers_[region_id], operation);
+        }
+
+        return operations.size();
+    }
+
+    template<typename Sink>
+    void RegionController::route_submitted_operations(Sink&& sink) {
+        LedgerRecorder* recorder = config_.ledger_recorder;
+        if (LIKELY(!recorder)) {
+            route_committed_operations(sink);
+            return;
+        }
+
+        route_committed_operations([this, recorder, &sink](RegionController& controller, const Operation operation) {
+            recorder->record_operation(region_id_, cycle_, operation, controller.region_id_);
+            sink(controller, operation);
+        });
+    }
+
+    template<typename Sink>
+    void RegionController::route_committed_operations(Sink&& sink) {
+        const size_t previous_count = metrics_.increment_count + metrics_.decrement_count;
+
+        if (submitted_increment_partition_) {
+            metrics_.increment_count += route_operations(OperationType::INCREMENT, *submitted_increment_partition_, sink);
+        }
+        else {
+            metrics_.increment_count += route_operations(OperationType::INCREMENT, submitted_increments_, sink);
+        }
+
+        if (submitted_decrement_partition_) {
+            metrics_.decrement_count += route_operations(OperationType::DECREMENT, *submitted_decrement_partition_, sink);
+        }
+        else {
+            metrics_.decrement_count += route_operations(OperationType::DECREMENT, submitted_decrements_, sink);
+        }
+
+        // Spilled operations are never null, and are already split by type.
+        if (submitted_increment_spill_) {
+            metrics_.increment_count += route_operations(std::span<const Operation>(submitted_increment_spill_->increments), sink);
+        }
+
+        if (submitted_decrement_spill_) {
+            metrics_.decrement_count += route_operations(std::span<const Operation>(submitted_decrement_spill_->decrements), sink);
+        }
+
+        // Operations recorded by `Ref`s are tagged with their type, and each segment holds both.
+        if (submitted_barrier_) {
+            submitted_barrier_->for_each_segment([&](const WriteBarrierSegment& segment) {
+                metrics_.increment_count += segment.increment_count;
+                metrics_.decrement_count += segment.decrement_count;
+                route_operations(segment.committed_operations(), sink);
+            });
+        }
+
+        trace(TraceSource::CONTROLLER, region_id_, TraceEventType::ROUTE, 0, metrics_.increment_count + metrics_.decrement_count - previous_count);
+    }
+
+    MANTLE_SOURCE_INLINE
+    void RegionController::record_release(const Object& object) {
+        if (UNLIKELY(config_.ledger_recorder)) {
+            config_.ledger_recorder->record_release(region_id_, object);
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    void RegionController::sample_heap_census() {
+        HeapCensus& census = *heap_census_;
+
+        // Objects that died are already on their way to the object grouper, and are counted with it.
+        const auto reference_count = [this](const Object& object) -> uint64_t {
+            const uint32_t count = reference_count_table_ ? reference_count_table_->count(object.reference_count_slot()) : object.reference_count_;
+            return uint64_t{count} + 1;
+        };
+
+        for (const auto& [object, delta]: operation_grouper_.retired_decrements()) {
+            census.add_decremented(*object);
+            if (object->is_managed()) {
+                census.add_survivor(*object, reference_count(*object));
+            }
+        }
+
+        for (const auto& [object, delta]: operation_grouper_.retired_increments()) {
+            if (object->is_managed()) {
+                census.add_survivor(*object, reference_count(*object));
+            }
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool RegionController::has_worker_pool() const {
+        return !inboxes_.empty();
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool RegionController::is_pipelined() const {
+        return config_.pipeline_cycles;
+    }
+
+    MANTLE_SOURCE_INLINE
+    bool RegionController::is_flush_forced() const {
+        return (state_ != State::STARTING) && (state_ != State::RUNNING);
+    }
+
     MANTLE_SOURCE_INLINE
     RegionControllerCensus synchronize(RegionControllerGroup& controllers) {
         RegionControllerCensus old_census;
@@ -461,6 +1033,29 @@ namespace mantle {
         return new_census;
     }
 
+    MANTLE_SOURCE_INLINE
+    bool can_synchronize(const RegionControllerCensus& cluster, const RegionControllerCensus& census) {
+        using Phase = RegionControllerPhase;
+        using Action = RegionControllerAction;
+
+        // These mirror the conditions in `RegionController::synchronize`. Pipelined cycles skip
+        // RETIRE_BARRIER, but neither it nor the phase after it waits on any controller, so the
+        // plain order of phases is enough here.
+        if (census.all(Action::BARRIER_ALL) || census.all(Action::BARRIER_ANY)) {
+            return cluster.count() > 0;
+        }
+
+        for (size_t i = 0; i < REGION_CONTROLLER_PHASE_COUNT; ++i) {
+            const Phase phase = static_cast<Phase>(i);
+            const Phase next_phase = next(phase);
+            if (cluster.any(phase) && (to_action(next_phase) == Action::BARRIER_ANY) && census.any(next_phase)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
     MANTLE_SOURCE_INLINE
     std::string_view to_string(RegionControllerState state) {
         using namespace std::literals;
@@ -0,0 +1,62 @@
+#include "mantle/region_pool.h"
+#include "mantle/domain.h"
+#include "mantle/object_finalizer.h"
+
+namespace mantle {
+
+    MANTLE_SOURCE_INLINE
+    RegionPool::RegionPool(Domain& domain, ObjectFinalizer& finalizer, const size_t capacity)
+        : domain_(domain)
+        , finalizer_(finalizer)
+        , capacity_(capacity)
+    {
+        parked_.reserve(capacity_);
+    }
+
+    MANTLE_SOURCE_INLINE
+    RegionPool::~RegionPool() = default;
+
+    MANTLE_SOURCE_INLINE
+    auto RegionPool::acquire() -> Lease {
+        std::unique_ptr<Region> region;
+        {
+            std::scoped_lock lock(mutex_);
+            if (!parked_.empty()) {
+                region = std::move(parked_.back());
+                parked_.pop_back();
+            }
+        }
+
+        if (!region) {
+            return { *this, std::make_unique<Region>(domain_, finalizer_) };
+        }
+
+        try {
+            region->adopt();
+        }
+        catch (...) {
+            release(std::move(region));
+            throw;
+        }
+
+        return { *this, std::move(region) };
+    }
+
+    MANTLE_SOURCE_INLINE
+    size_t RegionPool::parked_count() const {
+        std::scoped_lock lock(mutex_);
+
+        return parked_.size();
+    }
+
+    MANTLE_SOURCE_INLINE
+    void RegionPool::release(std::unique_ptr<Region> region) {
+        region->park();
+
+        std::scoped_lock lock(mutex_);
+        if (parked_.size() < capacity_) {
+            parked_.push_back(std::move(region));
+        }
+    }
+
+}
@@ -1,6 +1,8 @@
 #include "mantle/selector.h"
 #include "mantle/config.h"
 #include <stdexcept>
+#include <algorithm>
+#include <climits>
 #include <cstring>
 #include <cassert>
 #include <unistd.h>
@@ -25,13 +27,34 @@ namespace mantle {
         epoll_fd_ = -1;
     }
 
+    MANTLE_SOURCE_INLINE
+    int Selector::file_descriptor() const {
+        return epoll_fd_;
+    }
+
     MANTLE_SOURCE_INLINE
     std::span<void*> Selector::poll(bool non_blocking) {
+        if (non_blocking) {
+            return poll(std::chrono::nanoseconds::zero());
+        }
+
+        return poll(std::nullopt);
+    }
+
+    MANTLE_SOURCE_INLINE
+    std::span<void*> Selector::poll(const std::optional<std::chrono::nanoseconds> timeout) {
         std::array<struct epoll_event, MAX_EVENT_COUNT> events;
 
+        // Round up to whole milliseconds so we never wake up before the timeout.
+        int timeout_ms = -1;
+        if (timeout) {
+            const auto milliseconds = std::chrono::ceil<std::chrono::milliseconds>(std::max(*timeout, std::chrono::nanoseconds::zero()));
+            timeout_ms = static_cast<int>(std::min<std::chrono::milliseconds::rep>(milliseconds.count(), INT_MAX));
+        }
+
         int event_count = 0;
         do {
-            event_count = epoll_wait(epoll_fd_, events.data(), events.size(), non_blocking ? 0 : -1);
+            event_count = epoll_wait(epoll_fd_, events.data(), events.size(), timeout_ms);
         } while ((event_count < 0) && (errno == EINTR));
 
         if (event_count < 0) {
@@ -0,0 +1,219 @@
+#include "mantle/topology.h"
+#include "mantle/util.h"
+#include <map>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+#include <cctype>
+#include <sched.h>
+
+namespace mantle {
+
+    inline std::optional<std::string> read_sysfs_line(const std::string& path) {
+        std::ifstream stream(path);
+
+        std::string line;
+        if (!std::getline(stream, line)) {
+            return std::nullopt;
+        }
+
+        return line;
+    }
+
+    // The CPUs that are online and that this process is allowed to run on.
+    inline std::vector<size_t> usable_cpus() {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+            throw std::runtime_error("Failed to get cpu affinity");
+        }
+
+        std::vector<size_t> cpus;
+        if (const std::optional<std::string> online = read_sysfs_line("/sys/devices/system/cpu/online")) {
+            cpus = parse_cpu_list(*online);
+        }
+        else {
+            for (size_t cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        }
+
+        std::erase_if(cpus, [&](const size_t cpu) {
+            return (cpu >= CPU_SETSIZE) || !CPU_ISSET(cpu, &allowed);
+        });
+
+        return cpus;
+    }
+
+    // The CPUs that share the highest level data or unified cache of this one.
+    inline std::optional<std::string> last_level_cache(const size_t cpu) {
+        std::optional<std::string> shared_cpus;
+        size_t shared_level = 0;
+
+        for (size_t index = 0;; ++index) {
+            const std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/cache/index" + std::to_string(index) + "/";
+
+            const std::optional<std::string> level = read_sysfs_line(path + "level");
+            if (!level) {
+                break;
+            }
+
+            if (read_sysfs_line(path + "type") == "Instruction") {
+                continue;
+            }
+
+            const size_t value = std::stoul(*level);
+            if (const std::optional<std::string> list = read_sysfs_line(path + "shared_cpu_list"); list && (value >= shared_level)) {
+                shared_cpus = list;
+                shared_level = value;
+            }
+        }
+
+        return shared_cpus;
+    }
+
+    inline std::map<size_t, size_t> numa_nodes_by_cpu() {
+        std::map<size_t, size_t> nodes;
+
+        std::error_code error;
+        for (const std::filesystem::directory_entry& entry: std::filesystem::directory_iterator("/sys/devices/system/node", error)) {
+            const std::string name = entry.path().filename().string();
+            if (!name.starts_with("node") || (name.size() == 4) || !std::all_of(name.begin() + 4, name.end(), [](const char c) { return std::isdigit(static_cast<unsigned char>(c)) != 0; })) {
+                continue;
+            }
+
+            const size_t node = std::stoul(name.substr(4));
+            if (const std::optional<std::string> list = read_sysfs_line(entry.path().string() + "/cpulist")) {
+                for (const size_t cpu: parse_cpu_list(*list)) {
+                    nodes[cpu] = node;
+                }
+            }
+        }
+
+        return nodes;
+    }
+
+    MANTLE_SOURCE_INLINE
+    CpuTopology::CpuTopology(std::vector<CacheGroup> groups)
+        : groups_(std::move(groups))
+    {
+        std::erase_if(groups_, [](const CacheGroup& group) { return group.cpus.empty(); });
+
+        for (CacheGroup& group: groups_) {
+            std::sort(group.cpus.begin(), group.cpus.end());
+        }
+
+        std::sort(groups_.begin(), groups_.end(), [](const CacheGroup& lhs, const CacheGroup& rhs) {
+            return lhs.cpus.front() < rhs.cpus.front();
+        });
+    }
+
+    MANTLE_SOURCE_INLINE
+    CpuTopology CpuTopology::detect() {
+        const std::map<size_t, size_t> nodes = numa_nodes_by_cpu();
+
+        // Keyed by the list of CPUs sharing the cache, including ones we can't use.
+        std::map<std::string, CacheGroup> groups;
+        for (const size_t cpu: usable_cpus()) {
+            const std::string key = last_level_cache(cpu).value_or("cpu" + std::to_string(cpu));
+
+            CacheGroup& group = groups[key];
+            group.cpus.push_back(cpu);
+
+            if (!group.numa_node) {
+                if (auto it = nodes.find(cpu); it != nodes.end()) {
+                    group.numa_node = it->second;
+                }
+            }
+        }
+
+        if (groups.empty()) {
+            throw std::runtime_error("Failed to find any usable cpus");
+        }
+
+        std::vector<CacheGroup> cache_groups;
+        for (auto& [key, group]: groups) {
+            cache_groups.push_back(std::move(group));
+        }
+
+        return CpuTopology(std::move(cache_groups));
+    }
+
+    MANTLE_SOURCE_INLINE
+    std::span<const CacheGroup> CpuTopology::cache_groups() const {
+        return groups_;
+    }
+
+    MANTLE_SOURCE_INLINE
+    size_t CpuTopology::cpu_count() const {
+        size_t count = 0;
+        for (const CacheGroup& group: groups_) {
+            count += group.cpus.size();
+        }
+
+        return count;
+    }
+
+    MANTLE_SOURCE_INLINE
+    ThreadPlacement::ThreadPlacement(const CpuTopology& topology, const size_t domain_cpu_count)
+        : next_thread_index_(0)
+    {
+        const std::span<const CacheGroup> groups = topology.cache_groups();
+        if (groups.empty()) {
+            throw std::runtime_error("Cannot place threads without any cpus");
+        }
+
+        // The first of the largest groups, since that's where most region threads will go.
+        const CacheGroup& domain_group = *std::max_element(groups.begin(), groups.end(), [](const CacheGroup& lhs, const CacheGroup& rhs) {
+            return lhs.cpus.size() < rhs.cpus.size();
+        });
+
+        const size_t count = std::clamp<size_t>(domain_cpu_count, 1, domain_group.cpus.size());
+        domain_cpus_.assign(domain_group.cpus.end() - count, domain_group.cpus.end());
+        domain_numa_node_ = domain_group.numa_node;
+
+        thread_cpus_.assign(domain_group.cpus.begin(), domain_group.cpus.end() - count);
+        for (const bool same_node: {true, false}) {
+            for (const CacheGroup& group: groups) {
+                if ((&group != &domain_group) && ((group.numa_node == domain_numa_node_) == same_node)) {
+                    thread_cpus_.insert(thread_cpus_.end(), group.cpus.begin(), group.cpus.end());
+                }
+            }
+        }
+
+        if (thread_cpus_.empty()) {
+            thread_cpus_ = domain_cpus_;
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    std::span<const size_t> ThreadPlacement::domain_cpus() const {
+        return domain_cpus_;
+    }
+
+    MANTLE_SOURCE_INLINE
+    std::optional<size_t> ThreadPlacement::domain_numa_node() const {
+        return domain_numa_node_;
+    }
+
+    MANTLE_SOURCE_INLINE
+    std::span<const size_t> ThreadPlacement::thread_cpus() const {
+        return thread_cpus_;
+    }
+
+    MANTLE_SOURCE_INLINE
+    size_t ThreadPlacement::next_thread_cpu() {
+        const size_t index = next_thread_index_.fetch_add(1, std::memory_order_relaxed);
+        return thread_cpus_[index % thread_cpus_.size()];
+    }
+
+    MANTLE_SOURCE_INLINE
+    size_t ThreadPlacement::place_thread() {
+        const size_t cpu = next_thread_cpu();
+        set_cpu_affinity({&cpu, 1});
+        return cpu;
+    }
+
+}
@@ -0,0 +1,219 @@
+#include "mantle/trace.h"
+#include "mantle/message.h"
+#include "mantle/region.h"
+#include "mantle/region_controller.h"
+#include <fmt/core.h>
+#include <mutex>
+#include <string>
+#include <algorithm>
+#include <unordered_set>
+#include <cstdlib>
+
+namespace mantle {
+
+    // Every ring that has been created, so that rings of threads that have exited can still be read,
+    // and the ones that no thread is writing to anymore.
+    struct TraceRegistry {
+        std::mutex                              mutex;
+        std::vector<std::unique_ptr<TraceRing>> rings;
+        std::vector<TraceRing*>                 free_rings;
+    };
+
+    inline TraceRegistry& trace_registry() {
+        static TraceRegistry registry;
+        return registry;
+    }
+
+    // Regions and controllers are shown as threads of two separate processes.
+    inline int to_trace_process_id(const TraceSource source) {
+        return (source == TraceSource::REGION) ? 1 : 2;
+    }
+
+    inline uint32_t to_trace_track_key(const TraceEvent& event) {
+        return (static_cast<uint32_t>(event.source) << 16) | event.region_id;
+    }
+
+    inline std::string_view to_trace_phase_name(const TraceEvent& event) {
+        if (event.source == TraceSource::REGION) {
+            return to_string(static_cast<RegionPhase>(event.argument));
+        }
+        else {
+            return to_string(static_cast<RegionControllerPhase>(event.argument));
+        }
+    }
+
+    inline std::string_view to_trace_state_name(const TraceEvent& event) {
+        if (event.source == TraceSource::REGION) {
+            return to_string(static_cast<RegionState>(event.argument));
+        }
+        else {
+            return to_string(static_cast<RegionControllerState>(event.argument));
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    TraceRing::Owner::Owner() {
+        TraceRegistry& registry = trace_registry();
+        std::scoped_lock lock(registry.mutex);
+
+        // The events of the thread that gave the ring back are kept until they are overwritten.
+        if (!registry.free_rings.empty()) {
+            ring_ = registry.free_rings.back();
+            registry.free_rings.pop_back();
+            return;
+        }
+
+        registry.rings.push_back(std::make_unique<TraceRing>(TRACE_RING_CAPACITY));
+        ring_ = registry.rings.back().get();
+    }
+
+    MANTLE_SOURCE_INLINE
+    TraceRing::Owner::~Owner() {
+        TraceRegistry& registry = trace_registry();
+        std::scoped_lock lock(registry.mutex);
+        registry.free_rings.push_back(ring_);
+    }
+
+    MANTLE_SOURCE_INLINE
+    void TraceRing::snapshot(std::vector<TraceEvent>& events) const {
+        // The oldest slot is skipped once the ring is full, as the next event may be going into it.
+        const Sequence tail = head_.load(std::memory_order_acquire);
+        const Sequence head = (tail >= capacity()) ? (tail - capacity() + 1) : 0;
+
+        const size_t offset = events.size();
+        for (Sequence sequence = head; sequence != tail; ++sequence) {
+            events.push_back(events_[sequence]);
+        }
+
+        // Nothing was recorded while we were copying, so nothing can be torn.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const Sequence after = head_.load(std::memory_order_relaxed);
+        if (after == tail) {
+            return;
+        }
+
+        // Otherwise drop whatever was overwritten since, which includes the slot of the event at
+        // `after`, since events are written before the head moves past them.
+        if ((after + 1) > (head + capacity())) {
+            const size_t discard = std::min(after + 1 - capacity() - head, tail - head);
+            events.erase(events.begin() + offset, events.begin() + offset + discard);
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    size_t trace_ring_count() {
+        TraceRegistry& registry = trace_registry();
+        std::scoped_lock lock(registry.mutex);
+        return registry.rings.size();
+    }
+
+    MANTLE_SOURCE_INLINE
+    std::vector<TraceEvent> collect_trace() {
+        std::vector<TraceEvent> events;
+        {
+            TraceRegistry& registry = trace_registry();
+            std::scoped_lock lock(registry.mutex);
+
+            for (const std::unique_ptr<TraceRing>& ring: registry.rings) {
+                ring->snapshot(events);
+            }
+        }
+
+        std::stable_sort(events.begin(), events.end(), [](const TraceEvent& lhs, const TraceEvent& rhs) {
+            return lhs.timestamp < rhs.timestamp;
+        });
+
+        return events;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void write_chrome_trace(std::ostream& stream) {
+        const std::vector<TraceEvent> events = collect_trace();
+        write_chrome_trace(stream, events);
+    }
+
+    MANTLE_SOURCE_INLINE
+    void write_chrome_trace(std::ostream& stream, const std::span<const TraceEvent> events) {
+        const uint64_t origin = events.empty() ? 0 : events.front().timestamp;
+
+        bool first = true;
+        auto emit = [&](const std::string& line) {
+            stream << (first ? "\n" : ",\n") << line;
+            first = false;
+        };
+
+        stream << "{\"traceEvents\":[";
+
+        emit(R"({"name":"process_name","ph":"M","pid":1,"args":{"name":"regions"}})");
+        emit(R"({"name":"process_name","ph":"M","pid":2,"args":{"name":"region controllers"}})");
+
+        std::unordered_set<uint32_t> named_tracks;
+        std::unordered_set<uint32_t> open_tracks;
+        for (const TraceEvent& event: events) {
+            const uint32_t track = to_trace_track_key(event);
+            const int pid = to_trace_process_id(event.source);
+            const RegionId tid = event.region_id;
+            const double ts = static_cast<double>(event.timestamp - origin) / 1000.0;
+
+            if (named_tracks.insert(track).second) {
+                const std::string_view prefix = (event.source == TraceSource::REGION) ? "region" : "region_controller";
+                emit(fmt::format(R"({{"name":"thread_name","ph":"M","pid":{},"tid":{},"args":{{"name":"{}:{}"}}}})", pid, tid, prefix, tid));
+            }
+
+            switch (event.type) {
+                case TraceEventType::PHASE: {
+                    // Each phase is a slice that ends when the next one begins.
+                    if (open_tracks.erase(track)) {
+                        emit(fmt::format(R"({{"ph":"E","ts":{:.3f},"pid":{},"tid":{}}})", ts, pid, tid));
+                    }
+
+                    emit(fmt::format(R"({{"name":"{}","cat":"phase","ph":"B","ts":{:.3f},"pid":{},"tid":{},"args":{{"cycle":{}}}}})",
+                        to_trace_phase_name(event), ts, pid, tid, event.value));
+                    open_tracks.insert(track);
+                    break;
+                }
+                case TraceEventType::STATE: {
+                    emit(fmt::format(R"({{"name":"{}","cat":"state","ph":"i","s":"t","ts":{:.3f},"pid":{},"tid":{}}})",
+                        to_trace_state_name(event), ts, pid, tid));
+                    break;
+                }
+                case TraceEventType::CYCLE: {
+                    emit(fmt::format(R"({{"name":"CYCLE","cat":"cycle","ph":"i","s":"t","ts":{:.3f},"pid":{},"tid":{},"args":{{"cycle":{}}}}})",
+                        ts, pid, tid, event.value));
+                    break;
+                }
+                case TraceEventType::SEND:
+                case TraceEventType::RECEIVE: {
+                    emit(fmt::format(R"({{"name":"{} {}","cat":"message","ph":"i","s":"t","ts":{:.3f},"pid":{},"tid":{}}})",
+                        to_string(event.type), to_string(static_cast<MessageType>(event.argument)), ts, pid, tid));
+                    break;
+                }
+                case TraceEventType::ROUTE:
+                case TraceEventType::FINALIZE: {
+                    emit(fmt::format(R"({{"name":"{}","cat":"work","ph":"i","s":"t","ts":{:.3f},"pid":{},"tid":{},"args":{{"count":{}}}}})",
+                        to_string(event.type), ts, pid, tid, event.value));
+                    break;
+                }
+            }
+        }
+
+        stream << "\n]}\n";
+    }
+
+    MANTLE_SOURCE_INLINE
+    std::string_view to_string(TraceEventType type) {
+        using namespace std::literals;
+
+        switch (type) {
+#define X(MANTLE_TRACE_EVENT_TYPE)                        \
+            case TraceEventType::MANTLE_TRACE_EVENT_TYPE: \
+                return #MANTLE_TRACE_EVENT_TYPE ##sv;     \
+
+            MANTLE_TRACE_EVENT_TYPES(X)
+#undef X
+        }
+
+        abort(); // Unreachable.
+    }
+
+}
@@ -0,0 +1,101 @@
+#include "mantle/worker_pool.h"
+#include "mantle/util.h"
+#include <cassert>
+
+namespace mantle {
+
+    MANTLE_SOURCE_INLINE
+    WorkerPool::WorkerPool(const size_t helper_thread_count, const std::span<const size_t> cpu_affinity)
+        : function_(nullptr)
+        , context_(nullptr)
+        , task_count_(0)
+        , stopping_(false)
+        , generation_(0)
+        , next_task_(0)
+        , busy_count_(0)
+    {
+        threads_.reserve(helper_thread_count);
+        for (size_t i = 0; i < helper_thread_count; ++i) {
+            threads_.emplace_back([this, worker_index = i + 1, cpus = std::vector<size_t>(cpu_affinity.begin(), cpu_affinity.end())]() {
+                if (!cpus.empty()) {
+                    set_cpu_affinity(cpus);
+                }
+
+                helper_main(worker_index);
+            });
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    WorkerPool::~WorkerPool() {
+        stopping_.store(true, std::memory_order_release);
+        generation_.fetch_add(1, std::memory_order_acq_rel);
+        generation_.notify_all();
+
+        for (std::thread& thread: threads_) {
+            thread.join();
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    size_t WorkerPool::worker_count() const {
+        return threads_.size() + 1;
+    }
+
+    MANTLE_SOURCE_INLINE
+    void WorkerPool::run(const size_t task_count, const TaskFunction function, void* context) {
+        assert(busy_count_.load(std::memory_order_acquire) == 0);
+
+        function_   = function;
+        context_    = context;
+        task_count_ = task_count;
+        next_task_.store(0, std::memory_order_relaxed);
+
+        if (!threads_.empty()) {
+            // Publish the job and wake up the helpers.
+            busy_count_.store(threads_.size(), std::memory_order_relaxed);
+            generation_.fetch_add(1, std::memory_order_acq_rel);
+            generation_.notify_all();
+        }
+
+        work(0);
+
+        // Wait for the helpers to finish their share of the tasks.
+        for (size_t busy_count; (busy_count = busy_count_.load(std::memory_order_acquire)) != 0;) {
+            busy_count_.wait(busy_count, std::memory_order_acquire);
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    void WorkerPool::work(const size_t worker_index) {
+        while (true) {
+            const size_t task_index = next_task_.fetch_add(1, std::memory_order_relaxed);
+            if (task_index >= task_count_) {
+                return;
+            }
+
+            function_(context_, task_index, worker_index);
+        }
+    }
+
+    MANTLE_SOURCE_INLINE
+    void WorkerPool::helper_main(const size_t worker_index) {
+        uint64_t generation = 0;
+
+        while (true) {
+            generation_.wait(generation, std::memory_order_acquire);
+            generation = generation_.load(std::memory_order_acquire);
+
+            if (stopping_.load(std::memory_order_acquire)) {
+                return;
+            }
+
+            work(worker_index);
+
+            if (busy_count_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                busy_count_.notify_one();
+            }
+        }
+    }
+
+}
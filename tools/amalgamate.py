@@ -14,6 +14,8 @@ HEADER_EXTENSIONS = {'.h', '.hpp'}
 
 PRAGMA_ONCE_PATTERN = r'^#\s*pragma\s*once\s*$'
 EXTERNAL_INCLUDE_PATTERN = r'^#\s*include\s*<(.+)>\s*$'
+CONDITIONAL_BEGIN_PATTERN = r'^\s*#\s*if'
+CONDITIONAL_END_PATTERN = r'^\s*#\s*endif'
 INTERNAL_INCLUDE_PATTERN = r'^#\s*include\s*"(.+)"\s*$'
 
 
@@ -53,33 +55,49 @@ class InputFile:
         #    'include/mantle/foo.h' -> 'mantle/foo.h'
         self.include_file_path = None if self.is_source_file else Path(*file_path.parts[1:])
 
-        # Read and process the contents of the file and scan for internal include macros.
+        # Read and process the contents of the file and scan for internal include macros. External includes
+        # within a conditional block, like platform specific intrinsics, are left where they are.
         self.lines: list[str] = []
+        self.conditional_lines: set[int] = set()
         self.external_includes: list[Path] = []
         self.internal_includes: list[Path] = []
+        conditional_depth = 0
         for line in read_file_lines(file_path):
-            self.lines.append(line)
-            self.external_includes += [Path(match) for match in re.findall(EXTERNAL_INCLUDE_PATTERN, line)]
+            if re.match(CONDITIONAL_END_PATTERN, line):
+                conditional_depth -= 1
+            elif re.match(CONDITIONAL_BEGIN_PATTERN, line):
+                conditional_depth += 1
+            elif conditional_depth > 0 and re.match(EXTERNAL_INCLUDE_PATTERN, line):
+                self.conditional_lines.add(len(self.lines))
+            else:
+                self.external_includes += [Path(match) for match in re.findall(EXTERNAL_INCLUDE_PATTERN, line)]
             self.internal_includes += [Path(match) for match in re.findall(INTERNAL_INCLUDE_PATTERN, line)]
+            self.lines.append(line)
+
+    def remove_lines(self, predicate) -> None:
+        lines: list[str] = []
+        conditional_lines: set[int] = set()
+        for index, line in enumerate(self.lines):
+            if not predicate(index, line):
+                if index in self.conditional_lines:
+                    conditional_lines.add(len(lines))
+                lines.append(line)
+
+        self.lines = lines
+        self.conditional_lines = conditional_lines
 
     def remove_pragma_once_lines(self):
-        self.lines = [
-            line for line in self.lines if not re.match(PRAGMA_ONCE_PATTERN, line)
-        ]
+        self.remove_lines(lambda index, line: re.match(PRAGMA_ONCE_PATTERN, line))
 
     def remove_includes(self):
         self.remove_external_includes()
         self.remove_internal_includes()
 
     def remove_external_includes(self):
-        self.lines = [
-            line for line in self.lines if not re.match(EXTERNAL_INCLUDE_PATTERN, line)
-        ]
+        self.remove_lines(lambda index, line: index not in self.conditional_lines and re.match(EXTERNAL_INCLUDE_PATTERN, line))
 
     def remove_internal_includes(self):
-        self.lines = [
-            line for line in self.lines if not re.match(INTERNAL_INCLUDE_PATTERN, line)
-        ]
+        self.remove_lines(lambda index, line: re.match(INTERNAL_INCLUDE_PATTERN, line))
 
 
 class InputFileGraph:
@@ -221,7 +239,8 @@ def main():
             output.write_line(line)
         output.write_empty_line()
 
-    print('\n'.join(output.lines))
+    with open(str(args.output), 'w') as f:
+        f.write('\n'.join(output.lines) + '\n')
 
 
 if __name__ == '__main__':
@@ -1,85 +1,784 @@
 #include "benchmark.h"
+#include <fmt/core.h>
 #include <iostream>
-#include <vector>
+#include <fstream>
+#include <memory>
+#include <atomic>
 #include <latch>
 #include <thread>
+#include <optional>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <cstdlib>
 
 using namespace mantle;
 
-struct TrivialFinalizer final : ObjectFinalizer {
-    void finalize(ObjectGroup, std::span<Object*>) noexcept override {}
-};
+std::string_view to_string(PointerType type) {
+    using namespace std::literals;
 
-// Decrement the latch and step the region until it is safe to proceed.
-inline void synchronize(Region& region, std::latch& latch) {
-    latch.count_down();
-    while (!latch.try_wait()) {
-        bool non_blocking = true;
-        region.step(non_blocking);
+    switch (type) {
+#define X(POINTER_TYPE)                 \
+        case PointerType::POINTER_TYPE: \
+            return #POINTER_TYPE ##sv;  \
+
+        POINTER_TYPES(X)
+#undef X
+    }
+
+    abort(); // Unreachable.
+}
+
+std::string_view to_string(ScenarioType type) {
+    using namespace std::literals;
+
+    switch (type) {
+#define X(SCENARIO_TYPE)                  \
+        case ScenarioType::SCENARIO_TYPE: \
+            return #SCENARIO_TYPE ##sv;   \
+
+        SCENARIO_TYPES(X)
+#undef X
+    }
+
+    abort(); // Unreachable.
+}
+
+LatencyHistogram::LatencyHistogram()
+    : count_(0)
+    , max_ns_(0)
+{
+    for (size_t& bucket: buckets_) {
+        bucket = 0;
+    }
+}
+
+void LatencyHistogram::record(std::chrono::nanoseconds latency) {
+    const uint64_t ns = static_cast<uint64_t>(std::max<int64_t>(latency.count(), 0));
+
+    // Bucket `i` holds latencies in `[2^(i-1), 2^i)`.
+    const size_t bucket = ns ? static_cast<size_t>(64 - __builtin_clzll(ns)) : 0;
+    buckets_[std::min(bucket, BUCKET_COUNT - 1)] += 1;
+
+    count_ += 1;
+    max_ns_ = std::max(ns, max_ns_);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        buckets_[i] += other.buckets_[i];
+    }
+
+    count_ += other.count_;
+    max_ns_ = std::max(other.max_ns_, max_ns_);
+}
+
+size_t LatencyHistogram::count() const {
+    return count_;
+}
+
+uint64_t LatencyHistogram::quantile_ns(double quantile) const {
+    if (count_ == 0) {
+        return 0;
     }
+
+    const size_t rank = static_cast<size_t>(std::ceil(quantile * static_cast<double>(count_)));
+
+    size_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        seen += buckets_[i];
+        if (seen >= std::max<size_t>(rank, 1)) {
+            return std::min<uint64_t>(1ull << i, max_ns_);
+        }
+    }
+
+    return max_ns_;
+}
+
+uint64_t LatencyHistogram::max_ns() const {
+    return max_ns_;
 }
 
-void contend_mantle_handle(size_t thread_count, size_t iterations, size_t object_count) {
-    std::latch running_latch(thread_count + 1);
-    std::latch stopped_latch(thread_count + 1);
+Settings::Settings()
+    : pointer_types{PointerType::HANDLE, PointerType::REF, PointerType::SHARED_PTR}
+    , scenario_types{ScenarioType::COPY_DROP, ScenarioType::RECLAIM}
+    , thread_counts{1, 2, 4}
+    , object_counts{16, 1024}
+    , sharing_ratios{0.0, 0.5, 1.0}
+    , operation_count(1024 * 1024)
+    , sample_interval(64)
+    , step_interval(1024)
+    , round_count(64)
+    , placement(false)
+{
+}
+
+std::string Result::to_json() const {
+    const double seconds = std::chrono::duration<double>(duration).count();
+    const double operations_per_second = (seconds > 0.0) ? (static_cast<double>(operation_count) / seconds) : 0.0;
+
+    return fmt::format(
+        "{{\"scenario\":\"{}\",\"pointer\":\"{}\",\"threads\":{},\"objects\":{},\"sharing\":{},"
+        "\"operations\":{},\"seconds\":{:.9f},\"operations_per_second\":{:.1f},"
+        "\"latency_samples\":{},\"p50_ns\":{},\"p90_ns\":{},\"p99_ns\":{},\"p999_ns\":{},\"max_ns\":{}}}",
+        to_string(parameters.scenario_type),
+        to_string(parameters.pointer_type),
+        parameters.thread_count,
+        parameters.object_count,
+        parameters.sharing_ratio,
+        operation_count,
+        seconds,
+        operations_per_second,
+        latency.count(),
+        latency.quantile_ns(0.50),
+        latency.quantile_ns(0.90),
+        latency.quantile_ns(0.99),
+        latency.quantile_ns(0.999),
+        latency.max_ns()
+    );
+}
+
+namespace {
+
+    struct BenchmarkObject : Object {
+        Clock::time_point dropped_at;
+    };
+
+    struct SharedObject {
+        Clock::time_point dropped_at;
+    };
+
+    // Objects are owned by the benchmark, so finalization only records how long reclamation took.
+    class BenchmarkFinalizer final : public TypedObjectFinalizer<BenchmarkFinalizer, ObjectGroupType<0, BenchmarkObject>> {
+    public:
+        using TypedObjectFinalizer::finalize;
+
+        explicit BenchmarkFinalizer(LatencyHistogram* reclaim_latency = nullptr)
+            : reclaim_latency_(reclaim_latency)
+            , count_(0)
+        {
+        }
+
+        size_t count() const {
+            return count_;
+        }
+
+        void finalize(std::span<BenchmarkObject*> objects) noexcept {
+            const Clock::time_point now = Clock::now();
+
+            if (reclaim_latency_) {
+                for (BenchmarkObject* object: objects) {
+                    reclaim_latency_->record(now - object->dropped_at);
+                }
+            }
+
+            count_ += objects.size();
+        }
+
+    private:
+        LatencyHistogram* reclaim_latency_;
+        size_t            count_;
+    };
+
+    // Per-thread measurements that are merged into a `Result`.
+    struct WorkerMeasurement {
+        Clock::time_point start;
+        Clock::time_point stop;
+        size_t            operation_count = 0;
+        LatencyHistogram  latency;
+    };
+
+    template<typename T>
+    inline void do_not_optimize(T& value) {
+        asm volatile("" : : "g"(&value) : "memory");
+    }
+
+    // With `--placement`, the domain's threads are pinned where they share a cache with the most workers.
+    Config make_config(const Settings& settings) {
+        Config config;
+        config.topology_placement = settings.placement;
+        return config;
+    }
+
+    // Pin the calling worker next to the domain, if the domain was placed.
+    void place_worker(Domain& domain) {
+        if (ThreadPlacement* placement = domain.placement()) {
+            placement->place_thread();
+        }
+    }
+
+    // Without a domain, workers are still spread out the same way so the results stay comparable.
+    std::unique_ptr<ThreadPlacement> make_placement(const Settings& settings) {
+        return settings.placement ? std::make_unique<ThreadPlacement>(CpuTopology::detect()) : nullptr;
+    }
+
+    // Decrement the latch and step the region until it is safe to proceed.
+    inline void synchronize(Region& region, std::latch& latch) {
+        latch.count_down();
+        while (!latch.try_wait()) {
+            bool non_blocking = true;
+            region.step(non_blocking);
+        }
+    }
+
+    inline void synchronize(std::latch& latch) {
+        latch.arrive_and_wait();
+    }
+
+    // Copy and drop pointers from the working set, timing every `sample_interval`th operation.
+    template<typename Pointer, typename Step>
+    void copy_drop(std::vector<Pointer>& pointers, const Settings& settings, WorkerMeasurement& measurement, Step&& step) {
+        const size_t pointer_count = pointers.size();
+
+        measurement.start = Clock::now();
+        for (size_t i = 0; i < settings.operation_count; ++i) {
+            Pointer& pointer = pointers[i % pointer_count];
+
+            if ((i % settings.sample_interval) == 0) {
+                const Clock::time_point start = Clock::now();
+                {
+                    Pointer copy = pointer;
+                    do_not_optimize(copy);
+                }
+                measurement.latency.record(Clock::now() - start);
+            }
+            else {
+                Pointer copy = pointer;
+                do_not_optimize(copy);
+            }
+
+            if ((i % settings.step_interval) == 0) {
+                step();
+            }
+        }
+        measurement.stop = Clock::now();
+        measurement.operation_count = settings.operation_count;
+    }
+
+    Result make_result(const Parameters& parameters, const std::vector<WorkerMeasurement>& measurements) {
+        Result result = {
+            .parameters      = parameters,
+            .operation_count = 0,
+            .duration        = std::chrono::nanoseconds::zero(),
+            .latency         = {},
+        };
+
+        if (measurements.empty()) {
+            return result;
+        }
+
+        Clock::time_point start = measurements.front().start;
+        Clock::time_point stop = measurements.front().stop;
+        for (const WorkerMeasurement& measurement: measurements) {
+            start = std::min(measurement.start, start);
+            stop = std::max(measurement.stop, stop);
+
+            result.operation_count += measurement.operation_count;
+            result.latency.merge(measurement.latency);
+        }
+
+        result.duration = stop - start;
+        return result;
+    }
+
+    size_t shared_object_count(const Parameters& parameters) {
+        return static_cast<size_t>(std::llround(static_cast<double>(parameters.object_count) * parameters.sharing_ratio));
+    }
+
+    Result run_handle_copy_drop(const Settings& settings, const Parameters& parameters) {
+        const size_t shared_count = shared_object_count(parameters);
+        const size_t private_count = parameters.object_count - shared_count;
+
+        std::vector<BenchmarkObject> shared_objects(shared_count);
+        std::vector<WorkerMeasurement> measurements(parameters.thread_count);
+        std::latch running_latch(parameters.thread_count + 1);
+        std::latch stopped_latch(parameters.thread_count + 1);
+
+        Domain domain(make_config(settings));
+        BenchmarkFinalizer root_finalizer;
+        Region root_region(domain, root_finalizer);
+
+        std::vector<Handle<BenchmarkObject>> shared_handles;
+        for (BenchmarkObject& object: shared_objects) {
+            shared_handles.push_back(make_handle(object));
+        }
+
+        std::vector<std::jthread> threads;
+        for (size_t thread_index = 0; thread_index < parameters.thread_count; ++thread_index) {
+            threads.push_back(std::jthread([&, thread_index]() {
+                place_worker(domain);
+                std::vector<BenchmarkObject> private_objects(private_count);
+
+                BenchmarkFinalizer finalizer;
+                Region region(domain, finalizer);
+                {
+                    std::vector<Handle<BenchmarkObject>> handles = shared_handles;
+                    for (BenchmarkObject& object: private_objects) {
+                        handles.push_back(make_handle(object));
+                    }
+
+                    synchronize(region, running_latch);
+                    copy_drop(handles, settings, measurements[thread_index], [&]() {
+                        region.step(true);
+                    });
+                }
+
+                region.stop();
+                synchronize(region, stopped_latch);
+            }));
+        }
+
+        // Workers copy the shared handles before they reach the latch.
+        synchronize(root_region, running_latch);
+        shared_handles.clear();
+
+        root_region.stop();
+        synchronize(root_region, stopped_latch);
+        threads.clear();
+
+        return make_result(parameters, measurements);
+    }
+
+    Result run_handle_reclaim(const Settings& settings, const Parameters& parameters) {
+        const size_t round_count = settings.round_count;
+
+        std::vector<LatencyHistogram> reclaim_latencies(parameters.thread_count);
+        std::vector<WorkerMeasurement> measurements(parameters.thread_count);
+        std::latch running_latch(parameters.thread_count + 1);
+        std::latch stopped_latch(parameters.thread_count + 1);
+
+        Domain domain(make_config(settings));
+        BenchmarkFinalizer root_finalizer;
+        Region root_region(domain, root_finalizer);
+
+        std::vector<std::jthread> threads;
+        for (size_t thread_index = 0; thread_index < parameters.thread_count; ++thread_index) {
+            threads.push_back(std::jthread([&, thread_index]() {
+                place_worker(domain);
+                std::vector<BenchmarkObject> objects(parameters.object_count);
+                WorkerMeasurement& measurement = measurements[thread_index];
+
+                BenchmarkFinalizer finalizer(&measurement.latency);
+                Region region(domain, finalizer);
+
+                synchronize(region, running_latch);
+                measurement.start = Clock::now();
+                for (size_t round = 0; round < round_count; ++round) {
+                    {
+                        std::vector<Handle<BenchmarkObject>> handles;
+                        handles.reserve(objects.size());
+                        for (BenchmarkObject& object: objects) {
+                            handles.push_back(make_handle(object));
+                        }
 
-    Config config;
-    config.operation_grouper_enabled = true;
+                        // Drop every handle, noting when the last reference went away.
+                        for (Handle<BenchmarkObject>& handle: handles) {
+                            handle->dropped_at = Clock::now();
+                            handle.reset();
+                        }
+                    }
 
-    Domain domain(config);
-    TrivialFinalizer finalizer;
-    Region root_region(domain, finalizer);
+                    // Wait for the objects to be finalized before reusing them.
+                    const size_t target_count = (round + 1) * objects.size();
+                    while (finalizer.count() < target_count) {
+                        region.step(true);
+                    }
+                }
+                measurement.stop = Clock::now();
+                measurement.operation_count = round_count * objects.size();
+
+                region.stop();
+                synchronize(region, stopped_latch);
+            }));
+        }
+
+        synchronize(root_region, running_latch);
+
+        root_region.stop();
+        synchronize(root_region, stopped_latch);
+        threads.clear();
+
+        return make_result(parameters, measurements);
+    }
+
+    Result run_ref_copy_drop(const Settings& settings, const Parameters& parameters) {
+        const size_t shared_count = shared_object_count(parameters);
+        const size_t private_count = parameters.object_count - shared_count;
+
+        std::vector<BenchmarkObject> shared_objects(shared_count);
+        std::vector<WorkerMeasurement> measurements(parameters.thread_count);
+        std::latch running_latch(parameters.thread_count + 1);
+        std::latch stopped_latch(parameters.thread_count + 1);
+
+        Config config = make_config(settings);
+        config.ledger_backend = LedgerBackend::WRITE_BARRIER;
+
+        Domain domain(config);
+        BenchmarkFinalizer root_finalizer;
+        Region root_region(domain, root_finalizer);
+
+        std::vector<Ref<BenchmarkObject>> shared_refs;
+        for (BenchmarkObject& object: shared_objects) {
+            shared_refs.push_back(bind(object));
+        }
+
+        std::vector<std::jthread> threads;
+        for (size_t thread_index = 0; thread_index < parameters.thread_count; ++thread_index) {
+            threads.push_back(std::jthread([&, thread_index]() {
+                place_worker(domain);
+                std::vector<BenchmarkObject> private_objects(private_count);
+
+                BenchmarkFinalizer finalizer;
+                Region region(domain, finalizer);
+                {
+                    std::vector<Ref<BenchmarkObject>> refs = shared_refs;
+                    for (BenchmarkObject& object: private_objects) {
+                        refs.push_back(bind(object));
+                    }
+
+                    synchronize(region, running_latch);
+                    copy_drop(refs, settings, measurements[thread_index], [&]() {
+                        region.step(true);
+                    });
+                }
+
+                region.stop();
+                synchronize(region, stopped_latch);
+            }));
+        }
+
+        // Workers copy the shared refs before they reach the latch.
+        synchronize(root_region, running_latch);
+        shared_refs.clear();
+
+        root_region.stop();
+        synchronize(root_region, stopped_latch);
+        threads.clear();
+
+        return make_result(parameters, measurements);
+    }
+
+    Result run_ref_reclaim(const Settings& settings, const Parameters& parameters) {
+        const size_t round_count = settings.round_count;
+
+        std::vector<WorkerMeasurement> measurements(parameters.thread_count);
+        std::latch running_latch(parameters.thread_count + 1);
+        std::latch stopped_latch(parameters.thread_count + 1);
+
+        Config config = make_config(settings);
+        config.ledger_backend = LedgerBackend::WRITE_BARRIER;
+
+        Domain domain(config);
+        BenchmarkFinalizer root_finalizer;
+        Region root_region(domain, root_finalizer);
 
-    std::vector<Object> objects(object_count);
-    std::vector<Handle<Object>> root_handles;
-    root_handles.reserve(object_count);
-    for (size_t i = 0; i < object_count; ++i) {
-        root_handles.push_back(make_handle(objects[i]));
+        std::vector<std::jthread> threads;
+        for (size_t thread_index = 0; thread_index < parameters.thread_count; ++thread_index) {
+            threads.push_back(std::jthread([&, thread_index]() {
+                place_worker(domain);
+                std::vector<BenchmarkObject> objects(parameters.object_count);
+                WorkerMeasurement& measurement = measurements[thread_index];
+
+                BenchmarkFinalizer finalizer(&measurement.latency);
+                Region region(domain, finalizer);
+
+                synchronize(region, running_latch);
+                measurement.start = Clock::now();
+                for (size_t round = 0; round < round_count; ++round) {
+                    {
+                        std::vector<Ref<BenchmarkObject>> refs;
+                        refs.reserve(objects.size());
+                        for (BenchmarkObject& object: objects) {
+                            refs.push_back(bind(object));
+                        }
+
+                        // Drop every ref, noting when the last reference went away.
+                        while (!refs.empty()) {
+                            refs.back()->dropped_at = Clock::now();
+                            refs.pop_back();
+                        }
+                    }
+
+                    // Wait for the objects to be finalized before reusing them.
+                    const size_t target_count = (round + 1) * objects.size();
+                    while (finalizer.count() < target_count) {
+                        region.step(true);
+                    }
+                }
+                measurement.stop = Clock::now();
+                measurement.operation_count = round_count * objects.size();
+
+                region.stop();
+                synchronize(region, stopped_latch);
+            }));
+        }
+
+        synchronize(root_region, running_latch);
+
+        root_region.stop();
+        synchronize(root_region, stopped_latch);
+        threads.clear();
+
+        return make_result(parameters, measurements);
+    }
+
+    Result run_shared_ptr_copy_drop(const Settings& settings, const Parameters& parameters) {
+        const size_t shared_count = shared_object_count(parameters);
+        const size_t private_count = parameters.object_count - shared_count;
+
+        std::vector<WorkerMeasurement> measurements(parameters.thread_count);
+        std::latch running_latch(parameters.thread_count);
+        std::unique_ptr<ThreadPlacement> placement = make_placement(settings);
+
+        std::vector<std::shared_ptr<SharedObject>> shared_pointers;
+        for (size_t i = 0; i < shared_count; ++i) {
+            shared_pointers.push_back(std::make_shared<SharedObject>());
+        }
+
+        std::vector<std::jthread> threads;
+        for (size_t thread_index = 0; thread_index < parameters.thread_count; ++thread_index) {
+            threads.push_back(std::jthread([&, thread_index]() {
+                if (placement) {
+                    placement->place_thread();
+                }
+
+                std::vector<std::shared_ptr<SharedObject>> pointers = shared_pointers;
+                for (size_t i = 0; i < private_count; ++i) {
+                    pointers.push_back(std::make_shared<SharedObject>());
+                }
+
+                synchronize(running_latch);
+                copy_drop(pointers, settings, measurements[thread_index], []() {});
+            }));
+        }
+        threads.clear();
+
+        return make_result(parameters, measurements);
     }
 
-    std::vector<std::jthread> threads;
-    threads.reserve(thread_count);
-    for (size_t i = 0; i < thread_count; ++i) {
-        std::vector<Handle<Object>> handles = root_handles;
+    Result run_shared_ptr_reclaim(const Settings& settings, const Parameters& parameters) {
+        const size_t round_count = settings.round_count;
+
+        std::vector<WorkerMeasurement> measurements(parameters.thread_count);
+        std::latch running_latch(parameters.thread_count);
+        std::unique_ptr<ThreadPlacement> placement = make_placement(settings);
+
+        std::vector<std::jthread> threads;
+        for (size_t thread_index = 0; thread_index < parameters.thread_count; ++thread_index) {
+            threads.push_back(std::jthread([&, thread_index]() {
+                if (placement) {
+                    placement->place_thread();
+                }
 
-        threads.push_back(std::jthread([&, handles=std::move(handles)]() mutable {
-            // TODO: Set the thread's affinity.
+                std::vector<SharedObject> objects(parameters.object_count);
+                WorkerMeasurement& measurement = measurements[thread_index];
 
-            TrivialFinalizer finalizer;
-            Region region(domain, finalizer);
+                auto deleter = [&](SharedObject* object) {
+                    measurement.latency.record(Clock::now() - object->dropped_at);
+                };
 
-            std::cout << "Worker starting\n";
-            synchronize(region, running_latch);
+                synchronize(running_latch);
+                measurement.start = Clock::now();
+                for (size_t round = 0; round < round_count; ++round) {
+                    std::vector<std::shared_ptr<SharedObject>> pointers;
+                    pointers.reserve(objects.size());
+                    for (SharedObject& object: objects) {
+                        pointers.push_back(std::shared_ptr<SharedObject>(&object, deleter));
+                    }
 
-            for (size_t i = 0; i < iterations; ++i) {
-                for (Handle<Object>& handle: handles) {
-                    Handle<Object> handle_copy = handle;
-                    (void)handle_copy;
+                    for (std::shared_ptr<SharedObject>& pointer: pointers) {
+                        pointer->dropped_at = Clock::now();
+                        pointer.reset();
+                    }
                 }
+                measurement.stop = Clock::now();
+                measurement.operation_count = round_count * objects.size();
+            }));
+        }
+        threads.clear();
+
+        return make_result(parameters, measurements);
+    }
+
+    std::optional<Result> run(const Settings& settings, const Parameters& parameters) {
+        switch (parameters.scenario_type) {
+            case ScenarioType::COPY_DROP: {
+                switch (parameters.pointer_type) {
+                    case PointerType::HANDLE:     return run_handle_copy_drop(settings, parameters);
+                    case PointerType::REF:        return run_ref_copy_drop(settings, parameters);
+                    case PointerType::SHARED_PTR: return run_shared_ptr_copy_drop(settings, parameters);
+                }
+                break;
+            }
+            case ScenarioType::RECLAIM: {
+                switch (parameters.pointer_type) {
+                    case PointerType::HANDLE:     return run_handle_reclaim(settings, parameters);
+                    case PointerType::REF:        return run_ref_reclaim(settings, parameters);
+                    case PointerType::SHARED_PTR: return run_shared_ptr_reclaim(settings, parameters);
+                }
+                break;
+            }
+        }
+
+        abort(); // Unreachable.
+    }
+
+    std::vector<std::string_view> split(std::string_view text) {
+        std::vector<std::string_view> tokens;
+
+        while (!text.empty()) {
+            const size_t comma = text.find(',');
+            tokens.push_back(text.substr(0, comma));
+            text = (comma == std::string_view::npos) ? std::string_view{} : text.substr(comma + 1);
+        }
+
+        return tokens;
+    }
+
+    template<typename Enum, size_t COUNT>
+    Enum parse_enum(std::string_view token, const std::array<Enum, COUNT>& values) {
+        for (const Enum value: values) {
+            std::string name(to_string(value));
+            for (char& c: name) {
+                c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
             }
-            handles.clear();
 
-            region.stop();
-            std::cout << "Worker stopping\n";
-            synchronize(region, stopped_latch);
-        }));
+            if (name == token) {
+                return value;
+            }
+        }
+
+        throw std::invalid_argument(fmt::format("Unknown value '{}'", token));
     }
-    root_handles.clear();
 
-    std::cout << "Main thread starting\n";
-    synchronize(root_region, running_latch);
+    // Options look like `--threads=1,2,4`.
+    Settings parse_settings(int argc, char** argv) {
+        static constexpr std::array POINTER_TYPE_VALUES = {
+#define X(POINTER_TYPE) PointerType::POINTER_TYPE,
+            POINTER_TYPES(X)
+#undef X
+        };
+        static constexpr std::array SCENARIO_TYPE_VALUES = {
+#define X(SCENARIO_TYPE) ScenarioType::SCENARIO_TYPE,
+            SCENARIO_TYPES(X)
+#undef X
+        };
+
+        Settings settings;
+
+        for (int i = 1; i < argc; ++i) {
+            const std::string_view argument = argv[i];
+            const size_t equals = argument.find('=');
+            if (!argument.starts_with("--") || (equals == std::string_view::npos)) {
+                throw std::invalid_argument(fmt::format("Malformed option '{}'", argument));
+            }
+
+            const std::string_view name = argument.substr(2, equals - 2);
+            const std::vector<std::string_view> values = split(argument.substr(equals + 1));
+
+            if (name == "pointers") {
+                settings.pointer_types.clear();
+                for (std::string_view value: values) {
+                    settings.pointer_types.push_back(parse_enum(value, POINTER_TYPE_VALUES));
+                }
+            }
+            else if (name == "scenarios") {
+                settings.scenario_types.clear();
+                for (std::string_view value: values) {
+                    settings.scenario_types.push_back(parse_enum(value, SCENARIO_TYPE_VALUES));
+                }
+            }
+            else if (name == "threads") {
+                settings.thread_counts.clear();
+                for (std::string_view value: values) {
+                    settings.thread_counts.push_back(std::stoull(std::string(value)));
+                }
+            }
+            else if (name == "objects") {
+                settings.object_counts.clear();
+                for (std::string_view value: values) {
+                    settings.object_counts.push_back(std::max<size_t>(std::stoull(std::string(value)), 1));
+                }
+            }
+            else if (name == "sharing") {
+                settings.sharing_ratios.clear();
+                for (std::string_view value: values) {
+                    settings.sharing_ratios.push_back(std::clamp(std::stod(std::string(value)), 0.0, 1.0));
+                }
+            }
+            else if (name == "operations") {
+                settings.operation_count = std::stoull(std::string(values.at(0)));
+            }
+            else if (name == "sample-interval") {
+                settings.sample_interval = std::max<size_t>(std::stoull(std::string(values.at(0))), 1);
+            }
+            else if (name == "step-interval") {
+                settings.step_interval = std::max<size_t>(std::stoull(std::string(values.at(0))), 1);
+            }
+            else if (name == "rounds") {
+                settings.round_count = std::max<size_t>(std::stoull(std::string(values.at(0))), 1);
+            }
+            else if (name == "placement") {
+                settings.placement = std::stoull(std::string(values.at(0))) != 0;
+            }
+            else if (name == "trace") {
+                settings.trace_path = argument.substr(equals + 1);
+            }
+            else {
+                throw std::invalid_argument(fmt::format("Unknown option '{}'", name));
+            }
+        }
+
+        return settings;
+    }
 
-    root_region.stop();
-    std::cout << "Main thread stopping\n";
-    synchronize(root_region, stopped_latch);
 }
 
-int main() {
-    size_t thread_count = 4;
-    size_t iterations = 1000;
-    size_t object_count = 1000;
+// Results are written to stdout as JSON lines so they can be collected and compared across releases.
+int main(int argc, char** argv) {
+    Settings settings;
+    try {
+        settings = parse_settings(argc, argv);
+    }
+    catch (const std::exception& exception) {
+        std::cerr << exception.what() << std::endl;
+        std::cerr << "usage: benchmark [--pointers=handle,ref,shared_ptr] [--scenarios=copy_drop,reclaim]"
+                     " [--threads=1,2,4] [--objects=16,1024] [--sharing=0,0.5,1] [--operations=N]"
+                     " [--sample-interval=N] [--step-interval=N] [--rounds=N] [--placement=0|1] [--trace=PATH]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    for (const ScenarioType scenario_type: settings.scenario_types) {
+        // Sharing only affects the copy/drop scenario. Reclamation always uses private objects.
+        const std::vector<double> sharing_ratios = (scenario_type == ScenarioType::COPY_DROP)
+            ? settings.sharing_ratios
+            : std::vector<double>{0.0};
+
+        for (const PointerType pointer_type: settings.pointer_types) {
+            for (const size_t thread_count: settings.thread_counts) {
+                for (const size_t object_count: settings.object_counts) {
+                    for (const double sharing_ratio: sharing_ratios) {
+                        const Parameters parameters = {
+                            .pointer_type  = pointer_type,
+                            .scenario_type = scenario_type,
+                            .thread_count  = thread_count,
+                            .object_count  = object_count,
+                            .sharing_ratio = sharing_ratio,
+                        };
 
-    contend_mantle_handle(thread_count, iterations, object_count);
+                        if (std::optional<Result> result = run(settings, parameters)) {
+                            std::cout << result->to_json() << std::endl;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if (!settings.trace_path.empty()) {
+        std::ofstream stream(settings.trace_path);
+        write_chrome_trace(stream);
+    }
 
-    return 0;
+    return EXIT_SUCCESS;
 }
@@ -1,3 +1,104 @@
 #pragma once
 
 #include "mantle/mantle.h"
+#include <array>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#define POINTER_TYPES(X) \
+    X(HANDLE)            \
+    X(REF)               \
+    X(SHARED_PTR)        \
+
+#define SCENARIO_TYPES(X) \
+    X(COPY_DROP)          \
+    X(RECLAIM)            \
+
+using Clock = std::chrono::steady_clock;
+
+enum class PointerType {
+#define X(POINTER_TYPE) \
+    POINTER_TYPE,       \
+
+    POINTER_TYPES(X)
+#undef X
+};
+
+enum class ScenarioType {
+#define X(SCENARIO_TYPE) \
+    SCENARIO_TYPE,       \
+
+    SCENARIO_TYPES(X)
+#undef X
+};
+
+std::string_view to_string(PointerType type);
+std::string_view to_string(ScenarioType type);
+
+// A histogram of latencies with power-of-two nanosecond buckets.
+class LatencyHistogram {
+public:
+    static constexpr size_t BUCKET_COUNT = 48;
+
+    LatencyHistogram();
+
+    void record(std::chrono::nanoseconds latency);
+    void merge(const LatencyHistogram& other);
+
+    [[nodiscard]]
+    size_t count() const;
+
+    // Returns an upper bound of the latency at this quantile (0.0 to 1.0).
+    [[nodiscard]]
+    uint64_t quantile_ns(double quantile) const;
+
+    [[nodiscard]]
+    uint64_t max_ns() const;
+
+private:
+    std::array<size_t, BUCKET_COUNT> buckets_;
+    size_t                           count_;
+    uint64_t                         max_ns_;
+};
+
+struct Settings {
+    std::vector<PointerType>  pointer_types;
+    std::vector<ScenarioType> scenario_types;
+    std::vector<size_t>       thread_counts;
+    std::vector<size_t>       object_counts;
+    std::vector<double>       sharing_ratios;
+
+    size_t operation_count;    // Copy/drop pairs per thread.
+    size_t sample_interval;    // Time every Nth operation for the latency histogram.
+    size_t step_interval;      // Step the region every Nth operation.
+    size_t round_count;        // Allocate/drop rounds per thread when measuring reclamation.
+    bool   placement;          // Pin the domain and workers with `Config::topology_placement`.
+
+    std::string trace_path;    // Write a Chrome trace of the most recent cycles here after the sweep.
+
+    Settings();
+};
+
+// The parameters of one point in a sweep.
+struct Parameters {
+    PointerType  pointer_type;
+    ScenarioType scenario_type;
+    size_t       thread_count;
+    size_t       object_count;
+    double       sharing_ratio;
+};
+
+struct Result {
+    Parameters               parameters;
+    size_t                   operation_count;
+    std::chrono::nanoseconds duration;
+    LatencyHistogram         latency;
+
+    // Writes the result as a single line of JSON.
+    [[nodiscard]]
+    std::string to_json() const;
+};
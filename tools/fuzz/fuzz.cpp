@@ -1,7 +1,10 @@
 #include <iostream>
+#include <fstream>
+#include <bit>
 #include <fmt/core.h>
 #include <cstdlib>
 #include <cassert>
+#include <unistd.h>
 #include "mantle/mantle.h"
 #include "mantle/debug.h"
 #include "fuzz.h"
@@ -26,12 +29,62 @@ Settings::Settings()
     , worker_thread_count(1)
     , worker_object_count(1)
     , working_set_size(10)
+    , soak_duration(0)
+    , report_interval(10)
+    , action_rate(0)
 {
     for (size_t& ratio: action_type_ratios) {
         ratio = 1;
     }
 }
 
+namespace {
+
+    int64_t steady_clock_now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Returns zero if the resident set size can't be read.
+    size_t resident_set_size() {
+        std::ifstream statm("/proc/self/statm");
+
+        size_t total_pages = 0;
+        size_t resident_pages = 0;
+        if (!(statm >> total_pages >> resident_pages)) {
+            return 0;
+        }
+
+        return resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    }
+
+}
+
+void SoakMetrics::record_latency(const std::chrono::nanoseconds latency) {
+    const uint64_t nanoseconds = static_cast<uint64_t>(std::max<int64_t>(latency.count(), 1));
+    const size_t bucket = std::min<size_t>(std::bit_width(nanoseconds) - 1, LATENCY_BUCKET_COUNT - 1);
+
+    latency_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+std::chrono::nanoseconds SoakMetrics::percentile(const std::array<size_t, LATENCY_BUCKET_COUNT>& counts, const double fraction) {
+    size_t total = 0;
+    for (const size_t count: counts) {
+        total += count;
+    }
+
+    const size_t rank = static_cast<size_t>(static_cast<double>(total) * fraction);
+
+    size_t seen = 0;
+    for (size_t bucket = 0; bucket < LATENCY_BUCKET_COUNT; ++bucket) {
+        seen += counts[bucket];
+        if ((seen > rank) && (seen > 0)) {
+            return std::chrono::nanoseconds(int64_t(2) << bucket);
+        }
+    }
+
+    return std::chrono::nanoseconds::zero();
+}
+
 bool TestObject::is_alive() const {
     return (birth_count + 1) == death_count;
 }
@@ -62,15 +115,22 @@ Handle<TestObject> TestObjectAllocator::allocate_object() {
     TestObject* object = new TestObject;
     object->birth_count += 1; 
     metrics_.allocation_success_count += 1;
+    worker_.driver_.soak_metrics().allocation_count.fetch_add(1, std::memory_order_relaxed);
     return make_handle(*object);
 }
 
 
-void TestObjectAllocator::finalize(ObjectGroup, std::span<Object*> objects) noexcept {
-    for (Object* object: objects) {
-        TestObject* test_object = &static_cast<TestObject&>(*object);
+void TestObjectAllocator::finalize(std::span<TestObject*> objects) noexcept {
+    SoakMetrics& soak_metrics = worker_.driver_.soak_metrics();
+    const int64_t now = steady_clock_now();
 
+    for (TestObject* test_object: objects) {
         metrics_.deallocation_count += 1;
+        soak_metrics.deallocation_count.fetch_add(1, std::memory_order_relaxed);
+        if (const int64_t release_time = test_object->release_time.load(std::memory_order_relaxed); release_time > 0) {
+            soak_metrics.record_latency(std::chrono::nanoseconds(now - release_time));
+        }
+
         test_object->death_count += 1;
         if (test_object->birth_count != test_object->death_count) {
             std::scoped_lock<std::mutex> lock(test_object->action_log_mutex);
@@ -145,6 +205,8 @@ WorkerThread::WorkerThread(Driver& driver)
         .object_allocator = object_allocator_.metrics(),
         .action_counts    = {},
     })
+    , start_time_()
+    , paced_action_count_(0)
 {
     metrics_.reset();
 
@@ -153,11 +215,15 @@ WorkerThread::WorkerThread(Driver& driver)
         {
             Region region(driver_.domain(), object_allocator_);
 
-            while (region.cycle() < driver_.settings().cycle_count) {
-                // if ((region.cycle() % 100) == 0) {
+            const bool soaking = driver_.settings().soak_duration.count() > 0;
+            start_time_ = std::chrono::steady_clock::now();
+
+            while (!driver_.is_finished(region)) {
+                if (!soaking) {
                     std::cout << fmt::format("[worker_thread:{}] cycle: {}\n", region.id(), region.cycle());
-                // }
+                }
                 step(region);
+                pace(region);
             }
         }
         driver_.worker_thread_stopping(*this);
@@ -204,6 +270,7 @@ void WorkerThread::step(Region& region) {
                 Handle<TestObject> object = std::move(working_set_.back());
                 working_set_.pop_back();
                 action.object = object.get();
+                action.object->release_time.store(steady_clock_now(), std::memory_order_relaxed);
             }
             break;
         }
@@ -257,6 +324,28 @@ void WorkerThread::step(Region& region) {
     }
 }
 
+void WorkerThread::pace(Region& region) {
+    const size_t action_rate = driver_.settings().action_rate;
+    if (action_rate == 0) {
+        return;
+    }
+
+    // Only look at the clock every so often.
+    constexpr size_t PACING_INTERVAL = 64;
+    paced_action_count_ += 1;
+    if ((paced_action_count_ % PACING_INTERVAL) != 0) {
+        return;
+    }
+
+    using namespace std::chrono;
+    const auto schedule = start_time_ + duration_cast<steady_clock::duration>(duration<double>(static_cast<double>(paced_action_count_) / static_cast<double>(action_rate)));
+    while ((steady_clock::now() < schedule) && !driver_.is_finished(region)) {
+        constexpr bool non_blocking = true;
+        region.step(non_blocking);
+        std::this_thread::sleep_for(std::min<steady_clock::duration>(schedule - steady_clock::now(), milliseconds(1)));
+    }
+}
+
 void WorkerThread::deliver(Packet packet) {
     std::scoped_lock<std::mutex> lock(inbox_mutex_);
 
@@ -283,6 +372,9 @@ Driver::Driver(const Settings& settings)
     : settings_(settings)
     , starting_latch_(settings.worker_thread_count + 1)
     , stopping_latch_(settings.worker_thread_count + 1)
+    , stopping_(false)
+    , reported_cycle_(0)
+    , reported_latency_buckets_()
 {
     for (size_t i = 0; i < settings.worker_thread_count; ++i) {
         worker_threads_.push_back(
@@ -303,6 +395,18 @@ WorkerThread& Driver::worker_thread(RegionId region_id) {
     return *worker_threads_.at(region_id);
 }
 
+SoakMetrics& Driver::soak_metrics() {
+    return soak_metrics_;
+}
+
+bool Driver::is_finished(const Region& region) const {
+    if (settings_.soak_duration.count() > 0) {
+        return stopping_.load(std::memory_order_relaxed);
+    }
+
+    return region.cycle() >= settings_.cycle_count;
+}
+
 void Driver::run() {
     // We need to participate in the starting latch to prevent
     // worker threads from accessing the worker thread vector
@@ -316,9 +420,75 @@ void Driver::run() {
     // And that would be weird.
     //
     starting_latch_.arrive_and_wait();
+
+    if (settings_.soak_duration.count() > 0) {
+        using Clock = std::chrono::steady_clock;
+
+        const Clock::time_point start_time = Clock::now();
+        const Clock::time_point stop_time = start_time + settings_.soak_duration;
+
+        Clock::time_point report_time = start_time;
+        while (Clock::now() < stop_time) {
+            std::this_thread::sleep_until(std::min(report_time + settings_.report_interval, stop_time));
+
+            const Clock::time_point now = Clock::now();
+            report(now - report_time);
+            report_time = now;
+        }
+
+        stopping_.store(true, std::memory_order_relaxed);
+    }
+
     stopping_latch_.arrive_and_wait();
 }
 
+void Driver::report(const std::chrono::steady_clock::duration elapsed) {
+    const Domain::Metrics domain_metrics = domain_.snapshot_metrics();
+
+    size_t ledger_occupancy = 0;
+    size_t ledger_capacity = 0;
+    double ledger_peak = 0.0;
+    for (const RegionMetricsSnapshot& region: domain_metrics.regions) {
+        ledger_occupancy += region.ledger_occupancy;
+        ledger_capacity += region.ledger_capacity;
+        if (region.ledger_capacity > 0) {
+            ledger_peak = std::max(ledger_peak, static_cast<double>(region.ledger_occupancy) / static_cast<double>(region.ledger_capacity));
+        }
+    }
+
+    // Latencies are reported for the last interval only.
+    std::array<size_t, SoakMetrics::LATENCY_BUCKET_COUNT> latency_buckets;
+    for (size_t bucket = 0; bucket < SoakMetrics::LATENCY_BUCKET_COUNT; ++bucket) {
+        const size_t count = soak_metrics_.latency_buckets[bucket].load(std::memory_order_relaxed);
+        latency_buckets[bucket] = count - reported_latency_buckets_[bucket];
+        reported_latency_buckets_[bucket] = count;
+    }
+
+    const double seconds = std::chrono::duration<double>(elapsed).count();
+    const double cycle_rate = static_cast<double>(domain_metrics.cycle - reported_cycle_) / seconds;
+    reported_cycle_ = domain_metrics.cycle;
+
+    const size_t allocation_count = soak_metrics_.allocation_count.load(std::memory_order_relaxed);
+    const size_t deallocation_count = soak_metrics_.deallocation_count.load(std::memory_order_relaxed);
+
+    auto microseconds = [](std::chrono::nanoseconds duration) {
+        return std::chrono::duration<double, std::micro>(duration).count();
+    };
+
+    std::cout << fmt::format(
+        "[soak] cycle: {} cycles/s: {:.1f} ledger: {:.1f}% (peak {:.1f}%) finalize p50/p99/p999: {:.0f}/{:.0f}/{:.0f}us live: {} rss: {:.1f}MiB",
+        domain_metrics.cycle,
+        cycle_rate,
+        (ledger_capacity > 0) ? (100.0 * static_cast<double>(ledger_occupancy) / static_cast<double>(ledger_capacity)) : 0.0,
+        100.0 * ledger_peak,
+        microseconds(SoakMetrics::percentile(latency_buckets, 0.5)),
+        microseconds(SoakMetrics::percentile(latency_buckets, 0.99)),
+        microseconds(SoakMetrics::percentile(latency_buckets, 0.999)),
+        allocation_count - deallocation_count,
+        static_cast<double>(resident_set_size()) / (1024.0 * 1024.0)
+    ) << std::endl;
+}
+
 void Driver::worker_thread_starting(WorkerThread&) {
     starting_latch_.arrive_and_wait();
 }
@@ -327,23 +497,63 @@ void Driver::worker_thread_stopping(WorkerThread&) {
     stopping_latch_.arrive_and_wait();
 }
 
+// Options look like `--soak=3600` and override the defaults in `settings`. Without any, this is a
+// short correctness run.
+void parse_settings(int argc, char** argv, Settings& settings) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view argument = argv[i];
+        const size_t equals = argument.find('=');
+        if (!argument.starts_with("--") || (equals == std::string_view::npos)) {
+            throw std::invalid_argument(fmt::format("Malformed option '{}'", argument));
+        }
+
+        const std::string_view name = argument.substr(2, equals - 2);
+        const std::string value(argument.substr(equals + 1));
+
+        if (name == "soak") {
+            settings.soak_duration = std::chrono::seconds(std::stoull(value));
+        }
+        else if (name == "report-interval") {
+            settings.report_interval = std::chrono::seconds(std::max<size_t>(std::stoull(value), 1));
+        }
+        else if (name == "rate") {
+            settings.action_rate = std::stoull(value);
+        }
+        else if (name == "threads") {
+            settings.worker_thread_count = std::max<size_t>(std::stoull(value), 1);
+        }
+        else if (name == "working-set") {
+            settings.working_set_size = std::max<size_t>(std::stoull(value), 1);
+        }
+        else {
+            throw std::invalid_argument(fmt::format("Unknown option '{}'", name));
+        }
+    }
+}
+
 int main(int argc, char** argv) {
-    (void)argc;
-    (void)argv;
+    Settings settings;
+    settings.cycle_count = 1000;
+    settings.worker_thread_count = 6;
+    settings.worker_object_count = 100;
+    settings.action_type_ratios[static_cast<size_t>(ActionType::STEP)] = 1;
+    settings.action_type_ratios[static_cast<size_t>(ActionType::MAKE)] = 2;
+    settings.action_type_ratios[static_cast<size_t>(ActionType::POKE)] = 2;
+    settings.action_type_ratios[static_cast<size_t>(ActionType::DROP)] = 3;
+    settings.action_type_ratios[static_cast<size_t>(ActionType::RECV)] = 2;
+    settings.action_type_ratios[static_cast<size_t>(ActionType::SEND)] = 1;
+
+    try {
+        parse_settings(argc, argv, settings);
+    }
+    catch (const std::exception& exception) {
+        std::cerr << exception.what() << std::endl;
+        std::cerr << "usage: fuzz [--soak=SECONDS] [--report-interval=SECONDS] [--rate=N] [--threads=N] [--working-set=N]" << std::endl;
+        return EXIT_FAILURE;
+    }
 
     size_t rounds = 1;
     for (size_t i = 0; i < rounds; ++i) {
-        Settings settings;
-        settings.cycle_count = 1000;
-        settings.worker_thread_count = 6;
-        settings.worker_object_count = 100;
-        settings.action_type_ratios[static_cast<size_t>(ActionType::STEP)] = 1;
-        settings.action_type_ratios[static_cast<size_t>(ActionType::MAKE)] = 2;
-        settings.action_type_ratios[static_cast<size_t>(ActionType::POKE)] = 2;
-        settings.action_type_ratios[static_cast<size_t>(ActionType::DROP)] = 3;
-        settings.action_type_ratios[static_cast<size_t>(ActionType::RECV)] = 2;
-        settings.action_type_ratios[static_cast<size_t>(ActionType::SEND)] = 1;
-
         Driver driver(settings);
         driver.run();
 
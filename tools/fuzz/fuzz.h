@@ -6,6 +6,8 @@
 #include <queue>
 #include <latch>
 #include <thread>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <cstddef>
 #include "mantle/mantle.h"
@@ -63,13 +65,42 @@ struct Settings {
     size_t worker_object_count;
     size_t working_set_size;
 
+    // Soak runs go on for a while instead of a number of cycles, and report throughput and memory
+    // use along the way. Zero means a plain correctness run.
+    std::chrono::seconds soak_duration;
+    std::chrono::seconds report_interval;
+    size_t               action_rate; // Per worker thread and second. Zero doesn't hold back.
+
     Settings();
 };
 
+// Counters shared by every worker thread during a soak run. The reporter reads them while the workers
+// are still going, so they are all atomic.
+struct SoakMetrics {
+    // Finalization latency is measured from the last time a worker dropped a handle to the object.
+    // Buckets hold power of two ranges of nanoseconds.
+    static constexpr size_t LATENCY_BUCKET_COUNT = 64;
+
+    std::atomic_size_t                                     allocation_count   = 0;
+    std::atomic_size_t                                     deallocation_count = 0;
+    std::array<std::atomic_size_t, LATENCY_BUCKET_COUNT>   latency_buckets    = {};
+
+    void record_latency(std::chrono::nanoseconds latency);
+
+    // Returns the upper bound of the bucket that holds this fraction of the counted latencies.
+    static std::chrono::nanoseconds percentile(
+        const std::array<size_t, LATENCY_BUCKET_COUNT>& counts,
+        double fraction
+    );
+};
+
 struct TestObject : Object {
     size_t birth_count = 0;
     size_t death_count = 0;
 
+    // When a worker last dropped a handle to this object, in nanoseconds of the steady clock.
+    std::atomic_int64_t release_time = 0;
+
     std::vector<Action> action_log;
     std::vector<Action> old_action_log;
     std::mutex          action_log_mutex;
@@ -79,8 +110,10 @@ struct TestObject : Object {
     void record_action(const Action& action);
 };
 
-class TestObjectAllocator final : public ObjectFinalizer {
+class TestObjectAllocator final : public TypedObjectFinalizer<TestObjectAllocator, ObjectGroupType<0, TestObject>> {
 public:
+    using TypedObjectFinalizer::finalize;
+
     struct Metrics {
         size_t allocation_failure_count;
         size_t allocation_success_count;
@@ -95,7 +128,7 @@ public:
 
     Handle<TestObject> allocate_object();
 
-    void finalize(ObjectGroup, std::span<Object*> objects) noexcept override;
+    void finalize(std::span<TestObject*> objects) noexcept;
 
 private:
     WorkerThread&                            worker_;
@@ -143,6 +176,9 @@ private:
 
     void step(Region& region);
 
+    // Soak runs hold back to the target rate, but keep the region stepping while they wait.
+    void pace(Region& region);
+
     void deliver(Packet packet);
     bool receive(Packet& packet);
 
@@ -163,6 +199,9 @@ private:
     WorkingSet          working_set_;
 
     Metrics             metrics_;
+
+    std::chrono::steady_clock::time_point start_time_;
+    size_t                                paced_action_count_;
 };
 
 class Driver {
@@ -173,6 +212,10 @@ public:
 
     Domain& domain();
     WorkerThread& worker_thread(RegionId region_id);
+    SoakMetrics& soak_metrics();
+
+    // Returns true once the worker thread on this region should stop.
+    bool is_finished(const Region& region) const;
 
     void run();
 
@@ -182,6 +225,9 @@ private:
     void worker_thread_starting(WorkerThread& worker_thread);
     void worker_thread_stopping(WorkerThread& worker_thread);
 
+    // Print a line about the last interval of a soak run.
+    void report(std::chrono::steady_clock::duration elapsed);
+
 private:
     Settings                                   settings_;
     std::latch                                 starting_latch_;
@@ -189,4 +235,11 @@ private:
 
     Domain                                     domain_;
     std::vector<std::unique_ptr<WorkerThread>> worker_threads_;
+
+    std::atomic_bool                           stopping_;
+    SoakMetrics                                soak_metrics_;
+
+    // The state of the soak run as of the last report.
+    Sequence                                   reported_cycle_;
+    std::array<size_t, SoakMetrics::LATENCY_BUCKET_COUNT> reported_latency_buckets_;
 };
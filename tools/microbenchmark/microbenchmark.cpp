@@ -0,0 +1,572 @@
+#include "microbenchmark.h"
+#include <fmt/core.h>
+#include <iostream>
+#include <memory>
+#include <bit>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+using namespace mantle;
+
+std::string_view to_string(MicrobenchmarkType type) {
+    using namespace std::literals;
+
+    switch (type) {
+#define X(MICROBENCHMARK_TYPE)                        \
+        case MicrobenchmarkType::MICROBENCHMARK_TYPE: \
+            return #MICROBENCHMARK_TYPE ##sv;         \
+
+        MICROBENCHMARK_TYPES(X)
+#undef X
+    }
+
+    abort(); // Unreachable.
+}
+
+std::string_view to_string(PerfCounterType type) {
+    using namespace std::literals;
+
+    switch (type) {
+#define X(PERF_COUNTER_TYPE)                     \
+        case PerfCounterType::PERF_COUNTER_TYPE: \
+            return #PERF_COUNTER_TYPE ##sv;      \
+
+        PERF_COUNTER_TYPES(X)
+#undef X
+    }
+
+    abort(); // Unreachable.
+}
+
+namespace {
+
+    perf_event_attr to_perf_event_attr(const PerfCounterType type) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+
+        attr.size           = sizeof(attr);
+        attr.disabled       = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        switch (type) {
+            case PerfCounterType::CYCLES: {
+                attr.type   = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CPU_CYCLES;
+                break;
+            }
+            case PerfCounterType::INSTRUCTIONS: {
+                attr.type   = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+                break;
+            }
+            case PerfCounterType::L1D_MISSES: {
+                attr.type   = PERF_TYPE_HW_CACHE;
+                attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+                break;
+            }
+            case PerfCounterType::LLC_MISSES: {
+                attr.type   = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CACHE_MISSES;
+                break;
+            }
+        }
+
+        return attr;
+    }
+
+}
+
+PerfCounters::PerfCounters() {
+    for (size_t i = 0; i < PERF_COUNTER_TYPE_COUNT; ++i) {
+        perf_event_attr attr = to_perf_event_attr(static_cast<PerfCounterType>(i));
+        file_descriptors_[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+}
+
+PerfCounters::~PerfCounters() {
+    for (const int file_descriptor: file_descriptors_) {
+        if (file_descriptor >= 0) {
+            close(file_descriptor);
+        }
+    }
+}
+
+void PerfCounters::resume() {
+    for (const int file_descriptor: file_descriptors_) {
+        if (file_descriptor >= 0) {
+            ioctl(file_descriptor, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+void PerfCounters::pause() {
+    for (const int file_descriptor: file_descriptors_) {
+        if (file_descriptor >= 0) {
+            ioctl(file_descriptor, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+}
+
+PerfCounterValues PerfCounters::read() const {
+    PerfCounterValues values;
+
+    for (size_t i = 0; i < PERF_COUNTER_TYPE_COUNT; ++i) {
+        if (file_descriptors_[i] < 0) {
+            continue;
+        }
+
+        struct {
+            uint64_t value;
+            uint64_t time_enabled;
+            uint64_t time_running;
+        } reading;
+
+        if ((::read(file_descriptors_[i], &reading, sizeof(reading)) != sizeof(reading)) || !reading.time_running) {
+            continue;
+        }
+
+        values[i] = static_cast<double>(reading.value) * (static_cast<double>(reading.time_enabled) / static_cast<double>(reading.time_running));
+    }
+
+    return values;
+}
+
+Settings::Settings()
+    : microbenchmark_types({
+#define X(MICROBENCHMARK_TYPE) MicrobenchmarkType::MICROBENCHMARK_TYPE,
+        MICROBENCHMARK_TYPES(X)
+#undef X
+    })
+    , operation_count(1 << 22)
+    , repetition_count(5)
+{
+}
+
+std::string Result::to_json() const {
+    std::string name(to_string(microbenchmark_type));
+    for (char& c: name) {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+
+    const double operations = static_cast<double>(std::max<size_t>(operation_count, 1));
+    std::string json = fmt::format(
+        "{{\"microbenchmark\":\"{}\",\"operations\":{},\"ns_per_operation\":{:.3f}",
+        name,
+        operation_count,
+        static_cast<double>(duration.count()) / operations
+    );
+
+    for (size_t i = 0; i < PERF_COUNTER_TYPE_COUNT; ++i) {
+        std::string counter(to_string(static_cast<PerfCounterType>(i)));
+        for (char& c: counter) {
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+
+        if (counters[i]) {
+            json += fmt::format(",\"{}_per_operation\":{:.3f}", counter, *counters[i] / operations);
+        }
+        else {
+            json += fmt::format(",\"{}_per_operation\":null", counter);
+        }
+    }
+
+    json += "}";
+    return json;
+}
+
+namespace {
+
+    // Operations are measured in batches of this size, with setup in between them.
+    static constexpr size_t BATCH_SIZE = 4096;
+
+    struct MicrobenchmarkObject : Object {
+    };
+
+    class NullFinalizer final : public ObjectFinalizer {
+    public:
+        void finalize(ObjectGroup, std::span<Object*>) noexcept override {
+        }
+    };
+
+    template<typename T>
+    inline void do_not_optimize(T& value) {
+        asm volatile("" : : "g"(&value) : "memory");
+    }
+
+    // Run batches until the operation count is reached. Only `batch` is timed and counted, and it must
+    // perform `BATCH_SIZE` operations. The fastest repetition is kept, since noise only ever adds time.
+    template<typename Prepare, typename Batch>
+    Result measure(const MicrobenchmarkType type, const Settings& settings, Prepare&& prepare, Batch&& batch) {
+        std::optional<Result> best;
+
+        for (size_t repetition = 0; repetition < settings.repetition_count; ++repetition) {
+            PerfCounters counters;
+            std::chrono::nanoseconds duration{0};
+            size_t operation_count = 0;
+
+            while (operation_count < settings.operation_count) {
+                prepare();
+
+                counters.resume();
+                const Clock::time_point start = Clock::now();
+                batch();
+                const Clock::time_point stop = Clock::now();
+                counters.pause();
+
+                duration += std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start);
+                operation_count += BATCH_SIZE;
+            }
+
+            const Result result = {
+                .microbenchmark_type = type,
+                .operation_count     = operation_count,
+                .duration            = duration,
+                .counters            = counters.read(),
+            };
+
+            if (!best || (result.duration < best->duration)) {
+                best = result;
+            }
+        }
+
+        return *best;
+    }
+
+    // Objects that are only used as keys, and are never bound to a region.
+    std::unique_ptr<Object[]> make_objects(const size_t count) {
+        return std::unique_ptr<Object[]>(new Object[count]);
+    }
+
+    std::vector<Operation> make_operations(Object* objects, const size_t object_count) {
+        std::vector<Operation> operations;
+        operations.reserve(BATCH_SIZE);
+
+        for (size_t i = 0; i < BATCH_SIZE; ++i) {
+            // Step through the objects with an odd stride, so consecutive operations rarely share one.
+            Object* object = &objects[(i * 7919) % object_count];
+            operations.push_back((i % 2) ? make_decrement_operation(object) : make_increment_operation(object));
+        }
+
+        return operations;
+    }
+
+    Result run_handle(const MicrobenchmarkType type, const Settings& settings) {
+        NullFinalizer finalizer;
+        MicrobenchmarkObject object;
+
+        Domain domain;
+        Region region(domain, finalizer);
+
+        Handle<MicrobenchmarkObject> handle = make_handle(object);
+        std::vector<Handle<MicrobenchmarkObject>> sources(BATCH_SIZE);
+        std::vector<Handle<MicrobenchmarkObject>> targets(BATCH_SIZE);
+
+        // Keep cycles going, so the ledger doesn't fill up during a batch.
+        auto step = [&]() {
+            constexpr bool non_blocking = true;
+            region.step(non_blocking);
+        };
+
+        switch (type) {
+            case MicrobenchmarkType::HANDLE_COPY: {
+                return measure(type, settings,
+                    [&]() {
+                        std::ranges::for_each(targets, [](auto& target) { target.reset(); });
+                        step();
+                    },
+                    [&]() {
+                        for (Handle<MicrobenchmarkObject>& target: targets) {
+                            target = handle;
+                        }
+                    }
+                );
+            }
+            case MicrobenchmarkType::HANDLE_MOVE: {
+                return measure(type, settings,
+                    [&]() {
+                        std::ranges::for_each(sources, [&](auto& source) { source = handle; });
+                        std::ranges::for_each(targets, [](auto& target) { target.reset(); });
+                        step();
+                    },
+                    [&]() {
+                        for (size_t i = 0; i < BATCH_SIZE; ++i) {
+                            targets[i] = std::move(sources[i]);
+                        }
+                    }
+                );
+            }
+            case MicrobenchmarkType::HANDLE_RESET: {
+                return measure(type, settings,
+                    [&]() {
+                        std::ranges::for_each(targets, [&](auto& target) { target = handle; });
+                        step();
+                    },
+                    [&]() {
+                        for (Handle<MicrobenchmarkObject>& target: targets) {
+                            target.reset();
+                        }
+                    }
+                );
+            }
+            default: {
+                abort(); // Unreachable.
+            }
+        }
+    }
+
+    Result run_operation_writer(const MicrobenchmarkType type, const Settings& settings) {
+        std::unique_ptr<Object[]> objects = make_objects(BATCH_SIZE);
+        const std::vector<Operation> operations = make_operations(objects.get(), BATCH_SIZE);
+
+        // Every flush pads out a batch of its own.
+        const size_t batch_count = (type == MicrobenchmarkType::OPERATION_WRITER_FLUSH) ? BATCH_SIZE : (BATCH_SIZE / OperationBatch::SIZE);
+
+        OperationVector storage(batch_count);
+        OperationWriter<OperationVector> writer(storage);
+
+        auto prepare = [&]() {
+            writer.reset(0, batch_count * OperationBatch::SIZE);
+        };
+
+        if (type == MicrobenchmarkType::OPERATION_WRITER_WRITE) {
+            return measure(type, settings, prepare, [&]() {
+                for (const Operation operation: operations) {
+                    writer.write(operation);
+                }
+            });
+        }
+
+        // A write followed by a flush, which is how a transaction ends.
+        return measure(type, settings, prepare, [&]() {
+            for (const Operation operation: operations) {
+                writer.write(operation);
+                writer.flush();
+            }
+        });
+    }
+
+    Result run_object_cache(const MicrobenchmarkType type, const Settings& settings) {
+        using Cache = ObjectCache<uint32_t, 8>;
+
+        std::unique_ptr<Object[]> objects = make_objects(BATCH_SIZE);
+
+        // Half of the keys are cached, so probes both hit and miss.
+        Cache cache(BATCH_SIZE);
+        for (size_t i = 0; i < BATCH_SIZE; i += 2) {
+            Object* key = &objects[i];
+            const size_t set = cache.to_set(key);
+            const Cache::WayMask live = cache.live_ways(set);
+            if (live != Cache::ALL_WAYS) {
+                cache.store(Cache::Cursor(set, static_cast<size_t>(std::countr_one(live))), { .key = key, .val = static_cast<uint32_t>(i) });
+            }
+        }
+
+        size_t match_count = 0;
+        return measure(type, settings, []() {}, [&]() {
+            for (size_t i = 0; i < BATCH_SIZE; ++i) {
+                Object* key = &objects[(i * 7919) % BATCH_SIZE];
+                match_count += static_cast<size_t>(std::popcount(cache.matching_ways(cache.to_set(key), key)));
+            }
+            do_not_optimize(match_count);
+        });
+    }
+
+    Result run_operation_grouper(const MicrobenchmarkType type, const Settings& settings) {
+        // Fewer objects than operations, so most writes land on a group that is already cached.
+        static constexpr size_t OBJECT_COUNT = 1024;
+
+        std::unique_ptr<Object[]> objects = make_objects(OBJECT_COUNT);
+        const std::vector<Operation> operations = make_operations(objects.get(), OBJECT_COUNT);
+
+        OperationGrouper grouper;
+        return measure(type, settings,
+            [&]() {
+                grouper.reset();
+            },
+            [&]() {
+                for (const Operation operation: operations) {
+                    grouper.write(operation);
+                }
+            }
+        );
+    }
+
+    Result run_object_grouper(const MicrobenchmarkType type, const Settings& settings) {
+        static constexpr size_t GROUP_COUNT = 64;
+
+        std::vector<std::unique_ptr<Object>> objects;
+        for (size_t i = 0; i < BATCH_SIZE; ++i) {
+            objects.push_back(std::make_unique<Object>(static_cast<ObjectGroup>((i * 7919) % GROUP_COUNT)));
+        }
+
+        ObjectGrouper grouper;
+        return measure(type, settings,
+            [&]() {
+                for (const std::unique_ptr<Object>& object: objects) {
+                    grouper.write(*object);
+                }
+            },
+            [&]() {
+                ObjectGroups groups = grouper.flush();
+                do_not_optimize(groups);
+            }
+        );
+    }
+
+    Result run_stream(const MicrobenchmarkType type, const Settings& settings) {
+        const Message message = make_start_message();
+
+        Stream stream(BATCH_SIZE);
+
+        auto send = [&]() {
+            for (size_t i = 0; i < BATCH_SIZE; ++i) {
+                stream.send(message);
+            }
+        };
+
+        size_t received_count = 0;
+        auto receive = [&]() {
+            const Stream::Window window = stream.receive();
+            for (const std::span<const Message> messages: { window.first, window.second }) {
+                for (const Message& received: messages) {
+                    received_count += static_cast<size_t>(received.type == MessageType::START);
+                }
+            }
+            stream.release();
+            do_not_optimize(received_count);
+        };
+
+        if (type == MicrobenchmarkType::STREAM_SEND) {
+            return measure(type, settings, receive, send);
+        }
+
+        return measure(type, settings, send, receive);
+    }
+
+    Result run(const MicrobenchmarkType type, const Settings& settings) {
+        switch (type) {
+            case MicrobenchmarkType::HANDLE_COPY:
+            case MicrobenchmarkType::HANDLE_MOVE:
+            case MicrobenchmarkType::HANDLE_RESET: {
+                return run_handle(type, settings);
+            }
+            case MicrobenchmarkType::OPERATION_WRITER_WRITE:
+            case MicrobenchmarkType::OPERATION_WRITER_FLUSH: {
+                return run_operation_writer(type, settings);
+            }
+            case MicrobenchmarkType::OBJECT_CACHE_PROBE: {
+                return run_object_cache(type, settings);
+            }
+            case MicrobenchmarkType::OPERATION_GROUPER_WRITE: {
+                return run_operation_grouper(type, settings);
+            }
+            case MicrobenchmarkType::OBJECT_GROUPER_FLUSH: {
+                return run_object_grouper(type, settings);
+            }
+            case MicrobenchmarkType::STREAM_SEND:
+            case MicrobenchmarkType::STREAM_RECEIVE: {
+                return run_stream(type, settings);
+            }
+        }
+
+        abort(); // Unreachable.
+    }
+
+    std::vector<std::string_view> split(std::string_view value) {
+        std::vector<std::string_view> tokens;
+
+        while (!value.empty()) {
+            const size_t comma = value.find(',');
+            tokens.push_back(value.substr(0, comma));
+            if (comma == std::string_view::npos) {
+                break;
+            }
+
+            value.remove_prefix(comma + 1);
+        }
+
+        return tokens;
+    }
+
+    MicrobenchmarkType parse_microbenchmark_type(std::string_view token) {
+        static constexpr std::array VALUES = {
+#define X(MICROBENCHMARK_TYPE) MicrobenchmarkType::MICROBENCHMARK_TYPE,
+            MICROBENCHMARK_TYPES(X)
+#undef X
+        };
+
+        for (const MicrobenchmarkType value: VALUES) {
+            std::string name(to_string(value));
+            for (char& c: name) {
+                c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+
+            if (name == token) {
+                return value;
+            }
+        }
+
+        throw std::invalid_argument(fmt::format("Unknown value '{}'", token));
+    }
+
+    // Options look like `--microbenchmarks=handle_copy,stream_send`.
+    Settings parse_settings(int argc, char** argv) {
+        Settings settings;
+
+        for (int i = 1; i < argc; ++i) {
+            const std::string_view argument = argv[i];
+            const size_t equals = argument.find('=');
+            if (!argument.starts_with("--") || (equals == std::string_view::npos)) {
+                throw std::invalid_argument(fmt::format("Malformed option '{}'", argument));
+            }
+
+            const std::string_view name = argument.substr(2, equals - 2);
+            const std::vector<std::string_view> values = split(argument.substr(equals + 1));
+
+            if (name == "microbenchmarks") {
+                settings.microbenchmark_types.clear();
+                for (std::string_view value: values) {
+                    settings.microbenchmark_types.push_back(parse_microbenchmark_type(value));
+                }
+            }
+            else if (name == "operations") {
+                settings.operation_count = std::max<size_t>(std::stoull(std::string(values.at(0))), 1);
+            }
+            else if (name == "repetitions") {
+                settings.repetition_count = std::max<size_t>(std::stoull(std::string(values.at(0))), 1);
+            }
+            else {
+                throw std::invalid_argument(fmt::format("Unknown option '{}'", name));
+            }
+        }
+
+        return settings;
+    }
+
+}
+
+int main(int argc, char** argv) {
+    Settings settings;
+    try {
+        settings = parse_settings(argc, argv);
+    }
+    catch (const std::exception& exception) {
+        std::cerr << exception.what() << std::endl;
+        std::cerr << "usage: microbenchmark [--microbenchmarks=handle_copy,stream_send] [--operations=N] [--repetitions=N]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    for (const MicrobenchmarkType type: settings.microbenchmark_types) {
+        std::cout << run(type, settings).to_json() << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+}
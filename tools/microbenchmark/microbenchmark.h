@@ -0,0 +1,103 @@
+#pragma once
+
+#include "mantle/mantle.h"
+#include <array>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <optional>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Each of these measures a single hot path in isolation, with its setup kept out of the measurement.
+#define MICROBENCHMARK_TYPES(X)   \
+    X(HANDLE_COPY)                \
+    X(HANDLE_MOVE)                \
+    X(HANDLE_RESET)               \
+    X(OPERATION_WRITER_WRITE)     \
+    X(OPERATION_WRITER_FLUSH)     \
+    X(OBJECT_CACHE_PROBE)         \
+    X(OPERATION_GROUPER_WRITE)    \
+    X(OBJECT_GROUPER_FLUSH)       \
+    X(STREAM_SEND)                \
+    X(STREAM_RECEIVE)             \
+
+#define PERF_COUNTER_TYPES(X) \
+    X(CYCLES)                 \
+    X(INSTRUCTIONS)           \
+    X(L1D_MISSES)             \
+    X(LLC_MISSES)             \
+
+using Clock = std::chrono::steady_clock;
+
+enum class MicrobenchmarkType {
+#define X(MICROBENCHMARK_TYPE) \
+    MICROBENCHMARK_TYPE,       \
+
+    MICROBENCHMARK_TYPES(X)
+#undef X
+};
+
+enum class PerfCounterType {
+#define X(PERF_COUNTER_TYPE) \
+    PERF_COUNTER_TYPE,       \
+
+    PERF_COUNTER_TYPES(X)
+#undef X
+};
+
+static constexpr size_t PERF_COUNTER_TYPE_COUNT = 0
+#define X(PERF_COUNTER_TYPE) + 1
+    PERF_COUNTER_TYPES(X)
+#undef X
+;
+
+std::string_view to_string(MicrobenchmarkType type);
+std::string_view to_string(PerfCounterType type);
+
+using PerfCounterValues = std::array<std::optional<double>, PERF_COUNTER_TYPE_COUNT>;
+
+// Hardware counters of the calling thread, counted in user space only. Counters the kernel or the
+// CPU won't give us are left out, so this still works in containers and virtual machines.
+class PerfCounters {
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    PerfCounters(PerfCounters&&) = delete;
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(PerfCounters&&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // Counting can be paused and resumed, so setup between measured batches isn't counted.
+    void resume();
+    void pause();
+
+    // Counts since construction, scaled up when the kernel had to multiplex the counters.
+    [[nodiscard]]
+    PerfCounterValues read() const;
+
+private:
+    std::array<int, PERF_COUNTER_TYPE_COUNT> file_descriptors_;
+};
+
+struct Settings {
+    std::vector<MicrobenchmarkType> microbenchmark_types;
+
+    size_t operation_count;  // Measured operations per repetition.
+    size_t repetition_count; // The fastest repetition is reported.
+
+    Settings();
+};
+
+struct Result {
+    MicrobenchmarkType       microbenchmark_type;
+    size_t                   operation_count;
+    std::chrono::nanoseconds duration;
+    PerfCounterValues        counters;
+
+    // Writes the result as a single line of JSON, with counters per operation.
+    [[nodiscard]]
+    std::string to_json() const;
+};
@@ -0,0 +1,221 @@
+#include "mantle/mantle.h"
+#include <fmt/core.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <stdexcept>
+#include <cstdlib>
+
+using namespace mantle;
+
+namespace {
+
+    // The controller options to replay a recording with. Every combination is run.
+    struct Settings {
+        std::string path;
+
+        std::vector<GrouperEngine>  engines     = {GrouperEngine::CACHE};
+        std::vector<size_t>         cache_sizes = {OPERATION_GROUPER_CACHE_SIZE};
+        std::vector<bool>           pipelines   = {false};
+        std::vector<LedgerEncoding> encodings   = {LedgerEncoding::FULL};
+        std::vector<size_t>         prefetches  = {APPLY_PREFETCH_DISTANCE};
+    };
+
+    std::vector<std::string_view> split(std::string_view text) {
+        std::vector<std::string_view> tokens;
+
+        while (!text.empty()) {
+            const size_t comma = text.find(',');
+            tokens.push_back(text.substr(0, comma));
+            text = (comma == std::string_view::npos) ? std::string_view{} : text.substr(comma + 1);
+        }
+
+        return tokens;
+    }
+
+    GrouperEngine parse_engine(const std::string_view token) {
+        if (token == "cache") {
+            return GrouperEngine::CACHE;
+        }
+        if (token == "radix") {
+            return GrouperEngine::RADIX;
+        }
+
+        throw std::invalid_argument(fmt::format("Unknown engine '{}'", token));
+    }
+
+    LedgerEncoding parse_encoding(const std::string_view token) {
+        if (token == "full") {
+            return LedgerEncoding::FULL;
+        }
+        if (token == "compact") {
+            return LedgerEncoding::COMPACT;
+        }
+
+        throw std::invalid_argument(fmt::format("Unknown encoding '{}'", token));
+    }
+
+    std::string_view to_string(const GrouperEngine engine) {
+        return (engine == GrouperEngine::CACHE) ? "cache" : "radix";
+    }
+
+    std::string_view to_string(const LedgerEncoding encoding) {
+        return (encoding == LedgerEncoding::FULL) ? "full" : "compact";
+    }
+
+    // Options look like `--engines=cache,radix`, and the recording is the only positional argument.
+    Settings parse_settings(int argc, char** argv) {
+        Settings settings;
+
+        for (int i = 1; i < argc; ++i) {
+            const std::string_view argument = argv[i];
+            if (!argument.starts_with("--")) {
+                if (!settings.path.empty()) {
+                    throw std::invalid_argument("Only one recording can be replayed at a time");
+                }
+
+                settings.path = argument;
+                continue;
+            }
+
+            const size_t equals = argument.find('=');
+            if (equals == std::string_view::npos) {
+                throw std::invalid_argument(fmt::format("Malformed option '{}'", argument));
+            }
+
+            const std::string_view name = argument.substr(2, equals - 2);
+            const std::vector<std::string_view> values = split(argument.substr(equals + 1));
+
+            if (name == "engines") {
+                settings.engines.clear();
+                for (std::string_view value: values) {
+                    settings.engines.push_back(parse_engine(value));
+                }
+            }
+            else if (name == "cache-sizes") {
+                settings.cache_sizes.clear();
+                for (std::string_view value: values) {
+                    settings.cache_sizes.push_back(std::max<size_t>(std::stoull(std::string(value)), 1));
+                }
+            }
+            else if (name == "pipeline") {
+                settings.pipelines.clear();
+                for (std::string_view value: values) {
+                    settings.pipelines.push_back(std::stoull(std::string(value)) != 0);
+                }
+            }
+            else if (name == "encodings") {
+                settings.encodings.clear();
+                for (std::string_view value: values) {
+                    settings.encodings.push_back(parse_encoding(value));
+                }
+            }
+            else if (name == "prefetch") {
+                settings.prefetches.clear();
+                for (std::string_view value: values) {
+                    settings.prefetches.push_back(std::stoull(std::string(value)));
+                }
+            }
+            else {
+                throw std::invalid_argument(fmt::format("Unknown option '{}'", name));
+            }
+        }
+
+        if (settings.path.empty()) {
+            throw std::invalid_argument("Missing recording");
+        }
+
+        return settings;
+    }
+
+    std::string to_json(const Config& config, const LedgerReplayMetrics& metrics) {
+        const double seconds = std::chrono::duration<double>(metrics.duration).count();
+        const double finalize_seconds = std::chrono::duration<double>(metrics.finalize_duration).count();
+
+        return fmt::format(
+            "{{\"engine\":\"{}\",\"cache_size\":{},\"pipeline\":{},\"encoding\":\"{}\",\"prefetch\":{},"
+            "\"cycles\":{},\"operations\":{},\"applied\":{},\"grouper_hit_rate\":{:.6f},\"grouped\":{},\"evicted\":{},"
+            "\"applied_per_second\":{:.1f},\"finalized\":{},\"finalize_seconds\":{:.9f},\"revived\":{},\"seconds\":{:.9f}}}",
+            to_string(config.operation_grouper_engine),
+            config.operation_grouper_cache_size,
+            config.pipeline_cycles,
+            to_string(config.ledger_encoding),
+            config.apply_prefetch_distance,
+            metrics.cycle_count,
+            metrics.operation_count,
+            metrics.applied_count,
+            metrics.grouper_hit_rate(),
+            metrics.operation_grouper.grouped_count,
+            metrics.operation_grouper.evicted_count,
+            metrics.applied_objects_per_second(),
+            metrics.finalized_count,
+            finalize_seconds,
+            metrics.revived_count,
+            seconds
+        );
+    }
+
+}
+
+// Replays a recording made with `Config::ledger_recorder`. Results are written to stdout as JSON
+// lines, one for each combination of options, like the benchmark's.
+int main(int argc, char** argv) {
+    Settings settings;
+    try {
+        settings = parse_settings(argc, argv);
+    }
+    catch (const std::exception& exception) {
+        std::cerr << exception.what() << std::endl;
+        std::cerr << "usage: replay [--engines=cache,radix] [--cache-sizes=N,...] [--pipeline=0,1]"
+                     " [--encodings=full,compact] [--prefetch=N,...] RECORDING" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    LedgerRecording recording;
+    try {
+        std::ifstream stream(settings.path, std::ios::binary);
+        if (!stream) {
+            throw std::runtime_error(fmt::format("Failed to open '{}'", settings.path));
+        }
+
+        recording = LedgerRecording::read(stream);
+    }
+    catch (const std::exception& exception) {
+        std::cerr << exception.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cerr << fmt::format("{} regions, {} objects, {} cycles, {} operations",
+        recording.region_count(), recording.objects.size(), recording.cycles.size(), recording.operation_count()) << std::endl;
+
+    for (const GrouperEngine engine: settings.engines) {
+        for (const size_t cache_size: settings.cache_sizes) {
+            for (const bool pipeline: settings.pipelines) {
+                for (const LedgerEncoding encoding: settings.encodings) {
+                    for (const size_t prefetch: settings.prefetches) {
+                        Config config;
+                        config.operation_grouper_engine = engine;
+                        config.operation_grouper_cache_size = cache_size;
+                        config.operation_grouper_cache_size_max = cache_size;
+                        config.pipeline_cycles = pipeline;
+                        config.ledger_encoding = encoding;
+                        config.apply_prefetch_distance = prefetch;
+
+                        try {
+                            LedgerReplay replay(recording, config);
+                            std::cout << to_json(config, replay.run()) << std::endl;
+                        }
+                        catch (const std::exception& exception) {
+                            std::cerr << exception.what() << std::endl;
+                            return EXIT_FAILURE;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
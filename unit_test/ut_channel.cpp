@@ -0,0 +1,162 @@
+#include "catch.hpp"
+#include "mantle/mantle.h"
+#include <array>
+#include <thread>
+#include <vector>
+#include <poll.h>
+
+using namespace mantle;
+
+namespace {
+
+    struct TestObject : Object {
+        size_t value = 0;
+    };
+
+    class TestObjectFinalizer final : public ObjectFinalizer {
+    public:
+        size_t count() const {
+            return count_;
+        }
+
+        void finalize(ObjectGroup, std::span<Object*> objects) noexcept override {
+            count_ += objects.size();
+        }
+
+    private:
+        size_t count_ = 0;
+    };
+
+    bool is_readable(int file_descriptor) {
+        pollfd descriptor = {
+            .fd      = file_descriptor,
+            .events  = POLLIN,
+            .revents = 0,
+        };
+
+        return poll(&descriptor, 1, 0) == 1;
+    }
+
+}
+
+TEST_CASE("Channel") {
+    std::array<TestObject, 64> storage;
+    for (size_t i = 0; i < storage.size(); ++i) {
+        storage[i].value = i;
+    }
+
+    TestObjectFinalizer finalizer;
+    {
+        Domain domain;
+        Region region(domain, finalizer);
+
+        std::vector<Handle<TestObject>> handles;
+        for (TestObject& object: storage) {
+            handles.push_back(make_handle(object));
+        }
+
+        // Moving handles through a channel never touches their reference counts.
+        auto check_alive = [&] {
+            for (size_t i = 0; i < 100; ++i) {
+                constexpr bool non_blocking = true;
+                region.step(non_blocking);
+            }
+            CHECK(finalizer.count() == 0);
+        };
+
+        SECTION("Basic") {
+            Channel<Handle<TestObject>> channel(4);
+            CHECK(channel.capacity() == 4);
+            CHECK(!is_readable(channel.file_descriptor()));
+
+            // Sending takes the handle.
+            CHECK(channel.send(std::move(handles[0])));
+            CHECK(!handles[0]);
+            CHECK(is_readable(channel.file_descriptor()));
+
+            std::vector<Handle<TestObject>> received;
+            CHECK(channel.receive(received, true) == 1);
+            REQUIRE(received.size() == 1);
+            CHECK(received[0]->value == 0);
+            CHECK(!is_readable(channel.file_descriptor()));
+            check_alive();
+
+            // Nothing is left behind, and a full channel doesn't take the handle.
+            CHECK(channel.receive(received, true) == 0);
+            for (size_t i = 1; i <= 4; ++i) {
+                CHECK(channel.send(std::move(handles[i])));
+            }
+            CHECK(!channel.send(std::move(handles[5])));
+            CHECK(handles[5]);
+
+            // Handles that were never received are dropped with the channel.
+            CHECK(channel.receive(received, true) == 4);
+            CHECK(channel.send(std::move(handles[5])));
+        }
+
+        SECTION("Single producer") {
+            Channel<Handle<TestObject>> channel(8);
+
+            std::thread sender([&] {
+                for (Handle<TestObject>& handle: handles) {
+                    while (!channel.send(std::move(handle))) {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+
+            std::vector<Handle<TestObject>> received;
+            while (received.size() < storage.size()) {
+                constexpr bool non_blocking = false;
+                channel.receive(received, non_blocking);
+            }
+            sender.join();
+
+            check_alive();
+
+            // A single sender keeps its order.
+            for (size_t i = 0; i < received.size(); ++i) {
+                CHECK(received[i]->value == i);
+            }
+        }
+
+        SECTION("Multiple producers") {
+            constexpr size_t SENDER_COUNT = 4;
+            MpscChannel<Handle<TestObject>> channel(8);
+
+            std::vector<std::vector<Handle<TestObject>>> outboxes(SENDER_COUNT);
+            for (size_t i = 0; i < handles.size(); ++i) {
+                outboxes[i % SENDER_COUNT].push_back(std::move(handles[i]));
+            }
+
+            std::vector<std::thread> senders;
+            for (std::vector<Handle<TestObject>>& outbox: outboxes) {
+                senders.emplace_back([&] {
+                    for (Handle<TestObject>& handle: outbox) {
+                        while (!channel.send(std::move(handle))) {
+                            std::this_thread::yield();
+                        }
+                    }
+                });
+            }
+
+            std::vector<Handle<TestObject>> received;
+            while (received.size() < storage.size()) {
+                constexpr bool non_blocking = false;
+                channel.receive(received, non_blocking);
+            }
+            for (std::thread& sender: senders) {
+                sender.join();
+            }
+
+            std::vector<bool> seen(storage.size(), false);
+            for (const Handle<TestObject>& handle: received) {
+                CHECK(!seen[handle->value]);
+                seen[handle->value] = true;
+            }
+            check_alive();
+        }
+
+    }
+    CHECK(finalizer.count() == storage.size());
+}
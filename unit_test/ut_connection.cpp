@@ -1,5 +1,7 @@
 #include "catch.hpp"
 #include "mantle/connection.h"
+#include <thread>
+#include <poll.h>
 
 using namespace mantle;
 
@@ -14,7 +16,7 @@ TEST_CASE("Connection") {
         CHECK(sent);
 
         // Receive it.
-        std::span<const Message> messages = server_endpoint.receive_messages(true);
+        MessageBatch messages = server_endpoint.receive_messages(true);
         REQUIRE(messages.size() == 1);
         REQUIRE(messages[0].type == MessageType::ENTER);
         CHECK(messages[0].enter.cycle == 14);
@@ -34,7 +36,7 @@ TEST_CASE("Connection") {
         client_endpoint.send_message(make_enter_message(100));
         client_endpoint.send_message(make_enter_message(200));
 
-        std::span<const Message> messages = server_endpoint.receive_messages(true);
+        MessageBatch messages = server_endpoint.receive_messages(true);
         REQUIRE(messages.size() == 2);
         REQUIRE(messages[0].type == MessageType::ENTER);
         REQUIRE(messages[1].type == MessageType::ENTER);
@@ -57,8 +59,85 @@ TEST_CASE("Connection") {
         CHECK(server_endpoint.receive_messages(true).empty());
     }
 
+    SECTION("Wrap around") {
+        // Move the stream position close to the end of the ring.
+        for (size_t i = 0; i < (STREAM_CAPACITY - 1); ++i) {
+            CHECK(client_endpoint.send_message(make_enter_message(i)));
+        }
+        CHECK(server_endpoint.receive_messages(true).size() == (STREAM_CAPACITY - 1));
+
+        for (Sequence cycle = 0; cycle < 3; ++cycle) {
+            CHECK(client_endpoint.send_message(make_enter_message(cycle)));
+        }
+
+        MessageBatch messages = server_endpoint.receive_messages(true);
+        REQUIRE(messages.size() == 3);
+
+        Sequence cycle = 0;
+        for (const Message& message: messages) {
+            CHECK(message.enter.cycle == cycle);
+            cycle += 1;
+        }
+    }
+
+    SECTION("Release") {
+        auto message = make_enter_message(0);
+        for (size_t i = 0; i < STREAM_CAPACITY; ++i) {
+            CHECK(client_endpoint.send_message(message));
+        }
+
+        // Slots are only reused once the outermost batch is gone.
+        {
+            MessageBatch outer = server_endpoint.receive_messages(true);
+            CHECK(outer.size() == STREAM_CAPACITY);
+            {
+                MessageBatch inner = server_endpoint.receive_messages(true);
+                CHECK(inner.empty());
+            }
+            CHECK(!client_endpoint.send_message(message));
+        }
+        CHECK(client_endpoint.send_message(message));
+    }
+
     SECTION("Underflow") {
         CHECK(server_endpoint.receive_messages(true).size() == 0);
     }
 
+    SECTION("Futex wakeups") {
+        Connection futex_connection(std::nullopt, std::nullopt, WakeupPolicy::FUTEX);
+        Endpoint& client = futex_connection.client_endpoint();
+        Endpoint& server = futex_connection.server_endpoint();
+
+        // Nothing is waiting, so nothing blocks.
+        CHECK(client.receive_messages(true).empty());
+
+        // A notification lets one blocking receive through.
+        client.notify();
+        CHECK(client.receive_messages(false).empty());
+
+        std::thread sender([&] {
+            for (Sequence cycle = 0; cycle < 100; ++cycle) {
+                CHECK(server.send_message(make_enter_message(cycle)));
+                std::this_thread::yield();
+            }
+        });
+
+        Sequence next_cycle = 0;
+        while (next_cycle < 100) {
+            for (const Message& message: client.receive_messages(false)) {
+                CHECK(message.enter.cycle == next_cycle);
+                next_cycle += 1;
+            }
+        }
+        sender.join();
+
+        // The eventfd is left alone.
+        pollfd descriptor = {
+            .fd      = client.file_descriptor(),
+            .events  = POLLIN,
+            .revents = 0,
+        };
+        CHECK(poll(&descriptor, 1, 0) == 0);
+    }
+
 }
@@ -1,3 +1,5 @@
+#include <atomic>
+#include <thread>
 #include "catch.hpp"
 #include "mantle/mantle.h"
 #include "mantle/debug.h"
@@ -193,4 +195,323 @@ TEST_CASE("Handle") {
         }
         CHECK(finalizer.count() == 1);
     }
+
+    SECTION("Bulk clone and drop") {
+        TestObjectFinalizer finalizer(pool);
+        {
+            Domain domain;
+            Region region(domain, finalizer);
+            {
+                std::vector<Handle<TestObject>> handles;
+                while (!pool.empty()) {
+                    handles.push_back(new_test_object());
+                }
+                handles.emplace_back(); // Null handles are cloned as null.
+
+                // Enough clones to fill several staging batches and run past the end of them.
+                std::vector<Handle<TestObject>> clones;
+                for (size_t i = 0; i < 1000; ++i) {
+                    clone_handles(handles, clones);
+                }
+                REQUIRE(clones.size() == (1000 * handles.size()));
+                CHECK(!clones.back());
+                CHECK(clones.front().get() == handles.front().get());
+
+                drop_handles(std::span(handles));
+                for (const Handle<TestObject>& handle: handles) {
+                    CHECK(!handle);
+                }
+
+                // The clones keep the objects alive until they are dropped as well.
+                for (size_t i = 0; i < 100; ++i) {
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+                }
+                CHECK(finalizer.count() == 0);
+
+                drop_handles(std::span(clones));
+            }
+
+            while (finalizer.count() < storage.size()) {
+                constexpr bool non_blocking = true;
+                region.step(non_blocking);
+            }
+        }
+        CHECK(finalizer.count() == storage.size());
+    }
+
+    SECTION("Borrow") {
+        TestObjectFinalizer finalizer(pool);
+        {
+            Domain domain;
+            Region region(domain, finalizer);
+            {
+                auto birth_count = [](Borrow<const TestObject> object) {
+                    return object->birth_count;
+                };
+
+                Handle<TestObject> h0 = new_test_object();
+                Borrow<TestObject> b0 = h0;
+                CHECK(b0.get() == h0.get());
+                CHECK(birth_count(h0) == 1);
+                CHECK(birth_count(b0) == 1);
+                CHECK(!Borrow<TestObject>());
+
+                // Holding on to a borrow takes a reference of its own.
+                Handle<TestObject> h1 = b0.handle();
+                Handle<TestObject> h2 = Borrow<TestObject>().handle();
+                CHECK(h1.get() == h0.get());
+                CHECK(!h2);
+
+                const Region::Epoch epoch = region.epoch();
+                h0.reset();
+                for (size_t i = 0; i < 100; ++i) {
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+                }
+                CHECK(region.epoch() == (epoch + 100));
+                CHECK(finalizer.count() == 0);
+                CHECK(h1->birth_count == 1);
+            }
+
+            while (finalizer.count() < 1) {
+                constexpr bool non_blocking = true;
+                region.step(non_blocking);
+            }
+        }
+        CHECK(finalizer.count() == 1);
+    }
+
+    SECTION("Immortal") {
+        static TestObject singleton;
+
+        TestObjectFinalizer finalizer(pool);
+        {
+            Domain domain;
+            Region region(domain, finalizer);
+            {
+                Handle<TestObject> h0 = make_immortal_handle(singleton);
+                CHECK(h0.is_immortal());
+                CHECK(!new_test_object().is_immortal());
+                CHECK(!Handle<TestObject>().is_immortal());
+
+                std::vector<Handle<TestObject>> copies(100, h0);
+                std::vector<Handle<TestObject>> clones;
+                clone_handles(copies, clones);
+                CHECK(clones.back().is_immortal());
+                drop_handles(std::span(clones));
+                CHECK(!clones.front());
+
+                Borrow<TestObject> b0 = h0;
+                Handle<TestObject> h1 = b0.handle();
+                CHECK(h1.is_immortal());
+
+                AtomicHandle<TestObject> a0(std::move(h1));
+                CHECK(a0.load().is_immortal());
+                CHECK(!h1);
+            }
+
+            for (size_t i = 0; i < 100; ++i) {
+                constexpr bool non_blocking = true;
+                region.step(non_blocking);
+            }
+        }
+        CHECK(finalizer.count() == 1);
+        CHECK(!singleton.is_managed());
+
+        // Without a region there is nothing to leak.
+        Handle<TestObject> h2 = make_immortal_handle(singleton);
+        Handle<TestObject> h3 = h2;
+        CHECK(h3.get() == &singleton);
+    }
+
+    SECTION("Policies") {
+        using WeightedHandle = Handle<TestObject, WeightedReferencePolicy>;
+        using CountedHandle = Handle<TestObject, CountedReferencePolicy>;
+
+        auto new_weighted_test_object = [&]() -> WeightedHandle {
+            TestObject* test_object = pool.back();
+            test_object->birth_count += 1;
+            pool.pop_back();
+
+            return make_handle<WeightedReferencePolicy>(*test_object);
+        };
+
+        SECTION("Weighted") {
+            TestObjectFinalizer finalizer(pool);
+            {
+                Domain domain;
+                Region region(domain, finalizer);
+                {
+                    WeightedHandle h0 = new_weighted_test_object();
+                    CHECK(h0.weight() == 0);
+
+                    // The first copy has to gain weight before it can split.
+                    WeightedHandle h1 = h0;
+                    CHECK(h0.weight() == (Operation::EXPONENT_MAX - 1));
+                    CHECK(h1.weight() == (Operation::EXPONENT_MAX - 1));
+                    CHECK(region.metrics().weight_refill_count == 1);
+
+                    // Further copies split locally until the weight runs out again.
+                    std::vector<WeightedHandle> copies;
+                    while (h0.weight()) {
+                        copies.push_back(h0);
+                    }
+                    CHECK(region.metrics().weight_refill_count == 1);
+
+                    copies.push_back(h0);
+                    CHECK(region.metrics().weight_refill_count == 2);
+                }
+                CHECK(finalizer.count() == 0);
+            }
+            CHECK(finalizer.count() == 1);
+        }
+
+        SECTION("Counted") {
+            TestObjectFinalizer finalizer(pool);
+            {
+                Domain domain;
+                Region region(domain, finalizer);
+                {
+                    CountedHandle h0 = new_test_object();
+                    CountedHandle h1 = h0;
+                    CHECK(h0.weight() == 0);
+                    CHECK(h1.weight() == 0);
+                    CHECK(region.metrics().weight_refill_count == 0);
+                }
+                CHECK(finalizer.count() == 0);
+            }
+            CHECK(finalizer.count() == 1);
+        }
+
+        SECTION("Mixed") {
+            TestObjectFinalizer finalizer(pool);
+            {
+                Domain domain;
+                Region region(domain, finalizer);
+                {
+                    WeightedHandle h0 = new_weighted_test_object();
+                    WeightedHandle h1 = h0;
+
+                    // Copies follow the policy of the handle being copied, so this splits h1.
+                    CountedHandle h2 = h1;
+                    CHECK(h1.weight() == (Operation::EXPONENT_MAX - 2));
+                    CHECK(h2.weight() == (Operation::EXPONENT_MAX - 2));
+
+                    // Weight moves along with the reference.
+                    CountedHandle h3 = std::move(h1);
+                    CHECK(h3.weight() == (Operation::EXPONENT_MAX - 2));
+
+                    // Copying a counted handle leaves its weight alone.
+                    WeightedHandle h4 = h3;
+                    CHECK(h3.weight() == (Operation::EXPONENT_MAX - 2));
+                    CHECK(h4.weight() == 0);
+                    CHECK(region.metrics().weight_refill_count == 1);
+
+                    h0.reset();
+                    h2 = h4;
+                    h4 = h3;
+                }
+                CHECK(finalizer.count() == 0);
+            }
+            CHECK(finalizer.count() == 1);
+        }
+    }
+
+    SECTION("Atomic") {
+        SECTION("Load, store and exchange") {
+            TestObjectFinalizer finalizer(pool);
+            {
+                Domain domain;
+                Region region(domain, finalizer);
+                {
+                    AtomicHandle<TestObject> a0;
+                    CHECK(!a0.load());
+
+                    Handle<TestObject> h0 = new_test_object();
+                    AtomicHandle<TestObject> a1(h0);
+
+                    // Loads take references of their own.
+                    Handle<TestObject> h1 = a1.load();
+                    CHECK(h1.get() == h0.get());
+                    CHECK(h1.weight() == 0);
+
+                    // The value that is replaced is handed back.
+                    Handle<TestObject> h2 = a1.exchange(new_test_object());
+                    CHECK(h2.get() == h0.get());
+                    CHECK(a1.load().get() != h0.get());
+
+                    // Stored values are dropped once nothing else refers to them.
+                    a0.store(a1.load());
+                    a1.store(nullptr);
+                    CHECK(!a1.load());
+                    h0.reset();
+                    h1.reset();
+                    h2.reset();
+
+                    while (finalizer.count() < 1) {
+                        constexpr bool non_blocking = true;
+                        region.step(non_blocking);
+                    }
+                    CHECK(a0.load());
+                }
+
+                while (finalizer.count() < 2) {
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+                }
+            }
+            CHECK(finalizer.count() == 2);
+        }
+
+        SECTION("Concurrent readers") {
+            // A writer in another region keeps publishing new values, and drops each old one as it goes.
+            std::array<TestObject, 64> published;
+            std::vector<TestObject*> published_pool;
+            TestObjectFinalizer published_finalizer(published_pool);
+
+            TestObjectFinalizer finalizer(pool);
+            {
+                Domain domain;
+                Region region(domain, finalizer);
+
+                AtomicHandle<TestObject> current;
+                std::atomic_bool done = false;
+                std::thread writer([&]() {
+                    {
+                        Region other(domain, published_finalizer);
+                        for (TestObject& object: published) {
+                            object.birth_count += 1;
+                            current.store(make_handle(object));
+
+                            for (size_t i = 0; i < 4; ++i) {
+                                constexpr bool non_blocking = true;
+                                other.step(non_blocking);
+                            }
+                        }
+                        current.store(nullptr);
+                    }
+                    done = true;
+                });
+
+                // Whatever we load stays alive for as long as we hold on to it.
+                while (!done.load()) {
+                    if (Handle<TestObject> handle = current.load()) {
+                        CHECK(handle->death_count < handle->birth_count);
+                    }
+
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+                }
+                writer.join();
+
+                while (published_finalizer.count() < published.size()) {
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+                }
+            }
+            CHECK(finalizer.count() == 0);
+            CHECK(published_finalizer.count() == published.size());
+        }
+    }
 }
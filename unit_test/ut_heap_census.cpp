@@ -0,0 +1,178 @@
+#include "catch.hpp"
+#include "mantle/mantle.h"
+#include <deque>
+#include <vector>
+#include <algorithm>
+
+using namespace mantle;
+
+namespace {
+
+    struct CensusTestObject : Object {
+        explicit CensusTestObject(ObjectGroup group = 0)
+            : Object(group)
+        {
+        }
+    };
+
+    class CountingFinalizer final : public ObjectFinalizer {
+    public:
+        size_t count() const {
+            return count_;
+        }
+
+        void finalize(ObjectGroup, std::span<Object*> objects) noexcept override {
+            count_ += objects.size();
+        }
+
+    private:
+        size_t count_ = 0;
+    };
+
+    const ObjectGroupCensus* find_group(const std::vector<ObjectGroupCensus>& census, const ObjectGroup group) {
+        const auto it = std::find_if(census.begin(), census.end(), [group](const ObjectGroupCensus& entry) {
+            return entry.group == group;
+        });
+
+        return (it != census.end()) ? &*it : nullptr;
+    }
+
+}
+
+TEST_CASE("HeapCensus") {
+    SECTION("Sample") {
+        HeapCensus census(2);
+        CHECK(!census.sample_cycle());
+
+        CensusTestObject a(1);
+        CensusTestObject b(1);
+        CensusTestObject c(3);
+
+        HeapCensusDelta delta;
+        delta.bound_groups = {1, 1, 3};
+        census.add(1, delta);
+
+        // Nothing is sampled in odd cycles.
+        census.add_garbage(1, ObjectGroups{});
+        CHECK(!census.sample_cycle());
+
+        CHECK(census.is_sampled(2));
+        census.add_decremented(a);
+        census.add_survivor(a, 1);
+        census.add_survivor(a, 1);
+        census.add_survivor(b, 5);
+        census.add_survivor(c, 1000);
+
+        HeapCensusDelta released;
+        released.released_groups = {1};
+        census.add(2, released);
+        census.add_garbage(2, ObjectGroups{});
+
+        REQUIRE(census.sample_cycle() == 2);
+        REQUIRE(census.sample().size() == 2);
+
+        const ObjectGroupCensus& first = census.sample()[0];
+        CHECK(first.group == 1);
+        CHECK(first.live_count == 1);
+        CHECK(first.pending_decrement_count == 1);
+        CHECK(first.finalized_count == 1);
+        CHECK(first.reference_counts[0] == 1);
+        CHECK(first.reference_counts[2] == 1);
+
+        const ObjectGroupCensus& second = census.sample()[1];
+        CHECK(second.group == 3);
+        CHECK(second.live_count == 1);
+        CHECK(second.reference_counts[HEAP_CENSUS_BUCKET_COUNT - 1] == 1);
+
+        // The next sample only carries over the live counts.
+        census.add_garbage(4, ObjectGroups{});
+        REQUIRE(census.sample().size() == 2);
+        CHECK(census.sample()[0].live_count == 1);
+        CHECK(census.sample()[0].finalized_count == 0);
+        CHECK(census.sample()[0].reference_counts[0] == 0);
+    }
+
+    SECTION("Merge") {
+        std::vector<ObjectGroupCensus> total = {
+            { .group = 0, .live_count = 1 },
+            { .group = 2, .live_count = 2 },
+        };
+        const std::vector<ObjectGroupCensus> census = {
+            { .group = 1, .live_count = 4 },
+            { .group = 2, .live_count = 8, .finalized_count = 1 },
+        };
+
+        HeapCensus::merge(total, census);
+
+        REQUIRE(total.size() == 3);
+        CHECK(total[0].group == 0);
+        CHECK(total[1].group == 1);
+        CHECK(total[1].live_count == 4);
+        CHECK(total[2].group == 2);
+        CHECK(total[2].live_count == 10);
+        CHECK(total[2].finalized_count == 1);
+    }
+
+    SECTION("Domain") {
+        static constexpr size_t OBJECT_COUNT = 12;
+
+        Config config;
+        config.heap_census_interval = 1;
+
+        CountingFinalizer finalizer;
+        std::deque<CensusTestObject> objects;
+        for (size_t i = 0; i < OBJECT_COUNT; ++i) {
+            objects.emplace_back(static_cast<ObjectGroup>(i % 3));
+        }
+
+        Domain domain(config);
+        Region region(domain, finalizer);
+
+        {
+            std::vector<Handle<CensusTestObject>> handles;
+            for (CensusTestObject& object: objects) {
+                handles.push_back(make_handle(object));
+            }
+            const std::vector<Handle<CensusTestObject>> copies = handles;
+
+            // Every object is counted as live once the region has submitted what it bound.
+            bool counted = false;
+            size_t step_count = 0;
+            while (!counted) {
+                constexpr bool non_blocking = true;
+                region.step(non_blocking);
+
+                const Domain::Metrics metrics = domain.snapshot_metrics();
+                counted = metrics.heap_census_cycle && (metrics.heap_census.size() == 3);
+                for (const ObjectGroupCensus& census: metrics.heap_census) {
+                    counted &= census.live_count == (OBJECT_COUNT / 3);
+                }
+
+                step_count += 1;
+                REQUIRE(step_count < 1000000);
+            }
+
+            const Domain::Metrics metrics = domain.snapshot_metrics();
+            REQUIRE(metrics.regions.size() == 1);
+            CHECK(metrics.regions[0].heap_census.size() == 3);
+        }
+
+        // Once everything is finalized no group has anything left alive.
+        bool released = false;
+        size_t step_count = 0;
+        while (!released) {
+            constexpr bool non_blocking = true;
+            region.step(non_blocking);
+
+            const Domain::Metrics metrics = domain.snapshot_metrics();
+            released = finalizer.count() == OBJECT_COUNT;
+            for (ObjectGroup group = 0; group < 3; ++group) {
+                const ObjectGroupCensus* census = find_group(metrics.heap_census, group);
+                released &= (census == nullptr) || (census->live_count == 0);
+            }
+
+            step_count += 1;
+            REQUIRE(step_count < 1000000);
+        }
+    }
+}
@@ -64,4 +64,46 @@ TEST_CASE("Ledger") {
     }
 
     thread.join();
+
+    // Segments beyond the high watermark are released once they are idle.
+    SECTION("Segment pool") {
+        WriteBarrierManager pool_manager(1, 2);
+        pool_manager.maintain();
+        CHECK(pool_manager.metrics().resident_count == 1);
+
+        // A burst of operations that needs a few segments on top of one per barrier.
+        std::atomic_bool pool_done = false;
+        std::thread pool_thread([&]() {
+            {
+                Ledger ledger(pool_manager);
+                for (size_t i = 0; i < 4 * WRITE_BARRIER_CAPACITY; ++i) {
+                    increment_ref_cnt(object);
+                }
+
+                for (size_t i = 0; i < WRITE_BARRIER_PHASE_COUNT; ++i) {
+                    ledger.step();
+                }
+            }
+
+            pool_done = true;
+        });
+
+        while (!pool_done) {
+            pool_manager.poll();
+        }
+
+        pool_thread.join();
+
+        // Every segment is idle again, but only the high watermark's worth stays resident.
+        const WriteBarrierManager::Metrics spike_metrics = pool_manager.metrics();
+        CHECK(spike_metrics.segment_count > WRITE_BARRIER_PHASE_COUNT);
+        CHECK(spike_metrics.resident_count == spike_metrics.segment_count);
+
+        pool_manager.maintain();
+
+        const WriteBarrierManager::Metrics metrics = pool_manager.metrics();
+        CHECK(metrics.segment_count == spike_metrics.segment_count);
+        CHECK(metrics.resident_count == 2);
+        CHECK(metrics.released_count == (metrics.segment_count - 2));
+    }
 }
@@ -0,0 +1,130 @@
+#include "catch.hpp"
+#include "mantle/mantle.h"
+#include <deque>
+#include <vector>
+#include <sstream>
+#include <string>
+
+using namespace mantle;
+
+namespace {
+
+    struct RecordingTestObject : Object {
+        explicit RecordingTestObject(ObjectGroup group = 0)
+            : Object(group)
+        {
+        }
+    };
+
+    class CountingFinalizer final : public ObjectFinalizer {
+    public:
+        size_t count() const {
+            return count_;
+        }
+
+        void finalize(ObjectGroup, std::span<Object*> objects) noexcept override {
+            count_ += objects.size();
+        }
+
+    private:
+        size_t count_ = 0;
+    };
+
+}
+
+TEST_CASE("LedgerRecording") {
+    static constexpr size_t OBJECT_COUNT = 16;
+
+    // Record a domain where every object is copied a few times and then dropped.
+    std::stringstream stream;
+    size_t recorded_count = 0;
+    size_t recorded_object_count = 0;
+    {
+        LedgerRecorder recorder(stream);
+
+        Config config;
+        config.ledger_recorder = &recorder;
+
+        CountingFinalizer finalizer;
+        std::deque<RecordingTestObject> objects;
+        for (size_t i = 0; i < OBJECT_COUNT; ++i) {
+            objects.emplace_back(static_cast<ObjectGroup>(i % 3));
+        }
+        {
+            Domain domain(config);
+            Region region(domain, finalizer);
+            {
+                std::vector<Handle<RecordingTestObject>> handles;
+                for (RecordingTestObject& object: objects) {
+                    handles.push_back(make_handle(object));
+                }
+
+                for (size_t round = 0; round < 4; ++round) {
+                    std::vector<Handle<RecordingTestObject>> copies = handles;
+
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+                }
+            }
+
+            while (finalizer.count() < OBJECT_COUNT) {
+                constexpr bool non_blocking = true;
+                region.step(non_blocking);
+            }
+        }
+
+        recorded_count = recorder.operation_count();
+        recorded_object_count = recorder.object_count();
+    }
+
+    const std::string bytes = stream.str();
+
+    SECTION("Read back") {
+        std::istringstream input(bytes);
+        const LedgerRecording recording = LedgerRecording::read(input);
+
+        CHECK(recorded_count > 0);
+        CHECK(recording.operation_count() == recorded_count);
+        CHECK(recording.objects.size() == recorded_object_count);
+        CHECK(recording.objects.size() == OBJECT_COUNT);
+        CHECK(recording.region_count() == 1);
+        CHECK(!recording.cycles.empty());
+
+        for (size_t i = 1; i < recording.cycles.size(); ++i) {
+            CHECK(recording.cycles[i - 1].cycle < recording.cycles[i].cycle);
+        }
+    }
+
+    SECTION("Replay") {
+        std::istringstream input(bytes);
+        const LedgerRecording recording = LedgerRecording::read(input);
+
+        for (const bool pipeline_cycles: {false, true}) {
+            Config config;
+            config.pipeline_cycles = pipeline_cycles;
+            config.operation_grouper_engine = GrouperEngine::RADIX;
+
+            LedgerReplay replay(recording, config);
+            const LedgerReplayMetrics metrics = replay.run();
+
+            // Every object dies exactly once, as it did when it was recorded.
+            CHECK(metrics.operation_count == recording.operation_count());
+            CHECK(metrics.finalized_count == OBJECT_COUNT);
+            CHECK(metrics.revived_count == 0);
+            CHECK(metrics.cycle_count >= recording.cycles.size());
+            CHECK(metrics.applied_count <= metrics.operation_count);
+            CHECK(metrics.grouper_hit_rate() >= 0.0);
+        }
+    }
+
+    SECTION("Truncated") {
+        std::istringstream input(bytes.substr(0, bytes.size() - 1));
+        const LedgerRecording recording = LedgerRecording::read(input);
+        CHECK(recording.operation_count() < recorded_count);
+    }
+
+    SECTION("Not a recording") {
+        std::istringstream input("MANTLE");
+        CHECK_THROWS_AS(LedgerRecording::read(input), std::runtime_error);
+    }
+}
@@ -0,0 +1,56 @@
+#include "catch.hpp"
+#include "mantle/memory_mapping.h"
+#include "mantle/operation_ledger.h"
+#include "mantle/util.h"
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+using namespace mantle;
+
+TEST_CASE("MemoryMapping") {
+    SECTION("Mapping sizes") {
+        CHECK(mapping_size(1, HugePagePolicy::NONE) == PAGE_SIZE);
+        CHECK(mapping_size(PAGE_SIZE + 1, HugePagePolicy::NONE) == 2 * PAGE_SIZE);
+        CHECK(mapping_size(1, HugePagePolicy::TRANSPARENT) == HUGE_PAGE_SIZE);
+        CHECK(mapping_size(HUGE_PAGE_SIZE, HugePagePolicy::EXPLICIT) == HUGE_PAGE_SIZE);
+    }
+
+    // Explicit huge pages are usually not reserved, so this also covers the fallback.
+    SECTION("Map and unmap") {
+        for (const HugePagePolicy policy: {HugePagePolicy::NONE, HugePagePolicy::TRANSPARENT, HugePagePolicy::EXPLICIT}) {
+            const size_t size = HUGE_PAGE_SIZE + PAGE_SIZE;
+
+            std::span<std::byte> memory = map_memory(size, policy);
+            REQUIRE(memory.size() == mapping_size(size, policy));
+            if (policy != HugePagePolicy::NONE) {
+                CHECK((reinterpret_cast<uintptr_t>(memory.data()) % HUGE_PAGE_SIZE) == 0);
+            }
+
+            memset(memory.data(), 0xff, memory.size());
+            unmap_memory(memory.first(size), policy);
+        }
+    }
+
+    SECTION("Preferred NUMA node") {
+        const std::optional<size_t> node = current_numa_node();
+        REQUIRE(node);
+        CHECK(!numa_node_cpus(*node).empty());
+
+        MappedAllocator<uint64_t> allocator(HugePagePolicy::NONE, node);
+        std::vector<uint64_t, MappedAllocator<uint64_t>> values(1024 * 1024, 0, allocator);
+        CHECK(values.get_allocator().numa_node() == node);
+    }
+
+    SECTION("Huge page backed ledger") {
+        OperationLedger ledger(1024 * 1024, HugePagePolicy::TRANSPARENT);
+
+        ledger.begin_transaction();
+        const size_t count = ledger.writable_transaction_entries();
+        for (size_t i = 0; i < count; ++i) {
+            REQUIRE(ledger.write(make_operation(nullptr, OperationType::INCREMENT)));
+        }
+        CHECK(!ledger.write(make_operation(nullptr, OperationType::INCREMENT)));
+        CHECK(ledger.commit_transaction().size() == count);
+    }
+}
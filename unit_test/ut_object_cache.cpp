@@ -0,0 +1,93 @@
+#include "catch.hpp"
+#include "mantle/object_cache.h"
+
+using namespace mantle;
+
+TEST_CASE("ObjectCache") {
+    using Cache = ObjectCache<int, 8>;
+    using Cursor = Cache::Cursor;
+
+    static constexpr size_t CACHE_WAYS = 8;
+
+    auto cache = std::make_unique<Cache>(64);
+
+    // Allocate enough objects that several of them land in the same set.
+    std::vector<Object> objects(cache->size() * 2);
+
+    auto objects_in_set = [&](size_t set) {
+        std::vector<Object*> result;
+        for (Object& object: objects) {
+            if (cache->to_set(&object) == set) {
+                result.push_back(&object);
+            }
+        }
+
+        return result;
+    };
+
+    SECTION("Empty") {
+        for (size_t set = 0; set < cache->sets(); ++set) {
+            CHECK(cache->live_ways(set) == 0);
+        }
+
+        CHECK(cache->matching_ways(cache->to_set(&objects[0]), &objects[0]) == 0);
+    }
+
+    SECTION("Probe") {
+        const size_t set = cache->to_set(&objects[0]);
+        std::vector<Object*> members = objects_in_set(set);
+        REQUIRE(members.size() >= CACHE_WAYS + 1);
+
+        // Fill the odd ways.
+        for (size_t way = 1; way < CACHE_WAYS; way += 2) {
+            cache->store(Cursor(set, way), {.key = members[way], .val = static_cast<int>(way)});
+        }
+        CHECK(cache->live_ways(set) == 0b10101010);
+
+        for (size_t way = 0; way < CACHE_WAYS; ++way) {
+            const Cache::WayMask expected = (way % 2) ? (Cache::WayMask{1} << way) : 0;
+            CHECK(cache->matching_ways(set, members[way]) == expected);
+        }
+
+        // An object that isn't cached shouldn't match anything.
+        CHECK(cache->matching_ways(set, members[CACHE_WAYS]) == 0);
+
+        // Resetting an entry should clear its live bit and prevent matches.
+        cache->reset(Cursor(set, 3));
+        CHECK(cache->live_ways(set) == 0b10100010);
+        CHECK(cache->matching_ways(set, members[3]) == 0);
+
+        // Duplicate keys in a set are all reported.
+        cache->store(Cursor(set, 0), {.key = members[1], .val = 0});
+        CHECK(cache->matching_ways(set, members[1]) == 0b00000011);
+
+        // Storing a null key clears the live bit.
+        cache->store(Cursor(set, 0), {.key = nullptr, .val = 0});
+        CHECK(cache->live_ways(set) == 0b10100010);
+
+        cache->reset();
+        CHECK(cache->live_ways(set) == 0);
+    }
+
+    SECTION("Sizing") {
+        CHECK(cache->sets() == 8);
+        CHECK(Cache(100).size() == 128);
+        CHECK(Cache(1).size() == CACHE_WAYS);
+
+        // Every position is visited once, set by set.
+        size_t count = 0;
+        for (Cursor cursor = cache->begin(); cursor != cache->end(); cursor.advance()) {
+            CHECK(cursor.set() == count / CACHE_WAYS);
+            CHECK(cursor.way() == count % CACHE_WAYS);
+            count += 1;
+        }
+        CHECK(count == cache->size());
+
+        // Larger caches spread objects over more sets.
+        Cache larger(1024);
+        CHECK(larger.sets() == 128);
+        for (Object& object: objects) {
+            CHECK(larger.to_set(&object) % cache->sets() == cache->to_set(&object));
+        }
+    }
+}
@@ -0,0 +1,81 @@
+#include "catch.hpp"
+#include "mantle/object_finalizer.h"
+#include <array>
+#include <vector>
+
+using namespace mantle;
+
+namespace {
+
+    struct SmallObject : Object {
+        SmallObject()
+            : Object(1)
+        {
+        }
+    };
+
+    struct Payload {
+        uint64_t values[4] = {};
+    };
+
+    // The `Object` base isn't at the start of this class.
+    struct LargeObject : Payload, Object {
+        explicit LargeObject(uint64_t value)
+            : Object(7)
+        {
+            values[0] = value;
+        }
+    };
+
+    class TestFinalizer final : public TypedObjectFinalizer<TestFinalizer, ObjectGroupType<1, SmallObject>, ObjectGroupType<7, LargeObject>> {
+    public:
+        using TypedObjectFinalizer::finalize;
+
+        void finalize(std::span<SmallObject*> objects) noexcept {
+            small_count += objects.size();
+            batch_count += 1;
+        }
+
+        void finalize(std::span<LargeObject*> objects) noexcept {
+            for (LargeObject* object: objects) {
+                large_sum += object->values[0];
+            }
+        }
+
+        size_t   small_count = 0;
+        size_t   batch_count = 0;
+        uint64_t large_sum   = 0;
+    };
+
+}
+
+TEST_CASE("TypedObjectFinalizer") {
+    TestFinalizer finalizer;
+    ObjectFinalizer& base = finalizer;
+
+    SECTION("Dispatch by group") {
+        std::array<LargeObject, 3> large_objects = { LargeObject(1), LargeObject(2), LargeObject(3) };
+
+        std::vector<Object*> objects;
+        for (LargeObject& object: large_objects) {
+            objects.push_back(&object);
+        }
+
+        base.finalize(7, objects);
+        CHECK(finalizer.large_sum == 6);
+        CHECK(finalizer.small_count == 0);
+    }
+
+    SECTION("Large groups are split into batches") {
+        std::vector<SmallObject> small_objects(FINALIZATION_BATCH_SIZE + 1);
+
+        std::vector<Object*> objects;
+        for (SmallObject& object: small_objects) {
+            objects.push_back(&object);
+        }
+
+        base.finalize(1, objects);
+        CHECK(finalizer.small_count == small_objects.size());
+        CHECK(finalizer.batch_count == 2);
+    }
+}
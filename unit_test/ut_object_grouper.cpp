@@ -37,5 +37,30 @@ TEST_CASE("ObjectGrouper") {
             REQUIRE(groups.group_member_count(3) == 1);
             CHECK(groups.group_members(3)[0] == &object3);
         }
+
+        // Groups far apart, including the last one, and none of the groups from before.
+        Object object4(std::numeric_limits<ObjectGroup>::max());
+        Object object5(1000);
+
+        grouper.write(object4);
+        grouper.write(object5);
+
+        ObjectGroups groups = grouper.flush();
+        CHECK(groups.object_count == 2);
+        CHECK(groups.group_member_count(1) == 0);
+        CHECK(groups.group_member_count(3) == 0);
+
+        std::vector<ObjectGroup> visited;
+        groups.for_each_group([&](ObjectGroup group, std::span<Object*> members) {
+            REQUIRE(members.size() == 1);
+            CHECK(members[0]->group() == group);
+            visited.push_back(group);
+        });
+        CHECK(visited == std::vector<ObjectGroup>{ 1000, std::numeric_limits<ObjectGroup>::max() });
+
+        // Nothing is left over once everything has been flushed.
+        groups = grouper.flush();
+        CHECK(groups.object_count == 0);
+        CHECK(groups.group_member_count(1000) == 0);
     }
 }
@@ -0,0 +1,106 @@
+#include "catch.hpp"
+#include "mantle/operation_combiner.h"
+#include <vector>
+#include <array>
+
+using namespace mantle;
+
+TEST_CASE("OperationCombiner") {
+    std::vector<Object> objects(64);
+
+    OperationCombiner combiner(objects.size());
+    REQUIRE(combiner.is_enabled());
+    CHECK(combiner.capacity() == 64);
+    CHECK(!OperationCombiner().is_enabled());
+
+    std::vector<Operation> emitted;
+    auto sink = [&](const Operation operation) {
+        emitted.push_back(operation);
+        return true;
+    };
+
+    auto net_delta = [&](const Object& object) {
+        int64_t delta = 0;
+        for (const Operation operation: emitted) {
+            if (operation.object() == &object) {
+                delta += operation.value();
+            }
+        }
+
+        return delta;
+    };
+
+    SECTION("Folding") {
+        // Copies that are dropped again cancel out completely.
+        for (size_t i = 0; i < 100; ++i) {
+            combiner.write(make_increment_operation(&objects[0]), sink);
+            combiner.write(make_decrement_operation(&objects[0]), sink);
+        }
+        combiner.write(make_decrement_operation(&objects[1]), sink);
+        CHECK(emitted.empty());
+        CHECK(!combiner.is_empty());
+
+        CHECK(combiner.flush(sink));
+        CHECK(combiner.is_empty());
+        REQUIRE(emitted.size() == 1);
+        CHECK(emitted[0] == make_decrement_operation(&objects[1]));
+        CHECK(combiner.written_count() == 201);
+        CHECK(combiner.emitted_count() == 1);
+    }
+
+    SECTION("Encoding") {
+        // A delta is written as operations that each take it to the nearest power of two.
+        combiner.write(make_increment_operation(&objects[0], Operation::EXPONENT_MAX), sink);
+        combiner.write(make_decrement_operation(&objects[0]), sink);
+        for (size_t i = 0; i < 3; ++i) {
+            combiner.write(make_increment_operation(&objects[1], Operation::EXPONENT_MAX), sink);
+        }
+
+        CHECK(combiner.flush(sink));
+        CHECK(net_delta(objects[0]) == 127);
+        CHECK(net_delta(objects[1]) == 384);
+        CHECK(emitted.size() == 5);
+    }
+
+    SECTION("Eviction") {
+        // With a single slot, every object evicts the one before it.
+        OperationCombiner small(1);
+        small.write(make_increment_operation(&objects[0]), sink);
+        small.write(make_increment_operation(&objects[0]), sink);
+        CHECK(emitted.empty());
+
+        small.write(make_decrement_operation(&objects[1]), sink);
+        CHECK(net_delta(objects[0]) == 2);
+        CHECK(net_delta(objects[1]) == 0);
+
+        CHECK(small.flush(sink));
+        CHECK(net_delta(objects[1]) == -1);
+    }
+
+    SECTION("Partial flush") {
+        for (Object& object: objects) {
+            combiner.write(make_increment_operation(&object), sink);
+        }
+
+        // A sink that runs out of room leaves the rest in the cache.
+        size_t room = 10;
+        auto limited_sink = [&](const Operation operation) {
+            if (room == 0) {
+                return false;
+            }
+
+            room -= 1;
+            return sink(operation);
+        };
+
+        CHECK(!combiner.flush(limited_sink));
+        CHECK(emitted.size() == 10);
+        CHECK(!combiner.is_empty());
+
+        CHECK(combiner.flush(sink));
+        CHECK(emitted.size() == objects.size());
+        for (Object& object: objects) {
+            CHECK(net_delta(object) == 1);
+        }
+    }
+}
@@ -87,4 +87,222 @@ TEST_CASE("OperationGrouper") {
 
         grouper.clear();
     }
+
+    SECTION("Retiring operations") {
+        grouper.write(make_increment_operation(&objects[0], 0), true);
+        grouper.write(make_decrement_operation(&objects[1], 0), true);
+        grouper.retire();
+        CHECK(grouper.has_retired());
+        CHECK(increment_count() == 0);
+        CHECK(decrement_count() == 0);
+
+        // New operations are kept apart from the ones that were set aside.
+        grouper.write(make_increment_operation(&objects[2], 1), true);
+        REQUIRE(increment_count() == 1);
+        CHECK(increment_at(0).first == &objects[2]);
+
+        REQUIRE(grouper.retired_increments().size() == 1);
+        CHECK(grouper.retired_increments()[0].first == &objects[0]);
+        REQUIRE(grouper.retired_decrements().size() == 1);
+        CHECK(grouper.retired_decrements()[0].first == &objects[1]);
+
+        grouper.clear_retired();
+        CHECK(!grouper.has_retired());
+
+        grouper.retire();
+        REQUIRE(grouper.retired_increments().size() == 1);
+        CHECK(grouper.retired_increments()[0].second == +2);
+        grouper.clear_retired();
+    }
+
+    SECTION("Cache") {
+        std::vector<Object> cache_objects(1024);
+
+        // Returns whether this object's group was flushed to the increment collection.
+        auto was_flushed = [](OperationGrouper& cache_grouper, const Object& object) {
+            for (auto&& [key, delta]: cache_grouper.increments()) {
+                if (key == &object) {
+                    return true;
+                }
+            }
+
+            return false;
+        };
+
+        SECTION("Fixed size") {
+            OperationGrouper cache_grouper(100);
+            CHECK(cache_grouper.cache_capacity() == 128);
+
+            for (Object& object: cache_objects) {
+                cache_grouper.write(make_increment_operation(&object, 0));
+            }
+            CHECK(cache_grouper.metrics().evicted_count > 0);
+
+            cache_grouper.retire();
+            cache_grouper.clear_retired();
+            CHECK(cache_grouper.cache_capacity() == 128);
+            CHECK(cache_grouper.metrics().resize_count == 0);
+        }
+
+        SECTION("Adaptive size") {
+            OperationGrouper cache_grouper(64, 256);
+            CHECK(cache_grouper.cache_capacity() == 64);
+
+            // Far more cache_objects than fit in the cache, so most of them evict another group.
+            auto write_all = [&]() {
+                for (Object& object: cache_objects) {
+                    cache_grouper.write(make_increment_operation(&object, 0));
+                }
+
+                cache_grouper.retire();
+                cache_grouper.clear_retired();
+            };
+
+            write_all();
+            CHECK(cache_grouper.cache_capacity() == 128);
+            CHECK(!cache_grouper.is_dirty());
+
+            write_all();
+            CHECK(cache_grouper.cache_capacity() == 256);
+
+            write_all();
+            CHECK(cache_grouper.cache_capacity() == 256);
+            CHECK(cache_grouper.metrics().cache_capacity == 256);
+            CHECK(cache_grouper.metrics().resize_count == 2);
+
+            // Idle cycles shrink the cache back down, but never below its initial size.
+            for (size_t cycle = 0; cycle < 64; ++cycle) {
+                cache_grouper.retire();
+                cache_grouper.clear_retired();
+            }
+            CHECK(cache_grouper.cache_capacity() == 64);
+            CHECK(cache_grouper.metrics().resize_count == 4);
+        }
+
+        SECTION("Eviction policies") {
+            // A single set, so every object competes for the same ways.
+            auto fill_set = [&](OperationGrouper& cache_grouper) {
+                REQUIRE(cache_grouper.cache_capacity() == 8);
+
+                // The first group is small but has been hit a few times, the others are large.
+                cache_grouper.write(make_increment_operation(&cache_objects[0], 0));
+                cache_grouper.write(make_increment_operation(&cache_objects[0], 0));
+                cache_grouper.write(make_increment_operation(&cache_objects[0], 0));
+                for (size_t index = 1; index < 8; ++index) {
+                    cache_grouper.write(make_increment_operation(&cache_objects[index], 2));
+                }
+                CHECK(cache_grouper.increments().empty());
+
+                cache_grouper.write(make_increment_operation(&cache_objects[8], 0));
+                CHECK(cache_grouper.increments().size() == 1);
+            };
+
+            SECTION("Smallest delta") {
+                OperationGrouper cache_grouper(8, 0, GrouperEvictionPolicy::SMALLEST_DELTA);
+                fill_set(cache_grouper);
+                CHECK(was_flushed(cache_grouper, cache_objects[0]));
+            }
+
+            SECTION("Fewest hits") {
+                OperationGrouper cache_grouper(8, 0, GrouperEvictionPolicy::FEWEST_HITS);
+                fill_set(cache_grouper);
+                CHECK(was_flushed(cache_grouper, cache_objects[1]));
+            }
+
+            SECTION("Retention") {
+                // Hot groups survive a flush, unless every group is flushed each cycle.
+                for (const GrouperEvictionPolicy eviction: {GrouperEvictionPolicy::SMALLEST_DELTA, GrouperEvictionPolicy::EVERY_CYCLE}) {
+                    OperationGrouper cache_grouper(8, 0, eviction);
+                    for (size_t hit = 0; hit < 4; ++hit) {
+                        cache_grouper.write(make_increment_operation(&cache_objects[0], 0));
+                    }
+
+                    cache_grouper.flush();
+                    CHECK(cache_grouper.is_dirty() == (eviction != GrouperEvictionPolicy::EVERY_CYCLE));
+                    CHECK(was_flushed(cache_grouper, cache_objects[0]) == (eviction == GrouperEvictionPolicy::EVERY_CYCLE));
+                    cache_grouper.reset();
+                }
+            }
+        }
+    }
+
+    SECTION("Radix engine") {
+        size_t object_count = 0;
+
+        // Small collections are sorted in place, large ones are radix sorted.
+        SECTION("Small") {
+            object_count = 16;
+        }
+
+        SECTION("Large") {
+            object_count = 1024;
+        }
+
+        std::vector<Object> radix_objects(object_count);
+
+        OperationGrouper radix_grouper(OPERATION_GROUPER_CACHE_SIZE, 0, GrouperEvictionPolicy::SMALLEST_DELTA, GrouperEngine::RADIX);
+
+        // Write operations out of order. Even radix_objects end up incremented by their index, odd ones
+        // decremented, and every fourth object cancels out completely.
+        std::vector<size_t> order;
+        for (size_t round = 0; round < 3; ++round) {
+            for (size_t index = 0; index < object_count; ++index) {
+                order.push_back((index * 7919) % object_count);
+            }
+        }
+
+        size_t written_count = 0;
+        for (size_t round = 0; round < 3; ++round) {
+            for (size_t i = 0; i < object_count; ++i) {
+                const size_t index = order[(round * object_count) + i];
+                Object* object = &radix_objects[index];
+
+                if ((index % 4) == 0) {
+                    radix_grouper.write((round == 1) ? make_decrement_operation(object) : make_increment_operation(object));
+                    if (round == 2) {
+                        radix_grouper.write(make_decrement_operation(object));
+                        written_count += 1;
+                    }
+                }
+                else if ((index % 2) == 0) {
+                    radix_grouper.write(make_increment_operation(object));
+                }
+                else {
+                    radix_grouper.write(make_decrement_operation(object), true);
+                }
+
+                written_count += 1;
+            }
+        }
+
+        // Nothing is held back in a cache.
+        CHECK(!radix_grouper.is_dirty());
+
+        radix_grouper.retire();
+        auto increments = radix_grouper.retired_increments();
+        auto decrements = radix_grouper.retired_decrements();
+
+        CHECK(increments.size() == (object_count / 4));
+        CHECK(decrements.size() == (object_count / 2));
+        CHECK(radix_grouper.metrics().grouped_count == (written_count - increments.size() - decrements.size()));
+
+        // Both collections are in address order, with one entry per object.
+        for (auto collection: {increments, decrements}) {
+            for (size_t i = 1; i < collection.size(); ++i) {
+                CHECK(collection[i - 1].first < collection[i].first);
+            }
+        }
+
+        for (auto&& [object, delta]: increments) {
+            CHECK(((object - radix_objects.data()) % 4) == 2);
+            CHECK(delta == +3);
+        }
+
+        for (auto&& [object, delta]: decrements) {
+            CHECK(((object - radix_objects.data()) % 2) == 1);
+            CHECK(delta == -3);
+        }
+
+        radix_grouper.clear_retired();
+    }
 }
@@ -1,6 +1,8 @@
 #include "catch.hpp"
 #include "mantle/operation_ledger.h"
+#include <vector>
 #include <cstring>
+#include <sys/mman.h>
 
 using namespace mantle;
 
@@ -54,4 +56,149 @@ TEST_CASE("OperationLedger") {
             }
         }
     }
+
+    SECTION("Decommit") {
+        static constexpr size_t DECOMMIT_LEDGER_CAPACITY = 64 * 1024;
+        static constexpr size_t DECOMMIT_CYCLES = 4;
+
+        auto resident_pages = [](std::span<const std::byte> memory) {
+            std::vector<unsigned char> pages(memory.size() / PAGE_SIZE);
+            REQUIRE(mincore(const_cast<std::byte*>(memory.data()), memory.size(), pages.data()) == 0);
+
+            size_t count = 0;
+            for (unsigned char page: pages) {
+                count += page & 1;
+            }
+            return count;
+        };
+
+        // Both encodings give their pages back, each at its own entry size.
+        LedgerEncoding encoding = LedgerEncoding::FULL;
+        size_t entry_size = sizeof(Operation);
+        size_t batch_size = OperationBatch::SIZE;
+
+        SECTION("Full") {}
+
+        SECTION("Compact") {
+            encoding = LedgerEncoding::COMPACT;
+            entry_size = sizeof(CompactOperation);
+            batch_size = CompactOperationBatch::SIZE;
+        }
+
+        OperationLedger decommit_ledger(DECOMMIT_LEDGER_CAPACITY, HugePagePolicy::NONE, std::nullopt, 0.125, DECOMMIT_CYCLES, encoding);
+        // Any address at all, as long as every operation stays within the compact window.
+        const uintptr_t address = uintptr_t{1} << 40;
+        Object* object;
+        memcpy(&object, &address, sizeof(object)); // U.B.
+        const Operation operation = make_operation(object, OperationType::INCREMENT);
+
+        // Nothing is committed until it is written.
+        CHECK(resident_pages(decommit_ledger.memory()) == 0);
+
+        decommit_ledger.begin_transaction();
+        for (size_t i = 0; i < (DECOMMIT_LEDGER_CAPACITY / 2); ++i) {
+            REQUIRE(decommit_ledger.write(operation));
+        }
+        decommit_ledger.commit_transaction();
+        CHECK(decommit_ledger.escaped_count() == 0);
+
+        const size_t written_pages = (DECOMMIT_LEDGER_CAPACITY / 2) * entry_size / PAGE_SIZE;
+        CHECK(resident_pages(decommit_ledger.memory()) >= written_pages);
+
+        // Pages are kept while the transaction is still in the ledger.
+        decommit_ledger.begin_transaction();
+        CHECK(decommit_ledger.decommit_count() == 0);
+        decommit_ledger.commit_transaction();
+
+        // Once the transaction has rolled off and the ledger has stayed quiet for a while,
+        // the pages it used are given back.
+        for (size_t i = 0; i < (decommit_ledger.transaction_log().capacity() + DECOMMIT_CYCLES); ++i) {
+            decommit_ledger.begin_transaction();
+            decommit_ledger.commit_transaction();
+        }
+        CHECK(decommit_ledger.decommit_count() == 1);
+        CHECK(resident_pages(decommit_ledger.memory()) < written_pages);
+
+        // A trickle of operations after that only keeps the pages it touches committed.
+        static constexpr size_t TRICKLE_TRANSACTIONS = 100;
+        for (size_t i = 0; i < TRICKLE_TRANSACTIONS; ++i) {
+            decommit_ledger.begin_transaction();
+            for (size_t j = 0; j < batch_size; ++j) {
+                REQUIRE(decommit_ledger.write(operation));
+            }
+            decommit_ledger.commit_transaction();
+        }
+        CHECK(resident_pages(decommit_ledger.memory()) <= (((TRICKLE_TRANSACTIONS * batch_size * entry_size) / PAGE_SIZE) + 1));
+    }
+
+    SECTION("Compact encoding") {
+        static constexpr size_t OBJECT_COUNT = 100;
+
+        OperationLedger compact_ledger(OPERATION_LEDGER_CAPACITY, HugePagePolicy::NONE, std::nullopt, LEDGER_DECOMMIT_FILL, LEDGER_DECOMMIT_CYCLES, LedgerEncoding::COMPACT);
+        CHECK(compact_ledger.encoding() == LedgerEncoding::COMPACT);
+        CHECK(compact_ledger.memory().size() == (OPERATION_LEDGER_CAPACITY * sizeof(CompactOperation)));
+
+        auto make_object = [](uintptr_t address) {
+            Object* object;
+            memcpy(&object, &address, sizeof(object)); // U.B.
+            return object;
+        };
+
+        // Nearby objects are compacted, and ones outside the window are escaped.
+        const uintptr_t base = uintptr_t{1} << 40;
+        std::vector<Operation> compact_operations;
+        for (size_t i = 0; i < OBJECT_COUNT; ++i) {
+            const OperationType type = ((i % 2) == 0) ? OperationType::INCREMENT : OperationType::DECREMENT;
+            const uint8_t exponent = i & Operation::EXPONENT_MASK;
+            const uintptr_t address = ((i % 10) == 9) ? (base << 2) + (i * 16) : base + (i * 32);
+
+            compact_operations.push_back(make_operation(make_object(address), type, exponent));
+        }
+
+        auto read_transaction = [&](const SequenceRange range) {
+            std::vector<Operation> read;
+            compact_ledger.for_each_operation(range, [&](const Operation operation) {
+                if (operation) {
+                    read.push_back(operation);
+                }
+            });
+            return read;
+        };
+
+        SECTION("Round trip") {
+            for (size_t i = 0; i < 3; ++i) {
+                compact_ledger.begin_transaction();
+                for (const Operation operation: compact_operations) {
+                    REQUIRE(compact_ledger.write(operation));
+                }
+
+                const SequenceRange range = compact_ledger.commit_transaction();
+                CHECK(range.size() == (CompactOperationBatch::SIZE * ((OBJECT_COUNT + (10 * 2) + CompactOperationBatch::MASK) / CompactOperationBatch::SIZE)));
+                CHECK(read_transaction(range) == compact_operations);
+            }
+            CHECK(compact_ledger.escaped_count() == 30);
+        }
+
+        SECTION("Bulk write") {
+            compact_ledger.begin_transaction();
+            CHECK(compact_ledger.write(std::span<const Operation>(compact_operations)) == compact_operations.size());
+            CHECK(read_transaction(compact_ledger.commit_transaction()) == compact_operations);
+        }
+
+        // An escape that doesn't fit waits for the next transaction.
+        SECTION("Full") {
+            const Operation near = compact_operations[0];
+            const Operation far = compact_operations[9];
+
+            compact_ledger.begin_transaction();
+            for (size_t i = 0; i < (OPERATION_LEDGER_CAPACITY - 2); ++i) {
+                REQUIRE(compact_ledger.write(near));
+            }
+            CHECK(!compact_ledger.write(far));
+            CHECK(compact_ledger.write(near));
+            CHECK(compact_ledger.write(near));
+            CHECK(!compact_ledger.write(near));
+            CHECK(read_transaction(compact_ledger.commit_transaction()).size() == OPERATION_LEDGER_CAPACITY);
+        }
+    }
 }
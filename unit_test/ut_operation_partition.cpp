@@ -0,0 +1,62 @@
+#include "catch.hpp"
+#include "mantle/mantle.h"
+#include "mantle/operation_partition.h"
+
+using namespace mantle;
+
+namespace {
+
+    struct PartitionTestObject : Object {
+    };
+
+    class NullFinalizer final : public ObjectFinalizer {
+    public:
+        void finalize(ObjectGroup, std::span<Object*>) noexcept override {
+        }
+    };
+
+}
+
+TEST_CASE("OperationPartition") {
+    PartitionTestObject bound;
+    PartitionTestObject unbound;
+
+    NullFinalizer finalizer;
+    Domain domain;
+    Region region(domain, finalizer);
+
+    Handle<PartitionTestObject> handle = make_handle(bound);
+    REQUIRE(bound.region_id() == region.id());
+
+    OperationLedger ledger(1024);
+    OperationPartition partition;
+
+    SECTION("Increments of the last region") {
+        ledger.begin_transaction();
+        CHECK(ledger.write(make_increment_operation(&bound)));
+        const SequenceRange range = ledger.commit_transaction();
+
+        // Only the increment key of the region is present, and it still counts the region.
+        partition.assign(ledger, range);
+        CHECK(partition.region_count() == static_cast<size_t>(region.id()) + 1);
+        CHECK(partition.slice(region.id(), OperationType::INCREMENT).size() == 1);
+        CHECK(partition.slice(region.id(), OperationType::DECREMENT).empty());
+        CHECK(partition.unowned_count() == 0);
+    }
+
+    SECTION("Unowned objects") {
+        ledger.begin_transaction();
+        CHECK(ledger.write(make_increment_operation(&unbound)));
+        CHECK(ledger.write(make_decrement_operation(&bound)));
+        const SequenceRange range = ledger.commit_transaction();
+
+        partition.assign(ledger, range);
+        CHECK(partition.unowned_count() == 1);
+        CHECK(partition.size() == 1);
+        CHECK(partition.region_count() == static_cast<size_t>(region.id()) + 1);
+        CHECK(partition.slice(region.id(), OperationType::DECREMENT).size() == 1);
+
+        partition.clear();
+        CHECK(partition.unowned_count() == 0);
+    }
+}
@@ -0,0 +1,48 @@
+#include "catch.hpp"
+#include "mantle/reference_count_table.h"
+#include <vector>
+
+using namespace mantle;
+
+TEST_CASE("ReferenceCountTable") {
+    static constexpr size_t CAPACITY = 1024;
+
+    ReferenceCountTable table(CAPACITY);
+    REQUIRE(table.capacity() == CAPACITY);
+
+    SECTION("Fresh slots") {
+        const ReferenceCountTable::Slot first = table.allocate();
+        const ReferenceCountTable::Slot second = table.allocate();
+        CHECK(first != second);
+        CHECK(table.count(first) == 0);
+        CHECK(table.count(second) == 0);
+    }
+
+    SECTION("Apply") {
+        const ReferenceCountTable::Slot slot = table.allocate();
+
+        CHECK(table.apply_increment(slot, 3));
+        CHECK(table.count(slot) == 3);
+        CHECK(table.apply_decrement(slot, 3));
+        CHECK(table.count(slot) == 0);
+
+        // Like objects, a slot only dies once its count would go below zero.
+        CHECK(!table.apply_decrement(slot, 1));
+        CHECK(table.count(slot) == 0);
+    }
+
+    SECTION("Released slots are reused") {
+        std::vector<ReferenceCountTable::Slot> slots;
+        for (size_t i = 0; i < CAPACITY; ++i) {
+            slots.push_back(table.allocate());
+        }
+
+        // Every slot is in use, so the ones handed out next must be the released ones.
+        table.release(slots);
+        for (size_t i = 0; i < CAPACITY; ++i) {
+            const ReferenceCountTable::Slot slot = table.allocate();
+            CHECK(slot < CAPACITY);
+            CHECK(table.count(slot) == 0);
+        }
+    }
+}
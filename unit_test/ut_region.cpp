@@ -0,0 +1,1476 @@
+#include "catch.hpp"
+#include "mantle/mantle.h"
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <optional>
+#include <deque>
+#include <coroutine>
+#include <exception>
+#include <poll.h>
+
+using namespace mantle;
+
+namespace {
+
+    struct RegionTestObject : Object {
+    };
+
+    class CountingFinalizer final : public ObjectFinalizer {
+    public:
+        size_t count() const {
+            return count_;
+        }
+
+        void finalize(ObjectGroup, std::span<Object*> objects) noexcept override {
+            count_ += objects.size();
+        }
+
+    private:
+        std::atomic_size_t count_ = 0; // Regions that have left are finalized by the domain.
+    };
+
+    class ThreadFinalizer final : public ObjectFinalizer {
+    public:
+        size_t count() const {
+            return count_;
+        }
+
+        // The thread of the last call, once `count` has been seen to change.
+        std::thread::id thread_id() const {
+            return thread_id_;
+        }
+
+        void finalize(ObjectGroup, std::span<Object*> objects) noexcept override {
+            thread_id_ = std::this_thread::get_id();
+            count_ += objects.size();
+        }
+
+    private:
+        std::thread::id    thread_id_;
+        std::atomic_size_t count_ = 0;
+    };
+
+    struct TreeObject : Object {
+        std::vector<Handle<TreeObject>> children;
+    };
+
+    // Drops the children of whatever it finalizes, and steps the region until they have been
+    // collected too. They end up on the garbage pile, since this is a nested step.
+    class TreeFinalizer final : public ObjectFinalizer {
+    public:
+        size_t count() const {
+            return count_;
+        }
+
+        size_t largest_batch() const {
+            return largest_batch_;
+        }
+
+        void set_region(Region& region) {
+            region_ = &region;
+        }
+
+        void finalize(ObjectGroup, std::span<Object*> objects) noexcept override {
+            count_ += objects.size();
+            largest_batch_ = std::max(largest_batch_, objects.size());
+
+            bool dropped = false;
+            for (Object* object: objects) {
+                TreeObject& tree_object = static_cast<TreeObject&>(*object);
+                dropped |= !tree_object.children.empty();
+                tree_object.children.clear();
+            }
+
+            if (dropped) {
+                const Region::Cycle cycle = region_->cycle();
+                while (region_->cycle() < (cycle + 4)) {
+                    constexpr bool non_blocking = false;
+                    region_->step(non_blocking);
+                }
+            }
+        }
+
+    private:
+        Region* region_        = nullptr;
+        size_t  count_         = 0;
+        size_t  largest_batch_ = 0;
+    };
+
+    // Runs until its first suspension when called, and is destroyed once it finishes.
+    struct DetachedTask {
+        struct promise_type {
+            DetachedTask get_return_object() noexcept { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() noexcept {}
+            void unhandled_exception() noexcept { std::terminate(); }
+        };
+    };
+
+    DetachedTask await_region(Region& region, std::optional<Region::Cycle>& cycled, bool& quiesced) {
+        co_await region.next_cycle();
+        cycled = region.cycle();
+
+        co_await region.quiesce();
+        quiesced = true;
+    }
+
+}
+
+TEST_CASE("Region") {
+    static constexpr size_t OBJECT_COUNT = 8;
+
+    std::array<RegionTestObject, OBJECT_COUNT> objects;
+
+    SECTION("Incremental finalization") {
+        Config config;
+        config.finalization_budget_objects = 1;
+
+        CountingFinalizer finalizer;
+        {
+            Domain domain(config);
+            Region region(domain, finalizer);
+            {
+                std::vector<Handle<RegionTestObject>> handles;
+                for (RegionTestObject& object: objects) {
+                    handles.push_back(make_handle(object));
+                }
+            }
+
+            // No step should finalize more than the budget allows.
+            size_t step_count = 0;
+            while (finalizer.count() < OBJECT_COUNT) {
+                const size_t count = finalizer.count();
+
+                constexpr bool non_blocking = true;
+                region.step(non_blocking);
+                CHECK((finalizer.count() - count) <= 1);
+
+                step_count += 1;
+                REQUIRE(step_count < 1000000);
+            }
+        }
+        CHECK(finalizer.count() == OBJECT_COUNT);
+    }
+
+    SECTION("Nested finalization") {
+        std::array<TreeObject, OBJECT_COUNT> tree_objects;
+
+        TreeFinalizer finalizer;
+        {
+            Domain domain;
+            Region region(domain, finalizer);
+            finalizer.set_region(region);
+            {
+                Handle<TreeObject> root = make_handle(tree_objects[0]);
+                for (size_t i = 1; i < OBJECT_COUNT; ++i) {
+                    root->children.push_back(make_handle(tree_objects[i]));
+                }
+            }
+
+            while (finalizer.count() < OBJECT_COUNT) {
+                constexpr bool non_blocking = true;
+                region.step(non_blocking);
+            }
+
+            // The children are collected together, so they're finalized together as well.
+            CHECK(finalizer.largest_batch() == (OBJECT_COUNT - 1));
+        }
+        CHECK(finalizer.count() == OBJECT_COUNT);
+    }
+
+    SECTION("Parallel routing") {
+        Config config;
+        config.domain_worker_count = 2;
+
+        CountingFinalizer finalizer;
+        {
+            Domain domain(config);
+            Region region(domain, finalizer);
+            {
+                std::vector<Handle<RegionTestObject>> handles;
+                for (RegionTestObject& object: objects) {
+                    handles.push_back(make_handle(object));
+                    handles.push_back(handles.back());
+                }
+            }
+        }
+        CHECK(finalizer.count() == OBJECT_COUNT);
+    }
+
+    SECTION("Clustered domain") {
+        static constexpr size_t THREAD_COUNT = 4;
+
+        Config config;
+        config.domain_worker_count = 2;
+        config.domain_cluster_size = 2;
+
+        CountingFinalizer finalizer;
+        CountingFinalizer departed_finalizer;
+        {
+            Domain domain(config);
+            Region region(domain, finalizer);
+
+            auto step_until = [&](auto&& predicate) {
+                while (!predicate()) {
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+                }
+            };
+
+            // Regions in every cluster copy handles at the same time, and each hands one to us before leaving.
+            std::vector<std::optional<Handle<RegionTestObject>>> kept(THREAD_COUNT);
+            {
+                std::atomic_size_t done_count = 0;
+                std::vector<std::thread> threads;
+                for (size_t i = 0; i < THREAD_COUNT; ++i) {
+                    threads.emplace_back([&, i]() {
+                        {
+                            Region other(domain, departed_finalizer);
+
+                            Handle<RegionTestObject> handle = make_handle(objects[i]);
+                            for (size_t j = 0; j < 1000; ++j) {
+                                Handle<RegionTestObject> copy = handle;
+                            }
+                            kept[i].emplace(handle);
+                        }
+                        done_count += 1;
+                    });
+                }
+
+                step_until([&]() { return done_count == THREAD_COUNT; });
+                for (std::thread& thread: threads) {
+                    thread.join();
+                }
+            }
+            CHECK(departed_finalizer.count() == 0);
+
+            // The domain finalizes what they left behind, all with the same finalizer.
+            kept.clear();
+            step_until([&]() { return departed_finalizer.count() == THREAD_COUNT; });
+
+            {
+                std::vector<Handle<RegionTestObject>> handles;
+                for (size_t i = THREAD_COUNT; i < OBJECT_COUNT; ++i) {
+                    handles.push_back(make_handle(objects[i]));
+                    handles.push_back(handles.back());
+                }
+            }
+        }
+        CHECK(finalizer.count() == (OBJECT_COUNT - THREAD_COUNT));
+        CHECK(departed_finalizer.count() == THREAD_COUNT);
+    }
+
+    SECTION("Spinning domain") {
+        using namespace std::chrono_literals;
+
+        Config config;
+        config.domain_spin_duration = 1ms;
+
+        CountingFinalizer finalizer;
+        {
+            Domain domain(config);
+            Region region(domain, finalizer);
+            {
+                std::vector<Handle<RegionTestObject>> handles;
+                for (RegionTestObject& object: objects) {
+                    handles.push_back(make_handle(object));
+                    handles.push_back(handles.back());
+                }
+            }
+
+            // Idle long enough for the domain to give up spinning and block, then wake it up again.
+            std::this_thread::sleep_for(5ms);
+            while (finalizer.count() < OBJECT_COUNT) {
+                constexpr bool non_blocking = false;
+                region.step(non_blocking);
+            }
+        }
+        CHECK(finalizer.count() == OBJECT_COUNT);
+    }
+
+    SECTION("Futex wakeups") {
+        using namespace std::chrono_literals;
+
+        Config config;
+        config.region_wakeups = WakeupPolicy::FUTEX;
+
+        CountingFinalizer finalizer;
+        {
+            Domain domain(config);
+            Region region(domain, finalizer);
+            {
+                std::vector<Handle<RegionTestObject>> handles;
+                for (RegionTestObject& object: objects) {
+                    handles.push_back(make_handle(object));
+                    handles.push_back(handles.back());
+                }
+            }
+
+            // Every blocking step sleeps on the futex until the domain sends something.
+            std::this_thread::sleep_for(5ms);
+            while (finalizer.count() < OBJECT_COUNT) {
+                constexpr bool non_blocking = false;
+                region.step(non_blocking);
+            }
+        }
+        CHECK(finalizer.count() == OBJECT_COUNT);
+    }
+
+    SECTION("Idle steps") {
+        CountingFinalizer finalizer;
+        {
+            Domain domain;
+            Region region(domain, finalizer);
+
+            // Let the region settle until it has nothing left to do, and isn't waiting on the domain either.
+            while (region.has_work() || (region.phase() != Region::Phase::RECV_ENTER)) {
+                constexpr bool non_blocking = true;
+                region.step(non_blocking);
+            }
+
+            // Idle steps don't change anything.
+            const Region::Cycle cycle = region.cycle();
+            for (size_t i = 0; i < 1000; ++i) {
+                constexpr bool non_blocking = true;
+                region.step(non_blocking);
+            }
+            CHECK(region.cycle() == cycle);
+            CHECK(!region.has_work());
+
+            // Operations in the ledger are work.
+            {
+                Handle<RegionTestObject> handle = make_handle(objects[0]);
+            }
+            CHECK(region.has_work());
+
+            while (finalizer.count() < 1) {
+                constexpr bool non_blocking = true;
+                region.step(non_blocking);
+            }
+        }
+        CHECK(finalizer.count() == 1);
+    }
+
+    SECTION("NUMA placement") {
+        Config config;
+        config.domain_worker_count = 1;
+        config.domain_numa_node = current_numa_node();
+        config.numa_placement = true;
+
+        CountingFinalizer finalizer;
+        {
+            Domain domain(config);
+            Region region(domain, finalizer);
+            {
+                std::vector<Handle<RegionTestObject>> handles;
+                for (RegionTestObject& object: objects) {
+                    handles.push_back(make_handle(object));
+                    handles.push_back(handles.back());
+                }
+            }
+        }
+        CHECK(finalizer.count() == OBJECT_COUNT);
+
+        // Pinning to nothing is an error rather than not pinning at all.
+        Config unpinned;
+        std::vector<size_t> no_cpus;
+        unpinned.domain_cpu_affinity = std::span(no_cpus);
+        CHECK_THROWS_AS(Domain(unpinned), std::runtime_error);
+
+        unpinned = Config();
+        unpinned.domain_numa_node = 1 << 20;
+        CHECK_THROWS_AS(Domain(unpinned), std::runtime_error);
+    }
+
+    SECTION("Hot join and leave") {
+        CountingFinalizer finalizer;
+        CountingFinalizer departed_finalizer;
+        {
+            Domain domain;
+            Region region(domain, finalizer);
+
+            auto step_until = [&](auto&& predicate) {
+                while (!predicate()) {
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+                }
+            };
+
+            // Another region joins, hands us a handle to one of its objects, and leaves while we keep running.
+            // Leaving only takes a few cycles, as long as we keep stepping.
+            std::optional<Handle<RegionTestObject>> kept;
+            RegionId departed_id = INVALID_REGION_ID;
+            {
+                std::atomic_bool done = false;
+                std::thread thread([&]() {
+                    {
+                        Region other(domain, departed_finalizer);
+                        departed_id = other.id();
+
+                        Handle<RegionTestObject> handle = make_handle(objects[0]);
+                        kept.emplace(handle);
+                    }
+                    done = true;
+                });
+
+                step_until([&]() { return done.load(); });
+                thread.join();
+            }
+            CHECK(region.state() == Region::State::RUNNING);
+            CHECK(departed_finalizer.count() == 0);
+
+            // The domain finalizes what the region left behind once we let go of it.
+            kept.reset();
+            step_until([&]() { return departed_finalizer.count() == 1; });
+
+            // The slot is reused once nothing the region owned is left.
+            step_until([&]() {
+                const Domain::Metrics metrics = domain.snapshot_metrics();
+                return (metrics.regions.size() > departed_id) && (metrics.regions[departed_id].state == RegionControllerState::VACANT);
+            });
+
+            std::atomic_bool done = false;
+            RegionId joined_id = INVALID_REGION_ID;
+            std::thread thread([&]() {
+                {
+                    Region other(domain, departed_finalizer);
+                    joined_id = other.id();
+                }
+                done = true;
+            });
+
+            step_until([&]() { return done.load(); });
+            thread.join();
+            CHECK(joined_id == departed_id);
+        }
+        CHECK(finalizer.count() == 0);
+        CHECK(departed_finalizer.count() == 1);
+    }
+
+    SECTION("Finalizing after leaving") {
+        CountingFinalizer finalizer;
+        ThreadFinalizer departed_finalizer;
+        {
+            Domain domain;
+            Region region(domain, finalizer);
+
+            auto step_until = [&](auto&& predicate) {
+                while (!predicate()) {
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+                }
+            };
+
+            std::optional<Handle<RegionTestObject>> kept;
+            std::thread::id departed_thread_id;
+            std::atomic_bool done = false;
+            std::thread thread([&]() {
+                {
+                    Region other(domain, departed_finalizer);
+                    departed_thread_id = std::this_thread::get_id();
+
+                    Handle<RegionTestObject> handle = make_handle(objects[0]);
+                    kept.emplace(handle);
+                }
+                done = true;
+            });
+
+            step_until([&]() { return done.load(); });
+            thread.join();
+
+            // The region is gone, but its finalizer is still used for what it left behind, and on
+            // the domain's thread rather than either region's.
+            kept.reset();
+            step_until([&]() { return departed_finalizer.count() == 1; });
+            CHECK(departed_finalizer.thread_id() != departed_thread_id);
+            CHECK(departed_finalizer.thread_id() != std::this_thread::get_id());
+        }
+        CHECK(finalizer.count() == 0);
+        CHECK(departed_finalizer.count() == 1);
+    }
+
+    SECTION("Region pool") {
+        CountingFinalizer finalizer;
+        {
+            Domain domain;
+            Region region(domain, finalizer);
+            RegionPool pool(domain, finalizer, 1);
+
+            // Each thread makes a handle and drops it again, then hands its region to the next one.
+            std::vector<const Region*> leased;
+            for (size_t i = 0; i < OBJECT_COUNT; ++i) {
+                std::atomic_bool done = false;
+                std::thread thread([&]() {
+                    {
+                        RegionPool::Lease lease = pool.acquire();
+                        leased.push_back(&*lease);
+                        CHECK(lease->state() == Region::State::RUNNING);
+
+                        Handle<RegionTestObject> handle = make_handle(objects[i]);
+                    }
+                    done = true;
+                });
+
+                while (!done) {
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+                }
+                thread.join();
+
+                CHECK(pool.parked_count() == 1);
+                CHECK(leased.back() == leased.front());
+            }
+
+            // Parking finalizes whatever the thread dropped.
+            CHECK(finalizer.count() == OBJECT_COUNT);
+
+            // The pool only hands out regions to threads that don't have one.
+            CHECK_THROWS_AS(pool.acquire(), std::runtime_error);
+            CHECK(pool.parked_count() == 1);
+        }
+        CHECK(finalizer.count() == OBJECT_COUNT);
+    }
+
+    SECTION("Embedded domain") {
+        Config config;
+        config.domain_embedded = true;
+
+        CountingFinalizer finalizer;
+        CountingFinalizer other_finalizer;
+        {
+            // The region steps the domain by itself while it joins, since nobody else is going to.
+            Domain domain(config);
+            Region region(domain, finalizer);
+            {
+                std::vector<Handle<RegionTestObject>> handles;
+                for (RegionTestObject& object: objects) {
+                    handles.push_back(make_handle(object));
+                }
+            }
+
+            // A region on another thread relies on us stepping the domain, like an event loop would.
+            RegionTestObject other_object;
+            std::atomic_bool done = false;
+            std::thread thread([&]() {
+                {
+                    Region other(domain, other_finalizer);
+                    Handle<RegionTestObject> handle = make_handle(other_object);
+                }
+                done = true;
+            });
+
+            while (!done.load() || (finalizer.count() < OBJECT_COUNT)) {
+                struct pollfd events[] = {
+                    { .fd = domain.file_descriptor(), .events = POLLIN, .revents = 0 },
+                    { .fd = region.file_descriptor(), .events = POLLIN, .revents = 0 },
+                };
+
+                const std::chrono::milliseconds timeout = std::chrono::ceil<std::chrono::milliseconds>(domain.timeout().value_or(std::chrono::milliseconds(10)));
+                REQUIRE(::poll(events, 2, static_cast<int>(std::min<int64_t>(timeout.count(), 10))) >= 0);
+
+                constexpr bool non_blocking = true;
+                domain.step(non_blocking);
+                region.step(non_blocking);
+            }
+            thread.join();
+        }
+        CHECK(finalizer.count() == OBJECT_COUNT);
+        CHECK(other_finalizer.count() == 1);
+    }
+
+    SECTION("Coroutines") {
+        CountingFinalizer finalizer;
+        {
+            Domain domain;
+            Region region(domain, finalizer);
+            {
+                std::vector<Handle<RegionTestObject>> handles;
+                for (RegionTestObject& object: objects) {
+                    handles.push_back(make_handle(object));
+                }
+            }
+
+            const Region::Cycle first_cycle = region.cycle();
+            std::optional<Region::Cycle> cycled;
+            bool quiesced = false;
+            await_region(region, cycled, quiesced);
+            CHECK(!cycled);
+
+            // The coroutine is resumed from within step, rather than spinning on it by itself.
+            size_t step_count = 0;
+            while (!quiesced) {
+                constexpr bool non_blocking = true;
+                region.step(non_blocking);
+
+                step_count += 1;
+                REQUIRE(step_count < 1000000);
+            }
+
+            REQUIRE(cycled);
+            CHECK(*cycled > first_cycle);
+            CHECK(finalizer.count() == OBJECT_COUNT);
+
+            // Waiting on a region with nothing in flight returns straight away.
+            quiesced = false;
+            [](Region& region, bool& quiesced) -> DetachedTask {
+                co_await region.quiesce();
+                quiesced = true;
+            }(region, quiesced);
+            CHECK(quiesced);
+        }
+    }
+
+    SECTION("Retired memory") {
+        CountingFinalizer finalizer;
+        {
+            Domain domain;
+            Region region(domain, finalizer);
+
+            static size_t freed_count = 0;
+            freed_count = 0;
+
+            struct Node {
+                ~Node() {
+                    freed_count += 1;
+                }
+            };
+
+            // Nothing is freed until every region has submitted a cycle that started after the call.
+            const Region::Cycle first_cycle = region.cycle();
+            region.retire(new Node());
+            region.retire(new Node());
+            CHECK(region.metrics().retired_count == 0);
+
+            while (freed_count < 2) {
+                CHECK(region.cycle() <= (first_cycle + 2));
+
+                constexpr bool non_blocking = true;
+                region.step(non_blocking);
+            }
+            CHECK(region.cycle() >= (first_cycle + 2));
+            CHECK(region.metrics().retired_count == 2);
+
+            // Stopping waits for whatever is still retired.
+            region.retire(new Node());
+            region.stop();
+            CHECK(freed_count == 3);
+        }
+    }
+
+    SECTION("Partitioned operations") {
+        Config config;
+        config.partition_operations = true;
+
+        CountingFinalizer finalizer;
+        {
+            Domain domain(config);
+            Region region(domain, finalizer);
+            {
+                std::vector<Handle<RegionTestObject>> handles;
+                for (RegionTestObject& object: objects) {
+                    handles.push_back(make_handle(object));
+                    handles.push_back(handles.back());
+                }
+            }
+        }
+        CHECK(finalizer.count() == OBJECT_COUNT);
+    }
+
+    SECTION("Partitioned increments") {
+        Config config;
+        config.partition_operations = true;
+
+        CountingFinalizer finalizer;
+        {
+            Domain domain(config);
+            Region region(domain, finalizer);
+            {
+                std::vector<Handle<RegionTestObject>> handles;
+                for (RegionTestObject& object: objects) {
+                    handles.push_back(make_handle(object));
+                }
+
+                // A transaction with only increments for the last region must still route them.
+                handles.push_back(handles.front());
+
+                const Region::Cycle cycle = region.cycle();
+                while ((region.cycle() - cycle) < 4) {
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+                }
+                CHECK(finalizer.count() == 0);
+            }
+
+            while (finalizer.count() < OBJECT_COUNT) {
+                constexpr bool non_blocking = true;
+                region.step(non_blocking);
+            }
+        }
+        CHECK(finalizer.count() == OBJECT_COUNT);
+    }
+
+    SECTION("Pipelined cycles") {
+        Config config;
+        config.pipeline_cycles = true;
+
+        SECTION("On the domain thread") {
+        }
+
+        SECTION("With domain workers") {
+            config.domain_worker_count = 2;
+        }
+
+        CountingFinalizer finalizer;
+        {
+            Domain domain(config);
+            Region region(domain, finalizer);
+            {
+                std::vector<Handle<RegionTestObject>> handles;
+                for (RegionTestObject& object: objects) {
+                    handles.push_back(make_handle(object));
+                    handles.push_back(handles.back());
+                }
+            }
+
+            // The retire barrier is skipped, and every object is still reclaimed while we're running.
+            while (finalizer.count() < OBJECT_COUNT) {
+                constexpr bool non_blocking = true;
+                region.step(non_blocking);
+            }
+
+            const Domain::Metrics metrics = domain.snapshot_metrics();
+            REQUIRE(!metrics.regions.empty());
+            CHECK(metrics.regions[0].phase_durations[static_cast<size_t>(RegionControllerPhase::RETIRE_BARRIER)].count() == 0);
+        }
+        CHECK(finalizer.count() == OBJECT_COUNT);
+    }
+
+    SECTION("Ledger overflow") {
+        Config config;
+        config.ledger_capacity = 1024;
+        config.ledger_overflow = true;
+
+        CountingFinalizer finalizer;
+        {
+            Domain domain(config);
+            Region region(domain, finalizer);
+            {
+                std::vector<Handle<RegionTestObject>> handles;
+                for (RegionTestObject& object: objects) {
+                    handles.push_back(make_handle(object));
+                }
+
+                // A burst of operations larger than the ledger shouldn't wait on the domain.
+                const Region::Cycle cycle = region.cycle();
+                for (size_t i = 0; i < 4 * config.ledger_capacity; ++i) {
+                    handles.push_back(handles[i % OBJECT_COUNT]);
+                }
+                CHECK(region.cycle() == cycle);
+                CHECK(region.metrics().overflow_count == 1);
+                CHECK(region.metrics().spilled_count > 0);
+            }
+
+            // Spilled operations are submitted like any other.
+            while (finalizer.count() < OBJECT_COUNT) {
+                constexpr bool non_blocking = true;
+                region.step(non_blocking);
+            }
+        }
+        CHECK(finalizer.count() == OBJECT_COUNT);
+    }
+
+    SECTION("Prefetch distances") {
+        static constexpr size_t PREFETCHED_OBJECT_COUNT = 100;
+
+        // Prefetching is only a hint, so the same updates are applied whether it looks ahead by
+        // nothing, by less than the batch, or by more.
+        std::optional<size_t> expected_applied_count;
+        for (const size_t distance: {size_t{0}, size_t{1}, APPLY_PREFETCH_DISTANCE, 2 * PREFETCHED_OBJECT_COUNT}) {
+            Config config;
+            config.apply_prefetch_distance = distance;
+
+            CountingFinalizer finalizer;
+            std::deque<RegionTestObject> prefetched_objects(PREFETCHED_OBJECT_COUNT);
+            {
+                Domain domain(config);
+                Region region(domain, finalizer);
+                {
+                    std::vector<Handle<RegionTestObject>> handles;
+                    for (RegionTestObject& object: prefetched_objects) {
+                        handles.push_back(make_handle(object));
+                        handles.push_back(handles.back());
+                    }
+                }
+
+                // At least one net increment and one net decrement per object.
+                size_t applied_count = 0;
+                size_t step_count = 0;
+                while ((finalizer.count() < PREFETCHED_OBJECT_COUNT) || (applied_count < expected_applied_count.value_or(2 * PREFETCHED_OBJECT_COUNT))) {
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+
+                    applied_count = 0;
+                    for (const RegionMetricsSnapshot& metrics: domain.snapshot_metrics().regions) {
+                        applied_count += metrics.applied_count;
+                    }
+
+                    step_count += 1;
+                    REQUIRE(step_count < 1000000);
+                }
+
+                // Give a late cycle the chance to apply more than it should have.
+                for (size_t i = 0; i < 1000; ++i) {
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+                }
+
+                applied_count = 0;
+                for (const RegionMetricsSnapshot& metrics: domain.snapshot_metrics().regions) {
+                    applied_count += metrics.applied_count;
+                }
+
+                CHECK(finalizer.count() == PREFETCHED_OBJECT_COUNT);
+                CHECK(applied_count == expected_applied_count.value_or(applied_count));
+                expected_applied_count = applied_count;
+            }
+        }
+    }
+
+    SECTION("Quiescing with fallback operations") {
+        Config config;
+        config.fallback_ledger = true;
+
+        CountingFinalizer finalizer;
+        {
+            Domain domain(config);
+            Region region(domain, finalizer);
+
+            auto quiesce = [&region]() {
+                bool quiesced = false;
+                [](Region& region, bool& quiesced) -> DetachedTask {
+                    co_await region.quiesce();
+                    quiesced = true;
+                }(region, quiesced);
+
+                size_t step_count = 0;
+                while (!quiesced) {
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+
+                    step_count += 1;
+                    REQUIRE(step_count < 1000000);
+                }
+            };
+
+            std::vector<Handle<RegionTestObject>> handles;
+            for (RegionTestObject& object: objects) {
+                handles.push_back(make_handle(object));
+            }
+            quiesce();
+
+            // Only the fallback ledger holds the drops, and the region isn't done until it has taken them over.
+            std::thread thread([handles = std::move(handles)]() mutable {
+                handles.clear();
+            });
+            thread.join();
+
+            quiesce();
+            CHECK(finalizer.count() == OBJECT_COUNT);
+        }
+        CHECK(finalizer.count() == OBJECT_COUNT);
+    }
+
+    SECTION("Fallback ledger") {
+        Config config;
+        config.fallback_ledger = true;
+
+        CountingFinalizer finalizer;
+        {
+            Domain domain(config);
+            Region region(domain, finalizer);
+            {
+                std::vector<Handle<RegionTestObject>> handles;
+                for (RegionTestObject& object: objects) {
+                    handles.push_back(make_handle(object));
+                }
+
+                // The copies and drops of a thread without a region are taken over by ours.
+                std::thread thread([handles = std::move(handles)]() mutable {
+                    std::vector<Handle<RegionTestObject>> copies(handles.begin(), handles.end());
+                    handles.clear();
+                });
+                thread.join();
+            }
+
+            while (finalizer.count() < OBJECT_COUNT) {
+                constexpr bool non_blocking = true;
+                region.step(non_blocking);
+            }
+
+            CHECK(domain.snapshot_metrics().fallback_operation_count == 3 * OBJECT_COUNT);
+        }
+        CHECK(finalizer.count() == OBJECT_COUNT);
+
+        // Only one domain at a time can have one.
+        {
+            Domain domain(config);
+            CHECK_THROWS_AS(Domain(config), std::runtime_error);
+        }
+    }
+
+    SECTION("Local operations") {
+        Config config;
+        config.local_operations = true;
+
+        CountingFinalizer finalizer;
+        CountingFinalizer other_finalizer;
+        {
+            Domain domain(config);
+            Region region(domain, finalizer);
+
+            auto step_until = [&](auto&& predicate) {
+                while (!predicate()) {
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+                }
+            };
+
+            // Another region holds on to a copy of one of our objects while we drop ours.
+            std::atomic_bool dropped = false;
+            std::atomic_bool done = false;
+            std::thread thread;
+            {
+                std::vector<Handle<RegionTestObject>> handles;
+                for (RegionTestObject& object: objects) {
+                    handles.push_back(make_handle(object));
+                    handles.push_back(handles.back());
+                }
+
+                std::atomic_bool copied = false;
+                thread = std::thread([&, handle = handles.front()]() mutable {
+                    {
+                        Region other(domain, other_finalizer);
+                        Handle<RegionTestObject> copy = handle;
+                        handle = nullptr;
+                        copied = true;
+
+                        while (!dropped) {
+                            constexpr bool non_blocking = true;
+                            other.step(non_blocking);
+                        }
+                    }
+                    done = true;
+                });
+
+                step_until([&]() { return copied.load(); });
+            }
+
+            // Operations on our own objects never went to the domain.
+            step_until([&]() { return finalizer.count() == (OBJECT_COUNT - 1); });
+            CHECK(region.metrics().local_count > 0);
+            CHECK(region.metrics().local_released_count == (OBJECT_COUNT - 1));
+
+            // The copy keeps its object alive until the other region drops it too.
+            for (size_t i = 0; i < 1000; ++i) {
+                constexpr bool non_blocking = true;
+                region.step(non_blocking);
+            }
+            CHECK(finalizer.count() == (OBJECT_COUNT - 1));
+
+            dropped = true;
+            step_until([&]() { return done && (finalizer.count() == OBJECT_COUNT); });
+            thread.join();
+        }
+        CHECK(finalizer.count() == OBJECT_COUNT);
+        CHECK(other_finalizer.count() == 0);
+    }
+
+    SECTION("Sharded references") {
+        using ShardedHandle = Handle<RegionTestObject, ShardedReferencePolicy>;
+
+        CountingFinalizer finalizer;
+        CountingFinalizer other_finalizer;
+        {
+            Domain domain;
+            Region region(domain, finalizer);
+
+            auto step_until = [&](auto&& predicate) {
+                while (!predicate()) {
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+                }
+            };
+
+            // Both regions copy and drop every handle many times, and the other region holds on to copies.
+            std::atomic_bool dropped = false;
+            std::atomic_bool done = false;
+            size_t other_sharded_count = 0;
+            std::thread thread;
+            {
+                std::vector<ShardedHandle> handles;
+                for (RegionTestObject& object: objects) {
+                    handles.push_back(make_handle<ShardedReferencePolicy>(object));
+                }
+
+                std::atomic_bool copied = false;
+                thread = std::thread([&, shared = handles]() mutable {
+                    {
+                        Region other(domain, other_finalizer);
+
+                        std::vector<ShardedHandle> copies;
+                        for (size_t i = 0; i < 100; ++i) {
+                            clone_handles(shared, copies);
+                            drop_handles(std::span(copies));
+                            copies.clear();
+                        }
+                        clone_handles(shared, copies);
+                        shared.clear();
+                        copied = true;
+
+                        while (!dropped) {
+                            constexpr bool non_blocking = true;
+                            other.step(non_blocking);
+                        }
+                        other_sharded_count = other.metrics().sharded_count;
+                    }
+                    done = true;
+                });
+
+                for (size_t i = 0; i < 100; ++i) {
+                    for (const ShardedHandle& handle: handles) {
+                        ShardedHandle copy = handle;
+                    }
+
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+                }
+
+                step_until([&]() { return copied.load(); });
+                CHECK(region.metrics().shard_count >= OBJECT_COUNT);
+            }
+
+            // The other region's copies keep every object alive, even once our shards have been given back.
+            for (size_t i = 0; i < 1000; ++i) {
+                constexpr bool non_blocking = true;
+                region.step(non_blocking);
+            }
+            CHECK(finalizer.count() == 0);
+
+            dropped = true;
+            step_until([&]() { return done && (finalizer.count() == OBJECT_COUNT); });
+            thread.join();
+            CHECK(other_sharded_count > 0);
+        }
+        CHECK(finalizer.count() == OBJECT_COUNT);
+        CHECK(other_finalizer.count() == 0);
+    }
+
+    SECTION("Sharded references with a full ledger") {
+        using ShardedHandle = Handle<RegionTestObject, ShardedReferencePolicy>;
+        static constexpr size_t SHARDED_COUNT = 1024;
+
+        // Far more shards than fit in one transaction, so giving them back has to span several.
+        Config config;
+        config.ledger_capacity = 64;
+
+        CountingFinalizer finalizer;
+        std::deque<RegionTestObject> sharded_objects(SHARDED_COUNT);
+        {
+            Domain domain(config);
+            Region region(domain, finalizer);
+            {
+                std::vector<ShardedHandle> handles;
+                for (RegionTestObject& object: sharded_objects) {
+                    handles.push_back(make_handle<ShardedReferencePolicy>(object));
+                }
+
+                // Every copy takes a shard, and they are all left to be given back in the same cycle.
+                {
+                    std::vector<ShardedHandle> copies = handles;
+                }
+                CHECK(region.metrics().shard_count == SHARDED_COUNT);
+
+                for (size_t step = 0; step < 100; ++step) {
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+                }
+                CHECK(finalizer.count() == 0);
+            }
+
+            size_t step_count = 0;
+            while (finalizer.count() < SHARDED_COUNT) {
+                constexpr bool non_blocking = true;
+                region.step(non_blocking);
+
+                step_count += 1;
+                REQUIRE(step_count < 1000000);
+            }
+        }
+        CHECK(finalizer.count() == SHARDED_COUNT);
+    }
+
+    SECTION("Combining cache") {
+        Config config;
+        config.ledger_capacity = 1024;
+        config.region_combining_cache_size = 64;
+
+        CountingFinalizer finalizer;
+        {
+            Domain domain(config);
+            Region region(domain, finalizer);
+            {
+                std::vector<Handle<RegionTestObject>> handles;
+                for (RegionTestObject& object: objects) {
+                    handles.push_back(make_handle(object));
+                }
+
+                // Copies that are dropped again never reach the ledger, so this doesn't wait on the domain.
+                const Region::Cycle cycle = region.cycle();
+                for (size_t i = 0; i < 4 * config.ledger_capacity; ++i) {
+                    Handle<RegionTestObject> copy = handles[i % OBJECT_COUNT];
+                }
+                CHECK(region.cycle() == cycle);
+
+                // Copies that are kept alive keep their objects alive.
+                for (size_t i = 0; i < OBJECT_COUNT; ++i) {
+                    handles.push_back(handles[i]);
+                }
+                handles.erase(handles.begin(), handles.begin() + OBJECT_COUNT);
+
+                // The cache is only flushed once the domain asks for a submit, which may take a while.
+                size_t step_count = 0;
+                while (region.metrics().combined_count == 0) {
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+
+                    step_count += 1;
+                    REQUIRE(step_count < 1000000);
+                }
+                CHECK(finalizer.count() == 0);
+            }
+
+            while (finalizer.count() < OBJECT_COUNT) {
+                constexpr bool non_blocking = true;
+                region.step(non_blocking);
+            }
+        }
+        CHECK(finalizer.count() == OBJECT_COUNT);
+    }
+
+    SECTION("Radix grouping") {
+        Config config;
+        config.operation_grouper_engine = GrouperEngine::RADIX;
+
+        SECTION("On the domain thread") {
+        }
+
+        SECTION("With domain workers") {
+            config.domain_worker_count = 2;
+        }
+
+        CountingFinalizer finalizer;
+        {
+            Domain domain(config);
+            Region region(domain, finalizer);
+            {
+                std::vector<Handle<RegionTestObject>> handles;
+                for (RegionTestObject& object: objects) {
+                    handles.push_back(make_handle(object));
+                    handles.push_back(handles.back());
+                    handles.push_back(handles.back());
+                }
+            }
+
+            while (finalizer.count() < OBJECT_COUNT) {
+                constexpr bool non_blocking = true;
+                region.step(non_blocking);
+            }
+        }
+        CHECK(finalizer.count() == OBJECT_COUNT);
+    }
+
+    SECTION("Write barrier ledger") {
+        Config config;
+        config.ledger_backend = LedgerBackend::WRITE_BARRIER;
+
+        CountingFinalizer finalizer;
+        {
+            Domain domain(config);
+            Region region(domain, finalizer);
+            {
+                std::vector<Ref<RegionTestObject>> refs;
+                for (RegionTestObject& object: objects) {
+                    refs.push_back(bind(object));
+                }
+
+                // Enough copies to run into the guard page of the first segment.
+                refs.reserve(2 * WRITE_BARRIER_CAPACITY);
+                for (size_t i = 0; refs.size() < (2 * WRITE_BARRIER_CAPACITY); ++i) {
+                    refs.push_back(refs[i % OBJECT_COUNT]);
+                }
+            }
+
+            while (finalizer.count() < OBJECT_COUNT) {
+                constexpr bool non_blocking = true;
+                region.step(non_blocking);
+            }
+        }
+        CHECK(finalizer.count() == OBJECT_COUNT);
+    }
+
+    SECTION("Reference count table") {
+        Config config;
+        config.reference_count_table = true;
+        config.reference_count_table_capacity = OBJECT_COUNT;
+
+        CountingFinalizer finalizer;
+        {
+            Domain domain(config);
+            Region region(domain, finalizer);
+
+            // Objects are bound again once they've been finalized, so their slots have to be reused.
+            for (size_t round = 1; round <= 4; ++round) {
+                {
+                    std::vector<Handle<RegionTestObject>> handles;
+                    for (RegionTestObject& object: objects) {
+                        handles.push_back(make_handle(object));
+                        handles.push_back(handles.back());
+                    }
+                }
+
+                while (finalizer.count() < (round * OBJECT_COUNT)) {
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+                }
+            }
+        }
+        CHECK(finalizer.count() == (4 * OBJECT_COUNT));
+    }
+
+    SECTION("Metrics snapshot") {
+        CountingFinalizer finalizer;
+        {
+            Domain domain;
+            Region region(domain, finalizer);
+            {
+                Handle<RegionTestObject> handle = make_handle(objects[0]);
+                {
+                    std::vector<Handle<RegionTestObject>> handles;
+                    for (size_t i = 1; i < OBJECT_COUNT; ++i) {
+                        handles.push_back(make_handle(objects[i]));
+                    }
+                }
+
+                // Keep cycles going until the region has reported its finalizations.
+                Domain::Metrics metrics;
+                size_t step_count = 0;
+                while (metrics.regions.empty() || (metrics.regions[0].finalized_count < (OBJECT_COUNT - 1))) {
+                    Handle<RegionTestObject> copy = handle;
+
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+                    metrics = domain.snapshot_metrics();
+
+                    step_count += 1;
+                    REQUIRE(step_count < 1000000);
+                }
+
+                const RegionMetricsSnapshot& snapshot = metrics.regions[0];
+                CHECK(snapshot.region_id == region.id());
+                CHECK(snapshot.cycle_count > 0);
+                CHECK(snapshot.finalized_count == (OBJECT_COUNT - 1));
+                CHECK(snapshot.object_grouper.object_count == (OBJECT_COUNT - 1));
+                CHECK(snapshot.increment_count > 0);
+                CHECK(snapshot.ledger_capacity == domain.config().ledger_capacity);
+                CHECK(snapshot.ledger_occupancy <= snapshot.ledger_capacity);
+            }
+        }
+        CHECK(finalizer.count() == OBJECT_COUNT);
+    }
+
+    SECTION("Unbounded finalization") {
+        CountingFinalizer finalizer;
+        {
+            Domain domain;
+            Region region(domain, finalizer);
+            {
+                std::vector<Handle<RegionTestObject>> handles;
+                for (RegionTestObject& object: objects) {
+                    handles.push_back(make_handle(object));
+                }
+            }
+        }
+        CHECK(finalizer.count() == OBJECT_COUNT);
+    }
+
+    SECTION("Cycle cadence") {
+        using namespace std::chrono_literals;
+
+        SECTION("Minimum interval") {
+            Config config;
+            config.cycle_interval_min = 10ms;
+
+            CountingFinalizer finalizer;
+            {
+                Domain domain(config);
+                Region region(domain, finalizer);
+                {
+                    Handle<RegionTestObject> handle = make_handle(objects[0]);
+
+                    // Keep the ledger busy. Cycles should still only start about once per interval.
+                    const Region::Cycle first_cycle = region.cycle();
+                    const auto deadline = std::chrono::steady_clock::now() + 50ms;
+                    while (std::chrono::steady_clock::now() < deadline) {
+                        Handle<RegionTestObject> copy = handle;
+
+                        constexpr bool non_blocking = true;
+                        region.step(non_blocking);
+                    }
+
+                    CHECK((region.cycle() - first_cycle) <= 10);
+                }
+            }
+            CHECK(finalizer.count() == 1);
+        }
+
+        SECTION("Urgent start") {
+            // Cycles are held back for far longer than the test runs, unless the ledger fills up.
+            Config config;
+            config.ledger_capacity = 1024;
+            config.cycle_interval_min = 1h;
+
+            CountingFinalizer finalizer;
+            {
+                Domain domain(config);
+                Region region(domain, finalizer);
+                {
+                    Handle<RegionTestObject> handle = make_handle(objects[0]);
+                    for (size_t i = 0; i < 16 * config.ledger_capacity; ++i) {
+                        Handle<RegionTestObject> copy = handle;
+                    }
+                }
+            }
+            CHECK(finalizer.count() == 1);
+        }
+
+        SECTION("Memory pressure") {
+            // Cycles are held back for far longer than the test runs, unless dropped objects hold
+            // enough memory, or the process as a whole does.
+            Config config;
+            config.cycle_interval_min = 1h;
+
+            size_t byte_cost = 0;
+            SECTION("Dropped bytes") {
+                config.cycle_pressure_bytes = 1 << 20;
+                byte_cost = 4 << 20;
+            }
+            SECTION("Resident set") {
+                config.cycle_pressure_rss = 1;
+            }
+
+            CountingFinalizer finalizer;
+            {
+                Domain domain(config);
+                Region region(domain, finalizer);
+
+                // Cheap objects stay lazy.
+                {
+                    Handle<RegionTestObject> handle = make_handle(objects[1], 1);
+                }
+                for (size_t i = 0; i < 1000; ++i) {
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+                }
+                CHECK(region.metrics().pressure_start_count == 0);
+
+                {
+                    Handle<RegionTestObject> handle = make_handle(objects[0], byte_cost);
+                }
+
+                const auto deadline = std::chrono::steady_clock::now() + 10s;
+                while ((finalizer.count() < 2) && (std::chrono::steady_clock::now() < deadline)) {
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+                }
+                CHECK(finalizer.count() == 2);
+
+                if (config.cycle_pressure_bytes) {
+                    CHECK(region.metrics().pressure_start_count > 0);
+                }
+            }
+        }
+
+        SECTION("Repeated drops") {
+            Config config;
+            config.cycle_interval_min = 1h;
+            config.cycle_pressure_bytes = 1 << 20;
+
+            CountingFinalizer finalizer;
+            {
+                Domain domain(config);
+                Region region(domain, finalizer);
+
+                // The bytes of an object that is dropped over and over are only counted once.
+                Handle<RegionTestObject> handle = make_handle(objects[0], 512 << 10);
+                for (size_t i = 0; i < 8; ++i) {
+                    Handle<RegionTestObject> copy = handle;
+                }
+                std::vector<Handle<RegionTestObject>> copies(8, handle);
+                drop_handles(std::span(copies));
+
+                for (size_t i = 0; i < 1000; ++i) {
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+                }
+                CHECK(region.metrics().pressure_start_count == 0);
+
+                // Dropping in bulk counts just the same.
+                std::vector<Handle<RegionTestObject>> handles;
+                handles.push_back(make_handle(objects[1], 4 << 20));
+                drop_handles(std::span(handles));
+
+                const auto deadline = std::chrono::steady_clock::now() + 10s;
+                while ((finalizer.count() < 1) && (std::chrono::steady_clock::now() < deadline)) {
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+                }
+                CHECK(finalizer.count() == 1);
+                CHECK(region.metrics().pressure_start_count > 0);
+            }
+        }
+
+        SECTION("Idle cycles") {
+            Config config;
+            config.cycle_interval_max = 1ms;
+
+            CountingFinalizer finalizer;
+            {
+                Domain domain(config);
+                Region region(domain, finalizer);
+                {
+                    std::vector<Handle<RegionTestObject>> handles;
+                    for (RegionTestObject& object: objects) {
+                        handles.push_back(make_handle(object));
+                    }
+                }
+
+                // Only step when the region is readable, like an event loop would. The domain has
+                // to start cycles by itself for the dropped objects to be reclaimed.
+                while (finalizer.count() < OBJECT_COUNT) {
+                    struct pollfd event = {
+                        .fd      = region.file_descriptor(),
+                        .events  = POLLIN,
+                        .revents = 0,
+                    };
+                    REQUIRE(::poll(&event, 1, 1000) == 1);
+
+                    constexpr bool non_blocking = true;
+                    region.step(non_blocking);
+                }
+            }
+            CHECK(finalizer.count() == OBJECT_COUNT);
+        }
+    }
+}
@@ -0,0 +1,118 @@
+#include "catch.hpp"
+#include "mantle/mantle.h"
+
+using namespace mantle;
+
+namespace {
+
+    struct AllocatorTestObject : Object {
+        explicit AllocatorTestObject(size_t& destroyed_count)
+            : destroyed_count(destroyed_count)
+        {
+        }
+
+        ~AllocatorTestObject() {
+            destroyed_count += 1;
+        }
+
+        size_t& destroyed_count;
+    };
+
+    struct Payload {
+        uint64_t values[10] = {};
+    };
+
+    // The `Object` base isn't at the start of this class.
+    struct LargeAllocatorTestObject : Payload, Object {
+        explicit LargeAllocatorTestObject(size_t& destroyed_count)
+            : destroyed_count(destroyed_count)
+        {
+        }
+
+        ~LargeAllocatorTestObject() {
+            destroyed_count += 1;
+        }
+
+        size_t& destroyed_count;
+    };
+
+    void step_until(Region& region, const RegionAllocator& allocator, size_t finalized_count) {
+        size_t step_count = 0;
+        while (allocator.metrics().finalized_count < finalized_count) {
+            constexpr bool non_blocking = true;
+            region.step(non_blocking);
+
+            step_count += 1;
+            REQUIRE(step_count < 1000000);
+        }
+    }
+
+}
+
+TEST_CASE("RegionAllocator") {
+    SECTION("Size classes") {
+        CHECK(RegionAllocator::size_class<AllocatorTestObject>() == 0);
+        CHECK(RegionAllocator::size_class<LargeAllocatorTestObject>() == 2);
+
+        CHECK(RegionAllocator::slot_size(0) == 32);
+        CHECK(RegionAllocator::slot_size(RegionAllocator::SIZE_CLASS_COUNT - 1) == RegionAllocator::SLAB_SIZE);
+    }
+
+    SECTION("Finalization") {
+        static constexpr size_t OBJECT_COUNT = 64;
+
+        size_t destroyed_count = 0;
+
+        RegionAllocator allocator;
+        {
+            Domain domain;
+            Region region(domain, allocator);
+            {
+                std::vector<Handle<AllocatorTestObject>> small_handles;
+                std::vector<Handle<LargeAllocatorTestObject>> large_handles;
+                for (size_t i = 0; i < OBJECT_COUNT; ++i) {
+                    small_handles.push_back(allocator.make_handle<AllocatorTestObject>(destroyed_count));
+                    large_handles.push_back(allocator.make_handle<LargeAllocatorTestObject>(destroyed_count));
+
+                    CHECK(small_handles.back()->group() == RegionAllocator::size_class<AllocatorTestObject>());
+                    CHECK(large_handles.back()->group() == RegionAllocator::size_class<LargeAllocatorTestObject>());
+                }
+
+                CHECK(allocator.metrics().allocated_count == 2 * OBJECT_COUNT);
+                CHECK(allocator.metrics().slab_count == 2);
+            }
+
+            step_until(region, allocator, 2 * OBJECT_COUNT);
+            CHECK(destroyed_count == 2 * OBJECT_COUNT);
+        }
+        CHECK(allocator.metrics().finalized_count == 2 * OBJECT_COUNT);
+        CHECK(allocator.metrics().allocated_count == 2 * OBJECT_COUNT);
+    }
+
+    SECTION("Slot reuse") {
+        size_t destroyed_count = 0;
+
+        RegionAllocator allocator;
+        {
+            Domain domain;
+            Region region(domain, allocator);
+
+            const void* first = nullptr;
+            {
+                Handle<LargeAllocatorTestObject> handle = allocator.make_handle<LargeAllocatorTestObject>(destroyed_count);
+                first = handle.get();
+            }
+            step_until(region, allocator, 1);
+
+            // The free list hands back the slot that was just released.
+            {
+                Handle<LargeAllocatorTestObject> handle = allocator.make_handle<LargeAllocatorTestObject>(destroyed_count);
+                CHECK(handle.get() == first);
+            }
+            step_until(region, allocator, 2);
+
+            CHECK(allocator.metrics().slab_count == 1);
+        }
+        CHECK(destroyed_count == 2);
+    }
+}
@@ -8,10 +8,11 @@ static void deliver_message(RegionControllerGroup& controllers, RegionId region_
     controllers.at(region_id)->receive_message(message);
 }
 
-static void deliver_start_message(RegionControllerGroup& controllers, RegionId region_id) {
+static void deliver_start_message(RegionControllerGroup& controllers, RegionId region_id, bool urgent = false) {
     Message message = {
         .start = {
-            .type = MessageType::START,
+            .type   = MessageType::START,
+            .urgent = urgent,
         },
     };
 
@@ -25,6 +26,15 @@ static void deliver_submit_message(RegionControllerGroup& controllers, RegionId
             .stop       = false,
             .increments = increments,
             .decrements = decrements,
+            .increment_partition = nullptr,
+            .decrement_partition = nullptr,
+            .increment_spill     = nullptr,
+            .decrement_spill     = nullptr,
+            .barrier             = nullptr,
+            .finalized_count     = 0,
+            .bound_count         = 0,
+            .released_count      = 0,
+            .heap_census         = nullptr,
         },
     };
 
@@ -143,5 +153,84 @@ TEST_CASE("RegionController") {
         // Controllers should have returned to the starting Phase.
         census = RegionControllerCensus(controllers);
         CHECK(census.all(Phase::START));
+
+        // Nothing was submitted, so nothing should have been applied.
+        for (auto&& controller: controllers) {
+            CHECK(controller->metrics().applied_count == 0);
+            CHECK(controller->metrics().applied_objects_per_second() >= 0.0);
+        }
+    }
+
+    SECTION("Tracked census") {
+        RegionControllerCensus tracked;
+        for (auto&& controller: controllers) {
+            controller->track(tracked);
+        }
+        CHECK(tracked == RegionControllerCensus(controllers));
+
+        // Run a whole cycle, checking that the tracked census matches a fresh one at every step.
+        deliver_start_message(controllers, 0);
+        CHECK(tracked == RegionControllerCensus(controllers));
+
+        for (size_t step_count = 0; !tracked.all(Phase::START) || (tracked.min_cycle() == 0); ++step_count) {
+            REQUIRE(step_count < 100);
+
+            CHECK(synchronize(controllers) == tracked);
+
+            for (RegionId region_id = 0; region_id < controllers.size(); ++region_id) {
+                while (controllers[region_id]->send_message()) {
+                    CHECK(tracked == RegionControllerCensus(controllers));
+                }
+
+                if (controllers[region_id]->phase() == Phase::SUBMIT) {
+                    deliver_submit_message(controllers, region_id, increments, decrements);
+                    CHECK(tracked == RegionControllerCensus(controllers));
+                }
+            }
+        }
+
+        CHECK(tracked.min_cycle() == 1);
+        CHECK(tracked.max_cycle() == 1);
+    }
+
+    SECTION("Clusters") {
+        RegionControllerCensus first_cluster;
+        RegionControllerCensus second_cluster;
+        for (RegionId region_id = 0; region_id < controllers.size(); ++region_id) {
+            controllers[region_id]->track((region_id < 2) ? first_cluster : second_cluster);
+        }
+
+        const auto combine = [&]() {
+            RegionControllerCensus combined;
+            combined.add(first_cluster);
+            combined.add(second_cluster);
+            return combined;
+        };
+        CHECK(combine() == RegionControllerCensus(controllers));
+
+        // Nobody has asked for a cycle, so there is nothing to synchronize.
+        CHECK(!can_synchronize(first_cluster, combine()));
+        CHECK(!can_synchronize(second_cluster, combine()));
+
+        // A start in one cluster pulls the other one along.
+        deliver_start_message(controllers, 0);
+        CHECK(combine() == RegionControllerCensus(controllers));
+        CHECK(can_synchronize(first_cluster, combine()));
+        CHECK(can_synchronize(second_cluster, combine()));
+
+        // Urgency is counted where it was asked for, and combined like everything else.
+        deliver_start_message(controllers, 2, true);
+        CHECK(!first_cluster.any_urgent());
+        CHECK(second_cluster.any_urgent());
+        CHECK(combine() == RegionControllerCensus(controllers));
+
+        census = synchronize(controllers);
+        CHECK(census.all(Phase::ENTER));
+        CHECK(!census.any_urgent());
+        CHECK(combine() == census);
+
+        // Everyone has to send before anything can move again.
+        CHECK(!can_synchronize(first_cluster, census));
+        CHECK(!can_synchronize(second_cluster, census));
     }
 }
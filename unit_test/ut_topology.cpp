@@ -0,0 +1,77 @@
+#include "catch.hpp"
+#include "mantle/mantle.h"
+#include <thread>
+#include <vector>
+#include <sched.h>
+
+using namespace mantle;
+
+namespace {
+
+    class NullFinalizer final : public ObjectFinalizer {
+    public:
+        void finalize(ObjectGroup, std::span<Object*>) noexcept override {
+        }
+    };
+
+}
+
+TEST_CASE("Topology") {
+    SECTION("Placement") {
+        // Two small caches on the first node, and a large one on the second.
+        const CpuTopology topology({
+            { .cpus = {8, 9, 10, 11, 12, 13, 14, 15}, .numa_node = 1 },
+            { .cpus = {4, 5, 6, 7},                   .numa_node = 0 },
+            { .cpus = {3, 2, 1, 0},                   .numa_node = 0 },
+            { .cpus = {},                             .numa_node = 0 },
+        });
+        CHECK(topology.cache_groups().size() == 3);
+        CHECK(topology.cache_groups().front().cpus.front() == 0);
+        CHECK(topology.cpu_count() == 16);
+
+        ThreadPlacement placement(topology, 2);
+        CHECK(std::vector(placement.domain_cpus().begin(), placement.domain_cpus().end()) == std::vector<size_t>{14, 15});
+        CHECK(placement.domain_numa_node() == 1);
+
+        // Threads fill the domain's cache first, then move on to the other node.
+        const std::vector<size_t> thread_cpus = {8, 9, 10, 11, 12, 13, 0, 1, 2, 3, 4, 5, 6, 7};
+        CHECK(std::vector(placement.thread_cpus().begin(), placement.thread_cpus().end()) == thread_cpus);
+        for (size_t i = 0; i < 2 * thread_cpus.size(); ++i) {
+            CHECK(placement.next_thread_cpu() == thread_cpus[i % thread_cpus.size()]);
+        }
+    }
+
+    SECTION("Single cpu") {
+        const CpuTopology topology({{ .cpus = {0}, .numa_node = std::nullopt }});
+
+        ThreadPlacement placement(topology, 4);
+        CHECK(placement.domain_cpus().size() == 1);
+        CHECK(placement.next_thread_cpu() == 0);
+        CHECK(placement.next_thread_cpu() == 0);
+    }
+
+    SECTION("Detect") {
+        const CpuTopology topology = CpuTopology::detect();
+        CHECK(topology.cpu_count() > 0);
+
+        Config config;
+        config.topology_placement = true;
+
+        NullFinalizer finalizer;
+        Domain domain(config);
+        REQUIRE(domain.placement());
+
+        // Placing a thread pins it to a single cpu.
+        size_t cpu = 0;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        std::thread([&]() {
+            cpu = domain.placement()->place_thread();
+            Region region(domain, finalizer);
+            sched_getaffinity(0, sizeof(set), &set);
+        }).join();
+
+        CHECK(CPU_COUNT(&set) == 1);
+        CHECK(CPU_ISSET(cpu, &set));
+    }
+}
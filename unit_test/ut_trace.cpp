@@ -0,0 +1,137 @@
+#include "catch.hpp"
+#include "mantle/mantle.h"
+#include <vector>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <atomic>
+
+using namespace mantle;
+
+namespace {
+
+    struct TraceTestObject : Object {
+    };
+
+    class NullFinalizer final : public ObjectFinalizer {
+    public:
+        void finalize(ObjectGroup, std::span<Object*>) noexcept override {
+        }
+    };
+
+}
+
+TEST_CASE("Trace") {
+    SECTION("Ring keeps the most recent events") {
+        TraceRing ring(4);
+        for (uint64_t i = 0; i < 10; ++i) {
+            ring.record(TraceEvent {
+                .timestamp = i,
+                .value     = i,
+                .region_id = 0,
+                .source    = TraceSource::REGION,
+                .type      = TraceEventType::CYCLE,
+                .argument  = 0,
+            });
+        }
+
+        std::vector<TraceEvent> events;
+        ring.snapshot(events);
+        REQUIRE(events.size() == (ring.capacity() - 1));
+        for (size_t i = 0; i < events.size(); ++i) {
+            CHECK(events[i].value == (10 - ring.capacity() + 1 + i));
+        }
+    }
+
+    SECTION("Snapshots while recording") {
+        TraceRing ring(64);
+
+        // Every event is recorded with the same timestamp and value, so a torn one would show.
+        std::atomic_bool done = false;
+        std::thread thread([&]() {
+            for (uint64_t i = 0; i < 1000000; ++i) {
+                ring.record(TraceEvent {
+                    .timestamp = i,
+                    .value     = i,
+                    .region_id = 0,
+                    .source    = TraceSource::REGION,
+                    .type      = TraceEventType::CYCLE,
+                    .argument  = 0,
+                });
+            }
+            done = true;
+        });
+
+        while (!done) {
+            std::vector<TraceEvent> events;
+            ring.snapshot(events);
+            for (size_t i = 0; i < events.size(); ++i) {
+                REQUIRE(events[i].timestamp == events[i].value);
+                if (i != 0) {
+                    REQUIRE(events[i].value == (events[i - 1].value + 1));
+                }
+            }
+        }
+        thread.join();
+    }
+
+    SECTION("Rings are reused by later threads") {
+        static constexpr size_t THREAD_COUNT = 4;
+        static constexpr size_t ROUND_COUNT = 16;
+
+        auto record = []() {
+            TraceRing::thread_local_instance().record(TraceEvent {
+                .timestamp = 0,
+                .value     = 0,
+                .region_id = 0,
+                .source    = TraceSource::REGION,
+                .type      = TraceEventType::CYCLE,
+                .argument  = 0,
+            });
+        };
+
+        // Other threads may already have rings, but none of them are tracing anymore.
+        record();
+        const size_t ring_count = trace_ring_count();
+
+        for (size_t round = 0; round < ROUND_COUNT; ++round) {
+            std::vector<std::thread> threads;
+            for (size_t i = 0; i < THREAD_COUNT; ++i) {
+                threads.emplace_back(record);
+            }
+            for (std::thread& thread: threads) {
+                thread.join();
+            }
+        }
+        CHECK(trace_ring_count() <= (ring_count + THREAD_COUNT));
+    }
+
+    SECTION("Chrome trace export") {
+        NullFinalizer finalizer;
+        TraceTestObject object;
+        {
+            Domain domain;
+            Region region(domain, finalizer);
+            {
+                Handle<TraceTestObject> handle = make_handle(object);
+                Handle<TraceTestObject> copy = handle;
+            }
+        }
+
+        std::vector<TraceEvent> events = collect_trace();
+        CHECK(!events.empty());
+        for (size_t i = 1; i < events.size(); ++i) {
+            CHECK(events[i - 1].timestamp <= events[i].timestamp);
+        }
+
+        std::stringstream stream;
+        write_chrome_trace(stream, events);
+
+        const std::string json = stream.str();
+        CHECK(json.starts_with("{\"traceEvents\":["));
+        CHECK(json.find("\"name\":\"SUBMIT_BARRIER\"") != std::string::npos);
+        CHECK(json.find("\"name\":\"SEND SUBMIT\"") != std::string::npos);
+        CHECK(json.find("\"name\":\"FINALIZE\"") != std::string::npos);
+        CHECK(json.ends_with("]}\n"));
+    }
+}
@@ -0,0 +1,55 @@
+#include "catch.hpp"
+#include "mantle/worker_pool.h"
+#include <vector>
+#include <atomic>
+
+using namespace mantle;
+
+TEST_CASE("WorkerPool") {
+    static constexpr size_t TASK_COUNT = 1000;
+
+    SECTION("Inline") {
+        WorkerPool pool(0);
+        CHECK(pool.worker_count() == 1);
+
+        std::vector<size_t> counts(TASK_COUNT, 0);
+        pool.run(counts.size(), [&](size_t task_index, size_t worker_index) {
+            CHECK(worker_index == 0);
+            counts[task_index] += 1;
+        });
+
+        for (size_t count: counts) {
+            CHECK(count == 1);
+        }
+    }
+
+    SECTION("Helpers") {
+        WorkerPool pool(3);
+        CHECK(pool.worker_count() == 4);
+
+        std::vector<std::atomic<size_t>> counts(TASK_COUNT);
+        for (size_t round = 0; round < 100; ++round) {
+            std::atomic<bool> bad_worker_index = false;
+            pool.run(counts.size(), [&](size_t task_index, size_t worker_index) {
+                if (worker_index >= pool.worker_count()) {
+                    bad_worker_index = true;
+                }
+
+                counts[task_index].fetch_add(1);
+            });
+
+            CHECK(!bad_worker_index);
+        }
+
+        for (const std::atomic<size_t>& count: counts) {
+            CHECK(count.load() == 100);
+        }
+    }
+
+    SECTION("Empty") {
+        WorkerPool pool(2);
+        pool.run(0, [](size_t, size_t) {
+            FAIL("No tasks should run");
+        });
+    }
+}